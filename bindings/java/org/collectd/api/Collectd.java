@@ -175,6 +175,18 @@ public class Collectd
   native public static int registerWrite (String name,
       CollectdWriteInterface object);
 
+  /**
+   * Registers a write callback which receives many value lists per call.
+   * Value lists are passed once the batch buffer is full or the first value
+   * list has been waiting for one interval.
+   *
+   * @return Zero when successful, non-zero otherwise.
+   * @see CollectdWriteBatchInterface
+   * @see ValueListBatch
+   */
+  native public static int registerWriteBatch (String name,
+      CollectdWriteBatchInterface object);
+
   /**
    * Java representation of collectd/src/plugin.h:plugin_register_flush
    *
@@ -64,6 +64,17 @@ public class DataSet
         this._ds = ds;
     }
 
+    /**
+     * Creates a copy of <code>ds</code>, including its data sources.
+     */
+    public DataSet (DataSet ds)
+    {
+        this._type = ds._type;
+        this._ds = new ArrayList<DataSource> (ds._ds.size ());
+        for (DataSource dsrc : ds._ds)
+            this._ds.add (new DataSource (dsrc));
+    }
+
     public void setType (String type)
     {
         this._type = type;
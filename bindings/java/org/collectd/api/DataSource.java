@@ -53,6 +53,14 @@ public class DataSource {
         this._max = max;
     }
 
+    /** Creates a copy of <code>dsrc</code>. */
+    public DataSource (DataSource dsrc) {
+        this._name = dsrc._name;
+        this._type = dsrc._type;
+        this._min = dsrc._min;
+        this._max = dsrc._max;
+    }
+
     /* Needed in parseDataSource below. Other code should use the above
      * constructor or `parseDataSource'. */
     private DataSource () {
@@ -0,0 +1,297 @@
+/**
+ * collectd - bindings/java/org/collectd/api/ValueListBatch.java
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+package org.collectd.api;
+
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.charset.Charset;
+import java.util.HashMap;
+import java.util.Map;
+
+/**
+ * Decoder for a batch of value lists passed to a
+ * {@link CollectdWriteBatchInterface}.
+ *
+ * The value lists are stored in a direct buffer shared with the daemon, which
+ * is reused for the next batch once {@link
+ * CollectdWriteBatchInterface#writeBatch} returns. The batch is read like a
+ * cursor: each call to {@link #next} moves to the following value list,
+ * whose fields are then available through the getters. Strings which are
+ * equal to the ones of the previous value list are not decoded again.
+ *
+ * @see Collectd#registerWriteBatch
+ */
+public class ValueListBatch
+{
+    private static final Charset UTF8 = Charset.forName ("UTF-8");
+
+    private static final int FIELD_HOST            = 0;
+    private static final int FIELD_PLUGIN          = 1;
+    private static final int FIELD_PLUGIN_INSTANCE = 2;
+    private static final int FIELD_TYPE            = 3;
+    private static final int FIELD_TYPE_INSTANCE   = 4;
+    private static final int FIELDS_NUM            = 5;
+
+    /* Size of one value: type (1 byte) and value (8 bytes) */
+    private static final int VALUE_SIZE = 9;
+
+    private final ByteBuffer _buffer;
+    private int _count = 0;
+    private int _index = 0;
+
+    private long _time;
+    private long _interval;
+    private final String[] _strings = new String[FIELDS_NUM];
+    private final byte[][] _bytes = new byte[FIELDS_NUM][];
+    private int _valuesNum;
+    private int _valuesOffset;
+
+    private final Map<String, DataSet> _dataSets =
+        new HashMap<String, DataSet> ();
+
+    /* Created by the daemon, one object per buffer. */
+    ValueListBatch (ByteBuffer buffer)
+    {
+        _buffer = buffer;
+        _buffer.order (ByteOrder.nativeOrder ());
+    }
+
+    /* Called by the daemon before passing a new batch. */
+    void reset (int count, int length)
+    {
+        _buffer.clear ();
+        _buffer.limit (length);
+        _count = count;
+        _index = 0;
+    }
+
+    /**
+     * Returns the number of value lists in this batch.
+     */
+    public int size ()
+    {
+        return (_count);
+    }
+
+    /**
+     * Moves to the next value list.
+     *
+     * @return {@code false} if all value lists have been read.
+     */
+    public boolean next ()
+    {
+        if (_index >= _count)
+            return (false);
+
+        /* skip the values of the previous value list */
+        if (_index > 0)
+            _buffer.position (_valuesOffset + _valuesNum * VALUE_SIZE);
+
+        _time = _buffer.getLong ();
+        _interval = _buffer.getLong ();
+
+        for (int i = 0; i < FIELDS_NUM; i++)
+            readString (i);
+
+        _valuesNum = _buffer.getShort () & 0xffff;
+        _valuesOffset = _buffer.position ();
+
+        _index++;
+        return (true);
+    }
+
+    private void readString (int field)
+    {
+        int length = _buffer.getShort () & 0xffff;
+        int offset = _buffer.position ();
+        byte[] last = _bytes[field];
+
+        _buffer.position (offset + length);
+
+        if ((last != null) && (last.length == length))
+        {
+            int i;
+
+            for (i = 0; i < length; i++)
+                if (_buffer.get (offset + i) != last[i])
+                    break;
+            if (i == length)
+                return;
+        }
+
+        byte[] bytes = new byte[length];
+        for (int i = 0; i < length; i++)
+            bytes[i] = _buffer.get (offset + i);
+
+        _bytes[field] = bytes;
+        _strings[field] = new String (bytes, UTF8);
+    }
+
+    /**
+     * Returns the time (in milliseconds) of the current value list.
+     */
+    public long getTime ()
+    {
+        return (_time);
+    }
+
+    /**
+     * Returns the interval (in milliseconds) of the current value list.
+     */
+    public long getInterval ()
+    {
+        return (_interval);
+    }
+
+    public String getHost ()
+    {
+        return (_strings[FIELD_HOST]);
+    }
+
+    public String getPlugin ()
+    {
+        return (_strings[FIELD_PLUGIN]);
+    }
+
+    public String getPluginInstance ()
+    {
+        return (_strings[FIELD_PLUGIN_INSTANCE]);
+    }
+
+    public String getType ()
+    {
+        return (_strings[FIELD_TYPE]);
+    }
+
+    public String getTypeInstance ()
+    {
+        return (_strings[FIELD_TYPE_INSTANCE]);
+    }
+
+    /**
+     * Returns the number of values of the current value list.
+     */
+    public int getValuesNum ()
+    {
+        return (_valuesNum);
+    }
+
+    /**
+     * Returns the data source type of the {@code i}th value, i.e. one of
+     * {@link DataSource#TYPE_COUNTER}, {@link DataSource#TYPE_GAUGE},
+     * {@link DataSource#TYPE_DERIVE} or {@link DataSource#TYPE_ABSOLUTE}.
+     */
+    public int getValueType (int i)
+    {
+        return (_buffer.get (valueOffset (i)));
+    }
+
+    /**
+     * Returns the {@code i}th value as a double. Integer values are
+     * converted.
+     */
+    public double getDouble (int i)
+    {
+        int offset = valueOffset (i);
+
+        if (_buffer.get (offset) == DataSource.TYPE_GAUGE)
+            return (_buffer.getDouble (offset + 1));
+        return ((double) _buffer.getLong (offset + 1));
+    }
+
+    /**
+     * Returns the {@code i}th value as a long. Gauge values are truncated.
+     */
+    public long getLong (int i)
+    {
+        int offset = valueOffset (i);
+
+        if (_buffer.get (offset) == DataSource.TYPE_GAUGE)
+            return ((long) _buffer.getDouble (offset + 1));
+        return (_buffer.getLong (offset + 1));
+    }
+
+    /**
+     * Returns the {@code i}th value as a {@link Double} for gauges and a
+     * {@link Long} otherwise, just like {@link ValueList#getValues}.
+     */
+    public Number getValue (int i)
+    {
+        int offset = valueOffset (i);
+
+        if (_buffer.get (offset) == DataSource.TYPE_GAUGE)
+            return (Double.valueOf (_buffer.getDouble (offset + 1)));
+        return (Long.valueOf (_buffer.getLong (offset + 1)));
+    }
+
+    private int valueOffset (int i)
+    {
+        if ((i < 0) || (i >= _valuesNum))
+            throw new IndexOutOfBoundsException ("Value " + i + " of "
+                    + _valuesNum);
+        return (_valuesOffset + i * VALUE_SIZE);
+    }
+
+    /**
+     * Returns the data set of the current value list. Data sets are shared by
+     * all value lists of the same type passed to the callback and must not be
+     * modified.
+     */
+    public DataSet getDataSet ()
+    {
+        String type = getType ();
+        DataSet ds = _dataSets.get (type);
+
+        if (ds == null)
+        {
+            ds = Collectd.getDS (type);
+            if (ds != null)
+                _dataSets.put (type, ds);
+        }
+        return (ds);
+    }
+
+    /**
+     * Copies the current value list into a new {@link ValueList} object.
+     */
+    public ValueList toValueList ()
+    {
+        ValueList vl = new ValueList ();
+
+        vl.setHost (getHost ());
+        vl.setPlugin (getPlugin ());
+        vl.setPluginInstance (getPluginInstance ());
+        vl.setType (getType ());
+        vl.setTypeInstance (getTypeInstance ());
+        vl.setTime (_time);
+        vl.setInterval (_interval);
+        DataSet ds = getDataSet ();
+        if (ds != null)
+            vl.setDataSet (new DataSet (ds));
+
+        for (int i = 0; i < _valuesNum; i++)
+            vl.addValue (getValue (i));
+
+        return (vl);
+    }
+} /* class ValueListBatch */
@@ -54,6 +54,7 @@ our %EXPORT_TAGS = (
 			TYPE_INIT
 			TYPE_READ
 			TYPE_WRITE
+			TYPE_WRITE_BATCH
 			TYPE_SHUTDOWN
 			TYPE_LOG
 			TYPE_NOTIF
@@ -121,6 +122,7 @@ my %types = (
 	TYPE_INIT,     "init",
 	TYPE_READ,     "read",
 	TYPE_WRITE,    "write",
+	TYPE_WRITE_BATCH, "write_batch",
 	TYPE_SHUTDOWN, "shutdown",
 	TYPE_LOG,      "log",
 	TYPE_NOTIF,    "notify",
@@ -289,6 +291,9 @@ sub plugin_register {
 		if (TYPE_WRITE == $type) {
 			return plugin_register_write($name, $data);
 		}
+		if (TYPE_WRITE_BATCH == $type) {
+			return plugin_register_write_batch($name, $data);
+		}
 		if (TYPE_LOG == $type) {
 			return plugin_register_log($name, $data);
 		}
@@ -333,7 +338,7 @@ sub plugin_unregister {
 	elsif (TYPE_READ == $type) {
 		return plugin_unregister_read ($name);
 	}
-	elsif (TYPE_WRITE == $type) {
+	elsif ((TYPE_WRITE == $type) || (TYPE_WRITE_BATCH == $type)) {
 		return plugin_unregister_write($name);
 	}
 	elsif (TYPE_LOG == $type) {
@@ -0,0 +1,349 @@
+/**
+ * collectd - src/collectd-gorilla.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils_gorilla.h"
+
+#define DEFAULT_DATADIR PKGLOCALSTATEDIR "/gorilla"
+
+typedef struct {
+  int64_t time;
+  uint32_t series_id;
+  size_t offset;
+} point_t;
+
+typedef struct {
+  gorilla_index_t *idx;
+
+  /* Range scan */
+  _Bool *selected;
+  int64_t begin;
+  int64_t end;
+  point_t *points;
+  size_t points_num;
+  size_t points_alloc;
+  uint64_t *values;
+  size_t values_num;
+  size_t values_alloc;
+
+  /* Statistics, indexed by series id */
+  uint64_t *stat_points;
+  uint64_t *stat_bytes;
+} scan_t;
+
+__attribute__((noreturn)) static void exit_usage(const char *name, int status) {
+  fprintf(
+      (status == 0) ? stdout : stderr,
+      "Usage: %s [options] <identifier>\n"
+      "       %s [options] -l\n\n"
+
+      "Available options:\n"
+      "  -d <dir>     Data directory of the gorilla plugin.\n"
+      "               Default: " DEFAULT_DATADIR "\n"
+      "  -b <time>    Begin of the range, in seconds since the epoch, or\n"
+      "               relative to now if negative. Default: unlimited.\n"
+      "  -e <time>    End of the range, like -b. Default: unlimited.\n"
+      "  -l           List all series, the number of points stored and\n"
+      "               the bytes used on disk.\n"
+
+      "\n  -h           Display this help and exit.\n"
+
+      "\nThe points of the series are printed as comma separated values,\n"
+      "the time followed by the value of each data source. Points still\n"
+      "held in memory by the daemon are written by flushing the plugin:\n\n"
+      "  collectdctl flush plugin=gorilla\n\n",
+      name, name);
+  exit(status);
+} /* void exit_usage */
+
+static int parse_time(char const *str, int64_t *ret) /* {{{ */
+{
+  char *end = NULL;
+
+  errno = 0;
+  double t = strtod(str, &end);
+  if ((errno != 0) || (end == str) || (*end != 0))
+    return -1;
+
+  if (t < 0) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    t += (double)tv.tv_sec + ((double)tv.tv_usec) / 1000000.0;
+  }
+
+  *ret = (int64_t)(t * 1000.0);
+  return 0;
+} /* }}} int parse_time */
+
+static int scan_block(gorilla_block_header_t const *hdr, /* {{{ */
+                      uint8_t const *payload, void *user_data) {
+  scan_t *s = user_data;
+  gorilla_decoder_t d;
+  int64_t time;
+  uint64_t values[GORILLA_VALUES_MAX];
+
+  if (hdr->series_id >= s->idx->header->records_num)
+    return 0;
+
+  if (s->stat_points != NULL) {
+    s->stat_points[hdr->series_id] += hdr->points_num;
+    s->stat_bytes[hdr->series_id] += sizeof(*hdr) + hdr->size;
+    return 0;
+  }
+
+  gorilla_index_record_t const *r = s->idx->records + hdr->series_id;
+  if (!s->selected[hdr->series_id] || (hdr->values_num != r->values_num) ||
+      (hdr->last_time < s->begin) || (hdr->first_time > s->end))
+    return 0;
+
+  int status = gorilla_decoder_init(&d, hdr, payload, r->ds_types);
+  if (status != 0)
+    return status;
+
+  while ((status = gorilla_decoder_next(&d, &time, values)) == 0) {
+    if ((time < s->begin) || (time > s->end))
+      continue;
+
+    if (s->points_num == s->points_alloc) {
+      size_t alloc = (s->points_alloc > 0) ? 2 * s->points_alloc : 1024;
+      point_t *tmp = realloc(s->points, alloc * sizeof(*tmp));
+      if (tmp == NULL) {
+        status = ENOMEM;
+        break;
+      }
+      s->points = tmp;
+      s->points_alloc = alloc;
+    }
+    if (s->values_num + d.values_num > s->values_alloc) {
+      size_t alloc = 2 * (s->values_alloc + d.values_num);
+      uint64_t *tmp = realloc(s->values, alloc * sizeof(*tmp));
+      if (tmp == NULL) {
+        status = ENOMEM;
+        break;
+      }
+      s->values = tmp;
+      s->values_alloc = alloc;
+    }
+
+    s->points[s->points_num] = (point_t){
+        .time = time, .series_id = hdr->series_id, .offset = s->values_num};
+    memcpy(s->values + s->values_num, values,
+           d.values_num * sizeof(*values));
+    s->points_num++;
+    s->values_num += d.values_num;
+  }
+  gorilla_decoder_destroy(&d);
+
+  /* A corrupt block is skipped, running out of memory is not. */
+  return (status == ENOMEM) ? ENOMEM : 0;
+} /* }}} int scan_block */
+
+static int scan_segments(char const *dir, scan_t *s) /* {{{ */
+{
+  uint32_t *seqs = NULL;
+  size_t seqs_num = 0;
+  char path[PATH_MAX];
+
+  int status = gorilla_segment_list(dir, &seqs, &seqs_num);
+  if (status != 0) {
+    fprintf(stderr, "ERROR: Listing segments in %s failed: %s\n", dir,
+            strerror(status));
+    return -1;
+  }
+
+  for (size_t i = 0; i < seqs_num; i++) {
+    gorilla_segment_path(path, sizeof(path), dir, seqs[i]);
+    status = gorilla_segment_read(path, scan_block, s);
+    /* The segment may have been merged in the meantime. */
+    if (status == ENOENT)
+      continue;
+    if (status != 0) {
+      fprintf(stderr, "ERROR: Reading %s failed: %s\n", path,
+              strerror(status));
+      if (status == ENOMEM)
+        break;
+    }
+  }
+
+  free(seqs);
+  return (status == ENOMEM) ? -1 : 0;
+} /* }}} int scan_segments */
+
+static int compare_point(void const *a, void const *b) /* {{{ */
+{
+  point_t const *x = a;
+  point_t const *y = b;
+  return (x->time > y->time) - (x->time < y->time);
+} /* }}} int compare_point */
+
+static void print_point(scan_t const *s, point_t const *p) /* {{{ */
+{
+  gorilla_index_record_t const *r = s->idx->records + p->series_id;
+
+  printf("%.3f", ((double)p->time) / 1000.0);
+  for (size_t i = 0; i < r->values_num; i++) {
+    value_t v;
+    memcpy(&v, s->values + p->offset + i, sizeof(v));
+
+    switch (r->ds_types[i]) {
+    case DS_TYPE_GAUGE:
+      printf(",%.15g", v.gauge);
+      break;
+    case DS_TYPE_DERIVE:
+      printf(",%" PRIi64, v.derive);
+      break;
+    case DS_TYPE_COUNTER:
+      printf(",%llu", (unsigned long long)v.counter);
+      break;
+    case DS_TYPE_ABSOLUTE:
+      printf(",%" PRIu64, v.absolute);
+      break;
+    default:
+      printf(",U");
+    }
+  }
+  printf("\n");
+} /* }}} void print_point */
+
+static int do_list(char const *dir, gorilla_index_t *idx) /* {{{ */
+{
+  size_t n = idx->header->records_num;
+  scan_t s = {
+      .idx = idx,
+      .stat_points = calloc(n + 1, sizeof(uint64_t)),
+      .stat_bytes = calloc(n + 1, sizeof(uint64_t)),
+  };
+
+  if ((s.stat_points == NULL) || (s.stat_bytes == NULL) ||
+      (scan_segments(dir, &s) != 0)) {
+    free(s.stat_points);
+    free(s.stat_bytes);
+    return -1;
+  }
+
+  for (size_t i = 0; i < n; i++)
+    printf("%s %" PRIu64 " %" PRIu64 "\n", idx->records[i].name,
+           s.stat_points[i], s.stat_bytes[i]);
+
+  free(s.stat_points);
+  free(s.stat_bytes);
+  return 0;
+} /* }}} int do_list */
+
+static int do_range(char const *dir, gorilla_index_t *idx, /* {{{ */
+                    char const *name, int64_t begin, int64_t end) {
+  size_t n = idx->header->records_num;
+  scan_t s = {
+      .idx = idx,
+      .selected = calloc(n + 1, sizeof(_Bool)),
+      .begin = begin,
+      .end = end,
+  };
+  _Bool found = 0;
+
+  if (s.selected == NULL)
+    return -1;
+
+  /* A series is continued under a new id if its data set changes. */
+  for (size_t i = 0; i < n; i++) {
+    if (strcmp(name, idx->records[i].name) == 0) {
+      s.selected[i] = 1;
+      found = 1;
+    }
+  }
+  if (!found) {
+    fprintf(stderr, "ERROR: No such series: %s\n", name);
+    free(s.selected);
+    return -1;
+  }
+
+  int status = scan_segments(dir, &s);
+  if (status == 0) {
+    /* Merging segments may briefly leave a block in two segments. */
+    qsort(s.points, s.points_num, sizeof(*s.points), compare_point);
+    for (size_t i = 0; i < s.points_num; i++) {
+      if ((i > 0) && (s.points[i].time == s.points[i - 1].time))
+        continue;
+      print_point(&s, s.points + i);
+    }
+  }
+
+  free(s.selected);
+  free(s.points);
+  free(s.values);
+  return status;
+} /* }}} int do_range */
+
+int main(int argc, char **argv) {
+  char const *dir = DEFAULT_DATADIR;
+  int64_t begin = INT64_MIN;
+  int64_t end = INT64_MAX;
+  _Bool list = 0;
+  char path[PATH_MAX];
+  gorilla_index_t idx;
+
+  while (42) {
+    int opt = getopt(argc, argv, "d:b:e:lh");
+    if (opt == -1)
+      break;
+
+    switch (opt) {
+    case 'd':
+      dir = optarg;
+      break;
+    case 'b':
+    case 'e':
+      if (parse_time(optarg, (opt == 'b') ? &begin : &end) != 0) {
+        fprintf(stderr, "ERROR: Invalid time: %s\n", optarg);
+        exit_usage(argv[0], 1);
+      }
+      break;
+    case 'l':
+      list = 1;
+      break;
+    case 'h':
+      exit_usage(argv[0], 0);
+    default:
+      exit_usage(argv[0], 1);
+    }
+  }
+
+  if (!list && (optind != argc - 1))
+    exit_usage(argv[0], 1);
+
+  snprintf(path, sizeof(path), "%s/%s", dir, GORILLA_INDEX_FILE);
+  int status = gorilla_index_open(&idx, path, /* writable = */ 0);
+  if (status != 0) {
+    fprintf(stderr, "ERROR: Opening %s failed: %s\n", path, strerror(status));
+    return 1;
+  }
+
+  if (list)
+    status = do_list(dir, &idx);
+  else
+    status = do_range(dir, &idx, argv[optind], begin, end);
+
+  gorilla_index_close(&idx);
+  return (status == 0) ? 0 : 1;
+} /* int main */
@@ -33,40 +33,106 @@
 #endif
 
 #include <errno.h>
+#include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "utils_avltree.h"
 #include "utils_heap.h"
 
 #include "collectd/client.h"
 #include "collectd/network.h"
+#include "collectd/network_buffer.h"
+#include "collectd/network_parse.h"
+#include "collectd/server.h"
 
 #define DEF_NUM_HOSTS 1000
 #define DEF_NUM_PLUGINS 20
 #define DEF_NUM_VALUES 100000
 #define DEF_INTERVAL 10.0
+#define DEF_NUM_THREADS 1
+#define DEF_BURST 1
+#define DEF_REPORT_INTERVAL 1.0
+
+/* Upper bound for a single nanosleep(2), so that signals are noticed. */
+#define MAX_SLEEP 0.1
 
 static int conf_num_hosts = DEF_NUM_HOSTS;
 static int conf_num_plugins = DEF_NUM_PLUGINS;
 static int conf_num_values = DEF_NUM_VALUES;
 static double conf_interval = DEF_INTERVAL;
 static const char *conf_destination = NET_DEFAULT_V6_ADDR;
+static _Bool conf_destination_set = 0;
 static const char *conf_service = NET_DEFAULT_PORT;
-
-static lcc_network_t *net;
-
-static c_heap_t *values_heap = NULL;
+static int conf_num_threads = DEF_NUM_THREADS;
+static double conf_rate = 0.0;
+static int conf_burst = DEF_BURST;
+static int conf_packet_size = 0;
+static double conf_duration = 0.0;
+static double conf_report_interval = DEF_REPORT_INTERVAL;
+static lcc_security_level_t conf_security_level = NONE;
+static const char *conf_username = NULL;
+static const char *conf_password = NULL;
+static _Bool conf_sink = 0;
+static _Bool conf_batch = 0;
+
+/* A value list and the state needed to generate its values. The value is a
+ * per-series sequence number and the time is set when sending, so that the
+ * receiving end can determine loss and latency. */
+typedef struct {
+  lcc_value_list_t vl;
+  value_t value;
+  int value_type;
+  double next;
+  uint64_t seq;
+} series_t;
+
+typedef struct {
+  pthread_t thread;
+  lcc_network_t *net;
+
+  series_t **series;
+  size_t series_num;
+  c_heap_t *heap;
+
+  /* Values per second this thread sends in rate mode. */
+  double rate;
+
+  /* Value lists of the current burst if conf_batch is set. */
+  lcc_value_list_t *batch;
+  size_t batch_num;
+
+  pthread_mutex_t lock;
+  uint64_t sent;
+  uint64_t behind;
+} sender_t;
+
+static sender_t *senders = NULL;
+
+/* Sink state, protected by sink_lock. */
+static pthread_mutex_t sink_lock = PTHREAD_MUTEX_INITIALIZER;
+static double sink_now;
+static c_avl_tree_t *sink_series = NULL;
+static double *sink_latencies = NULL;
+static size_t sink_latencies_num = 0;
+static size_t sink_latencies_size = 0;
+static uint64_t sink_received = 0;
+static uint64_t sink_lost = 0;
+static uint64_t sink_reordered = 0;
+static uint64_t sink_duplicates = 0;
 
 static struct sigaction sigint_action;
 static struct sigaction sigterm_action;
 
-static _Bool loop = 1;
+static volatile _Bool loop = 1;
 
 __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
 {
@@ -85,12 +151,27 @@ __attribute__((noreturn)) static void exit_usage(int exit_status) /* {{{ */
       "                   (Default: %s)\n"
       "    -D <port>      Destination port of the network packets.\n"
       "                   (Default: %s)\n"
+      "    -t <number>    Number of sender threads. (Default: %i)\n"
+      "    -r <rate>      Values per second to send in total, regardless of\n"
+      "                   the interval. (Default: one value per interval)\n"
+      "    -b <number>    Values to send back-to-back in rate mode.\n"
+      "                   (Default: %i)\n"
+      "    -s <bytes>     Maximum packet size. (Default: %i)\n"
+      "    -T <seconds>   Stop after this many seconds. (Default: never)\n"
+      "    -R <seconds>   Interval of the reports. (Default: %.3f)\n"
+      "    -l <level>     Security level: none, sign or encrypt.\n"
+      "    -u <user>      Username for signing / encryption.\n"
+      "    -P <password>  Password for signing / encryption.\n"
+      "    -B             Hand each burst to the network code at once.\n"
+      "    -L             Sink mode: Receive values on <dest> and <port> and\n"
+      "                   report throughput, loss and latency.\n"
       "    -h             Print usage information (this output).\n"
       "\n"
       "Copyright (C) 2010-2012  Florian Forster\n"
       "Licensed under the MIT license.\n",
       DEF_NUM_VALUES, DEF_NUM_HOSTS, DEF_NUM_PLUGINS, DEF_INTERVAL,
-      NET_DEFAULT_V6_ADDR, NET_DEFAULT_PORT);
+      NET_DEFAULT_V6_ADDR, NET_DEFAULT_PORT, DEF_NUM_THREADS, DEF_BURST,
+      LCC_NETWORK_BUFFER_SIZE_DEFAULT, DEF_REPORT_INTERVAL);
   exit(exit_status);
 } /* }}} void exit_usage */
 
@@ -122,19 +203,75 @@ static double dtime(void) /* {{{ */
 } /* }}} double dtime */
 #endif
 
+/* Wall clock time, used for the timestamps sent over the wire. Latencies are
+ * only meaningful if sender and sink share a clock or are synchronized. */
+static double wtime(void) /* {{{ */
+{
+  struct timeval tv = {0};
+
+  if (gettimeofday(&tv, /* timezone = */ NULL) != 0)
+    perror("gettimeofday");
+
+  return (double)tv.tv_sec + ((double)tv.tv_usec) / 1e6;
+} /* }}} double wtime */
+
+/* Sleeps until `until' (in dtime() terms) or until a signal is received. */
+static void sleep_until(double until) /* {{{ */
+{
+  double now = dtime();
+
+  while (loop && (now < until)) {
+    double diff = until - now;
+    if (diff > MAX_SLEEP)
+      diff = MAX_SLEEP;
+
+    struct timespec ts = {
+        .tv_sec = (time_t)diff,
+    };
+    ts.tv_nsec = (long)((diff - ((double)ts.tv_sec)) * 1e9);
+
+    nanosleep(&ts, /* remaining = */ NULL);
+    now = dtime();
+  }
+} /* }}} void sleep_until */
+
+/* Returns when the next report is due, taking the duration into account. */
+static double report_deadline(double start, double last_report) /* {{{ */
+{
+  double deadline = last_report + conf_report_interval;
+
+  if ((conf_duration > 0.0) && (deadline > (start + conf_duration)))
+    deadline = start + conf_duration;
+
+  return deadline;
+} /* }}} double report_deadline */
+
 static int compare_time(const void *v0, const void *v1) /* {{{ */
 {
-  const lcc_value_list_t *vl0 = v0;
-  const lcc_value_list_t *vl1 = v1;
+  const series_t *s0 = v0;
+  const series_t *s1 = v1;
 
-  if (vl0->time < vl1->time)
+  if (s0->next < s1->next)
     return -1;
-  else if (vl0->time > vl1->time)
+  else if (s0->next > s1->next)
     return 1;
   else
     return 0;
 } /* }}} int compare_time */
 
+static int compare_double(const void *v0, const void *v1) /* {{{ */
+{
+  double d0 = *(const double *)v0;
+  double d1 = *(const double *)v1;
+
+  if (d0 < d1)
+    return -1;
+  else if (d0 > d1)
+    return 1;
+  else
+    return 0;
+} /* }}} int compare_double */
+
 static int get_boundet_random(int min, int max) /* {{{ */
 {
   int range;
@@ -149,86 +286,518 @@ static int get_boundet_random(int min, int max) /* {{{ */
   return min + ((int)(((double)range) * ((double)random()) / (((double)RAND_MAX) + 1.0)));
 } /* }}} int get_boundet_random */
 
-static lcc_value_list_t *create_value_list(void) /* {{{ */
+static series_t *create_series(void) /* {{{ */
 {
-  lcc_value_list_t *vl;
+  series_t *s;
   int host_num;
 
-  vl = calloc(1, sizeof(*vl));
-  if (vl == NULL) {
-    fprintf(stderr, "calloc failed.\n");
-    return NULL;
-  }
-
-  vl->values = calloc(/* nmemb = */ 1, sizeof(*vl->values));
-  if (vl->values == NULL) {
+  s = calloc(1, sizeof(*s));
+  if (s == NULL) {
     fprintf(stderr, "calloc failed.\n");
-    free(vl);
     return NULL;
   }
 
-  vl->values_types = calloc(/* nmemb = */ 1, sizeof(*vl->values_types));
-  if (vl->values_types == NULL) {
-    fprintf(stderr, "calloc failed.\n");
-    free(vl->values);
-    free(vl);
-    return NULL;
-  }
-
-  vl->values_len = 1;
+  s->vl.values = &s->value;
+  s->vl.values_types = &s->value_type;
+  s->vl.values_len = 1;
 
   host_num = get_boundet_random(0, conf_num_hosts);
 
-  vl->interval = conf_interval;
-  vl->time = 1.0 + dtime() + (host_num % (1 + (int)vl->interval));
+  s->vl.interval = conf_interval;
+  s->next = 1.0 + dtime() + (host_num % (1 + (int)s->vl.interval));
 
   if (get_boundet_random(0, 2) == 0)
-    vl->values_types[0] = LCC_TYPE_GAUGE;
+    s->value_type = LCC_TYPE_GAUGE;
   else
-    vl->values_types[0] = LCC_TYPE_DERIVE;
+    s->value_type = LCC_TYPE_DERIVE;
 
-  snprintf(vl->identifier.host, sizeof(vl->identifier.host), "host%04i",
+  snprintf(s->vl.identifier.host, sizeof(s->vl.identifier.host), "host%04i",
            host_num);
-  snprintf(vl->identifier.plugin, sizeof(vl->identifier.plugin), "plugin%03i",
-           get_boundet_random(0, conf_num_plugins));
-  strncpy(vl->identifier.type,
-          (vl->values_types[0] == LCC_TYPE_GAUGE) ? "gauge" : "derive",
-          sizeof(vl->identifier.type));
-  vl->identifier.type[sizeof(vl->identifier.type) - 1] = 0;
-  snprintf(vl->identifier.type_instance, sizeof(vl->identifier.type_instance),
-           "ti%li", random());
-
-  return vl;
-} /* }}} int create_value_list */
-
-static void destroy_value_list(lcc_value_list_t *vl) /* {{{ */
+  snprintf(s->vl.identifier.plugin, sizeof(s->vl.identifier.plugin),
+           "plugin%03i", get_boundet_random(0, conf_num_plugins));
+  strncpy(s->vl.identifier.type,
+          (s->value_type == LCC_TYPE_GAUGE) ? "gauge" : "derive",
+          sizeof(s->vl.identifier.type));
+  s->vl.identifier.type[sizeof(s->vl.identifier.type) - 1] = 0;
+  snprintf(s->vl.identifier.type_instance,
+           sizeof(s->vl.identifier.type_instance), "ti%li", random());
+
+  return s;
+} /* }}} series_t *create_series */
+
+static void update_value(series_t *s) /* {{{ */
 {
-  if (vl == NULL)
-    return;
+  s->seq++;
+  if (s->value_type == LCC_TYPE_GAUGE)
+    s->value.gauge = (gauge_t)s->seq;
+  else
+    s->value.derive = (derive_t)s->seq;
 
-  free(vl->values);
-  free(vl->values_types);
-  free(vl);
-} /* }}} void destroy_value_list */
+  s->vl.time = wtime();
+} /* }}} void update_value */
 
-static int send_value(lcc_value_list_t *vl) /* {{{ */
+static void send_value(sender_t *snd, series_t *s) /* {{{ */
 {
   int status;
 
-  if (vl->values_types[0] == LCC_TYPE_GAUGE)
-    vl->values[0].gauge =
-        100.0 * ((gauge_t)random()) / (((gauge_t)RAND_MAX) + 1.0);
-  else
-    vl->values[0].derive += (derive_t)get_boundet_random(0, 100);
+  update_value(s);
 
-  status = lcc_network_values_send(net, vl);
+  status = lcc_network_values_send(snd->net, &s->vl);
   if (status != 0)
     fprintf(stderr, "lcc_network_values_send failed with status %i.\n", status);
+} /* }}} void send_value */
+
+static void send_batch(sender_t *snd) /* {{{ */
+{
+  int status;
+
+  if (snd->batch_num == 0)
+    return;
+
+  status = lcc_network_values_send_batch(snd->net, snd->batch, snd->batch_num);
+  if (status != 0)
+    fprintf(stderr, "lcc_network_values_send_batch failed with status %i.\n",
+            status);
+  snd->batch_num = 0;
+} /* }}} void send_batch */
+
+/* Adds the next value of `s' to the batch. The value lists of the batch point
+ * to the values of their series, so a series must not be in a batch twice. */
+static void batch_value(sender_t *snd, series_t *s) /* {{{ */
+{
+  update_value(s);
+  snd->batch[snd->batch_num] = s->vl;
+  snd->batch_num++;
+} /* }}} void batch_value */
+
+/* Sends each value list once per interval. */
+static void sender_interval_loop(sender_t *snd) /* {{{ */
+{
+  while (loop) {
+    series_t *s = c_heap_get_root(snd->heap);
+    if (s == NULL)
+      break;
+
+    if (s->next > dtime()) {
+      /* Don't let values linger in the buffer while we're idle. */
+      if ((s->next - dtime()) > MAX_SLEEP)
+        lcc_network_flush(snd->net);
+      sleep_until(s->next);
+      if (!loop) {
+        c_heap_insert(snd->heap, s);
+        break;
+      }
+    }
+
+    send_value(snd, s);
+    s->next += s->vl.interval;
+    c_heap_insert(snd->heap, s);
+
+    pthread_mutex_lock(&snd->lock);
+    snd->sent++;
+    pthread_mutex_unlock(&snd->lock);
+  }
+} /* }}} void sender_interval_loop */
+
+/* Sends bursts of conf_burst values so that snd->rate values per second are
+ * sent on average, cycling through the value lists. */
+static void sender_rate_loop(sender_t *snd) /* {{{ */
+{
+  double period = ((double)conf_burst) / snd->rate;
+  double next = dtime();
+  size_t index = 0;
+
+  while (loop) {
+    double now = dtime();
+
+    if (next > now) {
+      if ((next - now) > MAX_SLEEP)
+        lcc_network_flush(snd->net);
+      sleep_until(next);
+      continue;
+    }
 
-  vl->time += vl->interval;
+    for (int i = 0; i < conf_burst; i++) {
+      if (!conf_batch)
+        send_value(snd, snd->series[index]);
+      else
+        batch_value(snd, snd->series[index]);
+
+      index = (index + 1) % snd->series_num;
+      if (index == 0)
+        send_batch(snd);
+    }
+    send_batch(snd);
+
+    pthread_mutex_lock(&snd->lock);
+    snd->sent += (uint64_t)conf_burst;
+    if ((now - next) > period)
+      snd->behind++;
+    pthread_mutex_unlock(&snd->lock);
+
+    next += period;
+  }
+} /* }}} void sender_rate_loop */
+
+static void *sender_thread(void *arg) /* {{{ */
+{
+  sender_t *snd = arg;
+
+  if (conf_rate > 0.0)
+    sender_rate_loop(snd);
+  else
+    sender_interval_loop(snd);
+
+  lcc_network_flush(snd->net);
+  return NULL;
+} /* }}} void *sender_thread */
+
+static int sender_init(sender_t *snd) /* {{{ */
+{
+  lcc_server_t *srv;
+
+  pthread_mutex_init(&snd->lock, /* attr = */ NULL);
+
+  snd->heap = c_heap_create(compare_time);
+  if (snd->heap == NULL) {
+    fprintf(stderr, "c_heap_create failed.\n");
+    return -1;
+  }
+
+  snd->net = lcc_network_create();
+  if (snd->net == NULL) {
+    fprintf(stderr, "lcc_network_create failed.\n");
+    return -1;
+  }
+
+  srv = lcc_server_create(snd->net, conf_destination, conf_service);
+  if (srv == NULL) {
+    fprintf(stderr, "lcc_server_create failed.\n");
+    return -1;
+  }
+
+  lcc_server_set_ttl(srv, 42);
+
+  if ((conf_packet_size > 0) &&
+      (lcc_server_set_packet_size(srv, (size_t)conf_packet_size) != 0)) {
+    fprintf(stderr, "lcc_server_set_packet_size(%i) failed.\n",
+            conf_packet_size);
+    return -1;
+  }
+
+  if ((conf_security_level != NONE) &&
+      (lcc_server_set_security_level(srv, conf_security_level, conf_username,
+                                     conf_password) != 0)) {
+    fprintf(stderr, "lcc_server_set_security_level failed.\n");
+    return -1;
+  }
 
   return 0;
-} /* }}} int send_value */
+} /* }}} int sender_init */
+
+static int sender_main(void) /* {{{ */
+{
+  uint64_t last_sent = 0;
+  uint64_t total_sent = 0;
+  uint64_t total_behind = 0;
+  double start;
+  double last_report;
+
+  senders = calloc((size_t)conf_num_threads, sizeof(*senders));
+  if (senders == NULL) {
+    fprintf(stderr, "calloc failed.\n");
+    return -1;
+  }
+
+  for (int i = 0; i < conf_num_threads; i++) {
+    if (sender_init(senders + i) != 0)
+      return -1;
+    senders[i].rate = conf_rate / (double)conf_num_threads;
+    senders[i].series = calloc(
+        (size_t)(conf_num_values / conf_num_threads + 1), sizeof(series_t *));
+    if (senders[i].series == NULL) {
+      fprintf(stderr, "calloc failed.\n");
+      return -1;
+    }
+    if (conf_batch) {
+      senders[i].batch =
+          calloc((size_t)conf_burst, sizeof(*senders[i].batch));
+      if (senders[i].batch == NULL) {
+        fprintf(stderr, "calloc failed.\n");
+        return -1;
+      }
+    }
+  }
+
+  fprintf(stdout, "Creating %i values ... ", conf_num_values);
+  fflush(stdout);
+  for (int i = 0; i < conf_num_values; i++) {
+    sender_t *snd = senders + (i % conf_num_threads);
+    series_t *s;
+
+    s = create_series();
+    if (s == NULL) {
+      fprintf(stderr, "create_series failed.\n");
+      return -1;
+    }
+
+    snd->series[snd->series_num] = s;
+    snd->series_num++;
+    c_heap_insert(snd->heap, s);
+  }
+  fprintf(stdout, "done\n");
+
+  start = dtime();
+  for (int i = 0; i < conf_num_threads; i++) {
+    int status = pthread_create(&senders[i].thread, /* attr = */ NULL,
+                                sender_thread, senders + i);
+    if (status != 0) {
+      fprintf(stderr, "pthread_create failed: %s\n", strerror(status));
+      return -1;
+    }
+  }
+
+  last_report = start;
+  while (loop) {
+    double now;
+
+    sleep_until(report_deadline(start, last_report));
+    now = dtime();
+    if ((conf_duration > 0.0) && ((now - start) >= conf_duration))
+      loop = 0;
+
+    total_sent = 0;
+    total_behind = 0;
+    for (int i = 0; i < conf_num_threads; i++) {
+      pthread_mutex_lock(&senders[i].lock);
+      total_sent += senders[i].sent;
+      total_behind += senders[i].behind;
+      pthread_mutex_unlock(&senders[i].lock);
+    }
+
+    printf("%8.1fs: %10.0f values/s sent, %" PRIu64 " total",
+           now - start, (double)(total_sent - last_sent) / (now - last_report),
+           total_sent);
+    if (conf_rate > 0.0)
+      printf(", %" PRIu64 " bursts behind schedule", total_behind);
+    printf("\n");
+    fflush(stdout);
+
+    last_sent = total_sent;
+    last_report = now;
+  }
+
+  fprintf(stdout, "Shutting down.\n");
+  fflush(stdout);
+
+  total_sent = 0;
+  for (int i = 0; i < conf_num_threads; i++) {
+    sender_t *snd = senders + i;
+
+    pthread_join(snd->thread, /* retval = */ NULL);
+    total_sent += snd->sent;
+
+    for (size_t j = 0; j < snd->series_num; j++)
+      free(snd->series[j]);
+    free(snd->series);
+    free(snd->batch);
+    c_heap_destroy(snd->heap);
+    lcc_network_destroy(snd->net);
+    pthread_mutex_destroy(&snd->lock);
+  }
+  free(senders);
+
+  printf("%" PRIu64 " values have been sent in %.3f seconds.\n", total_sent,
+         dtime() - start);
+  return 0;
+} /* }}} int sender_main */
+
+static int sink_parse(void *payload, size_t payload_size, /* {{{ */
+                      lcc_network_parse_options_t opts) {
+  double now = wtime();
+
+  pthread_mutex_lock(&sink_lock);
+  sink_now = now;
+  pthread_mutex_unlock(&sink_lock);
+
+  return lcc_network_parse(payload, payload_size, opts);
+} /* }}} int sink_parse */
+
+/* Called with every received value list. Uses the value as sequence number to
+ * detect lost and reordered values and the time to determine the latency. */
+static int sink_write(lcc_value_list_t const *vl) /* {{{ */
+{
+  char name[5 * LCC_NAME_LEN];
+  uint64_t seq;
+  uint64_t *last = NULL;
+
+  if (vl->values_len != 1)
+    return 0;
+
+  if (vl->values_types[0] == LCC_TYPE_GAUGE)
+    seq = (uint64_t)vl->values[0].gauge;
+  else
+    seq = (uint64_t)vl->values[0].derive;
+
+  snprintf(name, sizeof(name), "%s/%s-%s/%s-%s", vl->identifier.host,
+           vl->identifier.plugin, vl->identifier.plugin_instance,
+           vl->identifier.type, vl->identifier.type_instance);
+
+  pthread_mutex_lock(&sink_lock);
+
+  sink_received++;
+
+  if (sink_latencies_num >= sink_latencies_size) {
+    size_t size = (sink_latencies_size == 0) ? 1024 : 2 * sink_latencies_size;
+    double *tmp = realloc(sink_latencies, size * sizeof(*sink_latencies));
+    if (tmp != NULL) {
+      sink_latencies = tmp;
+      sink_latencies_size = size;
+    }
+  }
+  if (sink_latencies_num < sink_latencies_size)
+    sink_latencies[sink_latencies_num++] = sink_now - vl->time;
+
+  if (c_avl_get(sink_series, name, (void *)&last) != 0) {
+    char *key = strdup(name);
+    last = malloc(sizeof(*last));
+    if ((key == NULL) || (last == NULL) ||
+        (c_avl_insert(sink_series, key, last) != 0)) {
+      free(key);
+      free(last);
+      pthread_mutex_unlock(&sink_lock);
+      return 0;
+    }
+    /* Sequence numbers start at one. */
+    *last = 0;
+  }
+
+  if (seq > *last) {
+    sink_lost += seq - *last - 1;
+    *last = seq;
+  } else if (seq == *last) {
+    sink_duplicates++;
+  } else {
+    /* Counted as lost when the gap was detected. */
+    sink_reordered++;
+    if (sink_lost > 0)
+      sink_lost--;
+  }
+
+  pthread_mutex_unlock(&sink_lock);
+  return 0;
+} /* }}} int sink_write */
+
+static char const *sink_password(char const *username) /* {{{ */
+{
+  if ((conf_username != NULL) && (strcmp(conf_username, username) != 0))
+    return NULL;
+  return conf_password;
+} /* }}} char const *sink_password */
+
+static void *sink_thread(void *arg) /* {{{ */
+{
+  lcc_listener_t *listener = arg;
+  int status;
+
+  status = lcc_listen_and_write(*listener);
+  fprintf(stderr, "lcc_listen_and_write failed with status %i.\n", status);
+
+  loop = 0;
+  return NULL;
+} /* }}} void *sink_thread */
+
+static int sink_main(void) /* {{{ */
+{
+  lcc_listener_t listener = {
+      .conn = -1,
+      .node = conf_destination_set ? (char *)conf_destination : NULL,
+      .service = (char *)conf_service,
+      .parser = sink_parse,
+      .parse_options =
+          {
+              .writer = sink_write,
+              .password_lookup =
+                  (conf_password != NULL) ? sink_password : NULL,
+              .security_level = conf_security_level,
+          },
+      /* Accept packets of any size the senders may be configured to use. */
+      .buffer_size = UINT16_MAX,
+  };
+  pthread_t thread;
+  uint64_t last_received = 0;
+  double start;
+  double last_report;
+  int status;
+
+  sink_series = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (sink_series == NULL) {
+    fprintf(stderr, "c_avl_create failed.\n");
+    return -1;
+  }
+
+  status = pthread_create(&thread, /* attr = */ NULL, sink_thread, &listener);
+  if (status != 0) {
+    fprintf(stderr, "pthread_create failed: %s\n", strerror(status));
+    return -1;
+  }
+
+  start = dtime();
+  last_report = start;
+  while (loop) {
+    double *latencies;
+    size_t latencies_num;
+    uint64_t received;
+    uint64_t lost;
+    uint64_t reordered;
+    double now;
+
+    sleep_until(report_deadline(start, last_report));
+    now = dtime();
+    if ((conf_duration > 0.0) && ((now - start) >= conf_duration))
+      loop = 0;
+
+    pthread_mutex_lock(&sink_lock);
+    latencies = sink_latencies;
+    latencies_num = sink_latencies_num;
+    sink_latencies = NULL;
+    sink_latencies_num = 0;
+    sink_latencies_size = 0;
+    received = sink_received;
+    lost = sink_lost;
+    reordered = sink_reordered;
+    pthread_mutex_unlock(&sink_lock);
+
+    printf("%8.1fs: %10.0f values/s received, %" PRIu64 " total, %" PRIu64
+           " lost, %" PRIu64 " reordered",
+           now - start, (double)(received - last_received) / (now - last_report),
+           received, lost, reordered);
+    if (latencies_num > 0) {
+      qsort(latencies, latencies_num, sizeof(*latencies), compare_double);
+      printf(", latency p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms",
+             1000.0 * latencies[(size_t)(0.50 * (latencies_num - 1))],
+             1000.0 * latencies[(size_t)(0.90 * (latencies_num - 1))],
+             1000.0 * latencies[(size_t)(0.99 * (latencies_num - 1))],
+             1000.0 * latencies[latencies_num - 1]);
+    }
+    printf("\n");
+    fflush(stdout);
+    free(latencies);
+
+    last_received = received;
+    last_report = now;
+  }
+
+  /* lcc_listen_and_write() does not return, so the thread is not joined. */
+  pthread_mutex_lock(&sink_lock);
+  printf("%" PRIu64 " values from %i value lists have been received, %" PRIu64
+         " lost, %" PRIu64 " reordered, %" PRIu64 " duplicates.\n",
+         sink_received, c_avl_size(sink_series), sink_lost, sink_reordered,
+         sink_duplicates);
+  pthread_mutex_unlock(&sink_lock);
+
+  return 0;
+} /* }}} int sink_main */
 
 static int get_integer_opt(const char *str, int *ret_value) /* {{{ */
 {
@@ -282,7 +851,8 @@ static int read_options(int argc, char **argv) /* {{{ */
 {
   int opt;
 
-  while ((opt = getopt(argc, argv, "n:H:p:i:d:D:h")) != -1) {
+  while ((opt = getopt(argc, argv, "n:H:p:i:d:D:t:r:b:s:T:R:l:u:P:BLh")) !=
+         -1) {
     switch (opt) {
     case 'n':
       get_integer_opt(optarg, &conf_num_values);
@@ -302,123 +872,110 @@ static int read_options(int argc, char **argv) /* {{{ */
 
     case 'd':
       conf_destination = optarg;
+      conf_destination_set = 1;
       break;
 
     case 'D':
       conf_service = optarg;
       break;
 
-    case 'h':
-      exit_usage(EXIT_SUCCESS);
+    case 't':
+      get_integer_opt(optarg, &conf_num_threads);
+      break;
 
-    default:
-      exit_usage(EXIT_FAILURE);
-    } /* switch (opt) */
-  }   /* while (getopt) */
+    case 'r':
+      get_double_opt(optarg, &conf_rate);
+      break;
 
-  return 0;
-} /* }}} int read_options */
+    case 'b':
+      get_integer_opt(optarg, &conf_burst);
+      break;
 
-int main(int argc, char **argv) /* {{{ */
-{
-  double last_time;
-  int values_sent = 0;
+    case 's':
+      get_integer_opt(optarg, &conf_packet_size);
+      break;
 
-  read_options(argc, argv);
+    case 'T':
+      get_double_opt(optarg, &conf_duration);
+      break;
 
-  sigint_action.sa_handler = signal_handler;
-  sigaction(SIGINT, &sigint_action, /* old = */ NULL);
+    case 'R':
+      get_double_opt(optarg, &conf_report_interval);
+      break;
 
-  sigterm_action.sa_handler = signal_handler;
-  sigaction(SIGTERM, &sigterm_action, /* old = */ NULL);
+    case 'l':
+      if (strcasecmp("none", optarg) == 0)
+        conf_security_level = NONE;
+      else if (strcasecmp("sign", optarg) == 0)
+        conf_security_level = SIGN;
+      else if (strcasecmp("encrypt", optarg) == 0)
+        conf_security_level = ENCRYPT;
+      else {
+        fprintf(stderr, "Invalid security level: \"%s\"\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
 
-  values_heap = c_heap_create(compare_time);
-  if (values_heap == NULL) {
-    fprintf(stderr, "c_heap_create failed.\n");
-    exit(EXIT_FAILURE);
-  }
+    case 'u':
+      conf_username = optarg;
+      break;
 
-  net = lcc_network_create();
-  if (net == NULL) {
-    fprintf(stderr, "lcc_network_create failed.\n");
-    exit(EXIT_FAILURE);
-  } else {
-    lcc_server_t *srv;
+    case 'P':
+      conf_password = optarg;
+      break;
 
-    srv = lcc_server_create(net, conf_destination, conf_service);
-    if (srv == NULL) {
-      fprintf(stderr, "lcc_server_create failed.\n");
-      exit(EXIT_FAILURE);
-    }
+    case 'B':
+      conf_batch = 1;
+      break;
 
-    lcc_server_set_ttl(srv, 42);
-#if 0
-    lcc_server_set_security_level (srv, ENCRYPT,
-        "admin", "password1");
-#endif
-  }
+    case 'L':
+      conf_sink = 1;
+      break;
 
-  fprintf(stdout, "Creating %i values ... ", conf_num_values);
-  fflush(stdout);
-  for (int i = 0; i < conf_num_values; i++) {
-    lcc_value_list_t *vl;
+    case 'h':
+      exit_usage(EXIT_SUCCESS);
 
-    vl = create_value_list();
-    if (vl == NULL) {
-      fprintf(stderr, "create_value_list failed.\n");
-      exit(EXIT_FAILURE);
-    }
+    default:
+      exit_usage(EXIT_FAILURE);
+    } /* switch (opt) */
+  }   /* while (getopt) */
 
-    c_heap_insert(values_heap, vl);
+  if ((conf_num_values < 1) || (conf_num_threads < 1) || (conf_burst < 1) ||
+      (conf_interval <= 0.0) || (conf_report_interval <= 0.0) ||
+      (conf_rate < 0.0) || (conf_packet_size < 0) ||
+      (conf_packet_size > LCC_NETWORK_BUFFER_SIZE_MAX)) {
+    fprintf(stderr, "Invalid option value.\n");
+    exit_usage(EXIT_FAILURE);
   }
-  fprintf(stdout, "done\n");
-
-  last_time = 0;
-  while (loop) {
-    lcc_value_list_t *vl = c_heap_get_root(values_heap);
 
-    if (vl == NULL)
-      break;
-
-    if (vl->time != last_time) {
-      printf("%i values have been sent.\n", values_sent);
+  if (conf_num_threads > conf_num_values)
+    conf_num_threads = conf_num_values;
 
-      /* Check if we need to sleep */
-      double now = dtime();
-
-      while (now < vl->time) {
-        double diff = vl->time - now;
-        struct timespec ts = {
-            .tv_sec = (time_t)diff,
-        };
-        ts.tv_nsec = (long)((diff - ((double)ts.tv_sec)) * 1e9);
+  if ((conf_security_level != NONE) &&
+      ((conf_username == NULL) || (conf_password == NULL))) {
+    fprintf(stderr, "Signing and encryption require -u and -P.\n");
+    exit(EXIT_FAILURE);
+  }
 
-        nanosleep(&ts, /* remaining = */ NULL);
-        now = dtime();
+  return 0;
+} /* }}} int read_options */
 
-        if (!loop)
-          break;
-      }
-      last_time = vl->time;
-    }
+int main(int argc, char **argv) /* {{{ */
+{
+  int status;
 
-    send_value(vl);
-    values_sent++;
+  read_options(argc, argv);
 
-    c_heap_insert(values_heap, vl);
-  }
+  sigint_action.sa_handler = signal_handler;
+  sigaction(SIGINT, &sigint_action, /* old = */ NULL);
 
-  fprintf(stdout, "Shutting down.\n");
-  fflush(stdout);
+  sigterm_action.sa_handler = signal_handler;
+  sigaction(SIGTERM, &sigterm_action, /* old = */ NULL);
 
-  while (42) {
-    lcc_value_list_t *vl = c_heap_get_root(values_heap);
-    if (vl == NULL)
-      break;
-    destroy_value_list(vl);
-  }
-  c_heap_destroy(values_heap);
+  if (conf_sink)
+    status = sink_main();
+  else
+    status = sender_main();
 
-  lcc_network_destroy(net);
-  exit(EXIT_SUCCESS);
+  exit((status == 0) ? EXIT_SUCCESS : EXIT_FAILURE);
 } /* }}} int main */
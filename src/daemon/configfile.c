@@ -108,11 +108,19 @@ static cf_global_option_t cf_global_options[] = {
     {"Interval", NULL, 0, NULL},
     {"ReadThreads", NULL, 0, "5"},
     {"WriteThreads", NULL, 0, "5"},
+    {"InitThreads", NULL, 0, "1"},
     {"WriteQueueLimitHigh", NULL, 0, NULL},
     {"WriteQueueLimitLow", NULL, 0, NULL},
+    {"NotificationQueueLimit", NULL, 0, "0"},
+    {"NotificationCoalesceInterval", NULL, 0, "0"},
+    {"NotificationFlapThreshold", NULL, 0, "0"},
+    {"NotificationFlapWindow", NULL, 0, "600"},
     {"Timeout", NULL, 0, "2"},
     {"AutoLoadPlugin", NULL, 0, "false"},
     {"CollectInternalStats", NULL, 0, "false"},
+    {"HistoryRaw", NULL, 0, "0"},
+    {"HistoryTiers", NULL, 0, ""},
+    {"HistoryMaxPoints", NULL, 0, "1024"},
     {"PreCacheChain", NULL, 0, "PreCache"},
     {"PostCacheChain", NULL, 0, "PostCache"},
     {"MaxReadInterval", NULL, 0, "86400"}};
@@ -277,7 +285,17 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
       cf_util_get_cdtime(child, &ctx.flush_interval);
     else if (strcasecmp("FlushTimeout", child->key) == 0)
       cf_util_get_cdtime(child, &ctx.flush_timeout);
-    else {
+    else if (strcasecmp("InitAfter", child->key) == 0) {
+      for (int j = 0; j < child->values_num; j++) {
+        if (child->values[j].type != OCONFIG_TYPE_STRING) {
+          WARNING("The \"InitAfter\" option of plugin \"%s\" requires "
+                  "string arguments.",
+                  name);
+          continue;
+        }
+        plugin_register_init_dependency(name, child->values[j].value.string);
+      }
+    } else {
       WARNING("Ignoring unknown LoadPlugin option \"%s\" "
               "for plugin \"%s\"",
               child->key, ci->values[0].value.string);
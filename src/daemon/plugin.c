@@ -35,11 +35,15 @@
 #include "filter_chain.h"
 #include "plugin.h"
 #include "utils_avltree.h"
+#include "utils_btree.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
 #include "utils_heap.h"
+#include "utils_history.h"
 #include "utils_llist.h"
+#include "utils_notification.h"
 #include "utils_random.h"
+#include "utils_stats.h"
 #include "utils_time.h"
 
 #if HAVE_PTHREAD_NP_H
@@ -47,6 +51,7 @@
 #endif
 
 #include <dlfcn.h>
+#include <sched.h>
 
 /*
  * Private structures
@@ -55,6 +60,12 @@ struct callback_func_s {
   void *cf_callback;
   user_data_t cf_udata;
   plugin_ctx_t cf_ctx;
+  /* Identifier used with stats_record(), plus one. Zero means "not yet
+   * registered", so that calloc(3)ed callbacks need no initialization. */
+  int cf_stats_id;
+  /* Number of callback lists and snapshots referencing the callback, see
+   * plugin_callback_unref(). Not used by read callbacks. */
+  size_t cf_refs;
 };
 typedef struct callback_func_s callback_func_t;
 
@@ -85,29 +96,115 @@ struct write_queue_s {
   write_queue_t *next;
 };
 
+struct notification_entry_s;
+typedef struct notification_entry_s notification_entry_t;
+struct notification_entry_s {
+  notification_t n;
+  plugin_ctx_t ctx;
+  notification_entry_t *next;
+};
+
+/* Queue and thread delivering notifications to one notification callback, so
+ * that a slow callback neither blocks the dispatching thread nor the other
+ * callbacks. */
+struct notification_queue_s {
+  char *name;
+  /* NULL if the callback has been unregistered by itself. */
+  callback_func_t *cf;
+
+  notification_entry_t *head;
+  notification_entry_t *tail;
+  long length;
+  derive_t dropped;
+  c_complain_t complaint;
+
+  _Bool loop;
+  _Bool detached;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+};
+typedef struct notification_queue_s notification_queue_t;
+
 struct flush_callback_s {
   char *name;
   cdtime_t timeout;
 };
 typedef struct flush_callback_s flush_callback_t;
 
+struct init_dependency_s {
+  char *name;
+  char *depends_on;
+};
+typedef struct init_dependency_s init_dependency_t;
+
+#define INIT_PENDING 0
+#define INIT_RUNNING 1
+#define INIT_DONE 2
+struct init_job_s {
+  char *name;
+  callback_func_t *cf;
+  int state;
+};
+typedef struct init_job_s init_job_t;
+
+/* Immutable copy of a callback list, see plugin_callbacks_get(). The keys
+ * are stored behind the entries. */
+struct callback_snapshot_s {
+  size_t refs;
+  size_t entries_num;
+  llentry_t entries[];
+};
+typedef struct callback_snapshot_s callback_snapshot_t;
+
+struct callback_list_s {
+  /* Protected by `callback_lock'. */
+  llist_t *list;
+  /* Copy of `list' for the callers, NULL if the list is empty. Only
+   * accessed atomically. */
+  callback_snapshot_t *snapshot;
+  /* Number of threads taking a reference on `snapshot', indexed by the
+   * parity of `epoch', see plugin_callbacks_synchronize(). */
+  unsigned int epoch;
+  size_t acquiring[2];
+};
+typedef struct callback_list_s callback_list_t;
+
 /*
  * Private variables
  */
 static c_avl_tree_t *plugins_loaded = NULL;
 
-static llist_t *list_init;
-static llist_t *list_write;
-static llist_t *list_flush;
-static llist_t *list_missing;
-static llist_t *list_shutdown;
-static llist_t *list_log;
-static llist_t *list_notification;
+static callback_list_t list_init;
+static callback_list_t list_write;
+static callback_list_t list_flush;
+static callback_list_t list_missing;
+static callback_list_t list_shutdown;
+static callback_list_t list_log;
+static callback_list_t list_notification;
+
+/* Protects the callback lists against concurrent registration, e.g. from
+ * init callbacks running in parallel. The lists are not walked by the
+ * callers: after each change a snapshot is published, which callers
+ * reference with plugin_callbacks_get() without taking this lock. */
+static pthread_mutex_t callback_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static init_dependency_t *init_dependencies = NULL;
+static size_t init_dependencies_num = 0;
+
+/* State of the initialization phase, protected by `init_lock'. */
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t init_cond = PTHREAD_COND_INITIALIZER;
+static callback_snapshot_t *init_callbacks;
+static init_job_t *init_jobs = NULL;
+static size_t init_jobs_num = 0;
+static size_t init_jobs_done = 0;
+static int init_status = 0;
 
 static fc_chain_t *pre_cache_chain = NULL;
 static fc_chain_t *post_cache_chain = NULL;
 
-static c_avl_tree_t *data_sets;
+static c_btree_t *data_sets;
 
 static char *plugindir = NULL;
 
@@ -132,6 +229,16 @@ static pthread_cond_t write_cond = PTHREAD_COND_INITIALIZER;
 static pthread_t *write_threads = NULL;
 static size_t write_threads_num = 0;
 
+/* Notification queues, created when a notification is first delivered to a
+ * callback, and the filter applied to notifications before they are queued.
+ * Both are protected by `notification_lock'. */
+static pthread_mutex_t notification_lock = PTHREAD_MUTEX_INITIALIZER;
+static notification_queue_t **notification_queues = NULL;
+static size_t notification_queues_num = 0;
+static _Bool notification_async = 0;
+static long notification_queue_limit = 0;
+static notification_filter_t *notification_filter = NULL;
+
 static pthread_key_t plugin_ctx_key;
 static _Bool plugin_ctx_key_initialized = 0;
 
@@ -141,6 +248,10 @@ static long write_limit_low = 0;
 static derive_t stats_values_dropped = 0;
 static _Bool record_statistics = 0;
 
+static int pre_cache_chain_stats = -1;
+static int post_cache_chain_stats = -1;
+static int write_lock_stats = -1;
+
 /*
  * Static functions
  */
@@ -153,6 +264,68 @@ static const char *plugin_get_dir(void) {
     return plugindir;
 }
 
+/* Returns the stats ID of `cf', registering it on first use: callbacks are
+ * usually created before statistics are enabled. Callbacks are called from
+ * several threads at once, so `cf_stats_id' is only accessed atomically. If
+ * two threads race to register, the compare-and-swap keeps the first ID;
+ * stats_register() returns the same ID for the same kind and name anyway. */
+static int plugin_stats_id(callback_func_t *cf, /* {{{ */
+                           stats_kind_t kind, const char *name) {
+  int id = __atomic_load_n(&cf->cf_stats_id, __ATOMIC_ACQUIRE);
+  if (id != 0)
+    return id - 1;
+
+  int expected = 0;
+  id = stats_register(kind, name) + 1;
+  if (!__atomic_compare_exchange_n(&cf->cf_stats_id, &expected, id,
+                                   /* weak = */ 0, __ATOMIC_ACQ_REL,
+                                   __ATOMIC_ACQUIRE))
+    id = expected;
+
+  return id - 1;
+} /* }}} int plugin_stats_id */
+
+static int plugin_stats_submit(stats_kind_t kind, const char *name, /* {{{ */
+                               const stats_summary_t *summary,
+                               __attribute__((unused)) void *user_data) {
+  value_list_t vl = VALUE_LIST_INIT;
+  sstrncpy(vl.plugin, "collectd", sizeof(vl.plugin));
+  snprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%s-%s",
+           stats_kind_name(kind), name);
+  vl.interval = plugin_get_interval();
+  vl.values_len = 1;
+
+  sstrncpy(vl.type, "derive", sizeof(vl.type));
+  vl.values = &(value_t){.derive = (derive_t)summary->calls};
+  sstrncpy(vl.type_instance, "calls", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Locks can't fail, only report how long we waited for them. */
+  if (kind != STATS_LOCK) {
+    vl.values = &(value_t){.derive = (derive_t)summary->failures};
+    sstrncpy(vl.type_instance, "failures", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  struct {
+    const char *name;
+    cdtime_t value;
+  } latencies[] = {
+      {"p50", summary->p50}, {"p99", summary->p99}, {"max", summary->max},
+  };
+  sstrncpy(vl.type, "duration", sizeof(vl.type));
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(latencies); i++) {
+    gauge_t g = (summary->interval_calls > 0)
+                    ? CDTIME_T_TO_DOUBLE(latencies[i].value)
+                    : NAN;
+    vl.values = &(value_t){.gauge = g};
+    sstrncpy(vl.type_instance, latencies[i].name, sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  return 0;
+} /* }}} int plugin_stats_submit */
+
 static int plugin_update_internal_statistics(void) { /* {{{ */
   gauge_t copy_write_queue_length = (gauge_t)write_queue_length;
 
@@ -188,6 +361,50 @@ static int plugin_update_internal_statistics(void) { /* {{{ */
   vl.type_instance[0] = 0;
   plugin_dispatch_values(&vl);
 
+  /* Notification queues. Copied first, because dispatching values may
+   * dispatch notifications. */
+  struct {
+    char name[DATA_MAX_NAME_LEN];
+    long length;
+    derive_t dropped;
+  } *queues = NULL;
+  size_t queues_num = 0;
+
+  pthread_mutex_lock(&notification_lock);
+  if (notification_queues_num > 0)
+    queues = calloc(notification_queues_num, sizeof(*queues));
+  if (queues != NULL) {
+    queues_num = notification_queues_num;
+    for (size_t i = 0; i < queues_num; i++) {
+      notification_queue_t *q = notification_queues[i];
+      sstrncpy(queues[i].name, q->name, sizeof(queues[i].name));
+      pthread_mutex_lock(&q->lock);
+      queues[i].length = q->length;
+      queues[i].dropped = q->dropped;
+      pthread_mutex_unlock(&q->lock);
+    }
+  }
+  pthread_mutex_unlock(&notification_lock);
+
+  for (size_t i = 0; i < queues_num; i++) {
+    snprintf(vl.plugin_instance, sizeof(vl.plugin_instance),
+             "notification_queue-%s", queues[i].name);
+
+    vl.values = &(value_t){.gauge = (gauge_t)queues[i].length};
+    sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+    vl.type_instance[0] = 0;
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.derive = queues[i].dropped};
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+  sfree(queues);
+
+  /* Callbacks, filter chains and locks */
+  stats_collect(plugin_stats_submit, /* user_data = */ NULL);
+
   return 0;
 } /* }}} int plugin_update_internal_statistics */
 
@@ -209,30 +426,6 @@ static void destroy_callback(callback_func_t *cf) /* {{{ */
   sfree(cf);
 } /* }}} void destroy_callback */
 
-static void destroy_all_callbacks(llist_t **list) /* {{{ */
-{
-  llentry_t *le;
-
-  if (*list == NULL)
-    return;
-
-  le = llist_head(*list);
-  while (le != NULL) {
-    llentry_t *le_next;
-
-    le_next = le->next;
-
-    sfree(le->key);
-    destroy_callback(le->value);
-    le->value = NULL;
-
-    le = le_next;
-  }
-
-  llist_destroy(*list);
-  *list = NULL;
-} /* }}} void destroy_all_callbacks */
-
 static void destroy_read_heap(void) /* {{{ */
 {
   if (read_heap == NULL)
@@ -252,14 +445,154 @@ static void destroy_read_heap(void) /* {{{ */
   read_heap = NULL;
 } /* }}} void destroy_read_heap */
 
-static int register_callback(llist_t **list, /* {{{ */
-                             const char *name, callback_func_t *cf) {
+/* Drops a reference on `cf' and destroys it when the last one is gone. Must
+ * not hold `callback_lock': free functions may call back into the daemon,
+ * e.g. to log. */
+static void plugin_callback_unref(callback_func_t *cf) /* {{{ */
+{
+  if (cf == NULL)
+    return;
+
+  if (__atomic_sub_fetch(&cf->cf_refs, 1, __ATOMIC_ACQ_REL) == 0)
+    destroy_callback(cf);
+} /* }}} void plugin_callback_unref */
+
+/* Returns a reference on the current snapshot of `cl', or NULL if no
+ * callbacks are registered. The callbacks stay valid until
+ * plugin_callbacks_put() is called, even if they are unregistered meanwhile.
+ * Doesn't take any lock, so that callers like plugin_write() and
+ * plugin_log() don't serialize on `callback_lock'. */
+static callback_snapshot_t *plugin_callbacks_get(callback_list_t *cl) /* {{{ */
+{
+  unsigned int idx = __atomic_load_n(&cl->epoch, __ATOMIC_SEQ_CST) & 1;
+
+  __atomic_add_fetch(&cl->acquiring[idx], 1, __ATOMIC_SEQ_CST);
+  callback_snapshot_t *s = __atomic_load_n(&cl->snapshot, __ATOMIC_SEQ_CST);
+  if (s != NULL)
+    __atomic_add_fetch(&s->refs, 1, __ATOMIC_RELAXED);
+  __atomic_sub_fetch(&cl->acquiring[idx], 1, __ATOMIC_SEQ_CST);
+
+  return s;
+} /* }}} callback_snapshot_t *plugin_callbacks_get */
+
+/* Releases a reference taken with plugin_callbacks_get(). Must not hold
+ * `callback_lock', see plugin_callback_unref(). */
+static void plugin_callbacks_put(callback_snapshot_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+
+  if (__atomic_sub_fetch(&s->refs, 1, __ATOMIC_ACQ_REL) != 0)
+    return;
+
+  for (size_t i = 0; i < s->entries_num; i++)
+    plugin_callback_unref(s->entries[i].value);
+  sfree(s);
+} /* }}} void plugin_callbacks_put */
+
+static _Bool plugin_callbacks_empty(callback_list_t *cl) /* {{{ */
+{
+  return __atomic_load_n(&cl->snapshot, __ATOMIC_RELAXED) == NULL;
+} /* }}} _Bool plugin_callbacks_empty */
+
+/* Waits until all threads that may have read a snapshot pointer replaced
+ * before this call have taken their reference. Each flip of `epoch' lets
+ * new readers count themselves in the other slot, so that the slot waited
+ * for drains. Two flips cover readers that have read `epoch' before an
+ * earlier flip. Must hold `callback_lock'. */
+static void plugin_callbacks_synchronize(callback_list_t *cl) /* {{{ */
+{
+  for (int i = 0; i < 2; i++) {
+    unsigned int idx = __atomic_fetch_add(&cl->epoch, 1, __ATOMIC_SEQ_CST) & 1;
+    while (__atomic_load_n(&cl->acquiring[idx], __ATOMIC_SEQ_CST) != 0)
+      sched_yield();
+  }
+} /* }}} void plugin_callbacks_synchronize */
+
+/* Publishes a new snapshot of `cl->list'. The previous snapshot is returned
+ * in `old': pass it to plugin_callbacks_put() after releasing the lock. Must
+ * hold `callback_lock'. */
+static int plugin_callbacks_publish(callback_list_t *cl, /* {{{ */
+                                    callback_snapshot_t **old) {
+  callback_snapshot_t *s = NULL;
+  size_t num = (cl->list != NULL) ? (size_t)llist_size(cl->list) : 0;
+
+  *old = NULL;
+
+  if (num > 0) {
+    size_t size = sizeof(*s) + num * sizeof(s->entries[0]);
+    for (llentry_t *le = llist_head(cl->list); le != NULL; le = le->next)
+      size += strlen(le->key) + 1;
+
+    s = malloc(size);
+    if (s == NULL)
+      return -1;
+
+    s->refs = 1;
+    s->entries_num = 0;
+
+    char *keys = (char *)(s->entries + num);
+    for (llentry_t *le = llist_head(cl->list); le != NULL; le = le->next) {
+      callback_func_t *cf = le->value;
+      size_t len = strlen(le->key) + 1;
+
+      memcpy(keys, le->key, len);
+      __atomic_add_fetch(&cf->cf_refs, 1, __ATOMIC_RELAXED);
+      s->entries[s->entries_num] = (llentry_t){
+          .key = keys, .value = cf, .next = NULL,
+      };
+      s->entries_num++;
+      keys += len;
+    }
+  }
+
+  *old = __atomic_exchange_n(&cl->snapshot, s, __ATOMIC_SEQ_CST);
+  plugin_callbacks_synchronize(cl);
+  return 0;
+} /* }}} int plugin_callbacks_publish */
+
+static void destroy_all_callbacks(callback_list_t *cl) /* {{{ */
+{
+  pthread_mutex_lock(&callback_lock);
+  llist_t *list = cl->list;
+  cl->list = NULL;
+  callback_snapshot_t *old =
+      __atomic_exchange_n(&cl->snapshot, NULL, __ATOMIC_SEQ_CST);
+  plugin_callbacks_synchronize(cl);
+  pthread_mutex_unlock(&callback_lock);
+
+  plugin_callbacks_put(old);
+
+  if (list == NULL)
+    return;
+
+  for (llentry_t *le = llist_head(list); le != NULL; le = le->next) {
+    sfree(le->key);
+    plugin_callback_unref(le->value);
+    le->value = NULL;
+  }
+
+  llist_destroy(list);
+} /* }}} void destroy_all_callbacks */
+
+/* Stores `cf' as the callback `name' in `cl' or removes that callback if
+ * `cf' is NULL. The previous entry is returned in `old' rather than freed:
+ * pass it to plugin_callback_release() once it is no longer in use. On
+ * failure, `cf' is destroyed. */
+static int replace_callback(callback_list_t *cl, const char *name, /* {{{ */
+                            callback_func_t *cf, llentry_t **old) {
+  callback_snapshot_t *snapshot = NULL;
   llentry_t *le;
-  char *key;
+  int status = 0;
+
+  *old = NULL;
+
+  pthread_mutex_lock(&callback_lock);
 
-  if (*list == NULL) {
-    *list = llist_create();
-    if (*list == NULL) {
+  if ((cl->list == NULL) && (cf != NULL)) {
+    cl->list = llist_create();
+    if (cl->list == NULL) {
+      pthread_mutex_unlock(&callback_lock);
       ERROR("plugin: register_callback: "
             "llist_create failed.");
       destroy_callback(cf);
@@ -267,17 +600,26 @@ static int register_callback(llist_t **list, /* {{{ */
     }
   }
 
-  key = strdup(name);
-  if (key == NULL) {
-    ERROR("plugin: register_callback: strdup failed.");
-    destroy_callback(cf);
-    return -1;
-  }
+  le = (cl->list != NULL) ? llist_search(cl->list, name) : NULL;
+  if (cf == NULL) {
+    if (le == NULL) {
+      pthread_mutex_unlock(&callback_lock);
+      return -1;
+    }
+    llist_remove(cl->list, le);
+    *old = le;
+  } else if (le == NULL) {
+    char *key = strdup(name);
+    if (key == NULL) {
+      pthread_mutex_unlock(&callback_lock);
+      ERROR("plugin: register_callback: strdup failed.");
+      destroy_callback(cf);
+      return -1;
+    }
 
-  le = llist_search(*list, name);
-  if (le == NULL) {
     le = llentry_create(key, cf);
     if (le == NULL) {
+      pthread_mutex_unlock(&callback_lock);
       ERROR("plugin: register_callback: "
             "llentry_create failed.");
       sfree(key);
@@ -285,74 +627,105 @@ static int register_callback(llist_t **list, /* {{{ */
       return -1;
     }
 
-    llist_append(*list, le);
+    llist_append(cl->list, le);
   } else {
-    callback_func_t *old_cf;
+    *old = llentry_create(/* key = */ NULL, le->value);
+    if (*old == NULL) {
+      pthread_mutex_unlock(&callback_lock);
+      ERROR("plugin: register_callback: "
+            "llentry_create failed.");
+      destroy_callback(cf);
+      return -1;
+    }
 
-    old_cf = le->value;
     le->value = cf;
+  }
+
+  /* The list holds the first reference on `cf'. If publishing fails, the
+   * callers keep using the previous snapshot until the next change. */
+  status = plugin_callbacks_publish(cl, &snapshot);
+  pthread_mutex_unlock(&callback_lock);
+
+  if (status != 0)
+    ERROR("plugin: register_callback: "
+          "Publishing the callback list failed.");
+  plugin_callbacks_put(snapshot);
+
+  return status;
+} /* }}} int replace_callback */
+
+static void plugin_callback_release(llentry_t *old) /* {{{ */
+{
+  if (old == NULL)
+    return;
 
+  sfree(old->key);
+  plugin_callback_unref(old->value);
+  llentry_destroy(old);
+} /* }}} void plugin_callback_release */
+
+static int register_callback(callback_list_t *cl, /* {{{ */
+                             const char *name, callback_func_t *cf) {
+  llentry_t *old;
+
+  int status = replace_callback(cl, name, cf, &old);
+  if (old != NULL) {
     WARNING("plugin: register_callback: "
             "a callback named `%s' already exists - "
             "overwriting the old entry!",
             name);
-
-    destroy_callback(old_cf);
-    sfree(key);
+    plugin_callback_release(old);
   }
 
-  return 0;
+  return status;
 } /* }}} int register_callback */
 
-static void log_list_callbacks(llist_t **list, /* {{{ */
+static void log_list_callbacks(callback_list_t *cl, /* {{{ */
                                const char *comment) {
   char *str;
-  int len;
-  int i;
-  llentry_t *le;
-  int n;
+  size_t len = 0;
   char **keys;
 
-  n = llist_size(*list);
-  if (n == 0) {
+  callback_snapshot_t *s = plugin_callbacks_get(cl);
+  if (s == NULL) {
     INFO("%s [none]", comment);
     return;
   }
 
-  keys = calloc(n, sizeof(char *));
+  keys = calloc(s->entries_num, sizeof(char *));
 
   if (keys == NULL) {
     ERROR("%s: failed to allocate memory for list of callbacks", comment);
-
+    plugin_callbacks_put(s);
     return;
   }
 
-  for (le = llist_head(*list), i = 0, len = 0; le != NULL; le = le->next, i++) {
-    keys[i] = le->key;
-    len += strlen(le->key) + 6;
+  for (size_t i = 0; i < s->entries_num; i++) {
+    keys[i] = s->entries[i].key;
+    len += strlen(keys[i]) + 6;
   }
   str = malloc(len + 10);
   if (str == NULL) {
     ERROR("%s: failed to allocate memory for list of callbacks", comment);
   } else {
     *str = '\0';
-    strjoin(str, len, keys, n, "', '");
+    strjoin(str, len, keys, s->entries_num, "', '");
     INFO("%s ['%s']", comment, str);
     sfree(str);
   }
   sfree(keys);
+  plugin_callbacks_put(s);
 } /* }}} void log_list_callbacks */
 
-static int create_register_callback(llist_t **list, /* {{{ */
-                                    const char *name, void *callback,
-                                    user_data_t const *ud) {
+static callback_func_t *create_callback(void *callback, /* {{{ */
+                                        user_data_t const *ud) {
   callback_func_t *cf;
 
   cf = calloc(1, sizeof(*cf));
   if (cf == NULL) {
     free_userdata(ud);
     ERROR("plugin: create_register_callback: calloc failed.");
-    return -1;
+    return NULL;
   }
 
   cf->cf_callback = callback;
@@ -364,29 +737,28 @@ static int create_register_callback(llist_t **list, /* {{{ */
   }
 
   cf->cf_ctx = plugin_get_ctx();
+  cf->cf_refs = 1;
 
-  return register_callback(list, name, cf);
-} /* }}} int create_register_callback */
-
-static int plugin_unregister(llist_t *list, const char *name) /* {{{ */
-{
-  llentry_t *e;
-
-  if (list == NULL)
-    return -1;
+  return cf;
+} /* }}} callback_func_t *create_callback */
 
-  e = llist_search(list, name);
-  if (e == NULL)
+static int create_register_callback(callback_list_t *cl, /* {{{ */
+                                    const char *name, void *callback,
+                                    user_data_t const *ud) {
+  callback_func_t *cf = create_callback(callback, ud);
+  if (cf == NULL)
     return -1;
 
-  llist_remove(list, e);
-
-  sfree(e->key);
-  destroy_callback(e->value);
+  return register_callback(cl, name, cf);
+} /* }}} int create_register_callback */
 
-  llentry_destroy(e);
+static int plugin_unregister(callback_list_t *cl, const char *name) /* {{{ */
+{
+  llentry_t *old;
 
-  return 0;
+  int status = replace_callback(cl, name, /* cf = */ NULL, &old);
+  plugin_callback_release(old);
+  return status;
 } /* }}} int plugin_unregister */
 
 /* plugin_load_file loads the shared object "file" and calls its
@@ -407,11 +779,11 @@ static int plugin_load_file(char const *file, _Bool global) {
              "object.",
              file, dlerror());
 
-    /* This error is printed to STDERR unconditionally. If list_log is NULL,
+    /* This error is printed to STDERR unconditionally. If list_log is empty,
      * plugin_log() will also print to STDERR. We avoid duplicate output by
-     * checking that the list of log handlers, list_log, is not NULL. */
+     * checking that the list of log handlers, list_log, is not empty. */
     fprintf(stderr, "ERROR: %s\n", errbuf);
-    if (list_log != NULL) {
+    if (!plugin_callbacks_empty(&list_log)) {
       ERROR("%s", errbuf);
     }
 
@@ -558,6 +930,10 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
           "%.6f seconds.",
           rf->rf_name, CDTIME_T_TO_DOUBLE(elapsed));
 
+    if (record_statistics)
+      stats_record(plugin_stats_id(&rf->rf_super, STATS_READ, rf->rf_name),
+                   elapsed, status != 0);
+
     DEBUG("plugin_read_thread: Effective interval of the "
           "`%s' plugin is %.3f seconds.",
           rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_effective_interval));
@@ -753,7 +1129,7 @@ static int plugin_write_enqueue(value_list_t const *vl) /* {{{ */
    * value-list later on. */
   q->ctx = plugin_get_ctx();
 
-  pthread_mutex_lock(&write_lock);
+  stats_mutex_lock(&write_lock, write_lock_stats);
 
   if (write_queue_tail == NULL) {
     write_queue_head = q;
@@ -776,7 +1152,7 @@ static value_list_t *plugin_write_dequeue(void) /* {{{ */
   write_queue_t *q;
   value_list_t *vl;
 
-  pthread_mutex_lock(&write_lock);
+  stats_mutex_lock(&write_lock, write_lock_stats);
 
   while (write_loop && (write_queue_head == NULL))
     pthread_cond_wait(&write_cond, &write_lock);
@@ -896,6 +1272,368 @@ static void stop_write_threads(void) /* {{{ */
   }
 } /* }}} void stop_write_threads */
 
+static int plugin_notification_call(callback_func_t *cf, /* {{{ */
+                                    const char *name,
+                                    const notification_t *n) {
+  plugin_notification_cb callback = cf->cf_callback;
+  cdtime_t start = record_statistics ? cdtime() : 0;
+
+  int status = (*callback)(n, &cf->cf_udata);
+  if (record_statistics)
+    stats_record(plugin_stats_id(cf, STATS_NOTIFICATION, name),
+                 cdtime() - start, status != 0);
+
+  if (status != 0) {
+    WARNING("plugin_dispatch_notification: Notification "
+            "callback %s returned %i.",
+            name, status);
+  }
+
+  return status;
+} /* }}} int plugin_notification_call */
+
+static void plugin_notification_queue_free(notification_queue_t *q) /* {{{ */
+{
+  notification_entry_t *e = q->head;
+  while (e != NULL) {
+    notification_entry_t *next = e->next;
+    if (e->n.meta != NULL)
+      plugin_notification_meta_free(e->n.meta);
+    sfree(e);
+    e = next;
+  }
+
+  pthread_mutex_destroy(&q->lock);
+  pthread_cond_destroy(&q->cond);
+  sfree(q->name);
+  sfree(q);
+} /* }}} void plugin_notification_queue_free */
+
+static void *plugin_notification_thread(void *arg) /* {{{ */
+{
+  notification_queue_t *q = arg;
+
+  pthread_mutex_lock(&q->lock);
+  while (42) {
+    while (q->loop && (q->head == NULL))
+      pthread_cond_wait(&q->cond, &q->lock);
+
+    /* Pending notifications are delivered before the thread exits. */
+    notification_entry_t *e = q->head;
+    if (e == NULL)
+      break;
+
+    q->head = e->next;
+    if (q->head == NULL)
+      q->tail = NULL;
+    q->length--;
+    callback_func_t *cf = q->cf;
+    pthread_mutex_unlock(&q->lock);
+
+    if (cf != NULL) {
+      (void)plugin_set_ctx(e->ctx);
+      plugin_notification_call(cf, q->name, &e->n);
+    }
+
+    if (e->n.meta != NULL)
+      plugin_notification_meta_free(e->n.meta);
+    sfree(e);
+
+    pthread_mutex_lock(&q->lock);
+  }
+  _Bool detached = q->detached;
+  pthread_mutex_unlock(&q->lock);
+
+  if (detached)
+    plugin_notification_queue_free(q);
+
+  pthread_exit(NULL);
+  return (void *)0;
+} /* }}} void *plugin_notification_thread */
+
+/* Messages about the notification queues, collected while holding
+ * `notification_lock' and logged once it has been released, since a log
+ * callback may dispatch notifications itself. */
+typedef struct {
+  char **errors;
+  size_t errors_num;
+  char **warnings;
+  size_t warnings_num;
+  char **notices;
+  size_t notices_num;
+} notification_reports_t;
+
+static void plugin_notification_reports_log(notification_reports_t *r) /* {{{ */
+{
+  for (size_t i = 0; i < r->errors_num; i++)
+    ERROR("%s", r->errors[i]);
+  for (size_t i = 0; i < r->warnings_num; i++)
+    WARNING("%s", r->warnings[i]);
+  for (size_t i = 0; i < r->notices_num; i++)
+    INFO("%s", r->notices[i]);
+
+  strarray_free(r->errors, r->errors_num);
+  strarray_free(r->warnings, r->warnings_num);
+  strarray_free(r->notices, r->notices_num);
+} /* }}} void plugin_notification_reports_log */
+
+/* Returns the queue of the notification callback `name', starting its thread
+ * if necessary. Must be called with `notification_lock' held. Failures are
+ * added to `r'. */
+static notification_queue_t * /* {{{ */
+plugin_notification_queue_get(const char *name, callback_func_t *cf,
+                              notification_reports_t *r) {
+  char message[256];
+
+
+  for (size_t i = 0; i < notification_queues_num; i++)
+    if (strcmp(name, notification_queues[i]->name) == 0)
+      return notification_queues[i];
+
+  notification_queue_t **tmp =
+      realloc(notification_queues,
+              (notification_queues_num + 1) * sizeof(*notification_queues));
+  if (tmp == NULL)
+    return NULL;
+  notification_queues = tmp;
+
+  notification_queue_t *q = calloc(1, sizeof(*q));
+  if (q == NULL)
+    return NULL;
+
+  q->name = strdup(name);
+  if (q->name == NULL) {
+    sfree(q);
+    return NULL;
+  }
+  q->cf = cf;
+  C_COMPLAIN_INIT(&q->complaint);
+  q->loop = 1;
+  pthread_mutex_init(&q->lock, /* attr = */ NULL);
+  pthread_cond_init(&q->cond, /* attr = */ NULL);
+
+  int status = pthread_create(&q->thread, /* attr = */ NULL,
+                              plugin_notification_thread, q);
+  if (status != 0) {
+    snprintf(message, sizeof(message),
+             "plugin: Starting the notification thread for %s failed with "
+             "status %i (%s).",
+             name, status, STRERROR(status));
+    strarray_add(&r->errors, &r->errors_num, message);
+    plugin_notification_queue_free(q);
+    return NULL;
+  }
+
+  char thread_name[THREAD_NAME_MAX];
+  snprintf(thread_name, sizeof(thread_name), "notify#%" PRIsz,
+           notification_queues_num);
+  set_thread_name(q->thread, thread_name);
+
+  notification_queues[notification_queues_num] = q;
+  notification_queues_num++;
+  return q;
+} /* }}} notification_queue_t *plugin_notification_queue_get */
+
+/* Must be called with `notification_lock' held, which also serializes the
+ * updates of `q->complaint'. Messages are added to `r'. */
+static int plugin_notification_enqueue(notification_queue_t *q, /* {{{ */
+                                       const notification_t *n,
+                                       plugin_ctx_t ctx,
+                                       notification_reports_t *r) {
+  char message[256];
+
+  notification_entry_t *e = calloc(1, sizeof(*e));
+  if (e == NULL)
+    return ENOMEM;
+
+  e->n = *n;
+  e->n.meta = NULL;
+  plugin_notification_meta_copy(&e->n, n);
+  e->ctx = ctx;
+
+  pthread_mutex_lock(&q->lock);
+  if (q->length >= notification_queue_limit) {
+    q->dropped++;
+    pthread_mutex_unlock(&q->lock);
+
+    if (c_complain_check(&q->complaint)) {
+      snprintf(message, sizeof(message),
+               "plugin: The notification queue of %s is full, dropping "
+               "notifications.",
+               q->name);
+      strarray_add(&r->warnings, &r->warnings_num, message);
+    }
+    if (e->n.meta != NULL)
+      plugin_notification_meta_free(e->n.meta);
+    sfree(e);
+    return ENOBUFS;
+  }
+
+  if (q->tail == NULL)
+    q->head = e;
+  else
+    q->tail->next = e;
+  q->tail = e;
+  q->length++;
+  long length = q->length;
+
+  pthread_cond_signal(&q->cond);
+  pthread_mutex_unlock(&q->lock);
+
+  /* Only report recovery once the queue has drained, not each time the queue
+   * accepts a notification after dropping one. */
+  if ((length <= notification_queue_limit / 2) &&
+      c_release_check(&q->complaint)) {
+    snprintf(message, sizeof(message),
+             "plugin: The notification queue of %s accepts notifications "
+             "again.",
+             q->name);
+    strarray_add(&r->notices, &r->notices_num, message);
+  }
+  return 0;
+} /* }}} int plugin_notification_enqueue */
+
+/* Stops the thread of `q', which delivers all pending notifications first,
+ * and frees `q'. */
+static void plugin_notification_queue_stop(notification_queue_t *q) /* {{{ */
+{
+  pthread_mutex_lock(&q->lock);
+  q->loop = 0;
+  pthread_cond_signal(&q->cond);
+
+  /* The callback unregistered itself: it must not be called again and the
+   * thread cannot join itself. */
+  if (pthread_equal(q->thread, pthread_self())) {
+    q->cf = NULL;
+    q->detached = 1;
+    pthread_mutex_unlock(&q->lock);
+    pthread_detach(q->thread);
+    return;
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  if (pthread_join(q->thread, NULL) != 0)
+    ERROR("plugin: Stopping the notification thread of %s failed.", q->name);
+  plugin_notification_queue_free(q);
+} /* }}} void plugin_notification_queue_stop */
+
+/* Replaces the notification callback `name' by `cf' or removes it if `cf' is
+ * NULL. The callback's queue is removed together with the list entry, so
+ * that plugin_notification_deliver() cannot create a new queue for the old
+ * callback in between. The old callback is freed once its queue has been
+ * stopped. */
+static int plugin_notification_set(const char *name, /* {{{ */
+                                   callback_func_t *cf) {
+  notification_queue_t *q = NULL;
+  llentry_t *old;
+
+  pthread_mutex_lock(&notification_lock);
+  for (size_t i = 0; i < notification_queues_num; i++) {
+    if (strcmp(name, notification_queues[i]->name) == 0) {
+      q = notification_queues[i];
+      notification_queues[i] = notification_queues[notification_queues_num - 1];
+      notification_queues_num--;
+      break;
+    }
+  }
+  int status = replace_callback(&list_notification, name, cf, &old);
+  pthread_mutex_unlock(&notification_lock);
+
+  /* Not holding the lock: the callback may dispatch notifications itself. */
+  if (q != NULL)
+    plugin_notification_queue_stop(q);
+
+  if ((old != NULL) && (cf != NULL))
+    WARNING("plugin: register_callback: "
+            "a callback named `%s' already exists - "
+            "overwriting the old entry!",
+            name);
+  plugin_callback_release(old);
+
+  return status;
+} /* }}} int plugin_notification_set */
+
+static void stop_notification_threads(void) /* {{{ */
+{
+  pthread_mutex_lock(&notification_lock);
+  notification_queue_t **queues = notification_queues;
+  size_t queues_num = notification_queues_num;
+  notification_queues = NULL;
+  notification_queues_num = 0;
+  notification_async = 0;
+  pthread_mutex_unlock(&notification_lock);
+
+  if (queues_num > 0)
+    INFO("collectd: Stopping %" PRIsz " notification threads.", queues_num);
+
+  for (size_t i = 0; i < queues_num; i++)
+    plugin_notification_queue_stop(queues[i]);
+  sfree(queues);
+} /* }}} void stop_notification_threads */
+
+/* Passes `n' on to all notification callbacks, either by queueing it or, if
+ * the queues are disabled or not running, by calling them directly. */
+static void plugin_notification_deliver(const notification_t *n) /* {{{ */
+{
+  pthread_mutex_lock(&notification_lock);
+  callback_snapshot_t *s = plugin_callbacks_get(&list_notification);
+  if (s == NULL) {
+    pthread_mutex_unlock(&notification_lock);
+    return;
+  }
+
+  if (notification_async) {
+    plugin_ctx_t ctx = plugin_get_ctx();
+    notification_reports_t reports = {0};
+
+    for (size_t i = 0; i < s->entries_num; i++) {
+      llentry_t *le = s->entries + i;
+      notification_queue_t *q =
+          plugin_notification_queue_get(le->key, le->value, &reports);
+      if (q == NULL) {
+        char message[256];
+        snprintf(message, sizeof(message),
+                 "plugin: Creating the notification queue of %s failed. "
+                 "Dropping the notification.",
+                 le->key);
+        strarray_add(&reports.errors, &reports.errors_num, message);
+        continue;
+      }
+      plugin_notification_enqueue(q, n, ctx, &reports);
+    }
+
+    pthread_mutex_unlock(&notification_lock);
+    plugin_callbacks_put(s);
+    plugin_notification_reports_log(&reports);
+    return;
+  }
+  pthread_mutex_unlock(&notification_lock);
+
+  /* do not switch plugin context; rather keep the context
+   * (interval) information of the calling plugin */
+  for (size_t i = 0; i < s->entries_num; i++)
+    plugin_notification_call(s->entries[i].value, s->entries[i].key, n);
+  plugin_callbacks_put(s);
+} /* }}} void plugin_notification_deliver */
+
+/* Passes on the notifications held back while flapping, once the state has
+ * settled. Called periodically from the main loop. */
+static void plugin_notification_expire(void) /* {{{ */
+{
+  notification_t *released = NULL;
+  size_t released_num = 0;
+
+  pthread_mutex_lock(&notification_lock);
+  if (notification_filter != NULL)
+    notification_filter_expire(notification_filter, cdtime(), &released,
+                               &released_num);
+  pthread_mutex_unlock(&notification_lock);
+
+  for (size_t i = 0; i < released_num; i++)
+    plugin_notification_deliver(released + i);
+  sfree(released);
+} /* }}} void plugin_notification_expire */
+
 /*
  * Public functions
  */
@@ -924,16 +1662,13 @@ static _Bool plugin_is_loaded(char const *name) {
   return status == 0;
 }
 
-static int plugin_mark_loaded(char const *name) {
-  char *name_copy;
+/* Takes ownership of `name', which is also used as the name of the plugin's
+ * context and therefore kept until shutdown. */
+static int plugin_mark_loaded(char *name) {
   int status;
 
-  name_copy = strdup(name);
-  if (name_copy == NULL)
-    return ENOMEM;
-
   status = c_avl_insert(plugins_loaded,
-                        /* key = */ name_copy, /* value = */ NULL);
+                        /* key = */ name, /* value = */ NULL);
   return status;
 }
 
@@ -1003,6 +1738,16 @@ int plugin_load(char const *plugin_name, _Bool global) {
     return -1;
   }
 
+  /* Callbacks remember the context they have been registered in. Its name
+   * identifies the plugin they belong to. */
+  plugin_ctx_t ctx = plugin_get_ctx();
+  ctx.name = strdup(plugin_name);
+  if (ctx.name == NULL) {
+    ERROR("plugin_load: strdup failed.");
+    closedir(dh);
+    return -1;
+  }
+
   while ((de = readdir(dh)) != NULL) {
     if (strcasecmp(de->d_name, typename))
       continue;
@@ -1022,10 +1767,13 @@ int plugin_load(char const *plugin_name, _Bool global) {
       continue;
     }
 
+    plugin_ctx_t old_ctx = plugin_set_ctx(ctx);
     status = plugin_load_file(filename, global);
+    plugin_set_ctx(old_ctx);
     if (status == 0) {
       /* success */
-      plugin_mark_loaded(plugin_name);
+      plugin_mark_loaded(ctx.name);
+      ctx.name = NULL;
       ret = 0;
       INFO("plugin_load: plugin \"%s\" successfully loaded.", plugin_name);
       break;
@@ -1037,6 +1785,7 @@ int plugin_load(char const *plugin_name, _Bool global) {
   }
 
   closedir(dh);
+  sfree(ctx.name);
 
   if (filename[0] == 0)
     ERROR("plugin_load: Could not find plugin \"%s\" in %s", plugin_name, dir);
@@ -1063,6 +1812,43 @@ int plugin_register_init(const char *name, int (*callback)(void)) {
   return create_register_callback(&list_init, name, (void *)callback, NULL);
 } /* plugin_register_init */
 
+int plugin_register_init_dependency(const char *name, /* {{{ */
+                                    const char *depends_on) {
+  if ((name == NULL) || (depends_on == NULL))
+    return EINVAL;
+
+  if (strcmp(name, depends_on) == 0) {
+    WARNING("plugin_register_init_dependency: Plugin `%s' can't depend on "
+            "itself.",
+            name);
+    return EINVAL;
+  }
+
+  for (size_t i = 0; i < init_dependencies_num; i++)
+    if ((strcmp(init_dependencies[i].name, name) == 0) &&
+        (strcmp(init_dependencies[i].depends_on, depends_on) == 0))
+      return 0;
+
+  init_dependency_t *tmp =
+      realloc(init_dependencies,
+              (init_dependencies_num + 1) * sizeof(*init_dependencies));
+  if (tmp == NULL)
+    return ENOMEM;
+  init_dependencies = tmp;
+
+  init_dependency_t *dep = init_dependencies + init_dependencies_num;
+  dep->name = strdup(name);
+  dep->depends_on = strdup(depends_on);
+  if ((dep->name == NULL) || (dep->depends_on == NULL)) {
+    sfree(dep->name);
+    sfree(dep->depends_on);
+    return ENOMEM;
+  }
+
+  init_dependencies_num++;
+  return 0;
+} /* }}} int plugin_register_init_dependency */
+
 static int plugin_compare_read_func(const void *arg0, const void *arg1) {
   const read_func_t *rf0;
   const read_func_t *rf1;
@@ -1318,7 +2104,7 @@ static void plugin_free_data_sets(void) {
   if (data_sets == NULL)
     return;
 
-  while (c_avl_pick(data_sets, &key, &value) == 0) {
+  while (c_btree_pick(data_sets, &key, &value) == 0) {
     data_set_t *ds = value;
     /* key is a pointer to ds->type */
 
@@ -1326,18 +2112,18 @@ static void plugin_free_data_sets(void) {
     sfree(ds);
   }
 
-  c_avl_destroy(data_sets);
+  c_btree_destroy(data_sets);
   data_sets = NULL;
 } /* void plugin_free_data_sets */
 
 int plugin_register_data_set(const data_set_t *ds) {
   data_set_t *ds_copy;
 
-  if ((data_sets != NULL) && (c_avl_get(data_sets, ds->type, NULL) == 0)) {
+  if ((data_sets != NULL) && (c_btree_get(data_sets, ds->type, NULL) == 0)) {
     NOTICE("Replacing DS `%s' with another version.", ds->type);
     plugin_unregister_data_set(ds->type);
   } else if (data_sets == NULL) {
-    data_sets = c_avl_create((int (*)(const void *, const void *))strcmp);
+    data_sets = c_btree_create(/* compare = */ NULL);
     if (data_sets == NULL)
       return -1;
   }
@@ -1356,7 +2142,7 @@ int plugin_register_data_set(const data_set_t *ds) {
   for (size_t i = 0; i < ds->ds_num; i++)
     memcpy(ds_copy->ds + i, ds->ds + i, sizeof(data_source_t));
 
-  return c_avl_insert(data_sets, (void *)ds_copy->type, (void *)ds_copy);
+  return c_btree_insert(data_sets, (void *)ds_copy->type, (void *)ds_copy);
 } /* int plugin_register_data_set */
 
 int plugin_register_log(const char *name, plugin_log_cb callback,
@@ -1367,8 +2153,11 @@ int plugin_register_log(const char *name, plugin_log_cb callback,
 int plugin_register_notification(const char *name,
                                  plugin_notification_cb callback,
                                  user_data_t const *ud) {
-  return create_register_callback(&list_notification, name, (void *)callback,
-                                  ud);
+  callback_func_t *cf = create_callback((void *)callback, ud);
+  if (cf == NULL)
+    return -1;
+
+  return plugin_notification_set(name, cf);
 } /* int plugin_register_log */
 
 int plugin_unregister_config(const char *name) {
@@ -1382,7 +2171,7 @@ int plugin_unregister_complex_config(const char *name) {
 } /* int plugin_unregister_complex_config */
 
 int plugin_unregister_init(const char *name) {
-  return plugin_unregister(list_init, name);
+  return plugin_unregister(&list_init, name);
 }
 
 int plugin_unregister_read(const char *name) /* {{{ */
@@ -1485,7 +2274,7 @@ int plugin_unregister_read_group(const char *group) /* {{{ */
 } /* }}} int plugin_unregister_read_group */
 
 int plugin_unregister_write(const char *name) {
-  return plugin_unregister(list_write, name);
+  return plugin_unregister(&list_write, name);
 }
 
 int plugin_unregister_flush(const char *name) {
@@ -1501,15 +2290,15 @@ int plugin_unregister_flush(const char *name) {
     }
   }
 
-  return plugin_unregister(list_flush, name);
+  return plugin_unregister(&list_flush, name);
 }
 
 int plugin_unregister_missing(const char *name) {
-  return plugin_unregister(list_missing, name);
+  return plugin_unregister(&list_missing, name);
 }
 
 int plugin_unregister_shutdown(const char *name) {
-  return plugin_unregister(list_shutdown, name);
+  return plugin_unregister(&list_shutdown, name);
 }
 
 int plugin_unregister_data_set(const char *name) {
@@ -1518,7 +2307,7 @@ int plugin_unregister_data_set(const char *name) {
   if (data_sets == NULL)
     return -1;
 
-  if (c_avl_remove(data_sets, name, NULL, (void *)&ds) != 0)
+  if (c_btree_remove(data_sets, name, NULL, (void *)&ds) != 0)
     return -1;
 
   sfree(ds->ds);
@@ -1528,32 +2317,282 @@ int plugin_unregister_data_set(const char *name) {
 } /* int plugin_unregister_data_set */
 
 int plugin_unregister_log(const char *name) {
-  return plugin_unregister(list_log, name);
+  return plugin_unregister(&list_log, name);
 }
 
 int plugin_unregister_notification(const char *name) {
-  return plugin_unregister(list_notification, name);
+  return plugin_notification_set(name, /* cf = */ NULL);
 }
 
+static init_job_t *plugin_init_job_find(const char *name) /* {{{ */
+{
+  for (size_t i = 0; i < init_jobs_num; i++)
+    if (strcmp(init_jobs[i].name, name) == 0)
+      return init_jobs + i;
+
+  return NULL;
+} /* }}} init_job_t *plugin_init_job_find */
+
+/* Returns true if all init callbacks `job' depends on have returned.
+ * Dependencies on plugins without an init callback are always satisfied. */
+static _Bool plugin_init_job_ready(init_job_t const *job) /* {{{ */
+{
+  for (size_t i = 0; i < init_dependencies_num; i++) {
+    if (strcmp(init_dependencies[i].name, job->name) != 0)
+      continue;
+
+    init_job_t *dep = plugin_init_job_find(init_dependencies[i].depends_on);
+    if ((dep != NULL) && (dep->state != INIT_DONE))
+      return 0;
+  }
+
+  return 1;
+} /* }}} _Bool plugin_init_job_ready */
+
+/* Returns the next init callback to run in configuration order, or NULL if
+ * all remaining callbacks wait for a running one. Must hold `init_lock'. */
+static init_job_t *plugin_init_job_next(void) /* {{{ */
+{
+  init_job_t *first_pending = NULL;
+  _Bool running = 0;
+
+  for (size_t i = 0; i < init_jobs_num; i++) {
+    init_job_t *job = init_jobs + i;
+
+    if (job->state == INIT_RUNNING)
+      running = 1;
+    if (job->state != INIT_PENDING)
+      continue;
+    if (first_pending == NULL)
+      first_pending = job;
+    if (plugin_init_job_ready(job))
+      return job;
+  }
+
+  /* Nothing is running that could satisfy the remaining dependencies, so
+   * they must be circular. */
+  if ((first_pending != NULL) && !running) {
+    WARNING("plugin: The init dependencies of plugin `%s' are circular. "
+            "Ignoring them.",
+            first_pending->name);
+    return first_pending;
+  }
+
+  return NULL;
+} /* }}} init_job_t *plugin_init_job_next */
+
+static int plugin_init_job_run(init_job_t *job) /* {{{ */
+{
+  plugin_ctx_t old_ctx = plugin_set_ctx(job->cf->cf_ctx);
+  plugin_init_cb callback = job->cf->cf_callback;
+
+  cdtime_t start = cdtime();
+  int status = (*callback)();
+  cdtime_t elapsed = cdtime() - start;
+
+  plugin_set_ctx(old_ctx);
+
+  INFO("plugin: Initialization of plugin `%s' took %.3f seconds.", job->name,
+       CDTIME_T_TO_DOUBLE(elapsed));
+
+  if (status != 0) {
+    ERROR("Initialization of plugin `%s' "
+          "failed with status %i. "
+          "Plugin will be unloaded.",
+          job->name, status);
+    /* Plugins that register read callbacks from the init
+     * callback should take care of appropriate error
+     * handling themselves. */
+    /* FIXME: Unload _all_ functions */
+    plugin_unregister_read(job->name);
+  }
+
+  return status;
+} /* }}} int plugin_init_job_run */
+
+/* Marks `job' as done. Must hold `init_lock'. */
+static void plugin_init_job_done(init_job_t *job, int status) /* {{{ */
+{
+  job->state = INIT_DONE;
+  init_jobs_done++;
+  if (status != 0)
+    init_status = -1;
+
+  pthread_cond_broadcast(&init_cond);
+} /* }}} void plugin_init_job_done */
+
+static void *plugin_init_thread(void __attribute__((unused)) * args) /* {{{ */
+{
+  pthread_mutex_lock(&init_lock);
+  while (init_jobs_done < init_jobs_num) {
+    init_job_t *job = plugin_init_job_next();
+    if (job == NULL) {
+      pthread_cond_wait(&init_cond, &init_lock);
+      continue;
+    }
+
+    job->state = INIT_RUNNING;
+    pthread_mutex_unlock(&init_lock);
+
+    int status = plugin_init_job_run(job);
+
+    pthread_mutex_lock(&init_lock);
+    plugin_init_job_done(job, status);
+  }
+  pthread_mutex_unlock(&init_lock);
+
+  return (void *)0;
+} /* }}} void *plugin_init_thread */
+
+/* Creates a job for each init callback. */
+static int plugin_init_prepare(void) /* {{{ */
+{
+  init_callbacks = plugin_callbacks_get(&list_init);
+
+  size_t jobs_num = (init_callbacks != NULL) ? init_callbacks->entries_num : 0;
+  init_job_t *jobs = NULL;
+  if (jobs_num > 0) {
+    jobs = calloc(jobs_num, sizeof(*jobs));
+    if (jobs == NULL) {
+      ERROR("plugin: plugin_init_prepare: calloc failed.");
+      plugin_callbacks_put(init_callbacks);
+      init_callbacks = NULL;
+      return -1;
+    }
+  }
+
+  for (size_t i = 0; i < jobs_num; i++) {
+    jobs[i].name = init_callbacks->entries[i].key;
+    jobs[i].cf = init_callbacks->entries[i].value;
+    jobs[i].state = INIT_PENDING;
+  }
+
+  pthread_mutex_lock(&init_lock);
+  init_jobs = jobs;
+  init_jobs_num = jobs_num;
+  init_jobs_done = 0;
+  init_status = 0;
+  pthread_mutex_unlock(&init_lock);
+
+  return 0;
+} /* }}} int plugin_init_prepare */
+
+/* Calls all init callbacks prepared by plugin_init_prepare(), honoring the
+ * dependencies registered with plugin_register_init_dependency(). With more
+ * than one thread, independent callbacks run concurrently. */
+static int plugin_init_callbacks(size_t threads_num) /* {{{ */
+{
+  size_t jobs_num = init_jobs_num;
+
+  if (jobs_num == 0) {
+    plugin_callbacks_put(init_callbacks);
+    init_callbacks = NULL;
+    return 0;
+  }
+
+  if (threads_num > jobs_num)
+    threads_num = jobs_num;
+
+  cdtime_t start = cdtime();
+
+  pthread_t *threads = NULL;
+  size_t threads_started = 0;
+  if (threads_num > 1)
+    threads = calloc(threads_num, sizeof(*threads));
+
+  for (size_t j = 0; (threads != NULL) && (j < threads_num); j++) {
+    int status = pthread_create(threads + threads_started, /* attr = */ NULL,
+                                plugin_init_thread, /* arg = */ NULL);
+    if (status != 0) {
+      ERROR("plugin: plugin_init_callbacks: pthread_create failed with status "
+            "%i (%s).",
+            status, STRERROR(status));
+      break;
+    }
+
+    /* set_thread_name() truncates names that are too long. */
+    char name[32];
+    snprintf(name, sizeof(name), "init#%" PRIsz, threads_started);
+    set_thread_name(threads[threads_started], name);
+
+    threads_started++;
+  }
+
+  /* Without any threads, initialize in this thread. */
+  if (threads_started == 0)
+    plugin_init_thread(NULL);
+
+  for (size_t j = 0; j < threads_started; j++)
+    pthread_join(threads[j], NULL);
+  sfree(threads);
+
+  INFO("plugin: Initialized %" PRIsz " plugins in %.3f seconds "
+       "using %" PRIsz " thread(s).",
+       jobs_num, CDTIME_T_TO_DOUBLE(cdtime() - start),
+       (threads_started > 0) ? threads_started : 1);
+
+  pthread_mutex_lock(&init_lock);
+  int status = init_status;
+  init_job_t *jobs = init_jobs;
+  init_jobs = NULL;
+  init_jobs_num = 0;
+  init_jobs_done = 0;
+  pthread_mutex_unlock(&init_lock);
+
+  sfree(jobs);
+  plugin_callbacks_put(init_callbacks);
+  init_callbacks = NULL;
+  return status;
+} /* }}} int plugin_init_callbacks */
+
+static void plugin_start_read_threads(void) /* {{{ */
+{
+  if (read_heap == NULL)
+    return;
+
+  const char *rt = global_option_get("ReadThreads");
+  int num = atoi(rt);
+  if (num != -1)
+    start_read_threads((num > 0) ? ((size_t)num) : 5);
+} /* }}} void plugin_start_read_threads */
+
 int plugin_init_all(void) {
   char const *chain_name;
-  llentry_t *le;
-  int status;
+  long init_threads_num;
   int ret = 0;
 
-  /* Init the value cache */
-  uc_init();
-
+  /* Must be enabled before the value cache is initialized, so that waiting
+   * for the cache lock can be accounted for. */
   if (IS_TRUE(global_option_get("CollectInternalStats"))) {
     record_statistics = 1;
+    stats_enable();
+    write_lock_stats = stats_register(STATS_LOCK, "write_lock");
     plugin_register_read("collectd", plugin_update_internal_statistics);
   }
 
+  long history_max_points = global_option_get_long("HistoryMaxPoints",
+                                                   /* default = */ 1024);
+  if (history_max_points < 1) {
+    ERROR("HistoryMaxPoints must be positive.");
+    history_max_points = 1024;
+  }
+  if (history_configure(global_option_get_time("HistoryRaw", 0),
+                        global_option_get("HistoryTiers"),
+                        (size_t)history_max_points) != 0)
+    ERROR("Invalid history configuration. The history is disabled.");
+
+  /* Init the value cache */
+  uc_init();
+
   chain_name = global_option_get("PreCacheChain");
   pre_cache_chain = fc_chain_get_by_name(chain_name);
+  if (pre_cache_chain != NULL)
+    pre_cache_chain_stats = stats_register(STATS_CHAIN, chain_name);
 
   chain_name = global_option_get("PostCacheChain");
   post_cache_chain = fc_chain_get_by_name(chain_name);
+  if (post_cache_chain != NULL)
+    post_cache_chain_stats = stats_register(STATS_CHAIN, chain_name);
 
   write_limit_high = global_option_get_long("WriteQueueLimitHigh",
                                             /* default = */ 0);
@@ -1581,61 +2620,72 @@ int plugin_init_all(void) {
     write_threads_num = 5;
   }
 
-  if ((list_init == NULL) && (read_heap == NULL))
+  long queue_limit = global_option_get_long("NotificationQueueLimit",
+                                            /* default = */ 0);
+  if (queue_limit < 0) {
+    ERROR("NotificationQueueLimit must be positive or zero.");
+    queue_limit = 0;
+  }
+
+  cdtime_t coalesce =
+      global_option_get_time("NotificationCoalesceInterval", 0);
+  long flap_threshold = global_option_get_long("NotificationFlapThreshold",
+                                               /* default = */ 0);
+  if ((flap_threshold < 0) || (flap_threshold == 1)) {
+    ERROR("NotificationFlapThreshold must be zero or at least two.");
+    flap_threshold = 0;
+  }
+  cdtime_t flap_window = global_option_get_time(
+      "NotificationFlapWindow", TIME_T_TO_CDTIME_T_STATIC(600));
+
+  pthread_mutex_lock(&notification_lock);
+  /* Queues are created as notifications are dispatched. */
+  notification_queue_limit = queue_limit;
+  notification_async = (queue_limit > 0);
+  if ((notification_filter == NULL) &&
+      ((coalesce > 0) || (flap_threshold > 0))) {
+    notification_filter = notification_filter_create(
+        coalesce, (size_t)flap_threshold, flap_window);
+    if (notification_filter == NULL)
+      ERROR("plugin_init_all: Creating the notification filter failed.");
+  }
+  pthread_mutex_unlock(&notification_lock);
+
+  init_threads_num = global_option_get_long("InitThreads",
+                                            /* default = */ 1);
+  if (init_threads_num < 1) {
+    ERROR("InitThreads must be positive.");
+    init_threads_num = 1;
+  }
+
+  if (plugin_callbacks_empty(&list_init) && (read_heap == NULL))
     return ret;
 
-  /* Calling all init callbacks before checking if read callbacks
-   * are available allows the init callbacks to register the read
-   * callback. */
-  le = llist_head(list_init);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_init_cb callback;
-    plugin_ctx_t old_ctx;
-
-    cf = le->value;
-    old_ctx = plugin_set_ctx(cf->cf_ctx);
-    callback = cf->cf_callback;
-    status = (*callback)();
-    plugin_set_ctx(old_ctx);
+  max_read_interval =
+      global_option_get_time("MaxReadInterval", DEFAULT_MAX_READ_INTERVAL);
 
-    if (status != 0) {
-      ERROR("Initialization of plugin `%s' "
-            "failed with status %i. "
-            "Plugin will be unloaded.",
-            le->key, status);
-      /* Plugins that register read callbacks from the init
-       * callback should take care of appropriate error
-       * handling themselves. */
-      /* FIXME: Unload _all_ functions */
-      plugin_unregister_read(le->key);
-      ret = -1;
-    }
+  if (plugin_init_prepare() != 0)
+    return -1;
 
-    le = le->next;
-  }
+  /* Calling all init callbacks before checking if read callbacks
+   * are available allows the init callbacks to register the read
+   * callback. The read and write threads are started only once all init
+   * callbacks have returned, so that no callback of a plugin is called
+   * before that plugin has been initialized, even with InitThreads > 1. */
+  ret = plugin_init_callbacks((size_t)init_threads_num);
 
   start_write_threads((size_t)write_threads_num);
 
-  max_read_interval =
-      global_option_get_time("MaxReadInterval", DEFAULT_MAX_READ_INTERVAL);
-
   /* Start read-threads */
-  if (read_heap != NULL) {
-    const char *rt;
-    int num;
+  plugin_start_read_threads();
 
-    rt = global_option_get("ReadThreads");
-    num = atoi(rt);
-    if (num != -1)
-      start_read_threads((num > 0) ? ((size_t)num) : 5);
-  }
   return ret;
 } /* void plugin_init_all */
 
 /* TODO: Rename this function. */
 void plugin_read_all(void) {
   uc_check_timeout();
+  plugin_notification_expire();
 
   return;
 } /* void plugin_read_all */
@@ -1686,15 +2736,34 @@ int plugin_read_all_once(void) {
   return return_status;
 } /* int plugin_read_all_once */
 
+static int plugin_write_callback(llentry_t *le, /* {{{ */
+                                 const data_set_t *ds, const value_list_t *vl) {
+  callback_func_t *cf = le->value;
+  plugin_write_cb callback = cf->cf_callback;
+
+  /* do not switch plugin context; rather keep the context (interval)
+   * information of the calling read plugin */
+
+  DEBUG("plugin: plugin_write: Writing values via %s.", le->key);
+  if (!record_statistics)
+    return (*callback)(ds, vl, &cf->cf_udata);
+
+  cdtime_t start = cdtime();
+  int status = (*callback)(ds, vl, &cf->cf_udata);
+  stats_record(plugin_stats_id(cf, STATS_WRITE, le->key), cdtime() - start,
+               status != 0);
+
+  return status;
+} /* }}} int plugin_write_callback */
+
 int plugin_write(const char *plugin, /* {{{ */
                  const data_set_t *ds, const value_list_t *vl) {
-  llentry_t *le;
   int status;
 
   if (vl == NULL)
     return EINVAL;
 
-  if (list_write == NULL)
+  if (plugin_callbacks_empty(&list_write))
     return ENOENT;
 
   if (ds == NULL) {
@@ -1705,27 +2774,20 @@ int plugin_write(const char *plugin, /* {{{ */
     }
   }
 
+  callback_snapshot_t *s = plugin_callbacks_get(&list_write);
+  if (s == NULL)
+    return ENOENT;
+
   if (plugin == NULL) {
     int success = 0;
     int failure = 0;
 
-    le = llist_head(list_write);
-    while (le != NULL) {
-      callback_func_t *cf = le->value;
-      plugin_write_cb callback;
-
-      /* do not switch plugin context; rather keep the context (interval)
-       * information of the calling read plugin */
-
-      DEBUG("plugin: plugin_write: Writing values via %s.", le->key);
-      callback = cf->cf_callback;
-      status = (*callback)(ds, vl, &cf->cf_udata);
+    for (size_t i = 0; i < s->entries_num; i++) {
+      status = plugin_write_callback(s->entries + i, ds, vl);
       if (status != 0)
         failure++;
       else
         success++;
-
-      le = le->next;
     }
 
     if ((success == 0) && (failure != 0))
@@ -1734,65 +2796,57 @@ int plugin_write(const char *plugin, /* {{{ */
       status = 0;
   } else /* plugin != NULL */
   {
-    callback_func_t *cf;
-    plugin_write_cb callback;
-
-    le = llist_head(list_write);
-    while (le != NULL) {
-      if (strcasecmp(plugin, le->key) == 0)
+    size_t i;
+    for (i = 0; i < s->entries_num; i++)
+      if (strcasecmp(plugin, s->entries[i].key) == 0)
         break;
 
-      le = le->next;
-    }
-
-    if (le == NULL)
-      return ENOENT;
-
-    cf = le->value;
-
-    /* do not switch plugin context; rather keep the context (interval)
-     * information of the calling read plugin */
-
-    DEBUG("plugin: plugin_write: Writing values via %s.", le->key);
-    callback = cf->cf_callback;
-    status = (*callback)(ds, vl, &cf->cf_udata);
+    if (i < s->entries_num)
+      status = plugin_write_callback(s->entries + i, ds, vl);
+    else
+      status = ENOENT;
   }
 
+  plugin_callbacks_put(s);
   return status;
 } /* }}} int plugin_write */
 
 int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier) {
-  llentry_t *le;
-
-  if (list_flush == NULL)
+  callback_snapshot_t *s = plugin_callbacks_get(&list_flush);
+  if (s == NULL)
     return 0;
 
-  le = llist_head(list_flush);
-  while (le != NULL) {
+  for (size_t i = 0; i < s->entries_num; i++) {
+    llentry_t *le = s->entries + i;
     callback_func_t *cf;
     plugin_flush_cb callback;
     plugin_ctx_t old_ctx;
 
-    if ((plugin != NULL) && (strcmp(plugin, le->key) != 0)) {
-      le = le->next;
+    if ((plugin != NULL) && (strcmp(plugin, le->key) != 0))
       continue;
-    }
 
     cf = le->value;
     old_ctx = plugin_set_ctx(cf->cf_ctx);
     callback = cf->cf_callback;
 
-    (*callback)(timeout, identifier, &cf->cf_udata);
+    if (record_statistics) {
+      cdtime_t start = cdtime();
+      int status = (*callback)(timeout, identifier, &cf->cf_udata);
+      stats_record(plugin_stats_id(cf, STATS_FLUSH, le->key),
+                   cdtime() - start, status != 0);
+    } else {
+      (*callback)(timeout, identifier, &cf->cf_udata);
+    }
 
     plugin_set_ctx(old_ctx);
-
-    le = le->next;
   }
+  plugin_callbacks_put(s);
+
   return 0;
 } /* int plugin_flush */
 
 int plugin_shutdown_all(void) {
-  llentry_t *le;
+  callback_snapshot_t *s;
   int ret = 0; // Assume success.
 
   destroy_all_callbacks(&list_init);
@@ -1809,35 +2863,32 @@ int plugin_shutdown_all(void) {
   /* blocks until all write threads have shut down. */
   stop_write_threads();
 
+  /* delivers the queued notifications, e.g. from the threshold checks of the
+   * write threads, before the notification plugins are shut down. */
+  stop_notification_threads();
+
   /* ask all plugins to write out the state they kept. */
   plugin_flush(/* plugin = */ NULL,
                /* timeout = */ 0,
                /* identifier = */ NULL);
 
-  le = NULL;
-  if (list_shutdown != NULL)
-    le = llist_head(list_shutdown);
-
-  while (le != NULL) {
+  /* The snapshot allows shutdown functions to unregister themselves. */
+  s = plugin_callbacks_get(&list_shutdown);
+  for (size_t i = 0; (s != NULL) && (i < s->entries_num); i++) {
     callback_func_t *cf;
     plugin_shutdown_cb callback;
     plugin_ctx_t old_ctx;
 
-    cf = le->value;
+    cf = s->entries[i].value;
     old_ctx = plugin_set_ctx(cf->cf_ctx);
     callback = cf->cf_callback;
 
-    /* Advance the pointer before calling the callback allows
-     * shutdown functions to unregister themselves. If done the
-     * other way around the memory `le' points to will be freed
-     * after callback returns. */
-    le = le->next;
-
     if ((*callback)() != 0)
       ret = -1;
 
     plugin_set_ctx(old_ctx);
   }
+  plugin_callbacks_put(s);
 
   /* Write plugins which use the `user_data' pointer usually need the
    * same data available to the flush callback. If this is the case, set
@@ -1850,40 +2901,58 @@ int plugin_shutdown_all(void) {
 
   destroy_all_callbacks(&list_notification);
   destroy_all_callbacks(&list_shutdown);
+
+  pthread_mutex_lock(&notification_lock);
+  notification_filter_destroy(notification_filter);
+  notification_filter = NULL;
+  pthread_mutex_unlock(&notification_lock);
   destroy_all_callbacks(&list_log);
 
   plugin_free_loaded();
   plugin_free_data_sets();
+
+  for (size_t i = 0; i < init_dependencies_num; i++) {
+    sfree(init_dependencies[i].name);
+    sfree(init_dependencies[i].depends_on);
+  }
+  sfree(init_dependencies);
+  init_dependencies_num = 0;
   return ret;
 } /* void plugin_shutdown_all */
 
 int plugin_dispatch_missing(const value_list_t *vl) /* {{{ */
 {
-  if (list_missing == NULL)
+  callback_snapshot_t *s = plugin_callbacks_get(&list_missing);
+  if (s == NULL)
     return 0;
 
-  llentry_t *le = llist_head(list_missing);
-  while (le != NULL) {
+  int ret = 0;
+
+  for (size_t i = 0; i < s->entries_num; i++) {
+    llentry_t *le = s->entries + i;
     callback_func_t *cf = le->value;
     plugin_ctx_t old_ctx = plugin_set_ctx(cf->cf_ctx);
     plugin_missing_cb callback = cf->cf_callback;
 
+    cdtime_t start = record_statistics ? cdtime() : 0;
     int status = (*callback)(vl, &cf->cf_udata);
+    if (record_statistics)
+      stats_record(plugin_stats_id(cf, STATS_MISSING, le->key),
+                   cdtime() - start, status < 0);
     plugin_set_ctx(old_ctx);
     if (status != 0) {
       if (status < 0) {
         ERROR("plugin_dispatch_missing: Callback function \"%s\" "
               "failed with status %i.",
               le->key, status);
-        return status;
-      } else {
-        return 0;
+        ret = status;
       }
+      break;
     }
-
-    le = le->next;
   }
-  return 0;
+  plugin_callbacks_put(s);
+
+  return ret;
 } /* int }}} plugin_dispatch_missing */
 
 static int plugin_dispatch_values_internal(value_list_t *vl) {
@@ -1912,7 +2981,7 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   if (vl->meta == NULL)
     free_meta_data = 1;
 
-  if (list_write == NULL)
+  if (plugin_callbacks_empty(&list_write))
     c_complain_once(LOG_WARNING, &no_write_complaint,
                     "plugin_dispatch_values: No write callback has been "
                     "registered. Please load at least one output plugin, "
@@ -1926,7 +2995,7 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   }
 
   data_set_t *ds = NULL;
-  if (c_avl_get(data_sets, vl->type, (void *)&ds) != 0) {
+  if (c_btree_get(data_sets, vl->type, (void *)&ds) != 0) {
     char ident[6 * DATA_MAX_NAME_LEN];
 
     FORMAT_VL(ident, sizeof(ident), vl);
@@ -1970,7 +3039,10 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   escape_slashes(vl->type_instance, sizeof(vl->type_instance));
 
   if (pre_cache_chain != NULL) {
+    cdtime_t start = record_statistics ? cdtime() : 0;
     status = fc_process_chain(ds, vl, pre_cache_chain);
+    if (record_statistics)
+      stats_record(pre_cache_chain_stats, cdtime() - start, status < 0);
     if (status < 0) {
       WARNING("plugin_dispatch_values: Running the "
               "pre-cache chain failed with "
@@ -1984,7 +3056,10 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   uc_update(ds, vl);
 
   if (post_cache_chain != NULL) {
+    cdtime_t start = record_statistics ? cdtime() : 0;
     status = fc_process_chain(ds, vl, post_cache_chain);
+    if (record_statistics)
+      stats_record(post_cache_chain_stats, cdtime() - start, status < 0);
     if (status < 0) {
       WARNING("plugin_dispatch_values: Running the "
               "post-cache chain failed with "
@@ -2163,37 +3238,33 @@ plugin_dispatch_multivalue(value_list_t const *template, /* {{{ */
 } /* }}} int plugin_dispatch_multivalue */
 
 int plugin_dispatch_notification(const notification_t *notif) {
-  llentry_t *le;
-  /* Possible TODO: Add flap detection here */
-
   DEBUG("plugin_dispatch_notification: severity = %i; message = %s; "
         "time = %.3f; host = %s;",
         notif->severity, notif->message, CDTIME_T_TO_DOUBLE(notif->time),
         notif->host);
 
   /* Nobody cares for notifications */
-  if (list_notification == NULL)
+  if (plugin_callbacks_empty(&list_notification))
     return -1;
 
-  le = llist_head(list_notification);
-  while (le != NULL) {
-    callback_func_t *cf;
-    plugin_notification_cb callback;
-    int status;
+  pthread_mutex_lock(&notification_lock);
+  if (notification_filter == NULL) {
+    pthread_mutex_unlock(&notification_lock);
+    plugin_notification_deliver(notif);
+    return 0;
+  }
 
-    /* do not switch plugin context; rather keep the context
-     * (interval) information of the calling plugin */
+  /* The filter may amend the message. */
+  notification_t n = *notif;
+  n.meta = NULL;
+  _Bool pass = notification_filter_check(notification_filter, &n, cdtime());
+  pthread_mutex_unlock(&notification_lock);
 
-    cf = le->value;
-    callback = cf->cf_callback;
-    status = (*callback)(notif, &cf->cf_udata);
-    if (status != 0) {
-      WARNING("plugin_dispatch_notification: Notification "
-              "callback %s returned %i.",
-              le->key, status);
-    }
-
-    le = le->next;
+  if (pass) {
+    plugin_notification_meta_copy(&n, notif);
+    plugin_notification_deliver(&n);
+    if (n.meta != NULL)
+      plugin_notification_meta_free(n.meta);
   }
 
   return 0;
@@ -2202,7 +3273,6 @@ int plugin_dispatch_notification(const notification_t *notif) {
 void plugin_log(int level, const char *format, ...) {
   char msg[1024];
   va_list ap;
-  llentry_t *le;
 
 #if !COLLECT_DEBUG
   if (level >= LOG_DEBUG)
@@ -2214,26 +3284,25 @@ void plugin_log(int level, const char *format, ...) {
   msg[sizeof(msg) - 1] = '\0';
   va_end(ap);
 
-  if (list_log == NULL) {
+  callback_snapshot_t *s = plugin_callbacks_get(&list_log);
+  if (s == NULL) {
     fprintf(stderr, "%s\n", msg);
     return;
   }
 
-  le = llist_head(list_log);
-  while (le != NULL) {
+  for (size_t i = 0; i < s->entries_num; i++) {
     callback_func_t *cf;
     plugin_log_cb callback;
 
-    cf = le->value;
+    cf = s->entries[i].value;
     callback = cf->cf_callback;
 
     /* do not switch plugin context; rather keep the context
      * (interval) information of the calling plugin */
 
     (*callback)(level, msg, &cf->cf_udata);
-
-    le = le->next;
   }
+  plugin_callbacks_put(s);
 } /* void plugin_log */
 
 int parse_log_severity(const char *severity) {
@@ -2279,7 +3348,7 @@ const data_set_t *plugin_get_ds(const char *name) {
     return NULL;
   }
 
-  if (c_avl_get(data_sets, name, (void *)&ds) != 0) {
+  if (c_btree_get(data_sets, name, (void *)&ds) != 0) {
     DEBUG("No such dataset registered: %s", name);
     return NULL;
   }
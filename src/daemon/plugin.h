@@ -174,6 +174,8 @@ struct plugin_ctx_s {
   cdtime_t interval;
   cdtime_t flush_interval;
   cdtime_t flush_timeout;
+  /* Name of the plugin the context belongs to, NULL for the daemon. */
+  char *name;
 };
 typedef struct plugin_ctx_s plugin_ctx_t;
 
@@ -280,6 +282,10 @@ int plugin_register_config(const char *name,
 int plugin_register_complex_config(const char *type,
                                    int (*callback)(oconfig_item_t *));
 int plugin_register_init(const char *name, plugin_init_cb callback);
+/* Makes the init callback `name' run only after the init callback of
+ * `depends_on' has returned. Only relevant with "InitThreads" > 1 and for
+ * plugins that have to be initialized in a particular order. */
+int plugin_register_init_dependency(const char *name, const char *depends_on);
 int plugin_register_read(const char *name, int (*callback)(void));
 /* "user_data" will be freed automatically, unless
  * "plugin_register_complex_read" returns an error (non-zero). */
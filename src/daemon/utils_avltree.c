@@ -589,6 +589,30 @@ c_avl_iterator_t *c_avl_get_iterator(c_avl_tree_t *t) {
   return iter;
 } /* c_avl_iterator_t *c_avl_get_iterator */
 
+c_avl_iterator_t *c_avl_get_iterator_from(c_avl_tree_t *t, const void *key) {
+  c_avl_iterator_t *iter;
+  c_avl_node_t *n;
+
+  iter = c_avl_get_iterator(t);
+  if ((iter == NULL) || (key == NULL))
+    return iter;
+
+  /* Position the iterator on the largest node smaller than `key', so that
+   * c_avl_iterator_next() continues with the first node not smaller than
+   * `key'. If there is no such node, the iterator starts at the beginning. */
+  n = t->root;
+  while (n != NULL) {
+    if (t->compare(key, n->key) > 0) {
+      iter->node = n;
+      n = n->right;
+    } else {
+      n = n->left;
+    }
+  }
+
+  return iter;
+} /* c_avl_iterator_t *c_avl_get_iterator_from */
+
 int c_avl_iterator_next(c_avl_iterator_t *iter, void **key, void **value) {
   c_avl_node_t *n;
 
@@ -621,7 +645,7 @@ int c_avl_iterator_prev(c_avl_iterator_t *iter, void **key, void **value) {
     return -1;
 
   if (iter->node == NULL) {
-    for (n = iter->tree->root; n != NULL; n = n->left)
+    for (n = iter->tree->root; n != NULL; n = n->right)
       if (n->right == NULL)
         break;
     iter->node = n;
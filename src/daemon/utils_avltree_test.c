@@ -130,8 +130,58 @@ DEF_TEST(success) {
   return 0;
 }
 
+DEF_TEST(iterator_from) {
+  char *keys[] = {"b", "d", "f", "h"};
+  struct {
+    char *key;
+    char *want;
+  } cases[] = {
+      {"a", "b"}, {"b", "b"}, {"c", "d"}, {"f", "f"},
+      {"g", "h"}, {"h", "h"}, {"i", NULL}, {NULL, "b"},
+  };
+  c_avl_tree_t *t;
+
+  CHECK_NOT_NULL(t = c_avl_create(compare_callback));
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(keys); i++)
+    CHECK_ZERO(c_avl_insert(t, keys[i], keys[i]));
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    c_avl_iterator_t *iter;
+    char *key = NULL;
+    char *value = NULL;
+    char *prev = NULL;
+    int num = 0;
+
+    CHECK_NOT_NULL(iter = c_avl_get_iterator_from(t, cases[i].key));
+    if (cases[i].want == NULL) {
+      EXPECT_EQ_INT(-1, c_avl_iterator_next(iter, (void *)&key, (void *)&value));
+      c_avl_iterator_destroy(iter);
+      continue;
+    }
+
+    CHECK_ZERO(c_avl_iterator_next(iter, (void *)&key, (void *)&value));
+    EXPECT_EQ_STR(cases[i].want, key);
+
+    /* The remaining keys follow in order. */
+    do {
+      if (prev != NULL)
+        OK(strcmp(prev, key) < 0);
+      prev = key;
+      num++;
+    } while (c_avl_iterator_next(iter, (void *)&key, (void *)&value) == 0);
+    EXPECT_EQ_INT((int)STATIC_ARRAY_SIZE(keys) - (int)(cases[i].want[0] - 'b') / 2,
+                  num);
+
+    c_avl_iterator_destroy(iter);
+  }
+
+  c_avl_destroy(t);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(success);
+  RUN_TEST(iterator_from);
 
   END_TEST;
 }
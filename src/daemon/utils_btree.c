@@ -0,0 +1,767 @@
+/**
+ * collectd - src/daemon/utils_btree.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils_btree.h"
+
+/* Maximum number of keys per node. Leaves hold as many entries, inner nodes
+ * one child more. Nodes with less than BT_MIN keys are refilled from or merged
+ * with a sibling. */
+#define BT_ORDER 32
+#define BT_MIN (BT_ORDER / 4)
+
+/* Number of key bytes stored inline for string keys. */
+#define BT_PREFIX_LEN sizeof(uint64_t)
+
+/*
+ * private data types
+ *
+ * Separators in inner nodes are pointers to keys stored in the leaves: the
+ * separator `key[i]' is a key of the subtree `child[i + 1]' and all keys of
+ * `child[i]' are smaller than it. When the key a separator points to is
+ * removed, the separator is replaced by its successor (see
+ * bt_replace_separator), since the caller is free to release the key memory.
+ */
+typedef struct bt_node_s {
+  _Bool leaf;
+  int num;
+
+  /* Only used for string keys: all keys of the node share their first `lcp'
+   * bytes and prefix[i] holds the next BT_PREFIX_LEN bytes of key[i] in
+   * big-endian order, padded with zeros. */
+  size_t lcp;
+  uint64_t prefix[BT_ORDER];
+
+  void *key[BT_ORDER];
+} bt_node_t;
+
+typedef struct bt_leaf_s {
+  bt_node_t head;
+  void *value[BT_ORDER];
+  struct bt_leaf_s *prev;
+  struct bt_leaf_s *next;
+} bt_leaf_t;
+
+typedef struct bt_inner_s {
+  bt_node_t head;
+  bt_node_t *child[BT_ORDER + 1];
+} bt_inner_t;
+
+struct c_btree_s {
+  bt_node_t *root;
+  int (*compare)(const void *, const void *);
+  int size;
+};
+
+struct c_btree_iterator_s {
+  c_btree_t *tree;
+  bt_leaf_t *leaf;
+  int index;
+};
+
+#define BT_LEAF(n) ((bt_leaf_t *)(n))
+#define BT_INNER(n) ((bt_inner_t *)(n))
+
+/* Used as the `changed' argument of bt_refresh. */
+#define BT_NONE (-1)
+#define BT_ALL (-2)
+
+/*
+ * private functions
+ */
+static uint64_t bt_prefix(const char *s, size_t offset) {
+  uint64_t ret = 0;
+
+  s += offset;
+  for (size_t i = 0; i < BT_PREFIX_LEN; i++) {
+    ret <<= 8;
+    if (*s != 0) {
+      ret |= (uint8_t)*s;
+      s++;
+    }
+  }
+
+  return ret;
+} /* uint64_t bt_prefix */
+
+static size_t bt_common_prefix(const char *a, const char *b) {
+  size_t i = 0;
+  while ((a[i] != 0) && (a[i] == b[i]))
+    i++;
+  return i;
+} /* size_t bt_common_prefix */
+
+/* Updates the inline prefixes after the keys of `n' have been changed.
+ * `changed' is the index of the only key that was added or replaced, BT_NONE
+ * if keys have only been removed or BT_ALL. Since keys are sorted, the prefix
+ * all keys share is the one of the first and the last key. */
+static void bt_refresh(c_btree_t const *t, bt_node_t *n, int changed) {
+  size_t lcp;
+
+  if (t->compare != NULL)
+    return;
+
+  lcp = 0;
+  if (n->num > 1)
+    lcp = bt_common_prefix(n->key[0], n->key[n->num - 1]);
+
+  if (lcp != n->lcp) {
+    n->lcp = lcp;
+    changed = BT_ALL;
+  }
+
+  if (changed == BT_ALL) {
+    for (int i = 0; i < n->num; i++)
+      n->prefix[i] = bt_prefix(n->key[i], lcp);
+  } else if (changed >= 0) {
+    n->prefix[changed] = bt_prefix(n->key[changed], lcp);
+  }
+} /* void bt_refresh */
+
+/* Returns the index of the first key of `n' which is not smaller than `key'
+ * and sets `found' if it is equal to `key'. */
+static int bt_search(c_btree_t const *t, bt_node_t const *n, void const *key,
+                     _Bool *found) {
+  int lo = 0;
+  int hi = n->num;
+
+  *found = 0;
+
+  if (t->compare != NULL) {
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      int cmp = t->compare(key, n->key[mid]);
+
+      if (cmp == 0) {
+        *found = 1;
+        return mid;
+      } else if (cmp < 0) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    return lo;
+  }
+
+  if (n->num == 0)
+    return 0;
+
+  const char *k = key;
+  if (n->lcp > 0) {
+    int cmp = strncmp(k, n->key[0], n->lcp);
+    if (cmp < 0)
+      return 0;
+    else if (cmp > 0)
+      return n->num;
+  }
+
+  uint64_t p = bt_prefix(k, n->lcp);
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    int cmp;
+
+    if (p < n->prefix[mid])
+      cmp = -1;
+    else if (p > n->prefix[mid])
+      cmp = 1;
+    else if ((p & 0xff) == 0) /* both keys end within the prefix */
+      cmp = 0;
+    else
+      cmp = strcmp(k + n->lcp + BT_PREFIX_LEN,
+                   (char *)n->key[mid] + n->lcp + BT_PREFIX_LEN);
+
+    if (cmp == 0) {
+      *found = 1;
+      return mid;
+    } else if (cmp < 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+
+  return lo;
+} /* int bt_search */
+
+/* Returns the leaf `key' belongs to. */
+static bt_leaf_t *bt_find_leaf(c_btree_t const *t, void const *key) {
+  bt_node_t *n = t->root;
+
+  if (n == NULL)
+    return NULL;
+
+  while (!n->leaf) {
+    _Bool found;
+    int pos = bt_search(t, n, key, &found);
+    n = BT_INNER(n)->child[found ? pos + 1 : pos];
+  }
+
+  return BT_LEAF(n);
+} /* bt_leaf_t *bt_find_leaf */
+
+static bt_leaf_t *bt_first_leaf(bt_node_t *n) {
+  if (n == NULL)
+    return NULL;
+  while (!n->leaf)
+    n = BT_INNER(n)->child[0];
+  return BT_LEAF(n);
+} /* bt_leaf_t *bt_first_leaf */
+
+static bt_leaf_t *bt_last_leaf(bt_node_t *n) {
+  if (n == NULL)
+    return NULL;
+  while (!n->leaf)
+    n = BT_INNER(n)->child[n->num];
+  return BT_LEAF(n);
+} /* bt_leaf_t *bt_last_leaf */
+
+static void bt_free(bt_node_t *n) {
+  if (n == NULL)
+    return;
+
+  if (!n->leaf)
+    for (int i = 0; i <= n->num; i++)
+      bt_free(BT_INNER(n)->child[i]);
+
+  free(n);
+} /* void bt_free */
+
+static int bt_leaf_insert(c_btree_t *t, bt_leaf_t *l, void *key, void *value,
+                          void **up_key, bt_node_t **up_node) {
+  bt_node_t *n = &l->head;
+  bt_leaf_t *r;
+  _Bool found;
+  int pos;
+  int mid;
+
+  pos = bt_search(t, n, key, &found);
+  if (found)
+    return 1;
+
+  if (n->num < BT_ORDER) {
+    memmove(n->key + pos + 1, n->key + pos, (n->num - pos) * sizeof(void *));
+    memmove(n->prefix + pos + 1, n->prefix + pos,
+            (n->num - pos) * sizeof(uint64_t));
+    memmove(l->value + pos + 1, l->value + pos,
+            (n->num - pos) * sizeof(void *));
+    n->key[pos] = key;
+    l->value[pos] = value;
+    n->num++;
+    bt_refresh(t, n, pos);
+    return 0;
+  }
+
+  /* Split the full leaf in two and insert into the matching half. */
+  r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    return -1;
+  r->head.leaf = 1;
+
+  mid = BT_ORDER / 2;
+  r->head.num = BT_ORDER - mid;
+  memcpy(r->head.key, n->key + mid, r->head.num * sizeof(void *));
+  memcpy(r->value, l->value + mid, r->head.num * sizeof(void *));
+  n->num = mid;
+
+  r->next = l->next;
+  if (r->next != NULL)
+    r->next->prev = r;
+  r->prev = l;
+  l->next = r;
+
+  bt_refresh(t, n, BT_NONE);
+  bt_refresh(t, &r->head, BT_ALL);
+  if (pos <= mid)
+    bt_leaf_insert(t, l, key, value, NULL, NULL);
+  else
+    bt_leaf_insert(t, r, key, value, NULL, NULL);
+
+  *up_key = r->head.key[0];
+  *up_node = &r->head;
+  return 0;
+} /* int bt_leaf_insert */
+
+static int bt_insert(c_btree_t *t, bt_node_t *n, void *key, void *value,
+                     void **up_key, bt_node_t **up_node) {
+  bt_inner_t *in = BT_INNER(n);
+  bt_inner_t *r = NULL;
+  void *child_key = NULL;
+  bt_node_t *child_node = NULL;
+  void *keys[BT_ORDER + 1];
+  bt_node_t *children[BT_ORDER + 2];
+  _Bool found;
+  int status;
+  int pos;
+  int mid;
+
+  if (n->leaf)
+    return bt_leaf_insert(t, BT_LEAF(n), key, value, up_key, up_node);
+
+  pos = bt_search(t, n, key, &found);
+  if (found)
+    return 1;
+
+  /* Allocate the node needed for splitting this one up front, so that a
+   * failure doesn't leave a split child behind. */
+  if (n->num == BT_ORDER) {
+    r = calloc(1, sizeof(*r));
+    if (r == NULL)
+      return -1;
+  }
+
+  status = bt_insert(t, in->child[pos], key, value, &child_key, &child_node);
+  if ((status != 0) || (child_node == NULL)) {
+    free(r);
+    return status;
+  }
+
+  /* The child has been split: add the new separator at `pos' and the new
+   * node right of it. */
+  if (n->num < BT_ORDER) {
+    memmove(n->key + pos + 1, n->key + pos, (n->num - pos) * sizeof(void *));
+    memmove(n->prefix + pos + 1, n->prefix + pos,
+            (n->num - pos) * sizeof(uint64_t));
+    memmove(in->child + pos + 2, in->child + pos + 1,
+            (n->num - pos) * sizeof(bt_node_t *));
+    n->key[pos] = child_key;
+    in->child[pos + 1] = child_node;
+    n->num++;
+    bt_refresh(t, n, pos);
+    return 0;
+  }
+
+  memcpy(keys, n->key, pos * sizeof(void *));
+  keys[pos] = child_key;
+  memcpy(keys + pos + 1, n->key + pos, (BT_ORDER - pos) * sizeof(void *));
+
+  memcpy(children, in->child, (pos + 1) * sizeof(bt_node_t *));
+  children[pos + 1] = child_node;
+  memcpy(children + pos + 2, in->child + pos + 1,
+         (BT_ORDER - pos) * sizeof(bt_node_t *));
+
+  /* Keys [0, mid) stay, `mid' moves up and (mid, BT_ORDER] move right. */
+  mid = (BT_ORDER + 1) / 2;
+  n->num = mid;
+  memcpy(n->key, keys, mid * sizeof(void *));
+  memcpy(in->child, children, (mid + 1) * sizeof(bt_node_t *));
+
+  r->head.num = BT_ORDER - mid;
+  memcpy(r->head.key, keys + mid + 1, r->head.num * sizeof(void *));
+  memcpy(r->child, children + mid + 1, (r->head.num + 1) * sizeof(bt_node_t *));
+
+  bt_refresh(t, n, BT_ALL);
+  bt_refresh(t, &r->head, BT_ALL);
+
+  *up_key = keys[mid];
+  *up_node = &r->head;
+  return 0;
+} /* int bt_insert */
+
+/* Moves entries between the children `pos' and `pos + 1' of `p' or merges
+ * them, after one of them dropped below BT_MIN keys. */
+static void bt_rebalance(c_btree_t *t, bt_inner_t *p, int pos) {
+  bt_node_t *pn = &p->head;
+  bt_node_t *left = p->child[pos];
+  bt_node_t *right = p->child[pos + 1];
+
+  if (left->leaf) {
+    bt_leaf_t *ll = BT_LEAF(left);
+    bt_leaf_t *rl = BT_LEAF(right);
+
+    if (left->num + right->num <= BT_ORDER) {
+      memcpy(left->key + left->num, right->key, right->num * sizeof(void *));
+      memcpy(ll->value + left->num, rl->value, right->num * sizeof(void *));
+      left->num += right->num;
+
+      ll->next = rl->next;
+      if (ll->next != NULL)
+        ll->next->prev = ll;
+      free(rl);
+      right = NULL;
+    } else if (left->num < right->num) {
+      left->key[left->num] = right->key[0];
+      ll->value[left->num] = rl->value[0];
+      left->num++;
+
+      right->num--;
+      memmove(right->key, right->key + 1, right->num * sizeof(void *));
+      memmove(rl->value, rl->value + 1, right->num * sizeof(void *));
+    } else {
+      memmove(right->key + 1, right->key, right->num * sizeof(void *));
+      memmove(rl->value + 1, rl->value, right->num * sizeof(void *));
+      right->num++;
+
+      left->num--;
+      right->key[0] = left->key[left->num];
+      rl->value[0] = ll->value[left->num];
+    }
+
+    if (right != NULL)
+      pn->key[pos] = right->key[0];
+  } else {
+    bt_inner_t *li = BT_INNER(left);
+    bt_inner_t *ri = BT_INNER(right);
+
+    if (left->num + 1 + right->num <= BT_ORDER) {
+      left->key[left->num] = pn->key[pos];
+      memcpy(left->key + left->num + 1, right->key,
+             right->num * sizeof(void *));
+      memcpy(li->child + left->num + 1, ri->child,
+             (right->num + 1) * sizeof(bt_node_t *));
+      left->num += 1 + right->num;
+
+      free(ri);
+      right = NULL;
+    } else if (left->num < right->num) {
+      left->key[left->num] = pn->key[pos];
+      li->child[left->num + 1] = ri->child[0];
+      left->num++;
+
+      pn->key[pos] = right->key[0];
+      right->num--;
+      memmove(right->key, right->key + 1, right->num * sizeof(void *));
+      memmove(ri->child, ri->child + 1,
+              (right->num + 1) * sizeof(bt_node_t *));
+    } else {
+      memmove(right->key + 1, right->key, right->num * sizeof(void *));
+      memmove(ri->child + 1, ri->child,
+              (right->num + 1) * sizeof(bt_node_t *));
+      right->num++;
+      right->key[0] = pn->key[pos];
+      ri->child[0] = li->child[left->num];
+
+      left->num--;
+      pn->key[pos] = left->key[left->num];
+    }
+  }
+
+  bt_refresh(t, left, BT_ALL);
+
+  if (right != NULL) {
+    bt_refresh(t, right, BT_ALL);
+    bt_refresh(t, pn, pos);
+    return;
+  }
+
+  /* The two children have been merged: drop the separator and the right
+   * child. */
+  pn->num--;
+  memmove(pn->key + pos, pn->key + pos + 1, (pn->num - pos) * sizeof(void *));
+  memmove(pn->prefix + pos, pn->prefix + pos + 1,
+          (pn->num - pos) * sizeof(uint64_t));
+  memmove(p->child + pos + 1, p->child + pos + 2,
+          (pn->num - pos) * sizeof(bt_node_t *));
+  bt_refresh(t, pn, BT_NONE);
+} /* void bt_rebalance */
+
+static int bt_remove(c_btree_t *t, bt_node_t *n, const void *key, void **rkey,
+                     void **rvalue) {
+  _Bool found;
+  int pos;
+
+  pos = bt_search(t, n, key, &found);
+
+  if (n->leaf) {
+    bt_leaf_t *l = BT_LEAF(n);
+
+    if (!found)
+      return -1;
+
+    if (rkey != NULL)
+      *rkey = n->key[pos];
+    if (rvalue != NULL)
+      *rvalue = l->value[pos];
+
+    n->num--;
+    memmove(n->key + pos, n->key + pos + 1, (n->num - pos) * sizeof(void *));
+    memmove(n->prefix + pos, n->prefix + pos + 1,
+            (n->num - pos) * sizeof(uint64_t));
+    memmove(l->value + pos, l->value + pos + 1,
+            (n->num - pos) * sizeof(void *));
+    bt_refresh(t, n, BT_NONE);
+    return 0;
+  }
+
+  if (found)
+    pos++;
+
+  if (bt_remove(t, BT_INNER(n)->child[pos], key, rkey, rvalue) != 0)
+    return -1;
+
+  if (BT_INNER(n)->child[pos]->num < BT_MIN)
+    bt_rebalance(t, BT_INNER(n), (pos > 0) ? pos - 1 : 0);
+
+  return 0;
+} /* int bt_remove */
+
+/* Replaces the separator equal to the removed `key', if any, by the smallest
+ * key of the subtree right of it. */
+static void bt_replace_separator(c_btree_t *t, const void *key) {
+  bt_node_t *n = t->root;
+
+  while ((n != NULL) && !n->leaf) {
+    _Bool found;
+    int pos = bt_search(t, n, key, &found);
+
+    if (found) {
+      n->key[pos] = bt_first_leaf(BT_INNER(n)->child[pos + 1])->head.key[0];
+      bt_refresh(t, n, pos);
+      return;
+    }
+
+    n = BT_INNER(n)->child[pos];
+  }
+} /* void bt_replace_separator */
+
+/*
+ * public functions
+ */
+c_btree_t *c_btree_create(int (*compare)(const void *, const void *)) {
+  c_btree_t *t;
+
+  t = calloc(1, sizeof(*t));
+  if (t == NULL)
+    return NULL;
+
+  t->compare = compare;
+
+  return t;
+} /* c_btree_t *c_btree_create */
+
+void c_btree_destroy(c_btree_t *t) {
+  if (t == NULL)
+    return;
+  bt_free(t->root);
+  free(t);
+} /* void c_btree_destroy */
+
+int c_btree_insert(c_btree_t *t, void *key, void *value) {
+  void *up_key = NULL;
+  bt_node_t *up_node = NULL;
+  bt_inner_t *root = NULL;
+  int status;
+
+  if (t == NULL)
+    return -1;
+
+  if (t->root == NULL) {
+    bt_leaf_t *l = calloc(1, sizeof(*l));
+    if (l == NULL)
+      return -1;
+    l->head.leaf = 1;
+    t->root = &l->head;
+  }
+
+  if (t->root->num == BT_ORDER) {
+    root = calloc(1, sizeof(*root));
+    if (root == NULL)
+      return -1;
+  }
+
+  status = bt_insert(t, t->root, key, value, &up_key, &up_node);
+  if ((status != 0) || (up_node == NULL))
+    free(root);
+  if (status != 0)
+    return status;
+
+  if (up_node != NULL) {
+    root->head.num = 1;
+    root->head.key[0] = up_key;
+    root->child[0] = t->root;
+    root->child[1] = up_node;
+    bt_refresh(t, &root->head, BT_ALL);
+    t->root = &root->head;
+  }
+
+  t->size++;
+  return 0;
+} /* int c_btree_insert */
+
+int c_btree_remove(c_btree_t *t, const void *key, void **rkey, void **rvalue) {
+  if ((t == NULL) || (t->root == NULL))
+    return -1;
+
+  if (bt_remove(t, t->root, key, rkey, rvalue) != 0)
+    return -1;
+
+  if (t->root->num == 0) {
+    bt_node_t *old = t->root;
+    t->root = old->leaf ? NULL : BT_INNER(old)->child[0];
+    free(old);
+  }
+
+  bt_replace_separator(t, key);
+
+  t->size--;
+  return 0;
+} /* int c_btree_remove */
+
+int c_btree_get(c_btree_t *t, const void *key, void **value) {
+  bt_leaf_t *l;
+  _Bool found;
+  int pos;
+
+  if ((t == NULL) || (key == NULL))
+    return -1;
+
+  l = bt_find_leaf(t, key);
+  if (l == NULL)
+    return -1;
+
+  pos = bt_search(t, &l->head, key, &found);
+  if (!found)
+    return -1;
+
+  if (value != NULL)
+    *value = l->value[pos];
+
+  return 0;
+} /* int c_btree_get */
+
+int c_btree_pick(c_btree_t *t, void **key, void **value) {
+  bt_leaf_t *l;
+
+  if ((t == NULL) || (key == NULL) || (value == NULL))
+    return -1;
+
+  l = bt_last_leaf(t->root);
+  if ((l == NULL) || (l->head.num == 0))
+    return -1;
+
+  /* The last key is never used as a separator unless it is the only key of
+   * its leaf, so this rarely needs more than a single descent. */
+  return c_btree_remove(t, l->head.key[l->head.num - 1], key, value);
+} /* int c_btree_pick */
+
+c_btree_iterator_t *c_btree_get_iterator(c_btree_t *t) {
+  c_btree_iterator_t *iter;
+
+  if (t == NULL)
+    return NULL;
+
+  iter = calloc(1, sizeof(*iter));
+  if (iter == NULL)
+    return NULL;
+  iter->tree = t;
+
+  return iter;
+} /* c_btree_iterator_t *c_btree_get_iterator */
+
+c_btree_iterator_t *c_btree_get_iterator_from(c_btree_t *t, const void *key) {
+  c_btree_iterator_t *iter;
+  bt_leaf_t *l;
+  _Bool found;
+  int pos;
+
+  iter = c_btree_get_iterator(t);
+  if ((iter == NULL) || (key == NULL))
+    return iter;
+
+  l = bt_find_leaf(t, key);
+  if (l == NULL)
+    return iter;
+
+  /* Position the iterator on the entry before the first one not smaller than
+   * `key'. If there is no such entry, the iterator starts at the beginning. */
+  pos = bt_search(t, &l->head, key, &found);
+  if (pos > 0) {
+    iter->leaf = l;
+    iter->index = pos - 1;
+  } else if (l->prev != NULL) {
+    iter->leaf = l->prev;
+    iter->index = l->prev->head.num - 1;
+  }
+
+  return iter;
+} /* c_btree_iterator_t *c_btree_get_iterator_from */
+
+int c_btree_iterator_next(c_btree_iterator_t *iter, void **key, void **value) {
+  bt_leaf_t *l;
+  int index;
+
+  if ((iter == NULL) || (key == NULL) || (value == NULL))
+    return -1;
+
+  if (iter->leaf == NULL) {
+    l = bt_first_leaf(iter->tree->root);
+    index = 0;
+  } else if (iter->index + 1 < iter->leaf->head.num) {
+    l = iter->leaf;
+    index = iter->index + 1;
+  } else {
+    l = iter->leaf->next;
+    index = 0;
+  }
+
+  if ((l == NULL) || (index >= l->head.num))
+    return -1;
+
+  iter->leaf = l;
+  iter->index = index;
+  *key = l->head.key[index];
+  *value = l->value[index];
+
+  return 0;
+} /* int c_btree_iterator_next */
+
+int c_btree_iterator_prev(c_btree_iterator_t *iter, void **key, void **value) {
+  bt_leaf_t *l;
+  int index;
+
+  if ((iter == NULL) || (key == NULL) || (value == NULL))
+    return -1;
+
+  if (iter->leaf == NULL) {
+    l = bt_last_leaf(iter->tree->root);
+    index = (l != NULL) ? l->head.num - 1 : -1;
+  } else if (iter->index > 0) {
+    l = iter->leaf;
+    index = iter->index - 1;
+  } else {
+    l = iter->leaf->prev;
+    index = (l != NULL) ? l->head.num - 1 : -1;
+  }
+
+  if ((l == NULL) || (index < 0))
+    return -1;
+
+  iter->leaf = l;
+  iter->index = index;
+  *key = l->head.key[index];
+  *value = l->value[index];
+
+  return 0;
+} /* int c_btree_iterator_prev */
+
+void c_btree_iterator_destroy(c_btree_iterator_t *iter) { free(iter); }
+
+int c_btree_size(c_btree_t *t) {
+  if (t == NULL)
+    return 0;
+  return t->size;
+}
@@ -0,0 +1,151 @@
+/**
+ * collectd - src/daemon/utils_btree.h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_BTREE_H
+#define UTILS_BTREE_H 1
+
+/*
+ * An ordered map with the same interface and semantics as the AVL-tree in
+ * "utils_avltree.h", implemented as a B+tree. Each node stores up to a few
+ * dozen keys in contiguous arrays and all entries live in linked leaves, so
+ * lookups touch only a handful of cache lines and iteration is a linear scan.
+ */
+
+struct c_btree_s;
+typedef struct c_btree_s c_btree_t;
+
+struct c_btree_iterator_s;
+typedef struct c_btree_iterator_s c_btree_iterator_t;
+
+/*
+ * NAME
+ *   c_btree_create
+ *
+ * DESCRIPTION
+ *   Allocates a new B+tree.
+ *
+ * PARAMETERS
+ *   `compare'  The function-pointer `compare' is used to compare two keys,
+ *              just like with `c_avl_create'. If `compare' is NULL, keys must
+ *              be null-terminated strings and are ordered like `strcmp' would
+ *              order them. In this mode the tree stores eight bytes of each
+ *              key next to the key pointer, following the prefix all keys of
+ *              a node have in common, and only dereferences keys to break
+ *              ties. Use this for string keys whenever possible.
+ *
+ * RETURN VALUE
+ *   A c_btree_t-pointer upon success or NULL upon failure.
+ */
+c_btree_t *c_btree_create(int (*compare)(const void *, const void *));
+
+/*
+ * NAME
+ *   c_btree_destroy
+ *
+ * DESCRIPTION
+ *   Deallocates a B+tree. Stored value- and key-pointer are lost, but of
+ *   course not freed.
+ */
+void c_btree_destroy(c_btree_t *t);
+
+/*
+ * NAME
+ *   c_btree_insert
+ *
+ * DESCRIPTION
+ *   Stores the key-value-pair in the tree pointed to by `t'. The key pointer
+ *   is _not_ copied, see `c_avl_insert'. Keys must not be modified while they
+ *   are stored in the tree.
+ *
+ * RETURN VALUE
+ *   Zero upon success, non-zero otherwise. It's less than zero if an error
+ *   occurred or greater than zero if the key is already stored in the tree.
+ */
+int c_btree_insert(c_btree_t *t, void *key, void *value);
+
+/*
+ * NAME
+ *   c_btree_remove
+ *
+ * DESCRIPTION
+ *   Removes a key-value-pair from the tree t. The stored key and value may be
+ *   returned in `rkey' and `rvalue', see `c_avl_remove'.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the key isn't found in the tree.
+ */
+int c_btree_remove(c_btree_t *t, const void *key, void **rkey, void **rvalue);
+
+/*
+ * NAME
+ *   c_btree_get
+ *
+ * DESCRIPTION
+ *   Retrieve the `value' belonging to `key'. `value' may be NULL.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the key isn't found in the tree.
+ */
+int c_btree_get(c_btree_t *t, const void *key, void **value);
+
+/*
+ * NAME
+ *   c_btree_pick
+ *
+ * DESCRIPTION
+ *   Remove an element from the tree and return its `key' and `value'. Like
+ *   `c_avl_pick', this is intended for removing all elements, one at a time.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the tree is empty or key or value is
+ *   NULL.
+ */
+int c_btree_pick(c_btree_t *t, void **key, void **value);
+
+/*
+ * NAME
+ *   c_btree_get_iterator, c_btree_get_iterator_from
+ *
+ * DESCRIPTION
+ *   Creates an iterator. The first call to `c_btree_iterator_next' returns the
+ *   smallest key, respectively the smallest key which is greater than or equal
+ *   to `key'; the first call to `c_btree_iterator_prev' on an iterator
+ *   returned by `c_btree_get_iterator' returns the largest key. Iterators are
+ *   invalidated by `c_btree_insert', `c_btree_remove' and `c_btree_pick'.
+ */
+c_btree_iterator_t *c_btree_get_iterator(c_btree_t *t);
+c_btree_iterator_t *c_btree_get_iterator_from(c_btree_t *t, const void *key);
+
+int c_btree_iterator_next(c_btree_iterator_t *iter, void **key, void **value);
+int c_btree_iterator_prev(c_btree_iterator_t *iter, void **key, void **value);
+void c_btree_iterator_destroy(c_btree_iterator_t *iter);
+
+/*
+ * NAME
+ *   c_btree_size
+ *
+ * RETURN VALUE
+ *   Number of entries in the tree, 0 if the tree is empty or NULL.
+ */
+int c_btree_size(c_btree_t *t);
+
+#endif /* UTILS_BTREE_H */
@@ -0,0 +1,133 @@
+/**
+ * collectd - src/daemon/utils_btree_bench.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+/*
+ * Reports the time inserting and looking up value cache like keys takes with
+ * the AVL-tree and the B+tree. Not part of the test suite, build it with
+ * "make bench_utils_btree".
+ */
+
+#include "collectd.h"
+
+#include "utils_avltree.h"
+#include "utils_btree.h"
+
+#include <time.h>
+
+#define DEFAULT_KEYS 100000
+#define DEFAULT_LOOKUPS 500000
+
+/* Identifiers sharing long prefixes, like the keys of the value cache. */
+static char *make_key(unsigned int n) {
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), "host%u.example.com/cpu-%u/cpu-%s%u",
+           n % 7, (n / 7) % 64, (n % 2) ? "user" : "system", n);
+  return strdup(buffer);
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  unsigned int keys_num = DEFAULT_KEYS;
+  unsigned int lookups_num = DEFAULT_LOOKUPS;
+  char **keys;
+  c_avl_tree_t *a;
+  c_btree_t *b;
+  unsigned int seed = 1;
+  double t0;
+  double avl_insert, avl_get, btree_insert, btree_get;
+  int errors = 0;
+
+  if (argc > 3) {
+    fprintf(stderr, "Usage: %s [<keys> [<lookups>]]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (argc > 1)
+    keys_num = (unsigned int)strtoul(argv[1], NULL, 0);
+  if (argc > 2)
+    lookups_num = (unsigned int)strtoul(argv[2], NULL, 0);
+  if (keys_num == 0) {
+    fprintf(stderr, "The number of keys must be positive.\n");
+    return EXIT_FAILURE;
+  }
+
+  keys = calloc(keys_num, sizeof(*keys));
+  if (keys == NULL) {
+    fprintf(stderr, "calloc failed.\n");
+    return EXIT_FAILURE;
+  }
+  for (unsigned int i = 0; i < keys_num; i++) {
+    keys[i] = make_key(i);
+    if (keys[i] == NULL) {
+      fprintf(stderr, "strdup failed.\n");
+      return EXIT_FAILURE;
+    }
+  }
+
+  a = c_avl_create((int (*)(const void *, const void *))strcmp);
+  b = c_btree_create(NULL);
+  if ((a == NULL) || (b == NULL)) {
+    fprintf(stderr, "Creating the trees failed.\n");
+    return EXIT_FAILURE;
+  }
+
+  t0 = now();
+  for (unsigned int i = 0; i < keys_num; i++)
+    c_avl_insert(a, keys[i], keys[i]);
+  avl_insert = now() - t0;
+
+  t0 = now();
+  for (unsigned int i = 0; i < keys_num; i++)
+    c_btree_insert(b, keys[i], keys[i]);
+  btree_insert = now() - t0;
+
+  t0 = now();
+  for (unsigned int i = 0; i < lookups_num; i++)
+    errors += c_avl_get(a, keys[rand_r(&seed) % keys_num], NULL);
+  avl_get = now() - t0;
+
+  seed = 1;
+  t0 = now();
+  for (unsigned int i = 0; i < lookups_num; i++)
+    errors += c_btree_get(b, keys[rand_r(&seed) % keys_num], NULL);
+  btree_get = now() - t0;
+
+  printf("%u keys, %u lookups:\n", keys_num, lookups_num);
+  printf("  avltree: insert %.3fs, get %.3fs\n", avl_insert, avl_get);
+  printf("  btree:   insert %.3fs, get %.3fs\n", btree_insert, btree_get);
+
+  c_avl_destroy(a);
+  c_btree_destroy(b);
+  for (unsigned int i = 0; i < keys_num; i++)
+    free(keys[i]);
+  free(keys);
+
+  if (errors != 0) {
+    fprintf(stderr, "%d lookups failed.\n", errors);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,319 @@
+/**
+ * collectd - src/daemon/utils_btree_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "common.h" /* STATIC_ARRAY_SIZE */
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils_avltree.h"
+#include "utils_btree.h"
+
+static int compare_total_count = 0;
+
+static int compare_callback(void const *v0, void const *v1) {
+  assert(v0 != NULL);
+  assert(v1 != NULL);
+
+  compare_total_count++;
+  return strcmp(v0, v1);
+}
+
+/* Same workload as the "success" test of test_utils_avltree, run with a
+ * comparison function and with inline string prefixes. */
+static int check_success(int (*compare)(const void *, const void *)) {
+  struct {
+    char *key;
+    char *value;
+  } cases[] = {
+      {"Eeph7chu", "vai1reiV"}, {"igh3Paiz", "teegh1Ee"},
+      {"caip6Uu8", "ooteQu8n"}, {"Aech6vah", "AijeeT0l"},
+      {"Xah0et2L", "gah8Taep"}, {"BocaeB8n", "oGaig8io"},
+      {"thai8AhM", "ohjeFo3f"}, {"ohth6ieC", "hoo8ieWo"},
+      {"aej7Woow", "phahuC2s"}, {"Hai8ier2", "Yie6eimi"},
+      {"phuXi3Li", "JaiF7ieb"}, {"Shaig5ef", "aihi5Zai"},
+      {"voh6Aith", "Oozaeto0"}, {"zaiP5kie", "seep5veM"},
+      {"pae7ba7D", "chie8Ojo"}, {"Gou2ril3", "ouVoo0ha"},
+      {"lo3Thee3", "ahDu4Zuj"}, {"Rah8kohv", "ieShoc7E"},
+      {"ieN5engi", "Aevou1ah"}, {"ooTe4OhP", "aingai5Y"},
+  };
+
+  c_btree_t *t;
+
+  CHECK_NOT_NULL(t = c_btree_create(compare));
+
+  /* insert */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char *key;
+    char *value;
+
+    CHECK_NOT_NULL(key = strdup(cases[i].key));
+    CHECK_NOT_NULL(value = strdup(cases[i].value));
+
+    CHECK_ZERO(c_btree_insert(t, key, value));
+    EXPECT_EQ_INT((int)(i + 1), c_btree_size(t));
+  }
+
+  /* Key already exists. */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++)
+    EXPECT_EQ_INT(1, c_btree_insert(t, cases[i].key, cases[i].value));
+
+  /* get */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char *value_ret = NULL;
+
+    CHECK_ZERO(c_btree_get(t, cases[i].key, (void *)&value_ret));
+    EXPECT_EQ_STR(cases[i].value, value_ret);
+  }
+
+  /* remove half */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases) / 2; i++) {
+    char *key = NULL;
+    char *value = NULL;
+
+    int expected_size = (int)(STATIC_ARRAY_SIZE(cases) - (i + 1));
+
+    CHECK_ZERO(c_btree_remove(t, cases[i].key, (void *)&key, (void *)&value));
+
+    EXPECT_EQ_STR(cases[i].key, key);
+    EXPECT_EQ_STR(cases[i].value, value);
+
+    free(key);
+    free(value);
+
+    EXPECT_EQ_INT(expected_size, c_btree_size(t));
+  }
+
+  /* pick the other half */
+  for (size_t i = STATIC_ARRAY_SIZE(cases) / 2; i < STATIC_ARRAY_SIZE(cases);
+       i++) {
+    char *key = NULL;
+    char *value = NULL;
+
+    int expected_size = (int)(STATIC_ARRAY_SIZE(cases) - (i + 1));
+
+    EXPECT_EQ_INT(expected_size + 1, c_btree_size(t));
+    EXPECT_EQ_INT(0, c_btree_pick(t, (void *)&key, (void *)&value));
+
+    free(key);
+    free(value);
+
+    EXPECT_EQ_INT(expected_size, c_btree_size(t));
+  }
+
+  c_btree_destroy(t);
+
+  return 0;
+}
+
+DEF_TEST(success) {
+  CHECK_ZERO(check_success(compare_callback));
+  CHECK_ZERO(check_success(NULL));
+  return 0;
+}
+
+DEF_TEST(iterator_from) {
+  char *keys[] = {"b", "d", "f", "h"};
+  struct {
+    char *key;
+    char *want;
+  } cases[] = {
+      {"a", "b"}, {"b", "b"}, {"c", "d"}, {"f", "f"},
+      {"g", "h"}, {"h", "h"}, {"i", NULL}, {NULL, "b"},
+  };
+  c_btree_t *t;
+
+  CHECK_NOT_NULL(t = c_btree_create(NULL));
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(keys); i++)
+    CHECK_ZERO(c_btree_insert(t, keys[i], keys[i]));
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    c_btree_iterator_t *iter;
+    char *key = NULL;
+    char *value = NULL;
+    char *prev = NULL;
+    int num = 0;
+    int unordered = 0;
+
+    CHECK_NOT_NULL(iter = c_btree_get_iterator_from(t, cases[i].key));
+    if (cases[i].want == NULL) {
+      EXPECT_EQ_INT(-1,
+                    c_btree_iterator_next(iter, (void *)&key, (void *)&value));
+      c_btree_iterator_destroy(iter);
+      continue;
+    }
+
+    CHECK_ZERO(c_btree_iterator_next(iter, (void *)&key, (void *)&value));
+    EXPECT_EQ_STR(cases[i].want, key);
+
+    /* The remaining keys follow in order. */
+    do {
+      if ((prev != NULL) && (strcmp(prev, key) >= 0))
+        unordered++;
+      prev = key;
+      num++;
+    } while (c_btree_iterator_next(iter, (void *)&key, (void *)&value) == 0);
+    EXPECT_EQ_INT(0, unordered);
+    EXPECT_EQ_INT((int)STATIC_ARRAY_SIZE(keys) -
+                      (int)(cases[i].want[0] - 'b') / 2,
+                  num);
+
+    c_btree_iterator_destroy(iter);
+  }
+
+  c_btree_destroy(t);
+  return 0;
+}
+
+/* Identifiers sharing long prefixes, like the keys of the value cache. */
+static char *make_key(unsigned int n) {
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), "host%u.example.com/cpu-%u/cpu-%s%u",
+           n % 7, (n / 7) % 64, (n % 2) ? "user" : "system", n);
+  return strdup(buffer);
+}
+
+/* Applies random inserts and removals to a B+tree and an AVL-tree and
+ * compares their contents. Removed keys are freed right away, so a separator
+ * still pointing to one would be caught by memory checkers. */
+static int check_random(int (*compare)(const void *, const void *)) {
+  c_btree_t *b;
+  c_avl_tree_t *a;
+  unsigned int seed = 42;
+  int errors = 0;
+
+  CHECK_NOT_NULL(b = c_btree_create(compare));
+  CHECK_NOT_NULL(a = c_avl_create(compare_callback));
+
+  for (int round = 0; round < 50000; round++) {
+    unsigned int n = (unsigned int)rand_r(&seed) % 4000;
+    char *key = make_key(n);
+    void *bkey = NULL;
+    void *bvalue = NULL;
+    void *akey = NULL;
+    void *avalue = NULL;
+
+    /* Insert twice as often during the first half, remove twice as often
+     * during the second, so the tree grows and shrinks again. */
+    _Bool insert = ((rand_r(&seed) % 3) == 0) != (round < 25000);
+
+    if (insert) {
+      int bs = c_btree_insert(b, key, (void *)(uintptr_t)n);
+      int as = c_avl_insert(a, key, (void *)(uintptr_t)n);
+      if ((bs != as) || (bs < 0))
+        errors++;
+      if (bs != 0)
+        free(key);
+      continue;
+    }
+
+    int bs = c_btree_remove(b, key, &bkey, &bvalue);
+    int as = c_avl_remove(a, key, &akey, &avalue);
+    if ((bs != as) || (bkey != akey) || (bvalue != avalue))
+      errors++;
+    free(key);
+    free(bkey);
+  }
+  EXPECT_EQ_INT(0, errors);
+  EXPECT_EQ_INT(c_avl_size(a), c_btree_size(b));
+
+  /* Both iterate over the same entries, in both directions. */
+  for (int dir = 0; dir < 2; dir++) {
+    c_btree_iterator_t *bi = c_btree_get_iterator(b);
+    c_avl_iterator_t *ai = c_avl_get_iterator(a);
+    void *bkey;
+    void *bvalue;
+    void *akey;
+    void *avalue;
+    int num = 0;
+
+    while (1) {
+      int bs = dir ? c_btree_iterator_prev(bi, &bkey, &bvalue)
+                   : c_btree_iterator_next(bi, &bkey, &bvalue);
+      int as = dir ? c_avl_iterator_prev(ai, &akey, &avalue)
+                   : c_avl_iterator_next(ai, &akey, &avalue);
+      if (bs != as) {
+        errors++;
+        break;
+      }
+      if (bs != 0)
+        break;
+      if ((bkey != akey) || (bvalue != avalue))
+        errors++;
+      num++;
+    }
+    EXPECT_EQ_INT(0, errors);
+    EXPECT_EQ_INT(c_avl_size(a), num);
+
+    c_btree_iterator_destroy(bi);
+    c_avl_iterator_destroy(ai);
+  }
+
+  /* Seeking finds the same entry as the AVL-tree. */
+  for (unsigned int n = 0; n < 4000; n += 3) {
+    char *key = make_key(n);
+    c_btree_iterator_t *bi = c_btree_get_iterator_from(b, key);
+    c_avl_iterator_t *ai = c_avl_get_iterator_from(a, key);
+    void *bkey = NULL;
+    void *bvalue;
+    void *akey = NULL;
+    void *avalue;
+
+    if ((c_btree_iterator_next(bi, &bkey, &bvalue) !=
+         c_avl_iterator_next(ai, &akey, &avalue)) ||
+        (bkey != akey))
+      errors++;
+
+    c_btree_iterator_destroy(bi);
+    c_avl_iterator_destroy(ai);
+    free(key);
+  }
+  EXPECT_EQ_INT(0, errors);
+
+  void *key;
+  void *value;
+  while (c_btree_pick(b, &key, &value) == 0) {
+    if (c_avl_remove(a, key, NULL, NULL) != 0)
+      errors++;
+    free(key);
+  }
+  EXPECT_EQ_INT(0, errors);
+  EXPECT_EQ_INT(0, c_btree_size(b));
+  EXPECT_EQ_INT(0, c_avl_size(a));
+
+  c_btree_destroy(b);
+  c_avl_destroy(a);
+  return 0;
+}
+
+DEF_TEST(random) {
+  CHECK_ZERO(check_random(compare_callback));
+  CHECK_ZERO(check_random(NULL));
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(success);
+  RUN_TEST(iterator_from);
+  RUN_TEST(random);
+
+  END_TEST;
+}
@@ -31,8 +31,9 @@
 #include "common.h"
 #include "meta_data.h"
 #include "plugin.h"
-#include "utils_avltree.h"
+#include "utils_btree.h"
 #include "utils_cache.h"
+#include "utils_stats.h"
 
 #include <assert.h>
 
@@ -66,25 +67,27 @@ typedef struct cache_entry_s {
   size_t history_index; /* points to the next position to write to. */
   size_t history_length;
 
+  /* Multi-resolution history of the rates, if enabled. */
+  history_t *tiers;
+
   meta_data_t *meta;
 } cache_entry_t;
 
 struct uc_iter_s {
-  c_avl_iterator_t *iter;
+  c_btree_iterator_t *iter;
+
+  /* Only entries whose name starts with `prefix' are returned. */
+  char *prefix;
+  size_t prefix_len;
+  char *after;
 
   char *name;
   cache_entry_t *entry;
 };
 
-static c_avl_tree_t *cache_tree = NULL;
+static c_btree_t *cache_tree = NULL;
 static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
-
-static int cache_compare(const cache_entry_t *a, const cache_entry_t *b) {
-#if COLLECT_DEBUG
-  assert((a != NULL) && (b != NULL));
-#endif
-  return strcmp(a->name, b->name);
-} /* int cache_compare */
+static int cache_lock_stats = -1;
 
 static cache_entry_t *cache_alloc(size_t values_num) {
   cache_entry_t *ce;
@@ -120,6 +123,7 @@ static void cache_free(cache_entry_t *ce) {
   sfree(ce->values_gauge);
   sfree(ce->values_raw);
   sfree(ce->history);
+  history_destroy(ce->tiers);
   if (ce->meta != NULL) {
     meta_data_destroy(ce->meta);
     ce->meta = NULL;
@@ -203,9 +207,14 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
   ce->interval = vl->interval;
   ce->state = STATE_OKAY;
 
-  if (c_avl_insert(cache_tree, key_copy, ce) != 0) {
+  if (history_enabled()) {
+    ce->tiers = history_create(ce->values_num, vl->interval);
+    history_add(ce->tiers, vl->time, ce->values_gauge);
+  }
+
+  if (c_btree_insert(cache_tree, key_copy, ce) != 0) {
     sfree(key_copy);
-    ERROR("uc_insert: c_avl_insert failed.");
+    ERROR("uc_insert: c_btree_insert failed.");
     return -1;
   }
 
@@ -215,8 +224,9 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
 
 int uc_init(void) {
   if (cache_tree == NULL)
-    cache_tree =
-        c_avl_create((int (*)(const void *, const void *))cache_compare);
+    cache_tree = c_btree_create(/* compare = */ NULL);
+
+  cache_lock_stats = stats_register(STATS_LOCK, "cache_lock");
 
   return 0;
 } /* int uc_init */
@@ -229,14 +239,14 @@ int uc_check_timeout(void) {
   } *expired = NULL;
   size_t expired_num = 0;
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
   cdtime_t now = cdtime();
 
   /* Build a list of entries to be flushed */
-  c_avl_iterator_t *iter = c_avl_get_iterator(cache_tree);
+  c_btree_iterator_t *iter = c_btree_get_iterator(cache_tree);
   char *key = NULL;
   cache_entry_t *ce = NULL;
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&ce) == 0) {
+  while (c_btree_iterator_next(iter, (void *)&key, (void *)&ce) == 0) {
     /* If the entry is fresh enough, continue. */
     if ((now - ce->last_update) < (ce->interval * timeout_g))
       continue;
@@ -258,9 +268,9 @@ int uc_check_timeout(void) {
     }
 
     expired_num++;
-  } /* while (c_avl_iterator_next) */
+  } /* while (c_btree_iterator_next) */
 
-  c_avl_iterator_destroy(iter);
+  c_btree_iterator_destroy(iter);
   pthread_mutex_unlock(&cache_lock);
 
   if (expired_num == 0) {
@@ -290,14 +300,15 @@ int uc_check_timeout(void) {
   /* Now actually remove all the values from the cache. We don't re-evaluate
    * the timestamp again, so in theory it is possible we remove a value after
    * it is updated here. */
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
   for (size_t i = 0; i < expired_num; i++) {
     char *key = NULL;
     cache_entry_t *value = NULL;
 
-    if (c_avl_remove(cache_tree, expired[i].key, (void *)&key,
-                     (void *)&value) != 0) {
-      ERROR("uc_check_timeout: c_avl_remove (\"%s\") failed.", expired[i].key);
+    if (c_btree_remove(cache_tree, expired[i].key, (void *)&key,
+                       (void *)&value) != 0) {
+      ERROR("uc_check_timeout: c_btree_remove (\"%s\") failed.",
+            expired[i].key);
       sfree(expired[i].key);
       continue;
     }
@@ -322,9 +333,9 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
     return -1;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  status = c_avl_get(cache_tree, name, (void *)&ce);
+  status = c_btree_get(cache_tree, name, (void *)&ce);
   if (status != 0) /* entry does not yet exist */
   {
     status = uc_insert(ds, vl, name);
@@ -399,6 +410,8 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
   /* Prune invalid gauge data */
   uc_check_range(ds, ce);
 
+  history_add(ce->tiers, vl->time, ce->values_gauge);
+
   ce->last_time = vl->time;
   ce->last_update = cdtime();
   ce->interval = vl->interval;
@@ -415,9 +428,9 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
   cache_entry_t *ce = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_btree_get(cache_tree, name, (void *)&ce) == 0) {
     assert(ce != NULL);
 
     /* remove missing values from getval */
@@ -486,9 +499,9 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
   cache_entry_t *ce = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_btree_get(cache_tree, name, (void *)&ce) == 0) {
     assert(ce != NULL);
 
     /* remove missing values from getval */
@@ -550,15 +563,15 @@ value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl) {
 size_t uc_get_size(void) {
   size_t size_arrays = 0;
 
-  pthread_mutex_lock(&cache_lock);
-  size_arrays = (size_t)c_avl_size(cache_tree);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
+  size_arrays = (size_t)c_btree_size(cache_tree);
   pthread_mutex_unlock(&cache_lock);
 
   return size_arrays;
 }
 
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
-  c_avl_iterator_t *iter;
+  c_btree_iterator_t *iter;
   char *key;
   cache_entry_t *value;
 
@@ -572,9 +585,9 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   if ((ret_names == NULL) || (ret_number == NULL))
     return -1;
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  size_arrays = (size_t)c_avl_size(cache_tree);
+  size_arrays = (size_t)c_btree_size(cache_tree);
   if (size_arrays < 1) {
     /* Handle the "no values" case here, to avoid the error message when
      * calloc() returns NULL. */
@@ -592,14 +605,14 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
     return ENOMEM;
   }
 
-  iter = c_avl_get_iterator(cache_tree);
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&value) == 0) {
+  iter = c_btree_get_iterator(cache_tree);
+  while (c_btree_iterator_next(iter, (void *)&key, (void *)&value) == 0) {
     /* remove missing values when list values */
     if (value->state == STATE_MISSING)
       continue;
 
-    /* c_avl_size does not return a number smaller than the number of elements
-     * returned by c_avl_iterator_next. */
+    /* c_btree_size does not return a number smaller than the number of
+     * elements returned by c_btree_iterator_next. */
     assert(number < size_arrays);
 
     if (ret_times != NULL)
@@ -612,9 +625,9 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
     }
 
     number++;
-  } /* while (c_avl_iterator_next) */
+  } /* while (c_btree_iterator_next) */
 
-  c_avl_iterator_destroy(iter);
+  c_btree_iterator_destroy(iter);
   pthread_mutex_unlock(&cache_lock);
 
   if (status != 0) {
@@ -647,9 +660,9 @@ int uc_get_state(const data_set_t *ds, const value_list_t *vl) {
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_btree_get(cache_tree, name, (void *)&ce) == 0) {
     assert(ce != NULL);
     ret = ce->state;
   }
@@ -669,9 +682,9 @@ int uc_set_state(const data_set_t *ds, const value_list_t *vl, int state) {
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_btree_get(cache_tree, name, (void *)&ce) == 0) {
     assert(ce != NULL);
     ret = ce->state;
     ce->state = state;
@@ -687,9 +700,9 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
   cache_entry_t *ce = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  status = c_avl_get(cache_tree, name, (void *)&ce);
+  status = c_btree_get(cache_tree, name, (void *)&ce);
   if (status != 0) {
     pthread_mutex_unlock(&cache_lock);
     return -ENOENT;
@@ -742,6 +755,38 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
   return 0;
 } /* int uc_get_history_by_name */
 
+int uc_get_history_range(const char *name, cdtime_t begin, /* {{{ */
+                         cdtime_t end, history_result_t *res) {
+  cache_entry_t *ce = NULL;
+  int status;
+
+  if ((name == NULL) || (res == NULL))
+    return EINVAL;
+
+  if (!history_enabled())
+    return ENOTSUP;
+
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
+
+  if (c_btree_get(cache_tree, name, (void *)&ce) != 0) {
+    pthread_mutex_unlock(&cache_lock);
+    DEBUG("utils_cache: uc_get_history_range: No such value: %s", name);
+    return ENOENT;
+  }
+  assert(ce != NULL);
+
+  if (ce->tiers == NULL) {
+    /* history_create() failed when the entry was added. */
+    pthread_mutex_unlock(&cache_lock);
+    return ENOMEM;
+  }
+
+  status = history_query(ce->tiers, begin, end, res);
+  pthread_mutex_unlock(&cache_lock);
+
+  return status;
+} /* }}} int uc_get_history_range */
+
 int uc_get_history(const data_set_t *ds, const value_list_t *vl,
                    gauge_t *ret_history, size_t num_steps, size_t num_ds) {
   char name[6 * DATA_MAX_NAME_LEN];
@@ -764,9 +809,9 @@ int uc_get_hits(const data_set_t *ds, const value_list_t *vl) {
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_btree_get(cache_tree, name, (void *)&ce) == 0) {
     assert(ce != NULL);
     ret = ce->hits;
   }
@@ -786,9 +831,9 @@ int uc_set_hits(const data_set_t *ds, const value_list_t *vl, int hits) {
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_btree_get(cache_tree, name, (void *)&ce) == 0) {
     assert(ce != NULL);
     ret = ce->hits;
     ce->hits = hits;
@@ -809,9 +854,9 @@ int uc_inc_hits(const data_set_t *ds, const value_list_t *vl, int step) {
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (c_btree_get(cache_tree, name, (void *)&ce) == 0) {
     assert(ce != NULL);
     ret = ce->hits;
     ce->hits = ret + step;
@@ -832,10 +877,11 @@ uc_iter_t *uc_get_iterator(void) {
   if (iter == NULL)
     return NULL;
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  iter->iter = c_avl_get_iterator(cache_tree);
+  iter->iter = c_btree_get_iterator(cache_tree);
   if (iter->iter == NULL) {
+    pthread_mutex_unlock(&cache_lock);
     free(iter);
     return NULL;
   }
@@ -843,14 +889,72 @@ uc_iter_t *uc_get_iterator(void) {
   return iter;
 } /* uc_iter_t *uc_get_iterator */
 
+uc_iter_t *uc_get_iterator_prefix(const char *prefix, const char *after) {
+  uc_iter_t *iter;
+  const char *start;
+
+  if (prefix == NULL)
+    prefix = "";
+
+  iter = calloc(1, sizeof(*iter));
+  if (iter == NULL)
+    return NULL;
+
+  iter->prefix = strdup(prefix);
+  if (iter->prefix == NULL) {
+    free(iter);
+    return NULL;
+  }
+  iter->prefix_len = strlen(prefix);
+
+  /* Names are ordered by strcmp(), so all names sharing the prefix are
+   * adjacent and the first one is the smallest name not less than the
+   * prefix. */
+  start = prefix;
+  if ((after != NULL) && (strcmp(after, prefix) > 0))
+    start = after;
+
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
+
+  iter->iter = c_btree_get_iterator_from(cache_tree, start);
+  if (iter->iter == NULL) {
+    pthread_mutex_unlock(&cache_lock);
+    free(iter->prefix);
+    free(iter);
+    return NULL;
+  }
+
+  /* `after' itself has already been returned and is skipped if it still
+   * exists. */
+  if ((start == after) && ((iter->after = strdup(after)) == NULL)) {
+    uc_iterator_destroy(iter);
+    return NULL;
+  }
+
+  return iter;
+} /* uc_iter_t *uc_get_iterator_prefix */
+
 int uc_iterator_next(uc_iter_t *iter, char **ret_name) {
   int status;
 
   if (iter == NULL)
     return -1;
 
-  while ((status = c_avl_iterator_next(iter->iter, (void *)&iter->name,
-                                       (void *)&iter->entry)) == 0) {
+  while ((status = c_btree_iterator_next(iter->iter, (void *)&iter->name,
+                                         (void *)&iter->entry)) == 0) {
+    if ((iter->prefix_len > 0) &&
+        (strncmp(iter->name, iter->prefix, iter->prefix_len) != 0)) {
+      status = -1;
+      break;
+    }
+
+    if (iter->after != NULL) {
+      int cmp = strcmp(iter->name, iter->after);
+      sfree(iter->after);
+      if (cmp == 0)
+        continue;
+    }
+
     if (iter->entry->state == STATE_MISSING)
       continue;
 
@@ -872,9 +976,11 @@ void uc_iterator_destroy(uc_iter_t *iter) {
   if (iter == NULL)
     return;
 
-  c_avl_iterator_destroy(iter->iter);
+  c_btree_iterator_destroy(iter->iter);
   pthread_mutex_unlock(&cache_lock);
 
+  free(iter->prefix);
+  free(iter->after);
   free(iter);
 } /* void uc_iterator_destroy */
 
@@ -897,7 +1003,7 @@ int uc_iterator_get_values(uc_iter_t *iter, value_t **ret_values,
   if (*ret_values == NULL)
     return -1;
   for (size_t i = 0; i < iter->entry->values_num; ++i)
-    *ret_values[i] = iter->entry->values_raw[i];
+    (*ret_values)[i] = iter->entry->values_raw[i];
 
   *ret_num = iter->entry->values_num;
 
@@ -937,9 +1043,9 @@ static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
     return NULL;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  stats_mutex_lock(&cache_lock, cache_lock_stats);
 
-  status = c_avl_get(cache_tree, name, (void *)&ce);
+  status = c_btree_get(cache_tree, name, (void *)&ce);
   if (status != 0) {
     pthread_mutex_unlock(&cache_lock);
     return NULL;
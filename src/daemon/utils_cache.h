@@ -30,6 +30,7 @@
 #define UTILS_CACHE_H 1
 
 #include "plugin.h"
+#include "utils_history.h"
 
 #define STATE_OKAY 0
 #define STATE_WARNING 1
@@ -59,6 +60,22 @@ int uc_get_history(const data_set_t *ds, const value_list_t *vl,
 int uc_get_history_by_name(const char *name, gauge_t *ret_history,
                            size_t num_steps, size_t num_ds);
 
+/*
+ * NAME
+ *   uc_get_history_range
+ *
+ * DESCRIPTION
+ *   Returns the rates of the value list `name' between `begin' and `end' from
+ *   the tiered history, see history_query(). The result must be freed with
+ *   history_result_free().
+ *
+ * RETURN VALUE
+ *   Zero on success, ENOENT if there is no such value list, ENOTSUP if the
+ *   history is disabled, or another error code on failure.
+ */
+int uc_get_history_range(const char *name, cdtime_t begin, cdtime_t end,
+                         history_result_t *res);
+
 /*
  * Iterator interface
  */
@@ -78,6 +95,23 @@ typedef struct uc_iter_s uc_iter_t;
  */
 uc_iter_t *uc_get_iterator(void);
 
+/*
+ * NAME
+ *   uc_get_iterator_prefix
+ *
+ * DESCRIPTION
+ *   Create an iterator for the cache entries whose names start with `prefix'.
+ *   The entries are looked up in logarithmic time instead of walking the whole
+ *   cache. If `after' is not NULL, iteration starts with the first name
+ *   following `after', which allows to resume an iteration after the cache
+ *   lock has been released. Like uc_get_iterator(), the iterator holds the
+ *   cache lock until it's destroyed.
+ *
+ * RETURN VALUE
+ *   An iterator object on success or NULL else.
+ */
+uc_iter_t *uc_get_iterator_prefix(const char *prefix, const char *after);
+
 /*
  * NAME
  *   uc_iterator_next
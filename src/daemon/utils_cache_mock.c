@@ -38,6 +38,11 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
   return ENOTSUP;
 }
 
+int uc_get_history_range(const char *name, cdtime_t begin, cdtime_t end,
+                         history_result_t *res) {
+  return ENOTSUP;
+}
+
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   return ENOTSUP;
 }
@@ -31,11 +31,8 @@
 #include "plugin.h"
 #include "utils_complain.h"
 
-/* vcomplain returns 0 if it did not report, 1 else */
-__attribute__((format(printf, 3, 0))) static int
-vcomplain(int level, c_complain_t *c, const char *format, va_list ap) {
+_Bool c_complain_check(c_complain_t *c) {
   cdtime_t now;
-  char message[512];
 
   now = cdtime();
 
@@ -52,6 +49,18 @@ vcomplain(int level, c_complain_t *c, const char *format, va_list ap) {
   if (c->interval > TIME_T_TO_CDTIME_T(86400))
     c->interval = TIME_T_TO_CDTIME_T(86400);
 
+  c->complained_once = 1;
+  return 1;
+} /* c_complain_check */
+
+/* vcomplain returns 0 if it did not report, 1 else */
+__attribute__((format(printf, 3, 0))) static int
+vcomplain(int level, c_complain_t *c, const char *format, va_list ap) {
+  char message[512];
+
+  if (!c_complain_check(c))
+    return 0;
+
   vsnprintf(message, sizeof(message), format, ap);
   message[sizeof(message) - 1] = '\0';
 
@@ -80,16 +89,22 @@ void c_complain_once(int level, c_complain_t *c, const char *format, ...) {
   va_end(ap);
 } /* c_complain_once */
 
+_Bool c_release_check(c_complain_t *c) {
+  if (c->interval == 0)
+    return 0;
+
+  c->interval = 0;
+  c->complained_once = 0;
+  return 1;
+} /* c_release_check */
+
 void c_do_release(int level, c_complain_t *c, const char *format, ...) {
   char message[512];
   va_list ap;
 
-  if (c->interval == 0)
+  if (!c_release_check(c))
     return;
 
-  c->interval = 0;
-  c->complained_once = 0;
-
   va_start(ap, format);
   vsnprintf(message, sizeof(message), format, ap);
   message[sizeof(message) - 1] = '\0';
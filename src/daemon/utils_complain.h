@@ -85,6 +85,17 @@ c_complain(int level, c_complain_t *c, const char *format, ...);
 __attribute__((format(printf, 3, 4))) void
 c_complain_once(int level, c_complain_t *c, const char *format, ...);
 
+/*
+ * NAME
+ *   c_complain_check
+ *
+ * DESCRIPTION
+ *   Updates the complaint like `c_complain' but does not report anything.
+ *   Returns true if the message is due and the caller should report it, for
+ *   example after releasing a lock that must not be held while logging.
+ */
+_Bool c_complain_check(c_complain_t *c);
+
 /*
  * NAME
  *   c_would_release
@@ -106,6 +117,17 @@ c_complain_once(int level, c_complain_t *c, const char *format, ...);
  */
 __attribute__((format(printf, 3, 4))) void
 c_do_release(int level, c_complain_t *c, const char *format, ...);
+/*
+ * NAME
+ *   c_release_check
+ *
+ * DESCRIPTION
+ *   Releases the complaint like `c_release' but does not report anything.
+ *   Returns true if the complaint was active and the caller should report
+ *   its release.
+ */
+_Bool c_release_check(c_complain_t *c);
+
 #define c_release(level, c, ...)                                               \
   do {                                                                         \
     if (c_would_release(c))                                                    \
@@ -0,0 +1,432 @@
+/**
+ * collectd - src/daemon/utils_history.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_history.h"
+
+#include <assert.h>
+
+#define HISTORY_MAX_TIERS 8
+
+typedef struct {
+  cdtime_t resolution;
+  cdtime_t duration;
+} history_tier_conf_t;
+
+static cdtime_t conf_raw_duration = 0;
+static history_tier_conf_t conf_tiers[HISTORY_MAX_TIERS];
+static size_t conf_tiers_num = 0;
+static size_t conf_max_points = 0;
+
+/* A ring of points. Raw rings only use the "sum" column, which holds the
+ * values. Tiers accumulate all points of a bucket in the last slot. */
+typedef struct {
+  _Bool raw;
+  /* Bucket width, or the interval raw points were sized for. */
+  cdtime_t resolution;
+
+  size_t length;
+  size_t index; /* points to the next slot to write to. */
+  size_t num;   /* number of slots in use. */
+
+  /*
+   * Columns of the values are laid out one data source after the other:
+   *
+   * +--------+--------+-----+--------+--------+--------+-----+----
+   * ! slot 0 ! slot 1 ! ... ! slot n ! slot 0 ! slot 1 ! ... ! ...
+   * +--------+--------+-----+--------+--------+--------+-----+----
+   * !          ds0                   !          ds1             ...
+   * +--------------------------------+--------------------------+----
+   */
+  cdtime_t *time;
+  gauge_t *sum;
+  gauge_t *min;
+  gauge_t *max;
+  uint32_t *count;
+} history_ring_t;
+
+struct history_s {
+  size_t values_num;
+  size_t size;
+
+  size_t rings_num;
+  history_ring_t rings[];
+};
+
+static int tier_compare(const void *a, const void *b) /* {{{ */
+{
+  cdtime_t ra = ((const history_tier_conf_t *)a)->resolution;
+  cdtime_t rb = ((const history_tier_conf_t *)b)->resolution;
+
+  return (ra < rb) ? -1 : (ra > rb) ? 1 : 0;
+} /* }}} int tier_compare */
+
+int history_configure(cdtime_t raw_duration, const char *tiers, /* {{{ */
+                      size_t max_points) {
+  history_tier_conf_t tmp[HISTORY_MAX_TIERS];
+  size_t tmp_num = 0;
+  char *copy;
+  char *saveptr = NULL;
+
+  if (max_points < 1)
+    return EINVAL;
+
+  copy = strdup((tiers != NULL) ? tiers : "");
+  if (copy == NULL)
+    return ENOMEM;
+
+  for (char *ptr = copy, *tier; (tier = strtok_r(ptr, " \t", &saveptr)) != NULL;
+       ptr = NULL) {
+    double resolution;
+    double duration;
+    char garbage;
+
+    if (tmp_num >= HISTORY_MAX_TIERS) {
+      ERROR("utils_history: At most %d tiers are supported.",
+            HISTORY_MAX_TIERS);
+      sfree(copy);
+      return EINVAL;
+    }
+
+    if (sscanf(tier, "%lf:%lf%c", &resolution, &duration, &garbage) != 2) {
+      ERROR("utils_history: Cannot parse tier \"%s\": Expected "
+            "\"<resolution>:<duration>\".",
+            tier);
+      sfree(copy);
+      return EINVAL;
+    }
+
+    if ((resolution <= 0.0) || (duration < resolution)) {
+      ERROR("utils_history: Invalid tier \"%s\": The resolution must be "
+            "positive and must not exceed the duration.",
+            tier);
+      sfree(copy);
+      return EINVAL;
+    }
+
+    tmp[tmp_num] = (history_tier_conf_t){
+        .resolution = DOUBLE_TO_CDTIME_T(resolution),
+        .duration = DOUBLE_TO_CDTIME_T(duration),
+    };
+    tmp_num++;
+  }
+  sfree(copy);
+
+  qsort(tmp, tmp_num, sizeof(*tmp), tier_compare);
+
+  conf_raw_duration = raw_duration;
+  memcpy(conf_tiers, tmp, sizeof(tmp));
+  conf_tiers_num = tmp_num;
+  conf_max_points = max_points;
+
+  return 0;
+} /* }}} int history_configure */
+
+_Bool history_enabled(void) /* {{{ */
+{
+  return (conf_raw_duration > 0) || (conf_tiers_num > 0);
+} /* }}} _Bool history_enabled */
+
+static size_t ring_length(cdtime_t duration, cdtime_t resolution) /* {{{ */
+{
+  size_t length;
+
+  if (resolution == 0)
+    return conf_max_points;
+
+  length = (size_t)((duration + resolution - 1) / resolution);
+  if (length < 1)
+    length = 1;
+  if (length > conf_max_points)
+    length = conf_max_points;
+  return length;
+} /* }}} size_t ring_length */
+
+history_t *history_create(size_t values_num, cdtime_t interval) /* {{{ */
+{
+  history_ring_t rings[HISTORY_MAX_TIERS + 1];
+  size_t rings_num = 0;
+  size_t points = 0;
+  size_t tier_points = 0;
+
+  if (!history_enabled() || (values_num < 1))
+    return NULL;
+
+  if (conf_raw_duration > 0) {
+    rings[rings_num] = (history_ring_t){
+        .raw = 1,
+        .resolution = interval,
+        .length = ring_length(conf_raw_duration, interval),
+    };
+    points += rings[rings_num].length;
+    rings_num++;
+  }
+
+  for (size_t i = 0; i < conf_tiers_num; i++) {
+    rings[rings_num] = (history_ring_t){
+        .resolution = conf_tiers[i].resolution,
+        /* One more bucket for the one currently being filled. */
+        .length = ring_length(conf_tiers[i].duration + conf_tiers[i].resolution,
+                              conf_tiers[i].resolution),
+    };
+    points += rings[rings_num].length;
+    tier_points += rings[rings_num].length;
+    rings_num++;
+  }
+
+  /* Everything is allocated in one block. The header and the 64 bit columns
+   * come first, so that the 32 bit counters at the end are aligned, too. */
+  size_t header_size =
+      sizeof(history_t) + rings_num * sizeof(history_ring_t);
+  size_t size = header_size + points * sizeof(cdtime_t) +
+                points * values_num * sizeof(gauge_t) +
+                2 * tier_points * values_num * sizeof(gauge_t) +
+                tier_points * values_num * sizeof(uint32_t);
+
+  history_t *h = calloc(1, size);
+  if (h == NULL) {
+    ERROR("utils_history: history_create: calloc failed.");
+    return NULL;
+  }
+  h->values_num = values_num;
+  h->size = size;
+  h->rings_num = rings_num;
+
+  char *ptr = ((char *)h) + header_size;
+  for (size_t i = 0; i < rings_num; i++) {
+    history_ring_t *r = h->rings + i;
+    *r = rings[i];
+
+    size_t n = r->length * values_num;
+    r->time = (cdtime_t *)ptr;
+    ptr += r->length * sizeof(cdtime_t);
+    r->sum = (gauge_t *)ptr;
+    ptr += n * sizeof(gauge_t);
+    if (r->raw)
+      continue;
+
+    r->min = (gauge_t *)ptr;
+    ptr += n * sizeof(gauge_t);
+    r->max = (gauge_t *)ptr;
+    ptr += n * sizeof(gauge_t);
+  }
+
+  for (size_t i = 0; i < rings_num; i++) {
+    history_ring_t *r = h->rings + i;
+    if (r->raw)
+      continue;
+
+    r->count = (uint32_t *)ptr;
+    ptr += r->length * values_num * sizeof(uint32_t);
+  }
+  assert(ptr == ((char *)h) + size);
+
+  return h;
+} /* }}} history_t *history_create */
+
+void history_destroy(history_t *h) /* {{{ */
+{
+  sfree(h);
+} /* }}} void history_destroy */
+
+size_t history_size(const history_t *h) /* {{{ */
+{
+  return (h != NULL) ? h->size : 0;
+} /* }}} size_t history_size */
+
+static size_t ring_slot(const history_ring_t *r, size_t i) /* {{{ */
+{
+  /* Returns the slot of the i-th oldest point. */
+  return (r->index + r->length - r->num + i) % r->length;
+} /* }}} size_t ring_slot */
+
+static void ring_add_raw(history_ring_t *r, size_t values_num, /* {{{ */
+                         cdtime_t t, const gauge_t *values) {
+  size_t slot = r->index;
+
+  r->time[slot] = t;
+  for (size_t i = 0; i < values_num; i++)
+    r->sum[i * r->length + slot] = values[i];
+
+  r->index = (r->index + 1) % r->length;
+  if (r->num < r->length)
+    r->num++;
+} /* }}} void ring_add_raw */
+
+static void ring_add_tier(history_ring_t *r, size_t values_num, /* {{{ */
+                          cdtime_t t, const gauge_t *values) {
+  cdtime_t start = t - (t % r->resolution);
+  size_t slot = (r->index + r->length - 1) % r->length;
+
+  if ((r->num == 0) || (r->time[slot] < start)) {
+    slot = r->index;
+    r->time[slot] = start;
+    for (size_t i = 0; i < values_num; i++) {
+      size_t idx = i * r->length + slot;
+      r->sum[idx] = 0.0;
+      r->min[idx] = NAN;
+      r->max[idx] = NAN;
+      r->count[idx] = 0;
+    }
+
+    r->index = (r->index + 1) % r->length;
+    if (r->num < r->length)
+      r->num++;
+  } else if (r->time[slot] > start) {
+    /* Older than the current bucket. */
+    return;
+  }
+
+  for (size_t i = 0; i < values_num; i++) {
+    size_t idx = i * r->length + slot;
+
+    if (isnan(values[i]))
+      continue;
+
+    if ((r->count[idx] == 0) || (values[i] < r->min[idx]))
+      r->min[idx] = values[i];
+    if ((r->count[idx] == 0) || (values[i] > r->max[idx]))
+      r->max[idx] = values[i];
+    r->sum[idx] += values[i];
+    r->count[idx]++;
+  }
+} /* }}} void ring_add_tier */
+
+void history_add(history_t *h, cdtime_t t, const gauge_t *values) /* {{{ */
+{
+  if ((h == NULL) || (values == NULL))
+    return;
+
+  for (size_t i = 0; i < h->rings_num; i++) {
+    history_ring_t *r = h->rings + i;
+
+    if (r->raw)
+      ring_add_raw(r, h->values_num, t, values);
+    else
+      ring_add_tier(r, h->values_num, t, values);
+  }
+} /* }}} void history_add */
+
+static _Bool ring_contains(const history_ring_t *r, cdtime_t t, /* {{{ */
+                           cdtime_t begin, cdtime_t end) {
+  if (t > end)
+    return 0;
+  if (r->raw)
+    return t >= begin;
+  return (t + r->resolution) > begin;
+} /* }}} _Bool ring_contains */
+
+static const history_ring_t *select_ring(const history_t *h, /* {{{ */
+                                         cdtime_t begin) {
+  const history_ring_t *oldest = NULL;
+
+  /* Rings are ordered from finest to coarsest. */
+  for (size_t i = 0; i < h->rings_num; i++) {
+    const history_ring_t *r = h->rings + i;
+    if (r->num == 0)
+      continue;
+
+    cdtime_t first = r->time[ring_slot(r, 0)];
+    if (first <= begin)
+      return r;
+
+    if ((oldest == NULL) || (first < oldest->time[ring_slot(oldest, 0)]))
+      oldest = r;
+  }
+
+  return oldest;
+} /* }}} history_ring_t *select_ring */
+
+int history_query(const history_t *h, cdtime_t begin, cdtime_t end, /* {{{ */
+                  history_result_t *res) {
+  const history_ring_t *r;
+  size_t n = 0;
+
+  if ((h == NULL) || (res == NULL))
+    return EINVAL;
+
+  memset(res, 0, sizeof(*res));
+  res->values_num = h->values_num;
+
+  r = select_ring(h, begin);
+  if (r == NULL)
+    return 0;
+  res->raw = r->raw;
+  res->resolution = r->resolution;
+
+  for (size_t i = 0; i < r->num; i++)
+    if (ring_contains(r, r->time[ring_slot(r, i)], begin, end))
+      n++;
+  if (n == 0)
+    return 0;
+
+  res->time = calloc(n, sizeof(*res->time));
+  res->min = calloc(n * h->values_num, sizeof(*res->min));
+  res->avg = calloc(n * h->values_num, sizeof(*res->avg));
+  res->max = calloc(n * h->values_num, sizeof(*res->max));
+  if ((res->time == NULL) || (res->min == NULL) || (res->avg == NULL) ||
+      (res->max == NULL)) {
+    ERROR("utils_history: history_query: calloc failed.");
+    history_result_free(res);
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < r->num; i++) {
+    size_t slot = ring_slot(r, i);
+    if (!ring_contains(r, r->time[slot], begin, end))
+      continue;
+
+    res->time[res->points_num] = r->time[slot];
+    for (size_t j = 0; j < h->values_num; j++) {
+      size_t src = j * r->length + slot;
+      size_t dst = res->points_num * h->values_num + j;
+
+      if (r->raw) {
+        res->min[dst] = res->avg[dst] = res->max[dst] = r->sum[src];
+      } else if (r->count[src] == 0) {
+        res->min[dst] = res->avg[dst] = res->max[dst] = NAN;
+      } else {
+        res->min[dst] = r->min[src];
+        res->avg[dst] = r->sum[src] / (gauge_t)r->count[src];
+        res->max[dst] = r->max[src];
+      }
+    }
+    res->points_num++;
+  }
+
+  return 0;
+} /* }}} int history_query */
+
+void history_result_free(history_result_t *res) /* {{{ */
+{
+  if (res == NULL)
+    return;
+
+  sfree(res->time);
+  sfree(res->min);
+  sfree(res->avg);
+  sfree(res->max);
+  res->points_num = 0;
+} /* }}} void history_result_free */
@@ -0,0 +1,129 @@
+/**
+ * collectd - src/daemon/utils_history.h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_HISTORY_H
+#define UTILS_HISTORY_H 1
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils_time.h"
+
+/*
+ * Multi-resolution history of a single value list, kept by the value cache.
+ *
+ * The history consists of one ring of raw points and any number of tiers,
+ * each of which keeps the minimum, average and maximum of the points falling
+ * into fixed-size time buckets. The size of all rings is determined when the
+ * history is created, so the memory used per value list does not grow. All
+ * columns of a history are allocated as a single block.
+ */
+
+struct history_s;
+typedef struct history_s history_t;
+
+typedef struct {
+  /* True for raw points. */
+  _Bool raw;
+  /* Width of the buckets, or the interval of raw points. */
+  cdtime_t resolution;
+
+  size_t points_num;
+  size_t values_num;
+
+  /* Start of each point's bucket, or the time of each raw point. */
+  cdtime_t *time;
+  /* Indexed by (point * values_num + value). For raw points, all three hold
+   * the same value. Buckets without any valid value are NaN. */
+  gauge_t *min;
+  gauge_t *avg;
+  gauge_t *max;
+} history_result_t;
+
+/*
+ * NAME
+ *  history_configure
+ *
+ * DESCRIPTION
+ *  Sets the layout of histories created afterwards. Raw points are kept for
+ *  `raw_duration'. `tiers' is a whitespace separated list of
+ *  "<resolution>:<duration>" pairs, in seconds, e.g. "60:21600 900:172800".
+ *  No ring holds more than `max_points' points. If `raw_duration' is zero and
+ *  `tiers' is empty, no history is kept.
+ *
+ * RETURN VALUE
+ *  Zero on success, EINVAL if `tiers' cannot be parsed.
+ */
+int history_configure(cdtime_t raw_duration, const char *tiers,
+                      size_t max_points);
+
+/* Returns true if history_configure() enabled the history. */
+_Bool history_enabled(void);
+
+/*
+ * NAME
+ *  history_create
+ *
+ * DESCRIPTION
+ *  Allocates the history of a value list with `values_num' values, which is
+ *  expected to be updated every `interval'. The number of raw points kept is
+ *  derived from `interval'.
+ *
+ * RETURN VALUE
+ *  The new history, or NULL if the history is disabled or on failure.
+ */
+history_t *history_create(size_t values_num, cdtime_t interval);
+void history_destroy(history_t *h);
+
+/* Returns the number of bytes allocated for `h'. */
+size_t history_size(const history_t *h);
+
+/*
+ * NAME
+ *  history_add
+ *
+ * DESCRIPTION
+ *  Adds the `values_num' values in `values', taken at `t', to all rings of
+ *  the history. Points must be added in chronological order. NaN values are
+ *  stored as raw points but don't contribute to the tiers.
+ */
+void history_add(history_t *h, cdtime_t t, const gauge_t *values);
+
+/*
+ * NAME
+ *  history_query
+ *
+ * DESCRIPTION
+ *  Returns the points between `begin' and `end', both inclusive, from the
+ *  finest ring that reaches back to `begin', or from the ring reaching back
+ *  furthest if there is none. For tiers, a bucket is returned if any part of
+ *  it lies within the range. The points are returned in chronological order
+ *  and must be freed with history_result_free().
+ *
+ * RETURN VALUE
+ *  Zero on success, ENOMEM on failure.
+ */
+int history_query(const history_t *h, cdtime_t begin, cdtime_t end,
+                  history_result_t *res);
+void history_result_free(history_result_t *res);
+
+#endif /* UTILS_HISTORY_H */
@@ -0,0 +1,152 @@
+/**
+ * collectd - src/daemon/utils_history_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "testing.h"
+#include "utils_history.c" /* sic */
+
+#define S(x) TIME_T_TO_CDTIME_T(x)
+
+DEF_TEST(configure) {
+  EXPECT_EQ_INT(0, history_configure(0, NULL, 10));
+  OK(!history_enabled());
+  OK(history_create(1, S(10)) == NULL);
+
+  EXPECT_EQ_INT(EINVAL, history_configure(S(60), "60", 10));
+  EXPECT_EQ_INT(EINVAL, history_configure(S(60), "60:30", 10));
+  EXPECT_EQ_INT(EINVAL, history_configure(S(60), "0:30", 10));
+  EXPECT_EQ_INT(EINVAL, history_configure(S(60), "60:3600x", 10));
+  OK(!history_enabled());
+
+  /* Tiers are sorted by resolution. */
+  EXPECT_EQ_INT(0, history_configure(0, " 600:7200\t60:600 ", 100));
+  OK(history_enabled());
+  EXPECT_EQ_INT(2, conf_tiers_num);
+  EXPECT_EQ_UINT64(S(60), conf_tiers[0].resolution);
+  EXPECT_EQ_UINT64(S(600), conf_tiers[1].resolution);
+
+  return 0;
+}
+
+DEF_TEST(raw) {
+  history_result_t res;
+  gauge_t values[2];
+
+  CHECK_ZERO(history_configure(S(60), NULL, 100));
+
+  history_t *h = history_create(2, S(10));
+  CHECK_NOT_NULL(h);
+  EXPECT_EQ_INT(6, h->rings[0].length);
+
+  /* Only the last six points are kept. */
+  for (int i = 1; i <= 10; i++) {
+    values[0] = (gauge_t)i;
+    values[1] = -(gauge_t)i;
+    history_add(h, S(10 * i), values);
+  }
+
+  CHECK_ZERO(history_query(h, 0, S(1000), &res));
+  OK(res.raw);
+  EXPECT_EQ_UINT64(S(10), res.resolution);
+  EXPECT_EQ_INT(6, res.points_num);
+  for (size_t i = 0; i < res.points_num; i++) {
+    EXPECT_EQ_UINT64(S(10 * (i + 5)), res.time[i]);
+    EXPECT_EQ_DOUBLE((gauge_t)(i + 5), res.avg[2 * i]);
+    EXPECT_EQ_DOUBLE(-(gauge_t)(i + 5), res.min[2 * i + 1]);
+  }
+  history_result_free(&res);
+
+  /* Both ends are inclusive. */
+  CHECK_ZERO(history_query(h, S(70), S(80), &res));
+  EXPECT_EQ_INT(2, res.points_num);
+  EXPECT_EQ_UINT64(S(70), res.time[0]);
+  history_result_free(&res);
+
+  CHECK_ZERO(history_query(h, S(200), S(300), &res));
+  EXPECT_EQ_INT(0, res.points_num);
+  history_result_free(&res);
+
+  history_destroy(h);
+  return 0;
+}
+
+DEF_TEST(tiers) {
+  history_result_t res;
+  gauge_t value;
+
+  /* Raw points for one minute, minutely buckets for ten minutes. */
+  CHECK_ZERO(history_configure(S(60), "60:600", 100));
+
+  history_t *h = history_create(1, S(10));
+  CHECK_NOT_NULL(h);
+  EXPECT_EQ_INT(2, h->rings_num);
+  EXPECT_EQ_INT(11, h->rings[1].length);
+  OK(history_size(h) >= 17 * (sizeof(cdtime_t) + sizeof(gauge_t)));
+
+  for (int i = 0; i < 60; i++) {
+    value = (i == 7) ? NAN : (gauge_t)i;
+    history_add(h, S(600 + 10 * i), &value);
+  }
+
+  /* The raw points reach back far enough. */
+  CHECK_ZERO(history_query(h, S(1140), S(1200), &res));
+  OK(res.raw);
+  EXPECT_EQ_INT(6, res.points_num);
+  history_result_free(&res);
+
+  /* Older points are only available from the tier. */
+  CHECK_ZERO(history_query(h, S(600), S(1200), &res));
+  OK(!res.raw);
+  EXPECT_EQ_UINT64(S(60), res.resolution);
+  EXPECT_EQ_INT(10, res.points_num);
+  EXPECT_EQ_UINT64(S(600), res.time[0]);
+  EXPECT_EQ_DOUBLE(0.0, res.min[0]);
+  EXPECT_EQ_DOUBLE(5.0, res.max[0]);
+  EXPECT_EQ_DOUBLE(2.5, res.avg[0]);
+  /* NaN does not count towards the average. */
+  EXPECT_EQ_DOUBLE(6.0, res.min[1]);
+  EXPECT_EQ_DOUBLE(8.8, res.avg[1]);
+  EXPECT_EQ_DOUBLE(59.0, res.max[9]);
+  history_result_free(&res);
+
+  /* A bucket overlapping the beginning of the range is included. */
+  CHECK_ZERO(history_query(h, S(690), S(720), &res));
+  EXPECT_EQ_INT(2, res.points_num);
+  EXPECT_EQ_UINT64(S(660), res.time[0]);
+  history_result_free(&res);
+
+  /* Beyond the tier, the ring reaching back furthest is used. */
+  CHECK_ZERO(history_query(h, 0, S(1200), &res));
+  OK(!res.raw);
+  EXPECT_EQ_INT(10, res.points_num);
+  history_result_free(&res);
+
+  history_destroy(h);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(configure);
+  RUN_TEST(raw);
+  RUN_TEST(tiers);
+
+  END_TEST;
+}
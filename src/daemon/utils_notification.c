@@ -0,0 +1,263 @@
+/**
+ * collectd - src/daemon/utils_notification.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_avltree.h"
+#include "utils_notification.h"
+
+typedef struct {
+  /* Severity and original message of the last notification passed on.
+   * A severity of zero means none has been passed on yet. */
+  int severity;
+  char message[NOTIF_MAX_MSG_LEN];
+  cdtime_t passed;
+  uint64_t repeated;
+
+  /* Severity of the last notification seen, passed on or not. */
+  int state;
+  cdtime_t last_seen;
+  cdtime_t last_change;
+
+  _Bool flapping;
+  /* Last notification suppressed while flapping, without meta data. */
+  _Bool held_valid;
+  notification_t held;
+
+  /* Ring of the times of the last `flap_changes' changes of the severity.
+   * `changes_pos' points to the next slot to write to, i.e. the oldest
+   * change once the ring is full. */
+  size_t changes_num;
+  size_t changes_pos;
+  cdtime_t changes[];
+} filter_entry_t;
+
+struct notification_filter_s {
+  cdtime_t coalesce;
+  size_t flap_changes;
+  cdtime_t flap_window;
+
+  c_avl_tree_t *entries;
+};
+
+notification_filter_t *notification_filter_create(cdtime_t coalesce, /* {{{ */
+                                                  size_t flap_changes,
+                                                  cdtime_t flap_window) {
+  notification_filter_t *f = calloc(1, sizeof(*f));
+  if (f == NULL)
+    return NULL;
+
+  f->coalesce = coalesce;
+  f->flap_changes = flap_changes;
+  f->flap_window = flap_window;
+
+  f->entries = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (f->entries == NULL) {
+    sfree(f);
+    return NULL;
+  }
+
+  return f;
+} /* }}} notification_filter_t *notification_filter_create */
+
+void notification_filter_destroy(notification_filter_t *f) /* {{{ */
+{
+  void *key;
+  void *value;
+
+  if (f == NULL)
+    return;
+
+  while (c_avl_pick(f->entries, &key, &value) == 0) {
+    sfree(key);
+    sfree(value);
+  }
+  c_avl_destroy(f->entries);
+  sfree(f);
+} /* }}} void notification_filter_destroy */
+
+static filter_entry_t *filter_entry_get(notification_filter_t *f, /* {{{ */
+                                        notification_t const *n) {
+  char name[6 * DATA_MAX_NAME_LEN];
+  filter_entry_t *e = NULL;
+
+  if (format_name(name, sizeof(name), n->host, n->plugin, n->plugin_instance,
+                  n->type, n->type_instance) != 0)
+    return NULL;
+
+  if (c_avl_get(f->entries, name, (void *)&e) == 0)
+    return e;
+
+  e = calloc(1, sizeof(*e) + f->flap_changes * sizeof(e->changes[0]));
+  char *key = strdup(name);
+  if ((e == NULL) || (key == NULL) || (c_avl_insert(f->entries, key, e) != 0)) {
+    sfree(e);
+    sfree(key);
+    return NULL;
+  }
+
+  return e;
+} /* }}} filter_entry_t *filter_entry_get */
+
+static void filter_append(notification_t *n, char const *text) /* {{{ */
+{
+  size_t len = strlen(n->message);
+  if (len < sizeof(n->message) - 1)
+    sstrncpy(n->message + len, text, sizeof(n->message) - len);
+} /* }}} void filter_append */
+
+/* Records that `n' is passed on and appends `text' to its message. */
+static void filter_pass(filter_entry_t *e, notification_t *n, /* {{{ */
+                        cdtime_t now, char const *text) {
+  char repeated[64] = "";
+
+  if (e->repeated > 0)
+    snprintf(repeated, sizeof(repeated),
+             " (previous notification repeated %" PRIu64 " time%s)",
+             e->repeated, (e->repeated == 1) ? "" : "s");
+
+  e->severity = n->severity;
+  sstrncpy(e->message, n->message, sizeof(e->message));
+  e->passed = now;
+  e->repeated = 0;
+
+  if (text != NULL)
+    filter_append(n, text);
+  filter_append(n, repeated);
+} /* }}} void filter_pass */
+
+static void filter_flap_stop(filter_entry_t *e) /* {{{ */
+{
+  e->flapping = 0;
+  e->held_valid = 0;
+  e->changes_num = 0;
+  e->changes_pos = 0;
+} /* }}} void filter_flap_stop */
+
+_Bool notification_filter_check(notification_filter_t *f, /* {{{ */
+                                notification_t *n, cdtime_t now) {
+  filter_entry_t *e = filter_entry_get(f, n);
+  if (e == NULL)
+    return 1;
+
+  _Bool changed = (e->state != 0) && (e->state != n->severity);
+  e->state = n->severity;
+  e->last_seen = now;
+
+  if (changed && (f->flap_changes > 0)) {
+    e->last_change = now;
+    e->changes[e->changes_pos] = now;
+    e->changes_pos = (e->changes_pos + 1) % f->flap_changes;
+    if (e->changes_num < f->flap_changes)
+      e->changes_num++;
+  }
+
+  if (e->flapping) {
+    if ((now - e->last_change) < f->flap_window) {
+      e->held = *n;
+      e->held.meta = NULL;
+      e->held_valid = 1;
+      return 0;
+    }
+
+    /* Settled before notification_filter_expire() noticed. */
+    filter_flap_stop(e);
+    filter_pass(e, n, now, " (stopped flapping)");
+    return 1;
+  }
+
+  if (changed && (f->flap_changes > 0) &&
+      (e->changes_num == f->flap_changes) &&
+      ((now - e->changes[e->changes_pos]) < f->flap_window)) {
+    e->flapping = 1;
+    filter_pass(e, n, now, " (flapping, further changes are suppressed)");
+    return 1;
+  }
+
+  if ((f->coalesce > 0) && (e->severity == n->severity) &&
+      ((now - e->passed) < f->coalesce) &&
+      (strcmp(e->message, n->message) == 0)) {
+    e->repeated++;
+    return 0;
+  }
+
+  filter_pass(e, n, now, NULL);
+  return 1;
+} /* }}} _Bool notification_filter_check */
+
+int notification_filter_expire(notification_filter_t *f, /* {{{ */
+                               cdtime_t now,
+                               notification_t **ret_notifications,
+                               size_t *ret_notifications_num) {
+  notification_t *released = NULL;
+  size_t released_num = 0;
+  char **expired = NULL;
+  size_t expired_num = 0;
+  int status = 0;
+
+  cdtime_t keep = (f->coalesce > f->flap_window) ? f->coalesce : f->flap_window;
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(f->entries);
+  char *key;
+  filter_entry_t *e;
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&e) == 0) {
+    if (e->flapping && ((now - e->last_change) >= f->flap_window)) {
+      if (e->held_valid) {
+        notification_t *tmp =
+            realloc(released, (released_num + 1) * sizeof(*released));
+        if (tmp == NULL) {
+          status = ENOMEM;
+          break;
+        }
+        released = tmp;
+        released[released_num] = e->held;
+        filter_pass(e, released + released_num, now, " (stopped flapping)");
+        released_num++;
+      }
+      filter_flap_stop(e);
+    } else if (!e->flapping && ((now - e->last_seen) >= keep)) {
+      char **tmp = realloc(expired, (expired_num + 1) * sizeof(*expired));
+      if (tmp == NULL) {
+        status = ENOMEM;
+        break;
+      }
+      expired = tmp;
+      expired[expired_num] = key;
+      expired_num++;
+    }
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < expired_num; i++) {
+    if (c_avl_remove(f->entries, expired[i], (void *)&key, (void *)&e) == 0) {
+      sfree(key);
+      sfree(e);
+    }
+  }
+  sfree(expired);
+
+  *ret_notifications = released;
+  *ret_notifications_num = released_num;
+  return status;
+} /* }}} int notification_filter_expire */
@@ -0,0 +1,101 @@
+/**
+ * collectd - src/daemon/utils_notification.h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_NOTIFICATION_H
+#define UTILS_NOTIFICATION_H 1
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils_time.h"
+
+/*
+ * Coalescing and flap detection of notifications, applied by
+ * plugin_dispatch_notification() before notifications are queued for the
+ * notification plugins.
+ *
+ * Notifications are grouped by identifier, i.e. host, plugin, plugin
+ * instance, type and type instance. A notification repeating the severity
+ * and message of the previous one passed on for the same identifier is
+ * suppressed if it arrives within the coalescing interval; the next one
+ * passed on says how often it has been repeated. An identifier is flapping
+ * once its severity has changed `flap_changes' times within `flap_window'.
+ * While it flaps, all of its notifications are suppressed. Once its severity
+ * has not changed for `flap_window', the last notification suppressed is
+ * passed on by notification_filter_expire().
+ *
+ * The filter is not thread-safe.
+ */
+
+struct notification_filter_s;
+typedef struct notification_filter_s notification_filter_t;
+
+/*
+ * NAME
+ *  notification_filter_create
+ *
+ * DESCRIPTION
+ *  Creates a filter. Coalescing is disabled if `coalesce' is zero, flap
+ *  detection if `flap_changes' is zero.
+ *
+ * RETURN VALUE
+ *  The new filter or NULL on failure.
+ */
+notification_filter_t *notification_filter_create(cdtime_t coalesce,
+                                                  size_t flap_changes,
+                                                  cdtime_t flap_window);
+void notification_filter_destroy(notification_filter_t *f);
+
+/*
+ * NAME
+ *  notification_filter_check
+ *
+ * DESCRIPTION
+ *  Decides whether the notification `n', dispatched at `now', is passed on.
+ *  The message of notifications passed on may be amended, e.g. when `n'
+ *  starts or stops flapping.
+ *
+ * RETURN VALUE
+ *  True if `n' is to be passed on, false if it has been suppressed.
+ */
+_Bool notification_filter_check(notification_filter_t *f, notification_t *n,
+                                cdtime_t now);
+
+/*
+ * NAME
+ *  notification_filter_expire
+ *
+ * DESCRIPTION
+ *  Ends flapping for identifiers whose severity has not changed for the flap
+ *  window and forgets identifiers not seen for a while. For each identifier
+ *  that stopped flapping, the last notification suppressed is stored in
+ *  `ret_notifications', without its meta data. The array must be freed by
+ *  the caller.
+ *
+ * RETURN VALUE
+ *  Zero on success, ENOMEM on failure.
+ */
+int notification_filter_expire(notification_filter_t *f, cdtime_t now,
+                               notification_t **ret_notifications,
+                               size_t *ret_notifications_num);
+
+#endif /* UTILS_NOTIFICATION_H */
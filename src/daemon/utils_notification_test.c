@@ -0,0 +1,134 @@
+/**
+ * collectd - src/daemon/utils_notification_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "testing.h"
+#include "utils_notification.c" /* sic */
+
+#define S(x) TIME_T_TO_CDTIME_T(x)
+
+static notification_t make_notification(int severity, char const *message) {
+  notification_t n = {.severity = severity};
+  sstrncpy(n.host, "example.com", sizeof(n.host));
+  sstrncpy(n.plugin, "test", sizeof(n.plugin));
+  sstrncpy(n.type, "gauge", sizeof(n.type));
+  sstrncpy(n.message, message, sizeof(n.message));
+  return n;
+}
+
+DEF_TEST(coalesce) {
+  notification_filter_t *f = notification_filter_create(S(60), 0, 0);
+  CHECK_NOT_NULL(f);
+
+  notification_t n = make_notification(NOTIF_WARNING, "too high");
+  OK(notification_filter_check(f, &n, S(0)));
+  EXPECT_EQ_STR("too high", n.message);
+
+  /* Repetitions within the interval are suppressed. */
+  n = make_notification(NOTIF_WARNING, "too high");
+  OK(!notification_filter_check(f, &n, S(10)));
+  OK(!notification_filter_check(f, &n, S(20)));
+
+  /* Other messages, severities and identifiers are not. */
+  notification_t other = make_notification(NOTIF_WARNING, "much too high");
+  OK(notification_filter_check(f, &other, S(30)));
+  other = make_notification(NOTIF_WARNING, "much too high");
+  sstrncpy(other.type_instance, "other", sizeof(other.type_instance));
+  OK(notification_filter_check(f, &other, S(30)));
+
+  n = make_notification(NOTIF_WARNING, "much too high");
+  OK(!notification_filter_check(f, &n, S(40)));
+  n = make_notification(NOTIF_WARNING, "much too high");
+  OK(notification_filter_check(f, &n, S(95)));
+  EXPECT_EQ_STR("much too high (previous notification repeated 1 time)",
+                n.message);
+
+  /* Identifiers are forgotten once the interval has passed. */
+  notification_t *released = NULL;
+  size_t released_num = 0;
+  CHECK_ZERO(notification_filter_expire(f, S(100), &released, &released_num));
+  EXPECT_EQ_INT(0, released_num);
+  EXPECT_EQ_INT(1, c_avl_size(f->entries));
+  CHECK_ZERO(notification_filter_expire(f, S(160), &released, &released_num));
+  EXPECT_EQ_INT(0, c_avl_size(f->entries));
+
+  notification_filter_destroy(f);
+  return 0;
+}
+
+DEF_TEST(flapping) {
+  notification_filter_t *f = notification_filter_create(0, 3, S(300));
+  CHECK_NOT_NULL(f);
+
+  int severities[] = {NOTIF_OKAY, NOTIF_WARNING, NOTIF_OKAY, NOTIF_WARNING,
+                      NOTIF_OKAY, NOTIF_FAILURE};
+  _Bool want[] = {1, 1, 1, 1, 0, 0};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(severities); i++) {
+    notification_t n = make_notification(severities[i], "state");
+    EXPECT_EQ_INT(want[i], notification_filter_check(f, &n, S(10 * i)));
+    if (i == 3)
+      EXPECT_EQ_STR("state (flapping, further changes are suppressed)",
+                    n.message);
+  }
+
+  /* Stops flapping once the state has been stable for the window, passing
+   * on the last state. */
+  notification_t *released = NULL;
+  size_t released_num = 0;
+  CHECK_ZERO(notification_filter_expire(f, S(340), &released, &released_num));
+  EXPECT_EQ_INT(0, released_num);
+  CHECK_ZERO(notification_filter_expire(f, S(350), &released, &released_num));
+  EXPECT_EQ_INT(1, released_num);
+  EXPECT_EQ_INT(NOTIF_FAILURE, released[0].severity);
+  EXPECT_EQ_STR("state (stopped flapping)", released[0].message);
+  sfree(released);
+
+  /* Changes far apart do not count as flapping. */
+  for (int i = 0; i < 4; i++) {
+    notification_t n =
+        make_notification((i % 2) ? NOTIF_OKAY : NOTIF_FAILURE, "state");
+    OK(notification_filter_check(f, &n, S(400 + 200 * i)));
+    EXPECT_EQ_STR("state", n.message);
+  }
+
+  /* Quick changes start flapping again. A notification after the window
+   * ends flapping, too. */
+  for (int i = 0; i < 4; i++) {
+    notification_t n =
+        make_notification((i % 2) ? NOTIF_FAILURE : NOTIF_OKAY, "state");
+    OK(notification_filter_check(f, &n, S(2000 + i)));
+  }
+  notification_t n = make_notification(NOTIF_FAILURE, "state");
+  OK(!notification_filter_check(f, &n, S(2200)));
+  n = make_notification(NOTIF_FAILURE, "state");
+  OK(notification_filter_check(f, &n, S(2400)));
+  EXPECT_EQ_STR("state (stopped flapping)", n.message);
+
+  notification_filter_destroy(f);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(coalesce);
+  RUN_TEST(flapping);
+
+  END_TEST;
+}
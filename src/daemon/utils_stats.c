@@ -0,0 +1,387 @@
+/**
+ * collectd - src/daemon/utils_stats.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_stats.h"
+
+/*
+ * Latencies are counted in a log-linear histogram: every power of two is
+ * split into STATS_SUB_BUCKETS buckets of equal width, which bounds the error
+ * of the reported percentiles to 25%. Values of 2^STATS_MAX_MSB (about four
+ * hours) and above end up in the last bucket.
+ */
+#define STATS_SUB_BUCKETS 4
+#define STATS_SUB_BITS 2
+#define STATS_MAX_MSB 44
+#define STATS_BUCKETS ((STATS_MAX_MSB - 1) * STATS_SUB_BUCKETS)
+
+typedef struct {
+  uint64_t calls;
+  uint64_t failures;
+  cdtime_t max;
+  uint32_t histogram[STATS_BUCKETS];
+} stats_counter_t;
+
+struct stats_thread_s;
+typedef struct stats_thread_s stats_thread_t;
+struct stats_thread_s {
+  /* Only contended while stats_collect() merges this thread's counters. */
+  pthread_mutex_t lock;
+  stats_counter_t *counters;
+  size_t counters_num;
+
+  stats_thread_t *next;
+};
+
+typedef struct {
+  stats_kind_t kind;
+  char *name;
+} stats_entry_t;
+
+/* `stats_lock' protects the list of entries, the list of threads and the
+ * counters of threads that have already exited. */
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static stats_entry_t *stats_entries = NULL;
+static size_t stats_entries_num = 0;
+static stats_thread_t *stats_threads = NULL;
+static stats_counter_t *stats_retired = NULL;
+static size_t stats_retired_num = 0;
+
+static pthread_key_t stats_key;
+static _Bool stats_enabled = 0;
+
+static size_t stats_bucket(cdtime_t latency) /* {{{ */
+{
+  size_t msb = 0;
+
+  if (latency < STATS_SUB_BUCKETS)
+    return (size_t)latency;
+
+  for (cdtime_t tmp = latency; tmp > 1; tmp >>= 1)
+    msb++;
+  if (msb >= STATS_MAX_MSB)
+    return STATS_BUCKETS - 1;
+
+  return (msb - 1) * STATS_SUB_BUCKETS +
+         (size_t)((latency >> (msb - STATS_SUB_BITS)) &
+                  (STATS_SUB_BUCKETS - 1));
+} /* }}} size_t stats_bucket */
+
+/* Returns the largest latency that is counted in bucket `index'. */
+static cdtime_t stats_bucket_upper(size_t index) /* {{{ */
+{
+  if (index < STATS_SUB_BUCKETS)
+    return (cdtime_t)index;
+  if (index >= STATS_BUCKETS - 1)
+    return (cdtime_t)-1;
+
+  size_t msb = index / STATS_SUB_BUCKETS + 1;
+  cdtime_t sub = (cdtime_t)(index % STATS_SUB_BUCKETS);
+  cdtime_t width = ((cdtime_t)1) << (msb - STATS_SUB_BITS);
+
+  return ((STATS_SUB_BUCKETS + sub) << (msb - STATS_SUB_BITS)) + width - 1;
+} /* }}} cdtime_t stats_bucket_upper */
+
+static int stats_counters_grow(stats_counter_t **counters, /* {{{ */
+                               size_t *counters_num, size_t num) {
+  if (*counters_num >= num)
+    return 0;
+
+  stats_counter_t *tmp = realloc(*counters, num * sizeof(*tmp));
+  if (tmp == NULL)
+    return ENOMEM;
+  memset(tmp + *counters_num, 0, (num - *counters_num) * sizeof(*tmp));
+
+  *counters = tmp;
+  *counters_num = num;
+  return 0;
+} /* }}} int stats_counters_grow */
+
+/* Adds `src' to `dst'. If `reset' is true, the latency distribution of `src'
+ * is cleared, so that it will not be reported twice. */
+static void stats_counter_merge(stats_counter_t *dst, /* {{{ */
+                                stats_counter_t *src, _Bool reset) {
+  dst->calls += src->calls;
+  dst->failures += src->failures;
+  if (dst->max < src->max)
+    dst->max = src->max;
+
+  for (size_t i = 0; i < STATS_BUCKETS; i++)
+    dst->histogram[i] += src->histogram[i];
+
+  if (reset) {
+    src->max = 0;
+    memset(src->histogram, 0, sizeof(src->histogram));
+  }
+} /* }}} void stats_counter_merge */
+
+/* Called when a thread exits: keeps its counters around until they have been
+ * reported. */
+static void stats_thread_destroy(void *arg) /* {{{ */
+{
+  stats_thread_t *t = arg;
+
+  pthread_mutex_lock(&stats_lock);
+
+  stats_thread_t **prev = &stats_threads;
+  while ((*prev != NULL) && (*prev != t))
+    prev = &(*prev)->next;
+  if (*prev != NULL)
+    *prev = t->next;
+
+  if (stats_counters_grow(&stats_retired, &stats_retired_num,
+                          t->counters_num) == 0) {
+    for (size_t i = 0; i < t->counters_num; i++)
+      stats_counter_merge(stats_retired + i, t->counters + i, /* reset = */ 0);
+  }
+
+  pthread_mutex_unlock(&stats_lock);
+
+  pthread_mutex_destroy(&t->lock);
+  sfree(t->counters);
+  sfree(t);
+} /* }}} void stats_thread_destroy */
+
+static stats_thread_t *stats_thread_get(void) /* {{{ */
+{
+  stats_thread_t *t = pthread_getspecific(stats_key);
+  if (t != NULL)
+    return t;
+
+  t = calloc(1, sizeof(*t));
+  if (t == NULL)
+    return NULL;
+  pthread_mutex_init(&t->lock, /* attr = */ NULL);
+
+  pthread_mutex_lock(&stats_lock);
+  t->next = stats_threads;
+  stats_threads = t;
+  pthread_mutex_unlock(&stats_lock);
+
+  pthread_setspecific(stats_key, t);
+  return t;
+} /* }}} stats_thread_t *stats_thread_get */
+
+void stats_enable(void) /* {{{ */
+{
+  if (stats_enabled)
+    return;
+
+  int status = pthread_key_create(&stats_key, stats_thread_destroy);
+  if (status != 0) {
+    ERROR("stats_enable: pthread_key_create failed: %s", STRERROR(status));
+    return;
+  }
+
+  stats_enabled = 1;
+} /* }}} void stats_enable */
+
+int stats_register(stats_kind_t kind, const char *name) /* {{{ */
+{
+  int id = -1;
+
+  if (!stats_enabled || (name == NULL))
+    return -1;
+
+  pthread_mutex_lock(&stats_lock);
+
+  for (size_t i = 0; i < stats_entries_num; i++) {
+    if ((stats_entries[i].kind == kind) &&
+        (strcmp(stats_entries[i].name, name) == 0)) {
+      id = (int)i;
+      break;
+    }
+  }
+
+  if (id < 0) {
+    stats_entry_t *tmp = realloc(stats_entries, (stats_entries_num + 1) *
+                                                    sizeof(*stats_entries));
+    char *name_copy = strdup(name);
+    if ((tmp != NULL) && (name_copy != NULL)) {
+      stats_entries = tmp;
+      stats_entries[stats_entries_num] = (stats_entry_t){
+          .kind = kind, .name = name_copy,
+      };
+      id = (int)stats_entries_num;
+      stats_entries_num++;
+    } else {
+      if (tmp != NULL)
+        stats_entries = tmp;
+      sfree(name_copy);
+      ERROR("stats_register: Allocating memory failed.");
+    }
+  }
+
+  pthread_mutex_unlock(&stats_lock);
+  return id;
+} /* }}} int stats_register */
+
+void stats_record(int id, cdtime_t latency, _Bool failed) /* {{{ */
+{
+  if (!stats_enabled || (id < 0))
+    return;
+
+  stats_thread_t *t = stats_thread_get();
+  if (t == NULL)
+    return;
+
+  pthread_mutex_lock(&t->lock);
+
+  if (stats_counters_grow(&t->counters, &t->counters_num, (size_t)id + 1) !=
+      0) {
+    pthread_mutex_unlock(&t->lock);
+    return;
+  }
+
+  stats_counter_t *c = t->counters + id;
+  c->calls++;
+  if (failed)
+    c->failures++;
+  if (c->max < latency)
+    c->max = latency;
+  c->histogram[stats_bucket(latency)]++;
+
+  pthread_mutex_unlock(&t->lock);
+} /* }}} void stats_record */
+
+void stats_mutex_lock(pthread_mutex_t *lock, int id) /* {{{ */
+{
+  if (!stats_enabled || (id < 0)) {
+    pthread_mutex_lock(lock);
+    return;
+  }
+
+  if (pthread_mutex_trylock(lock) == 0) {
+    stats_record(id, 0, /* failed = */ 0);
+    return;
+  }
+
+  cdtime_t start = cdtime();
+  pthread_mutex_lock(lock);
+  stats_record(id, cdtime() - start, /* failed = */ 0);
+} /* }}} void stats_mutex_lock */
+
+static cdtime_t stats_percentile(stats_counter_t const *c, /* {{{ */
+                                 uint64_t num, double percent) {
+  uint64_t want = (uint64_t)ceil(((double)num) * percent / 100.0);
+  uint64_t sum = 0;
+
+  if (want < 1)
+    want = 1;
+
+  for (size_t i = 0; i < STATS_BUCKETS; i++) {
+    sum += c->histogram[i];
+    if (sum >= want) {
+      cdtime_t upper = stats_bucket_upper(i);
+      return (upper < c->max) ? upper : c->max;
+    }
+  }
+
+  return c->max;
+} /* }}} cdtime_t stats_percentile */
+
+int stats_collect(stats_callback_t callback, void *user_data) /* {{{ */
+{
+  if (!stats_enabled)
+    return 0;
+
+  pthread_mutex_lock(&stats_lock);
+
+  size_t num = stats_entries_num;
+  stats_counter_t *sum = calloc(num, sizeof(*sum));
+  stats_entry_t *entries = calloc(num, sizeof(*entries));
+  if ((num > 0) && ((sum == NULL) || (entries == NULL))) {
+    pthread_mutex_unlock(&stats_lock);
+    sfree(sum);
+    sfree(entries);
+    ERROR("stats_collect: calloc failed.");
+    return ENOMEM;
+  }
+  /* Names are never freed, copying the pointers is sufficient. */
+  if (num > 0)
+    memcpy(entries, stats_entries, num * sizeof(*entries));
+
+  for (size_t i = 0; (i < stats_retired_num) && (i < num); i++)
+    stats_counter_merge(sum + i, stats_retired + i, /* reset = */ 1);
+
+  for (stats_thread_t *t = stats_threads; t != NULL; t = t->next) {
+    pthread_mutex_lock(&t->lock);
+    for (size_t i = 0; (i < t->counters_num) && (i < num); i++)
+      stats_counter_merge(sum + i, t->counters + i, /* reset = */ 1);
+    pthread_mutex_unlock(&t->lock);
+  }
+
+  pthread_mutex_unlock(&stats_lock);
+
+  /* The callback is invoked without holding any locks, because it will
+   * usually dispatch values, which in turn records statistics. */
+  int status = 0;
+  for (size_t i = 0; i < num; i++) {
+    uint64_t interval_calls = 0;
+    for (size_t j = 0; j < STATS_BUCKETS; j++)
+      interval_calls += sum[i].histogram[j];
+
+    stats_summary_t summary = {
+        .calls = sum[i].calls,
+        .failures = sum[i].failures,
+        .interval_calls = interval_calls,
+    };
+    if (interval_calls > 0) {
+      summary.p50 = stats_percentile(sum + i, interval_calls, 50.0);
+      summary.p99 = stats_percentile(sum + i, interval_calls, 99.0);
+      summary.max = sum[i].max;
+    }
+
+    status = callback(entries[i].kind, entries[i].name, &summary, user_data);
+    if (status != 0)
+      break;
+  }
+
+  sfree(sum);
+  sfree(entries);
+  return status;
+} /* }}} int stats_collect */
+
+const char *stats_kind_name(stats_kind_t kind) /* {{{ */
+{
+  switch (kind) {
+  case STATS_READ:
+    return "read";
+  case STATS_WRITE:
+    return "write";
+  case STATS_FLUSH:
+    return "flush";
+  case STATS_MISSING:
+    return "missing";
+  case STATS_CHAIN:
+    return "chain";
+  case STATS_LOCK:
+    return "lock";
+  case STATS_NOTIFICATION:
+    return "notification";
+  }
+
+  return "unknown";
+} /* }}} const char *stats_kind_name */
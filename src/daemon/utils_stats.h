@@ -0,0 +1,130 @@
+/**
+ * collectd - src/daemon/utils_stats.h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_STATS_H
+#define UTILS_STATS_H 1
+
+#include "collectd.h"
+
+#include "utils_time.h"
+
+/*
+ * Self-instrumentation of the daemon: invocation counts, failure counts and
+ * latency distributions of callbacks, filter chains and locks.
+ *
+ * Every thread records into its own set of counters, so recording only takes
+ * an uncontended per-thread lock. stats_collect() merges the counters of all
+ * threads when the internal statistics are read.
+ */
+
+typedef enum {
+  STATS_READ = 0,
+  STATS_WRITE,
+  STATS_FLUSH,
+  STATS_MISSING,
+  STATS_CHAIN,
+  STATS_LOCK,
+  STATS_NOTIFICATION,
+} stats_kind_t;
+
+typedef struct {
+  /* Totals since the daemon has been started. */
+  uint64_t calls;
+  uint64_t failures;
+
+  /* Distribution of the latencies recorded since the previous call of
+   * stats_collect(). All three are zero if nothing has been recorded. */
+  uint64_t interval_calls;
+  cdtime_t p50;
+  cdtime_t p99;
+  cdtime_t max;
+} stats_summary_t;
+
+typedef int (*stats_callback_t)(stats_kind_t kind, const char *name,
+                                const stats_summary_t *summary,
+                                void *user_data);
+
+/*
+ * NAME
+ *  stats_enable
+ *
+ * DESCRIPTION
+ *  Enables recording. Until this is called, stats_register() returns -1 and
+ *  all other functions are no-ops, so instrumented code paths only pay for a
+ *  comparison.
+ */
+void stats_enable(void);
+
+/*
+ * NAME
+ *  stats_register
+ *
+ * DESCRIPTION
+ *  Returns the identifier of the counter set for `name' of the given kind,
+ *  creating it if necessary. Registering the same kind and name twice returns
+ *  the same identifier.
+ *
+ * RETURN VALUE
+ *  A non-negative identifier on success, -1 if recording is disabled or on
+ *  failure.
+ */
+int stats_register(stats_kind_t kind, const char *name);
+
+/*
+ * NAME
+ *  stats_record
+ *
+ * DESCRIPTION
+ *  Records one invocation taking `latency'. If `failed' is true, the failure
+ *  counter is incremented, too. Negative identifiers are ignored.
+ */
+void stats_record(int id, cdtime_t latency, _Bool failed);
+
+/*
+ * NAME
+ *  stats_mutex_lock
+ *
+ * DESCRIPTION
+ *  Locks `lock' like pthread_mutex_lock(3) and records the time spent waiting
+ *  for it under `id'. Uncontended acquisitions are recorded with a latency of
+ *  zero. If `id' is negative, this is a plain pthread_mutex_lock(3).
+ */
+void stats_mutex_lock(pthread_mutex_t *lock, int id);
+
+/*
+ * NAME
+ *  stats_collect
+ *
+ * DESCRIPTION
+ *  Merges the counters of all threads and calls `callback' once for each
+ *  registered counter set. The latency distributions are reset afterwards,
+ *  i.e. each call reports the latencies recorded since the previous one.
+ *
+ * RETURN VALUE
+ *  Zero on success, the first non-zero value returned by `callback' otherwise.
+ */
+int stats_collect(stats_callback_t callback, void *user_data);
+
+/* Returns a short name for `kind', e.g. "read" or "lock". */
+const char *stats_kind_name(stats_kind_t kind);
+
+#endif /* UTILS_STATS_H */
@@ -0,0 +1,145 @@
+/**
+ * collectd - src/daemon/utils_stats_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "testing.h"
+#include "utils_stats.c" /* sic */
+
+DEF_TEST(bucket) {
+  cdtime_t cases[] = {0,    1,       3,       4,        7,
+                      8,    9,       1000,    1048576,  1073741824,
+                      1234567890123};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    size_t index = stats_bucket(cases[i]);
+
+    printf("## Case %zu: %" PRIu64 " -> %zu\n", i, (uint64_t)cases[i], index);
+    OK(index < STATS_BUCKETS);
+    OK(cases[i] <= stats_bucket_upper(index));
+    if (index > 0)
+      OK(cases[i] > stats_bucket_upper(index - 1));
+    /* The bucket is at most 25% wider than its lower bound. */
+    OK(stats_bucket_upper(index) <= cases[i] + cases[i] / 4);
+  }
+
+  /* Buckets are contiguous. */
+  for (size_t i = 1; i < STATS_BUCKETS - 1; i++)
+    OK(stats_bucket(stats_bucket_upper(i - 1) + 1) == i);
+
+  EXPECT_EQ_INT(STATS_BUCKETS - 1, stats_bucket((cdtime_t)-1));
+
+  return 0;
+}
+
+typedef struct {
+  stats_summary_t summary[3];
+  int seen;
+} collect_result_t;
+
+static int collect_callback(__attribute__((unused)) stats_kind_t kind,
+                            const char *name,
+                            const stats_summary_t *summary, void *user_data) {
+  collect_result_t *r = user_data;
+  char const *names[] = {"one", "two", "lock"};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(names); i++) {
+    if (strcmp(names[i], name) != 0)
+      continue;
+    r->summary[i] = *summary;
+    r->seen++;
+  }
+
+  return 0;
+}
+
+static void *record_thread(void *arg) {
+  int *id = arg;
+
+  for (cdtime_t i = 1; i <= 100; i++)
+    stats_record(*id, TIME_T_TO_CDTIME_T(i), (i % 10) == 0);
+
+  return NULL;
+}
+
+DEF_TEST(collect) {
+  /* Disabled: nothing is registered or recorded. */
+  EXPECT_EQ_INT(-1, stats_register(STATS_READ, "one"));
+  stats_record(0, 1, 0);
+
+  stats_enable();
+
+  int one = stats_register(STATS_READ, "one");
+  int two = stats_register(STATS_READ, "two");
+  int lock = stats_register(STATS_LOCK, "lock");
+  OK(one >= 0);
+  OK(two >= 0);
+  OK(lock >= 0);
+  EXPECT_EQ_INT(one, stats_register(STATS_READ, "one"));
+
+  /* Record from four threads, some of which exit before collecting. */
+  pthread_t threads[4];
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(threads); i++)
+    CHECK_ZERO(pthread_create(threads + i, NULL, record_thread, &one));
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(threads); i++)
+    CHECK_ZERO(pthread_join(threads[i], NULL));
+
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  stats_mutex_lock(&mutex, lock);
+  pthread_mutex_unlock(&mutex);
+
+  collect_result_t r = {.seen = 0};
+  CHECK_ZERO(stats_collect(collect_callback, &r));
+  EXPECT_EQ_INT(3, r.seen);
+
+  EXPECT_EQ_UINT64(400, r.summary[0].calls);
+  EXPECT_EQ_UINT64(40, r.summary[0].failures);
+  EXPECT_EQ_UINT64(400, r.summary[0].interval_calls);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(100), r.summary[0].max);
+  OK(r.summary[0].p50 >= TIME_T_TO_CDTIME_T(50));
+  OK(r.summary[0].p50 <= TIME_T_TO_CDTIME_T(50) + TIME_T_TO_CDTIME_T(50) / 4);
+  OK(r.summary[0].p99 >= TIME_T_TO_CDTIME_T(99));
+  OK(r.summary[0].p99 <= TIME_T_TO_CDTIME_T(100));
+
+  EXPECT_EQ_UINT64(0, r.summary[1].calls);
+  EXPECT_EQ_UINT64(0, r.summary[1].interval_calls);
+
+  EXPECT_EQ_UINT64(1, r.summary[2].calls);
+  EXPECT_EQ_UINT64(0, r.summary[2].max);
+
+  /* Totals are kept, distributions are reset. */
+  stats_record(two, TIME_T_TO_CDTIME_T(2), 0);
+  r = (collect_result_t){.seen = 0};
+  CHECK_ZERO(stats_collect(collect_callback, &r));
+  EXPECT_EQ_UINT64(400, r.summary[0].calls);
+  EXPECT_EQ_UINT64(0, r.summary[0].interval_calls);
+  EXPECT_EQ_UINT64(0, r.summary[0].max);
+  EXPECT_EQ_UINT64(1, r.summary[1].calls);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(2), r.summary[1].p50);
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(bucket);
+  RUN_TEST(collect);
+
+  END_TEST;
+}
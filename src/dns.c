@@ -38,95 +38,86 @@
 #include <sys/capability.h>
 #endif
 
+#if KERNEL_LINUX
+#include <arpa/inet.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#ifdef TPACKET3_HDRLEN
+#define DNS_HAVE_TPACKET_V3 1
+#endif
+#endif
+
 /*
  * Private data types
  */
-struct counter_list_s {
-  unsigned int key;
-  unsigned int value;
-  struct counter_list_s *next;
-};
-typedef struct counter_list_s counter_list_t;
+
+/* Counters of one capture thread. They are only written by that thread and
+ * only read by dns_read(), so they are updated without locking. */
+typedef struct {
+  derive_t queries;
+  derive_t responses;
+  derive_t dropped;
+  derive_t qtype[T_MAX];
+  derive_t opcode[16];
+  derive_t rcode[16];
+} dns_counters_t;
+
+#define COUNTER_ADD(c, n) __atomic_store_n(&(c), (c) + (n), __ATOMIC_RELAXED)
+#define COUNTER_GET(c) __atomic_load_n(&(c), __ATOMIC_RELAXED)
+
+typedef struct {
+  dns_counters_t counters;
+  pthread_t thread;
+
+#if DNS_HAVE_TPACKET_V3
+  /* Ring of the packet socket. */
+  int fd;
+  uint8_t *ring;
+  unsigned int block_size;
+  unsigned int block_num;
+  int loopback_ifindex;
+#endif
+} dns_capture_t;
+
+#define ENGINE_PCAP 0
+#define ENGINE_PACKET 1
 
 /*
  * Private variables
  */
-static const char *config_keys[] = {"Interface", "IgnoreSource",
-                                    "SelectNumericQueryTypes"};
+static const char *config_keys[] = {
+    "Interface",     "IgnoreSource",   "SelectNumericQueryTypes",
+    "CaptureEngine", "CaptureThreads", "RingSize",
+    "PcapFile"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 static int select_numeric_qtype = 1;
 
 #define PCAP_SNAPLEN 1460
 static char *pcap_device = NULL;
+static char *pcap_file = NULL;
+static int capture_engine = ENGINE_PCAP;
+static size_t capture_threads_num = 1;
+static size_t ring_size = 4 * 1024 * 1024;
+
+/* Block size of the packet socket rings. Each block is handed to user space
+ * as a whole, once it is full or after `DNS_BLOCK_TIMEOUT' milliseconds. */
+#define DNS_BLOCK_SIZE (1 << 18)
+#define DNS_BLOCK_TIMEOUT 100
 
-static derive_t tr_queries;
-static derive_t tr_responses;
-static counter_list_t *qtype_list;
-static counter_list_t *opcode_list;
-static counter_list_t *rcode_list;
+static dns_capture_t **captures = NULL;
+static size_t captures_num = 0;
+static _Bool capture_loop = 1;
 
 static pthread_t listen_thread;
 static int listen_thread_init = 0;
-/* The `traffic' mutex if for `tr_queries' and `tr_responses' */
-static pthread_mutex_t traffic_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t qtype_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t opcode_mutex = PTHREAD_MUTEX_INITIALIZER;
-static pthread_mutex_t rcode_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  * Private functions
  */
-static counter_list_t *counter_list_search(counter_list_t **list,
-                                           unsigned int key) {
-  counter_list_t *entry;
-
-  for (entry = *list; entry != NULL; entry = entry->next)
-    if (entry->key == key)
-      break;
-
-  return entry;
-}
-
-static counter_list_t *counter_list_create(counter_list_t **list,
-                                           unsigned int key,
-                                           unsigned int value) {
-  counter_list_t *entry;
-
-  entry = calloc(1, sizeof(*entry));
-  if (entry == NULL)
-    return NULL;
-
-  entry->key = key;
-  entry->value = value;
-
-  if (*list == NULL) {
-    *list = entry;
-  } else {
-    counter_list_t *last;
-
-    last = *list;
-    while (last->next != NULL)
-      last = last->next;
-
-    last->next = entry;
-  }
-
-  return entry;
-}
-
-static void counter_list_add(counter_list_t **list, unsigned int key,
-                             unsigned int increment) {
-  counter_list_t *entry;
-
-  entry = counter_list_search(list, key);
-
-  if (entry != NULL) {
-    entry->value += increment;
-  } else {
-    counter_list_create(list, key, increment);
-  }
-}
-
 static int dns_config(const char *key, const char *value) {
   if (strcasecmp(key, "Interface") == 0) {
     if (pcap_device != NULL)
@@ -141,6 +132,40 @@ static int dns_config(const char *key, const char *value) {
       select_numeric_qtype = 0;
     else
       select_numeric_qtype = 1;
+  } else if (strcasecmp(key, "CaptureEngine") == 0) {
+    if (strcasecmp(value, "pcap") == 0)
+      capture_engine = ENGINE_PCAP;
+    else if (strcasecmp(value, "packet") == 0) {
+#if DNS_HAVE_TPACKET_V3
+      capture_engine = ENGINE_PACKET;
+#else
+      ERROR("dns plugin: The \"packet\" capture engine is not supported on "
+            "this system.");
+      return 1;
+#endif
+    } else {
+      ERROR("dns plugin: Unknown capture engine: %s", value);
+      return 1;
+    }
+  } else if (strcasecmp(key, "CaptureThreads") == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("dns plugin: CaptureThreads must be positive.");
+      return 1;
+    }
+    capture_threads_num = (size_t)tmp;
+  } else if (strcasecmp(key, "RingSize") == 0) {
+    double tmp = atof(value);
+    if (tmp < 2 * DNS_BLOCK_SIZE) {
+      ERROR("dns plugin: RingSize must be at least %d bytes.",
+            2 * DNS_BLOCK_SIZE);
+      return 1;
+    }
+    ring_size = (size_t)tmp;
+  } else if (strcasecmp(key, "PcapFile") == 0) {
+    sfree(pcap_file);
+    if ((pcap_file = strdup(value)) == NULL)
+      return 1;
   } else {
     return -1;
   }
@@ -148,43 +173,24 @@ static int dns_config(const char *key, const char *value) {
   return 0;
 }
 
-static void dns_child_callback(const rfc1035_header_t *dns) {
+static void dns_child_callback(const rfc1035_header_t *dns, void *user_data) {
+  dns_counters_t *c = user_data;
+
   if (dns->qr == 0) {
     /* This is a query */
-    int skip = 0;
-    if (!select_numeric_qtype) {
-      const char *str = qtype_str(dns->qtype);
-      if ((str == NULL) || (str[0] == '#'))
-        skip = 1;
-    }
-
-    pthread_mutex_lock(&traffic_mutex);
-    tr_queries += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
-
-    if (skip == 0) {
-      pthread_mutex_lock(&qtype_mutex);
-      counter_list_add(&qtype_list, dns->qtype, 1);
-      pthread_mutex_unlock(&qtype_mutex);
-    }
+    COUNTER_ADD(c->queries, dns->length);
+    COUNTER_ADD(c->qtype[dns->qtype], 1);
   } else {
     /* This is a reply */
-    pthread_mutex_lock(&traffic_mutex);
-    tr_responses += dns->length;
-    pthread_mutex_unlock(&traffic_mutex);
-
-    pthread_mutex_lock(&rcode_mutex);
-    counter_list_add(&rcode_list, dns->rcode, 1);
-    pthread_mutex_unlock(&rcode_mutex);
+    COUNTER_ADD(c->responses, dns->length);
+    COUNTER_ADD(c->rcode[dns->rcode], 1);
   }
 
   /* FIXME: Are queries, replies or both interesting? */
-  pthread_mutex_lock(&opcode_mutex);
-  counter_list_add(&opcode_list, dns->opcode, 1);
-  pthread_mutex_unlock(&opcode_mutex);
+  COUNTER_ADD(c->opcode[dns->opcode], 1);
 }
 
-static int dns_run_pcap_loop(void) {
+static int dns_run_pcap_loop(dns_capture_t *c) {
   pcap_t *pcap_obj;
   char pcap_error[PCAP_ERRBUF_SIZE];
   struct bpf_program fp = {0};
@@ -200,14 +206,19 @@ static int dns_run_pcap_loop(void) {
 
   /* Passing `pcap_device == NULL' is okay and the same as passign "any" */
   DEBUG("dns plugin: Creating PCAP object..");
-  pcap_obj = pcap_open_live((pcap_device != NULL) ? pcap_device : "any",
-                            PCAP_SNAPLEN, 0 /* Not promiscuous */,
-                            (int)CDTIME_T_TO_MS(plugin_get_interval() / 2),
-                            pcap_error);
+  if (pcap_file != NULL)
+    pcap_obj = pcap_open_offline(pcap_file, pcap_error);
+  else
+    pcap_obj = pcap_open_live((pcap_device != NULL) ? pcap_device : "any",
+                              PCAP_SNAPLEN, 0 /* Not promiscuous */,
+                              (int)CDTIME_T_TO_MS(plugin_get_interval() / 2),
+                              pcap_error);
   if (pcap_obj == NULL) {
-    ERROR("dns plugin: Opening interface `%s' "
-          "failed: %s",
-          (pcap_device != NULL) ? pcap_device : "any", pcap_error);
+    ERROR("dns plugin: Opening %s `%s' failed: %s",
+          (pcap_file != NULL) ? "file" : "interface",
+          (pcap_file != NULL) ? pcap_file
+                              : (pcap_device != NULL) ? pcap_device : "any",
+          pcap_error);
     return PCAP_ERROR;
   }
 
@@ -226,14 +237,28 @@ static int dns_run_pcap_loop(void) {
   DEBUG("dns plugin: PCAP object created.");
 
   dnstop_set_pcap_obj(pcap_obj);
-  dnstop_set_callback(dns_child_callback);
 
+  cdtime_t start = cdtime();
   status = pcap_loop(pcap_obj, -1 /* loop forever */,
-                     handle_pcap /* callback */, NULL /* user data */);
+                     handle_pcap /* callback */, (void *)&c->counters);
   INFO("dns plugin: pcap_loop exited with status %i.", status);
+
+  /* Report the throughput of reading a file, so that it can be used as a
+   * benchmark. */
+  if ((pcap_file != NULL) && (status == 0)) {
+    double elapsed = CDTIME_T_TO_DOUBLE(cdtime() - start);
+    derive_t messages = 0;
+    for (size_t i = 0; i < STATIC_ARRAY_SIZE(c->counters.opcode); i++)
+      messages += COUNTER_GET(c->counters.opcode[i]);
+    INFO("dns plugin: Read %" PRIi64 " DNS messages from %s in %.3f s "
+         "(%.0f messages/s).",
+         messages, pcap_file, elapsed,
+         (elapsed > 0) ? ((double)messages) / elapsed : 0.0);
+  }
+
   /* We need to handle "PCAP_ERROR" specially because libpcap currently
    * doesn't return PCAP_ERROR_IFACE_NOT_UP for compatibility reasons. */
-  if (status == PCAP_ERROR)
+  if ((status == PCAP_ERROR) && (pcap_file == NULL))
     status = PCAP_ERROR_IFACE_NOT_UP;
 
   pcap_close(pcap_obj);
@@ -253,48 +278,266 @@ static int dns_sleep_one_interval(void) /* {{{ */
   return 0;
 } /* }}} int dns_sleep_one_interval */
 
-static void *dns_child_loop(__attribute__((unused)) void *dummy) /* {{{ */
+static void *dns_child_loop(void *arg) /* {{{ */
 {
+  dns_capture_t *c = arg;
   int status;
 
   while (42) {
-    status = dns_run_pcap_loop();
+    status = dns_run_pcap_loop(c);
     if (status != PCAP_ERROR_IFACE_NOT_UP)
       break;
 
     dns_sleep_one_interval();
   }
 
-  if (status != PCAP_ERROR_BREAK)
+  if ((status != PCAP_ERROR_BREAK) && (status != 0))
     ERROR("dns plugin: PCAP returned error %s.", pcap_statustostr(status));
 
   listen_thread_init = 0;
   return NULL;
 } /* }}} void *dns_child_loop */
 
+#if DNS_HAVE_TPACKET_V3
+/* Attaches the "udp port 53" filter, compiled by libpcap, to the packet
+ * socket, so that the kernel only puts DNS traffic into the ring. */
+static int dns_packet_filter(int fd) /* {{{ */
+{
+  struct bpf_program fp = {0};
+
+  pcap_t *pcap_obj = pcap_open_dead(DLT_RAW, PCAP_SNAPLEN);
+  if (pcap_obj == NULL)
+    return -1;
+
+  int status = pcap_compile(pcap_obj, &fp, "udp port 53", 1,
+                            PCAP_NETMASK_UNKNOWN);
+  if (status < 0) {
+    ERROR("dns plugin: pcap_compile failed: %s", pcap_geterr(pcap_obj));
+    pcap_close(pcap_obj);
+    return -1;
+  }
+
+  struct sock_fprog prog = {
+      .len = (unsigned short)fp.bf_len,
+      .filter = (struct sock_filter *)fp.bf_insns,
+  };
+  status = setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+  if (status != 0)
+    ERROR("dns plugin: Attaching the socket filter failed: %s", STRERRNO);
+
+  pcap_freecode(&fp);
+  pcap_close(pcap_obj);
+  return status;
+} /* }}} int dns_packet_filter */
+
+static void dns_packet_close(dns_capture_t *c) /* {{{ */
+{
+  if (c->ring != NULL)
+    munmap(c->ring, (size_t)c->block_size * c->block_num);
+  c->ring = NULL;
+  if (c->fd >= 0)
+    close(c->fd);
+  c->fd = -1;
+} /* }}} void dns_packet_close */
+
+/* Opens a packet socket with a TPACKET_V3 ring. With several capture threads,
+ * the sockets join a fanout group, which spreads the packets over the
+ * threads by flow. */
+static int dns_packet_open(dns_capture_t *c) /* {{{ */
+{
+  c->fd = socket(AF_PACKET, SOCK_DGRAM, htons(ETH_P_ALL));
+  if (c->fd < 0) {
+    ERROR("dns plugin: socket(AF_PACKET) failed: %s", STRERRNO);
+    return -1;
+  }
+
+  int version = TPACKET_V3;
+  if (setsockopt(c->fd, SOL_PACKET, PACKET_VERSION, &version,
+                 sizeof(version)) != 0) {
+    ERROR("dns plugin: Setting TPACKET_V3 failed: %s", STRERRNO);
+    dns_packet_close(c);
+    return -1;
+  }
+
+  if (dns_packet_filter(c->fd) != 0) {
+    dns_packet_close(c);
+    return -1;
+  }
+
+  c->block_size = DNS_BLOCK_SIZE;
+  c->block_num = (unsigned int)(ring_size / DNS_BLOCK_SIZE);
+  struct tpacket_req3 req = {
+      .tp_block_size = c->block_size,
+      .tp_block_nr = c->block_num,
+      .tp_frame_size = TPACKET_ALIGNMENT << 7,
+      .tp_retire_blk_tov = DNS_BLOCK_TIMEOUT,
+  };
+  req.tp_frame_nr = (req.tp_block_size / req.tp_frame_size) * req.tp_block_nr;
+  if (setsockopt(c->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0) {
+    ERROR("dns plugin: Creating the packet ring failed: %s", STRERRNO);
+    dns_packet_close(c);
+    return -1;
+  }
+
+  c->ring = mmap(NULL, (size_t)c->block_size * c->block_num,
+                 PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+  if (c->ring == MAP_FAILED) {
+    ERROR("dns plugin: Mapping the packet ring failed: %s", STRERRNO);
+    c->ring = NULL;
+    dns_packet_close(c);
+    return -1;
+  }
+
+  struct sockaddr_ll sll = {
+      .sll_family = AF_PACKET, .sll_protocol = htons(ETH_P_ALL),
+  };
+  if ((pcap_device != NULL) && (strcmp(pcap_device, "any") != 0)) {
+    sll.sll_ifindex = (int)if_nametoindex(pcap_device);
+    if (sll.sll_ifindex == 0) {
+      ERROR("dns plugin: Unknown interface: %s", pcap_device);
+      dns_packet_close(c);
+      return -1;
+    }
+  }
+  /* Like libpcap, ignore the outgoing copy of packets on the loopback
+   * device, so that they are not counted twice. */
+  c->loopback_ifindex = (int)if_nametoindex("lo");
+
+  if (bind(c->fd, (struct sockaddr *)&sll, sizeof(sll)) != 0) {
+    ERROR("dns plugin: Binding the packet socket failed: %s", STRERRNO);
+    dns_packet_close(c);
+    return -1;
+  }
+
+  if (captures_num > 1) {
+    int fanout = (getpid() & 0xffff) |
+                 ((PACKET_FANOUT_HASH | PACKET_FANOUT_FLAG_DEFRAG) << 16);
+    if (setsockopt(c->fd, SOL_PACKET, PACKET_FANOUT, &fanout,
+                   sizeof(fanout)) != 0) {
+      ERROR("dns plugin: Joining the fanout group failed: %s", STRERRNO);
+      dns_packet_close(c);
+      return -1;
+    }
+  }
+
+  return 0;
+} /* }}} int dns_packet_open */
+
+static void dns_packet_stats(dns_capture_t *c) /* {{{ */
+{
+  struct tpacket_stats_v3 stats = {0};
+  socklen_t len = sizeof(stats);
+
+  /* Reading the statistics resets them. */
+  if (getsockopt(c->fd, SOL_PACKET, PACKET_STATISTICS, &stats, &len) == 0)
+    COUNTER_ADD(c->counters.dropped, stats.tp_drops);
+} /* }}} void dns_packet_stats */
+
+static void *dns_packet_loop(void *arg) /* {{{ */
+{
+  dns_capture_t *c = arg;
+  unsigned int block = 0;
+  cdtime_t next_stats = 0;
+
+  if (dns_packet_open(c) != 0)
+    return NULL;
+
+  while (capture_loop) {
+    struct tpacket_block_desc *bd =
+        (void *)(c->ring + (size_t)block * c->block_size);
+
+    if (cdtime() >= next_stats) {
+      dns_packet_stats(c);
+      next_stats = cdtime() + TIME_T_TO_CDTIME_T(1);
+    }
+
+    if ((__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+         TP_STATUS_USER) == 0) {
+      struct pollfd pfd = {.fd = c->fd, .events = POLLIN | POLLERR};
+      /* The timeout lets the thread notice the shutdown. */
+      poll(&pfd, 1, 1000);
+      continue;
+    }
+
+    uint8_t *pkt = (uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt;
+    for (uint32_t i = 0; i < bd->hdr.bh1.num_pkts; i++) {
+      struct tpacket3_hdr *ph = (void *)pkt;
+      struct sockaddr_ll *sll =
+          (void *)(pkt + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+      if ((sll->sll_pkttype != PACKET_OUTGOING) ||
+          (sll->sll_ifindex != c->loopback_ifindex))
+        handle_ip_packet(pkt + ph->tp_net, (int)ph->tp_snaplen, &c->counters);
+      pkt += ph->tp_next_offset;
+    }
+
+    __atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL,
+                     __ATOMIC_RELEASE);
+    block = (block + 1) % c->block_num;
+  }
+
+  dns_packet_close(c);
+  return NULL;
+} /* }}} void *dns_packet_loop */
+#endif /* DNS_HAVE_TPACKET_V3 */
+
 static int dns_init(void) {
   /* clean up an old thread */
   int status;
 
-  pthread_mutex_lock(&traffic_mutex);
-  tr_queries = 0;
-  tr_responses = 0;
-  pthread_mutex_unlock(&traffic_mutex);
-
-  if (listen_thread_init != 0)
+  if ((listen_thread_init != 0) || (captures != NULL))
     return -1;
 
-  status = plugin_thread_create(&listen_thread, NULL, dns_child_loop, (void *)0,
-                                "dns listen");
-  if (status != 0) {
-    ERROR("dns plugin: pthread_create failed: %s", STRERRNO);
+  /* Files are read by a single thread. */
+  captures_num = 1;
+  if ((capture_engine == ENGINE_PACKET) && (pcap_file == NULL))
+    captures_num = capture_threads_num;
+  else if (capture_threads_num > 1)
+    WARNING("dns plugin: CaptureThreads requires the \"packet\" capture "
+            "engine. Using a single thread.");
+
+  captures = calloc(captures_num, sizeof(*captures));
+  if (captures == NULL)
     return -1;
+  for (size_t i = 0; i < captures_num; i++) {
+    captures[i] = calloc(1, sizeof(*captures[i]));
+    if (captures[i] == NULL) {
+      ERROR("dns plugin: calloc failed.");
+      return -1;
+    }
+#if DNS_HAVE_TPACKET_V3
+    captures[i]->fd = -1;
+#endif
   }
 
-  listen_thread_init = 1;
+  dnstop_set_callback(dns_child_callback);
+
+#if DNS_HAVE_TPACKET_V3
+  if ((capture_engine == ENGINE_PACKET) && (pcap_file == NULL)) {
+    for (size_t i = 0; i < captures_num; i++) {
+      char name[32];
+      snprintf(name, sizeof(name), "dns packet#%" PRIsz, i);
+      status = plugin_thread_create(&captures[i]->thread, NULL,
+                                    dns_packet_loop, captures[i], name);
+      if (status != 0) {
+        ERROR("dns plugin: pthread_create failed: %s", STRERRNO);
+        return -1;
+      }
+    }
+  } else
+#endif
+  {
+    status = plugin_thread_create(&listen_thread, NULL, dns_child_loop,
+                                  captures[0], "dns listen");
+    if (status != 0) {
+      ERROR("dns plugin: pthread_create failed: %s", STRERRNO);
+      return -1;
+    }
+
+    listen_thread_init = 1;
+  }
 
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_RAW)
-  if (check_capability(CAP_NET_RAW) != 0) {
+  if ((pcap_file == NULL) && (check_capability(CAP_NET_RAW) != 0)) {
     if (getuid() == 0)
       WARNING("dns plugin: Running collectd as root, but the CAP_NET_RAW "
               "capability is missing. The plugin's read function will probably "
@@ -309,6 +552,27 @@ static int dns_init(void) {
   return 0;
 } /* int dns_init */
 
+static int dns_shutdown(void) {
+#if DNS_HAVE_TPACKET_V3
+  if ((capture_engine != ENGINE_PACKET) || (pcap_file != NULL) ||
+      (captures == NULL))
+    return 0;
+
+  capture_loop = 0;
+  for (size_t i = 0; i < captures_num; i++) {
+    if (captures[i] == NULL)
+      continue;
+    if (captures[i]->thread != (pthread_t)0)
+      pthread_join(captures[i]->thread, NULL);
+    sfree(captures[i]);
+  }
+  sfree(captures);
+  captures_num = 0;
+#endif
+
+  return 0;
+} /* int dns_shutdown */
+
 static void submit_derive(const char *type, const char *type_instance,
                           derive_t value) {
   value_list_t vl = VALUE_LIST_INIT;
@@ -337,59 +601,62 @@ static void submit_octets(derive_t queries, derive_t responses) {
 } /* void submit_octets */
 
 static int dns_read(void) {
-  unsigned int keys[T_MAX];
-  unsigned int values[T_MAX];
-  int len;
+  derive_t queries = 0;
+  derive_t responses = 0;
+  derive_t dropped = 0;
 
-  counter_list_t *ptr;
+  if (captures == NULL)
+    return -1;
 
-  pthread_mutex_lock(&traffic_mutex);
-  values[0] = tr_queries;
-  values[1] = tr_responses;
-  pthread_mutex_unlock(&traffic_mutex);
+  for (size_t i = 0; i < captures_num; i++) {
+    queries += COUNTER_GET(captures[i]->counters.queries);
+    responses += COUNTER_GET(captures[i]->counters.responses);
+    dropped += COUNTER_GET(captures[i]->counters.dropped);
+  }
 
-  if ((values[0] != 0) || (values[1] != 0))
-    submit_octets(values[0], values[1]);
+  if ((queries != 0) || (responses != 0))
+    submit_octets(queries, responses);
 
-  pthread_mutex_lock(&qtype_mutex);
-  for (ptr = qtype_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
-  }
-  pthread_mutex_unlock(&qtype_mutex);
+  for (int t = 0; t < T_MAX; t++) {
+    derive_t sum = 0;
+    for (size_t i = 0; i < captures_num; i++)
+      sum += COUNTER_GET(captures[i]->counters.qtype[t]);
+    if (sum == 0)
+      continue;
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: qtype = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_qtype", qtype_str(keys[i]), values[i]);
-  }
+    const char *str = qtype_str(t);
+    if (!select_numeric_qtype && ((str == NULL) || (str[0] == '#')))
+      continue;
 
-  pthread_mutex_lock(&opcode_mutex);
-  for (ptr = opcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+    DEBUG("dns plugin: qtype = %i; counter = %" PRIi64 ";", t, sum);
+    submit_derive("dns_qtype", str, sum);
   }
-  pthread_mutex_unlock(&opcode_mutex);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: opcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_opcode", opcode_str(keys[i]), values[i]);
-  }
+  for (int o = 0; o < 16; o++) {
+    derive_t sum = 0;
+    for (size_t i = 0; i < captures_num; i++)
+      sum += COUNTER_GET(captures[i]->counters.opcode[o]);
+    if (sum == 0)
+      continue;
 
-  pthread_mutex_lock(&rcode_mutex);
-  for (ptr = rcode_list, len = 0; (ptr != NULL) && (len < T_MAX);
-       ptr = ptr->next, len++) {
-    keys[len] = ptr->key;
-    values[len] = ptr->value;
+    DEBUG("dns plugin: opcode = %i; counter = %" PRIi64 ";", o, sum);
+    submit_derive("dns_opcode", opcode_str(o), sum);
   }
-  pthread_mutex_unlock(&rcode_mutex);
 
-  for (int i = 0; i < len; i++) {
-    DEBUG("dns plugin: rcode = %u; counter = %u;", keys[i], values[i]);
-    submit_derive("dns_rcode", rcode_str(keys[i]), values[i]);
+  for (int r = 0; r < 16; r++) {
+    derive_t sum = 0;
+    for (size_t i = 0; i < captures_num; i++)
+      sum += COUNTER_GET(captures[i]->counters.rcode[r]);
+    if (sum == 0)
+      continue;
+
+    DEBUG("dns plugin: rcode = %i; counter = %" PRIi64 ";", r, sum);
+    submit_derive("dns_rcode", rcode_str(r), sum);
   }
 
+  if ((capture_engine == ENGINE_PACKET) && (pcap_file == NULL))
+    submit_derive("if_rx_dropped", "capture", dropped);
+
   return 0;
 } /* int dns_read */
 
@@ -397,4 +664,5 @@ void module_register(void) {
   plugin_register_config("dns", dns_config, config_keys, config_keys_num);
   plugin_register_init("dns", dns_init);
   plugin_register_read("dns", dns_read);
+  plugin_register_shutdown("dns", dns_shutdown);
 } /* void module_register */
@@ -25,6 +25,7 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE /* For setgroups */
+#define _GNU_SOURCE /* For posix_spawn_file_actions_addclosefrom_np */
 
 #include "collectd.h"
 
@@ -34,17 +35,23 @@
 #include "utils_cmd_putnotif.h"
 #include "utils_cmd_putval.h"
 
+#include <fcntl.h>
 #include <grp.h>
 #include <pwd.h>
 #include <signal.h>
 #include <sys/types.h>
 
+#if HAVE_POSIX_SPAWN
+#include <spawn.h>
+#endif
+
 #ifdef HAVE_SYS_CAPABILITY_H
 #include <sys/capability.h>
 #endif
 
 #define PL_NORMAL 0x01
 #define PL_NOTIF_ACTION 0x02
+#define PL_PERSISTENT 0x04
 
 #define PL_RUNNING 0x10
 
@@ -58,6 +65,9 @@
  * The `pid' and `status' fields are thus unused if the `PL_NOTIF_ACTION' flag
  * is set.
  * The `PL_RUNNING' flag is set in `exec_read' and unset in `exec_read_one'.
+ *
+ * Programs with the `PL_PERSISTENT' flag are started once and kept running.
+ * Their `pid' and `fh_in' fields are protected by `lock' instead.
  */
 struct program_list_s;
 typedef struct program_list_s program_list_t;
@@ -69,6 +79,8 @@ struct program_list_s {
   int pid;
   int status;
   int flags;
+  FILE *fh_in;
+  pthread_mutex_t lock;
   program_list_t *next;
 };
 
@@ -77,6 +89,12 @@ typedef struct program_list_and_notification_s {
   notification_t n;
 } program_list_and_notification_t;
 
+typedef struct program_list_and_fds_s {
+  program_list_t *pl;
+  int fd_out;
+  int fd_err;
+} program_list_and_fds_t;
+
 /*
  * Private variables
  */
@@ -130,11 +148,15 @@ static int exec_config_exec(oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
-  if (strcasecmp("NotificationExec", ci->key) == 0)
+  if ((strcasecmp("NotificationExec", ci->key) == 0) ||
+      (strcasecmp("PersistentNotificationExec", ci->key) == 0))
     pl->flags |= PL_NOTIF_ACTION;
   else
     pl->flags |= PL_NORMAL;
 
+  if (strncasecmp("Persistent", ci->key, strlen("Persistent")) == 0)
+    pl->flags |= PL_PERSISTENT;
+
   pl->user = strdup(ci->values[0].value.string);
   if (pl->user == NULL) {
     ERROR("exec plugin: strdup failed.");
@@ -219,6 +241,8 @@ static int exec_config_exec(oconfig_item_t *ci) /* {{{ */
     DEBUG("exec plugin: argv[%i] = %s", i, pl->argv[i]);
   }
 
+  pthread_mutex_init(&pl->lock, /* attr = */ NULL);
+
   pl->next = pl_head;
   pl_head = pl;
 
@@ -230,7 +254,9 @@ static int exec_config(oconfig_item_t *ci) /* {{{ */
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
     if ((strcasecmp("Exec", child->key) == 0) ||
-        (strcasecmp("NotificationExec", child->key) == 0))
+        (strcasecmp("NotificationExec", child->key) == 0) ||
+        (strcasecmp("PersistentExec", child->key) == 0) ||
+        (strcasecmp("PersistentNotificationExec", child->key) == 0))
       exec_config_exec(child);
     else {
       WARNING("exec plugin: Unknown config option `%s'.", child->key);
@@ -309,6 +335,102 @@ __attribute__((noreturn)) static void exec_child(program_list_t *pl, int uid,
   exit(-1);
 } /* void exec_child }}} */
 
+#if HAVE_POSIX_SPAWN && HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+extern char **environ;
+
+/* Returns a copy of the environment with the variables set by
+ * `set_environment', for use with posix_spawn(). */
+static char **build_environment(void) /* {{{ */
+{
+  size_t env_num = 0;
+  while (environ[env_num] != NULL)
+    env_num++;
+
+  char **env = calloc(env_num + 3, sizeof(*env));
+  if (env == NULL)
+    return NULL;
+
+  size_t j = 0;
+  for (size_t i = 0; i < env_num; i++) {
+    if ((strncmp("COLLECTD_INTERVAL=", environ[i],
+                 strlen("COLLECTD_INTERVAL=")) == 0) ||
+        (strncmp("COLLECTD_HOSTNAME=", environ[i],
+                 strlen("COLLECTD_HOSTNAME=")) == 0))
+      continue;
+    env[j++] = environ[i];
+  }
+
+  char buffer[1024];
+  snprintf(buffer, sizeof(buffer), "COLLECTD_INTERVAL=%.3f",
+           CDTIME_T_TO_DOUBLE(plugin_get_interval()));
+  env[j++] = strdup(buffer);
+  snprintf(buffer, sizeof(buffer), "COLLECTD_HOSTNAME=%s", hostname_g);
+  env[j++] = strdup(buffer);
+
+  if ((env[j - 1] == NULL) || (env[j - 2] == NULL)) {
+    free(env[j - 1]);
+    free(env[j - 2]);
+    free(env);
+    return NULL;
+  }
+
+  return env;
+} /* }}} char **build_environment */
+
+/*
+ * Starts the program with posix_spawn(), which does not need to copy the
+ * page tables of the daemon like fork() does. Since posix_spawn() cannot
+ * change the credentials of the child, this is only used if the program runs
+ * as the same user and group as the daemon.
+ */
+static int spawn_child(program_list_t *pl, int fd_in, int fd_out, /* {{{ */
+                       int fd_err) {
+  posix_spawn_file_actions_t fa;
+  posix_spawnattr_t attr;
+  sigset_t ss;
+  pid_t pid = -1;
+
+  char **env = build_environment();
+  if (env == NULL) {
+    ERROR("exec plugin: build_environment failed.");
+    return -1;
+  }
+
+  posix_spawn_file_actions_init(&fa);
+  posix_spawn_file_actions_adddup2(&fa, fd_in, STDIN_FILENO);
+  posix_spawn_file_actions_adddup2(&fa, fd_out, STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&fa, fd_err, STDERR_FILENO);
+  /* Close all file descriptors but the pipe ends we need. */
+  posix_spawn_file_actions_addclosefrom_np(&fa, STDERR_FILENO + 1);
+
+  /* Unblock all signals */
+  posix_spawnattr_init(&attr);
+  sigemptyset(&ss);
+  posix_spawnattr_setsigmask(&attr, &ss);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+  int status = posix_spawnp(&pid, pl->exec, &fa, &attr, pl->argv, env);
+  if (status != 0) {
+    ERROR("exec plugin: Failed to execute ``%s'': %s", pl->exec,
+          STRERROR(status));
+    pid = -1;
+  }
+
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&fa);
+
+  /* The last two entries have been allocated by build_environment(). */
+  size_t env_num = 0;
+  while (env[env_num] != NULL)
+    env_num++;
+  free(env[env_num - 1]);
+  free(env[env_num - 2]);
+  free(env);
+
+  return (int)pid;
+} /* }}} int spawn_child */
+#endif
+
 static void reset_signal_mask(void) /* {{{ */
 {
   sigset_t ss;
@@ -428,7 +550,17 @@ static int fork_child(program_list_t *pl, int *fd_in, int *fd_out,
     }
   } /* if (pl->group == NULL) */
 
-  pid = fork();
+  pid = -1;
+#if HAVE_POSIX_SPAWN && HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+  if (((uid_t)uid == getuid()) && ((uid_t)uid == geteuid()) &&
+      ((gid_t)gid == getgid()) && ((egid == -1) || ((gid_t)egid == getegid()))) {
+    pid = spawn_child(pl, fd_pipe_in[0], fd_pipe_out[1], fd_pipe_err[1]);
+    if (pid < 0)
+      goto failed;
+  }
+#endif
+  if (pid < 0)
+    pid = fork();
   if (pid < 0) {
     ERROR("exec plugin: fork failed: %s", STRERRNO);
     goto failed;
@@ -500,9 +632,95 @@ failed:
   return -1;
 } /* int fork_child }}} */
 
+/*
+ * Handles the "PUTBATCH" command, which submits any number of value lists
+ * sharing the host, plugin and time with a single line:
+ *
+ *   PUTBATCH <host>/<plugin>[-<instance>] [interval=<seconds>] <time>
+ *       <type>[-<instance>]=<value>[:<value>...] ...
+ */
+static int handle_putbatch(char *buffer) /* {{{ */
+{
+  char *saveptr = NULL;
+  cdtime_t interval = 0;
+  int errors = 0;
+
+  /* Skip the command itself. */
+  strtok_r(buffer, " \t", &saveptr);
+  char *prefix = strtok_r(NULL, " \t", &saveptr);
+  char *time_str = strtok_r(NULL, " \t", &saveptr);
+  if ((time_str != NULL) &&
+      (strncasecmp("interval=", time_str, strlen("interval=")) == 0)) {
+    double tmp = atof(time_str + strlen("interval="));
+    if (tmp > 0.0)
+      interval = DOUBLE_TO_CDTIME_T(tmp);
+    time_str = strtok_r(NULL, " \t", &saveptr);
+  }
+
+  if ((prefix == NULL) || (strchr(prefix, '/') == NULL) ||
+      (time_str == NULL)) {
+    ERROR("exec plugin: Unable to parse PUTBATCH command, ignoring line.");
+    return -1;
+  }
+
+  char *item;
+  while ((item = strtok_r(NULL, " \t", &saveptr)) != NULL) {
+    char identifier[6 * DATA_MAX_NAME_LEN];
+    char values[1024];
+    value_list_t vl = VALUE_LIST_INIT;
+
+    char *value_str = strchr(item, '=');
+    if (value_str == NULL) {
+      ERROR("exec plugin: PUTBATCH: Missing values for `%s'.", item);
+      errors++;
+      continue;
+    }
+    *value_str = 0;
+    value_str++;
+
+    snprintf(identifier, sizeof(identifier), "%s/%s", prefix, item);
+    if (parse_identifier_vl(identifier, &vl) != 0) {
+      ERROR("exec plugin: PUTBATCH: Cannot parse identifier `%s'.",
+            identifier);
+      errors++;
+      continue;
+    }
+
+    const data_set_t *ds = plugin_get_ds(vl.type);
+    if (ds == NULL) {
+      ERROR("exec plugin: PUTBATCH: Type `%s' isn't defined.", vl.type);
+      errors++;
+      continue;
+    }
+
+    vl.values_len = ds->ds_num;
+    vl.values = calloc(vl.values_len, sizeof(*vl.values));
+    if (vl.values == NULL) {
+      ERROR("exec plugin: calloc failed.");
+      return -1;
+    }
+    vl.interval = interval;
+
+    snprintf(values, sizeof(values), "%s:%s", time_str, value_str);
+    if (parse_values(values, &vl, ds) != 0) {
+      ERROR("exec plugin: PUTBATCH: Parsing the values of `%s' failed.",
+            identifier);
+      errors++;
+    } else {
+      plugin_dispatch_values(&vl);
+    }
+
+    sfree(vl.values);
+  }
+
+  return (errors == 0) ? 0 : -1;
+} /* }}} int handle_putbatch */
+
 static int parse_line(char *buffer) /* {{{ */
 {
-  if (strncasecmp("PUTVAL", buffer, strlen("PUTVAL")) == 0)
+  if (strncasecmp("PUTBATCH", buffer, strlen("PUTBATCH")) == 0)
+    return handle_putbatch(buffer);
+  else if (strncasecmp("PUTVAL", buffer, strlen("PUTVAL")) == 0)
     return cmd_handle_putval(stdout, buffer);
   else if (strncasecmp("PUTNOTIF", buffer, strlen("PUTNOTIF")) == 0)
     return handle_putnotif(stdout, buffer);
@@ -513,29 +731,23 @@ static int parse_line(char *buffer) /* {{{ */
   }
 } /* int parse_line }}} */
 
-static void *exec_read_one(void *arg) /* {{{ */
-{
-  program_list_t *pl = (program_list_t *)arg;
-  int fd, fd_err, highest_fd;
+/*
+ * Reads the commands written by a program to STDOUT and logs the lines it
+ * writes to STDERR, until STDOUT is closed. `fd_err' is set to -1 if the
+ * program closes STDERR.
+ */
+static void exec_read_output(program_list_t *pl, int fd, /* {{{ */
+                             int *ret_fd_err) {
+  int fd_err = *ret_fd_err;
+  int highest_fd;
   fd_set fdset, copy;
   int status;
-  char buffer[1200]; /* if not completely read */
+  /* Large enough for PUTBATCH lines. */
+  char buffer[65536]; /* if not completely read */
   char buffer_err[1024];
   char *pbuffer = buffer;
   char *pbuffer_err = buffer_err;
 
-  status = fork_child(pl, NULL, &fd, &fd_err);
-  if (status < 0) {
-    /* Reset the "running" flag */
-    pthread_mutex_lock(&pl_lock);
-    pl->flags &= ~PL_RUNNING;
-    pthread_mutex_unlock(&pl_lock);
-    pthread_exit((void *)1);
-  }
-  pl->pid = status;
-
-  assert(pl->pid != 0);
-
   FD_ZERO(&fdset);
   FD_SET(fd, &fdset);
   FD_SET(fd_err, &fdset);
@@ -559,6 +771,13 @@ static void *exec_read_one(void *arg) /* {{{ */
     if (FD_ISSET(fd, &copy)) {
       char *pnl;
 
+      if (pbuffer - buffer >= (ptrdiff_t)sizeof(buffer) - 1) {
+        ERROR("exec plugin: Program `%s' wrote a line longer than %" PRIsz
+              " bytes, ignoring it.",
+              pl->exec, sizeof(buffer) - 1);
+        pbuffer = buffer;
+      }
+
       len = read(fd, pbuffer, sizeof(buffer) - 1 - (pbuffer - buffer));
 
       if (len < 0) {
@@ -640,6 +859,29 @@ static void *exec_read_one(void *arg) /* {{{ */
     copy = fdset;
   }
 
+  *ret_fd_err = fd_err;
+} /* }}} void exec_read_output */
+
+static void *exec_read_one(void *arg) /* {{{ */
+{
+  program_list_t *pl = (program_list_t *)arg;
+  int fd, fd_err;
+  int status;
+
+  status = fork_child(pl, NULL, &fd, &fd_err);
+  if (status < 0) {
+    /* Reset the "running" flag */
+    pthread_mutex_lock(&pl_lock);
+    pl->flags &= ~PL_RUNNING;
+    pthread_mutex_unlock(&pl_lock);
+    pthread_exit((void *)1);
+  }
+  pl->pid = status;
+
+  assert(pl->pid != 0);
+
+  exec_read_output(pl, fd, &fd_err);
+
   DEBUG("exec plugin: exec_read_one: Waiting for `%s' to exit.", pl->exec);
   if (waitpid(pl->pid, &status, 0) > 0)
     pl->status = status;
@@ -661,31 +903,11 @@ static void *exec_read_one(void *arg) /* {{{ */
   return NULL;
 } /* void *exec_read_one }}} */
 
-static void *exec_notification_one(void *arg) /* {{{ */
-{
-  program_list_t *pl = ((program_list_and_notification_t *)arg)->pl;
-  notification_t *n = &((program_list_and_notification_t *)arg)->n;
-  int fd;
-  FILE *fh;
-  int pid;
-  int status;
+/* Prints the header of a notification, followed by an empty line. */
+static void exec_print_notification(FILE *fh, /* {{{ */
+                                    const notification_t *n) {
   const char *severity;
 
-  pid = fork_child(pl, &fd, NULL, NULL);
-  if (pid < 0) {
-    sfree(arg);
-    pthread_exit((void *)1);
-  }
-
-  fh = fdopen(fd, "w");
-  if (fh == NULL) {
-    ERROR("exec plugin: fdopen (%i) failed: %s", fd, STRERRNO);
-    kill(pid, SIGTERM);
-    close(fd);
-    sfree(arg);
-    pthread_exit((void *)1);
-  }
-
   severity = "FAILURE";
   if (n->severity == NOTIF_WARNING)
     severity = "WARNING";
@@ -724,7 +946,214 @@ static void *exec_notification_one(void *arg) /* {{{ */
               meta->nm_value.nm_boolean ? "true" : "false");
   }
 
-  fprintf(fh, "\n%s\n", n->message);
+  fprintf(fh, "\n");
+} /* }}} void exec_print_notification */
+
+/*
+ * Reads the output of a persistent program until it exits. The program is
+ * started again by the next call to `exec_read'.
+ */
+static void *exec_read_persistent(void *arg) /* {{{ */
+{
+  program_list_and_fds_t *plf = arg;
+  program_list_t *pl = plf->pl;
+  int fd = plf->fd_out;
+  int fd_err = plf->fd_err;
+  int status;
+
+  sfree(plf);
+
+  exec_read_output(pl, fd, &fd_err);
+
+  pthread_mutex_lock(&pl->lock);
+  int pid = pl->pid;
+  if (pl->fh_in != NULL)
+    fclose(pl->fh_in);
+  pl->fh_in = NULL;
+  pthread_mutex_unlock(&pl->lock);
+
+  _Bool reaped = (waitpid(pid, &status, 0) > 0);
+
+  NOTICE("exec plugin: Persistent program `%s' (pid %i) exited, it will be "
+         "started again.",
+         pl->exec, pid);
+
+  /* The program may have been replaced already, e.g. after a failed write
+   * in `exec_notification_persistent'. Only forget the pid if it is ours. */
+  pthread_mutex_lock(&pl->lock);
+  if (reaped)
+    pl->status = status;
+  if (pl->pid == pid)
+    pl->pid = 0;
+  pthread_mutex_unlock(&pl->lock);
+
+  close(fd);
+  if (fd_err >= 0)
+    close(fd_err);
+
+  pthread_exit((void *)0);
+  return NULL;
+} /* }}} void *exec_read_persistent */
+
+/*
+ * Starts a persistent program and keeps its STDIN open in `fh_in'. If the
+ * program submits values, a thread reading its output is started, too. Must
+ * be called with `pl->lock' held.
+ */
+static int exec_start_persistent(program_list_t *pl) /* {{{ */
+{
+  int fd_in = -1;
+  int fd_out = -1;
+  int fd_err = -1;
+  _Bool read_output = ((pl->flags & PL_NORMAL) != 0);
+
+  int pid = fork_child(pl, &fd_in, read_output ? &fd_out : NULL,
+                       read_output ? &fd_err : NULL);
+  if (pid < 0)
+    return -1;
+
+  pl->fh_in = fdopen(fd_in, "w");
+  if (pl->fh_in == NULL) {
+    ERROR("exec plugin: fdopen (%i) failed: %s", fd_in, STRERRNO);
+    goto failed;
+  }
+  pl->pid = pid;
+
+  if (!read_output)
+    return 0;
+
+  /* Read requests are skipped rather than blocking the read thread if the
+   * program does not keep up. */
+  fcntl(fd_in, F_SETFL, fcntl(fd_in, F_GETFL) | O_NONBLOCK);
+
+  program_list_and_fds_t *plf = malloc(sizeof(*plf));
+  if (plf == NULL) {
+    ERROR("exec plugin: malloc failed.");
+    goto failed;
+  }
+  plf->pl = pl;
+  plf->fd_out = fd_out;
+  plf->fd_err = fd_err;
+
+  pthread_t t;
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  int status = plugin_thread_create(&t, &attr, exec_read_persistent,
+                                    (void *)plf, "exec persist");
+  pthread_attr_destroy(&attr);
+  if (status != 0) {
+    ERROR("exec plugin: plugin_thread_create failed.");
+    sfree(plf);
+    goto failed;
+  }
+
+  return 0;
+
+failed:
+  kill(pid, SIGTERM);
+  if (pl->fh_in != NULL)
+    fclose(pl->fh_in);
+  else
+    close(fd_in);
+  pl->fh_in = NULL;
+  pl->pid = 0;
+  if (fd_out >= 0)
+    close(fd_out);
+  if (fd_err >= 0)
+    close(fd_err);
+  return -1;
+} /* }}} int exec_start_persistent */
+
+/* Asks a persistent program to submit its values, starting it if needed. */
+static void exec_trigger_persistent(program_list_t *pl) /* {{{ */
+{
+  char buffer[64];
+
+  pthread_mutex_lock(&pl->lock);
+  if ((pl->fh_in == NULL) && (exec_start_persistent(pl) != 0)) {
+    pthread_mutex_unlock(&pl->lock);
+    return;
+  }
+
+  int len = snprintf(buffer, sizeof(buffer), "READ %.3f\n",
+                     CDTIME_T_TO_DOUBLE(cdtime()));
+  /* If the write fails otherwise, the program has exited and is started
+   * again once its output has been read. */
+  if ((write(fileno(pl->fh_in), buffer, (size_t)len) < 0) &&
+      (errno == EAGAIN))
+    WARNING("exec plugin: Persistent program `%s' does not keep up with the "
+            "read requests, skipping one.",
+            pl->exec);
+  pthread_mutex_unlock(&pl->lock);
+} /* }}} void exec_trigger_persistent */
+
+/*
+ * Passes a notification to a persistent program. Notifications are separated
+ * by an empty line, so newlines in the message are replaced by spaces.
+ */
+static int exec_notification_persistent(program_list_t *pl, /* {{{ */
+                                        const notification_t *n) {
+  char message[NOTIF_MAX_MSG_LEN];
+  int status = -1;
+
+  sstrncpy(message, n->message, sizeof(message));
+  for (char *c = message; *c != 0; c++)
+    if ((*c == '\n') || (*c == '\r'))
+      *c = ' ';
+
+  pthread_mutex_lock(&pl->lock);
+  /* Start the program again, once, if it has exited. */
+  for (int i = 0; i < 2; i++) {
+    if ((pl->fh_in == NULL) && (exec_start_persistent(pl) != 0))
+      break;
+
+    exec_print_notification(pl->fh_in, n);
+    fprintf(pl->fh_in, "%s\n\n", message);
+    if ((fflush(pl->fh_in) == 0) && !ferror(pl->fh_in)) {
+      status = 0;
+      break;
+    }
+
+    NOTICE("exec plugin: Writing to persistent program `%s' failed: %s",
+           pl->exec, STRERRNO);
+    fclose(pl->fh_in);
+    pl->fh_in = NULL;
+    if (pl->pid > 0)
+      kill(pl->pid, SIGTERM);
+    pl->pid = 0;
+  }
+  pthread_mutex_unlock(&pl->lock);
+
+  return status;
+} /* }}} int exec_notification_persistent */
+
+static void *exec_notification_one(void *arg) /* {{{ */
+{
+  program_list_t *pl = ((program_list_and_notification_t *)arg)->pl;
+  notification_t *n = &((program_list_and_notification_t *)arg)->n;
+  int fd;
+  FILE *fh;
+  int pid;
+  int status;
+
+  pid = fork_child(pl, &fd, NULL, NULL);
+  if (pid < 0) {
+    sfree(arg);
+    pthread_exit((void *)1);
+  }
+
+  fh = fdopen(fd, "w");
+  if (fh == NULL) {
+    ERROR("exec plugin: fdopen (%i) failed: %s", fd, STRERRNO);
+    kill(pid, SIGTERM);
+    close(fd);
+    sfree(arg);
+    pthread_exit((void *)1);
+  }
+
+  exec_print_notification(fh, n);
+  fprintf(fh, "%s\n", n->message);
 
   fflush(fh);
   fclose(fh);
@@ -777,6 +1206,11 @@ static int exec_read(void) /* {{{ */
     if ((pl->flags & PL_NORMAL) == 0)
       continue;
 
+    if ((pl->flags & PL_PERSISTENT) != 0) {
+      exec_trigger_persistent(pl);
+      continue;
+    }
+
     pthread_mutex_lock(&pl_lock);
     /* Skip if a child is already running. */
     if ((pl->flags & PL_RUNNING) != 0) {
@@ -811,6 +1245,11 @@ static int exec_notification(const notification_t *n, /* {{{ */
     if ((pl->flags & PL_NOTIF_ACTION) == 0)
       continue;
 
+    if ((pl->flags & PL_PERSISTENT) != 0) {
+      exec_notification_persistent(pl, n);
+      continue;
+    }
+
     /* Skip if a child is already running. */
     if (pl->pid != 0)
       continue;
@@ -851,13 +1290,24 @@ static int exec_shutdown(void) /* {{{ */
   while (pl != NULL) {
     next = pl->next;
 
+    /* Persistent programs are expected to exit when STDIN is closed. */
+    pthread_mutex_lock(&pl->lock);
+    if (pl->fh_in != NULL)
+      fclose(pl->fh_in);
+    pl->fh_in = NULL;
+    pthread_mutex_unlock(&pl->lock);
+
     if (pl->pid > 0) {
       kill(pl->pid, SIGTERM);
       INFO("exec plugin: Sent SIGTERM to %hu", (unsigned short int)pl->pid);
     }
 
-    sfree(pl->user);
-    sfree(pl);
+    /* The thread reading the output of a persistent program may still access
+     * its entry. */
+    if ((pl->flags & PL_PERSISTENT) == 0) {
+      sfree(pl->user);
+      sfree(pl);
+    }
 
     pl = next;
   } /* while (pl) */
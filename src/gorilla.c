@@ -0,0 +1,812 @@
+/**
+ * collectd - src/gorilla.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "plugin.h"
+#include "utils_avltree.h"
+#include "utils_cache.h"
+#include "utils_gorilla.h"
+
+/*
+ * Each series has one open block in memory, to which points are appended as
+ * they are written. Once a block is full, old enough, or flushed, it is sealed
+ * and copied to the write buffer. A separate thread appends the buffer to the
+ * current segment whenever it is full, so the disk only sees large sequential
+ * writes. The same thread periodically compacts the data directory: segments
+ * past the retention time are removed and small segments, as left behind by
+ * each restart, are merged with their blocks grouped by series.
+ */
+
+typedef struct {
+  uint32_t id;
+  gorilla_encoder_t enc;
+} gorilla_series_t;
+
+typedef struct {
+  char *data;
+  size_t size;
+  size_t alloc;
+} gorilla_buffer_t;
+
+/* A block read during compaction, its payload is stored at `offset' in the
+ * compaction buffer. */
+typedef struct {
+  gorilla_block_header_t hdr;
+  size_t offset;
+} gorilla_block_ref_t;
+
+typedef struct {
+  int64_t expire;
+  gorilla_buffer_t data;
+  gorilla_block_ref_t *blocks;
+  size_t blocks_num;
+  size_t dropped;
+  int64_t last_time;
+} gorilla_compaction_t;
+
+/*
+ * Private variables
+ */
+static char *conf_datadir = NULL;
+static _Bool conf_store_rates = 0;
+static size_t conf_block_size = 4096;
+static cdtime_t conf_block_duration = TIME_T_TO_CDTIME_T_STATIC(7200);
+static size_t conf_segment_size = 64 * 1024 * 1024;
+static size_t conf_write_buffer_size = 1024 * 1024;
+static cdtime_t conf_retention = 0;
+static cdtime_t conf_compact_interval = TIME_T_TO_CDTIME_T_STATIC(3600);
+
+/* Protects the series and the index. */
+static c_avl_tree_t *series_tree = NULL;
+static gorilla_index_t series_index = {.fd = -1};
+static pthread_mutex_t series_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Sealed blocks waiting for the writer thread. */
+static gorilla_buffer_t pending = {NULL, 0, 0};
+static _Bool pending_flush = 0;
+static _Bool pending_shutdown = 0;
+static pthread_mutex_t pending_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pending_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t writer_thread;
+static _Bool writer_running = 0;
+
+/* Only used by the writer thread. */
+static int segment_fd = -1;
+static uint32_t segment_seq = 0;
+static size_t segment_size = 0;
+
+static int buffer_append(gorilla_buffer_t *buf, void const *data, /* {{{ */
+                         size_t size) {
+  if (buf->size + size > buf->alloc) {
+    size_t alloc = (buf->alloc > 0) ? buf->alloc : 4096;
+    while (alloc < buf->size + size)
+      alloc *= 2;
+
+    char *tmp = realloc(buf->data, alloc);
+    if (tmp == NULL)
+      return ENOMEM;
+    buf->data = tmp;
+    buf->alloc = alloc;
+  }
+
+  memcpy(buf->data + buf->size, data, size);
+  buf->size += size;
+  return 0;
+} /* }}} int buffer_append */
+
+/*
+ * Writer thread
+ */
+static int write_all(int fd, char const *data, size_t size) /* {{{ */
+{
+  while (size > 0) {
+    ssize_t status = write(fd, data, size);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      return errno;
+    }
+    data += status;
+    size -= (size_t)status;
+  }
+  return 0;
+} /* }}} int write_all */
+
+static void segment_close(void) /* {{{ */
+{
+  if (segment_fd < 0)
+    return;
+
+  if (fsync(segment_fd) != 0)
+    WARNING("gorilla plugin: fsync of segment %" PRIu32 " failed: %s",
+            segment_seq, STRERRNO);
+  close(segment_fd);
+  segment_fd = -1;
+} /* }}} void segment_close */
+
+static int segment_write(char const *data, size_t size) /* {{{ */
+{
+  char path[PATH_MAX];
+
+  if ((segment_fd >= 0) && (segment_size >= conf_segment_size))
+    segment_close();
+
+  if (segment_fd < 0) {
+    segment_seq++;
+    segment_size = 0;
+    gorilla_segment_path(path, sizeof(path), conf_datadir, segment_seq);
+    segment_fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644);
+    if (segment_fd < 0) {
+      ERROR("gorilla plugin: Creating segment \"%s\" failed: %s", path,
+            STRERRNO);
+      return -1;
+    }
+  }
+
+  int status = write_all(segment_fd, data, size);
+  if (status != 0) {
+    ERROR("gorilla plugin: Writing segment %" PRIu32 " failed: %s",
+          segment_seq, STRERROR(status));
+    /* Don't append to a segment with a partially written block. */
+    close(segment_fd);
+    segment_fd = -1;
+    return -1;
+  }
+
+  segment_size += size;
+  return 0;
+} /* }}} int segment_write */
+
+static int compaction_add_block(gorilla_block_header_t const *hdr, /* {{{ */
+                                uint8_t const *payload, void *user_data) {
+  gorilla_compaction_t *c = user_data;
+
+  if (hdr->last_time < c->expire) {
+    c->dropped++;
+    return 0;
+  }
+
+  gorilla_block_ref_t *tmp =
+      realloc(c->blocks, (c->blocks_num + 1) * sizeof(*c->blocks));
+  if (tmp == NULL)
+    return ENOMEM;
+  c->blocks = tmp;
+
+  c->blocks[c->blocks_num].hdr = *hdr;
+  c->blocks[c->blocks_num].offset = c->data.size;
+  if (buffer_append(&c->data, payload, hdr->size) != 0)
+    return ENOMEM;
+  c->blocks_num++;
+  return 0;
+} /* }}} int compaction_add_block */
+
+static int compaction_last_time(gorilla_block_header_t const *hdr, /* {{{ */
+                                __attribute__((unused)) uint8_t const *payload,
+                                void *user_data) {
+  gorilla_compaction_t *c = user_data;
+  if (hdr->last_time > c->last_time)
+    c->last_time = hdr->last_time;
+  return 0;
+} /* }}} int compaction_last_time */
+
+static int compare_block_ref(void const *a, void const *b) /* {{{ */
+{
+  gorilla_block_header_t const *x = &((gorilla_block_ref_t const *)a)->hdr;
+  gorilla_block_header_t const *y = &((gorilla_block_ref_t const *)b)->hdr;
+
+  if (x->series_id != y->series_id)
+    return (x->series_id > y->series_id) ? 1 : -1;
+  return (x->first_time > y->first_time) - (x->first_time < y->first_time);
+} /* }}} int compare_block_ref */
+
+/* Replaces the segments in `seqs' with a single one holding the blocks read
+ * into `c', sorted by series. */
+static int compaction_merge(gorilla_compaction_t *c, /* {{{ */
+                            uint32_t const *seqs, size_t seqs_num) {
+  char path[PATH_MAX];
+  char tmp_path[PATH_MAX + sizeof(".tmp")];
+  int status = 0;
+
+  gorilla_segment_path(path, sizeof(path), conf_datadir, seqs[0]);
+
+  if (c->blocks_num > 0) {
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      ERROR("gorilla plugin: Creating \"%s\" failed: %s", tmp_path, STRERRNO);
+      return -1;
+    }
+
+    qsort(c->blocks, c->blocks_num, sizeof(*c->blocks), compare_block_ref);
+
+    /* Blocks are collected in a buffer so that the file is written with few
+     * large writes. */
+    gorilla_buffer_t out = {NULL, 0, 0};
+    for (size_t i = 0; (i < c->blocks_num) && (status == 0); i++) {
+      gorilla_block_ref_t *b = c->blocks + i;
+      status = buffer_append(&out, &b->hdr, sizeof(b->hdr));
+      if (status == 0)
+        status = buffer_append(&out, c->data.data + b->offset, b->hdr.size);
+      if ((status == 0) &&
+          ((out.size >= conf_write_buffer_size) || (i == c->blocks_num - 1))) {
+        status = write_all(fd, out.data, out.size);
+        out.size = 0;
+      }
+    }
+    sfree(out.data);
+
+    if ((status == 0) && (fsync(fd) != 0))
+      status = errno;
+    close(fd);
+
+    if (status == 0 && (rename(tmp_path, path) != 0))
+      status = errno;
+    if (status != 0) {
+      ERROR("gorilla plugin: Writing \"%s\" failed: %s", tmp_path,
+            STRERROR(status));
+      unlink(tmp_path);
+      return -1;
+    }
+  } else {
+    unlink(path);
+  }
+
+  for (size_t i = 1; i < seqs_num; i++) {
+    gorilla_segment_path(path, sizeof(path), conf_datadir, seqs[i]);
+    unlink(path);
+  }
+
+  DEBUG("gorilla plugin: Merged %" PRIsz " segments starting at %" PRIu32
+        ", %" PRIsz " blocks kept, %" PRIsz " expired.",
+        seqs_num, seqs[0], c->blocks_num, c->dropped);
+  return 0;
+} /* }}} int compaction_merge */
+
+static void compaction_reset(gorilla_compaction_t *c) /* {{{ */
+{
+  c->data.size = 0;
+  c->blocks_num = 0;
+  c->dropped = 0;
+} /* }}} void compaction_reset */
+
+static void gorilla_compact(void) /* {{{ */
+{
+  gorilla_compaction_t c = {.expire = INT64_MIN};
+  uint32_t *seqs = NULL;
+  size_t seqs_num = 0;
+  char path[PATH_MAX];
+
+  int status = gorilla_segment_list(conf_datadir, &seqs, &seqs_num);
+  if (status != 0) {
+    ERROR("gorilla plugin: Listing segments failed: %s", STRERROR(status));
+    return;
+  }
+
+  cdtime_t now = cdtime();
+  if ((conf_retention > 0) && (now > conf_retention))
+    c.expire = (int64_t)CDTIME_T_TO_MS(now - conf_retention);
+
+  /* Runs of small segments are merged, up to the segment size. */
+  size_t group_begin = 0;
+  size_t group_num = 0;
+  size_t group_size = 0;
+
+  for (size_t i = 0; i <= seqs_num; i++) {
+    struct stat statbuf;
+
+    /* The current segment is still being written to. */
+    _Bool skip = (i == seqs_num) ||
+                 ((segment_fd >= 0) && (seqs[i] == segment_seq));
+    if (!skip) {
+      gorilla_segment_path(path, sizeof(path), conf_datadir, seqs[i]);
+      skip = (stat(path, &statbuf) != 0);
+    }
+    size_t size = skip ? 0 : (size_t)statbuf.st_size;
+    _Bool small = !skip && (size < conf_segment_size / 2);
+
+    /* Merging a single segment only pays off if blocks expired. */
+    if ((group_num > 0) && (!small || (group_size + size > conf_segment_size))) {
+      if ((group_num > 1) || (c.dropped > 0))
+        compaction_merge(&c, seqs + group_begin, group_num);
+      compaction_reset(&c);
+      group_num = 0;
+      group_size = 0;
+    }
+
+    if (small) {
+      if (group_num == 0)
+        group_begin = i;
+      group_num++;
+      group_size += size;
+
+      status = gorilla_segment_read(path, compaction_add_block, &c);
+      if (status != 0) {
+        ERROR("gorilla plugin: Reading \"%s\" failed: %s", path,
+              STRERROR(status));
+        compaction_reset(&c);
+        group_num = 0;
+        group_size = 0;
+      }
+      continue;
+    }
+
+    if (skip || (c.expire == INT64_MIN))
+      continue;
+
+    /* A large segment is removed once all of its blocks expired. Blocks are
+     * written after their last point, so the modification time tells whether
+     * reading the segment is worth it. */
+    if ((int64_t)CDTIME_T_TO_MS(TIME_T_TO_CDTIME_T(statbuf.st_mtime)) >=
+        c.expire)
+      continue;
+
+    c.last_time = INT64_MIN;
+    if ((gorilla_segment_read(path, compaction_last_time, &c) == 0) &&
+        (c.last_time < c.expire)) {
+      DEBUG("gorilla plugin: Removing expired segment \"%s\".", path);
+      unlink(path);
+    }
+  }
+
+  sfree(c.data.data);
+  sfree(c.blocks);
+  sfree(seqs);
+} /* }}} void gorilla_compact */
+
+static void *gorilla_writer(__attribute__((unused)) void *arg) /* {{{ */
+{
+  gorilla_buffer_t buf = {NULL, 0, 0};
+  cdtime_t next_compaction = cdtime() + conf_compact_interval;
+
+  pthread_mutex_lock(&pending_lock);
+  while (42) {
+    while (!pending_shutdown && !pending_flush &&
+           (pending.size < conf_write_buffer_size)) {
+      if (conf_compact_interval == 0) {
+        pthread_cond_wait(&pending_cond, &pending_lock);
+        continue;
+      }
+
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(next_compaction);
+      if (pthread_cond_timedwait(&pending_cond, &pending_lock, &ts) ==
+          ETIMEDOUT)
+        break;
+    }
+
+    /* Swap buffers, so that blocks can be sealed while writing. */
+    gorilla_buffer_t tmp = pending;
+    pending = buf;
+    buf = tmp;
+    pending_flush = 0;
+    _Bool shutdown = pending_shutdown;
+    pthread_mutex_unlock(&pending_lock);
+
+    if (buf.size > 0) {
+      segment_write(buf.data, buf.size);
+      buf.size = 0;
+    }
+
+    if (shutdown)
+      break;
+
+    if ((conf_compact_interval > 0) && (cdtime() >= next_compaction)) {
+      gorilla_compact();
+      next_compaction = cdtime() + conf_compact_interval;
+    }
+
+    pthread_mutex_lock(&pending_lock);
+  }
+
+  segment_close();
+  sfree(buf.data);
+  return NULL;
+} /* }}} void *gorilla_writer */
+
+/*
+ * Series
+ */
+/* Copies the open block of `s' to the write buffer and starts a new one.
+ * Must be called with series_lock held. */
+static int series_seal(gorilla_series_t *s) /* {{{ */
+{
+  gorilla_block_header_t hdr;
+  int status = 0;
+
+  if (s->enc.points_num == 0)
+    return 0;
+
+  gorilla_encoder_header(&s->enc, s->id, &hdr);
+
+  pthread_mutex_lock(&pending_lock);
+  size_t size = pending.size;
+  if ((buffer_append(&pending, &hdr, sizeof(hdr)) != 0) ||
+      (buffer_append(&pending, s->enc.data, hdr.size) != 0)) {
+    pending.size = size;
+    status = ENOMEM;
+  }
+  if (pending.size >= conf_write_buffer_size)
+    pthread_cond_signal(&pending_cond);
+  pthread_mutex_unlock(&pending_lock);
+
+  if (status != 0)
+    ERROR("gorilla plugin: Dropping a block of %" PRIu32 " points: %s",
+          hdr.points_num, STRERROR(status));
+
+  gorilla_encoder_reset(&s->enc);
+  return status;
+} /* }}} int series_seal */
+
+static gorilla_series_t *series_create(uint32_t id, /* {{{ */
+                                       size_t values_num,
+                                       uint8_t const *ds_types) {
+  gorilla_series_t *s = calloc(1, sizeof(*s));
+  if (s == NULL)
+    return NULL;
+
+  s->id = id;
+  if (gorilla_encoder_init(&s->enc, values_num, ds_types) != 0) {
+    sfree(s);
+    return NULL;
+  }
+  return s;
+} /* }}} gorilla_series_t *series_create */
+
+static void series_destroy(gorilla_series_t *s) /* {{{ */
+{
+  if (s == NULL)
+    return;
+  gorilla_encoder_destroy(&s->enc);
+  sfree(s);
+} /* }}} void series_destroy */
+
+/* Returns the series `name', creating it if necessary. If the data set
+ * changed, the series is continued under a new id. Must be called with
+ * series_lock held. */
+static gorilla_series_t *series_get(char const *name, /* {{{ */
+                                    size_t values_num,
+                                    uint8_t const *ds_types) {
+  gorilla_series_t *s = NULL;
+  uint32_t id;
+
+  if (c_avl_get(series_tree, name, (void *)&s) == 0) {
+    gorilla_index_record_t const *r = series_index.records + s->id;
+    if ((r->values_num == values_num) &&
+        (memcmp(r->ds_types, ds_types, values_num) == 0))
+      return s;
+  }
+
+  int status =
+      gorilla_index_add(&series_index, name, values_num, ds_types, &id);
+  if (status != 0) {
+    ERROR("gorilla plugin: Adding \"%s\" to the index failed: %s", name,
+          STRERROR(status));
+    return NULL;
+  }
+
+  if (s != NULL) {
+    INFO("gorilla plugin: The data set of \"%s\" changed, continuing as "
+         "series %" PRIu32 ".",
+         name, id);
+    series_seal(s);
+    gorilla_encoder_destroy(&s->enc);
+    s->id = id;
+    if (gorilla_encoder_init(&s->enc, values_num, ds_types) != 0) {
+      char *key = NULL;
+      c_avl_remove(series_tree, name, (void *)&key, NULL);
+      sfree(key);
+      sfree(s);
+      return NULL;
+    }
+    return s;
+  }
+
+  s = series_create(id, values_num, ds_types);
+  char *key = strdup(name);
+  if ((s == NULL) || (key == NULL) || (c_avl_insert(series_tree, key, s) != 0)) {
+    series_destroy(s);
+    sfree(key);
+    return NULL;
+  }
+  return s;
+} /* }}} gorilla_series_t *series_get */
+
+static int series_append(gorilla_series_t *s, int64_t time, /* {{{ */
+                         uint64_t const *values) {
+  int status = gorilla_encoder_append(&s->enc, time, values);
+  if (status == ERANGE) {
+    series_seal(s);
+    status = gorilla_encoder_append(&s->enc, time, values);
+  }
+  if (status == EINVAL) {
+    /* Only happens if a block received points out of order. */
+    DEBUG("gorilla plugin: Ignoring point of series %" PRIu32
+          " not newer than the last one.",
+          s->id);
+    return 0;
+  }
+  if (status != 0)
+    return status;
+
+  int64_t duration_ms = (int64_t)CDTIME_T_TO_MS(conf_block_duration);
+  if ((gorilla_encoder_size(&s->enc) >= conf_block_size) ||
+      (s->enc.last_time - s->enc.first_time >= duration_ms))
+    series_seal(s);
+
+  return 0;
+} /* }}} int series_append */
+
+/*
+ * Plugin callbacks
+ */
+static int gorilla_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
+                         __attribute__((unused)) user_data_t *user_data) {
+  char name[6 * DATA_MAX_NAME_LEN];
+  uint64_t values[GORILLA_VALUES_MAX];
+  uint8_t ds_types[GORILLA_VALUES_MAX];
+  gauge_t *rates = NULL;
+
+  if (ds->ds_num > GORILLA_VALUES_MAX) {
+    ERROR("gorilla plugin: Data set \"%s\" has too many data sources.",
+          ds->type);
+    return -1;
+  }
+
+  if (FORMAT_VL(name, sizeof(name), vl) != 0)
+    return -1;
+
+  for (size_t i = 0; i < ds->ds_num; i++) {
+    value_t v = vl->values[i];
+
+    ds_types[i] = (uint8_t)ds->ds[i].type;
+    if (conf_store_rates && (ds->ds[i].type != DS_TYPE_GAUGE)) {
+      if (rates == NULL)
+        rates = uc_get_rate(ds, vl);
+      if (rates == NULL) {
+        WARNING("gorilla plugin: uc_get_rate failed.");
+        return -1;
+      }
+      v.gauge = rates[i];
+      ds_types[i] = DS_TYPE_GAUGE;
+    }
+    memcpy(values + i, &v, sizeof(values[i]));
+  }
+  sfree(rates);
+
+  pthread_mutex_lock(&series_lock);
+  gorilla_series_t *s = series_get(name, ds->ds_num, ds_types);
+  int status = -1;
+  if (s != NULL)
+    status = series_append(s, (int64_t)CDTIME_T_TO_MS(vl->time), values);
+  pthread_mutex_unlock(&series_lock);
+
+  return status;
+} /* }}} int gorilla_write */
+
+static int gorilla_flush(cdtime_t timeout, const char *identifier, /* {{{ */
+                         __attribute__((unused)) user_data_t *user_data) {
+  gorilla_series_t *s;
+  char *name;
+
+  int64_t limit = INT64_MAX;
+  if (timeout > 0)
+    limit = (int64_t)CDTIME_T_TO_MS(cdtime() - timeout);
+
+  pthread_mutex_lock(&series_lock);
+  if (identifier != NULL) {
+    if (c_avl_get(series_tree, identifier, (void *)&s) == 0)
+      series_seal(s);
+  } else {
+    c_avl_iterator_t *iter = c_avl_get_iterator(series_tree);
+    while (c_avl_iterator_next(iter, (void *)&name, (void *)&s) == 0) {
+      if ((s->enc.points_num > 0) && (s->enc.first_time <= limit))
+        series_seal(s);
+    }
+    c_avl_iterator_destroy(iter);
+  }
+  pthread_mutex_unlock(&series_lock);
+
+  pthread_mutex_lock(&pending_lock);
+  pending_flush = 1;
+  pthread_cond_signal(&pending_cond);
+  pthread_mutex_unlock(&pending_lock);
+
+  return 0;
+} /* }}} int gorilla_flush */
+
+static int config_get_size(oconfig_item_t *ci, size_t *ret) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+  if (tmp <= 0) {
+    ERROR("gorilla plugin: \"%s\" must be positive.", ci->key);
+    return -1;
+  }
+
+  *ret = (size_t)tmp;
+  return 0;
+} /* }}} int config_get_size */
+
+static int gorilla_config(oconfig_item_t *ci) /* {{{ */
+{
+  int status = 0;
+
+  for (int i = 0; i < ci->children_num; i++) {
+    oconfig_item_t *child = ci->children + i;
+
+    if (strcasecmp("DataDir", child->key) == 0)
+      status = cf_util_get_string(child, &conf_datadir);
+    else if (strcasecmp("StoreRates", child->key) == 0)
+      status = cf_util_get_boolean(child, &conf_store_rates);
+    else if (strcasecmp("BlockSize", child->key) == 0)
+      status = config_get_size(child, &conf_block_size);
+    else if (strcasecmp("BlockDuration", child->key) == 0)
+      status = cf_util_get_cdtime(child, &conf_block_duration);
+    else if (strcasecmp("SegmentSize", child->key) == 0)
+      status = config_get_size(child, &conf_segment_size);
+    else if (strcasecmp("WriteBufferSize", child->key) == 0)
+      status = config_get_size(child, &conf_write_buffer_size);
+    else if (strcasecmp("Retention", child->key) == 0)
+      status = cf_util_get_cdtime(child, &conf_retention);
+    else if (strcasecmp("CompactInterval", child->key) == 0)
+      status = cf_util_get_cdtime(child, &conf_compact_interval);
+    else {
+      ERROR("gorilla plugin: Unknown config option \"%s\".", child->key);
+      status = -1;
+    }
+
+    if (status != 0)
+      return -1;
+  }
+
+  return 0;
+} /* }}} int gorilla_config */
+
+static int gorilla_init(void) /* {{{ */
+{
+  char path[PATH_MAX];
+  uint32_t *seqs = NULL;
+  size_t seqs_num = 0;
+
+  if (series_tree != NULL)
+    return 0;
+
+  if (conf_datadir == NULL)
+    conf_datadir = strdup(PKGLOCALSTATEDIR "/gorilla");
+  if (conf_datadir == NULL)
+    return -1;
+
+  snprintf(path, sizeof(path), "%s/%s", conf_datadir, GORILLA_INDEX_FILE);
+  if (check_create_dir(path) != 0)
+    return -1;
+
+  int status = gorilla_index_open(&series_index, path, /* writable = */ 1);
+  if (status != 0) {
+    ERROR("gorilla plugin: Opening the index \"%s\" failed: %s", path,
+          STRERROR(status));
+    return -1;
+  }
+
+  series_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (series_tree == NULL) {
+    gorilla_index_close(&series_index);
+    return -1;
+  }
+
+  /* Later records of the same name supersede earlier ones. */
+  for (uint32_t i = 0; i < series_index.header->records_num; i++) {
+    gorilla_index_record_t const *r = series_index.records + i;
+    gorilla_series_t *s = NULL;
+
+    if (c_avl_get(series_tree, r->name, (void *)&s) == 0) {
+      gorilla_encoder_destroy(&s->enc);
+      s->id = i;
+      if (gorilla_encoder_init(&s->enc, r->values_num, r->ds_types) != 0)
+        return -1;
+      continue;
+    }
+
+    s = series_create(i, r->values_num, r->ds_types);
+    char *key = strdup(r->name);
+    if ((s == NULL) || (key == NULL) ||
+        (c_avl_insert(series_tree, key, s) != 0)) {
+      series_destroy(s);
+      sfree(key);
+      return -1;
+    }
+  }
+
+  /* Existing segments may end in a partially written block, so a new segment
+   * is started. */
+  status = gorilla_segment_list(conf_datadir, &seqs, &seqs_num);
+  if (status != 0) {
+    ERROR("gorilla plugin: Listing segments in \"%s\" failed: %s",
+          conf_datadir, STRERROR(status));
+    return -1;
+  }
+  if (seqs_num > 0)
+    segment_seq = seqs[seqs_num - 1];
+  sfree(seqs);
+
+  INFO("gorilla plugin: Loaded %" PRIu32 " series, last segment is %" PRIu32
+       ".",
+       series_index.header->records_num, segment_seq);
+
+  status = plugin_thread_create(&writer_thread, /* attr = */ NULL,
+                                gorilla_writer, /* arg = */ NULL,
+                                "gorilla writer");
+  if (status != 0) {
+    ERROR("gorilla plugin: Creating the writer thread failed: %s",
+          STRERROR(status));
+    return -1;
+  }
+  writer_running = 1;
+
+  return 0;
+} /* }}} int gorilla_init */
+
+static int gorilla_shutdown(void) /* {{{ */
+{
+  gorilla_series_t *s;
+  char *name;
+
+  if (series_tree == NULL)
+    return 0;
+
+  pthread_mutex_lock(&series_lock);
+  while (c_avl_pick(series_tree, (void *)&name, (void *)&s) == 0) {
+    series_seal(s);
+    series_destroy(s);
+    sfree(name);
+  }
+  c_avl_destroy(series_tree);
+  series_tree = NULL;
+  gorilla_index_close(&series_index);
+  pthread_mutex_unlock(&series_lock);
+
+  pthread_mutex_lock(&pending_lock);
+  pending_shutdown = 1;
+  pthread_cond_signal(&pending_cond);
+  pthread_mutex_unlock(&pending_lock);
+
+  if (writer_running) {
+    pthread_join(writer_thread, NULL);
+    writer_running = 0;
+  }
+
+  sfree(pending.data);
+  pending.size = pending.alloc = 0;
+  sfree(conf_datadir);
+  return 0;
+} /* }}} int gorilla_shutdown */
+
+void module_register(void) {
+  plugin_register_complex_config("gorilla", gorilla_config);
+  plugin_register_init("gorilla", gorilla_init);
+  plugin_register_write("gorilla", gorilla_write, /* user_data = */ NULL);
+  plugin_register_flush("gorilla", gorilla_flush, /* user_data = */ NULL);
+  plugin_register_shutdown("gorilla", gorilla_shutdown);
+} /* void module_register */
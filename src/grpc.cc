@@ -29,9 +29,16 @@
 #include <google/protobuf/util/time_util.h>
 #include <grpc++/grpc++.h>
 
+#include <grpc++/alarm.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <fstream>
 #include <iostream>
-#include <queue>
+#include <mutex>
+#include <set>
+#include <thread>
 #include <vector>
 
 #include "collectd.grpc.pb.h"
@@ -49,10 +56,14 @@ extern "C" {
 
 using collectd::Collectd;
 
+using collectd::QueryHistoryRequest;
+using collectd::QueryHistoryResponse;
 using collectd::PutValuesRequest;
 using collectd::PutValuesResponse;
 using collectd::QueryValuesRequest;
 using collectd::QueryValuesResponse;
+using collectd::WatchRequest;
+using collectd::WatchResponse;
 
 using google::protobuf::util::TimeUtil;
 
@@ -71,6 +82,7 @@ struct Listener {
 };
 static std::vector<Listener> listeners;
 static grpc::string default_addr("0.0.0.0:50051");
+static size_t worker_threads = 2;
 
 /*
  * helper functions
@@ -396,75 +408,169 @@ static grpc::Status unmarshal_value_list(const collectd::types::ValueList &msg,
 /*
  * Collectd service
  */
-class CollectdImpl : public collectd::Collectd::Service {
+
+// QueryValues reads at most QUERY_BATCH_SIZE matching value lists, or looks at
+// QUERY_SCAN_SIZE cache entries, while holding the cache lock. The lock is
+// released while the batch is sent to the client.
+#define QUERY_BATCH_SIZE 128
+#define QUERY_SCAN_SIZE 4096
+
+// Maximum number of value lists queued for a Watch client. If the client does
+// not keep up, the oldest value lists are dropped.
+#define WATCH_QUEUE_SIZE 1024
+
+static bool is_pattern(const char *s) {
+  return strpbrk(s, "*?[\\") != nullptr;
+} /* is_pattern */
+
+// ident_prefix returns the longest prefix shared by all cache entry names
+// (see FORMAT_VL) matching the identifier, so that only those entries have to
+// be looked at.
+static grpc::string ident_prefix(const value_list_t *match) {
+  grpc::string prefix;
+
+  if (is_pattern(match->host))
+    return prefix;
+  prefix += match->host;
+  prefix += "/";
+
+  if (is_pattern(match->plugin))
+    return prefix;
+  prefix += match->plugin;
+  if (is_pattern(match->plugin_instance))
+    return prefix;
+  if (match->plugin_instance[0] != '\0') {
+    prefix += "-";
+    prefix += match->plugin_instance;
+  }
+  prefix += "/";
+
+  if (is_pattern(match->type))
+    return prefix;
+  prefix += match->type;
+  if (is_pattern(match->type_instance))
+    return prefix;
+  if (match->type_instance[0] != '\0') {
+    prefix += "-";
+    prefix += match->type_instance;
+  }
+
+  return prefix;
+} /* ident_prefix */
+
+// Call is the state of a single RPC on the asynchronous server. Its address is
+// used as the tag of all operations started on behalf of the RPC.
+class Call {
 public:
-  grpc::Status
-  QueryValues(grpc::ServerContext *ctx, QueryValuesRequest const *req,
-              grpc::ServerWriter<QueryValuesResponse> *writer) override {
-    value_list_t match;
-    auto status = unmarshal_ident(req->identifier(), &match, false);
-    if (!status.ok()) {
-      return status;
-    }
+  virtual ~Call() {}
 
-    std::queue<value_list_t> value_lists;
-    status = this->queryValuesRead(&match, &value_lists);
-    if (status.ok()) {
-      status = this->queryValuesWrite(ctx, writer, &value_lists);
-    }
+  // Proceed is called when the operation last started by this call has
+  // completed. "ok" is false if the operation failed, e.g. because the client
+  // went away or the server is shutting down.
+  virtual void Proceed(bool ok) = 0;
+};
 
-    while (!value_lists.empty()) {
-      auto vl = value_lists.front();
-      value_lists.pop();
+class QueryValuesCall final : public Call {
+public:
+  QueryValuesCall(collectd::Collectd::AsyncService *service,
+                  grpc::ServerCompletionQueue *cq)
+      : service_(service), cq_(cq), writer_(&ctx_) {
+    service_->RequestQueryValues(&ctx_, &req_, &writer_, cq_, cq_, this);
+  }
+
+  ~QueryValuesCall() {
+    while (!batch_.empty()) {
+      auto vl = batch_.front();
+      batch_.pop_front();
       sfree(vl.values);
       meta_data_destroy(vl.meta);
     }
-
-    return status;
   }
 
-  grpc::Status PutValues(grpc::ServerContext *ctx,
-                         grpc::ServerReader<PutValuesRequest> *reader,
-                         PutValuesResponse *res) override {
-    PutValuesRequest req;
+  void Proceed(bool ok) override {
+    if (!ok || (state_ == FINISH)) {
+      delete this;
+      return;
+    }
 
-    while (reader->Read(&req)) {
-      value_list_t vl = {0};
-      auto status = unmarshal_value_list(req.value_list(), &vl);
-      if (!status.ok())
-        return status;
+    grpc::Status status;
+    if (state_ == REQUEST) {
+      // Accept the next call while this one is being handled.
+      new QueryValuesCall(service_, cq_);
 
-      if (plugin_dispatch_values(&vl))
-        return grpc::Status(
-            grpc::StatusCode::INTERNAL,
-            grpc::string("failed to enqueue values for writing"));
+      status = unmarshal_ident(req_.identifier(), &match_, false);
+      if (!status.ok()) {
+        state_ = FINISH;
+        writer_.Finish(status, this);
+        return;
+      }
+
+      prefix_ = ident_prefix(&match_);
+      state_ = WRITE;
     }
 
-    res->Clear();
-    return grpc::Status::OK;
+    if (WriteNext(&status))
+      return;
+
+    state_ = FINISH;
+    writer_.Finish(status, this);
   }
 
 private:
-  grpc::Status queryValuesRead(value_list_t const *match,
-                               std::queue<value_list_t> *value_lists) {
-    uc_iter_t *iter;
-    if ((iter = uc_get_iterator()) == NULL) {
+  // WriteNext starts writing the next matching value list, reading the next
+  // batch from the cache if necessary. It returns false if there is nothing
+  // left to write or on error.
+  bool WriteNext(grpc::Status *status) {
+    while (batch_.empty() && !done_) {
+      *status = ReadBatch();
+      if (!status->ok())
+        return false;
+    }
+    if (batch_.empty())
+      return false;
+
+    auto vl = batch_.front();
+    batch_.pop_front();
+
+    res_.Clear();
+    *status = marshal_value_list(&vl, res_.mutable_value_list());
+    sfree(vl.values);
+    meta_data_destroy(vl.meta);
+    if (!status->ok())
+      return false;
+
+    writer_.Write(res_, this);
+    return true;
+  }
+
+  grpc::Status ReadBatch() {
+    uc_iter_t *iter = uc_get_iterator_prefix(
+        prefix_.c_str(), last_.empty() ? nullptr : last_.c_str());
+    if (iter == nullptr) {
       return grpc::Status(
           grpc::StatusCode::INTERNAL,
           grpc::string("failed to query values: cannot create iterator"));
     }
 
     grpc::Status status = grpc::Status::OK;
-    char *name = NULL;
-    while (uc_iterator_next(iter, &name) == 0) {
-      value_list_t vl;
+    size_t scanned = 0;
+    char *name = nullptr;
+
+    done_ = true;
+    while ((batch_.size() < QUERY_BATCH_SIZE) && (scanned < QUERY_SCAN_SIZE)) {
+      if (uc_iterator_next(iter, &name) != 0)
+        break;
+      scanned++;
+      last_ = name;
+
+      value_list_t vl = {0};
       if (parse_identifier_vl(name, &vl) != 0) {
         status = grpc::Status(grpc::StatusCode::INTERNAL,
                               grpc::string("failed to parse identifier"));
         break;
       }
 
-      if (!ident_matches(&vl, match))
+      if (!ident_matches(&vl, &match_))
         continue;
       if (uc_iterator_get_time(iter, &vl.time) < 0) {
         status =
@@ -484,49 +590,363 @@ private:
         break;
       }
       if (uc_iterator_get_meta(iter, &vl.meta) < 0) {
+        sfree(vl.values);
         status =
             grpc::Status(grpc::StatusCode::INTERNAL,
                          grpc::string("failed to retrieve value metadata"));
+        break;
       }
 
-      value_lists->push(vl);
-    } // while (uc_iterator_next(iter, &name) == 0)
+      batch_.push_back(vl);
+    }
+
+    // The batch is full: there may be more matching entries.
+    if (status.ok() &&
+        ((batch_.size() >= QUERY_BATCH_SIZE) || (scanned >= QUERY_SCAN_SIZE)))
+      done_ = false;
 
     uc_iterator_destroy(iter);
     return status;
   }
 
-  grpc::Status queryValuesWrite(grpc::ServerContext *ctx,
-                                grpc::ServerWriter<QueryValuesResponse> *writer,
-                                std::queue<value_list_t> *value_lists) {
-    while (!value_lists->empty()) {
-      auto vl = value_lists->front();
-      QueryValuesResponse res;
-      res.Clear();
+  enum { REQUEST, WRITE, FINISH } state_ = REQUEST;
+
+  collectd::Collectd::AsyncService *service_;
+  grpc::ServerCompletionQueue *cq_;
+  grpc::ServerContext ctx_;
 
-      auto status = marshal_value_list(&vl, res.mutable_value_list());
+  QueryValuesRequest req_;
+  QueryValuesResponse res_;
+  grpc::ServerAsyncWriter<QueryValuesResponse> writer_;
+
+  value_list_t match_ = {0};
+  grpc::string prefix_;
+  // The name of the last cache entry looked at, to resume from.
+  grpc::string last_;
+  bool done_ = false;
+  std::deque<value_list_t> batch_;
+}; /* class QueryValuesCall */
+
+class QueryHistoryCall final : public Call {
+public:
+  QueryHistoryCall(collectd::Collectd::AsyncService *service,
+                   grpc::ServerCompletionQueue *cq)
+      : service_(service), cq_(cq), responder_(&ctx_) {
+    service_->RequestQueryHistory(&ctx_, &req_, &responder_, cq_, cq_, this);
+  }
+
+  void Proceed(bool ok) override {
+    if (!ok || finished_) {
+      delete this;
+      return;
+    }
+
+    new QueryHistoryCall(service_, cq_);
+    finished_ = true;
+
+    auto status = Query();
+    if (status.ok())
+      responder_.Finish(res_, grpc::Status::OK, this);
+    else
+      responder_.FinishWithError(status, this);
+  }
+
+private:
+  grpc::Status Query() {
+    value_list_t vl = {0};
+    auto status = unmarshal_ident(req_.identifier(), &vl, true);
+    if (!status.ok())
+      return status;
+
+    const data_set_t *ds = plugin_get_ds(vl.type);
+    if (ds == nullptr)
+      return grpc::Status(grpc::StatusCode::NOT_FOUND,
+                          grpc::string("unknown type"));
+
+    char name[6 * DATA_MAX_NAME_LEN];
+    if (FORMAT_VL(name, sizeof(name), &vl) != 0)
+      return grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("failed to format identifier"));
+
+    cdtime_t begin =
+        NS_TO_CDTIME_T(TimeUtil::TimestampToNanoseconds(req_.begin()));
+    cdtime_t end =
+        req_.has_end()
+            ? NS_TO_CDTIME_T(TimeUtil::TimestampToNanoseconds(req_.end()))
+            : cdtime();
+    if (begin > end)
+      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                          grpc::string("begin is after end"));
+
+    history_result_t hist;
+    int err = uc_get_history_range(name, begin, end, &hist);
+    if (err == ENOTSUP)
+      return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION,
+                          grpc::string("the history is disabled"));
+    else if (err == ENOENT)
+      return grpc::Status(grpc::StatusCode::NOT_FOUND,
+                          grpc::string("no such value"));
+    else if (err != 0)
+      return grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("failed to read history"));
+
+    if (hist.values_num != ds->ds_num) {
+      history_result_free(&hist);
+      return grpc::Status(grpc::StatusCode::INTERNAL,
+                          grpc::string("history does not match the type"));
+    }
+
+    res_.set_raw(hist.raw);
+    *res_.mutable_resolution() =
+        TimeUtil::NanosecondsToDuration(CDTIME_T_TO_NS(hist.resolution));
+    for (size_t i = 0; i < ds->ds_num; i++)
+      res_.add_ds_names(ds->ds[i].name);
+
+    for (size_t i = 0; i < hist.points_num; i++) {
+      auto point = res_.add_points();
+
+      *point->mutable_time() =
+          TimeUtil::NanosecondsToTimestamp(CDTIME_T_TO_NS(hist.time[i]));
+      for (size_t j = 0; j < hist.values_num; j++) {
+        size_t idx = i * hist.values_num + j;
+        point->add_min(hist.min[idx]);
+        point->add_avg(hist.avg[idx]);
+        point->add_max(hist.max[idx]);
+      }
+    }
+
+    history_result_free(&hist);
+    return grpc::Status::OK;
+  }
+
+  bool finished_ = false;
+
+  collectd::Collectd::AsyncService *service_;
+  grpc::ServerCompletionQueue *cq_;
+  grpc::ServerContext ctx_;
+
+  QueryHistoryRequest req_;
+  QueryHistoryResponse res_;
+  grpc::ServerAsyncResponseWriter<QueryHistoryResponse> responder_;
+}; /* class QueryHistoryCall */
+
+class PutValuesCall final : public Call {
+public:
+  PutValuesCall(collectd::Collectd::AsyncService *service,
+                grpc::ServerCompletionQueue *cq)
+      : service_(service), cq_(cq), reader_(&ctx_) {
+    service_->RequestPutValues(&ctx_, &reader_, cq_, cq_, this);
+  }
+
+  void Proceed(bool ok) override {
+    switch (state_) {
+    case REQUEST:
+      if (!ok) {
+        delete this;
+        return;
+      }
+      new PutValuesCall(service_, cq_);
+      state_ = READ;
+      reader_.Read(&req_, this);
+      return;
+
+    case READ: {
+      if (!ok) {
+        // The client is done writing.
+        state_ = FINISH;
+        res_.Clear();
+        reader_.Finish(res_, grpc::Status::OK, this);
+        return;
+      }
+
+      value_list_t vl = {0};
+      auto status = unmarshal_value_list(req_.value_list(), &vl);
+      if (status.ok()) {
+        if (plugin_dispatch_values(&vl))
+          status = grpc::Status(
+              grpc::StatusCode::INTERNAL,
+              grpc::string("failed to enqueue values for writing"));
+        sfree(vl.values);
+        meta_data_destroy(vl.meta);
+      }
       if (!status.ok()) {
-        return status;
+        state_ = FINISH;
+        reader_.FinishWithError(status, this);
+        return;
+      }
+
+      reader_.Read(&req_, this);
+      return;
+    }
+
+    case FINISH:
+      delete this;
+      return;
+    }
+  }
+
+private:
+  enum { REQUEST, READ, FINISH } state_ = REQUEST;
+
+  collectd::Collectd::AsyncService *service_;
+  grpc::ServerCompletionQueue *cq_;
+  grpc::ServerContext ctx_;
+
+  PutValuesRequest req_;
+  PutValuesResponse res_;
+  grpc::ServerAsyncReader<PutValuesResponse, PutValuesRequest> reader_;
+}; /* class PutValuesCall */
+
+class WatchCall;
+
+// Active Watch calls. The write callback hands matching value lists to them.
+static std::mutex watch_lock;
+static std::set<WatchCall *> watchers;
+static std::atomic<size_t> watchers_num(0);
+
+class WatchCall final : public Call {
+public:
+  WatchCall(collectd::Collectd::AsyncService *service,
+            grpc::ServerCompletionQueue *cq)
+      : service_(service), cq_(cq), writer_(&ctx_), done_tag_(this) {
+    ctx_.AsyncNotifyWhenDone(&done_tag_);
+    service_->RequestWatch(&ctx_, &req_, &writer_, cq_, cq_, this);
+  }
+
+  void Proceed(bool ok) override {
+    if (state_ == REQUEST) {
+      // The done tag is not delivered for calls that never started.
+      if (!ok) {
+        delete this;
+        return;
       }
+      new WatchCall(service_, cq_);
+
+      auto status = unmarshal_ident(req_.identifier(), &match_, false);
 
-      if (!writer->Write(res)) {
-        return grpc::Status::CANCELLED;
+      std::lock_guard<std::mutex> watch(watch_lock);
+      std::unique_lock<std::mutex> lock(lock_);
+      if (done_) {
+        // Cancelled already; Done() left deleting the call to us.
+        lock.unlock();
+        delete this;
+        return;
       }
 
-      value_lists->pop();
-      sfree(vl.values);
+      if (!status.ok()) {
+        state_ = FINISH;
+        writer_.Finish(status, this);
+        return;
+      }
+
+      state_ = STREAM;
+      busy_ = false;
+      watchers.insert(this);
+      watchers_num = watchers.size();
+      return;
     }
 
-    return grpc::Status::OK;
+    std::unique_lock<std::mutex> lock(lock_);
+    busy_ = false;
+
+    // Either a write or the alarm set by Enqueue() completed.
+    if (ok && (state_ == STREAM) && !done_ && !queue_.empty()) {
+      res_ = std::move(queue_.front());
+      queue_.pop_front();
+      busy_ = true;
+      writer_.Write(res_, this);
+      return;
+    }
+
+    if (done_) {
+      lock.unlock();
+      delete this;
+    }
   }
-};
+
+  // Done is called when the call has finished or has been cancelled.
+  void Done() {
+    {
+      std::lock_guard<std::mutex> watch(watch_lock);
+      watchers.erase(this);
+      watchers_num = watchers.size();
+    }
+
+    std::unique_lock<std::mutex> lock(lock_);
+    done_ = true;
+    if (dropped_ > 0)
+      NOTICE("grpc: Dropped %" PRIu64 " value lists for a slow Watch client.",
+             dropped_);
+
+    // The pending operation fails now and deletes the call.
+    if (busy_)
+      return;
+
+    lock.unlock();
+    delete this;
+  }
+
+  // Enqueue queues a value list for sending to the client. The caller holds
+  // watch_lock.
+  void Enqueue(const WatchResponse &res) {
+    std::lock_guard<std::mutex> lock(lock_);
+    if (done_)
+      return;
+
+    if (queue_.size() >= WATCH_QUEUE_SIZE) {
+      queue_.pop_front();
+      dropped_++;
+    }
+    queue_.push_back(res);
+
+    // Wake up the completion queue to start writing.
+    if (!busy_) {
+      busy_ = true;
+      alarm_.Set(cq_, gpr_now(GPR_CLOCK_MONOTONIC), this);
+    }
+  }
+
+  const value_list_t *Match() const { return &match_; }
+
+private:
+  class DoneTag final : public Call {
+  public:
+    DoneTag(WatchCall *call) : call_(call) {}
+    void Proceed(bool ok) override { call_->Done(); }
+
+  private:
+    WatchCall *call_;
+  };
+
+  enum { REQUEST, STREAM, FINISH } state_ = REQUEST;
+
+  collectd::Collectd::AsyncService *service_;
+  grpc::ServerCompletionQueue *cq_;
+  grpc::ServerContext ctx_;
+
+  WatchRequest req_;
+  WatchResponse res_;
+  grpc::ServerAsyncWriter<WatchResponse> writer_;
+  grpc::Alarm alarm_;
+  DoneTag done_tag_;
+
+  value_list_t match_ = {0};
+
+  // lock_ protects the members below.
+  std::mutex lock_;
+  std::deque<WatchResponse> queue_;
+  uint64_t dropped_ = 0;
+  // busy_ is true while the request, a write, or the alarm is pending.
+  bool busy_ = true;
+  bool done_ = false;
+}; /* class WatchCall */
 
 /*
  * gRPC server implementation
  */
 class CollectdServer final {
 public:
-  void Start() {
+  int Start() {
     auto auth = grpc::InsecureServerCredentials();
 
     grpc::ServerBuilder builder;
@@ -551,16 +971,50 @@ public:
     }
 
     builder.RegisterService(&collectd_service_);
+    cq_ = builder.AddCompletionQueue();
 
     server_ = builder.BuildAndStart();
+    if (!server_) {
+      ERROR("grpc: Failed to start server");
+      return -1;
+    }
+
+    new QueryValuesCall(&collectd_service_, cq_.get());
+    new QueryHistoryCall(&collectd_service_, cq_.get());
+    new PutValuesCall(&collectd_service_, cq_.get());
+    new WatchCall(&collectd_service_, cq_.get());
+
+    for (size_t i = 0; i < worker_threads; i++)
+      workers_.push_back(std::thread(&CollectdServer::HandleRpcs, this));
+
+    return 0;
   } /* Start() */
 
-  void Shutdown() { server_->Shutdown(); } /* Shutdown() */
+  void Shutdown() {
+    // Cancel all calls in progress, notably Watch calls, which do not end on
+    // their own.
+    server_->Shutdown(std::chrono::system_clock::now());
+    cq_->Shutdown();
+
+    for (auto &w : workers_)
+      w.join();
+    workers_.clear();
+  } /* Shutdown() */
 
 private:
-  CollectdImpl collectd_service_;
+  void HandleRpcs() {
+    void *tag = nullptr;
+    bool ok = false;
+
+    while (cq_->Next(&tag, &ok))
+      static_cast<Call *>(tag)->Proceed(ok);
+  } /* HandleRpcs() */
 
+  collectd::Collectd::AsyncService collectd_service_;
+
+  std::unique_ptr<grpc::ServerCompletionQueue> cq_;
   std::unique_ptr<grpc::Server> server_;
+  std::vector<std::thread> workers_;
 }; /* class CollectdServer */
 
 class CollectdClient final {
@@ -766,6 +1220,15 @@ static int c_grpc_config(oconfig_item_t *ci) {
     } else if (!strcasecmp("Server", child->key)) {
       if (c_grpc_config_server(child))
         return -1;
+    } else if (!strcasecmp("WorkerThreads", child->key)) {
+      int tmp = 0;
+      if (cf_util_get_int(child, &tmp))
+        return -1;
+      if (tmp < 1) {
+        ERROR("grpc: `%s` must be at least 1.", child->key);
+        return -1;
+      }
+      worker_threads = (size_t)tmp;
     }
 
     else {
@@ -776,6 +1239,34 @@ static int c_grpc_config(oconfig_item_t *ci) {
   return 0;
 } /* c_grpc_config() */
 
+static int c_grpc_watch_write(__attribute__((unused)) data_set_t const *ds,
+                              value_list_t const *vl,
+                              __attribute__((unused)) user_data_t *ud) {
+  if (watchers_num == 0)
+    return 0;
+
+  std::lock_guard<std::mutex> lock(watch_lock);
+
+  // Marshal the value list once and only if a client is interested.
+  WatchResponse res;
+  bool marshalled = false;
+  for (auto w : watchers) {
+    if (!ident_matches(vl, w->Match()))
+      continue;
+
+    if (!marshalled) {
+      auto status = marshal_value_list(vl, res.mutable_value_list());
+      if (!status.ok())
+        return -1;
+      marshalled = true;
+    }
+
+    w->Enqueue(res);
+  }
+
+  return 0;
+} /* c_grpc_watch_write() */
+
 static int c_grpc_init(void) {
   server = new CollectdServer();
   if (!server) {
@@ -783,7 +1274,13 @@ static int c_grpc_init(void) {
     return -1;
   }
 
-  server->Start();
+  if (server->Start() != 0) {
+    delete server;
+    server = nullptr;
+    return -1;
+  }
+
+  plugin_register_write("grpc/watch", c_grpc_watch_write, /* user_data = */ NULL);
   return 0;
 } /* c_grpc_init() */
 
@@ -26,6 +26,7 @@
 #include "common.h"
 #include "filter_chain.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 
 #include <jni.h>
 
@@ -63,6 +64,7 @@ typedef struct java_plugin_class_s java_plugin_class_t;
 #define CB_TYPE_NOTIFICATION 8
 #define CB_TYPE_MATCH 9
 #define CB_TYPE_TARGET 10
+#define CB_TYPE_WRITE_BATCH 11
 struct cjni_callback_info_s /* {{{ */
 {
   char *name;
@@ -74,6 +76,83 @@ struct cjni_callback_info_s /* {{{ */
 typedef struct cjni_callback_info_s cjni_callback_info_t;
 /* }}} */
 
+/* Classes and methods used when converting value lists. They are looked up
+ * once after the JVM has been created instead of for every value. */
+struct cjni_class_cache_s /* {{{ */
+{
+  jclass c_long;
+  jmethodID m_long_valueof;
+  jclass c_double;
+  jmethodID m_double_valueof;
+
+  jclass c_datasource;
+  jmethodID m_datasource_constructor;
+
+  jclass c_dataset;
+  jmethodID m_dataset_constructor;
+  jmethodID m_dataset_copy_constructor;
+  jmethodID m_dataset_add;
+
+  jclass c_valuelist;
+  jmethodID m_valuelist_constructor;
+  jmethodID m_valuelist_setdataset;
+  jmethodID m_valuelist_addvalue;
+  jmethodID m_valuelist_sethost;
+  jmethodID m_valuelist_setplugin;
+  jmethodID m_valuelist_setplugininstance;
+  jmethodID m_valuelist_settype;
+  jmethodID m_valuelist_settypeinstance;
+  jmethodID m_valuelist_settime;
+  jmethodID m_valuelist_setinterval;
+
+  jclass c_batch;
+  jmethodID m_batch_constructor;
+  jmethodID m_batch_reset;
+};
+typedef struct cjni_class_cache_s cjni_class_cache_t;
+/* }}} */
+
+/* DataSet objects are built once per type. They are never handed to Java code
+ * themselves, only copies are, so that they can't be modified. */
+struct cjni_data_set_cache_entry_s /* {{{ */
+{
+  const data_set_t *ds;
+  jobject o_dataset;
+};
+typedef struct cjni_data_set_cache_entry_s cjni_data_set_cache_entry_t;
+/* }}} */
+
+/* One of the two buffers of a batch write callback. The Java side sees the
+ * memory through a direct ByteBuffer wrapped in a ValueListBatch object,
+ * both of which are created once and reused for every batch. */
+struct cjni_batch_buffer_s /* {{{ */
+{
+  char *data;
+  size_t fill;
+  jint count;
+  cdtime_t first_time;
+  jobject o_batch;
+};
+typedef struct cjni_batch_buffer_s cjni_batch_buffer_t;
+/* }}} */
+
+struct cjni_write_batch_s /* {{{ */
+{
+  cjni_callback_info_t *cbi;
+
+  /* Value lists are appended to `buffers[active]' while holding `lock'. A
+   * full buffer is passed to Java while holding `deliver_lock' so that
+   * appending to the other buffer can continue in the meantime. */
+  pthread_mutex_t lock;
+  pthread_mutex_t deliver_lock;
+  cjni_batch_buffer_t buffers[2];
+  int active;
+
+  struct cjni_write_batch_s *next;
+};
+typedef struct cjni_write_batch_s cjni_write_batch_t;
+/* }}} */
+
 /*
  * Global variables
  */
@@ -95,6 +174,18 @@ static pthread_mutex_t java_callbacks_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static oconfig_item_t *config_block = NULL;
 
+static cjni_class_cache_t class_cache;
+
+static c_avl_tree_t *data_set_cache = NULL;
+static pthread_mutex_t data_set_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Size of each of the two buffers of a batch write callback. */
+static size_t batch_buffer_size = 65536;
+
+/* List of batch write callbacks, used to deliver pending values on shutdown. */
+static cjni_write_batch_t *write_batches = NULL;
+static pthread_mutex_t write_batches_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /*
  * Prototypes
  *
@@ -111,6 +202,11 @@ static int cjni_callback_register(JNIEnv *jvm_env, jobject o_name,
 static int cjni_read(user_data_t *user_data);
 static int cjni_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *ud);
+static int cjni_write_batch(const data_set_t *ds, const value_list_t *vl,
+                            user_data_t *ud);
+static void cjni_write_batch_destroy(void *arg);
+static int cjni_write_batch_flush(cdtime_t timeout, const char *identifier,
+                                  user_data_t *ud);
 static int cjni_flush(cdtime_t timeout, const char *identifier,
                       user_data_t *ud);
 static void cjni_log(int severity, const char *message, user_data_t *ud);
@@ -230,51 +326,15 @@ static int ctoj_double(JNIEnv *jvm_env, /* {{{ */
 /* Convert a jlong to a java.lang.Number */
 static jobject ctoj_jlong_to_number(JNIEnv *jvm_env, jlong value) /* {{{ */
 {
-  jclass c_long;
-  jmethodID m_long_constructor;
-
-  /* Look up the java.lang.Long class */
-  c_long = (*jvm_env)->FindClass(jvm_env, "java/lang/Long");
-  if (c_long == NULL) {
-    ERROR("java plugin: ctoj_jlong_to_number: Looking up the "
-          "java.lang.Long class failed.");
-    return NULL;
-  }
-
-  m_long_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_long, "<init>", "(J)V");
-  if (m_long_constructor == NULL) {
-    ERROR("java plugin: ctoj_jlong_to_number: Looking up the "
-          "`Long (long)' constructor failed.");
-    return NULL;
-  }
-
-  return (*jvm_env)->NewObject(jvm_env, c_long, m_long_constructor, value);
+  return (*jvm_env)->CallStaticObjectMethod(jvm_env, class_cache.c_long,
+                                            class_cache.m_long_valueof, value);
 } /* }}} jobject ctoj_jlong_to_number */
 
 /* Convert a jdouble to a java.lang.Number */
 static jobject ctoj_jdouble_to_number(JNIEnv *jvm_env, jdouble value) /* {{{ */
 {
-  jclass c_double;
-  jmethodID m_double_constructor;
-
-  /* Look up the java.lang.Long class */
-  c_double = (*jvm_env)->FindClass(jvm_env, "java/lang/Double");
-  if (c_double == NULL) {
-    ERROR("java plugin: ctoj_jdouble_to_number: Looking up the "
-          "java.lang.Double class failed.");
-    return NULL;
-  }
-
-  m_double_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_double, "<init>", "(D)V");
-  if (m_double_constructor == NULL) {
-    ERROR("java plugin: ctoj_jdouble_to_number: Looking up the "
-          "`Double (double)' constructor failed.");
-    return NULL;
-  }
-
-  return (*jvm_env)->NewObject(jvm_env, c_double, m_double_constructor, value);
+  return (*jvm_env)->CallStaticObjectMethod(
+      jvm_env, class_cache.c_double, class_cache.m_double_valueof, value);
 } /* }}} jobject ctoj_jdouble_to_number */
 
 /* Convert a value_t to a java.lang.Number */
@@ -295,31 +355,13 @@ static jobject ctoj_value_to_number(JNIEnv *jvm_env, /* {{{ */
 /* Convert a data_source_t to a org/collectd/api/DataSource */
 static jobject ctoj_data_source(JNIEnv *jvm_env, /* {{{ */
                                 const data_source_t *dsrc) {
-  jclass c_datasource;
-  jmethodID m_datasource_constructor;
+  jclass c_datasource = class_cache.c_datasource;
   jobject o_datasource;
   int status;
 
-  /* Look up the DataSource class */
-  c_datasource = (*jvm_env)->FindClass(jvm_env, "org/collectd/api/DataSource");
-  if (c_datasource == NULL) {
-    ERROR("java plugin: ctoj_data_source: "
-          "FindClass (org/collectd/api/DataSource) failed.");
-    return NULL;
-  }
-
-  /* Lookup the `ValueList ()' constructor. */
-  m_datasource_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_datasource, "<init>", "()V");
-  if (m_datasource_constructor == NULL) {
-    ERROR("java plugin: ctoj_data_source: Cannot find the "
-          "`DataSource ()' constructor.");
-    return NULL;
-  }
-
   /* Create a new instance. */
-  o_datasource =
-      (*jvm_env)->NewObject(jvm_env, c_datasource, m_datasource_constructor);
+  o_datasource = (*jvm_env)->NewObject(jvm_env, c_datasource,
+                                       class_cache.m_datasource_constructor);
   if (o_datasource == NULL) {
     ERROR("java plugin: ctoj_data_source: "
           "Creating a new DataSource instance failed.");
@@ -558,45 +600,17 @@ static jobject ctoj_oconfig_item(JNIEnv *jvm_env, /* {{{ */
 /* Convert a data_set_t to a org/collectd/api/DataSet */
 static jobject ctoj_data_set(JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
 {
-  jclass c_dataset;
-  jmethodID m_constructor;
-  jmethodID m_add;
   jobject o_type;
   jobject o_dataset;
 
-  /* Look up the org/collectd/api/DataSet class */
-  c_dataset = (*jvm_env)->FindClass(jvm_env, "org/collectd/api/DataSet");
-  if (c_dataset == NULL) {
-    ERROR("java plugin: ctoj_data_set: Looking up the "
-          "org/collectd/api/DataSet class failed.");
-    return NULL;
-  }
-
-  /* Search for the `DataSet (String type)' constructor. */
-  m_constructor = (*jvm_env)->GetMethodID(jvm_env, c_dataset, "<init>",
-                                          "(Ljava/lang/String;)V");
-  if (m_constructor == NULL) {
-    ERROR("java plugin: ctoj_data_set: Looking up the "
-          "`DataSet (String)' constructor failed.");
-    return NULL;
-  }
-
-  /* Search for the `void addDataSource (DataSource)' method. */
-  m_add = (*jvm_env)->GetMethodID(jvm_env, c_dataset, "addDataSource",
-                                  "(Lorg/collectd/api/DataSource;)V");
-  if (m_add == NULL) {
-    ERROR("java plugin: ctoj_data_set: Looking up the "
-          "`addDataSource (DataSource)' method failed.");
-    return NULL;
-  }
-
   o_type = (*jvm_env)->NewStringUTF(jvm_env, ds->type);
   if (o_type == NULL) {
     ERROR("java plugin: ctoj_data_set: Creating a String object failed.");
     return NULL;
   }
 
-  o_dataset = (*jvm_env)->NewObject(jvm_env, c_dataset, m_constructor, o_type);
+  o_dataset = (*jvm_env)->NewObject(jvm_env, class_cache.c_dataset,
+                                    class_cache.m_dataset_constructor, o_type);
   if (o_dataset == NULL) {
     ERROR("java plugin: ctoj_data_set: Creating a DataSet object failed.");
     (*jvm_env)->DeleteLocalRef(jvm_env, o_type);
@@ -617,7 +631,8 @@ static jobject ctoj_data_set(JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
       return NULL;
     }
 
-    (*jvm_env)->CallVoidMethod(jvm_env, o_dataset, m_add, o_datasource);
+    (*jvm_env)->CallVoidMethod(jvm_env, o_dataset, class_cache.m_dataset_add,
+                               o_datasource);
 
     (*jvm_env)->DeleteLocalRef(jvm_env, o_datasource);
   } /* for (i = 0; i < ds->ds_num; i++) */
@@ -625,20 +640,104 @@ static jobject ctoj_data_set(JNIEnv *jvm_env, const data_set_t *ds) /* {{{ */
   return o_dataset;
 } /* }}} jobject ctoj_data_set */
 
+/* Return a local reference to the cached DataSet object of `ds', creating it
+ * on first use. The entry is rebuilt if the type has been re-registered. */
+static jobject ctoj_data_set_template(JNIEnv *jvm_env, /* {{{ */
+                                      const data_set_t *ds) {
+  cjni_data_set_cache_entry_t *entry = NULL;
+  jobject o_dataset;
+  jobject o_global;
+  char *key;
+
+  pthread_mutex_lock(&data_set_cache_lock);
+  if ((data_set_cache != NULL) &&
+      (c_avl_get(data_set_cache, ds->type, (void *)&entry) == 0) &&
+      (entry->ds == ds)) {
+    o_dataset = (*jvm_env)->NewLocalRef(jvm_env, entry->o_dataset);
+    pthread_mutex_unlock(&data_set_cache_lock);
+    return o_dataset;
+  }
+  pthread_mutex_unlock(&data_set_cache_lock);
+
+  o_dataset = ctoj_data_set(jvm_env, ds);
+  if (o_dataset == NULL)
+    return NULL;
+
+  o_global = (*jvm_env)->NewGlobalRef(jvm_env, o_dataset);
+  if (o_global == NULL) {
+    ERROR("java plugin: ctoj_data_set_template: NewGlobalRef failed.");
+    return o_dataset;
+  }
+
+  pthread_mutex_lock(&data_set_cache_lock);
+
+  if (data_set_cache == NULL) {
+    data_set_cache =
+        c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (data_set_cache == NULL) {
+      pthread_mutex_unlock(&data_set_cache_lock);
+      (*jvm_env)->DeleteGlobalRef(jvm_env, o_global);
+      return o_dataset;
+    }
+  }
+
+  if (c_avl_get(data_set_cache, ds->type, (void *)&entry) == 0) {
+    /* Either another thread was faster or the type has been re-registered. */
+    (*jvm_env)->DeleteGlobalRef(jvm_env, entry->o_dataset);
+    entry->ds = ds;
+    entry->o_dataset = o_global;
+  } else {
+    entry = calloc(1, sizeof(*entry));
+    key = strdup(ds->type);
+    if ((entry == NULL) || (key == NULL) ||
+        (c_avl_insert(data_set_cache, key, entry) != 0)) {
+      sfree(entry);
+      sfree(key);
+      pthread_mutex_unlock(&data_set_cache_lock);
+      (*jvm_env)->DeleteGlobalRef(jvm_env, o_global);
+      return o_dataset;
+    }
+    entry->ds = ds;
+    entry->o_dataset = o_global;
+  }
+
+  pthread_mutex_unlock(&data_set_cache_lock);
+  return o_dataset;
+} /* }}} jobject ctoj_data_set_template */
+
+/* Convert a data_set_t to a org/collectd/api/DataSet by copying the cached
+ * object, which is cheaper than building it from scratch. */
+static jobject ctoj_data_set_cached(JNIEnv *jvm_env, /* {{{ */
+                                    const data_set_t *ds) {
+  jobject o_template;
+  jobject o_dataset;
+
+  o_template = ctoj_data_set_template(jvm_env, ds);
+  if (o_template == NULL)
+    return NULL;
+
+  o_dataset =
+      (*jvm_env)->NewObject(jvm_env, class_cache.c_dataset,
+                            class_cache.m_dataset_copy_constructor, o_template);
+  (*jvm_env)->DeleteLocalRef(jvm_env, o_template);
+  if ((*jvm_env)->ExceptionCheck(jvm_env)) {
+    (*jvm_env)->ExceptionClear(jvm_env);
+    o_dataset = NULL;
+  }
+  if (o_dataset == NULL) {
+    ERROR("java plugin: ctoj_data_set_cached: Copying the DataSet object "
+          "failed.");
+    return NULL;
+  }
+
+  return o_dataset;
+} /* }}} jobject ctoj_data_set_cached */
+
 static int ctoj_value_list_add_value(JNIEnv *jvm_env, /* {{{ */
                                      value_t value, int ds_type,
-                                     jclass class_ptr, jobject object_ptr) {
-  jmethodID m_addvalue;
+                                     jobject object_ptr) {
   jobject o_number;
 
-  m_addvalue = (*jvm_env)->GetMethodID(jvm_env, class_ptr, "addValue",
-                                       "(Ljava/lang/Number;)V");
-  if (m_addvalue == NULL) {
-    ERROR("java plugin: ctoj_value_list_add_value: "
-          "Cannot find method `void addValue (Number)'.");
-    return -1;
-  }
-
   o_number = ctoj_value_to_number(jvm_env, value, ds_type);
   if (o_number == NULL) {
     ERROR("java plugin: ctoj_value_list_add_value: "
@@ -646,7 +745,8 @@ static int ctoj_value_list_add_value(JNIEnv *jvm_env, /* {{{ */
     return -1;
   }
 
-  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr, m_addvalue, o_number);
+  (*jvm_env)->CallVoidMethod(jvm_env, object_ptr,
+                             class_cache.m_valuelist_addvalue, o_number);
 
   (*jvm_env)->DeleteLocalRef(jvm_env, o_number);
 
@@ -654,33 +754,22 @@ static int ctoj_value_list_add_value(JNIEnv *jvm_env, /* {{{ */
 } /* }}} int ctoj_value_list_add_value */
 
 static int ctoj_value_list_add_data_set(JNIEnv *jvm_env, /* {{{ */
-                                        jclass c_valuelist, jobject o_valuelist,
+                                        jobject o_valuelist,
                                         const data_set_t *ds) {
-  jmethodID m_setdataset;
   jobject o_dataset;
 
-  /* Look for the `void setDataSource (List<DataSource> ds)' method. */
-  m_setdataset = (*jvm_env)->GetMethodID(jvm_env, c_valuelist, "setDataSet",
-                                         "(Lorg/collectd/api/DataSet;)V");
-  if (m_setdataset == NULL) {
-    ERROR("java plugin: ctoj_value_list_add_data_set: "
-          "Cannot find the `void setDataSet (DataSet)' method.");
-    return -1;
-  }
-
-  /* Create a DataSet object. */
-  o_dataset = ctoj_data_set(jvm_env, ds);
+  o_dataset = ctoj_data_set_cached(jvm_env, ds);
   if (o_dataset == NULL) {
     ERROR("java plugin: ctoj_value_list_add_data_set: "
-          "ctoj_data_set (%s) failed.",
+          "ctoj_data_set_cached (%s) failed.",
           ds->type);
     return -1;
   }
 
-  /* Actually call the method. */
-  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist, m_setdataset, o_dataset);
+  /* Actually call the `void setDataSet (DataSet)' method. */
+  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist,
+                             class_cache.m_valuelist_setdataset, o_dataset);
 
-  /* Decrease reference counter on the List<DataSource> object. */
   (*jvm_env)->DeleteLocalRef(jvm_env, o_dataset);
 
   return 0;
@@ -689,39 +778,19 @@ static int ctoj_value_list_add_data_set(JNIEnv *jvm_env, /* {{{ */
 /* Convert a value_list_t (and data_set_t) to a org/collectd/api/ValueList */
 static jobject ctoj_value_list(JNIEnv *jvm_env, /* {{{ */
                                const data_set_t *ds, const value_list_t *vl) {
-  jclass c_valuelist;
-  jmethodID m_valuelist_constructor;
   jobject o_valuelist;
   int status;
 
-  /* First, create a new ValueList instance..
-   * Look up the class.. */
-  c_valuelist = (*jvm_env)->FindClass(jvm_env, "org/collectd/api/ValueList");
-  if (c_valuelist == NULL) {
-    ERROR("java plugin: ctoj_value_list: "
-          "FindClass (org/collectd/api/ValueList) failed.");
-    return NULL;
-  }
-
-  /* Lookup the `ValueList ()' constructor. */
-  m_valuelist_constructor =
-      (*jvm_env)->GetMethodID(jvm_env, c_valuelist, "<init>", "()V");
-  if (m_valuelist_constructor == NULL) {
-    ERROR("java plugin: ctoj_value_list: Cannot find the "
-          "`ValueList ()' constructor.");
-    return NULL;
-  }
-
   /* Create a new instance. */
-  o_valuelist =
-      (*jvm_env)->NewObject(jvm_env, c_valuelist, m_valuelist_constructor);
+  o_valuelist = (*jvm_env)->NewObject(jvm_env, class_cache.c_valuelist,
+                                      class_cache.m_valuelist_constructor);
   if (o_valuelist == NULL) {
     ERROR("java plugin: ctoj_value_list: Creating a new ValueList instance "
           "failed.");
     return NULL;
   }
 
-  status = ctoj_value_list_add_data_set(jvm_env, c_valuelist, o_valuelist, ds);
+  status = ctoj_value_list_add_data_set(jvm_env, o_valuelist, ds);
   if (status != 0) {
     ERROR("java plugin: ctoj_value_list: "
           "ctoj_value_list_add_data_set failed.");
@@ -730,46 +799,48 @@ static jobject ctoj_value_list(JNIEnv *jvm_env, /* {{{ */
   }
 
 /* Set the strings.. */
-#define SET_STRING(str, method_name)                                           \
+#define SET_STRING(str, method)                                                \
   do {                                                                         \
-    status = ctoj_string(jvm_env, str, c_valuelist, o_valuelist, method_name); \
-    if (status != 0) {                                                         \
-      ERROR("java plugin: ctoj_value_list: ctoj_string (%s) failed.",          \
-            method_name);                                                      \
+    jstring o_string = (*jvm_env)->NewStringUTF(jvm_env, str);                 \
+    if (o_string == NULL) {                                                    \
+      ERROR("java plugin: ctoj_value_list: NewStringUTF failed.");             \
+      (*jvm_env)->ExceptionClear(jvm_env);                                     \
+      (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);                        \
+      return NULL;                                                             \
+    }                                                                          \
+    (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist, class_cache.method,       \
+                               o_string);                                      \
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_string);                             \
+    if ((*jvm_env)->ExceptionCheck(jvm_env)) {                                 \
+      ERROR("java plugin: ctoj_value_list: Setting a string member threw an "  \
+            "exception.");                                                     \
+      (*jvm_env)->ExceptionDescribe(jvm_env);                                  \
+      (*jvm_env)->ExceptionClear(jvm_env);                                     \
       (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);                        \
       return NULL;                                                             \
     }                                                                          \
   } while (0)
 
-  SET_STRING(vl->host, "setHost");
-  SET_STRING(vl->plugin, "setPlugin");
-  SET_STRING(vl->plugin_instance, "setPluginInstance");
-  SET_STRING(vl->type, "setType");
-  SET_STRING(vl->type_instance, "setTypeInstance");
+  SET_STRING(vl->host, m_valuelist_sethost);
+  SET_STRING(vl->plugin, m_valuelist_setplugin);
+  SET_STRING(vl->plugin_instance, m_valuelist_setplugininstance);
+  SET_STRING(vl->type, m_valuelist_settype);
+  SET_STRING(vl->type_instance, m_valuelist_settypeinstance);
 
 #undef SET_STRING
 
   /* Set the `time' member. Java stores time in milliseconds. */
-  status = ctoj_long(jvm_env, (jlong)CDTIME_T_TO_MS(vl->time), c_valuelist,
-                     o_valuelist, "setTime");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_value_list: ctoj_long (setTime) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
-    return NULL;
-  }
+  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist, class_cache.m_valuelist_settime,
+                             (jlong)CDTIME_T_TO_MS(vl->time));
 
   /* Set the `interval' member.. */
-  status = ctoj_long(jvm_env, (jlong)CDTIME_T_TO_MS(vl->interval), c_valuelist,
-                     o_valuelist, "setInterval");
-  if (status != 0) {
-    ERROR("java plugin: ctoj_value_list: ctoj_long (setInterval) failed.");
-    (*jvm_env)->DeleteLocalRef(jvm_env, o_valuelist);
-    return NULL;
-  }
+  (*jvm_env)->CallVoidMethod(jvm_env, o_valuelist,
+                             class_cache.m_valuelist_setinterval,
+                             (jlong)CDTIME_T_TO_MS(vl->interval));
 
   for (size_t i = 0; i < vl->values_len; i++) {
     status = ctoj_value_list_add_value(jvm_env, vl->values[i], ds->ds[i].type,
-                                       c_valuelist, o_valuelist);
+                                       o_valuelist);
     if (status != 0) {
       ERROR("java plugin: ctoj_value_list: "
             "ctoj_value_list_add_value failed.");
@@ -781,6 +852,82 @@ static jobject ctoj_value_list(JNIEnv *jvm_env, /* {{{ */
   return o_valuelist;
 } /* }}} jobject ctoj_value_list */
 
+/* Size of one value list in the batch buffer layout, see ctoj_batch_append. */
+static size_t ctoj_batch_entry_size(const value_list_t *vl) /* {{{ */
+{
+  return 2 * sizeof(int64_t) + 5 * sizeof(uint16_t) + strlen(vl->host) +
+         strlen(vl->plugin) + strlen(vl->plugin_instance) + strlen(vl->type) +
+         strlen(vl->type_instance) + sizeof(uint16_t) +
+         vl->values_len * (sizeof(uint8_t) + sizeof(int64_t));
+} /* }}} size_t ctoj_batch_entry_size */
+
+/* Append a value list to a batch buffer. The layout, in host byte order, is
+ * decoded by org.collectd.api.ValueListBatch:
+ *
+ *   int64   time (milliseconds)
+ *   int64   interval (milliseconds)
+ *   5 x     uint16 length, bytes: host, plugin, plugin instance, type,
+ *           type instance
+ *   uint16  number of values
+ *   n x     uint8 data source type, int64 or double value
+ *
+ * The caller has to make sure there is enough room, see
+ * ctoj_batch_entry_size. */
+static void ctoj_batch_append(cjni_batch_buffer_t *buf, /* {{{ */
+                              const data_set_t *ds, const value_list_t *vl) {
+  char *ptr = buf->data + buf->fill;
+  const char *strings[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                           vl->type_instance};
+  int64_t i64;
+  uint16_t u16;
+
+  i64 = (int64_t)CDTIME_T_TO_MS(vl->time);
+  memcpy(ptr, &i64, sizeof(i64));
+  ptr += sizeof(i64);
+
+  i64 = (int64_t)CDTIME_T_TO_MS(vl->interval);
+  memcpy(ptr, &i64, sizeof(i64));
+  ptr += sizeof(i64);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(strings); i++) {
+    size_t len = strlen(strings[i]);
+
+    u16 = (uint16_t)len;
+    memcpy(ptr, &u16, sizeof(u16));
+    ptr += sizeof(u16);
+
+    memcpy(ptr, strings[i], len);
+    ptr += len;
+  }
+
+  u16 = (uint16_t)vl->values_len;
+  memcpy(ptr, &u16, sizeof(u16));
+  ptr += sizeof(u16);
+
+  for (size_t i = 0; i < vl->values_len; i++) {
+    uint8_t type = (uint8_t)ds->ds[i].type;
+
+    *ptr = (char)type;
+    ptr++;
+
+    if (type == DS_TYPE_GAUGE)
+      memcpy(ptr, &vl->values[i].gauge, sizeof(vl->values[i].gauge));
+    else if (type == DS_TYPE_COUNTER)
+      i64 = (int64_t)vl->values[i].counter;
+    else if (type == DS_TYPE_DERIVE)
+      i64 = (int64_t)vl->values[i].derive;
+    else
+      i64 = (int64_t)vl->values[i].absolute;
+
+    if (type != DS_TYPE_GAUGE)
+      memcpy(ptr, &i64, sizeof(i64));
+    ptr += sizeof(i64);
+  }
+
+  buf->fill = (size_t)(ptr - buf->data);
+  buf->count++;
+} /* }}} void ctoj_batch_append */
+
 /* Convert a notification_t to a org/collectd/api/Notification */
 static jobject ctoj_notification(JNIEnv *jvm_env, /* {{{ */
                                  const notification_t *n) {
@@ -1276,7 +1423,7 @@ static jobject JNICALL cjni_api_get_ds(JNIEnv *jvm_env, /* {{{ */
   if (ds == NULL)
     return NULL;
 
-  o_dataset = ctoj_data_set(jvm_env, ds);
+  o_dataset = ctoj_data_set_cached(jvm_env, ds);
   return o_dataset;
 } /* }}} jint cjni_api_get_ds */
 
@@ -1337,6 +1484,101 @@ static jint JNICALL cjni_api_register_write(JNIEnv *jvm_env, /* {{{ */
   return 0;
 } /* }}} jint cjni_api_register_write */
 
+static cjni_write_batch_t *cjni_write_batch_create(JNIEnv *jvm_env, /* {{{ */
+                                                   cjni_callback_info_t *cbi) {
+  cjni_write_batch_t *b;
+
+  b = calloc(1, sizeof(*b));
+  if (b == NULL) {
+    ERROR("java plugin: cjni_write_batch_create: calloc failed.");
+    cjni_callback_info_destroy(cbi);
+    return NULL;
+  }
+  b->cbi = cbi;
+  pthread_mutex_init(&b->lock, /* attr = */ NULL);
+  pthread_mutex_init(&b->deliver_lock, /* attr = */ NULL);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(b->buffers); i++) {
+    cjni_batch_buffer_t *buf = b->buffers + i;
+    jobject o_buffer;
+    jobject o_batch;
+
+    buf->data = malloc(batch_buffer_size);
+    if (buf->data == NULL) {
+      ERROR("java plugin: cjni_write_batch_create: malloc failed.");
+      cjni_write_batch_destroy(b);
+      return NULL;
+    }
+
+    o_buffer = (*jvm_env)->NewDirectByteBuffer(jvm_env, buf->data,
+                                               (jlong)batch_buffer_size);
+    if (o_buffer == NULL) {
+      ERROR("java plugin: cjni_write_batch_create: "
+            "NewDirectByteBuffer failed.");
+      cjni_write_batch_destroy(b);
+      return NULL;
+    }
+
+    o_batch = (*jvm_env)->NewObject(jvm_env, class_cache.c_batch,
+                                    class_cache.m_batch_constructor, o_buffer);
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_buffer);
+    if (o_batch == NULL) {
+      ERROR("java plugin: cjni_write_batch_create: "
+            "Creating a ValueListBatch object failed.");
+      cjni_write_batch_destroy(b);
+      return NULL;
+    }
+
+    buf->o_batch = (*jvm_env)->NewGlobalRef(jvm_env, o_batch);
+    (*jvm_env)->DeleteLocalRef(jvm_env, o_batch);
+    if (buf->o_batch == NULL) {
+      ERROR("java plugin: cjni_write_batch_create: NewGlobalRef failed.");
+      cjni_write_batch_destroy(b);
+      return NULL;
+    }
+  }
+
+  pthread_mutex_lock(&write_batches_lock);
+  b->next = write_batches;
+  write_batches = b;
+  pthread_mutex_unlock(&write_batches_lock);
+
+  return b;
+} /* }}} cjni_write_batch_t *cjni_write_batch_create */
+
+static jint JNICALL cjni_api_register_write_batch(JNIEnv *jvm_env, /* {{{ */
+                                                  jobject this, jobject o_name,
+                                                  jobject o_write) {
+  cjni_callback_info_t *cbi;
+  cjni_write_batch_t *b;
+
+  cbi = cjni_callback_info_create(jvm_env, o_name, o_write,
+                                  CB_TYPE_WRITE_BATCH);
+  if (cbi == NULL)
+    return -1;
+
+  /* On failure, `cbi' has been freed along with the batch. */
+  b = cjni_write_batch_create(jvm_env, cbi);
+  if (b == NULL)
+    return -1;
+
+  DEBUG("java plugin: Registering new batch write callback: %s", cbi->name);
+
+  plugin_register_write(
+      cbi->name, cjni_write_batch,
+      &(user_data_t){
+          .data = b, .free_func = cjni_write_batch_destroy,
+      });
+
+  /* The write callback owns the batch, the flush callback only borrows it. */
+  plugin_register_flush(cbi->name, cjni_write_batch_flush,
+                        &(user_data_t){.data = b});
+
+  (*jvm_env)->DeleteLocalRef(jvm_env, o_write);
+
+  return 0;
+} /* }}} jint cjni_api_register_write_batch */
+
 static jint JNICALL cjni_api_register_flush(JNIEnv *jvm_env, /* {{{ */
                                             jobject this, jobject o_name,
                                             jobject o_flush) {
@@ -1532,6 +1774,10 @@ static JNINativeMethod jni_api_functions[] = /* {{{ */
          "(Ljava/lang/String;Lorg/collectd/api/CollectdWriteInterface;)I",
          cjni_api_register_write},
 
+        {"registerWriteBatch", "(Ljava/lang/String;Lorg/collectd/api/"
+                               "CollectdWriteBatchInterface;)I",
+         cjni_api_register_write_batch},
+
         {"registerFlush",
          "(Ljava/lang/String;Lorg/collectd/api/CollectdFlushInterface;)I",
          cjni_api_register_flush},
@@ -1599,6 +1845,11 @@ cjni_callback_info_create(JNIEnv *jvm_env, /* {{{ */
     method_signature = "(Lorg/collectd/api/ValueList;)I";
     break;
 
+  case CB_TYPE_WRITE_BATCH:
+    method_name = "writeBatch";
+    method_signature = "(Lorg/collectd/api/ValueListBatch;)I";
+    break;
+
   case CB_TYPE_FLUSH:
     method_name = "flush";
     method_signature = "(Ljava/lang/Number;Ljava/lang/String;)I";
@@ -1812,6 +2063,119 @@ static int cjni_init_native(JNIEnv *jvm_env) /* {{{ */
   return 0;
 } /* }}} int cjni_init_native */
 
+/* Look up the classes and methods in `class_cache'. */
+static int cjni_init_class_cache(JNIEnv *jvm_env) /* {{{ */
+{
+  cjni_class_cache_t *cc = &class_cache;
+
+#define LOOKUP_CLASS(member, name)                                             \
+  do {                                                                         \
+    jclass tmp = (*jvm_env)->FindClass(jvm_env, name);                         \
+    if (tmp == NULL) {                                                         \
+      ERROR("java plugin: cjni_init_class_cache: FindClass (%s) failed.",      \
+            name);                                                             \
+      return -1;                                                               \
+    }                                                                          \
+    cc->member = (*jvm_env)->NewGlobalRef(jvm_env, tmp);                       \
+    (*jvm_env)->DeleteLocalRef(jvm_env, tmp);                                  \
+    if (cc->member == NULL) {                                                  \
+      ERROR("java plugin: cjni_init_class_cache: NewGlobalRef failed.");       \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+#define LOOKUP_METHOD(member, class, name, signature)                          \
+  do {                                                                         \
+    cc->member = (*jvm_env)->GetMethodID(jvm_env, cc->class, name, signature); \
+    if (cc->member == NULL) {                                                  \
+      ERROR("java plugin: cjni_init_class_cache: Cannot find the `%s' method " \
+            "with signature `%s'.",                                            \
+            name, signature);                                                  \
+      return -1;                                                               \
+    }                                                                          \
+  } while (0)
+
+  LOOKUP_CLASS(c_long, "java/lang/Long");
+  cc->m_long_valueof = (*jvm_env)->GetStaticMethodID(jvm_env, cc->c_long,
+                                                     "valueOf", "(J)Ljava/lang/Long;");
+  LOOKUP_CLASS(c_double, "java/lang/Double");
+  cc->m_double_valueof = (*jvm_env)->GetStaticMethodID(
+      jvm_env, cc->c_double, "valueOf", "(D)Ljava/lang/Double;");
+  if ((cc->m_long_valueof == NULL) || (cc->m_double_valueof == NULL)) {
+    ERROR("java plugin: cjni_init_class_cache: Cannot find the `valueOf' "
+          "methods of java.lang.Long and java.lang.Double.");
+    return -1;
+  }
+
+  LOOKUP_CLASS(c_datasource, "org/collectd/api/DataSource");
+  LOOKUP_METHOD(m_datasource_constructor, c_datasource, "<init>", "()V");
+
+  LOOKUP_CLASS(c_dataset, "org/collectd/api/DataSet");
+  LOOKUP_METHOD(m_dataset_constructor, c_dataset, "<init>",
+                "(Ljava/lang/String;)V");
+  LOOKUP_METHOD(m_dataset_copy_constructor, c_dataset, "<init>",
+                "(Lorg/collectd/api/DataSet;)V");
+  LOOKUP_METHOD(m_dataset_add, c_dataset, "addDataSource",
+                "(Lorg/collectd/api/DataSource;)V");
+
+  LOOKUP_CLASS(c_valuelist, "org/collectd/api/ValueList");
+  LOOKUP_METHOD(m_valuelist_constructor, c_valuelist, "<init>", "()V");
+  LOOKUP_METHOD(m_valuelist_setdataset, c_valuelist, "setDataSet",
+                "(Lorg/collectd/api/DataSet;)V");
+  LOOKUP_METHOD(m_valuelist_addvalue, c_valuelist, "addValue",
+                "(Ljava/lang/Number;)V");
+  LOOKUP_METHOD(m_valuelist_sethost, c_valuelist, "setHost",
+                "(Ljava/lang/String;)V");
+  LOOKUP_METHOD(m_valuelist_setplugin, c_valuelist, "setPlugin",
+                "(Ljava/lang/String;)V");
+  LOOKUP_METHOD(m_valuelist_setplugininstance, c_valuelist,
+                "setPluginInstance", "(Ljava/lang/String;)V");
+  LOOKUP_METHOD(m_valuelist_settype, c_valuelist, "setType",
+                "(Ljava/lang/String;)V");
+  LOOKUP_METHOD(m_valuelist_settypeinstance, c_valuelist, "setTypeInstance",
+                "(Ljava/lang/String;)V");
+  LOOKUP_METHOD(m_valuelist_settime, c_valuelist, "setTime", "(J)V");
+  LOOKUP_METHOD(m_valuelist_setinterval, c_valuelist, "setInterval", "(J)V");
+
+  LOOKUP_CLASS(c_batch, "org/collectd/api/ValueListBatch");
+  LOOKUP_METHOD(m_batch_constructor, c_batch, "<init>",
+                "(Ljava/nio/ByteBuffer;)V");
+  LOOKUP_METHOD(m_batch_reset, c_batch, "reset", "(II)V");
+
+#undef LOOKUP_METHOD
+#undef LOOKUP_CLASS
+
+  return 0;
+} /* }}} int cjni_init_class_cache */
+
+/* Release the global references held by `class_cache' and `data_set_cache'. */
+static void cjni_free_class_cache(JNIEnv *jvm_env) /* {{{ */
+{
+  jclass *classes[] = {&class_cache.c_long,       &class_cache.c_double,
+                       &class_cache.c_datasource, &class_cache.c_dataset,
+                       &class_cache.c_valuelist,  &class_cache.c_batch};
+  cjni_data_set_cache_entry_t *entry;
+  char *key;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(classes); i++) {
+    if (*classes[i] != NULL)
+      (*jvm_env)->DeleteGlobalRef(jvm_env, *classes[i]);
+  }
+  memset(&class_cache, 0, sizeof(class_cache));
+
+  pthread_mutex_lock(&data_set_cache_lock);
+  if (data_set_cache != NULL) {
+    while (c_avl_pick(data_set_cache, (void *)&key, (void *)&entry) == 0) {
+      (*jvm_env)->DeleteGlobalRef(jvm_env, entry->o_dataset);
+      sfree(entry);
+      sfree(key);
+    }
+    c_avl_destroy(data_set_cache);
+    data_set_cache = NULL;
+  }
+  pthread_mutex_unlock(&data_set_cache_lock);
+} /* }}} void cjni_free_class_cache */
+
 /* Create the JVM. This is called when the first thread tries to access the JVM
  * via cjni_thread_attach. */
 static int cjni_create_jvm(void) /* {{{ */
@@ -1862,6 +2226,12 @@ static int cjni_create_jvm(void) /* {{{ */
     return -1;
   }
 
+  status = cjni_init_class_cache(jvm_env);
+  if (status != 0) {
+    ERROR("java plugin: cjni_create_jvm: cjni_init_class_cache failed.");
+    return -1;
+  }
+
   DEBUG("java plugin: The JVM has been created.");
   return 0;
 } /* }}} int cjni_create_jvm */
@@ -1999,6 +2369,25 @@ static int cjni_config_add_jvm_arg(oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int cjni_config_add_jvm_arg */
 
+static int cjni_config_batch_buffer_size(oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+  int status;
+
+  status = cf_util_get_int(ci, &tmp);
+  if (status != 0)
+    return status;
+
+  /* Large enough for a value list with 64 values and maximum length names. */
+  if (tmp < 4096) {
+    ERROR("java plugin: `BatchBufferSize' must be at least 4096 bytes.");
+    return -1;
+  }
+
+  batch_buffer_size = (size_t)tmp;
+  return 0;
+} /* }}} int cjni_config_batch_buffer_size */
+
 static int cjni_config_load_plugin(oconfig_item_t *ci) /* {{{ */
 {
   JNIEnv *jvm_env;
@@ -2166,6 +2555,12 @@ static int cjni_config_perform(oconfig_item_t *ci) /* {{{ */
         success++;
       else
         errors++;
+    } else if (strcasecmp("BatchBufferSize", child->key) == 0) {
+      status = cjni_config_batch_buffer_size(child);
+      if (status == 0)
+        success++;
+      else
+        errors++;
     } else if (strcasecmp("LoadPlugin", child->key) == 0) {
       status = cjni_config_load_plugin(child);
       if (status == 0)
@@ -2349,6 +2744,201 @@ static int cjni_write(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   return ret_status;
 } /* }}} int cjni_write */
 
+/* Switch to the other buffer and return the full one. Must be called with
+ * `b->lock' held. Returns with `b->deliver_lock' held, i.e. after a previous
+ * delivery of the other buffer has finished. */
+static cjni_batch_buffer_t *cjni_write_batch_swap(cjni_write_batch_t *b) /* {{{ */
+{
+  cjni_batch_buffer_t *full = b->buffers + b->active;
+
+  pthread_mutex_lock(&b->deliver_lock);
+  b->active = (b->active + 1) % STATIC_ARRAY_SIZE(b->buffers);
+
+  return full;
+} /* }}} cjni_batch_buffer_t *cjni_write_batch_swap */
+
+/* Pass a buffer returned by cjni_write_batch_swap to the CB_TYPE_WRITE_BATCH
+ * callback and release `b->deliver_lock'. */
+static int cjni_write_batch_deliver(cjni_write_batch_t *b, /* {{{ */
+                                    cjni_batch_buffer_t *buf) {
+  JNIEnv *jvm_env;
+  int ret_status = -1;
+
+  jvm_env = cjni_thread_attach();
+  if (jvm_env != NULL) {
+    (*jvm_env)->CallVoidMethod(jvm_env, buf->o_batch, class_cache.m_batch_reset,
+                               buf->count, (jint)buf->fill);
+
+    if (!(*jvm_env)->ExceptionCheck(jvm_env))
+      ret_status = (*jvm_env)->CallIntMethod(jvm_env, b->cbi->object,
+                                             b->cbi->method, buf->o_batch);
+
+    if ((*jvm_env)->ExceptionCheck(jvm_env)) {
+      ERROR("java plugin: cjni_write_batch_deliver: `%s' threw an exception.",
+            b->cbi->name);
+      (*jvm_env)->ExceptionDescribe(jvm_env);
+      (*jvm_env)->ExceptionClear(jvm_env);
+      ret_status = -1;
+    }
+
+    cjni_thread_detach();
+  }
+
+  buf->fill = 0;
+  buf->count = 0;
+
+  pthread_mutex_unlock(&b->deliver_lock);
+  return ret_status;
+} /* }}} int cjni_write_batch_deliver */
+
+/* Queue a value list for the CB_TYPE_WRITE_BATCH callback pointed to by the
+ * `user_data_t' pointer. The values are encoded into the active buffer, which
+ * is handed to Java once it is full or its first value list has been waiting
+ * for one interval. */
+static int cjni_write_batch(const data_set_t *ds, const value_list_t *vl, /* {{{ */
+                            user_data_t *ud) {
+  cjni_write_batch_t *b;
+  cjni_batch_buffer_t *buf;
+  cjni_batch_buffer_t *full = NULL;
+  size_t size;
+  cdtime_t now;
+
+  if (jvm == NULL) {
+    ERROR("java plugin: cjni_write_batch: jvm == NULL");
+    return -1;
+  }
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("java plugin: cjni_write_batch: Invalid user data.");
+    return -1;
+  }
+
+  b = (cjni_write_batch_t *)ud->data;
+
+  size = ctoj_batch_entry_size(vl);
+  if (size > batch_buffer_size) {
+    ERROR("java plugin: cjni_write_batch: A value list of %" PRIsz " bytes "
+          "does not fit into the batch buffer.",
+          size);
+    return -1;
+  }
+
+  now = cdtime();
+
+  pthread_mutex_lock(&b->lock);
+
+  buf = b->buffers + b->active;
+  if (buf->fill + size > batch_buffer_size) {
+    full = cjni_write_batch_swap(b);
+    buf = b->buffers + b->active;
+  }
+
+  if (buf->count == 0)
+    buf->first_time = now;
+
+  ctoj_batch_append(buf, ds, vl);
+
+  if ((full == NULL) && ((now - buf->first_time) >= vl->interval))
+    full = cjni_write_batch_swap(b);
+
+  pthread_mutex_unlock(&b->lock);
+
+  if (full == NULL)
+    return 0;
+
+  return cjni_write_batch_deliver(b, full);
+} /* }}} int cjni_write_batch */
+
+/* Deliver the active buffer of `b' if its first value list is older than
+ * `timeout'. A timeout of zero delivers any waiting value lists. */
+static int cjni_write_batch_flush_one(cjni_write_batch_t *b, /* {{{ */
+                                       cdtime_t timeout) {
+  cjni_batch_buffer_t *buf;
+  cjni_batch_buffer_t *full = NULL;
+
+  pthread_mutex_lock(&b->lock);
+  buf = b->buffers + b->active;
+  if ((buf->count > 0) &&
+      ((timeout == 0) || ((cdtime() - buf->first_time) >= timeout)))
+    full = cjni_write_batch_swap(b);
+  pthread_mutex_unlock(&b->lock);
+
+  if (full == NULL)
+    return 0;
+
+  return cjni_write_batch_deliver(b, full);
+} /* }}} int cjni_write_batch_flush_one */
+
+/* Flush callback registered along with each CB_TYPE_WRITE_BATCH callback, so
+ * that a partly filled buffer does not have to wait for the next value list. */
+static int cjni_write_batch_flush(cdtime_t timeout, /* {{{ */
+                                  __attribute__((unused))
+                                  const char *identifier,
+                                  user_data_t *ud) {
+  if (jvm == NULL) {
+    ERROR("java plugin: cjni_write_batch_flush: jvm == NULL");
+    return -1;
+  }
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    ERROR("java plugin: cjni_write_batch_flush: Invalid user data.");
+    return -1;
+  }
+
+  return cjni_write_batch_flush_one(ud->data, timeout);
+} /* }}} int cjni_write_batch_flush */
+
+/* Deliver the value lists still waiting in any batch buffer. */
+static void cjni_write_batch_flush_all(void) /* {{{ */
+{
+  pthread_mutex_lock(&write_batches_lock);
+
+  for (cjni_write_batch_t *b = write_batches; b != NULL; b = b->next)
+    cjni_write_batch_flush_one(b, /* timeout = */ 0);
+
+  pthread_mutex_unlock(&write_batches_lock);
+} /* }}} void cjni_write_batch_flush_all */
+
+/* Free the data contained in the `user_data_t' pointer passed to
+ * `cjni_write_batch'. */
+static void cjni_write_batch_destroy(void *arg) /* {{{ */
+{
+  cjni_write_batch_t *b = arg;
+  JNIEnv *jvm_env = NULL;
+
+  if (b == NULL)
+    return;
+
+  pthread_mutex_lock(&write_batches_lock);
+  for (cjni_write_batch_t **prev = &write_batches; *prev != NULL;
+       prev = &(*prev)->next) {
+    if (*prev == b) {
+      *prev = b->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&write_batches_lock);
+
+  /* The JVM has already been destroyed when shutting down. */
+  if (jvm != NULL)
+    jvm_env = cjni_thread_attach();
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(b->buffers); i++) {
+    if ((jvm_env != NULL) && (b->buffers[i].o_batch != NULL))
+      (*jvm_env)->DeleteGlobalRef(jvm_env, b->buffers[i].o_batch);
+    sfree(b->buffers[i].data);
+  }
+
+  if (jvm_env != NULL)
+    cjni_thread_detach();
+
+  cjni_callback_info_destroy(b->cbi);
+
+  pthread_mutex_destroy(&b->deliver_lock);
+  pthread_mutex_destroy(&b->lock);
+  sfree(b);
+} /* }}} void cjni_write_batch_destroy */
+
 /* Call the CB_TYPE_FLUSH callback pointed to by the `user_data_t' pointer. */
 static int cjni_flush(cdtime_t timeout, const char *identifier, /* {{{ */
                       user_data_t *ud) {
@@ -2658,7 +3248,7 @@ static int cjni_match_target_invoke(const data_set_t *ds, /* {{{ */
     return -1;
   }
 
-  o_ds = ctoj_data_set(jvm_env, ds);
+  o_ds = ctoj_data_set_cached(jvm_env, ds);
   if (o_ds == NULL) {
     ERROR("java plugin: cjni_match_target_invoke: ctoj_value_list failed.");
     cjni_thread_detach();
@@ -2751,6 +3341,10 @@ static int cjni_shutdown(void) /* {{{ */
   if (jvm == NULL)
     return 0;
 
+  /* Hand the remaining values to the batch write callbacks. This attaches
+   * and detaches the thread by itself, so do it first. */
+  cjni_write_batch_flush_all();
+
   jvm_env = NULL;
   args.version = JNI_VERSION_1_2;
 
@@ -2787,6 +3381,9 @@ static int cjni_shutdown(void) /* {{{ */
   java_classes_list_len = 0;
   sfree(java_classes_list);
 
+  /* Release the cached classes and DataSet objects. */
+  cjni_free_class_cache(jvm_env);
+
   /* Destroy the JVM */
   DEBUG("java plugin: Destroying the JVM.");
   (*jvm)->DestroyJavaVM(jvm);
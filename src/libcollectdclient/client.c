@@ -62,6 +62,13 @@
 #endif
 #endif
 
+/* Size of the buffer used to format a single command. */
+#define LCC_COMMAND_SIZE 1024
+
+/* Maximum number of PUTVAL commands lcc_putval_batch() sends before reading
+ * the responses. */
+#define LCC_PUTVAL_WINDOW 64
+
 /* Secure/static macros. They work like `strcpy' and `strcat', but assure null
  * termination. They work for static buffers only, because they use `sizeof'.
  * The `SSTRCATF' combines the functionality of `snprintf' and `strcat' which
@@ -698,16 +705,17 @@ int lcc_getval(lcc_connection_t *c, lcc_identifier_t *ident, /* {{{ */
   return 0;
 } /* }}} int lcc_getval */
 
-int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
-{
+/* Formats the PUTVAL command for "vl" into "buffer". */
+static int lcc_format_putval(lcc_connection_t *c, /* {{{ */
+                             char *buffer, size_t buffer_size,
+                             const lcc_value_list_t *vl) {
   char ident_str[6 * LCC_NAME_LEN];
   char ident_esc[12 * LCC_NAME_LEN];
-  char command[1024] = "";
-  lcc_response_t res;
+  char command[LCC_COMMAND_SIZE] = "";
   int status;
 
-  if ((c == NULL) || (vl == NULL) || (vl->values_len < 1) ||
-      (vl->values == NULL) || (vl->values_types == NULL)) {
+  if ((vl == NULL) || (vl->values_len < 1) || (vl->values == NULL) ||
+      (vl->values_types == NULL)) {
     lcc_set_errno(c, EINVAL);
     return -1;
   }
@@ -737,12 +745,29 @@ int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
       else
         SSTRCATF(command, ":%g", vl->values[i].gauge);
     } else if (vl->values_types[i] == LCC_TYPE_DERIVE)
-      SSTRCATF(command, ":%" PRIu64, vl->values[i].derive);
+      SSTRCATF(command, ":%" PRIi64, vl->values[i].derive);
     else if (vl->values_types[i] == LCC_TYPE_ABSOLUTE)
       SSTRCATF(command, ":%" PRIu64, vl->values[i].absolute);
 
   } /* for (i = 0; i < vl->values_len; i++) */
 
+  snprintf(buffer, buffer_size, "%s", command);
+  return 0;
+} /* }}} int lcc_format_putval */
+
+int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
+{
+  char command[LCC_COMMAND_SIZE];
+  lcc_response_t res;
+  int status;
+
+  if (c == NULL)
+    return -1;
+
+  status = lcc_format_putval(c, command, sizeof(command), vl);
+  if (status != 0)
+    return status;
+
   status = lcc_sendreceive(c, command, &res);
   if (status != 0)
     return status;
@@ -757,6 +782,72 @@ int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl) /* {{{ */
   return 0;
 } /* }}} int lcc_putval */
 
+/* Closes the connection after a batch has been interrupted. Responses to
+ * commands already sent would otherwise be read as the responses to later
+ * commands. The error message of `c' is kept. */
+static void lcc_putval_batch_abort(lcc_connection_t *c) /* {{{ */
+{
+  fclose(c->fh);
+  c->fh = NULL;
+} /* }}} void lcc_putval_batch_abort */
+
+int lcc_putval_batch(lcc_connection_t *c, /* {{{ */
+                     const lcc_value_list_t *vl, size_t vl_num) {
+  char command[LCC_COMMAND_SIZE];
+  size_t failed = 0;
+
+  if (c == NULL)
+    return -1;
+
+  if (c->fh == NULL) {
+    lcc_set_errno(c, EBADF);
+    return -1;
+  }
+
+  /* Send up to LCC_PUTVAL_WINDOW commands before reading their responses.
+   * The window is bounded so that the responses fit into the socket buffer;
+   * otherwise the daemon would block writing responses while we block
+   * writing commands. */
+  for (size_t offset = 0; offset < vl_num; offset += LCC_PUTVAL_WINDOW) {
+    size_t window = vl_num - offset;
+    if (window > LCC_PUTVAL_WINDOW)
+      window = LCC_PUTVAL_WINDOW;
+
+    size_t sent = 0;
+    for (size_t i = 0; i < window; i++) {
+      if (lcc_format_putval(c, command, sizeof(command), vl + offset + i) !=
+          0) {
+        failed++;
+        continue;
+      }
+
+      lcc_tracef("send:    --> %s\n", command);
+      if (fprintf(c->fh, "%s\r\n", command) < 0) {
+        lcc_set_errno(c, errno);
+        lcc_putval_batch_abort(c);
+        return -1;
+      }
+      sent++;
+    }
+    fflush(c->fh);
+
+    for (size_t i = 0; i < sent; i++) {
+      lcc_response_t res = {0};
+
+      if (lcc_receive(c, &res) != 0) {
+        lcc_putval_batch_abort(c);
+        return -1;
+      }
+
+      if ((res.status != 0) && (failed++ == 0))
+        LCC_SET_ERRSTR(c, "Server error: %s", res.message);
+      lcc_response_free(&res);
+    }
+  }
+
+  return (failed == 0) ? 0 : -1;
+} /* }}} int lcc_putval_batch */
+
 int lcc_flush(lcc_connection_t *c, const char *plugin, /* {{{ */
               lcc_identifier_t *ident, int timeout) {
   char command[1024] = "";
@@ -66,6 +66,15 @@ int lcc_getval(lcc_connection_t *c, lcc_identifier_t *ident,
 
 int lcc_putval(lcc_connection_t *c, const lcc_value_list_t *vl);
 
+/* lcc_putval_batch submits the "vl_num" value lists in "vl" like lcc_putval()
+ * but writes several commands before reading their responses, saving a round
+ * trip per value list. All value lists are submitted even if some fail; in
+ * that case -1 is returned and lcc_strerror() describes the first failure.
+ * If sending a command or receiving a response fails, the connection is
+ * closed and has to be re-established with lcc_connect(). */
+int lcc_putval_batch(lcc_connection_t *c, const lcc_value_list_t *vl,
+                     size_t vl_num);
+
 int lcc_flush(lcc_connection_t *c, const char *plugin, lcc_identifier_t *ident,
               int timeout);
 
@@ -64,10 +64,26 @@ int lcc_server_set_interface(lcc_server_t *srv, char const *interface);
 int lcc_server_set_security_level(lcc_server_t *srv, lcc_security_level_t level,
                                   const char *username, const char *password);
 
+/* lcc_server_set_packet_size sets the maximum size of the UDP packets sent to
+ * "srv". Zero selects the default, LCC_NETWORK_BUFFER_SIZE_DEFAULT. Sizes
+ * above LCC_NETWORK_BUFFER_SIZE_MAX are rejected with EINVAL. */
+int lcc_server_set_packet_size(lcc_server_t *srv, size_t size);
+
 /*
  * Send data
  */
 int lcc_network_values_send(lcc_network_t *net, const lcc_value_list_t *vl);
+
+/* lcc_network_values_send_batch adds the "vl_num" value lists in "vl" to the
+ * buffers of all servers of "net". Packets filled in the process are sent
+ * with as few system calls as possible; like with lcc_network_values_send(),
+ * values that do not fill a packet stay buffered until the next call or
+ * lcc_network_flush(). */
+int lcc_network_values_send_batch(lcc_network_t *net,
+                                  const lcc_value_list_t *vl, size_t vl_num);
+
+/* lcc_network_flush sends the values buffered for all servers of "net". */
+int lcc_network_flush(lcc_network_t *net);
 #if 0
 int lcc_network_notification_send (lcc_network_t *net,
     const lcc_notification_t *notif);
@@ -32,6 +32,8 @@
 
 /* Ethernet frame - (IPv6 header + UDP header) */
 #define LCC_NETWORK_BUFFER_SIZE_DEFAULT 1452
+/* Largest UDP payload: 65535 - (IPv4 header + UDP header) */
+#define LCC_NETWORK_BUFFER_SIZE_MAX 65507
 
 struct lcc_network_buffer_s;
 typedef struct lcc_network_buffer_s lcc_network_buffer_t;
@@ -44,6 +44,13 @@ typedef struct {
 
   /* security_level is the minimal required security level. */
   lcc_security_level_t security_level;
+
+  /* source identifies where the data has been received from, usually the
+   * sender's address. Identifiers defined by the sender are only used for
+   * data from the same source. Optional: if source_size is zero, all data is
+   * considered to come from the same source. */
+  void const *source;
+  size_t source_size;
 } lcc_network_parse_options_t;
 
 /* lcc_network_parse parses data received from the network and calls "w" with
@@ -26,6 +26,11 @@
  *   Max Henkel <henkel at gmx.at>
  **/
 
+/* for sendmmsg(2) */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "collectd.h"
 
 #include <assert.h>
@@ -57,6 +62,10 @@ struct lcc_network_s {
   lcc_server_t *servers;
 };
 
+/* Maximum number of packets lcc_network_values_send_batch() hands to the
+ * kernel at once. */
+#define LCC_NETWORK_BATCH_PACKETS 32
+
 struct lcc_server_s {
   char *node;
   char *service;
@@ -71,6 +80,15 @@ struct lcc_server_s {
   socklen_t sa_len;
 
   lcc_network_buffer_t *buffer;
+  size_t packet_size;
+  size_t values_buffered;
+  /* Holds a single packet sent by server_send_buffer(). */
+  char *packet;
+
+  /* Packets assembled by lcc_network_values_send_batch(), sent at once. */
+  char *batch;
+  size_t batch_size[LCC_NETWORK_BATCH_PACKETS];
+  size_t batch_num;
 
   lcc_server_t *next;
 };
@@ -106,6 +124,9 @@ static void int_server_destroy(lcc_server_t *srv) /* {{{ */
 
   next = srv->next;
 
+  lcc_network_buffer_destroy(srv->buffer);
+  free(srv->packet);
+  free(srv->batch);
   free(srv->node);
   free(srv->service);
   free(srv->username);
@@ -193,10 +214,34 @@ static int server_open_socket(lcc_server_t *srv) /* {{{ */
   return 0;
 } /* }}} int server_open_socket */
 
-static int server_send_buffer(lcc_server_t *srv) /* {{{ */
-{
-  char buffer[LCC_NETWORK_BUFFER_SIZE_DEFAULT] = {0};
-  size_t buffer_size;
+/* Finalizes the buffer of "srv", copies the packet to "buffer", and resets the
+ * buffer. "buffer_size" must be at least srv->packet_size. */
+static int server_take_buffer(lcc_server_t *srv, char *buffer, /* {{{ */
+                              size_t *buffer_size) {
+  int status;
+
+  status = lcc_network_buffer_finalize(srv->buffer);
+  if (status != 0) {
+    lcc_network_buffer_initialize(srv->buffer);
+    srv->values_buffered = 0;
+    return status;
+  }
+
+  status = lcc_network_buffer_get(srv->buffer, buffer, buffer_size);
+  lcc_network_buffer_initialize(srv->buffer);
+  srv->values_buffered = 0;
+
+  if (status != 0)
+    return status;
+
+  if (*buffer_size > srv->packet_size)
+    *buffer_size = srv->packet_size;
+
+  return 0;
+} /* }}} int server_take_buffer */
+
+static int server_send_packets(lcc_server_t *srv, char *packets, /* {{{ */
+                               size_t *packets_size, size_t packets_num) {
   int status;
 
   if (srv->fd < 0) {
@@ -204,50 +249,123 @@ static int server_send_buffer(lcc_server_t *srv) /* {{{ */
     if (status != 0)
       return status;
   }
+  assert(srv->fd >= 0);
+  assert(srv->sa != NULL);
+
+#if HAVE_SENDMMSG
+  struct mmsghdr msgs[packets_num];
+  struct iovec iovs[packets_num];
+
+  for (size_t i = 0; i < packets_num; i++) {
+    iovs[i] = (struct iovec){
+        .iov_base = packets + i * srv->packet_size, .iov_len = packets_size[i],
+    };
+    msgs[i] = (struct mmsghdr){
+        .msg_hdr =
+            {
+                .msg_name = srv->sa,
+                .msg_namelen = srv->sa_len,
+                .msg_iov = iovs + i,
+                .msg_iovlen = 1,
+            },
+    };
+  }
 
-  buffer_size = sizeof(buffer);
+  size_t sent = 0;
+  while (sent < packets_num) {
+    status = sendmmsg(srv->fd, msgs + sent, (unsigned int)(packets_num - sent),
+                      /* flags = */ 0);
+    if (status < 0) {
+      if ((errno == EINTR) || (errno == EAGAIN))
+        continue;
+      return status;
+    }
+    sent += (size_t)status;
+  }
+#else
+  for (size_t i = 0; i < packets_num; i++) {
+    while (42) {
+      status = (int)sendto(srv->fd, packets + i * srv->packet_size,
+                           packets_size[i], /* flags = */ 0, srv->sa,
+                           srv->sa_len);
+      if ((status < 0) && ((errno == EINTR) || (errno == EAGAIN)))
+        continue;
+
+      break;
+    }
 
-  status = lcc_network_buffer_finalize(srv->buffer);
-  if (status != 0) {
-    lcc_network_buffer_initialize(srv->buffer);
-    return status;
+    if (status < 0)
+      return status;
   }
+#endif
 
-  status = lcc_network_buffer_get(srv->buffer, buffer, &buffer_size);
-  lcc_network_buffer_initialize(srv->buffer);
+  return 0;
+} /* }}} int server_send_packets */
+
+static int server_send_buffer(lcc_server_t *srv) /* {{{ */
+{
+  size_t buffer_size = srv->packet_size;
+  int status;
 
+  status = server_take_buffer(srv, srv->packet, &buffer_size);
   if (status != 0)
     return status;
 
-  if (buffer_size > sizeof(buffer))
-    buffer_size = sizeof(buffer);
+  return server_send_packets(srv, srv->packet, &buffer_size, 1);
+} /* }}} int server_send_buffer */
 
-  while (42) {
-    assert(srv->fd >= 0);
-    assert(srv->sa != NULL);
-    status = (int)sendto(srv->fd, buffer, buffer_size, /* flags = */ 0, srv->sa,
-                         srv->sa_len);
-    if ((status < 0) && ((errno == EINTR) || (errno == EAGAIN)))
-      continue;
+static int server_send_batch(lcc_server_t *srv) /* {{{ */
+{
+  int status;
 
-    break;
+  if (srv->batch_num == 0)
+    return 0;
+
+  status = server_send_packets(srv, srv->batch, srv->batch_size, srv->batch_num);
+  srv->batch_num = 0;
+  return status;
+} /* }}} int server_send_batch */
+
+/* Moves the full buffer of "srv" into its batch of packets, sending the batch
+ * if it is full. */
+static int server_batch_buffer(lcc_server_t *srv) /* {{{ */
+{
+  size_t i = srv->batch_num;
+  int status;
+
+  if (srv->batch == NULL) {
+    srv->batch = malloc(LCC_NETWORK_BATCH_PACKETS * srv->packet_size);
+    if (srv->batch == NULL)
+      return ENOMEM;
   }
 
-  if (status < 0)
+  srv->batch_size[i] = srv->packet_size;
+  status = server_take_buffer(srv, srv->batch + i * srv->packet_size,
+                              srv->batch_size + i);
+  if (status != 0)
     return status;
+  srv->batch_num++;
+
+  if (srv->batch_num >= LCC_NETWORK_BATCH_PACKETS)
+    return server_send_batch(srv);
   return 0;
-} /* }}} int server_send_buffer */
+} /* }}} int server_batch_buffer */
 
 static int server_value_add(lcc_server_t *srv, /* {{{ */
                             const lcc_value_list_t *vl) {
   int status;
 
   status = lcc_network_buffer_add_value(srv->buffer, vl);
-  if (status == 0)
+  if (status == 0) {
+    srv->values_buffered++;
     return 0;
+  }
 
   server_send_buffer(srv);
-  return lcc_network_buffer_add_value(srv->buffer, vl);
+  status = lcc_network_buffer_add_value(srv->buffer, vl);
+  if (status == 0)
+    srv->values_buffered++;
+  return status;
 } /* }}} int server_value_add */
 
 /*
@@ -306,8 +424,12 @@ lcc_server_t *lcc_server_create(lcc_network_t *net, /* {{{ */
     return NULL;
   }
 
-  srv->buffer = lcc_network_buffer_create(/* size = */ 0);
-  if (srv->buffer == NULL) {
+  srv->packet_size = LCC_NETWORK_BUFFER_SIZE_DEFAULT;
+  srv->buffer = lcc_network_buffer_create(srv->packet_size);
+  srv->packet = malloc(srv->packet_size);
+  if ((srv->buffer == NULL) || (srv->packet == NULL)) {
+    lcc_network_buffer_destroy(srv->buffer);
+    free(srv->packet);
     free(srv->service);
     free(srv->node);
     free(srv);
@@ -432,10 +554,73 @@ int lcc_server_set_interface(lcc_server_t *srv, char const *interface) /* {{{ */
 int lcc_server_set_security_level(lcc_server_t *srv, /* {{{ */
                                   lcc_security_level_t level,
                                   const char *username, const char *password) {
-  return lcc_network_buffer_set_security_level(srv->buffer, level, username,
-                                               password);
+  int status;
+
+  status = lcc_network_buffer_set_security_level(srv->buffer, level, username,
+                                                 password);
+  if (status != 0)
+    return status;
+
+  /* Remember the settings in case the buffer is re-created by
+   * lcc_server_set_packet_size(). */
+  free(srv->username);
+  free(srv->password);
+  srv->security_level = level;
+  srv->username = (username != NULL) ? strdup(username) : NULL;
+  srv->password = (password != NULL) ? strdup(password) : NULL;
+
+  return 0;
 } /* }}} int lcc_server_set_security_level */
 
+int lcc_server_set_packet_size(lcc_server_t *srv, size_t size) /* {{{ */
+{
+  lcc_network_buffer_t *buffer;
+  char *packet;
+
+  if (srv == NULL)
+    return EINVAL;
+
+  if (size == 0)
+    size = LCC_NETWORK_BUFFER_SIZE_DEFAULT;
+  else if (size > LCC_NETWORK_BUFFER_SIZE_MAX)
+    return EINVAL;
+
+  buffer = lcc_network_buffer_create(size);
+  if (buffer == NULL)
+    return (errno != 0) ? errno : ENOMEM;
+
+  if (srv->security_level != NONE) {
+    int status = lcc_network_buffer_set_security_level(
+        buffer, srv->security_level, srv->username, srv->password);
+    if (status != 0) {
+      lcc_network_buffer_destroy(buffer);
+      return status;
+    }
+  }
+
+  packet = malloc(size);
+  if (packet == NULL) {
+    lcc_network_buffer_destroy(buffer);
+    return ENOMEM;
+  }
+
+  /* Send what has been buffered so far. */
+  if (srv->values_buffered > 0)
+    server_send_buffer(srv);
+
+  lcc_network_buffer_destroy(srv->buffer);
+  srv->buffer = buffer;
+  free(srv->packet);
+  srv->packet = packet;
+  srv->packet_size = size;
+
+  /* Allocated with the new size when needed. */
+  free(srv->batch);
+  srv->batch = NULL;
+
+  return 0;
+} /* }}} int lcc_server_set_packet_size */
+
 int lcc_network_values_send(lcc_network_t *net, /* {{{ */
                             const lcc_value_list_t *vl) {
   if ((net == NULL) || (vl == NULL))
@@ -446,3 +631,63 @@ int lcc_network_values_send(lcc_network_t *net, /* {{{ */
 
   return 0;
 } /* }}} int lcc_network_values_send */
+
+int lcc_network_values_send_batch(lcc_network_t *net, /* {{{ */
+                                  const lcc_value_list_t *vl, size_t vl_num) {
+  int status = 0;
+
+  if ((net == NULL) || ((vl == NULL) && (vl_num > 0)))
+    return EINVAL;
+
+  for (lcc_server_t *srv = net->servers; srv != NULL; srv = srv->next) {
+    for (size_t i = 0; i < vl_num; i++) {
+      if (lcc_network_buffer_add_value(srv->buffer, vl + i) == 0) {
+        srv->values_buffered++;
+        continue;
+      }
+
+      /* The value doesn't fit into a packet at all. */
+      if (srv->values_buffered == 0) {
+        if (status == 0)
+          status = EMSGSIZE;
+        continue;
+      }
+
+      /* The buffer is full. */
+      int tmp = server_batch_buffer(srv);
+      if (tmp == 0)
+        tmp = lcc_network_buffer_add_value(srv->buffer, vl + i);
+      if (tmp == 0)
+        srv->values_buffered++;
+      else if (status == 0)
+        status = tmp;
+    }
+
+    /* Values not filling a packet stay buffered, like with
+     * lcc_network_values_send(). */
+    int tmp = server_send_batch(srv);
+    if ((tmp != 0) && (status == 0))
+      status = tmp;
+  }
+
+  return status;
+} /* }}} int lcc_network_values_send_batch */
+
+int lcc_network_flush(lcc_network_t *net) /* {{{ */
+{
+  int status = 0;
+
+  if (net == NULL)
+    return EINVAL;
+
+  for (lcc_server_t *srv = net->servers; srv != NULL; srv = srv->next) {
+    if (srv->values_buffered == 0)
+      continue;
+
+    int tmp = server_send_buffer(srv);
+    if ((tmp != 0) && (status == 0))
+      status = tmp;
+  }
+
+  return status;
+} /* }}} int lcc_network_flush */
@@ -140,7 +140,7 @@ static _Bool have_gcrypt(void) /* {{{ */
   if (!gcry_check_version(GCRYPT_VERSION))
     return 0;
 
-  if (!gcry_control(GCRYCTL_INIT_SECMEM, 32768, 0))
+  if (gcry_control(GCRYCTL_INIT_SECMEM, 32768, 0))
     return 0;
 
   gcry_control(GCRYCTL_INITIALIZATION_FINISHED, 0);
@@ -543,7 +543,7 @@ static int nb_add_encryption(lcc_network_buffer_t *nb) /* {{{ */
   memcpy(nb->buffer + 2, &pkg_length, sizeof(pkg_length));
 
   /* Calculate what to hash */
-  hash_ptr = nb->buffer + PART_ENCRYPTION_AES256_SIZE;
+  hash_ptr = nb->buffer + nb->encr_header_len;
   hash_size = package_length - nb->encr_header_len;
 
   /* Calculate what to encrypt */
@@ -68,6 +68,10 @@ __attribute__((const)) static uint64_t be64toh(uint64_t n) {
 #include <gcrypt.h>
 #endif
 
+#if HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #include <stdio.h>
 #define DEBUG(...) printf(__VA_ARGS__)
 
@@ -77,9 +81,15 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #endif
 #endif
 
+/* PARSE_COMPRESSED is set when parsing the content of a compressed part.
+ * Compressed parts must not be nested. */
+#define PARSE_COMPRESSED 0x01
+
 /* forward declaration because parse_sign_sha256()/parse_encrypt_aes256() and
- * network_parse() need to call each other. */
+ * network_parse() need to call each other. "username" is the user that signed
+ * or encrypted the data, NULL if it is neither. */
 static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
+                         char const *username, int flags,
                          lcc_network_parse_options_t const *opts);
 
 #if HAVE_GCRYPT_H
@@ -150,8 +160,140 @@ static int buffer_uint16(buffer_t *b, uint16_t *out) {
 #define TYPE_VALUES 0x0006
 #define TYPE_INTERVAL 0x0007
 #define TYPE_INTERVAL_HR 0x0009
+#define TYPE_IDENT_SET 0x0010
+#define TYPE_IDENT_USE 0x0011
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
+#define TYPE_COMPRESSED 0x0220
+
+#define COMPRESSED_ALGORITHM_ZLIB 1
+
+/* Identifiers defined by TYPE_IDENT_SET parts. Senders choose random IDs per
+ * session. Entries are scoped by the source the packet has been received from,
+ * the user that signed or encrypted it and its security level, so that a
+ * definition can only be used by parts of the same origin. When the
+ * dictionary grows beyond DICT_MAX_SIZE entries, the entries of the same or
+ * lower security level are dropped; senders re-define their identifiers
+ * periodically. */
+#define DICT_BUCKETS 1024
+#define DICT_MAX_SIZE 65536
+
+typedef struct dict_entry_s {
+  uint64_t id;
+  lcc_security_level_t sl;
+  /* Both point behind the entry. */
+  char *username;
+  void *source;
+  size_t source_size;
+  lcc_identifier_t identifier;
+  struct dict_entry_s *next;
+} dict_entry_t;
+
+static dict_entry_t *dict[DICT_BUCKETS];
+static size_t dict_size;
+static pthread_mutex_t dict_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static dict_entry_t **dict_bucket(uint64_t id) {
+  return &dict[(id ^ (id >> 32)) % DICT_BUCKETS];
+}
+
+static _Bool dict_match(dict_entry_t const *e, uint64_t id,
+                        lcc_security_level_t sl, char const *username,
+                        lcc_network_parse_options_t const *opts) {
+  return (e->id == id) && (e->sl == sl) &&
+         (strcmp(e->username, (username != NULL) ? username : "") == 0) &&
+         (e->source_size == opts->source_size) &&
+         ((opts->source_size == 0) ||
+          (memcmp(e->source, opts->source, opts->source_size) == 0));
+}
+
+/* dict_find must be called with dict_lock held. */
+static dict_entry_t *dict_find(uint64_t id, lcc_security_level_t sl,
+                               char const *username,
+                               lcc_network_parse_options_t const *opts) {
+  dict_entry_t *e = *dict_bucket(id);
+  while ((e != NULL) && !dict_match(e, id, sl, username, opts))
+    e = e->next;
+  return e;
+}
+
+/* Removes the entries with security level "sl" or lower, so that packets with
+ * a lower security level cannot displace definitions made by packets with a
+ * higher one. dict_evict must be called with dict_lock held. */
+static void dict_evict(lcc_security_level_t sl) {
+  for (size_t i = 0; i < DICT_BUCKETS; i++) {
+    dict_entry_t **next = &dict[i];
+    while (*next != NULL) {
+      dict_entry_t *e = *next;
+      if (e->sl > sl) {
+        next = &e->next;
+        continue;
+      }
+      *next = e->next;
+      free(e);
+      dict_size--;
+    }
+  }
+}
+
+static int dict_define(uint64_t id, lcc_security_level_t sl,
+                       char const *username,
+                       lcc_network_parse_options_t const *opts,
+                       lcc_identifier_t const *identifier) {
+  if (username == NULL)
+    username = "";
+
+  pthread_mutex_lock(&dict_lock);
+
+  dict_entry_t *e = dict_find(id, sl, username, opts);
+  if (e == NULL) {
+    if (dict_size >= DICT_MAX_SIZE)
+      dict_evict(sl);
+    /* Full of definitions with a higher security level: ignore this one. */
+    if (dict_size >= DICT_MAX_SIZE) {
+      pthread_mutex_unlock(&dict_lock);
+      return 0;
+    }
+
+    size_t username_size = strlen(username) + 1;
+    e = calloc(1, sizeof(*e) + username_size + opts->source_size);
+    if (e == NULL) {
+      pthread_mutex_unlock(&dict_lock);
+      return ENOMEM;
+    }
+    e->id = id;
+    e->sl = sl;
+    e->username = (char *)(e + 1);
+    memcpy(e->username, username, username_size);
+    e->source = e->username + username_size;
+    e->source_size = opts->source_size;
+    if (opts->source_size > 0)
+      memcpy(e->source, opts->source, opts->source_size);
+
+    e->next = *dict_bucket(id);
+    *dict_bucket(id) = e;
+    dict_size++;
+  }
+
+  e->identifier = *identifier;
+
+  pthread_mutex_unlock(&dict_lock);
+  return 0;
+}
+
+static int dict_lookup(uint64_t id, lcc_security_level_t sl,
+                       char const *username,
+                       lcc_network_parse_options_t const *opts,
+                       lcc_identifier_t *identifier) {
+  pthread_mutex_lock(&dict_lock);
+
+  dict_entry_t *e = dict_find(id, sl, username, opts);
+  if (e != NULL)
+    *identifier = e->identifier;
+
+  pthread_mutex_unlock(&dict_lock);
+  return (e != NULL) ? 0 : ENOENT;
+}
 
 static int parse_int(void *payload, size_t payload_size, uint64_t *out) {
   uint64_t tmp;
@@ -405,12 +547,12 @@ static int verify_sha256(void *payload, size_t payload_size,
 #endif
 
 static int parse_sign_sha256(void *signature, size_t signature_len,
-                             void *payload, size_t payload_size,
+                             void *payload, size_t payload_size, int flags,
                              lcc_network_parse_options_t const *opts) {
   if (opts->password_lookup == NULL) {
     /* The sender signed the packet but we can't verify it. Handle it as if it
      * were unsigned, i.e. security level NONE. */
-    return network_parse(payload, payload_size, NONE, opts);
+    return network_parse(payload, payload_size, NONE, NULL, flags, opts);
   }
 
   buffer_t *b = &(buffer_t){
@@ -429,13 +571,13 @@ static int parse_sign_sha256(void *signature, size_t signature_len,
 
   char const *password = opts->password_lookup(username);
   if (!password)
-    return network_parse(payload, payload_size, NONE, opts);
+    return network_parse(payload, payload_size, NONE, NULL, flags, opts);
 
   int status = verify_sha256(payload, payload_size, username, password, hash);
   if (status != 0)
     return status;
 
-  return network_parse(payload, payload_size, SIGN, opts);
+  return network_parse(payload, payload_size, SIGN, username, flags, opts);
 }
 
 #if HAVE_GCRYPT_H
@@ -450,7 +592,6 @@ static int decrypt_aes256(buffer_t *b, void *iv, size_t iv_size,
   uint8_t pwhash[32] = {0};
   gcry_md_hash_buffer(GCRY_MD_SHA256, pwhash, password, strlen(password));
 
-  fprintf(stderr, "sizeof(iv) = %" PRIsz "\n", sizeof(iv));
   if (gcry_cipher_setkey(cipher, pwhash, sizeof(pwhash)) ||
       gcry_cipher_setiv(cipher, iv, iv_size) ||
       gcry_cipher_decrypt(cipher, b->data, b->len, /* in = */ NULL,
@@ -463,7 +604,7 @@ static int decrypt_aes256(buffer_t *b, void *iv, size_t iv_size,
   return 0;
 }
 
-static int parse_encrypt_aes256(void *data, size_t data_size,
+static int parse_encrypt_aes256(void *data, size_t data_size, int flags,
                                 lcc_network_parse_options_t const *opts) {
   if (opts->password_lookup == NULL) {
     /* Without a password source it's (hopefully) impossible to decrypt the
@@ -509,22 +650,68 @@ static int parse_encrypt_aes256(void *data, size_t data_size,
     return -1;
   }
 
-  return network_parse(b->data, b->len, ENCRYPT, opts);
+  return network_parse(b->data, b->len, ENCRYPT, username, flags, opts);
 }
 #else /* !HAVE_GCRYPT_H */
-static int parse_encrypt_aes256(void *data, size_t data_size,
+static int parse_encrypt_aes256(void *data, size_t data_size, int flags,
                                 lcc_network_parse_options_t const *opts) {
   return ENOTSUP;
 }
 #endif
 
+static int parse_compressed(void *payload, size_t payload_size,
+                            lcc_security_level_t sl, char const *username,
+                            int flags,
+                            lcc_network_parse_options_t const *opts) {
+  if (flags & PARSE_COMPRESSED)
+    return EINVAL;
+
+  buffer_t *b = &(buffer_t){
+      .data = payload, .len = payload_size,
+  };
+
+  uint8_t algorithm, reserved;
+  uint16_t data_size;
+  if (buffer_next(b, &algorithm, sizeof(algorithm)) ||
+      buffer_next(b, &reserved, sizeof(reserved)) ||
+      buffer_uint16(b, &data_size))
+    return EINVAL;
+
+#if HAVE_LIBZ
+  /* Like unknown part types, unknown algorithms are ignored. */
+  if ((algorithm != COMPRESSED_ALGORITHM_ZLIB) || (data_size == 0))
+    return 0;
+
+  uint8_t *data = malloc(data_size);
+  if (data == NULL)
+    return ENOMEM;
+
+  uLongf data_len = data_size;
+  if ((uncompress(data, &data_len, b->data, b->len) != Z_OK) ||
+      (data_len != data_size)) {
+    free(data);
+    return EINVAL;
+  }
+
+  int status =
+      network_parse(data, data_size, sl, username, flags | PARSE_COMPRESSED,
+                    opts);
+  free(data);
+  return status;
+#else
+  return ENOTSUP;
+#endif
+}
+
 static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
+                         char const *username, int flags,
                          lcc_network_parse_options_t const *opts) {
   buffer_t *b = &(buffer_t){
       .data = data, .len = data_size,
   };
 
   lcc_value_list_t state = {0};
+  _Bool ident_missing = 0;
 
   while (b->len > 0) {
     uint16_t type = 0, sz = 0;
@@ -569,7 +756,31 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
       break;
     }
 
+    case TYPE_IDENT_SET:
+    case TYPE_IDENT_USE: {
+      uint64_t id = 0;
+      if (parse_int(payload, sizeof(payload), &id)) {
+        DEBUG("lcc_network_parse(): parse_int failed.\n");
+        return EINVAL;
+      }
+      if (type == TYPE_IDENT_SET) {
+        int status = dict_define(id, sl, username, opts, &state.identifier);
+        if (status != 0)
+          return status;
+      } else {
+        ident_missing =
+            (dict_lookup(id, sl, username, opts, &state.identifier) != 0);
+      }
+      break;
+    }
+
     case TYPE_VALUES: {
+      /* Skip values referring to an identifier we have not seen defined. */
+      if (ident_missing) {
+        ident_missing = 0;
+        break;
+      }
+
       lcc_value_list_t vl = state;
       if (parse_values(payload, sizeof(payload), &vl)) {
         free(vl.values);
@@ -593,8 +804,8 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
     }
 
     case TYPE_SIGN_SHA256: {
-      int status =
-          parse_sign_sha256(payload, sizeof(payload), b->data, b->len, opts);
+      int status = parse_sign_sha256(payload, sizeof(payload), b->data, b->len,
+                                     flags, opts);
       if (status != 0) {
         DEBUG("lcc_network_parse(): parse_sign_sha256() = %d\n", status);
         return -1;
@@ -606,7 +817,7 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
     }
 
     case TYPE_ENCR_AES256: {
-      int status = parse_encrypt_aes256(payload, sizeof(payload), opts);
+      int status = parse_encrypt_aes256(payload, sizeof(payload), flags, opts);
       if (status != 0) {
         DEBUG("lcc_network_parse(): parse_encrypt_aes256() = %d\n", status);
         return -1;
@@ -614,9 +825,20 @@ static int network_parse(void *data, size_t data_size, lcc_security_level_t sl,
       break;
     }
 
+    case TYPE_COMPRESSED: {
+      int status = parse_compressed(payload, sizeof(payload), sl, username,
+                                    flags, opts);
+      if (status != 0) {
+        DEBUG("lcc_network_parse(): parse_compressed() = %d\n", status);
+        return status;
+      }
+      break;
+    }
+
     default: {
+      /* Newer senders may add part types; skip over them. */
       DEBUG("lcc_network_parse(): ignoring unknown type %" PRIu16 "\n", type);
-      return EINVAL;
+      break;
     }
     }
   }
@@ -637,5 +859,6 @@ int lcc_network_parse(void *data, size_t data_size,
 #endif
   }
 
-  return network_parse(data, data_size, NONE, &opts);
+  return network_parse(data, data_size, NONE, /* username = */ NULL,
+                       /* flags = */ 0, &opts);
 }
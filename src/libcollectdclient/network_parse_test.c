@@ -268,6 +268,170 @@ static int test_network_parse() {
   return ret;
 }
 
+#if HAVE_LIBZ
+static size_t put_part(uint8_t *buffer, uint16_t type, void const *payload,
+                       size_t payload_size) {
+  uint16_t tmp;
+
+  tmp = htobe16(type);
+  memmove(buffer, &tmp, sizeof(tmp));
+  tmp = htobe16((uint16_t)(payload_size + 4));
+  memmove(buffer + 2, &tmp, sizeof(tmp));
+  memmove(buffer + 4, payload, payload_size);
+
+  return payload_size + 4;
+}
+
+static size_t put_string(uint8_t *buffer, uint16_t type, char const *s) {
+  return put_part(buffer, type, s, strlen(s) + 1);
+}
+
+static size_t put_number(uint8_t *buffer, uint16_t type, uint64_t n) {
+  uint64_t be = htobe64(n);
+  return put_part(buffer, type, &be, sizeof(be));
+}
+
+static size_t put_derive(uint8_t *buffer, uint64_t n) {
+  uint8_t payload[11] = {0, 1, LCC_TYPE_DERIVE};
+  uint64_t be = htobe64(n);
+  memmove(payload + 3, &be, sizeof(be));
+  return put_part(buffer, TYPE_VALUES, payload, sizeof(payload));
+}
+
+static int compressed_writes;
+
+static int compressed_writer(lcc_value_list_t const *vl) {
+  if ((strcmp("example.com", vl->identifier.host) != 0) ||
+      (strcmp("cpu", vl->identifier.plugin) != 0) ||
+      (strcmp("0", vl->identifier.plugin_instance) != 0) ||
+      (strcmp("cpu", vl->identifier.type) != 0) ||
+      (strcmp("idle", vl->identifier.type_instance) != 0)) {
+    fprintf(stderr, "compressed_writer: unexpected identifier %s/%s-%s/%s-%s\n",
+            vl->identifier.host, vl->identifier.plugin,
+            vl->identifier.plugin_instance, vl->identifier.type,
+            vl->identifier.type_instance);
+    return EINVAL;
+  }
+
+  compressed_writes++;
+  return 0;
+}
+
+static int test_network_parse_compressed() {
+  uint64_t id = 0x2a00000000ULL;
+  uint8_t data[512];
+  size_t data_size = 0;
+
+  /* Define the identifier, then reference it. */
+  data_size += put_string(data + data_size, TYPE_HOST, "example.com");
+  data_size += put_string(data + data_size, TYPE_PLUGIN, "cpu");
+  data_size += put_string(data + data_size, TYPE_PLUGIN_INSTANCE, "0");
+  data_size += put_string(data + data_size, TYPE_TYPE, "cpu");
+  data_size += put_string(data + data_size, TYPE_TYPE_INSTANCE, "idle");
+  data_size += put_number(data + data_size, TYPE_IDENT_SET, id);
+  data_size += put_number(data + data_size, TYPE_TIME_HR, 1546167635576736987);
+  data_size += put_number(data + data_size, TYPE_INTERVAL_HR, 10737418240);
+  data_size += put_derive(data + data_size, 42);
+
+  data_size += put_number(data + data_size, TYPE_IDENT_USE, id);
+  data_size += put_number(data + data_size, TYPE_TIME_HR, 1546167646314155212);
+  data_size += put_derive(data + data_size, 43);
+
+  /* Unknown IDs and part types are skipped. */
+  data_size += put_number(data + data_size, TYPE_IDENT_USE, id + 1);
+  data_size += put_derive(data + data_size, 44);
+  data_size += put_string(data + data_size, 0x7fff, "future");
+
+  uint8_t packet[512] = {TYPE_COMPRESSED >> 8, TYPE_COMPRESSED & 0xff, 0, 0,
+                         COMPRESSED_ALGORITHM_ZLIB, 0};
+  uint16_t tmp = htobe16((uint16_t)data_size);
+  memmove(packet + 6, &tmp, sizeof(tmp));
+
+  uLongf compressed_size = sizeof(packet) - 8;
+  if (compress(packet + 8, &compressed_size, data, data_size) != Z_OK) {
+    fprintf(stderr, "test_network_parse_compressed: compress failed.\n");
+    return -1;
+  }
+  tmp = htobe16((uint16_t)(compressed_size + 8));
+  memmove(packet + 2, &tmp, sizeof(tmp));
+
+  compressed_writes = 0;
+  int status = lcc_network_parse(packet, compressed_size + 8,
+                                 (lcc_network_parse_options_t){
+                                     .writer = compressed_writer,
+                                 });
+  if ((status != 0) || (compressed_writes != 2)) {
+    fprintf(stderr,
+            "lcc_network_parse(compressed) = (%d, %d writes), want (0, 2)\n",
+            status, compressed_writes);
+    return -1;
+  }
+
+  printf("ok - lcc_network_parse(compressed)\n");
+  return 0;
+}
+
+/* Identifiers are only used for data from the source that defined them. */
+static int test_network_parse_dict_scope() {
+  uint64_t id = 0x2b00000000ULL;
+  uint8_t define[512];
+  size_t define_size = 0;
+  uint8_t use[64];
+  size_t use_size = 0;
+
+  define_size += put_string(define + define_size, TYPE_HOST, "example.com");
+  define_size += put_string(define + define_size, TYPE_PLUGIN, "cpu");
+  define_size += put_string(define + define_size, TYPE_PLUGIN_INSTANCE, "0");
+  define_size += put_string(define + define_size, TYPE_TYPE, "cpu");
+  define_size += put_string(define + define_size, TYPE_TYPE_INSTANCE, "idle");
+  define_size += put_number(define + define_size, TYPE_IDENT_SET, id);
+  define_size += put_derive(define + define_size, 42);
+
+  use_size += put_number(use + use_size, TYPE_IDENT_USE, id);
+  use_size += put_derive(use + use_size, 43);
+
+  char const *source_a = "192.0.2.1";
+  char const *source_b = "192.0.2.2";
+  lcc_network_parse_options_t opts = {
+      .writer = compressed_writer,
+      .source = source_a,
+      .source_size = strlen(source_a),
+  };
+
+  compressed_writes = 0;
+  int status = lcc_network_parse(define, define_size, opts);
+  if ((status != 0) || (compressed_writes != 1)) {
+    fprintf(stderr,
+            "lcc_network_parse(define) = (%d, %d writes), want (0, 1)\n",
+            status, compressed_writes);
+    return -1;
+  }
+
+  opts.source = source_b;
+  opts.source_size = strlen(source_b);
+  status = lcc_network_parse(use, use_size, opts);
+  if ((status != 0) || (compressed_writes != 1)) {
+    fprintf(stderr,
+            "lcc_network_parse(other source) = (%d, %d writes), want (0, 1)\n",
+            status, compressed_writes);
+    return -1;
+  }
+
+  opts.source = source_a;
+  opts.source_size = strlen(source_a);
+  status = lcc_network_parse(use, use_size, opts);
+  if ((status != 0) || (compressed_writes != 2)) {
+    fprintf(stderr,
+            "lcc_network_parse(same source) = (%d, %d writes), want (0, 2)\n",
+            status, compressed_writes);
+    return -1;
+  }
+
+  printf("ok - lcc_network_parse(dictionary scope)\n");
+  return 0;
+}
+#endif
+
 static int test_parse_time() {
   int ret = 0;
 
@@ -502,6 +666,14 @@ int main(void) {
   if ((status = test_parse_values())) {
     ret = status;
   }
+#if HAVE_LIBZ
+  if ((status = test_network_parse_compressed())) {
+    ret = status;
+  }
+  if ((status = test_network_parse_dict_scope())) {
+    ret = status;
+  }
+#endif
 
 #if HAVE_GCRYPT_H
   if ((status = test_verify_sha256())) {
@@ -193,7 +193,10 @@ int lcc_listen_and_write(lcc_listener_t srv) {
   int ret = 0;
   while (42) {
     char buffer[srv.buffer_size];
-    ssize_t len = recv(srv.conn, buffer, sizeof(buffer), /* flags = */ 0);
+    struct sockaddr_storage addr = {0};
+    socklen_t addrlen = sizeof(addr);
+    ssize_t len = recvfrom(srv.conn, buffer, sizeof(buffer), /* flags = */ 0,
+                           (struct sockaddr *)&addr, &addrlen);
     if (len == -1) {
       ret = errno;
       break;
@@ -201,7 +204,12 @@ int lcc_listen_and_write(lcc_listener_t srv) {
       break;
     }
 
-    (void)srv.parser(buffer, (size_t)len, srv.parse_options);
+    /* Scopes the identifiers the sender defines to its address. */
+    lcc_network_parse_options_t opts = srv.parse_options;
+    opts.source = &addr;
+    opts.source_size = (size_t)addrlen;
+
+    (void)srv.parser(buffer, (size_t)len, opts);
   }
 
   if (close_socket) {
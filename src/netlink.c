@@ -25,12 +25,16 @@
  *   Marc Fournier <marc.fournier at camptocamp.com>
  **/
 
+#define _GNU_SOURCE /* For recvmmsg */
+
 #include "collectd.h"
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 
 #include <asm/types.h>
+#include <net/if.h>
 
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
@@ -90,13 +94,64 @@ struct qos_stats {
   struct gnet_stats_queue *qs;
 };
 
+/* Whether statistics of one type are collected for a link. IR_COLLECT_CHECK
+ * means that the decision depends on the qdisc, class or filter. */
+typedef enum {
+  IR_COLLECT_NONE = 0,
+  IR_COLLECT_ALL,
+  IR_COLLECT_CHECK,
+} ir_collect_t;
+
+enum {
+  IR_TYPE_INTERFACE = 0,
+  IR_TYPE_IF_DETAIL,
+  IR_TYPE_QDISC,
+  IR_TYPE_CLASS,
+  IR_TYPE_FILTER,
+  IR_TYPE_MAX,
+};
+
+static const char *ir_type_names[IR_TYPE_MAX] = {
+    "interface", "if_detail", "qdisc", "class", "filter",
+};
+
+typedef struct ir_link_s {
+  int ifindex;
+  char name[IFNAMSIZ];
+  ir_collect_t collect[IR_TYPE_MAX];
+  /* Set if the last qdisc dump returned a qdisc other than "noqueue", i.e.
+   * if there may be classes and filters to query. */
+  _Bool has_qdisc;
+  unsigned int generation;
+} ir_link_t;
+
+/* Size of one datagram buffer and number of datagrams received with one
+ * system call. The kernel fills dump datagrams up to 32 KiB. */
+#define IR_BUFFER_SIZE 65536
+#define IR_BATCH_NUM 8
+
 static int ir_ignorelist_invert = 1;
 static ir_ignorelist_t *ir_ignorelist_head = NULL;
 
 static struct mnl_socket *nl;
-
-static char **iflist = NULL;
-static size_t iflist_len = 0;
+/* Subscribed to RTNLGRP_LINK, so that links don't have to be dumped on every
+ * read. */
+static struct mnl_socket *nl_events;
+
+static char *ir_buffer;
+static size_t ir_buffer_len[IR_BATCH_NUM];
+static unsigned int ir_seq;
+
+/* ifindex -> ir_link_t */
+static c_avl_tree_t *ir_links;
+static unsigned int ir_links_generation;
+static _Bool ir_links_resync = 1;
+
+#if HAVE_IFLA_STATS_LINK_64
+static _Bool ir_have_getstats = 1;
+#else
+static _Bool ir_have_getstats = 0;
+#endif
 
 static const char *config_keys[] = {"Interface", "VerboseInterface",
                                     "QDisc",     "Class",
@@ -212,36 +267,130 @@ static void submit_two(const char *dev, const char *type,
   plugin_dispatch_values(&vl);
 } /* void submit_two */
 
-static int update_iflist(struct ifinfomsg *msg, const char *dev) {
-  /* Update the `iflist'. It's used to know which interfaces exist and query
-   * them later for qdiscs and classes. */
-  if ((msg->ifi_index >= 0) && ((size_t)msg->ifi_index >= iflist_len)) {
-    char **temp;
+/*
+ * Decides once per link whether a type of statistics is collected, so that
+ * the ignorelist only needs to be walked for qdiscs, classes and filters that
+ * have been selected by their identifier. Matches `check_ignorelist'.
+ */
+static ir_collect_t ir_link_collect(const char *dev, const char *type) {
+  _Bool match_all = 0;
+  _Bool match_some = 0;
+
+  if (ir_ignorelist_head == NULL)
+    return ir_ignorelist_invert ? IR_COLLECT_ALL : IR_COLLECT_NONE;
 
-    temp = realloc(iflist, (msg->ifi_index + 1) * sizeof(char *));
-    if (temp == NULL) {
-      ERROR("netlink plugin: update_iflist: realloc failed.");
-      return -1;
+  for (ir_ignorelist_t *i = ir_ignorelist_head; i != NULL; i = i->next) {
+    if ((i->device != NULL) && (strcasecmp(i->device, dev) != 0))
+      continue;
+
+    if (strcasecmp(i->type, type) != 0)
+      continue;
+
+    if (i->inst == NULL) {
+      match_all = 1;
+      break;
     }
+    match_some = 1;
+  }
 
-    memset(temp + iflist_len, '\0',
-           (msg->ifi_index + 1 - iflist_len) * sizeof(char *));
-    iflist = temp;
-    iflist_len = msg->ifi_index + 1;
+  if (match_all)
+    return ir_ignorelist_invert ? IR_COLLECT_ALL : IR_COLLECT_NONE;
+  if (match_some)
+    return IR_COLLECT_CHECK;
+  return ir_ignorelist_invert ? IR_COLLECT_NONE : IR_COLLECT_ALL;
+} /* ir_collect_t ir_link_collect */
+
+static int ir_link_compare(const void *a, const void *b) {
+  int ia = *((const int *)a);
+  int ib = *((const int *)b);
+
+  return (ia > ib) - (ia < ib);
+} /* int ir_link_compare */
+
+static ir_link_t *ir_link_lookup(int ifindex) {
+  ir_link_t *link = NULL;
+
+  if (c_avl_get(ir_links, &ifindex, (void *)&link) != 0)
+    return NULL;
+  return link;
+} /* ir_link_t *ir_link_lookup */
+
+/* Adds a link to the table or updates its name. Used for both dumps and
+ * RTM_NEWLINK events. */
+static ir_link_t *ir_link_update(int ifindex, const char *dev) {
+  ir_link_t *link = ir_link_lookup(ifindex);
+
+  if (link == NULL) {
+    link = calloc(1, sizeof(*link));
+    if (link == NULL) {
+      ERROR("netlink plugin: ir_link_update: calloc failed.");
+      return NULL;
+    }
+    link->ifindex = ifindex;
+    /* Query classes and filters until the first qdisc dump. */
+    link->has_qdisc = 1;
+
+    if (c_avl_insert(ir_links, &link->ifindex, link) != 0) {
+      ERROR("netlink plugin: ir_link_update: c_avl_insert failed.");
+      sfree(link);
+      return NULL;
+    }
+    DEBUG("netlink plugin: Added interface %s (%i).", dev, ifindex);
   }
-  if ((iflist[msg->ifi_index] == NULL) ||
-      (strcmp(iflist[msg->ifi_index], dev) != 0)) {
-    sfree(iflist[msg->ifi_index]);
-    iflist[msg->ifi_index] = strdup(dev);
+
+  if (strcmp(link->name, dev) != 0) {
+    sstrncpy(link->name, dev, sizeof(link->name));
+    for (int type = 0; type < IR_TYPE_MAX; type++)
+      link->collect[type] = ir_link_collect(dev, ir_type_names[type]);
   }
 
-  return 0;
-} /* int update_iflist */
+  link->generation = ir_links_generation;
+  return link;
+} /* ir_link_t *ir_link_update */
+
+static void ir_link_remove(int ifindex) {
+  ir_link_t *link = NULL;
+
+  if (c_avl_remove(ir_links, &ifindex, NULL, (void *)&link) != 0)
+    return;
+
+  DEBUG("netlink plugin: Removed interface %s (%i).", link->name, ifindex);
+  sfree(link);
+} /* void ir_link_remove */
+
+/* Removes all links not seen by the last complete link dump. */
+static void ir_link_expire(void) {
+  c_avl_iterator_t *iter;
+  ir_link_t *link;
+  int *ifindex;
+  int *expired = NULL;
+  size_t expired_num = 0;
+
+  iter = c_avl_get_iterator(ir_links);
+  while (c_avl_iterator_next(iter, (void *)&ifindex, (void *)&link) == 0) {
+    int *tmp;
+
+    if (link->generation == ir_links_generation)
+      continue;
+
+    tmp = realloc(expired, (expired_num + 1) * sizeof(*expired));
+    if (tmp == NULL)
+      break;
+    expired = tmp;
+    expired[expired_num++] = *ifindex;
+  }
+  c_avl_iterator_destroy(iter);
+
+  for (size_t i = 0; i < expired_num; i++)
+    ir_link_remove(expired[i]);
+  sfree(expired);
+} /* void ir_link_expire */
 
-static void check_ignorelist_and_submit(const char *dev,
+static void check_ignorelist_and_submit(const ir_link_t *link,
                                         struct ir_link_stats_storage_s *stats) {
+  const char *dev = link->name;
 
-  if (check_ignorelist(dev, "interface", NULL) == 0) {
+  if (link->collect[IR_TYPE_INTERFACE] != IR_COLLECT_NONE) {
     submit_two(dev, "if_octets", NULL, stats->rx_bytes, stats->tx_bytes);
     submit_two(dev, "if_packets", NULL, stats->rx_packets, stats->tx_packets);
     submit_two(dev, "if_errors", NULL, stats->rx_errors, stats->tx_errors);
@@ -249,7 +398,7 @@ static void check_ignorelist_and_submit(const char *dev,
     DEBUG("netlink plugin: Ignoring %s/interface.", dev);
   }
 
-  if (check_ignorelist(dev, "if_detail", NULL) == 0) {
+  if (link->collect[IR_TYPE_IF_DETAIL] != IR_COLLECT_NONE) {
     submit_two(dev, "if_dropped", NULL, stats->rx_dropped, stats->tx_dropped);
     submit_one(dev, "if_multicast", NULL, stats->multicast);
     submit_one(dev, "if_collisions", NULL, stats->collisions);
@@ -299,32 +448,45 @@ static void check_ignorelist_and_submit(const char *dev,
   COPY_RTNL_LINK_VALUE(dst_stats, src_stats, tx_window_errors)
 
 #ifdef HAVE_RTNL_LINK_STATS64
-static void check_ignorelist_and_submit64(const char *dev,
+static void check_ignorelist_and_submit64(const ir_link_t *link,
                                           struct rtnl_link_stats64 *stats) {
   struct ir_link_stats_storage_s s;
 
   COPY_RTNL_LINK_STATS(&s, stats);
 
-  check_ignorelist_and_submit(dev, &s);
+  check_ignorelist_and_submit(link, &s);
 }
 #endif
 
-static void check_ignorelist_and_submit32(const char *dev,
+static void check_ignorelist_and_submit32(const ir_link_t *link,
                                           struct rtnl_link_stats *stats) {
   struct ir_link_stats_storage_s s;
 
   COPY_RTNL_LINK_STATS(&s, stats);
 
-  check_ignorelist_and_submit(dev, &s);
+  check_ignorelist_and_submit(link, &s);
 }
 
-static int link_filter_cb(const struct nlmsghdr *nlh,
-                          void *args __attribute__((unused))) {
+/* Handles RTM_NEWLINK messages of link dumps and RTM_NEWLINK / RTM_DELLINK
+ * events. If `args' points to a true value, the link statistics contained in
+ * the message are submitted, too. */
+static int link_filter_cb(const struct nlmsghdr *nlh, void *args) {
   struct ifinfomsg *ifm = mnl_nlmsg_get_payload(nlh);
   struct nlattr *attr;
   const char *dev = NULL;
+  ir_link_t *link;
   union ir_link_stats_u stats;
 
+  /* Bridge ports are also reported with AF_BRIDGE, e.g. with RTM_DELLINK when
+   * they leave the bridge, although the interface still exists. */
+  if ((ifm->ifi_family != AF_UNSPEC) && (ifm->ifi_family != AF_PACKET))
+    return MNL_CB_OK;
+
+  if (nlh->nlmsg_type == RTM_DELLINK) {
+    ir_link_remove(ifm->ifi_index);
+    return MNL_CB_OK;
+  }
+
   if (nlh->nlmsg_type != RTM_NEWLINK) {
     ERROR("netlink plugin: link_filter_cb: Don't know how to handle type %i.",
           nlh->nlmsg_type);
@@ -343,8 +505,6 @@ static int link_filter_cb(const struct nlmsghdr *nlh,
     }
 
     dev = mnl_attr_get_str(attr);
-    if (update_iflist(ifm, dev) < 0)
-      return MNL_CB_ERROR;
     break;
   }
 
@@ -352,6 +512,13 @@ static int link_filter_cb(const struct nlmsghdr *nlh,
     ERROR("netlink plugin: link_filter_cb: dev == NULL");
     return MNL_CB_ERROR;
   }
+
+  link = ir_link_update(ifm->ifi_index, dev);
+  if (link == NULL)
+    return MNL_CB_ERROR;
+
+  if ((args == NULL) || !*((_Bool *)args))
+    return MNL_CB_OK;
 #ifdef HAVE_RTNL_LINK_STATS64
   mnl_attr_for_each(attr, nlh, sizeof(*ifm)) {
     if (mnl_attr_get_type(attr) != IFLA_STATS64)
@@ -366,7 +533,7 @@ static int link_filter_cb(const struct nlmsghdr *nlh,
     }
     stats.stats64 = mnl_attr_get_payload(attr);
 
-    check_ignorelist_and_submit64(dev, stats.stats64);
+    check_ignorelist_and_submit64(link, stats.stats64);
 
     return MNL_CB_OK;
   }
@@ -384,7 +551,7 @@ static int link_filter_cb(const struct nlmsghdr *nlh,
     }
     stats.stats32 = mnl_attr_get_payload(attr);
 
-    check_ignorelist_and_submit32(dev, stats.stats32);
+    check_ignorelist_and_submit32(link, stats.stats32);
 
     return MNL_CB_OK;
   }
@@ -394,6 +561,54 @@ static int link_filter_cb(const struct nlmsghdr *nlh,
 
 } /* int link_filter_cb */
 
+#if HAVE_IFLA_STATS_LINK_64
+/* Handles the RTM_NEWSTATS messages of a RTM_GETSTATS dump. Only the 64 bit
+ * link statistics are requested, so there is nothing else to parse. */
+static int stats_filter_cb(const struct nlmsghdr *nlh,
+                           void *args __attribute__((unused))) {
+  struct if_stats_msg *ifsm = mnl_nlmsg_get_payload(nlh);
+  struct nlattr *attr;
+  ir_link_t *link;
+
+  if (nlh->nlmsg_type != RTM_NEWSTATS) {
+    ERROR("netlink plugin: stats_filter_cb: Don't know how to handle type %i.",
+          nlh->nlmsg_type);
+    return MNL_CB_ERROR;
+  }
+
+  /* Links created since the events have been processed are picked up during
+   * the next read. */
+  link = ir_link_lookup((int)ifsm->ifindex);
+  if (link == NULL)
+    return MNL_CB_OK;
+
+  if ((link->collect[IR_TYPE_INTERFACE] == IR_COLLECT_NONE) &&
+      (link->collect[IR_TYPE_IF_DETAIL] == IR_COLLECT_NONE))
+    return MNL_CB_OK;
+
+  mnl_attr_for_each(attr, nlh, sizeof(*ifsm)) {
+    if (mnl_attr_get_type(attr) != IFLA_STATS_LINK_64)
+      continue;
+
+    if (mnl_attr_validate2(attr, MNL_TYPE_UNSPEC,
+                           sizeof(struct rtnl_link_stats64)) < 0) {
+      char errbuf[1024];
+      ERROR("netlink plugin: stats_filter_cb: IFLA_STATS_LINK_64 "
+            "mnl_attr_validate2 failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      return MNL_CB_ERROR;
+    }
+
+    check_ignorelist_and_submit64(link, mnl_attr_get_payload(attr));
+    return MNL_CB_OK;
+  }
+
+  DEBUG("netlink plugin: stats_filter_cb: No statistics for interface %s.",
+        link->name);
+  return MNL_CB_OK;
+} /* int stats_filter_cb */
+#endif /* HAVE_IFLA_STATS_LINK_64 */
+
 #if HAVE_TCA_STATS2
 static int qos_attr_cb(const struct nlattr *attr, void *data) {
   struct qos_stats *q_stats = (struct qos_stats *)data;
@@ -428,52 +643,55 @@ static int qos_attr_cb(const struct nlattr *attr, void *data) {
 } /* qos_attr_cb */
 #endif
 
+/* Handles qdisc, class and filter messages. `args' points to the interface
+ * index the dump was requested for, or zero for the qdisc dump, which covers
+ * all interfaces. */
 static int qos_filter_cb(const struct nlmsghdr *nlh, void *args) {
   struct tcmsg *tm = mnl_nlmsg_get_payload(nlh);
   struct nlattr *attr;
 
   int wanted_ifindex = *((int *)args);
 
+  ir_link_t *link;
   const char *dev;
   const char *kind = NULL;
 
   /* char *type_instance; */
+  int tc_type_index;
   const char *tc_type;
   char tc_inst[DATA_MAX_NAME_LEN];
 
   _Bool stats_submitted = 0;
 
-  if (nlh->nlmsg_type == RTM_NEWQDISC)
+  if (nlh->nlmsg_type == RTM_NEWQDISC) {
+    tc_type_index = IR_TYPE_QDISC;
     tc_type = "qdisc";
-  else if (nlh->nlmsg_type == RTM_NEWTCLASS)
+  } else if (nlh->nlmsg_type == RTM_NEWTCLASS) {
+    tc_type_index = IR_TYPE_CLASS;
     tc_type = "class";
-  else if (nlh->nlmsg_type == RTM_NEWTFILTER)
+  } else if (nlh->nlmsg_type == RTM_NEWTFILTER) {
+    tc_type_index = IR_TYPE_FILTER;
     tc_type = "filter";
-  else {
+  } else {
     ERROR("netlink plugin: qos_filter_cb: Don't know how to handle type %i.",
           nlh->nlmsg_type);
     return MNL_CB_ERROR;
   }
 
-  if (tm->tcm_ifindex != wanted_ifindex) {
+  if ((wanted_ifindex != 0) && (tm->tcm_ifindex != wanted_ifindex)) {
     DEBUG("netlink plugin: qos_filter_cb: Got %s for interface #%i, "
           "but expected #%i.",
           tc_type, tm->tcm_ifindex, wanted_ifindex);
     return MNL_CB_OK;
   }
 
-  if ((tm->tcm_ifindex >= 0) && ((size_t)tm->tcm_ifindex >= iflist_len)) {
-    ERROR("netlink plugin: qos_filter_cb: tm->tcm_ifindex = %i "
-          ">= iflist_len = %" PRIsz,
-          tm->tcm_ifindex, iflist_len);
-    return MNL_CB_ERROR;
-  }
-
-  dev = iflist[tm->tcm_ifindex];
-  if (dev == NULL) {
-    ERROR("netlink plugin: qos_filter_cb: iflist[%i] == NULL", tm->tcm_ifindex);
-    return MNL_CB_ERROR;
+  link = ir_link_lookup(tm->tcm_ifindex);
+  if (link == NULL) {
+    DEBUG("netlink plugin: qos_filter_cb: Unknown interface #%i.",
+          tm->tcm_ifindex);
+    return MNL_CB_OK;
   }
+  dev = link->name;
 
   mnl_attr_for_each(attr, nlh, sizeof(*tm)) {
     if (mnl_attr_get_type(attr) != TCA_KIND)
@@ -494,11 +712,19 @@ static int qos_filter_cb(const struct nlmsghdr *nlh, void *args) {
     return -1;
   }
 
+  /* Interfaces with only the "noqueue" qdisc have neither classes nor
+   * filters. This is the common case for virtual interfaces. */
+  if ((tc_type_index == IR_TYPE_QDISC) && (strcmp(kind, "noqueue") != 0))
+    link->has_qdisc = 1;
+
+  if (link->collect[tc_type_index] == IR_COLLECT_NONE)
+    return MNL_CB_OK;
+
   { /* The ID */
     uint32_t numberic_id;
 
     numberic_id = tm->tcm_handle;
-    if (strcmp(tc_type, "filter") == 0)
+    if (tc_type_index == IR_TYPE_FILTER)
       numberic_id = tm->tcm_parent;
 
     snprintf(tc_inst, sizeof(tc_inst), "%s-%x:%x", kind, numberic_id >> 16,
@@ -508,7 +734,8 @@ static int qos_filter_cb(const struct nlmsghdr *nlh, void *args) {
   DEBUG("netlink plugin: qos_filter_cb: got %s for %s (%i).", tc_type, dev,
         tm->tcm_ifindex);
 
-  if (check_ignorelist(dev, tc_type, tc_inst))
+  if ((link->collect[tc_type_index] == IR_COLLECT_CHECK) &&
+      check_ignorelist(dev, tc_type, tc_inst))
     return MNL_CB_OK;
 
 #if HAVE_TCA_STATS2
@@ -647,117 +874,343 @@ static int ir_config(const char *key, const char *value) {
   return status;
 } /* int ir_config */
 
-static int ir_init(void) {
-  nl = mnl_socket_open(NETLINK_ROUTE);
-  if (nl == NULL) {
-    ERROR("netlink plugin: ir_init: mnl_socket_open failed.");
-    return -1;
+typedef struct {
+  mnl_cb_t cb;
+  void *data;
+  _Bool failed;
+} ir_dump_ctx_t;
+
+/* Passes messages on to the actual callback. Failures are remembered rather
+ * than returned, so that the remainder of the dump is still read from the
+ * socket. */
+static int ir_dump_cb(const struct nlmsghdr *nlh, void *data) {
+  ir_dump_ctx_t *ctx = data;
+
+  if (ctx->cb(nlh, ctx->data) == MNL_CB_ERROR)
+    ctx->failed = 1;
+
+  return MNL_CB_OK;
+} /* int ir_dump_cb */
+
+/* Receives up to IR_BATCH_NUM datagrams with one system call. Returns the
+ * number of datagrams received, zero if `flags' contains MSG_DONTWAIT and
+ * nothing is pending, or -1 on error. */
+static int ir_recv(struct mnl_socket *sock, int flags) {
+  struct mmsghdr msgs[IR_BATCH_NUM];
+  struct iovec iov[IR_BATCH_NUM];
+  struct sockaddr_nl addr[IR_BATCH_NUM];
+  int status;
+
+  memset(msgs, 0, sizeof(msgs));
+  for (size_t i = 0; i < IR_BATCH_NUM; i++) {
+    iov[i].iov_base = ir_buffer + i * IR_BUFFER_SIZE;
+    iov[i].iov_len = IR_BUFFER_SIZE;
+    msgs[i].msg_hdr.msg_name = &addr[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(addr[i]);
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
   }
 
-  if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0) {
-    ERROR("netlink plugin: ir_init: mnl_socket_bind failed.");
+  status = recvmmsg(mnl_socket_get_fd(sock), msgs, IR_BATCH_NUM,
+                    flags | MSG_WAITFORONE, NULL);
+  if (status < 0) {
+    if ((flags & MSG_DONTWAIT) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+      return 0;
     return -1;
   }
 
-  return 0;
-} /* int ir_init */
+  for (int i = 0; i < status; i++) {
+    if (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      errno = ENOSPC;
+      return -1;
+    }
+    ir_buffer_len[i] = msgs[i].msg_len;
+  }
 
-static int ir_read(void) {
+  return status;
+} /* int ir_recv */
+
+/* Sends the dump request `nlh' and runs `cb' for all replies. Returns zero on
+ * success and -1 with errno set otherwise. */
+static int ir_dump(struct nlmsghdr *nlh, mnl_cb_t cb, void *data) {
+  ir_dump_ctx_t ctx = {.cb = cb, .data = data};
+  unsigned int portid = mnl_socket_get_portid(nl);
+  unsigned int seq = ++ir_seq;
+
+  nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  nlh->nlmsg_seq = seq;
+
+  if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0)
+    return -1;
+
+  while (1) {
+    int num = ir_recv(nl, /* flags = */ 0);
+    if (num < 0)
+      return -1;
+
+    for (int i = 0; i < num; i++) {
+      int ret = mnl_cb_run(ir_buffer + i * IR_BUFFER_SIZE, ir_buffer_len[i],
+                           seq, portid, ir_dump_cb, &ctx);
+      if (ret == MNL_CB_STOP) {
+        if (ctx.failed) {
+          errno = EPROTO;
+          return -1;
+        }
+        return 0;
+      }
+      /* Left over from an earlier dump that has been aborted. */
+      if ((ret < 0) && (errno == ESRCH))
+        continue;
+      if (ret < 0)
+        return -1;
+    }
+  }
+} /* int ir_dump */
+
+/* Dumps all links to rebuild the link table. The link statistics are
+ * submitted, too, if they can't be queried with RTM_GETSTATS. */
+static int ir_dump_links(_Bool submit) {
   char buf[MNL_SOCKET_BUFFER_SIZE];
   struct nlmsghdr *nlh;
   struct rtgenmsg *rt;
-  int ret;
-  unsigned int seq, portid;
-
-  static const int type_id[] = {RTM_GETQDISC, RTM_GETTCLASS, RTM_GETTFILTER};
-  static const char *type_name[] = {"qdisc", "class", "filter"};
-
-  portid = mnl_socket_get_portid(nl);
 
   nlh = mnl_nlmsg_put_header(buf);
   nlh->nlmsg_type = RTM_GETLINK;
-  nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
-  nlh->nlmsg_seq = seq = time(NULL);
   rt = mnl_nlmsg_put_extra_header(nlh, sizeof(*rt));
   rt->rtgen_family = AF_PACKET;
 
-  if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-    ERROR("netlink plugin: ir_read: rtnl_wilddump_request failed.");
+  ir_links_generation++;
+  if (ir_dump(nlh, link_filter_cb, &submit) != 0) {
+    char errbuf[1024];
+    ERROR("netlink plugin: ir_read: Dumping links failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
     return -1;
   }
 
-  ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-  while (ret > 0) {
-    ret = mnl_cb_run(buf, ret, seq, portid, link_filter_cb, NULL);
-    if (ret <= MNL_CB_STOP)
-      break;
-    ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-  }
-  if (ret < 0) {
+  ir_link_expire();
+  ir_links_resync = 0;
+  return 0;
+} /* int ir_dump_links */
+
+#if HAVE_IFLA_STATS_LINK_64
+static int ir_dump_stats(void) {
+  char buf[MNL_SOCKET_BUFFER_SIZE];
+  struct nlmsghdr *nlh;
+  struct if_stats_msg *ifsm;
+
+  nlh = mnl_nlmsg_put_header(buf);
+  nlh->nlmsg_type = RTM_GETSTATS;
+  ifsm = mnl_nlmsg_put_extra_header(nlh, sizeof(*ifsm));
+  ifsm->family = AF_UNSPEC;
+  ifsm->filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+
+  if (ir_dump(nlh, stats_filter_cb, NULL) != 0) {
     char errbuf[1024];
-    ERROR("netlink plugin: ir_read: mnl_socket_recvfrom failed: %s",
+
+    /* Linux < 4.7 */
+    if ((errno == EOPNOTSUPP) || (errno == EINVAL)) {
+      NOTICE("netlink plugin: RTM_GETSTATS is not supported, dumping all "
+             "link attributes instead.");
+      ir_have_getstats = 0;
+      return -1;
+    }
+
+    ERROR("netlink plugin: ir_read: Dumping link statistics failed: %s",
           sstrerror(errno, errbuf, sizeof(errbuf)));
-    return (-1);
+    return -1;
   }
 
-  /* `link_filter_cb' will update `iflist' which is used here to iterate
-   * over all interfaces. */
-  for (size_t ifindex = 1; ifindex < iflist_len; ifindex++) {
-    struct tcmsg *tm;
+  return 0;
+} /* int ir_dump_stats */
+#endif /* HAVE_IFLA_STATS_LINK_64 */
+
+static int ir_dump_tc(int type_index, int ifindex) {
+  static const int type_id[IR_TYPE_MAX] = {
+      [IR_TYPE_QDISC] = RTM_GETQDISC,
+      [IR_TYPE_CLASS] = RTM_GETTCLASS,
+      [IR_TYPE_FILTER] = RTM_GETTFILTER,
+  };
+  char buf[MNL_SOCKET_BUFFER_SIZE];
+  struct nlmsghdr *nlh;
+  struct tcmsg *tm;
 
-    if (iflist[ifindex] == NULL)
-      continue;
+  DEBUG("netlink plugin: ir_read: querying %s from interface #%i.",
+        ir_type_names[type_index], ifindex);
+
+  nlh = mnl_nlmsg_put_header(buf);
+  nlh->nlmsg_type = type_id[type_index];
+  tm = mnl_nlmsg_put_extra_header(nlh, sizeof(*tm));
+  tm->tcm_family = AF_PACKET;
+  tm->tcm_ifindex = ifindex;
+
+  if (ir_dump(nlh, qos_filter_cb, &ifindex) != 0) {
+    char errbuf[1024];
+    ERROR("netlink plugin: ir_read: Querying %s from interface #%i failed: %s",
+          ir_type_names[type_index], ifindex,
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    return -1;
+  }
 
-    for (size_t type_index = 0; type_index < STATIC_ARRAY_SIZE(type_id);
-         type_index++) {
-      if (check_ignorelist(iflist[ifindex], type_name[type_index], NULL)) {
-        DEBUG("netlink plugin: ir_read: check_ignorelist (%s, %s, (nil)) "
-              "== TRUE",
-              iflist[ifindex], type_name[type_index]);
+  return 0;
+} /* int ir_dump_tc */
+
+/* Applies pending RTNLGRP_LINK events to the link table. If events have been
+ * lost, the table is rebuilt from a link dump. */
+static void ir_process_events(void) {
+  while (1) {
+    int num = ir_recv(nl_events, MSG_DONTWAIT);
+    if (num == 0)
+      return;
+
+    if (num < 0) {
+      if (errno == ENOBUFS) {
+        DEBUG("netlink plugin: Link events have been lost.");
+        ir_links_resync = 1;
         continue;
       }
 
-      DEBUG("netlink plugin: ir_read: querying %s from %s (%" PRIsz ").",
-            type_name[type_index], iflist[ifindex], ifindex);
+      char errbuf[1024];
+      ERROR("netlink plugin: ir_read: Receiving link events failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      ir_links_resync = 1;
+      return;
+    }
 
-      nlh = mnl_nlmsg_put_header(buf);
-      nlh->nlmsg_type = type_id[type_index];
-      nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
-      nlh->nlmsg_seq = seq = time(NULL);
-      tm = mnl_nlmsg_put_extra_header(nlh, sizeof(*tm));
-      tm->tcm_family = AF_PACKET;
-      tm->tcm_ifindex = ifindex;
+    for (int i = 0; i < num; i++) {
+      if (mnl_cb_run(ir_buffer + i * IR_BUFFER_SIZE, ir_buffer_len[i],
+                     /* seq = */ 0, /* portid = */ 0, link_filter_cb,
+                     NULL) < 0)
+        ir_links_resync = 1;
+    }
+  }
+} /* void ir_process_events */
 
-      if (mnl_socket_sendto(nl, nlh, nlh->nlmsg_len) < 0) {
-        ERROR("netlink plugin: ir_read: mnl_socket_sendto failed.");
-        continue;
-      }
+static int ir_init(void) {
+  ir_buffer = malloc(IR_BUFFER_SIZE * IR_BATCH_NUM);
+  ir_links = c_avl_create(ir_link_compare);
+  if ((ir_buffer == NULL) || (ir_links == NULL)) {
+    ERROR("netlink plugin: ir_init: malloc failed.");
+    return -1;
+  }
+  ir_seq = (unsigned int)time(NULL);
 
-      ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-      while (ret > 0) {
-        ret = mnl_cb_run(buf, ret, seq, portid, qos_filter_cb, &ifindex);
-        if (ret <= MNL_CB_STOP)
-          break;
-        ret = mnl_socket_recvfrom(nl, buf, sizeof(buf));
-      }
-      if (ret < 0) {
-        char errbuf[1024];
-        ERROR("netlink plugin: ir_read: mnl_socket_recvfrom failed: %s",
-              sstrerror(errno, errbuf, sizeof(errbuf)));
-        continue;
-      }
-    } /* for (type_index) */
-  }   /* for (if_index) */
+  nl = mnl_socket_open(NETLINK_ROUTE);
+  if (nl == NULL) {
+    ERROR("netlink plugin: ir_init: mnl_socket_open failed.");
+    return -1;
+  }
+
+  if (mnl_socket_bind(nl, 0, MNL_SOCKET_AUTOPID) < 0) {
+    ERROR("netlink plugin: ir_init: mnl_socket_bind failed.");
+    return -1;
+  }
+
+  /* Subscribe before the first link dump, so that no changes are missed. */
+  nl_events = mnl_socket_open(NETLINK_ROUTE);
+  if ((nl_events == NULL) ||
+      (mnl_socket_bind(nl_events, RTMGRP_LINK, MNL_SOCKET_AUTOPID) < 0)) {
+    char errbuf[1024];
+    WARNING("netlink plugin: ir_init: Subscribing to link events failed: %s. "
+            "Links will be dumped on every read.",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+    if (nl_events != NULL) {
+      mnl_socket_close(nl_events);
+      nl_events = NULL;
+    }
+  } else {
+    /* Creating or removing a lot of interfaces at once otherwise overruns the
+     * socket, which is recovered from by a link dump. */
+    int rcvbuf = IR_BUFFER_SIZE * IR_BATCH_NUM;
+    setsockopt(mnl_socket_get_fd(nl_events), SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+               sizeof(rcvbuf));
+  }
+
+  return 0;
+} /* int ir_init */
+
+static int ir_read(void) {
+  _Bool want[IR_TYPE_MAX] = {0};
+  c_avl_iterator_t *iter;
+  ir_link_t *link;
+  int *ifindex;
+
+  if (nl_events != NULL)
+    ir_process_events();
+  else
+    ir_links_resync = 1;
+
+  if (ir_links_resync || !ir_have_getstats) {
+    if (ir_dump_links(/* submit = */ !ir_have_getstats) != 0)
+      return -1;
+  }
+
+  iter = c_avl_get_iterator(ir_links);
+  while (c_avl_iterator_next(iter, (void *)&ifindex, (void *)&link) == 0) {
+    for (int type = 0; type < IR_TYPE_MAX; type++)
+      if (link->collect[type] != IR_COLLECT_NONE)
+        want[type] = 1;
+  }
+  c_avl_iterator_destroy(iter);
+
+#if HAVE_IFLA_STATS_LINK_64
+  if (ir_have_getstats &&
+      (want[IR_TYPE_INTERFACE] || want[IR_TYPE_IF_DETAIL]) &&
+      (ir_dump_stats() != 0) && !ir_have_getstats)
+    ir_dump_links(/* submit = */ 1);
+#endif
+
+  if (!want[IR_TYPE_QDISC] && !want[IR_TYPE_CLASS] && !want[IR_TYPE_FILTER])
+    return 0;
+
+  /* A single qdisc dump covers all interfaces. It's also used to find the
+   * interfaces that may have classes and filters. */
+  iter = c_avl_get_iterator(ir_links);
+  while (c_avl_iterator_next(iter, (void *)&ifindex, (void *)&link) == 0)
+    link->has_qdisc = 0;
+  c_avl_iterator_destroy(iter);
+
+  _Bool qdisc_failed = (ir_dump_tc(IR_TYPE_QDISC, /* ifindex = */ 0) != 0);
+
+  iter = c_avl_get_iterator(ir_links);
+  while (c_avl_iterator_next(iter, (void *)&ifindex, (void *)&link) == 0) {
+    if (qdisc_failed)
+      link->has_qdisc = 1;
+    if (!link->has_qdisc)
+      continue;
+
+    if (link->collect[IR_TYPE_CLASS] != IR_COLLECT_NONE)
+      ir_dump_tc(IR_TYPE_CLASS, link->ifindex);
+    if (link->collect[IR_TYPE_FILTER] != IR_COLLECT_NONE)
+      ir_dump_tc(IR_TYPE_FILTER, link->ifindex);
+  }
+  c_avl_iterator_destroy(iter);
 
   return 0;
 } /* int ir_read */
 
 static int ir_shutdown(void) {
+  void *key;
+  void *value;
+
   if (nl) {
     mnl_socket_close(nl);
     nl = NULL;
   }
 
+  if (nl_events) {
+    mnl_socket_close(nl_events);
+    nl_events = NULL;
+  }
+
+  if (ir_links != NULL) {
+    while (c_avl_pick(ir_links, &key, &value) == 0)
+      sfree(value);
+    c_avl_destroy(ir_links);
+    ir_links = NULL;
+  }
+
+  sfree(ir_buffer);
+
   return 0;
 } /* int ir_shutdown */
 
@@ -29,9 +29,11 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
 #include "utils_fbhash.h"
+#include "utils_random.h"
 
 #include "network.h"
 
@@ -74,6 +76,10 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
 #endif
 #endif
 
+#if HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #ifndef IPV6_ADD_MEMBERSHIP
 #ifdef IPV6_JOIN_GROUP
 #define IPV6_ADD_MEMBERSHIP IPV6_JOIN_GROUP
@@ -92,6 +98,22 @@ GCRY_THREAD_OPTION_PTHREAD_IMPL;
  */
 #define BUFF_SIG_SIZE 106
 
+/*
+ * Compressed packets carry up to COMPRESS_MAX_RATIO times as much data as
+ * plain packets. Every value list in them is self-contained, i.e. it starts
+ * with its identifier (or a dictionary reference), time and interval, so the
+ * buffer can be split at any value list should the data not compress as well
+ * as expected.
+ *
+ * Identifiers are (re-)defined every DICT_REFRESH_INTERVALS intervals so that
+ * receivers that missed a definition recover eventually.
+ */
+#define COMPRESSED_HEADER_SIZE 8
+#define COMPRESS_MAX_RATIO 8
+#define DICT_MAX_SIZE 65536
+#define DICT_REFRESH_INTERVALS 10
+#define DICT_EXPIRE TIME_T_TO_CDTIME_T(3600)
+
 /*
  * Private data types
  */
@@ -113,6 +135,7 @@ struct sockent_client {
 #endif
   cdtime_t next_resolve_reconnect;
   cdtime_t resolve_interval;
+  _Bool compress;
 };
 
 struct sockent_server {
@@ -258,6 +281,38 @@ struct receive_list_entry_s {
 };
 typedef struct receive_list_entry_s receive_list_entry_t;
 
+/* Scope of a TYPE_IDENT_SET definition: IDs are only valid for parts received
+ * on the same socket, from the same user and with the same security level. */
+struct receive_dict_key_s {
+  uint64_t id;
+  sockent_t *se;
+  int security_level;
+  /* Empty if the part was neither signed nor encrypted. */
+  char *username;
+};
+typedef struct receive_dict_key_s receive_dict_key_t;
+
+/* Identifier defined by a TYPE_IDENT_SET part. Only accessed by the dispatch
+ * thread. */
+struct receive_dict_entry_s {
+  receive_dict_key_t key;
+  char host[DATA_MAX_NAME_LEN];
+  char plugin[DATA_MAX_NAME_LEN];
+  char plugin_instance[DATA_MAX_NAME_LEN];
+  char type[DATA_MAX_NAME_LEN];
+  char type_instance[DATA_MAX_NAME_LEN];
+  cdtime_t last_used;
+};
+typedef struct receive_dict_entry_s receive_dict_entry_t;
+
+#if HAVE_LIBZ
+struct send_dict_entry_s {
+  uint64_t id;
+  cdtime_t defined;
+};
+typedef struct send_dict_entry_s send_dict_entry_t;
+#endif
+
 /*
  * Private variables
  */
@@ -268,6 +323,8 @@ static _Bool network_config_forward = 0;
 static _Bool network_config_stats = 0;
 
 static sockent_t *sending_sockets = NULL;
+static size_t sending_plain_num = 0;
+static size_t sending_compressed_num = 0;
 
 static receive_list_entry_t *receive_list_head = NULL;
 static receive_list_entry_t *receive_list_tail = NULL;
@@ -287,6 +344,12 @@ static pthread_t receive_thread_id;
 static int dispatch_thread_running = 0;
 static pthread_t dispatch_thread_id;
 
+static c_avl_tree_t *receive_dict = NULL;
+#if HAVE_LIBZ
+static z_stream receive_zstream;
+static _Bool receive_zstream_init = 0;
+#endif
+
 /* Buffer in which to-be-sent network packets are constructed. */
 static char *send_buffer;
 static char *send_buffer_ptr;
@@ -295,6 +358,27 @@ static cdtime_t send_buffer_last_update;
 static value_list_t send_buffer_vl = VALUE_LIST_INIT;
 static pthread_mutex_t send_buffer_lock = PTHREAD_MUTEX_INITIALIZER;
 
+#if HAVE_LIBZ
+/* Buffer for servers with "Compress" enabled, protected by send_buffer_lock.
+ * compress_bounds holds the end offset of each value list. Once the buffer
+ * holds compress_target bytes, it is compressed into compress_packet. */
+static char *compress_buffer;
+static size_t compress_buffer_size;
+static size_t compress_buffer_fill;
+static size_t *compress_bounds;
+static size_t compress_bounds_num;
+static size_t compress_bounds_size;
+static size_t compress_target;
+static char *compress_packet;
+static size_t compress_packet_size;
+static z_stream compress_zstream;
+static _Bool compress_zstream_init = 0;
+
+static c_avl_tree_t *send_dict = NULL;
+static uint64_t send_dict_session;
+static uint64_t send_dict_next;
+#endif
+
 /* XXX: These counters are incremented from one place only. The spot in which
  * the values are incremented is either only reachable by one thread (the
  * dispatch thread, for example) or locked by some lock (send_buffer_lock for
@@ -965,10 +1049,185 @@ static int parse_part_string(void **ret_buffer, size_t *ret_buffer_len,
   return 0;
 } /* int parse_part_string */
 
-/* Forward declaration: parse_part_sign_sha256 and parse_part_encr_aes256 call
- * parse_packet and vice versa. */
+/* Flags of parse_packet(), describing how the parts have been received. */
 #define PP_SIGNED 0x01
 #define PP_ENCRYPTED 0x02
+#define PP_COMPRESSED 0x04
+
+static int network_dict_compare(const void *a, const void *b) /* {{{ */
+{
+  receive_dict_key_t const *key_a = a;
+  receive_dict_key_t const *key_b = b;
+
+  if (key_a->id != key_b->id)
+    return (key_a->id < key_b->id) ? -1 : 1;
+  if (key_a->se != key_b->se)
+    return ((uintptr_t)key_a->se < (uintptr_t)key_b->se) ? -1 : 1;
+  if (key_a->security_level != key_b->security_level)
+    return (key_a->security_level < key_b->security_level) ? -1 : 1;
+  return strcmp(key_a->username, key_b->username);
+} /* }}} int network_dict_compare */
+
+static void network_dict_entry_free(receive_dict_entry_t *entry) /* {{{ */
+{
+  if (entry == NULL)
+    return;
+
+  sfree(entry->key.username);
+  sfree(entry);
+} /* }}} void network_dict_entry_free */
+
+/* Removes the entries that have not been used for DICT_EXPIRE. If that does
+ * not free any space, removes the entries with security level
+ * `security_level' or lower, so that unsigned packets cannot displace the
+ * definitions of signed or encrypted ones. */
+static void network_dict_expire(int security_level) /* {{{ */
+{
+  cdtime_t now = cdtime();
+  int size = c_avl_size(receive_dict);
+  receive_dict_entry_t **expired = calloc(size, sizeof(*expired));
+  size_t expired_num = 0;
+  size_t evicted_num = 0;
+  c_avl_iterator_t *iter;
+  receive_dict_key_t *key;
+  receive_dict_entry_t *entry;
+
+  if (expired == NULL)
+    return;
+
+  iter = c_avl_get_iterator(receive_dict);
+  while (c_avl_iterator_next(iter, (void *)&key, (void *)&entry) == 0) {
+    if ((entry->last_used + DICT_EXPIRE) < now)
+      expired[expired_num++] = entry;
+  }
+  c_avl_iterator_destroy(iter);
+
+  if (expired_num == 0) {
+    iter = c_avl_get_iterator(receive_dict);
+    while (c_avl_iterator_next(iter, (void *)&key, (void *)&entry) == 0) {
+      if (entry->key.security_level <= security_level)
+        expired[evicted_num++] = entry;
+    }
+    c_avl_iterator_destroy(iter);
+  }
+
+  for (size_t i = 0; i < expired_num + evicted_num; i++) {
+    if (c_avl_remove(receive_dict, &expired[i]->key, (void *)&key,
+                     (void *)&entry) == 0)
+      network_dict_entry_free(entry);
+  }
+
+  DEBUG("network plugin: Expired %" PRIsz " and evicted %" PRIsz " of %i "
+        "identifier dictionary entries.",
+        expired_num, evicted_num, size);
+  sfree(expired);
+} /* }}} void network_dict_expire */
+
+static int network_dict_security_level(int flags) /* {{{ */
+{
+  if (flags & PP_ENCRYPTED)
+    return SECURITY_LEVEL_ENCRYPT;
+  else if (flags & PP_SIGNED)
+    return SECURITY_LEVEL_SIGN;
+  return SECURITY_LEVEL_NONE;
+} /* }}} int network_dict_security_level */
+
+static void network_dict_define(sockent_t *se, int flags, /* {{{ */
+                                const char *username, uint64_t id,
+                                const value_list_t *vl) {
+  receive_dict_key_t key = {
+      .id = id,
+      .se = se,
+      .security_level = network_dict_security_level(flags),
+      .username = (char *)((username != NULL) ? username : ""),
+  };
+  receive_dict_entry_t *entry = NULL;
+
+  if (receive_dict == NULL) {
+    receive_dict = c_avl_create(network_dict_compare);
+    if (receive_dict == NULL)
+      return;
+  }
+
+  if (c_avl_get(receive_dict, &key, (void *)&entry) != 0) {
+    if (c_avl_size(receive_dict) >= DICT_MAX_SIZE)
+      network_dict_expire(key.security_level);
+    /* Full of definitions with a higher security level: ignore this one. */
+    if (c_avl_size(receive_dict) >= DICT_MAX_SIZE)
+      return;
+
+    entry = calloc(1, sizeof(*entry));
+    if (entry == NULL)
+      return;
+    entry->key = key;
+    entry->key.username = strdup(key.username);
+    if (entry->key.username == NULL) {
+      sfree(entry);
+      return;
+    }
+
+    if (c_avl_insert(receive_dict, &entry->key, entry) != 0) {
+      network_dict_entry_free(entry);
+      return;
+    }
+  }
+
+  sstrncpy(entry->host, vl->host, sizeof(entry->host));
+  sstrncpy(entry->plugin, vl->plugin, sizeof(entry->plugin));
+  sstrncpy(entry->plugin_instance, vl->plugin_instance,
+           sizeof(entry->plugin_instance));
+  sstrncpy(entry->type, vl->type, sizeof(entry->type));
+  sstrncpy(entry->type_instance, vl->type_instance,
+           sizeof(entry->type_instance));
+  entry->last_used = cdtime();
+} /* }}} void network_dict_define */
+
+/* Copies the identifier `id' refers to into `vl'. IDs are only valid for
+ * parts with the same origin as the part that defined them, see
+ * receive_dict_key_t. */
+static int network_dict_lookup(sockent_t *se, int flags, /* {{{ */
+                               const char *username, uint64_t id,
+                               value_list_t *vl) {
+  receive_dict_key_t key = {
+      .id = id,
+      .se = se,
+      .security_level = network_dict_security_level(flags),
+      .username = (char *)((username != NULL) ? username : ""),
+  };
+  receive_dict_entry_t *entry = NULL;
+
+  if ((receive_dict == NULL) ||
+      (c_avl_get(receive_dict, &key, (void *)&entry) != 0))
+    return ENOENT;
+
+  sstrncpy(vl->host, entry->host, sizeof(vl->host));
+  sstrncpy(vl->plugin, entry->plugin, sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, entry->plugin_instance,
+           sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, entry->type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, entry->type_instance,
+           sizeof(vl->type_instance));
+  entry->last_used = cdtime();
+
+  return 0;
+} /* }}} int network_dict_lookup */
+
+static void network_dict_destroy(void) /* {{{ */
+{
+  receive_dict_key_t *key;
+  receive_dict_entry_t *entry;
+
+  if (receive_dict == NULL)
+    return;
+
+  while (c_avl_pick(receive_dict, (void *)&key, (void *)&entry) == 0)
+    network_dict_entry_free(entry);
+  c_avl_destroy(receive_dict);
+  receive_dict = NULL;
+} /* }}} void network_dict_destroy */
+
+/* Forward declaration: parse_part_sign_sha256 and parse_part_encr_aes256 call
+ * parse_packet and vice versa. */
 static int parse_packet(sockent_t *se, void *buffer, size_t buffer_size,
                         int flags, const char *username);
 
@@ -1310,6 +1569,107 @@ static int parse_part_encr_aes256(sockent_t *se, /* {{{ */
 
 #undef BUFFER_READ
 
+static int parse_part_compressed(sockent_t *se, /* {{{ */
+                                 void **ret_buffer, size_t *ret_buffer_len,
+                                 int flags, const char *username) {
+  char *buffer = *ret_buffer;
+  size_t buffer_len = *ret_buffer_len;
+
+  uint16_t tmp16;
+  uint16_t pkg_length;
+
+  if (buffer_len <= COMPRESSED_HEADER_SIZE) {
+    WARNING("network plugin: parse_part_compressed: "
+            "Packet too short: "
+            "Chunk of at least size %i expected, "
+            "but buffer has only %" PRIsz " bytes left.",
+            COMPRESSED_HEADER_SIZE + 1, buffer_len);
+    return -1;
+  }
+
+  memcpy(&tmp16, buffer + sizeof(uint16_t), sizeof(tmp16));
+  pkg_length = ntohs(tmp16);
+
+  if ((pkg_length > buffer_len) || (pkg_length <= COMPRESSED_HEADER_SIZE)) {
+    WARNING("network plugin: parse_part_compressed: "
+            "Invalid part length: %" PRIu16 " (buffer holds %" PRIsz
+            " bytes).",
+            pkg_length, buffer_len);
+    return -1;
+  }
+
+  /* Limit the amount of memory a single packet can expand to. */
+  if (flags & PP_COMPRESSED) {
+    WARNING("network plugin: parse_part_compressed: "
+            "Nested compressed parts are not allowed.");
+    return -1;
+  }
+
+#if HAVE_LIBZ
+  uint8_t algorithm;
+  uint16_t data_size;
+
+  memcpy(&algorithm, buffer + 2 * sizeof(uint16_t), sizeof(algorithm));
+  memcpy(&tmp16, buffer + 3 * sizeof(uint16_t), sizeof(tmp16));
+  data_size = ntohs(tmp16);
+
+  if (algorithm != COMPRESSED_ALGORITHM_ZLIB) {
+    DEBUG("network plugin: parse_part_compressed: "
+          "Unknown algorithm: %" PRIu8,
+          algorithm);
+  } else if (data_size > 0) {
+    char *data;
+    int status;
+
+    if (!receive_zstream_init) {
+      if (inflateInit(&receive_zstream) != Z_OK) {
+        ERROR("network plugin: inflateInit failed: %s",
+              (receive_zstream.msg != NULL) ? receive_zstream.msg : "?");
+        return -1;
+      }
+      receive_zstream_init = 1;
+    } else {
+      inflateReset(&receive_zstream);
+    }
+
+    data = malloc(data_size);
+    if (data == NULL) {
+      ERROR("network plugin: malloc failed.");
+      return -1;
+    }
+
+    receive_zstream.next_in = (Bytef *)buffer + COMPRESSED_HEADER_SIZE;
+    receive_zstream.avail_in = pkg_length - COMPRESSED_HEADER_SIZE;
+    receive_zstream.next_out = (Bytef *)data;
+    receive_zstream.avail_out = data_size;
+
+    status = inflate(&receive_zstream, Z_FINISH);
+    if ((status != Z_STREAM_END) || (receive_zstream.total_out != data_size)) {
+      WARNING("network plugin: parse_part_compressed: "
+              "Decompressing %" PRIu16 " bytes failed: %s",
+              data_size,
+              (receive_zstream.msg != NULL) ? receive_zstream.msg
+                                            : "size mismatch");
+      sfree(data);
+      return -1;
+    }
+
+    parse_packet(se, data, data_size, flags | PP_COMPRESSED, username);
+    sfree(data);
+  }
+#else
+  static c_complain_t complaint = C_COMPLAIN_INIT_STATIC;
+  c_complain_once(LOG_WARNING, &complaint,
+                  "network plugin: Ignoring compressed parts because zlib "
+                  "support is not available.");
+#endif
+
+  *ret_buffer = buffer + pkg_length;
+  *ret_buffer_len = buffer_len - pkg_length;
+
+  return 0;
+} /* }}} int parse_part_compressed */
+
 static int parse_packet(sockent_t *se, /* {{{ */
                         void *buffer, size_t buffer_size, int flags,
                         const char *username) {
@@ -1317,6 +1677,7 @@ static int parse_packet(sockent_t *se, /* {{{ */
 
   value_list_t vl = VALUE_LIST_INIT;
   notification_t n = {0};
+  _Bool ident_missing = 0;
 
 #if HAVE_GCRYPT_H
   int packet_was_signed = (flags & PP_SIGNED);
@@ -1397,9 +1758,35 @@ static int parse_packet(sockent_t *se, /* {{{ */
       if (status != 0)
         break;
 
-      network_dispatch_values(&vl, username);
+      /* The identifier referenced by the preceding TYPE_IDENT_USE part has
+       * not been defined (yet). */
+      if (ident_missing)
+        stats_values_not_dispatched++;
+      else
+        network_dispatch_values(&vl, username);
+      ident_missing = 0;
 
       sfree(vl.values);
+    } else if (pkg_type == TYPE_COMPRESSED) {
+      status = parse_part_compressed(se, &buffer, &buffer_size, flags,
+                                     username);
+      if (status != 0) {
+        ERROR("network plugin: Decompressing part failed "
+              "with status %i.",
+              status);
+        break;
+      }
+    } else if (pkg_type == TYPE_IDENT_SET) {
+      uint64_t tmp = 0;
+      status = parse_part_number(&buffer, &buffer_size, &tmp);
+      if (status == 0)
+        network_dict_define(se, flags, username, tmp, &vl);
+    } else if (pkg_type == TYPE_IDENT_USE) {
+      uint64_t tmp = 0;
+      status = parse_part_number(&buffer, &buffer_size, &tmp);
+      if (status == 0)
+        ident_missing =
+            (network_dict_lookup(se, flags, username, tmp, &vl) != 0);
     } else if (pkg_type == TYPE_TIME) {
       uint64_t tmp = 0;
       status = parse_part_number(&buffer, &buffer_size, &tmp);
@@ -2496,23 +2883,314 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
 #undef BUFFER_ADD
 #endif /* HAVE_GCRYPT_H */
 
+static void network_send_buffer_se(sockent_t *se, /* {{{ */
+                                   const char *buffer, size_t buffer_len) {
+#if HAVE_GCRYPT_H
+  if (se->data.client.security_level == SECURITY_LEVEL_ENCRYPT)
+    network_send_buffer_encrypted(se, buffer, buffer_len);
+  else if (se->data.client.security_level == SECURITY_LEVEL_SIGN)
+    network_send_buffer_signed(se, buffer, buffer_len);
+  else /* if (se->data.client.security_level == SECURITY_LEVEL_NONE) */
+#endif /* HAVE_GCRYPT_H */
+    network_send_buffer_plain(se, buffer, buffer_len);
+} /* }}} void network_send_buffer_se */
+
+/* Sends `buffer' to all servers that don't use compression. */
 static void network_send_buffer(char *buffer, size_t buffer_len) /* {{{ */
 {
   DEBUG("network plugin: network_send_buffer: buffer_len = %" PRIsz,
         buffer_len);
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
-#if HAVE_GCRYPT_H
-    if (se->data.client.security_level == SECURITY_LEVEL_ENCRYPT)
-      network_send_buffer_encrypted(se, buffer, buffer_len);
-    else if (se->data.client.security_level == SECURITY_LEVEL_SIGN)
-      network_send_buffer_signed(se, buffer, buffer_len);
-    else /* if (se->data.client.security_level == SECURITY_LEVEL_NONE) */
-#endif   /* HAVE_GCRYPT_H */
-      network_send_buffer_plain(se, buffer, buffer_len);
+    if (se->data.client.compress)
+      continue;
+    network_send_buffer_se(se, buffer, buffer_len);
   } /* for (sending_sockets) */
 } /* }}} void network_send_buffer */
 
+#if HAVE_LIBZ
+/* Compresses `buffer' into a TYPE_COMPRESSED part in `compress_packet'.
+ * Returns the size of the part or zero if it does not fit. Must be called
+ * with send_buffer_lock held. */
+static size_t network_compress(const char *buffer, /* {{{ */
+                               size_t buffer_len) {
+  uint16_t tmp16;
+  uint8_t tmp8;
+  size_t packet_len;
+  int status;
+
+  if (buffer_len > UINT16_MAX)
+    return 0;
+
+  deflateReset(&compress_zstream);
+  compress_zstream.next_in = (Bytef *)buffer;
+  compress_zstream.avail_in = (uInt)buffer_len;
+  compress_zstream.next_out = (Bytef *)compress_packet + COMPRESSED_HEADER_SIZE;
+  compress_zstream.avail_out =
+      (uInt)(compress_packet_size - COMPRESSED_HEADER_SIZE);
+
+  status = deflate(&compress_zstream, Z_FINISH);
+  if (status != Z_STREAM_END)
+    return 0;
+
+  packet_len = COMPRESSED_HEADER_SIZE + compress_zstream.total_out;
+
+  tmp16 = htons(TYPE_COMPRESSED);
+  memcpy(compress_packet, &tmp16, sizeof(tmp16));
+  tmp16 = htons((uint16_t)packet_len);
+  memcpy(compress_packet + 2, &tmp16, sizeof(tmp16));
+  tmp8 = COMPRESSED_ALGORITHM_ZLIB;
+  memcpy(compress_packet + 4, &tmp8, sizeof(tmp8));
+  tmp8 = 0;
+  memcpy(compress_packet + 5, &tmp8, sizeof(tmp8));
+  tmp16 = htons((uint16_t)buffer_len);
+  memcpy(compress_packet + 6, &tmp16, sizeof(tmp16));
+
+  return packet_len;
+} /* }}} size_t network_compress */
+
+/* Sends `compress_packet' to all servers that use compression. */
+static void network_send_compressed(size_t packet_len) /* {{{ */
+{
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
+    if (!se->data.client.compress)
+      continue;
+    network_send_buffer_se(se, compress_packet, packet_len);
+  }
+} /* }}} void network_send_compressed */
+
+/* Compresses and sends the value lists in `compress_buffer'. If `force' is
+ * false, only sends while the buffer holds at least `compress_target' bytes.
+ * If the data does not compress well enough to fit into a single packet, the
+ * value lists are split up, and the target is adjusted to the achieved
+ * compression ratio. Must be called with send_buffer_lock held. */
+static void compress_buffer_flush(_Bool force) /* {{{ */
+{
+  while ((compress_bounds_num > 0) &&
+         (force || (compress_buffer_fill >= compress_target))) {
+    size_t n = compress_bounds_num;
+    size_t data_len;
+    size_t packet_len;
+
+    while (42) {
+      data_len = compress_bounds[n - 1];
+      packet_len = network_compress(compress_buffer, data_len);
+      if ((packet_len > 0) || (n == 1))
+        break;
+      n = (n + 1) / 2;
+    }
+
+    if (packet_len == 0) {
+      ERROR("network plugin: Value list of %" PRIsz " bytes does not fit "
+            "into a packet, even when compressed.",
+            data_len);
+    } else {
+      uint64_t target = ((uint64_t)data_len) * compress_packet_size /
+                        packet_len * 9 / 10;
+
+      DEBUG("network plugin: compress_buffer_flush: %" PRIsz " value lists, "
+            "%" PRIsz " -> %" PRIsz " bytes",
+            n, data_len, packet_len);
+      network_send_compressed(packet_len);
+
+      stats_octets_tx += ((uint64_t)packet_len);
+      stats_packets_tx++;
+
+      if (target < compress_packet_size)
+        target = compress_packet_size;
+      if (target > compress_buffer_size)
+        target = compress_buffer_size;
+      compress_target = (size_t)target;
+    }
+
+    memmove(compress_buffer, compress_buffer + data_len,
+            compress_buffer_fill - data_len);
+    compress_buffer_fill -= data_len;
+    for (size_t i = n; i < compress_bounds_num; i++)
+      compress_bounds[i - n] = compress_bounds[i] - data_len;
+    compress_bounds_num -= n;
+  }
+} /* }}} void compress_buffer_flush */
+
+static void send_dict_reset(void) /* {{{ */
+{
+  char *key;
+  send_dict_entry_t *entry;
+
+  while (c_avl_pick(send_dict, (void *)&key, (void *)&entry) == 0) {
+    sfree(key);
+    sfree(entry);
+  }
+
+  /* Receivers may still know IDs of the previous session. */
+  send_dict_session = ((uint64_t)cdrand_u()) << 32;
+  send_dict_next = 0;
+} /* }}} void send_dict_reset */
+
+/* Appends a self-contained value list to `buffer', referencing the identifier
+ * by ID when it has been defined recently enough. Returns the number of bytes
+ * written or -1 if `buffer' is too small. */
+static int compress_encode(char *buffer, size_t buffer_size, /* {{{ */
+                           const data_set_t *ds, const value_list_t *vl) {
+  char *buffer_orig = buffer;
+  char name[6 * DATA_MAX_NAME_LEN];
+  send_dict_entry_t *entry = NULL;
+  _Bool define;
+
+  FORMAT_VL(name, sizeof(name), vl);
+
+  if (c_avl_get(send_dict, name, (void *)&entry) != 0) {
+    entry = NULL;
+    if (c_avl_size(send_dict) >= DICT_MAX_SIZE)
+      send_dict_reset();
+  }
+  define = (entry == NULL) ||
+           ((entry->defined + DICT_REFRESH_INTERVALS * vl->interval) <=
+            vl->time);
+
+  if (!define) {
+    if (write_part_number(&buffer, &buffer_size, TYPE_IDENT_USE, entry->id))
+      return -1;
+  } else {
+    uint64_t id = (entry != NULL) ? entry->id : (send_dict_session |
+                                                 send_dict_next);
+
+    if ((write_part_string(&buffer, &buffer_size, TYPE_HOST, vl->host,
+                           strlen(vl->host)) != 0) ||
+        (write_part_string(&buffer, &buffer_size, TYPE_PLUGIN, vl->plugin,
+                           strlen(vl->plugin)) != 0) ||
+        (write_part_string(&buffer, &buffer_size, TYPE_PLUGIN_INSTANCE,
+                           vl->plugin_instance,
+                           strlen(vl->plugin_instance)) != 0) ||
+        (write_part_string(&buffer, &buffer_size, TYPE_TYPE, vl->type,
+                           strlen(vl->type)) != 0) ||
+        (write_part_string(&buffer, &buffer_size, TYPE_TYPE_INSTANCE,
+                           vl->type_instance,
+                           strlen(vl->type_instance)) != 0) ||
+        (write_part_number(&buffer, &buffer_size, TYPE_IDENT_SET, id) != 0))
+      return -1;
+  }
+
+  if ((write_part_number(&buffer, &buffer_size, TYPE_TIME_HR,
+                         (uint64_t)vl->time) != 0) ||
+      (write_part_number(&buffer, &buffer_size, TYPE_INTERVAL_HR,
+                         (uint64_t)vl->interval) != 0) ||
+      (write_part_values(&buffer, &buffer_size, ds, vl) != 0))
+    return -1;
+
+  if (define && (entry != NULL)) {
+    entry->defined = vl->time;
+  } else if (define) {
+    char *key = strdup(name);
+
+    entry = calloc(1, sizeof(*entry));
+    if ((key == NULL) || (entry == NULL)) {
+      sfree(key);
+      sfree(entry);
+    } else {
+      entry->id = send_dict_session | send_dict_next;
+      entry->defined = vl->time;
+      if (c_avl_insert(send_dict, key, entry) != 0) {
+        sfree(key);
+        sfree(entry);
+      }
+    }
+    send_dict_next++;
+  }
+
+  return buffer - buffer_orig;
+} /* }}} int compress_encode */
+
+/* Must be called with send_buffer_lock held. */
+static int compress_buffer_add(const data_set_t *ds, /* {{{ */
+                               const value_list_t *vl) {
+  int status;
+
+  if (compress_bounds_num >= compress_bounds_size) {
+    size_t *tmp = realloc(compress_bounds,
+                          2 * compress_bounds_size * sizeof(*compress_bounds));
+    if (tmp == NULL) {
+      ERROR("network plugin: realloc failed.");
+      return -1;
+    }
+    compress_bounds = tmp;
+    compress_bounds_size *= 2;
+  }
+
+  status = compress_encode(compress_buffer + compress_buffer_fill,
+                           compress_buffer_size - compress_buffer_fill, ds, vl);
+  if (status < 0) {
+    compress_buffer_flush(/* force = */ 1);
+    status = compress_encode(compress_buffer, compress_buffer_size, ds, vl);
+  }
+  if (status < 0) {
+    ERROR("network plugin: Unable to append to the compression buffer.");
+    return -1;
+  }
+
+  compress_buffer_fill += (size_t)status;
+  compress_bounds[compress_bounds_num] = compress_buffer_fill;
+  compress_bounds_num++;
+
+  compress_buffer_flush(/* force = */ 0);
+  return 0;
+} /* }}} int compress_buffer_add */
+
+static int compress_init(void) /* {{{ */
+{
+  compress_packet_size = network_config_packet_size - BUFF_SIG_SIZE;
+  compress_buffer_size = COMPRESS_MAX_RATIO * compress_packet_size;
+  if (compress_buffer_size > UINT16_MAX)
+    compress_buffer_size = UINT16_MAX;
+  compress_buffer_fill = 0;
+  compress_target = 2 * compress_packet_size;
+
+  compress_bounds_size = 64;
+  compress_bounds_num = 0;
+
+  compress_buffer = malloc(compress_buffer_size);
+  compress_packet = malloc(compress_packet_size);
+  compress_bounds = calloc(compress_bounds_size, sizeof(*compress_bounds));
+  send_dict = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if ((compress_buffer == NULL) || (compress_packet == NULL) ||
+      (compress_bounds == NULL) || (send_dict == NULL)) {
+    ERROR("network plugin: compress_init: Allocating memory failed.");
+    return -1;
+  }
+  send_dict_reset();
+
+  memset(&compress_zstream, 0, sizeof(compress_zstream));
+  if (deflateInit(&compress_zstream, Z_DEFAULT_COMPRESSION) != Z_OK) {
+    ERROR("network plugin: deflateInit failed: %s",
+          (compress_zstream.msg != NULL) ? compress_zstream.msg : "?");
+    return -1;
+  }
+  compress_zstream_init = 1;
+
+  return 0;
+} /* }}} int compress_init */
+
+static void compress_shutdown(void) /* {{{ */
+{
+  if (compress_zstream_init) {
+    if (compress_buffer_fill > 0)
+      compress_buffer_flush(/* force = */ 1);
+    deflateEnd(&compress_zstream);
+    compress_zstream_init = 0;
+  }
+
+  if (send_dict != NULL) {
+    send_dict_reset();
+    c_avl_destroy(send_dict);
+    send_dict = NULL;
+  }
+
+  sfree(compress_buffer);
+  sfree(compress_packet);
+  sfree(compress_bounds);
+} /* }}} void compress_shutdown */
+#endif /* HAVE_LIBZ */
+
 static int add_to_buffer(char *buffer, size_t buffer_size, /* {{{ */
                          value_list_t *vl_def, const data_set_t *ds,
                          const value_list_t *vl) {
@@ -2588,9 +3266,47 @@ static void flush_buffer(void) {
   network_init_buffer();
 }
 
+/* Must be called with send_buffer_lock held. */
+static int network_write_plain(const data_set_t *ds, /* {{{ */
+                               const value_list_t *vl) {
+  int status;
+
+  status = add_to_buffer(send_buffer_ptr,
+                         network_config_packet_size -
+                             (send_buffer_fill + BUFF_SIG_SIZE),
+                         &send_buffer_vl, ds, vl);
+  if (status >= 0) {
+    /* status == bytes added to the buffer */
+    send_buffer_fill += status;
+    send_buffer_ptr += status;
+  } else {
+    flush_buffer();
+
+    status = add_to_buffer(send_buffer_ptr,
+                           network_config_packet_size -
+                               (send_buffer_fill + BUFF_SIG_SIZE),
+                           &send_buffer_vl, ds, vl);
+
+    if (status >= 0) {
+      send_buffer_fill += status;
+      send_buffer_ptr += status;
+    }
+  }
+
+  if (status < 0) {
+    ERROR("network plugin: Unable to append to the "
+          "buffer for some weird reason");
+    return -1;
+  } else if ((network_config_packet_size - send_buffer_fill) < 15) {
+    flush_buffer();
+  }
+
+  return 0;
+} /* }}} int network_write_plain */
+
 static int network_write(const data_set_t *ds, const value_list_t *vl,
                          user_data_t __attribute__((unused)) * user_data) {
-  int status;
+  int status = 0;
 
   /* listen_loop is set to non-zero in the shutdown callback, which is
    * guaranteed to be called *after* all the write threads have been shut
@@ -2618,43 +3334,21 @@ static int network_write(const data_set_t *ds, const value_list_t *vl,
 
   pthread_mutex_lock(&send_buffer_lock);
 
-  status = add_to_buffer(send_buffer_ptr,
-                         network_config_packet_size -
-                             (send_buffer_fill + BUFF_SIG_SIZE),
-                         &send_buffer_vl, ds, vl);
-  if (status >= 0) {
-    /* status == bytes added to the buffer */
-    send_buffer_fill += status;
-    send_buffer_ptr += status;
-    send_buffer_last_update = cdtime();
+  if (sending_plain_num > 0)
+    status = network_write_plain(ds, vl);
+#if HAVE_LIBZ
+  if ((status == 0) && (sending_compressed_num > 0))
+    status = compress_buffer_add(ds, vl);
+#endif
 
+  if (status == 0) {
+    send_buffer_last_update = cdtime();
     stats_values_sent++;
-  } else {
-    flush_buffer();
-
-    status = add_to_buffer(send_buffer_ptr,
-                           network_config_packet_size -
-                               (send_buffer_fill + BUFF_SIG_SIZE),
-                           &send_buffer_vl, ds, vl);
-
-    if (status >= 0) {
-      send_buffer_fill += status;
-      send_buffer_ptr += status;
-
-      stats_values_sent++;
-    }
-  }
-
-  if (status < 0) {
-    ERROR("network plugin: Unable to append to the "
-          "buffer for some weird reason");
-  } else if ((network_config_packet_size - send_buffer_fill) < 15) {
-    flush_buffer();
   }
 
   pthread_mutex_unlock(&send_buffer_lock);
 
-  return (status < 0) ? -1 : 0;
+  return status;
 } /* int network_write */
 
 static int network_config_set_ttl(const oconfig_item_t *ci) /* {{{ */
@@ -2845,7 +3539,14 @@ static int network_config_add_server(const oconfig_item_t *ci) /* {{{ */
       network_config_set_interface(child, &se->interface);
     else if (strcasecmp("ResolveInterval", child->key) == 0)
       cf_util_get_cdtime(child, &se->data.client.resolve_interval);
-    else {
+    else if (strcasecmp("Compress", child->key) == 0) {
+#if HAVE_LIBZ
+      cf_util_get_boolean(child, &se->data.client.compress);
+#else
+      WARNING("network plugin: The `Compress' option requires zlib support, "
+              "which is not available.");
+#endif
+    } else {
       WARNING("network plugin: Option `%s' is not allowed here.", child->key);
     }
   }
@@ -2980,6 +3681,26 @@ static int network_notification(const notification_t *n,
 
   network_send_buffer(buffer, sizeof(buffer) - buffer_free);
 
+#if HAVE_LIBZ
+  /* Notifications are rare, so they are compressed on their own. If that
+   * does not save enough space, send them uncompressed. */
+  if (sending_compressed_num > 0) {
+    size_t packet_len;
+
+    pthread_mutex_lock(&send_buffer_lock);
+    packet_len = network_compress(buffer, sizeof(buffer) - buffer_free);
+    if (packet_len > 0)
+      network_send_compressed(packet_len);
+    pthread_mutex_unlock(&send_buffer_lock);
+
+    if (packet_len == 0) {
+      for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
+        if (se->data.client.compress)
+          network_send_buffer_se(se, buffer, sizeof(buffer) - buffer_free);
+    }
+  }
+#endif
+
   return 0;
 } /* int network_notification */
 
@@ -3006,11 +3727,21 @@ static int network_shutdown(void) {
   }
 
   sockent_destroy(listen_sockets);
+  network_dict_destroy();
+#if HAVE_LIBZ
+  if (receive_zstream_init) {
+    inflateEnd(&receive_zstream);
+    receive_zstream_init = 0;
+  }
+#endif
 
   if (send_buffer_fill > 0)
     flush_buffer();
 
   sfree(send_buffer);
+#if HAVE_LIBZ
+  compress_shutdown();
+#endif
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next)
     sockent_client_disconnect(se);
@@ -3116,6 +3847,18 @@ static int network_init(void) {
   }
   network_init_buffer();
 
+  for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
+    if (se->data.client.compress)
+      sending_compressed_num++;
+    else
+      sending_plain_num++;
+  }
+
+#if HAVE_LIBZ
+  if ((sending_compressed_num > 0) && (compress_init() != 0))
+    return -1;
+#endif
+
   /* setup socket(s) and so on */
   if (sending_sockets != NULL) {
     plugin_register_write("network", network_write,
@@ -3168,16 +3911,17 @@ static int network_flush(cdtime_t timeout,
                          __attribute__((unused)) user_data_t *user_data) {
   pthread_mutex_lock(&send_buffer_lock);
 
-  if (send_buffer_fill > 0) {
-    if (timeout > 0) {
-      cdtime_t now = cdtime();
-      if ((send_buffer_last_update + timeout) > now) {
-        pthread_mutex_unlock(&send_buffer_lock);
-        return 0;
-      }
-    }
-    flush_buffer();
+  if ((timeout > 0) && ((send_buffer_last_update + timeout) > cdtime())) {
+    pthread_mutex_unlock(&send_buffer_lock);
+    return 0;
   }
+
+  if (send_buffer_fill > 0)
+    flush_buffer();
+#if HAVE_LIBZ
+  if (compress_buffer_fill > 0)
+    compress_buffer_flush(/* force = */ 1);
+#endif
   pthread_mutex_unlock(&send_buffer_lock);
 
   return 0;
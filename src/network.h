@@ -70,6 +70,13 @@
 #define TYPE_INTERVAL 0x0007
 #define TYPE_INTERVAL_HR 0x0009
 
+/* Identifier dictionary: TYPE_IDENT_SET binds the current host, plugin,
+ * plugin instance, type and type instance to a 64 bit ID, TYPE_IDENT_USE
+ * loads them back. Both are number parts. Senders only emit them inside
+ * TYPE_COMPRESSED parts. */
+#define TYPE_IDENT_SET 0x0010
+#define TYPE_IDENT_USE 0x0011
+
 /* Types to transmit notifications */
 #define TYPE_MESSAGE 0x0100
 #define TYPE_SEVERITY 0x0101
@@ -77,4 +84,9 @@
 #define TYPE_SIGN_SHA256 0x0200
 #define TYPE_ENCR_AES256 0x0210
 
+/* A sequence of parts, compressed. The payload starts with the algorithm
+ * (uint8_t), a reserved byte and the uncompressed size (uint16_t). */
+#define TYPE_COMPRESSED 0x0220
+#define COMPRESSED_ALGORITHM_ZLIB 1
+
 #endif /* NETWORK_H */
@@ -77,8 +77,9 @@
 #define PLUGIN_NOTIF 5
 #define PLUGIN_FLUSH 6
 #define PLUGIN_FLUSH_ALL 7 /* For collectd-5.6 only */
+#define PLUGIN_WRITE_BATCH 8
 
-#define PLUGIN_TYPES 8
+#define PLUGIN_TYPES 9
 
 #define PLUGIN_CONFIG 254
 #define PLUGIN_DATASET 255
@@ -104,6 +105,7 @@ void boot_DynaLoader(PerlInterpreter *, CV *);
 
 static XS(Collectd_plugin_register_read);
 static XS(Collectd_plugin_register_write);
+static XS(Collectd_plugin_register_write_batch);
 static XS(Collectd_plugin_register_log);
 static XS(Collectd_plugin_register_notification);
 static XS(Collectd_plugin_register_flush);
@@ -126,6 +128,11 @@ static XS(Collectd_call_by_name);
 static int perl_read(user_data_t *ud);
 static int perl_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *user_data);
+static int perl_write_batch(const data_set_t *ds, const value_list_t *vl,
+                            user_data_t *user_data);
+static int perl_write_batch_flush(cdtime_t timeout, const char *identifier,
+                                  user_data_t *user_data);
+static void pwrite_batch_free(void *arg);
 static void perl_log(int level, const char *msg, user_data_t *user_data);
 static int perl_notify(const notification_t *notif, user_data_t *user_data);
 static int perl_flush(cdtime_t timeout, const char *identifier,
@@ -136,30 +143,62 @@ static int perl_flush(cdtime_t timeout, const char *identifier,
  */
 
 typedef struct c_ithread_s {
-  /* the thread's Perl interpreter */
+  /* the Perl interpreter */
   PerlInterpreter *interp;
-  _Bool running; /* thread is inside Perl interpreter */
-  _Bool shutdown;
-  pthread_t pthread;
+  /* number of nested calls of the thread using the interpreter, zero if
+   * the interpreter is idle */
+  int running;
+  /* context of the thread before it acquired the interpreter */
+  PerlInterpreter *prev_context;
 
-  /* double linked list of threads */
+  /* double linked list of interpreters */
   struct c_ithread_s *prev;
   struct c_ithread_s *next;
+
+  /* list of idle interpreters */
+  struct c_ithread_s *next_idle;
 } c_ithread_t;
 
 typedef struct {
   c_ithread_t *head;
   c_ithread_t *tail;
+  c_ithread_t *idle;
 
 #if COLLECT_DEBUG
   /* some usage stats */
   int number_of_threads;
 #endif /* COLLECT_DEBUG */
 
+  /* set once the pool has been created; the "base" interpreter is then only
+   * used for shutting down */
+  _Bool pool_ready;
+  _Bool shutdown;
+
+  /* number of interpreters in use and of threads waiting for one */
+  int busy;
+  int waiting;
+
   pthread_mutex_t mutex;
   pthread_mutexattr_t mutexattr;
+  pthread_cond_t cond;
 } c_ithread_list_t;
 
+/* value lists queued for a TYPE_WRITE_BATCH callback */
+typedef struct pwrite_batch_s {
+  char *sub_name;
+  value_list_t *vls;
+  size_t vls_num;
+  size_t vls_size;
+  cdtime_t first_time;
+  pthread_mutex_t lock;
+
+  /* number of callbacks (write and flush) using the batch, protected by
+   * perl_write_batches_lock */
+  int refs;
+  /* list of all batches, used to deliver pending values on shutdown */
+  struct pwrite_batch_s *next;
+} pwrite_batch_t;
+
 /* name / user_data for Perl matches / targets */
 typedef struct {
   char *name;
@@ -185,11 +224,19 @@ extern char **environ;
 
 static _Bool register_legacy_flush = 1;
 
+/* number of interpreters cloned from the "base" interpreter */
+static int perl_interpreters = 4;
+/* maximum number of value lists passed to a TYPE_WRITE_BATCH callback */
+static int perl_write_batch_size = 64;
+
+static pwrite_batch_t *perl_write_batches = NULL;
+static pthread_mutex_t perl_write_batches_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* if perl_threads != NULL perl_threads->head must
- * point to the "base" thread */
+ * point to the "base" interpreter */
 static c_ithread_list_t *perl_threads = NULL;
 
-/* the key used to store each pthread's ithread */
+/* the key used to store the ithread a pthread is currently using */
 static pthread_key_t perl_thr_key;
 
 static int perl_argc = 0;
@@ -203,6 +250,8 @@ static struct {
 } api[] = {
     {"Collectd::plugin_register_read", Collectd_plugin_register_read},
     {"Collectd::plugin_register_write", Collectd_plugin_register_write},
+    {"Collectd::plugin_register_write_batch",
+     Collectd_plugin_register_write_batch},
     {"Collectd::plugin_register_log", Collectd_plugin_register_log},
     {"Collectd::plugin_register_notification",
      Collectd_plugin_register_notification},
@@ -232,6 +281,7 @@ struct {
 } constants[] = {{"Collectd::TYPE_INIT", PLUGIN_INIT},
                  {"Collectd::TYPE_READ", PLUGIN_READ},
                  {"Collectd::TYPE_WRITE", PLUGIN_WRITE},
+                 {"Collectd::TYPE_WRITE_BATCH", PLUGIN_WRITE_BATCH},
                  {"Collectd::TYPE_SHUTDOWN", PLUGIN_SHUTDOWN},
                  {"Collectd::TYPE_LOG", PLUGIN_LOG},
                  {"Collectd::TYPE_NOTIF", PLUGIN_NOTIF},
@@ -977,31 +1027,6 @@ static int pplugin_dispatch_notification(pTHX_ HV *notif) {
   return ret;
 } /* static int pplugin_dispatch_notification (HV *) */
 
-/*
- * Call perl sub with thread locking flags handled.
- */
-static int call_pv_locked(pTHX_ const char *sub_name) {
-  _Bool old_running;
-  int ret;
-
-  c_ithread_t *t = (c_ithread_t *)pthread_getspecific(perl_thr_key);
-  if (t == NULL) /* thread destroyed */
-    return 0;
-
-  old_running = t->running;
-  t->running = 1;
-
-  if (t->shutdown) {
-    t->running = old_running;
-    return 0;
-  }
-
-  ret = call_pv(sub_name, G_SCALAR | G_EVAL);
-
-  t->running = old_running;
-  return ret;
-} /* static int call_pv_locked (pTHX, *sub_name) */
-
 /*
  * Call all working functions of the given type.
  */
@@ -1079,6 +1104,82 @@ static int pplugin_call(pTHX_ int type, ...) {
     XPUSHs(sv_2mortal(newSVpv(ds->type, 0)));
     XPUSHs(sv_2mortal(newRV_noinc((SV *)pds)));
     XPUSHs(sv_2mortal(newRV_noinc((SV *)pvl)));
+  } else if (PLUGIN_WRITE_BATCH == type) {
+    value_list_t *vls;
+    size_t vls_num;
+
+    AV *batch = newAV();
+    const data_set_t *ds = NULL;
+    SV *ptype = NULL;
+    SV *pds = NULL;
+
+    subname = va_arg(ap, char *);
+    /*
+     * $_[0] =
+     * [
+     *   [ $type, $data_set, $value_list ],
+     *   ...
+     * ];
+     *
+     * Consecutive value lists of the same type share the data-set.
+     */
+    vls = va_arg(ap, value_list_t *);
+    vls_num = va_arg(ap, size_t);
+
+    av_extend(batch, vls_num - 1);
+
+    for (size_t i = 0; i < vls_num; ++i) {
+      const data_set_t *vl_ds = plugin_get_ds(vls[i].type);
+      AV *entry;
+      HV *pvl;
+
+      /* the data-set has been unregistered in the meantime */
+      if ((NULL == vl_ds) || (vl_ds->ds_num != vls[i].values_len)) {
+        ret = -1;
+        continue;
+      }
+
+      if (vl_ds != ds) {
+        AV *tmp = newAV();
+
+        if (NULL != pds) {
+          SvREFCNT_dec(pds);
+          SvREFCNT_dec(ptype);
+        }
+
+        if (-1 == data_set2av(aTHX_(data_set_t *) vl_ds, tmp)) {
+          av_clear(tmp);
+          av_undef(tmp);
+          pds = newSV(0);
+          ret = -1;
+        } else {
+          pds = newRV_noinc((SV *)tmp);
+        }
+        ptype = newSVpv(vl_ds->type, 0);
+        ds = vl_ds;
+      }
+
+      pvl = newHV();
+      if (-1 == value_list2hv(aTHX_ vls + i, (data_set_t *)ds, pvl)) {
+        hv_clear(pvl);
+        hv_undef(pvl);
+        ret = -1;
+        continue;
+      }
+
+      entry = newAV();
+      av_push(entry, newSVsv(ptype));
+      av_push(entry, newSVsv(pds));
+      av_push(entry, newRV_noinc((SV *)pvl));
+      av_push(batch, newRV_noinc((SV *)entry));
+    }
+
+    if (NULL != pds) {
+      SvREFCNT_dec(pds);
+      SvREFCNT_dec(ptype);
+    }
+
+    XPUSHs(sv_2mortal(newRV_noinc((SV *)batch)));
   } else if (PLUGIN_LOG == type) {
     subname = va_arg(ap, char *);
     /*
@@ -1152,7 +1253,7 @@ static int pplugin_call(pTHX_ int type, ...) {
 
   PUTBACK;
 
-  retvals = call_pv_locked(aTHX_ subname);
+  retvals = call_pv(subname, G_SCALAR | G_EVAL);
 
   SPAGAIN;
   if (SvTRUE(ERRSV)) {
@@ -1185,12 +1286,8 @@ static void c_ithread_destroy(c_ithread_t *ithread) {
 
   assert(NULL != perl_threads);
 
-  PERL_SET_CONTEXT(aTHX);
-  /* Mark as running to avoid deadlock:
-     c_ithread_destroy -> log_debug -> perl_log()
-  */
-  ithread->running = 1;
   log_debug("Shutting down Perl interpreter %p...", aTHX);
+  PERL_SET_CONTEXT(aTHX);
 
 #if COLLECT_DEBUG
   sv_report_used();
@@ -1215,31 +1312,6 @@ static void c_ithread_destroy(c_ithread_t *ithread) {
   return;
 } /* static void c_ithread_destroy (c_ithread_t *) */
 
-static void c_ithread_destructor(void *arg) {
-  c_ithread_t *ithread = (c_ithread_t *)arg;
-  c_ithread_t *t = NULL;
-
-  if (NULL == perl_threads)
-    return;
-
-  pthread_mutex_lock(&perl_threads->mutex);
-
-  for (t = perl_threads->head; NULL != t; t = t->next)
-    if (t == ithread)
-      break;
-
-  /* the ithread no longer exists */
-  if (NULL == t) {
-    pthread_mutex_unlock(&perl_threads->mutex);
-    return;
-  }
-
-  c_ithread_destroy(ithread);
-
-  pthread_mutex_unlock(&perl_threads->mutex);
-  return;
-} /* static void c_ithread_destructor (void *) */
-
 /* must be called with perl_threads->mutex locked */
 static c_ithread_t *c_ithread_create(PerlInterpreter *base) {
   c_ithread_t *t = NULL;
@@ -1254,10 +1326,18 @@ static c_ithread_t *c_ithread_create(PerlInterpreter *base) {
 
   aTHX = t->interp;
 
-  if ((NULL != base) && (NULL != PL_endav)) {
-    av_clear(PL_endav);
-    av_undef(PL_endav);
-    PL_endav = Nullav;
+  if (NULL != base) {
+    /* the table is only needed while cloning (see threads.xs) */
+    if (NULL != PL_ptr_table) {
+      ptr_table_free(PL_ptr_table);
+      PL_ptr_table = NULL;
+    }
+
+    if (NULL != PL_endav) {
+      av_clear(PL_endav);
+      av_undef(PL_endav);
+      PL_endav = Nullav;
+    }
   }
 
 #if COLLECT_DEBUG
@@ -1274,14 +1354,105 @@ static c_ithread_t *c_ithread_create(PerlInterpreter *base) {
     t->prev = perl_threads->tail;
   }
 
-  t->pthread = pthread_self();
   t->running = 0;
-  t->shutdown = 0;
   perl_threads->tail = t;
+  return t;
+} /* static c_ithread_t *c_ithread_create (PerlInterpreter *) */
+
+/*
+ * Check out an idle interpreter and make it the current context of the
+ * calling thread. Blocks until an interpreter becomes available. Calls
+ * nested inside another callback (e.g. a Perl plugin dispatching values to
+ * a Perl write plugin) use the interpreter the thread already holds.
+ *
+ * Returns NULL if the plugin is shutting down.
+ */
+static c_ithread_t *c_ithread_acquire(void) {
+  c_ithread_t *t;
+
+  assert(NULL != perl_threads);
+
+  t = pthread_getspecific(perl_thr_key);
+  if (NULL != t) {
+    ++t->running;
+    return t;
+  }
+
+  pthread_mutex_lock(&perl_threads->mutex);
+
+  ++perl_threads->waiting;
+  while ((NULL == perl_threads->idle) && !perl_threads->shutdown)
+    pthread_cond_wait(&perl_threads->cond, &perl_threads->mutex);
+  --perl_threads->waiting;
+
+  if (perl_threads->shutdown) {
+    pthread_cond_broadcast(&perl_threads->cond);
+    pthread_mutex_unlock(&perl_threads->mutex);
+    return NULL;
+  }
+
+  t = perl_threads->idle;
+  perl_threads->idle = t->next_idle;
+  t->next_idle = NULL;
+  ++perl_threads->busy;
+
+  pthread_mutex_unlock(&perl_threads->mutex);
+
+  t->running = 1;
+  t->prev_context = PERL_GET_CONTEXT;
 
   pthread_setspecific(perl_thr_key, (const void *)t);
+  PERL_SET_CONTEXT(t->interp);
   return t;
-} /* static c_ithread_t *c_ithread_create (PerlInterpreter *) */
+} /* static c_ithread_t *c_ithread_acquire (void) */
+
+static void c_ithread_release(c_ithread_t *t) {
+  assert(0 < t->running);
+
+  if (0 < --t->running)
+    return;
+
+  PERL_SET_CONTEXT(t->prev_context);
+  t->prev_context = NULL;
+  pthread_setspecific(perl_thr_key, NULL);
+
+  pthread_mutex_lock(&perl_threads->mutex);
+
+  /* once the pool exists, the "base" interpreter is kept for shutting down */
+  if ((t != perl_threads->head) || !perl_threads->pool_ready) {
+    t->next_idle = perl_threads->idle;
+    perl_threads->idle = t;
+  }
+  --perl_threads->busy;
+
+  pthread_cond_broadcast(&perl_threads->cond);
+  pthread_mutex_unlock(&perl_threads->mutex);
+} /* static void c_ithread_release (c_ithread_t *) */
+
+/* Clone the interpreters of the pool from the "base" interpreter. Must be
+ * called while holding the "base" interpreter. */
+static void c_ithread_create_pool(void) {
+  c_ithread_t *base = perl_threads->head;
+
+  pthread_mutex_lock(&perl_threads->mutex);
+
+  for (int i = 0; i < perl_interpreters; ++i) {
+    c_ithread_t *t = c_ithread_create(base->interp);
+
+    t->next_idle = perl_threads->idle;
+    perl_threads->idle = t;
+  }
+
+  /* perl_clone() switches the context to the new interpreter */
+  PERL_SET_CONTEXT(base->interp);
+
+  perl_threads->pool_ready = 1;
+  pthread_cond_broadcast(&perl_threads->cond);
+  pthread_mutex_unlock(&perl_threads->mutex);
+
+  log_debug("c_ithread_create_pool: created %i interpreters",
+            perl_interpreters);
+} /* static void c_ithread_create_pool (void) */
 
 /*
  * Filter chains implementation.
@@ -1393,7 +1564,7 @@ static int fc_call(pTHX_ int type, int cb_type, pfc_user_data_t *data, ...) {
 
   PUTBACK;
 
-  retvals = call_pv_locked(aTHX_ "Collectd::fc_call");
+  retvals = call_pv("Collectd::fc_call", G_SCALAR | G_EVAL);
 
   if ((FC_CB_EXEC == cb_type) && (meta != NULL)) {
     assert(pmeta != NULL);
@@ -1427,23 +1598,17 @@ static int fc_call(pTHX_ int type, int cb_type, pfc_user_data_t *data, ...) {
 
 static int fc_create(int type, const oconfig_item_t *ci, void **user_data) {
   pfc_user_data_t *data;
+  c_ithread_t *t;
 
   int ret = 0;
 
-  dTHX;
-
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
+  if (NULL == (t = c_ithread_acquire()))
+    return -1;
 
-    aTHX = t->interp;
-  }
+  dTHXa(t->interp);
 
   log_debug("fc_create: c_ithread: interp = %p (active threads: %i)", aTHX,
             perl_threads->number_of_threads);
@@ -1451,6 +1616,7 @@ static int fc_create(int type, const oconfig_item_t *ci, void **user_data) {
   if ((1 != ci->values_num) || (OCONFIG_TYPE_STRING != ci->values[0].type)) {
     log_warn("A \"%s\" block expects a single string argument.",
              (FC_MATCH == type) ? "Match" : "Target");
+    c_ithread_release(t);
     return -1;
   }
 
@@ -1464,28 +1630,24 @@ static int fc_create(int type, const oconfig_item_t *ci, void **user_data) {
     PFC_USER_DATA_FREE(data);
   else
     *user_data = data;
+
+  c_ithread_release(t);
   return ret;
 } /* static int fc_create (int, const oconfig_item_t *, void **) */
 
 static int fc_destroy(int type, void **user_data) {
   pfc_user_data_t *data = *(pfc_user_data_t **)user_data;
+  c_ithread_t *t;
 
   int ret = 0;
 
-  dTHX;
-
   if ((NULL == perl_threads) || (NULL == data))
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
+  if (NULL == (t = c_ithread_acquire()))
+    return -1;
 
-    aTHX = t->interp;
-  }
+  dTHXa(t->interp);
 
   log_debug("fc_destroy: c_ithread: interp = %p (active threads: %i)", aTHX,
             perl_threads->number_of_threads);
@@ -1494,34 +1656,35 @@ static int fc_destroy(int type, void **user_data) {
 
   PFC_USER_DATA_FREE(data);
   *user_data = NULL;
+
+  c_ithread_release(t);
   return ret;
 } /* static int fc_destroy (int, void **) */
 
 static int fc_exec(int type, const data_set_t *ds, const value_list_t *vl,
                    notification_meta_t **meta, void **user_data) {
   pfc_user_data_t *data = *(pfc_user_data_t **)user_data;
+  c_ithread_t *t;
 
-  dTHX;
+  int ret;
 
   if (NULL == perl_threads)
     return 0;
 
   assert(NULL != data);
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
+  if (NULL == (t = c_ithread_acquire()))
+    return -1;
 
-    aTHX = t->interp;
-  }
+  dTHXa(t->interp);
 
   log_debug("fc_exec: c_ithread: interp = %p (active threads: %i)", aTHX,
             perl_threads->number_of_threads);
 
-  return fc_call(aTHX_ type, FC_CB_EXEC, data, ds, vl, meta);
+  ret = fc_call(aTHX_ type, FC_CB_EXEC, data, ds, vl, meta);
+
+  c_ithread_release(t);
+  return ret;
 } /* static int fc_exec (int, const data_set_t *, const value_list_t *,
                 notification_meta_t **, void **) */
 
@@ -1606,6 +1769,38 @@ static void _plugin_register_generic_userdata(pTHX, int type,
         &userdata);
   } else if (PLUGIN_WRITE == type) {
     ret = plugin_register_write(pluginname, perl_write, &userdata);
+  } else if (PLUGIN_WRITE_BATCH == type) {
+    pwrite_batch_t *b = smalloc(sizeof(*b));
+
+    memset(b, 0, sizeof(*b));
+    b->sub_name = userdata.data;
+    b->vls_size = (size_t)perl_write_batch_size;
+    b->vls = smalloc(b->vls_size * sizeof(*b->vls));
+    pthread_mutex_init(&b->lock, /* attr = */ NULL);
+    b->refs = 2;
+
+    pthread_mutex_lock(&perl_write_batches_lock);
+    b->next = perl_write_batches;
+    perl_write_batches = b;
+    pthread_mutex_unlock(&perl_write_batches_lock);
+
+    userdata.data = b;
+    userdata.free_func = pwrite_batch_free;
+
+    /* The user data is released by the plugin infrastructure if registering
+     * fails, dropping one reference each. */
+    ret = plugin_register_write(pluginname, perl_write_batch, &userdata);
+    if (0 == ret) {
+      /* Delivers batches which don't fill up before they get old, e.g. with
+       * FlushInterval set. */
+      if (0 != plugin_register_flush(pluginname, perl_write_batch_flush,
+                                     &userdata))
+        log_warn("Collectd::plugin_register_write_batch: Registering a "
+                 "flush callback for \"%s\" failed.",
+                 pluginname);
+    } else {
+      pwrite_batch_free(b);
+    }
   } else if (PLUGIN_LOG == type) {
     ret = plugin_register_log(pluginname, perl_log, &userdata);
   } else if (PLUGIN_NOTIF == type) {
@@ -1649,6 +1844,11 @@ static XS(Collectd_plugin_register_write) {
   return _plugin_register_generic_userdata(aTHX, PLUGIN_WRITE, "write");
 }
 
+static XS(Collectd_plugin_register_write_batch) {
+  return _plugin_register_generic_userdata(aTHX, PLUGIN_WRITE_BATCH,
+                                           "write_batch");
+}
+
 static XS(Collectd_plugin_register_log) {
   return _plugin_register_generic_userdata(aTHX, PLUGIN_LOG, "log");
 }
@@ -2069,231 +2269,402 @@ static XS(Collectd_call_by_name) {
  */
 
 static int perl_init(void) {
+  c_ithread_t *t;
   int status;
-  dTHX;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
+  if (NULL == (t = c_ithread_acquire()))
+    return -1;
 
-    aTHX = t->interp;
-  }
+  dTHXa(t->interp);
 
   log_debug("perl_init: c_ithread: interp = %p (active threads: %i)", aTHX,
             perl_threads->number_of_threads);
 
-  /* Lock the base thread to avoid race conditions with c_ithread_create().
-   * See https://github.com/collectd/collectd/issues/9 and
-   *     https://github.com/collectd/collectd/issues/1706 for details.
-   */
-  assert(aTHX == perl_threads->head->interp);
-  pthread_mutex_lock(&perl_threads->mutex);
-
   status = pplugin_call(aTHX_ PLUGIN_INIT);
 
-  pthread_mutex_unlock(&perl_threads->mutex);
+  /* Clone the pool only now so that each interpreter starts out with the
+   * state set up by the plugins' init callbacks. Until then, all callbacks
+   * share the "base" interpreter. */
+  if ((t == perl_threads->head) && !perl_threads->pool_ready)
+    c_ithread_create_pool();
 
+  c_ithread_release(t);
   return status;
 } /* static int perl_init (void) */
 
 static int perl_read(user_data_t *user_data) {
-  dTHX;
+  c_ithread_t *t;
+  int status;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  if (NULL == (t = c_ithread_acquire()))
+    return -1;
 
-  /* Assert that we're not running as the base thread. Otherwise, we might
-   * run into concurrency issues with c_ithread_create(). See
-   * https://github.com/collectd/collectd/issues/9 for details. */
-  assert(aTHX != perl_threads->head->interp);
+  dTHXa(t->interp);
 
   log_debug("perl_read: c_ithread: interp = %p (active threads: %i)", aTHX,
             perl_threads->number_of_threads);
 
-  return pplugin_call(aTHX_ PLUGIN_READ, user_data->data);
+  status = pplugin_call(aTHX_ PLUGIN_READ, user_data->data);
+
+  c_ithread_release(t);
+  return status;
 } /* static int perl_read (user_data_t *user_data) */
 
 static int perl_write(const data_set_t *ds, const value_list_t *vl,
                       user_data_t *user_data) {
+  c_ithread_t *t;
   int status;
-  dTHX;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
-
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  if (NULL == (t = c_ithread_acquire()))
+    return -1;
 
-  /* Lock the base thread if this is not called from one of the read threads
-   * to avoid race conditions with c_ithread_create(). See
-   * https://github.com/collectd/collectd/issues/9 for details. */
-  if (aTHX == perl_threads->head->interp)
-    pthread_mutex_lock(&perl_threads->mutex);
+  dTHXa(t->interp);
 
   log_debug("perl_write: c_ithread: interp = %p (active threads: %i)", aTHX,
             perl_threads->number_of_threads);
-  status = pplugin_call(aTHX_ PLUGIN_WRITE, user_data->data, ds, vl);
 
-  if (aTHX == perl_threads->head->interp)
-    pthread_mutex_unlock(&perl_threads->mutex);
+  status = pplugin_call(aTHX_ PLUGIN_WRITE, user_data->data, ds, vl);
 
+  c_ithread_release(t);
   return status;
 } /* static int perl_write (const data_set_t *, const value_list_t *) */
 
-static void perl_log(int level, const char *msg, user_data_t *user_data) {
-  dTHX;
+static int pwrite_batch_deliver(char *sub_name, value_list_t *vls,
+                                size_t vls_num) {
+  c_ithread_t *t;
+  int status = -1;
+
+  if ((NULL != perl_threads) && (NULL != (t = c_ithread_acquire()))) {
+    dTHXa(t->interp);
+
+    log_debug("pwrite_batch_deliver: c_ithread: interp = %p, "
+              "%" PRIsz " value lists",
+              aTHX, vls_num);
+
+    status = pplugin_call(aTHX_ PLUGIN_WRITE_BATCH, sub_name, vls, vls_num);
+
+    c_ithread_release(t);
+  }
+
+  for (size_t i = 0; i < vls_num; ++i)
+    sfree(vls[i].values);
+  sfree(vls);
+  return status;
+} /* static int pwrite_batch_deliver (char *, value_list_t *, size_t) */
+
+/* Detach the queued value lists from the batch. Must be called with b->lock
+ * locked. */
+static value_list_t *pwrite_batch_take(pwrite_batch_t *b, size_t *vls_num) {
+  value_list_t *vls = b->vls;
+
+  *vls_num = b->vls_num;
+
+  b->vls = smalloc(b->vls_size * sizeof(*b->vls));
+  b->vls_num = 0;
+  return vls;
+} /* static value_list_t *pwrite_batch_take (pwrite_batch_t *, size_t *) */
+
+/*
+ * Queue the value list and hand the whole batch to Perl once it is full or
+ * its oldest entry has been waiting for one interval. The Perl callback is
+ * called without holding the batch's lock so that other write threads can
+ * keep queueing in the meantime.
+ */
+static int perl_write_batch(const data_set_t *ds, const value_list_t *vl,
+                            user_data_t *user_data) {
+  pwrite_batch_t *b = user_data->data;
+  value_list_t *vls = NULL;
+  size_t vls_num = 0;
+  value_t *values;
+  cdtime_t now;
 
   if (NULL == perl_threads)
-    return;
+    return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
+  values = malloc(vl->values_len * sizeof(*values));
+  if (NULL == values) {
+    log_err("perl_write_batch: malloc failed.");
+    return -1;
+  }
+  memcpy(values, vl->values, vl->values_len * sizeof(*values));
 
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
+  now = cdtime();
+
+  pthread_mutex_lock(&b->lock);
+
+  if (0 == b->vls_num)
+    b->first_time = now;
+
+  b->vls[b->vls_num] = *vl;
+  b->vls[b->vls_num].values = values;
+  b->vls[b->vls_num].meta = NULL;
+  ++b->vls_num;
+
+  if ((b->vls_size <= b->vls_num) ||
+      ((now - b->first_time) >= vl->interval))
+    vls = pwrite_batch_take(b, &vls_num);
+
+  pthread_mutex_unlock(&b->lock);
 
-    aTHX = t->interp;
+  if (NULL == vls)
+    return 0;
+
+  return pwrite_batch_deliver(b->sub_name, vls, vls_num);
+} /* static int perl_write_batch (const data_set_t *, const value_list_t *,
+                                  user_data_t *) */
+
+/* Hand the batch to Perl if its oldest entry is older than `timeout'. The
+ * identifier is ignored, the whole batch is delivered. */
+static int perl_write_batch_flush(cdtime_t timeout,
+                                  const char __attribute__((unused)) *
+                                      identifier,
+                                  user_data_t *user_data) {
+  pwrite_batch_t *b = user_data->data;
+  value_list_t *vls = NULL;
+  size_t vls_num = 0;
+
+  if (NULL == perl_threads)
+    return 0;
+
+  pthread_mutex_lock(&b->lock);
+  if ((0 < b->vls_num) &&
+      ((0 == timeout) || ((cdtime() - b->first_time) >= timeout)))
+    vls = pwrite_batch_take(b, &vls_num);
+  pthread_mutex_unlock(&b->lock);
+
+  if (NULL == vls)
+    return 0;
+
+  return pwrite_batch_deliver(b->sub_name, vls, vls_num);
+} /* static int perl_write_batch_flush (cdtime_t, const char *,
+                                        user_data_t *) */
+
+/* Deliver all value lists still queued in any batch. The batches are detached
+ * first so that the callbacks may unregister themselves. */
+static void pwrite_batch_flush_all(void) {
+  struct {
+    char *sub_name;
+    value_list_t *vls;
+    size_t vls_num;
+  } *pending = NULL;
+  size_t pending_num = 0;
+
+  pthread_mutex_lock(&perl_write_batches_lock);
+
+  for (pwrite_batch_t *b = perl_write_batches; NULL != b; b = b->next)
+    ++pending_num;
+
+  if (0 < pending_num)
+    pending = smalloc(pending_num * sizeof(*pending));
+
+  pending_num = 0;
+  for (pwrite_batch_t *b = perl_write_batches; NULL != b; b = b->next) {
+    pthread_mutex_lock(&b->lock);
+    if (0 < b->vls_num) {
+      pending[pending_num].sub_name = sstrdup(b->sub_name);
+      pending[pending_num].vls =
+          pwrite_batch_take(b, &pending[pending_num].vls_num);
+      ++pending_num;
+    }
+    pthread_mutex_unlock(&b->lock);
   }
 
-  /* Lock the base thread if this is not called from one of the read threads
-   * to avoid race conditions with c_ithread_create(). See
-   * https://github.com/collectd/collectd/issues/9 for details.
-   */
+  pthread_mutex_unlock(&perl_write_batches_lock);
 
-  if (aTHX == perl_threads->head->interp)
-    pthread_mutex_lock(&perl_threads->mutex);
+  for (size_t i = 0; i < pending_num; ++i) {
+    pwrite_batch_deliver(pending[i].sub_name, pending[i].vls,
+                         pending[i].vls_num);
+    sfree(pending[i].sub_name);
+  }
+  sfree(pending);
+} /* static void pwrite_batch_flush_all (void) */
 
-  pplugin_call(aTHX_ PLUGIN_LOG, user_data->data, level, msg);
+static void pwrite_batch_free(void *arg) {
+  pwrite_batch_t *b = arg;
 
-  if (aTHX == perl_threads->head->interp)
-    pthread_mutex_unlock(&perl_threads->mutex);
+  if (NULL == b)
+    return;
 
+  pthread_mutex_lock(&perl_write_batches_lock);
+  if (0 < --b->refs) {
+    pthread_mutex_unlock(&perl_write_batches_lock);
+    return;
+  }
+  for (pwrite_batch_t **prev = &perl_write_batches; NULL != *prev;
+       prev = &(*prev)->next) {
+    if (*prev == b) {
+      *prev = b->next;
+      break;
+    }
+  }
+  pthread_mutex_unlock(&perl_write_batches_lock);
+
+  for (size_t i = 0; i < b->vls_num; ++i)
+    sfree(b->vls[i].values);
+  sfree(b->vls);
+
+  pthread_mutex_destroy(&b->lock);
+  sfree(b->sub_name);
+  sfree(b);
+} /* static void pwrite_batch_free (void *) */
+
+static void perl_log(int level, const char *msg, user_data_t *user_data) {
+  c_ithread_t *t;
+
+  if (NULL == perl_threads)
+    return;
+
+  if (NULL == (t = c_ithread_acquire()))
+    return;
+
+  dTHXa(t->interp);
+
+  pplugin_call(aTHX_ PLUGIN_LOG, user_data->data, level, msg);
+
+  c_ithread_release(t);
   return;
 } /* static void perl_log (int, const char *) */
 
 static int perl_notify(const notification_t *notif, user_data_t *user_data) {
-  dTHX;
+  c_ithread_t *t;
+  int status;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
+  if (NULL == (t = c_ithread_acquire()))
+    return -1;
 
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
+  dTHXa(t->interp);
 
-    aTHX = t->interp;
-  }
-  return pplugin_call(aTHX_ PLUGIN_NOTIF, user_data->data, notif);
+  status = pplugin_call(aTHX_ PLUGIN_NOTIF, user_data->data, notif);
+
+  c_ithread_release(t);
+  return status;
 } /* static int perl_notify (const notification_t *) */
 
 static int perl_flush(cdtime_t timeout, const char *identifier,
                       user_data_t *user_data) {
-  dTHX;
+  c_ithread_t *t;
+  int status;
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    c_ithread_t *t = NULL;
+  if (NULL == (t = c_ithread_acquire()))
+    return -1;
 
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
-
-    aTHX = t->interp;
-  }
+  dTHXa(t->interp);
 
   /* For collectd-5.6 only, #1731 */
   if (user_data == NULL || user_data->data == NULL)
-    return pplugin_call(aTHX_ PLUGIN_FLUSH_ALL, timeout, identifier);
+    status = pplugin_call(aTHX_ PLUGIN_FLUSH_ALL, timeout, identifier);
+  else
+    status =
+        pplugin_call(aTHX_ PLUGIN_FLUSH, user_data->data, timeout, identifier);
 
-  return pplugin_call(aTHX_ PLUGIN_FLUSH, user_data->data, timeout, identifier);
+  c_ithread_release(t);
+  return status;
 } /* static int perl_flush (const int) */
 
 static int perl_shutdown(void) {
+  c_ithread_t *base;
   c_ithread_t *t;
+  struct timespec deadline;
   int ret;
 
-  dTHX;
-
   plugin_unregister_complex_config("perl");
   plugin_unregister_read_group("perl");
 
   if (NULL == perl_threads)
     return 0;
 
-  if (NULL == aTHX) {
-    pthread_mutex_lock(&perl_threads->mutex);
-    t = c_ithread_create(perl_threads->head->interp);
-    pthread_mutex_unlock(&perl_threads->mutex);
+  /* hand the remaining queued values to the TYPE_WRITE_BATCH callbacks
+   * while the pool is still available */
+  pwrite_batch_flush_all();
+
+  pthread_mutex_lock(&perl_threads->mutex);
+
+  /* wake up threads waiting for an interpreter and give the ones running
+   * inside Perl some time to return */
+  perl_threads->shutdown = 1;
+  pthread_cond_broadcast(&perl_threads->cond);
 
-    aTHX = t->interp;
+  deadline = CDTIME_T_TO_TIMESPEC(cdtime() + TIME_T_TO_CDTIME_T(5));
+  while ((0 < perl_threads->busy) || (0 < perl_threads->waiting)) {
+    if (ETIMEDOUT == pthread_cond_timedwait(&perl_threads->cond,
+                                            &perl_threads->mutex, &deadline))
+      break;
   }
 
-  log_debug("perl_shutdown: c_ithread: interp = %p (active threads: %i)", aTHX,
-            perl_threads->number_of_threads);
+  if (0 < perl_threads->busy) {
+    /* These interpreters can neither be destroyed nor can the list be
+     * freed as their threads would access it when returning. */
+    ERROR("perl shutdown: %i interpreter(s) still running inside Perl. "
+          "Not destroying them.",
+          perl_threads->busy);
+
+    while (NULL != (t = perl_threads->idle)) {
+      perl_threads->idle = t->next_idle;
+      if (t != perl_threads->head)
+        c_ithread_destroy(t);
+    }
+
+    pthread_mutex_unlock(&perl_threads->mutex);
+    return -1;
+  }
+
+  pthread_mutex_unlock(&perl_threads->mutex);
+
+  /* Run the plugins' shutdown functions in the "base" interpreter. Nested
+   * calls (e.g. logging) use it as well. */
+  base = perl_threads->head;
+  base->running = 1;
+  base->prev_context = PERL_GET_CONTEXT;
+  pthread_setspecific(perl_thr_key, (const void *)base);
+  PERL_SET_CONTEXT(base->interp);
+
+  {
+    dTHXa(base->interp);
 
-  plugin_unregister_init("perl");
-  plugin_unregister_flush("perl"); /* For collectd-5.6 only, #1731 */
+    log_debug("perl_shutdown: c_ithread: interp = %p (active threads: %i)",
+              aTHX, perl_threads->number_of_threads);
 
-  ret = pplugin_call(aTHX_ PLUGIN_SHUTDOWN);
+    plugin_unregister_init("perl");
+    plugin_unregister_flush("perl"); /* For collectd-5.6 only, #1731 */
+
+    ret = pplugin_call(aTHX_ PLUGIN_SHUTDOWN);
+  }
+
+  pthread_setspecific(perl_thr_key, NULL);
+  base->running = 0;
 
   pthread_mutex_lock(&perl_threads->mutex);
-  t = perl_threads->tail;
 
+  t = perl_threads->tail;
   while (NULL != t) {
-    struct timespec ts_wait;
     c_ithread_t *thr = t;
 
     /* the pointer has to be advanced before destroying
      * the thread as this will free the memory */
     t = t->prev;
 
-    thr->shutdown = 1;
-    if (thr->running) {
-      /* Give some time to thread to exit from Perl interpreter */
-      WARNING("perl shutdown: Thread is running inside Perl. Waiting.");
-      ts_wait.tv_sec = 0;
-      ts_wait.tv_nsec = 500000;
-      nanosleep(&ts_wait, NULL);
-    }
-    if (thr->running) {
-      pthread_kill(thr->pthread, SIGTERM);
-      ERROR("perl shutdown: Thread hangs inside Perl. Thread killed.");
-    }
     c_ithread_destroy(thr);
   }
 
   pthread_mutex_unlock(&perl_threads->mutex);
   pthread_mutex_destroy(&perl_threads->mutex);
   pthread_mutexattr_destroy(&perl_threads->mutexattr);
+  pthread_cond_destroy(&perl_threads->cond);
 
   sfree(perl_threads);
 
@@ -2426,7 +2797,7 @@ static int init_pi(int argc, char **argv) {
   }
 #endif /* COLLECT_DEBUG */
 
-  if (0 != pthread_key_create(&perl_thr_key, c_ithread_destructor)) {
+  if (0 != pthread_key_create(&perl_thr_key, /* destructor = */ NULL)) {
     log_err("init_pi: pthread_key_create failed");
 
     /* this must not happen - cowardly giving up if it does */
@@ -2446,12 +2817,15 @@ static int init_pi(int argc, char **argv) {
   pthread_mutexattr_init(&perl_threads->mutexattr);
   pthread_mutexattr_settype(&perl_threads->mutexattr, PTHREAD_MUTEX_RECURSIVE);
   pthread_mutex_init(&perl_threads->mutex, &perl_threads->mutexattr);
+  pthread_cond_init(&perl_threads->cond, /* attr = */ NULL);
   /* locking the mutex should not be necessary at this point
    * but let's just do it for the sake of completeness */
   pthread_mutex_lock(&perl_threads->mutex);
 
   perl_threads->head = c_ithread_create(NULL);
   perl_threads->tail = perl_threads->head;
+  /* until the pool has been created, the "base" interpreter is used */
+  perl_threads->idle = perl_threads->head;
 
   if (NULL == (perl_threads->head->interp = perl_alloc())) {
     log_err("init_pi: Not enough memory.");
@@ -2674,6 +3048,25 @@ static int perl_config_plugin(pTHX_ oconfig_item_t *ci) {
   return ret;
 } /* static int perl_config_plugin (oconfig_item_it *) */
 
+/*
+ * Interpreters <num>
+ * WriteBatchSize <num>
+ */
+static int perl_config_positive_int(oconfig_item_t *ci, int *ret) {
+  int tmp;
+
+  if (0 != cf_util_get_int(ci, &tmp))
+    return 1;
+
+  if (1 > tmp) {
+    log_err("%s expects a positive number.", ci->key);
+    return 1;
+  }
+
+  *ret = tmp;
+  return 0;
+} /* static int perl_config_positive_int (oconfig_item_t *, int *) */
+
 static int perl_config(oconfig_item_t *ci) {
   int status = 0;
 
@@ -2700,6 +3093,10 @@ static int perl_config(oconfig_item_t *ci) {
       current_status = perl_config_plugin(aTHX_ c);
     else if (0 == strcasecmp(c->key, "RegisterLegacyFlush"))
       cf_util_get_boolean(c, &register_legacy_flush);
+    else if (0 == strcasecmp(c->key, "Interpreters"))
+      current_status = perl_config_positive_int(c, &perl_interpreters);
+    else if (0 == strcasecmp(c->key, "WriteBatchSize"))
+      current_status = perl_config_positive_int(c, &perl_write_batch_size);
     else {
       log_warn("Ignoring unknown config key \"%s\".", c->key);
       current_status = 0;
@@ -29,11 +29,18 @@
 #include "common.h"
 #include "plugin.h"
 #include "utils_complain.h"
+#include "utils_random.h"
 
+#include <fcntl.h>
+#include <netinet/icmp6.h>
 #include <netinet/in.h>
+#include <poll.h>
 #if HAVE_NETDB_H
 #include <netdb.h> /* NI_MAXHOST */
 #endif
+#if KERNEL_LINUX
+#include <linux/icmp.h> /* ICMP_FILTER */
+#endif
 
 #ifdef HAVE_SYS_CAPABILITY_H
 #include <sys/capability.h>
@@ -49,6 +56,25 @@
 #define HAVE_OPING_1_3
 #endif
 
+#define ENGINE_LIBOPING 0
+#define ENGINE_NATIVE 1
+
+/* The native engine keeps one timer per host in a hashed timer wheel with a
+ * resolution of one millisecond. */
+#define PING_WHEEL_SIZE 1024
+#define PING_WHEEL_TICK MS_TO_CDTIME_T(1)
+
+/* Upper bound for a single poll(2), so the thread notices a shutdown. */
+#define PING_POLL_MAX_MS 100
+
+#define PING_ICMP_ECHO 8
+#define PING_ICMP_ECHOREPLY 0
+#define PING_ICMP6_ECHO 128
+#define PING_ICMP6_ECHOREPLY 129
+
+/* Default payload size, matching ping(1) and liboping. */
+#define PING_DEF_DATA_SIZE 56
+
 /*
  * Private data types
  */
@@ -59,8 +85,10 @@ struct hostlist_s {
   uint32_t pkg_recv;
   uint32_t pkg_missed;
 
-  double latency_total;
-  double latency_squared;
+  /* Running mean and sum of squared differences from the mean of the
+   * latencies received since the last read, see ping_host_update(). */
+  double latency_mean;
+  double latency_m2;
 
   struct hostlist_s *next;
 };
@@ -80,6 +108,7 @@ static int ping_ttl = PING_DEF_TTL;
 static double ping_interval = 1.0;
 static double ping_timeout = 0.9;
 static int ping_max_missed = -1;
+static int ping_engine = ENGINE_LIBOPING;
 
 static pthread_mutex_t ping_lock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t ping_cond = PTHREAD_COND_INITIALIZER;
@@ -92,7 +121,7 @@ static const char *config_keys[] = {"Host",    "SourceAddress",
                                     "Device",
 #endif
                                     "Size",    "TTL",           "Interval",
-                                    "Timeout", "MaxMissed"};
+                                    "Timeout", "MaxMissed",     "Engine"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /*
@@ -140,6 +169,51 @@ static void time_calc(struct timespec *ts_dest, /* {{{ */
   time_normalize(ts_dest);
 } /* }}} void time_calc */
 
+/* Accounts for one echo request to `hl'. `latency' is the round trip time in
+ * milliseconds or less than zero if no reply was received. The caller must
+ * hold `ping_lock'. Returns true if the host should be resolved again. */
+static _Bool ping_host_update(hostlist_t *hl, double latency) /* {{{ */
+{
+  hl->pkg_sent++;
+  if (latency >= 0.0) {
+    /* Welford's method: numerically stable, and the mean and standard
+     * deviation are available without another pass over the samples. */
+    double delta = latency - hl->latency_mean;
+
+    hl->pkg_recv++;
+    hl->latency_mean += delta / ((double)hl->pkg_recv);
+    hl->latency_m2 += delta * (latency - hl->latency_mean);
+
+    /* reset missed packages counter */
+    hl->pkg_missed = 0;
+  } else
+    hl->pkg_missed++;
+
+  /* if the host did not answer our last N packages, trigger a resolv. */
+  if ((ping_max_missed >= 0) &&
+      (hl->pkg_missed >= ((uint32_t)ping_max_missed))) {
+    /* we reset the missed package counter here, since we only want to
+     * trigger a resolv every N packages and not every package _AFTER_ N
+     * missed packages */
+    hl->pkg_missed = 0;
+
+    WARNING("ping plugin: host %s has not answered %d PING requests,"
+            " triggering resolve",
+            hl->host, ping_max_missed);
+    return 1;
+  }
+
+  return 0;
+} /* }}} _Bool ping_host_update */
+
+static void ping_host_reset(hostlist_t *hl) /* {{{ */
+{
+  hl->pkg_sent = 0;
+  hl->pkg_recv = 0;
+  hl->latency_mean = 0.0;
+  hl->latency_m2 = 0.0;
+} /* }}} void ping_host_reset */
+
 static int ping_dispatch_all(pingobj_t *pingobj) /* {{{ */
 {
   hostlist_t *hl;
@@ -183,29 +257,7 @@ static int ping_dispatch_all(pingobj_t *pingobj) /* {{{ */
       continue;
     }
 
-    hl->pkg_sent++;
-    if (latency >= 0.0) {
-      hl->pkg_recv++;
-      hl->latency_total += latency;
-      hl->latency_squared += (latency * latency);
-
-      /* reset missed packages counter */
-      hl->pkg_missed = 0;
-    } else
-      hl->pkg_missed++;
-
-    /* if the host did not answer our last N packages, trigger a resolv. */
-    if ((ping_max_missed >= 0) &&
-        (hl->pkg_missed >= ((uint32_t)ping_max_missed))) { /* {{{ */
-      /* we reset the missed package counter here, since we only want to
-       * trigger a resolv every N packages and not every package _AFTER_ N
-       * missed packages */
-      hl->pkg_missed = 0;
-
-      WARNING("ping plugin: host %s has not answered %d PING requests,"
-              " triggering resolve",
-              hl->host, ping_max_missed);
-
+    if (ping_host_update(hl, latency)) { /* {{{ */
       /* we trigger the resolv simply be removeing and adding the host to our
        * ping object */
       status = ping_host_remove(pingobj, hl->host);
@@ -339,6 +391,737 @@ static void *ping_thread(void *arg) /* {{{ */
   return (void *)0;
 } /* }}} void *ping_thread */
 
+/*
+ * Native engine
+ *
+ * Every host has a slot in a flat table and the slot index is carried in the
+ * payload of each echo request, so replies are matched without a lookup.
+ * Sends are spread across the interval by a timer wheel and replies are read
+ * whenever a socket becomes readable, so the number of hosts is not bounded
+ * by the timeout.
+ */
+#define PING_WHEEL_NONE UINT32_MAX
+#define PING_ICMP_HDR_SIZE 8
+
+typedef struct {
+  hostlist_t *hl;
+
+  struct sockaddr_storage addr;
+  socklen_t addrlen;
+
+  /* Time the outstanding request has been sent or zero if it has been
+   * answered already. */
+  cdtime_t sent;
+  uint16_t seq;
+
+  /* When `waiting' is true, the timer fires when the outstanding request
+   * times out. Otherwise it fires when the next request is due. */
+  cdtime_t deadline;
+  _Bool waiting;
+  uint32_t wheel_next;
+
+  /* Set while the host is being looked up again. The resolver thread stores
+   * up to one IPv4 and one IPv6 address in `resolved', in the order returned
+   * by getaddrinfo(3). Protected by `resolve_lock'. */
+  _Bool resolving;
+  struct sockaddr_storage resolved[2];
+  socklen_t resolved_len[2];
+  size_t resolved_num;
+} ping_target_t;
+
+typedef struct {
+  int fd;
+  _Bool raw;
+} ping_socket_t;
+
+/* Start of the payload of all echo requests sent by the native engine. */
+typedef struct {
+  uint32_t cookie;
+  uint32_t index;
+} ping_payload_t;
+
+typedef struct {
+  ping_target_t *targets;
+  uint32_t targets_num;
+
+  uint32_t wheel[PING_WHEEL_SIZE];
+  uint64_t tick;
+
+  ping_socket_t sock4;
+  ping_socket_t sock6;
+
+  uint16_t ident;
+  uint32_t cookie;
+
+  cdtime_t interval;
+  cdtime_t timeout;
+
+  /* Echo request template, starting with the ICMP header. */
+  uint8_t *packet;
+  size_t packet_len;
+
+  uint8_t buffer[65536];
+
+  c_complain_t complaint;
+
+  /* Lookups triggered by MaxMissed are done by a thread of its own, started
+   * when the first one is needed, so that sending and receiving go on while
+   * getaddrinfo(3) blocks. Both stacks hold target indexes. */
+  pthread_mutex_t resolve_lock;
+  pthread_cond_t resolve_cond;
+  pthread_t resolve_thread;
+  _Bool resolve_thread_running;
+  _Bool resolve_loop;
+  uint32_t *resolve_requests;
+  uint32_t resolve_requests_num;
+  uint32_t *resolve_results;
+  uint32_t resolve_results_num;
+} ping_native_t;
+
+static cdtime_t ping_native_now(void) /* {{{ */
+{
+  struct timespec ts = {0};
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return TIMESPEC_TO_CDTIME_T(&ts);
+} /* }}} cdtime_t ping_native_now */
+
+static uint16_t ping_native_checksum(const uint8_t *buf, size_t len) /* {{{ */
+{
+  uint32_t sum = 0;
+
+  for (size_t i = 0; i + 1 < len; i += 2) {
+    uint16_t word;
+    memcpy(&word, buf + i, sizeof(word));
+    sum += word;
+  }
+  if ((len % 2) != 0) {
+    uint16_t word = 0;
+    memcpy(&word, buf + len - 1, 1);
+    sum += word;
+  }
+
+  while ((sum >> 16) != 0)
+    sum = (sum & 0xffff) + (sum >> 16);
+
+  return (uint16_t)~sum;
+} /* }}} uint16_t ping_native_checksum */
+
+static ping_socket_t *ping_native_socket(ping_native_t *pn, /* {{{ */
+                                         int family) {
+  ping_socket_t *ps = (family == AF_INET6) ? &pn->sock6 : &pn->sock4;
+  int proto = (family == AF_INET6) ? IPPROTO_ICMPV6 : IPPROTO_ICMP;
+  const char *family_name = (family == AF_INET6) ? "ICMPv6" : "ICMP";
+
+  if (ps->fd >= 0)
+    return ps;
+
+  /* Raw sockets need CAP_NET_RAW. Datagram ICMP sockets are available to
+   * unprivileged users on Linux, depending on net.ipv4.ping_group_range. */
+  ps->raw = 1;
+  ps->fd = socket(family, SOCK_RAW, proto);
+  if ((ps->fd < 0) && ((errno == EPERM) || (errno == EACCES))) {
+    ps->raw = 0;
+    ps->fd = socket(family, SOCK_DGRAM, proto);
+  }
+  if (ps->fd < 0) {
+    ERROR("ping plugin: Opening %s socket failed: %s", family_name, STRERRNO);
+    return NULL;
+  }
+
+  int flags = fcntl(ps->fd, F_GETFL, 0);
+  if ((flags < 0) || (fcntl(ps->fd, F_SETFL, flags | O_NONBLOCK) != 0)) {
+    ERROR("ping plugin: Making %s socket non-blocking failed: %s",
+          family_name, STRERRNO);
+    close(ps->fd);
+    ps->fd = -1;
+    return NULL;
+  }
+
+  int status;
+  if (family == AF_INET6)
+    status = setsockopt(ps->fd, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ping_ttl,
+                        sizeof(ping_ttl));
+  else
+    status = setsockopt(ps->fd, IPPROTO_IP, IP_TTL, &ping_ttl,
+                        sizeof(ping_ttl));
+  if (status != 0)
+    WARNING("ping plugin: Setting the TTL of the %s socket failed: %s",
+            family_name, STRERRNO);
+
+  /* Raw sockets receive a copy of all ICMP messages. Let the kernel drop
+   * everything but echo replies. */
+#if defined(SOL_RAW) && defined(ICMP_FILTER)
+  if (ps->raw && (family == AF_INET)) {
+    struct icmp_filter filter = {.data = ~(1U << PING_ICMP_ECHOREPLY)};
+    setsockopt(ps->fd, SOL_RAW, ICMP_FILTER, &filter, sizeof(filter));
+  }
+#endif
+#ifdef ICMP6_FILTER
+  if (ps->raw && (family == AF_INET6)) {
+    struct icmp6_filter filter;
+    ICMP6_FILTER_SETBLOCKALL(&filter);
+    ICMP6_FILTER_SETPASS(PING_ICMP6_ECHOREPLY, &filter);
+    setsockopt(ps->fd, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter));
+  }
+#endif
+
+#if defined(HAVE_OPING_1_3) && defined(SO_BINDTODEVICE)
+  if (ping_device != NULL) {
+    if (setsockopt(ps->fd, SOL_SOCKET, SO_BINDTODEVICE, ping_device,
+                   strlen(ping_device) + 1) != 0)
+      ERROR("ping plugin: Failed to set device: %s", STRERRNO);
+  }
+#endif
+
+  if (ping_source != NULL) {
+    struct addrinfo *ai_list;
+    struct addrinfo ai_hints = {.ai_family = family,
+                                .ai_socktype = ps->raw ? SOCK_RAW : SOCK_DGRAM,
+                                .ai_protocol = proto};
+
+    status = getaddrinfo(ping_source, NULL, &ai_hints, &ai_list);
+    if (status == 0) {
+      status = bind(ps->fd, ai_list->ai_addr, ai_list->ai_addrlen);
+      freeaddrinfo(ai_list);
+    }
+    if (status != 0) {
+      ERROR("ping plugin: Failed to set %s source address to %s.",
+            family_name, ping_source);
+      close(ps->fd);
+      ps->fd = -1;
+      return NULL;
+    }
+  }
+
+  INFO("ping plugin: Using %s %s socket.", ps->raw ? "raw" : "datagram",
+       family_name);
+  return ps;
+} /* }}} ping_socket_t *ping_native_socket */
+
+/* Looks up the first IPv4 and the first IPv6 address of `host', in the order
+ * returned by getaddrinfo(3). Returns the number of addresses found. */
+static size_t ping_native_lookup(const char *host, /* {{{ */
+                                 struct sockaddr_storage addrs[2],
+                                 socklen_t addrs_len[2]) {
+  struct addrinfo *ai_list;
+  struct addrinfo ai_hints = {.ai_family = AF_UNSPEC,
+                              .ai_socktype = SOCK_RAW};
+  size_t addrs_num = 0;
+
+  int status = getaddrinfo(host, NULL, &ai_hints, &ai_list);
+  if (status != 0) {
+    WARNING("ping plugin: Resolving host %s failed: %s", host,
+            (status == EAI_SYSTEM) ? STRERRNO : gai_strerror(status));
+    return 0;
+  }
+
+  for (struct addrinfo *ai = ai_list; (ai != NULL) && (addrs_num < 2);
+       ai = ai->ai_next) {
+    if (((ai->ai_family != AF_INET) && (ai->ai_family != AF_INET6)) ||
+        (ai->ai_addrlen > sizeof(addrs[0])))
+      continue;
+    if ((addrs_num > 0) && (addrs[0].ss_family == ai->ai_family))
+      continue;
+
+    memcpy(addrs + addrs_num, ai->ai_addr, ai->ai_addrlen);
+    addrs_len[addrs_num] = ai->ai_addrlen;
+    addrs_num++;
+  }
+
+  freeaddrinfo(ai_list);
+  return addrs_num;
+} /* }}} size_t ping_native_lookup */
+
+/* Switches `t' to the first of `addrs' a socket can be opened for. The
+ * previous address is kept if there is none. */
+static int ping_native_use(ping_native_t *pn, ping_target_t *t, /* {{{ */
+                           struct sockaddr_storage const addrs[2],
+                           socklen_t const addrs_len[2], size_t addrs_num) {
+  for (size_t i = 0; i < addrs_num; i++) {
+    if (ping_native_socket(pn, addrs[i].ss_family) == NULL)
+      continue;
+
+    memcpy(&t->addr, addrs + i, addrs_len[i]);
+    t->addrlen = addrs_len[i];
+    return 0;
+  }
+
+  WARNING("ping plugin: No usable address for host %s.", t->hl->host);
+  return -1;
+} /* }}} int ping_native_use */
+
+/* Looks up the address of `t' and opens a socket for its address family, if
+ * necessary. The previous address is kept if either fails. */
+static int ping_native_resolve(ping_native_t *pn, /* {{{ */
+                               ping_target_t *t) {
+  struct sockaddr_storage addrs[2];
+  socklen_t addrs_len[2];
+
+  size_t addrs_num = ping_native_lookup(t->hl->host, addrs, addrs_len);
+  if (addrs_num == 0)
+    return -1;
+
+  return ping_native_use(pn, t, addrs, addrs_len, addrs_num);
+} /* }}} int ping_native_resolve */
+
+static void *ping_native_resolve_thread(void *arg) /* {{{ */
+{
+  ping_native_t *pn = arg;
+
+  pthread_mutex_lock(&pn->resolve_lock);
+  while (pn->resolve_loop) {
+    if (pn->resolve_requests_num == 0) {
+      pthread_cond_wait(&pn->resolve_cond, &pn->resolve_lock);
+      continue;
+    }
+
+    pn->resolve_requests_num--;
+    uint32_t index = pn->resolve_requests[pn->resolve_requests_num];
+    ping_target_t *t = pn->targets + index;
+    pthread_mutex_unlock(&pn->resolve_lock);
+
+    struct sockaddr_storage addrs[2];
+    socklen_t addrs_len[2];
+    size_t addrs_num = ping_native_lookup(t->hl->host, addrs, addrs_len);
+
+    pthread_mutex_lock(&pn->resolve_lock);
+    memcpy(t->resolved, addrs, sizeof(addrs));
+    memcpy(t->resolved_len, addrs_len, sizeof(addrs_len));
+    t->resolved_num = addrs_num;
+    pn->resolve_results[pn->resolve_results_num] = index;
+    pn->resolve_results_num++;
+  }
+  pthread_mutex_unlock(&pn->resolve_lock);
+
+  return (void *)0;
+} /* }}} void *ping_native_resolve_thread */
+
+/* Hands the lookup of target `index' to the resolver thread. The target keeps
+ * being pinged at its previous address until the answer arrives. */
+static void ping_native_resolve_async(ping_native_t *pn, /* {{{ */
+                                      uint32_t index) {
+  ping_target_t *t = pn->targets + index;
+
+  pthread_mutex_lock(&pn->resolve_lock);
+  if (t->resolving) {
+    pthread_mutex_unlock(&pn->resolve_lock);
+    return;
+  }
+
+  if (!pn->resolve_thread_running) {
+    pn->resolve_loop = 1;
+    int status = plugin_thread_create(&pn->resolve_thread, /* attr = */ NULL,
+                                      ping_native_resolve_thread, pn,
+                                      "ping resolve");
+    if (status != 0) {
+      pn->resolve_loop = 0;
+      pthread_mutex_unlock(&pn->resolve_lock);
+      ERROR("ping plugin: Starting the resolver thread failed.");
+      return;
+    }
+    pn->resolve_thread_running = 1;
+  }
+
+  t->resolving = 1;
+  pn->resolve_requests[pn->resolve_requests_num] = index;
+  pn->resolve_requests_num++;
+  pthread_cond_signal(&pn->resolve_cond);
+  pthread_mutex_unlock(&pn->resolve_lock);
+} /* }}} void ping_native_resolve_async */
+
+/* Switches the targets looked up by the resolver thread to their new
+ * addresses. */
+static void ping_native_resolve_done(ping_native_t *pn) /* {{{ */
+{
+  pthread_mutex_lock(&pn->resolve_lock);
+  while (pn->resolve_results_num > 0) {
+    pn->resolve_results_num--;
+    uint32_t index = pn->resolve_results[pn->resolve_results_num];
+    ping_target_t *t = pn->targets + index;
+
+    struct sockaddr_storage addrs[2];
+    socklen_t addrs_len[2];
+    size_t addrs_num = t->resolved_num;
+    memcpy(addrs, t->resolved, sizeof(addrs));
+    memcpy(addrs_len, t->resolved_len, sizeof(addrs_len));
+    t->resolving = 0;
+    pthread_mutex_unlock(&pn->resolve_lock);
+
+    /* Opening a socket for a new address family may log. */
+    if (addrs_num > 0)
+      ping_native_use(pn, t, addrs, addrs_len, addrs_num);
+
+    pthread_mutex_lock(&pn->resolve_lock);
+  }
+  pthread_mutex_unlock(&pn->resolve_lock);
+} /* }}} void ping_native_resolve_done */
+
+static void ping_native_schedule(ping_native_t *pn, /* {{{ */
+                                 uint32_t index, cdtime_t deadline) {
+  ping_target_t *t = pn->targets + index;
+  uint64_t tick = deadline / PING_WHEEL_TICK;
+
+  /* Deadlines that have passed already fire with the next tick. */
+  if (tick <= pn->tick)
+    tick = pn->tick + 1;
+
+  t->deadline = deadline;
+  t->wheel_next = pn->wheel[tick % PING_WHEEL_SIZE];
+  pn->wheel[tick % PING_WHEEL_SIZE] = index;
+} /* }}} void ping_native_schedule */
+
+static void ping_native_send(ping_native_t *pn, /* {{{ */
+                             uint32_t index) {
+  ping_target_t *t = pn->targets + index;
+  int family = t->addr.ss_family;
+  ping_socket_t *ps = (family == AF_INET6) ? &pn->sock6 : &pn->sock4;
+  uint8_t *packet = pn->packet;
+
+  uint16_t ident = htons(pn->ident);
+  uint16_t seq = htons(++t->seq);
+  ping_payload_t payload = {.cookie = pn->cookie, .index = index};
+
+  packet[0] = (family == AF_INET6) ? PING_ICMP6_ECHO : PING_ICMP_ECHO;
+  packet[1] = 0;
+  memset(packet + 2, 0, 2);
+  memcpy(packet + 4, &ident, sizeof(ident));
+  memcpy(packet + 6, &seq, sizeof(seq));
+  memcpy(packet + PING_ICMP_HDR_SIZE, &payload, sizeof(payload));
+
+  /* The kernel computes the ICMPv6 checksum, which covers a pseudo header. */
+  if (family == AF_INET) {
+    uint16_t checksum = ping_native_checksum(packet, pn->packet_len);
+    memcpy(packet + 2, &checksum, sizeof(checksum));
+  }
+
+  /* A request that could not be sent counts as lost once it times out. */
+  t->sent = ping_native_now();
+  if (sendto(ps->fd, packet, pn->packet_len, 0, (struct sockaddr *)&t->addr,
+             t->addrlen) < 0)
+    c_complain(LOG_ERR, &pn->complaint,
+               "ping plugin: Sending to host %s failed: %s", t->hl->host,
+               STRERRNO);
+  else
+    c_release(LOG_NOTICE, &pn->complaint,
+              "ping plugin: Sending succeeded again.");
+} /* }}} void ping_native_send */
+
+static void ping_native_fire(ping_native_t *pn, uint32_t index) /* {{{ */
+{
+  ping_target_t *t = pn->targets + index;
+
+  if (!t->waiting) {
+    ping_native_send(pn, index);
+    t->waiting = 1;
+    ping_native_schedule(pn, index, t->deadline + pn->timeout);
+    return;
+  }
+
+  t->waiting = 0;
+  if (t->sent != 0) {
+    t->sent = 0;
+
+    pthread_mutex_lock(&ping_lock);
+    _Bool resolve = ping_host_update(t->hl, -1.0);
+    pthread_mutex_unlock(&ping_lock);
+
+    if (resolve)
+      ping_native_resolve_async(pn, index);
+  }
+
+  /* Relative to the previous deadline, so the schedule does not drift. */
+  ping_native_schedule(pn, index, t->deadline - pn->timeout + pn->interval);
+} /* }}} void ping_native_fire */
+
+/* Fires all timers up to and including the current tick. Timers fire up to
+ * one tick early. */
+static void ping_native_advance(ping_native_t *pn) /* {{{ */
+{
+  uint64_t now_tick = ping_native_now() / PING_WHEEL_TICK;
+
+  while (pn->tick < now_tick) {
+    pn->tick++;
+
+    uint32_t *slot = pn->wheel + (pn->tick % PING_WHEEL_SIZE);
+    uint32_t index = *slot;
+    *slot = PING_WHEEL_NONE;
+
+    while (index != PING_WHEEL_NONE) {
+      ping_target_t *t = pn->targets + index;
+      uint32_t next = t->wheel_next;
+
+      if ((t->deadline / PING_WHEEL_TICK) <= pn->tick) {
+        ping_native_fire(pn, index);
+      } else { /* due in a later revolution of the wheel */
+        t->wheel_next = *slot;
+        *slot = index;
+      }
+
+      index = next;
+    }
+  }
+} /* }}} void ping_native_advance */
+
+/* Returns the number of milliseconds until the next non-empty wheel slot. */
+static int ping_native_poll_timeout(ping_native_t const *pn) /* {{{ */
+{
+  uint64_t tick;
+
+  for (tick = pn->tick + 1; tick < pn->tick + PING_POLL_MAX_MS; tick++)
+    if (pn->wheel[tick % PING_WHEEL_SIZE] != PING_WHEEL_NONE)
+      break;
+
+  cdtime_t due = (cdtime_t)tick * PING_WHEEL_TICK;
+  cdtime_t now = ping_native_now();
+  if (due <= now)
+    return 0;
+  return (int)CDTIME_T_TO_MS(due - now) + 1;
+} /* }}} int ping_native_poll_timeout */
+
+static _Bool ping_native_same_host(ping_target_t const *t, /* {{{ */
+                                   struct sockaddr_storage const *ss) {
+  if (ss->ss_family != t->addr.ss_family)
+    return 0;
+
+  if (ss->ss_family == AF_INET6) {
+    struct sockaddr_in6 const *a = (void const *)ss;
+    struct sockaddr_in6 const *b = (void const *)&t->addr;
+    return memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(a->sin6_addr)) == 0;
+  }
+
+  struct sockaddr_in const *a = (void const *)ss;
+  struct sockaddr_in const *b = (void const *)&t->addr;
+  return a->sin_addr.s_addr == b->sin_addr.s_addr;
+} /* }}} _Bool ping_native_same_host */
+
+static void ping_native_receive(ping_native_t *pn, /* {{{ */
+                                ping_socket_t const *ps, int family) {
+  while (42) {
+    struct sockaddr_storage ss;
+    socklen_t ss_len = sizeof(ss);
+
+    ssize_t len = recvfrom(ps->fd, pn->buffer, sizeof(pn->buffer), 0,
+                           (struct sockaddr *)&ss, &ss_len);
+    if (len < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno != EAGAIN) && (errno != EWOULDBLOCK))
+        c_complain(LOG_ERR, &pn->complaint,
+                   "ping plugin: Receiving failed: %s", STRERRNO);
+      return;
+    }
+
+    cdtime_t now = ping_native_now();
+    uint8_t const *packet = pn->buffer;
+    size_t packet_len = (size_t)len;
+
+    /* Raw IPv4 sockets return the IP header, too. */
+    if (ps->raw && (family == AF_INET)) {
+      size_t ip_hdr_len;
+      if (packet_len < 1)
+        continue;
+      ip_hdr_len = 4 * (size_t)(packet[0] & 0x0f);
+      if (packet_len < ip_hdr_len)
+        continue;
+      packet += ip_hdr_len;
+      packet_len -= ip_hdr_len;
+    }
+
+    if (packet_len < PING_ICMP_HDR_SIZE + sizeof(ping_payload_t))
+      continue;
+    if ((packet[0] != ((family == AF_INET6) ? PING_ICMP6_ECHOREPLY
+                                            : PING_ICMP_ECHOREPLY)) ||
+        (packet[1] != 0))
+      continue;
+
+    /* Datagram sockets only receive replies to their own requests. The kernel
+     * replaces the identifier, so it is only checked for raw sockets. */
+    uint16_t ident;
+    uint16_t seq;
+    ping_payload_t payload;
+    memcpy(&ident, packet + 4, sizeof(ident));
+    memcpy(&seq, packet + 6, sizeof(seq));
+    memcpy(&payload, packet + PING_ICMP_HDR_SIZE, sizeof(payload));
+
+    if ((ps->raw && (ntohs(ident) != pn->ident)) ||
+        (payload.cookie != pn->cookie) || (payload.index >= pn->targets_num))
+      continue;
+
+    ping_target_t *t = pn->targets + payload.index;
+    if (!t->waiting || (t->sent == 0) || (ntohs(seq) != t->seq) ||
+        !ping_native_same_host(t, &ss))
+      continue;
+
+    double latency = 1000.0 * CDTIME_T_TO_DOUBLE(now - t->sent);
+    t->sent = 0;
+
+    pthread_mutex_lock(&ping_lock);
+    ping_host_update(t->hl, latency);
+    pthread_mutex_unlock(&ping_lock);
+  }
+} /* }}} void ping_native_receive */
+
+static void ping_native_destroy(ping_native_t *pn) /* {{{ */
+{
+  if (pn == NULL)
+    return;
+
+  /* Waits for a lookup in progress to time out. */
+  if (pn->resolve_thread_running) {
+    pthread_mutex_lock(&pn->resolve_lock);
+    pn->resolve_loop = 0;
+    pthread_cond_signal(&pn->resolve_cond);
+    pthread_mutex_unlock(&pn->resolve_lock);
+
+    pthread_join(pn->resolve_thread, /* retval = */ NULL);
+  }
+  pthread_mutex_destroy(&pn->resolve_lock);
+  pthread_cond_destroy(&pn->resolve_cond);
+
+  if (pn->sock4.fd >= 0)
+    close(pn->sock4.fd);
+  if (pn->sock6.fd >= 0)
+    close(pn->sock6.fd);
+
+  sfree(pn->targets);
+  sfree(pn->resolve_requests);
+  sfree(pn->resolve_results);
+  sfree(pn->packet);
+  sfree(pn);
+} /* }}} void ping_native_destroy */
+
+static ping_native_t *ping_native_create(void) /* {{{ */
+{
+  ping_native_t *pn = calloc(1, sizeof(*pn));
+  if (pn == NULL) {
+    ERROR("ping plugin: calloc failed.");
+    return NULL;
+  }
+
+  pn->sock4.fd = -1;
+  pn->sock6.fd = -1;
+  C_COMPLAIN_INIT(&pn->complaint);
+  pthread_mutex_init(&pn->resolve_lock, /* attr = */ NULL);
+  pthread_cond_init(&pn->resolve_cond, /* attr = */ NULL);
+  pn->ident = (uint16_t)cdrand_u();
+  pn->cookie = cdrand_u();
+  pn->interval = DOUBLE_TO_CDTIME_T(ping_interval);
+  pn->timeout = DOUBLE_TO_CDTIME_T(ping_timeout);
+
+  size_t data_len =
+      (ping_data != NULL) ? strlen(ping_data) : PING_DEF_DATA_SIZE;
+  if (data_len < sizeof(ping_payload_t))
+    data_len = sizeof(ping_payload_t);
+
+  pn->packet_len = PING_ICMP_HDR_SIZE + data_len;
+  pn->packet = calloc(1, pn->packet_len);
+
+  uint32_t hosts_num = 0;
+  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next)
+    hosts_num++;
+  pn->targets = calloc(hosts_num, sizeof(*pn->targets));
+  pn->resolve_requests = calloc(hosts_num, sizeof(*pn->resolve_requests));
+  pn->resolve_results = calloc(hosts_num, sizeof(*pn->resolve_results));
+
+  if ((pn->packet == NULL) || (pn->targets == NULL) ||
+      (pn->resolve_requests == NULL) || (pn->resolve_results == NULL)) {
+    ERROR("ping plugin: calloc failed.");
+    ping_native_destroy(pn);
+    return NULL;
+  }
+
+  /* The part of the payload after `ping_payload_t' is constant. */
+  for (size_t i = sizeof(ping_payload_t); i < data_len; i++)
+    pn->packet[PING_ICMP_HDR_SIZE + i] =
+        (ping_data != NULL) ? ping_data[i] : ('0' + i % 64);
+
+  for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next) {
+    ping_target_t *t = pn->targets + pn->targets_num;
+
+    t->hl = hl;
+    if (ping_native_resolve(pn, t) != 0) {
+      WARNING("ping plugin: Not pinging host %s.", hl->host);
+      continue;
+    }
+    pn->targets_num++;
+  }
+
+  if (pn->targets_num == 0) {
+    ERROR("ping plugin: No host could be added to ping object. Giving up.");
+    ping_native_destroy(pn);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(pn->wheel); i++)
+    pn->wheel[i] = PING_WHEEL_NONE;
+
+  /* Spread the first requests evenly across one interval. */
+  cdtime_t start = ping_native_now();
+  pn->tick = (start / PING_WHEEL_TICK) - 1;
+  for (uint32_t i = 0; i < pn->targets_num; i++)
+    ping_native_schedule(pn, i,
+                         start + (pn->interval / pn->targets_num) * i);
+
+  return pn;
+} /* }}} ping_native_t *ping_native_create */
+
+static void *ping_native_thread(void *arg) /* {{{ */
+{
+  ping_native_t *pn = ping_native_create();
+  if (pn == NULL) {
+    pthread_mutex_lock(&ping_lock);
+    ping_thread_error = 1;
+    pthread_mutex_unlock(&ping_lock);
+    return (void *)-1;
+  }
+
+  pthread_mutex_lock(&ping_lock);
+  while (ping_thread_loop > 0) {
+    pthread_mutex_unlock(&ping_lock);
+
+    ping_native_resolve_done(pn);
+    ping_native_advance(pn);
+
+    struct pollfd fds[2];
+    int families[2];
+    nfds_t fds_num = 0;
+    if (pn->sock4.fd >= 0) {
+      fds[fds_num] = (struct pollfd){.fd = pn->sock4.fd, .events = POLLIN};
+      families[fds_num++] = AF_INET;
+    }
+    if (pn->sock6.fd >= 0) {
+      fds[fds_num] = (struct pollfd){.fd = pn->sock6.fd, .events = POLLIN};
+      families[fds_num++] = AF_INET6;
+    }
+
+    int status = poll(fds, fds_num, ping_native_poll_timeout(pn));
+
+    pthread_mutex_lock(&ping_lock);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      ERROR("ping plugin: poll failed: %s", STRERRNO);
+      ping_thread_error = 1;
+      break;
+    }
+    pthread_mutex_unlock(&ping_lock);
+
+    for (nfds_t i = 0; (status > 0) && (i < fds_num); i++) {
+      if (fds[i].revents == 0)
+        continue;
+      ping_native_receive(pn, families[i] == AF_INET6 ? &pn->sock6 : &pn->sock4,
+                          families[i]);
+    }
+
+    pthread_mutex_lock(&ping_lock);
+  } /* while (ping_thread_loop > 0) */
+  pthread_mutex_unlock(&ping_lock);
+
+  ping_native_destroy(pn);
+  return (void *)0;
+} /* }}} void *ping_native_thread */
+
 static int start_thread(void) /* {{{ */
 {
   int status;
@@ -352,8 +1135,10 @@ static int start_thread(void) /* {{{ */
 
   ping_thread_loop = 1;
   ping_thread_error = 0;
-  status = plugin_thread_create(&ping_thread_id, /* attr = */ NULL, ping_thread,
-                                /* arg = */ (void *)0, "ping");
+  status = plugin_thread_create(
+      &ping_thread_id, /* attr = */ NULL,
+      (ping_engine == ENGINE_NATIVE) ? ping_native_thread : ping_thread,
+      /* arg = */ (void *)0, "ping");
   if (status != 0) {
     ping_thread_loop = 0;
     ERROR("ping plugin: Starting thread failed.");
@@ -409,7 +1194,9 @@ static int ping_init(void) /* {{{ */
   }
 
 #if defined(HAVE_SYS_CAPABILITY_H) && defined(CAP_NET_RAW)
-  if (check_capability(CAP_NET_RAW) != 0) {
+  /* The native engine falls back to unprivileged ICMP sockets. */
+  if ((ping_engine == ENGINE_LIBOPING) &&
+      (check_capability(CAP_NET_RAW) != 0)) {
     if (getuid() == 0)
       WARNING("ping plugin: Running collectd as root, but the CAP_NET_RAW "
               "capability is missing. The plugin's read function will probably "
@@ -461,11 +1248,8 @@ static int ping_config(const char *key, const char *value) /* {{{ */
     }
 
     hl->host = host;
-    hl->pkg_sent = 0;
-    hl->pkg_recv = 0;
     hl->pkg_missed = 0;
-    hl->latency_total = 0.0;
-    hl->latency_squared = 0.0;
+    ping_host_reset(hl);
     hl->next = hostlist_head;
     hostlist_head = hl;
   } else if (strcasecmp(key, "SourceAddress") == 0) {
@@ -534,6 +1318,15 @@ static int ping_config(const char *key, const char *value) /* {{{ */
     ping_max_missed = atoi(value);
     if (ping_max_missed < 0)
       INFO("ping plugin: MaxMissed < 0, disabled re-resolving of hosts");
+  } else if (strcasecmp(key, "Engine") == 0) {
+    if (strcasecmp(value, "liboping") == 0)
+      ping_engine = ENGINE_LIBOPING;
+    else if (strcasecmp(value, "native") == 0)
+      ping_engine = ENGINE_NATIVE;
+    else {
+      ERROR("ping plugin: Unknown engine: %s", value);
+      return 1;
+    }
   } else {
     return -1;
   }
@@ -561,12 +1354,8 @@ static int ping_read(void) /* {{{ */
 
     stop_thread();
 
-    for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next) {
-      hl->pkg_sent = 0;
-      hl->pkg_recv = 0;
-      hl->latency_total = 0.0;
-      hl->latency_squared = 0.0;
-    }
+    for (hostlist_t *hl = hostlist_head; hl != NULL; hl = hl->next)
+      ping_host_reset(hl);
 
     start_thread();
 
@@ -577,8 +1366,8 @@ static int ping_read(void) /* {{{ */
   {
     uint32_t pkg_sent;
     uint32_t pkg_recv;
-    double latency_total;
-    double latency_squared;
+    double latency_mean;
+    double latency_m2;
 
     double latency_average;
     double latency_stddev;
@@ -591,13 +1380,10 @@ static int ping_read(void) /* {{{ */
 
     pkg_sent = hl->pkg_sent;
     pkg_recv = hl->pkg_recv;
-    latency_total = hl->latency_total;
-    latency_squared = hl->latency_squared;
+    latency_mean = hl->latency_mean;
+    latency_m2 = hl->latency_m2;
 
-    hl->pkg_sent = 0;
-    hl->pkg_recv = 0;
-    hl->latency_total = 0.0;
-    hl->latency_squared = 0.0;
+    ping_host_reset(hl);
 
     pthread_mutex_unlock(&ping_lock);
 
@@ -607,11 +1393,11 @@ static int ping_read(void) /* {{{ */
       continue;
     }
 
-    /* Calculate average. Beware of division by zero. */
+    /* Calculate average. */
     if (pkg_recv == 0)
       latency_average = NAN;
     else
-      latency_average = latency_total / ((double)pkg_recv);
+      latency_average = latency_mean;
 
     /* Calculate standard deviation. Beware even more of division by zero. */
     if (pkg_recv == 0)
@@ -619,9 +1405,7 @@ static int ping_read(void) /* {{{ */
     else if (pkg_recv == 1)
       latency_stddev = 0.0;
     else
-      latency_stddev = sqrt(((((double)pkg_recv) * latency_squared) -
-                             (latency_total * latency_total)) /
-                            ((double)(pkg_recv * (pkg_recv - 1))));
+      latency_stddev = sqrt(latency_m2 / ((double)(pkg_recv - 1)));
 
     /* Calculate drop rate. */
     droprate = ((double)(pkg_sent - pkg_recv)) / ((double)pkg_sent);
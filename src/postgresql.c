@@ -119,6 +119,14 @@ typedef struct {
   udb_query_t **queries;
   size_t queries_num;
 
+  /* Server-side prepared statements of the queries on the current
+   * connection: zero if `queries[i]' has not been prepared yet, one if it
+   * has, and -1 if it can't be prepared (e.g. because it consists of multiple
+   * statements) and is always executed as is. */
+  int *q_prepared;
+  _Bool prepare_queries;
+  _Bool pipeline_queries;
+
   c_psql_writer_t **writers;
   size_t writers_num;
 
@@ -232,6 +240,10 @@ static c_psql_database_t *c_psql_database_new(const char *name) {
   db->queries = NULL;
   db->queries_num = 0;
 
+  db->q_prepared = NULL;
+  db->prepare_queries = 0;
+  db->pipeline_queries = 0;
+
   db->writers = NULL;
   db->writers_num = 0;
 
@@ -284,6 +296,7 @@ static void c_psql_database_delete(void *data) {
     for (size_t i = 0; i < db->queries_num; ++i)
       udb_query_delete_preparation_area(db->q_prep_areas[i]);
   free(db->q_prep_areas);
+  sfree(db->q_prepared);
 
   sfree(db->queries);
   db->queries_num = 0;
@@ -375,6 +388,10 @@ static int c_psql_check_connection(c_psql_database_t *db) {
     }
 
     db->proto_version = PQprotocolVersion(db->conn);
+
+    /* Prepared statements don't survive the connection. */
+    if (db->q_prepared != NULL)
+      memset(db->q_prepared, 0, db->queries_num * sizeof(*db->q_prepared));
   }
 
   db->server_version = PQserverVersion(db->conn);
@@ -407,13 +424,14 @@ static PGresult *c_psql_exec_query_noparams(c_psql_database_t *db,
   return PQexec(db->conn, udb_query_get_statement(q));
 } /* c_psql_exec_query_noparams */
 
-static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
-                                          c_psql_user_data_t *data) {
-  const char *params[db->max_params_num];
-  char interval[64];
-
+/* Fills `params' with the values of the query's parameters. `interval' is
+ * used as a buffer for the interval parameter. Returns the number of
+ * parameters. */
+static int c_psql_query_params(c_psql_database_t *db, /* {{{ */
+                               c_psql_user_data_t *data, const char **params,
+                               char *interval, size_t interval_size) {
   if ((data == NULL) || (data->params_num == 0))
-    return c_psql_exec_query_noparams(db, q);
+    return 0;
 
   assert(db->max_params_num >= data->params_num);
 
@@ -430,7 +448,7 @@ static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
       params[i] = db->user;
       break;
     case C_PSQL_PARAM_INTERVAL:
-      snprintf(interval, sizeof(interval), "%.3f",
+      snprintf(interval, interval_size, "%.3f",
                (db->interval > 0) ? CDTIME_T_TO_DOUBLE(db->interval)
                                   : plugin_get_interval());
       params[i] = interval;
@@ -443,16 +461,92 @@ static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
     }
   }
 
-  return PQexecParams(db->conn, udb_query_get_statement(q), data->params_num,
-                      NULL, (const char *const *)params, NULL, NULL, 0);
+  return data->params_num;
+} /* }}} c_psql_query_params */
+
+static PGresult *c_psql_exec_query_params(c_psql_database_t *db, udb_query_t *q,
+                                          c_psql_user_data_t *data) {
+  const char *params[db->max_params_num];
+  char interval[64];
+
+  if ((data == NULL) || (data->params_num == 0))
+    return c_psql_exec_query_noparams(db, q);
+
+  int params_num =
+      c_psql_query_params(db, data, params, interval, sizeof(interval));
+
+  return PQexecParams(db->conn, udb_query_get_statement(q), params_num, NULL,
+                      (const char *const *)params, NULL, NULL, 0);
 } /* c_psql_exec_query_params */
 
-/* db->db_lock must be locked when calling this function */
-static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
-                             udb_query_preparation_area_t *prep_area) {
-  PGresult *res;
+static void c_psql_statement_name(size_t idx, char *buffer, /* {{{ */
+                                  size_t buffer_size) {
+  snprintf(buffer, buffer_size, "collectd_query_%" PRIsz, idx);
+} /* }}} c_psql_statement_name */
+
+/* Prepares `db->queries[idx]' on the current connection unless that has
+ * been done before. Returns zero if the prepared statement may be used.
+ * db->db_lock must be locked when calling this function. */
+static int c_psql_prepare_query(c_psql_database_t *db, size_t idx) /* {{{ */
+{
+  udb_query_t *q = db->queries[idx];
+  c_psql_user_data_t *data = udb_query_get_user_data(q);
+  char name[64];
+
+  if (!db->prepare_queries || (3 > db->proto_version))
+    return -1;
 
-  c_psql_user_data_t *data;
+  if (db->q_prepared[idx] != 0)
+    return (db->q_prepared[idx] > 0) ? 0 : -1;
+
+  c_psql_statement_name(idx, name, sizeof(name));
+
+  PGresult *res =
+      PQprepare(db->conn, name, udb_query_get_statement(q),
+                (data != NULL) ? data->params_num : 0, /* paramTypes = */ NULL);
+  if (PGRES_COMMAND_OK != PQresultStatus(res)) {
+    /* Try again once the connection has been re-established. */
+    if (CONNECTION_OK != PQstatus(db->conn)) {
+      PQclear(res);
+      return -1;
+    }
+
+    log_info("Query \"%s\" can't be used as a prepared statement and will "
+             "be executed as is: %s",
+             udb_query_get_name(q), PQerrorMessage(db->conn));
+    db->q_prepared[idx] = -1;
+    PQclear(res);
+    return -1;
+  }
+
+  PQclear(res);
+  db->q_prepared[idx] = 1;
+  return 0;
+} /* }}} c_psql_prepare_query */
+
+static PGresult *c_psql_exec_query_prepared(c_psql_database_t *db, /* {{{ */
+                                            size_t idx) {
+  const char *params[db->max_params_num];
+  char interval[64];
+  char name[64];
+
+  int params_num =
+      c_psql_query_params(db, udb_query_get_user_data(db->queries[idx]),
+                          params, interval, sizeof(interval));
+  c_psql_statement_name(idx, name, sizeof(name));
+
+  return PQexecPrepared(db->conn, name, params_num,
+                        (const char *const *)params, NULL, NULL, 0);
+} /* }}} c_psql_exec_query_prepared */
+
+static int c_psql_exec_query(c_psql_database_t *db, size_t idx);
+
+/* Walks the result of `db->queries[idx]' and frees it.
+ * db->db_lock must be locked when calling this function */
+static int c_psql_handle_result(c_psql_database_t *db, size_t idx, /* {{{ */
+                                PGresult *res) {
+  udb_query_t *q = db->queries[idx];
+  udb_query_preparation_area_t *prep_area = db->q_prep_areas[idx];
 
   const char *host;
 
@@ -463,23 +557,6 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
   int rows_num;
   int status;
 
-  /* The user data may hold parameter information, but may be NULL. */
-  data = udb_query_get_user_data(q);
-
-  /* Versions up to `3' don't know how to handle parameters. */
-  if (3 <= db->proto_version)
-    res = c_psql_exec_query_params(db, q, data);
-  else if ((NULL == data) || (0 == data->params_num))
-    res = c_psql_exec_query_noparams(db, q);
-  else {
-    log_err("Connection to database \"%s\" (%s) does not support "
-            "parameters (protocol version %d) - "
-            "cannot execute query \"%s\".",
-            db->database, db->instance, db->proto_version,
-            udb_query_get_name(q));
-    return -1;
-  }
-
   /* give c_psql_write() a chance to acquire the lock if called recursively
    * through dispatch_values(); this will happen if, both, queries and
    * writers are configured for a single connection */
@@ -491,10 +568,15 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
   if (PGRES_TUPLES_OK != PQresultStatus(res)) {
     pthread_mutex_lock(&db->db_lock);
 
+    /* Have the statement prepared again next time, in case it was dropped
+     * on the server side (e.g. by "DISCARD ALL"). */
+    if (db->q_prepared[idx] > 0)
+      db->q_prepared[idx] = 0;
+
     if ((CONNECTION_OK != PQstatus(db->conn)) &&
         (0 == c_psql_check_connection(db))) {
       PQclear(res);
-      return c_psql_exec_query(db, q, prep_area);
+      return c_psql_exec_query(db, idx);
     }
 
     log_err("Failed to execute SQL query: %s", PQerrorMessage(db->conn));
@@ -581,8 +663,111 @@ static int c_psql_exec_query(c_psql_database_t *db, udb_query_t *q,
 
   BAIL_OUT(0);
 #undef BAIL_OUT
+} /* }}} c_psql_handle_result */
+
+/* db->db_lock must be locked when calling this function */
+static int c_psql_exec_query(c_psql_database_t *db, size_t idx) {
+  udb_query_t *q = db->queries[idx];
+  PGresult *res;
+
+  c_psql_user_data_t *data;
+
+  /* The user data may hold parameter information, but may be NULL. */
+  data = udb_query_get_user_data(q);
+
+  /* Versions up to `3' don't know how to handle parameters. */
+  if (0 == c_psql_prepare_query(db, idx))
+    res = c_psql_exec_query_prepared(db, idx);
+  else if (3 <= db->proto_version)
+    res = c_psql_exec_query_params(db, q, data);
+  else if ((NULL == data) || (0 == data->params_num))
+    res = c_psql_exec_query_noparams(db, q);
+  else {
+    log_err("Connection to database \"%s\" (%s) does not support "
+            "parameters (protocol version %d) - "
+            "cannot execute query \"%s\".",
+            db->database, db->instance, db->proto_version,
+            udb_query_get_name(q));
+    return -1;
+  }
+
+  return c_psql_handle_result(db, idx, res);
 } /* c_psql_exec_query */
 
+#ifdef LIBPQ_HAS_PIPELINING
+/* Sends all prepared queries to the server at once and handles the results
+ * afterwards, so that they only cost a single round trip. Every query is
+ * followed by a sync point, so that a failing query doesn't abort the
+ * following ones. Queries that can't be prepared are left for
+ * c_psql_exec_query(); `done[i]' is set for all queries handled here.
+ * db->db_lock must be locked when calling this function */
+static int c_psql_exec_pipelined(c_psql_database_t *db, _Bool *done) /* {{{ */
+{
+  _Bool prepared[db->queries_num];
+  size_t prepared_num = 0;
+  size_t sent[db->queries_num];
+  PGresult *results[db->queries_num];
+  size_t sent_num = 0;
+  int success = 0;
+
+  /* PQprepare() is synchronous, which libpq refuses in pipeline mode. */
+  for (size_t i = 0; i < db->queries_num; ++i) {
+    prepared[i] = !done[i] && (0 == c_psql_prepare_query(db, i));
+    if (prepared[i])
+      prepared_num++;
+  }
+
+  if ((prepared_num == 0) || !PQenterPipelineMode(db->conn))
+    return 0;
+
+  for (size_t i = 0; i < db->queries_num; ++i) {
+    const char *params[db->max_params_num];
+    char interval[64];
+    char name[64];
+
+    if (!prepared[i])
+      continue;
+
+    int params_num =
+        c_psql_query_params(db, udb_query_get_user_data(db->queries[i]),
+                            params, interval, sizeof(interval));
+    c_psql_statement_name(i, name, sizeof(name));
+
+    if (!PQsendQueryPrepared(db->conn, name, params_num,
+                             (const char *const *)params, NULL, NULL, 0) ||
+        !PQpipelineSync(db->conn)) {
+      log_warn("Failed to send query \"%s\": %s",
+               udb_query_get_name(db->queries[i]), PQerrorMessage(db->conn));
+      break;
+    }
+
+    sent[sent_num] = i;
+    sent_num++;
+  }
+
+  /* Each query yields its result, NULL, and the result of the sync point. */
+  for (size_t i = 0; i < sent_num; ++i) {
+    results[i] = PQgetResult(db->conn);
+    if (results[i] != NULL) {
+      PGresult *tmp;
+      while ((tmp = PQgetResult(db->conn)) != NULL)
+        PQclear(tmp);
+    }
+    PQclear(PQgetResult(db->conn));
+  }
+
+  PQexitPipelineMode(db->conn);
+
+  for (size_t i = 0; i < sent_num; ++i) {
+    done[sent[i]] = 1;
+    if (0 == c_psql_handle_result(db, sent[i], results[i]))
+      success = 1;
+  }
+
+  return success;
+} /* }}} c_psql_exec_pipelined */
+#endif /* LIBPQ_HAS_PIPELINING */
+
 static int c_psql_read(user_data_t *ud) {
   c_psql_database_t *db;
 
@@ -606,18 +791,21 @@ static int c_psql_read(user_data_t *ud) {
     return -1;
   }
 
-  for (size_t i = 0; i < db->queries_num; ++i) {
-    udb_query_preparation_area_t *prep_area;
-    udb_query_t *q;
+  _Bool done[db->queries_num];
+  for (size_t i = 0; i < db->queries_num; ++i)
+    done[i] = (0 != db->server_version) &&
+              (udb_query_check_version(db->queries[i], db->server_version) <= 0);
 
-    prep_area = db->q_prep_areas[i];
-    q = db->queries[i];
+#ifdef LIBPQ_HAS_PIPELINING
+  if (db->pipeline_queries && (3 <= db->proto_version))
+    success = c_psql_exec_pipelined(db, done);
+#endif
 
-    if ((0 != db->server_version) &&
-        (udb_query_check_version(q, db->server_version) <= 0))
+  for (size_t i = 0; i < db->queries_num; ++i) {
+    if (done[i])
       continue;
 
-    if (0 == c_psql_exec_query(db, q, prep_area))
+    if (0 == c_psql_exec_query(db, i))
       success = 1;
   }
 
@@ -1168,6 +1356,10 @@ static int c_psql_config_database(oconfig_item_t *ci) {
       cf_util_get_cdtime(c, &db->commit_interval);
     else if (strcasecmp("ExpireDelay", c->key) == 0)
       cf_util_get_cdtime(c, &db->expire_delay);
+    else if (strcasecmp("PrepareQueries", c->key) == 0)
+      cf_util_get_boolean(c, &db->prepare_queries);
+    else if (strcasecmp("PipelineQueries", c->key) == 0)
+      cf_util_get_boolean(c, &db->pipeline_queries);
     else
       log_warn("Ignoring unknown config key \"%s\".", c->key);
   }
@@ -1182,8 +1374,9 @@ static int c_psql_config_database(oconfig_item_t *ci) {
   if (db->queries_num > 0) {
     db->q_prep_areas = (udb_query_preparation_area_t **)calloc(
         db->queries_num, sizeof(*db->q_prep_areas));
+    db->q_prepared = calloc(db->queries_num, sizeof(*db->q_prepared));
 
-    if (db->q_prep_areas == NULL) {
+    if ((db->q_prep_areas == NULL) || (db->q_prepared == NULL)) {
       log_err("Out of memory.");
       c_psql_database_delete(db);
       return -1;
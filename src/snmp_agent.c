@@ -54,6 +54,26 @@ struct oid_s {
 };
 typedef struct oid_s oid_t;
 
+/* A single table cell, i.e. a column OID plus the row's index suffix, and
+ * the variable data served for it. */
+struct snmp_agent_cell_s {
+  oid *name;
+  size_t name_len;
+  u_char type;
+  size_t data_len;
+  u_char data[DATA_MAX_NAME_LEN];
+};
+typedef struct snmp_agent_cell_s snmp_agent_cell_t;
+
+/* All cells of a table, sorted by OID. */
+struct snmp_agent_snapshot_s {
+  snmp_agent_cell_t *cells;
+  size_t cells_num;
+  oid *names;
+  size_t names_num;
+};
+typedef struct snmp_agent_snapshot_s snmp_agent_snapshot_t;
+
 struct table_definition_s {
   char *name;
   oid_t index_oid;
@@ -61,9 +81,23 @@ struct table_definition_s {
   llist_t *columns;
   c_avl_tree_t *instance_index;
   c_avl_tree_t *index_instance;
+  /* `snapshot' is only accessed by the AgentX thread, which answers requests
+   * from it. The read callback builds a new snapshot once per interval and
+   * hands it over through `pending'. */
+  snmp_agent_snapshot_t *snapshot;
+  snmp_agent_snapshot_t *pending;
+  /* Incremented whenever rows are added or removed, so that a snapshot built
+   * from outdated rows isn't published. Protected by g_agent->lock. */
+  unsigned long generation;
 };
 typedef struct table_definition_s table_definition_t;
 
+struct snmp_agent_row_s {
+  char instance[DATA_MAX_NAME_LEN];
+  int index;
+};
+typedef struct snmp_agent_row_s snmp_agent_row_t;
+
 struct data_definition_s {
   char *name;
   char *plugin;
@@ -332,6 +366,287 @@ static int snmp_agent_unregister_oid_string(oid_t *oid, const char *key) {
   return unregister_mib(new_oid.oid, new_oid.oid_len);
 }
 
+static void snmp_agent_snapshot_free(snmp_agent_snapshot_t *snap) {
+  if (snap == NULL)
+    return;
+
+  sfree(snap->cells);
+  sfree(snap->names);
+  sfree(snap);
+}
+
+static int snmp_agent_cell_compare(const void *a, const void *b) {
+  const snmp_agent_cell_t *c0 = a;
+  const snmp_agent_cell_t *c1 = b;
+
+  return snmp_oid_compare(c0->name, c0->name_len, c1->name, c1->name_len);
+}
+
+/* Copies the table's rows, so that values can be looked up without holding
+ * g_agent->lock. Also returns the table's generation the rows belong to. */
+static int snmp_agent_snapshot_rows(table_definition_t *td,
+                                    snmp_agent_row_t **ret_rows,
+                                    size_t *ret_rows_num,
+                                    unsigned long *ret_generation) {
+  snmp_agent_row_t *rows;
+  size_t rows_num = 0;
+  char *instance;
+  void *value;
+
+  pthread_mutex_lock(&g_agent->lock);
+
+  rows = calloc((size_t)c_avl_size(td->instance_index) + 1, sizeof(*rows));
+  if (rows == NULL) {
+    pthread_mutex_unlock(&g_agent->lock);
+    return -ENOMEM;
+  }
+
+  c_avl_iterator_t *iter = c_avl_get_iterator(td->instance_index);
+  while (c_avl_iterator_next(iter, (void *)&instance, &value) == 0) {
+    sstrncpy(rows[rows_num].instance, instance,
+             sizeof(rows[rows_num].instance));
+    rows[rows_num].index = td->index_oid.oid_len ? *((int *)value) : -1;
+    rows_num++;
+  }
+  c_avl_iterator_destroy(iter);
+  *ret_generation = td->generation;
+
+  pthread_mutex_unlock(&g_agent->lock);
+
+  *ret_rows = rows;
+  *ret_rows_num = rows_num;
+  return 0;
+}
+
+static void snmp_agent_snapshot_add(snmp_agent_snapshot_t *snap,
+                                    const table_definition_t *td,
+                                    const oid_t *column,
+                                    const snmp_agent_row_t *row, u_char type,
+                                    const void *data, size_t data_len) {
+  size_t key_len = strlen(row->instance);
+  size_t suffix_len = td->index_oid.oid_len ? 1 : 1 + key_len;
+
+  /* Same limit as for the registered OIDs, see
+   * snmp_agent_generate_string2oid(). */
+  if ((column->oid_len + suffix_len >= MAX_OID_LEN) ||
+      (data_len > sizeof(snap->cells[0].data)))
+    return;
+
+  snmp_agent_cell_t *cell = snap->cells + snap->cells_num;
+  cell->name = snap->names + snap->names_num;
+
+  memcpy(cell->name, column->oid, column->oid_len * sizeof(oid));
+  cell->name_len = column->oid_len;
+  if (td->index_oid.oid_len) {
+    cell->name[cell->name_len++] = row->index;
+  } else {
+    cell->name[cell->name_len++] = key_len;
+    for (size_t i = 0; i < key_len; i++)
+      cell->name[cell->name_len++] = row->instance[i];
+  }
+
+  cell->type = type;
+  cell->data_len = data_len;
+  memcpy(cell->data, data, data_len);
+
+  snap->names_num += cell->name_len;
+  snap->cells_num++;
+}
+
+/* Reads the current values of all cells of `td' from the value cache. */
+static snmp_agent_snapshot_t *
+snmp_agent_snapshot_create(table_definition_t *td,
+                           unsigned long *ret_generation) {
+  snmp_agent_snapshot_t *snap;
+  snmp_agent_row_t *rows = NULL;
+  size_t rows_num = 0;
+  size_t cells_max = 0;
+  size_t names_max = 0;
+
+  if (snmp_agent_snapshot_rows(td, &rows, &rows_num, ret_generation) != 0)
+    return NULL;
+
+  for (size_t r = 0; r < rows_num; r++) {
+    size_t suffix_len =
+        td->index_oid.oid_len ? 1 : 1 + strlen(rows[r].instance);
+
+    if (td->index_oid.oid_len) {
+      cells_max++;
+      names_max += td->index_oid.oid_len + suffix_len;
+    }
+
+    for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
+      data_definition_t *dd = de->value;
+
+      for (size_t i = 0; i < dd->oids_len; i++) {
+        cells_max++;
+        names_max += dd->oids[i].oid_len + suffix_len;
+      }
+    }
+  }
+
+  snap = calloc(1, sizeof(*snap));
+  if (snap == NULL) {
+    sfree(rows);
+    return NULL;
+  }
+  snap->cells = calloc(cells_max + 1, sizeof(*snap->cells));
+  snap->names = calloc(names_max + 1, sizeof(*snap->names));
+  if ((snap->cells == NULL) || (snap->names == NULL)) {
+    snmp_agent_snapshot_free(snap);
+    sfree(rows);
+    return NULL;
+  }
+
+  for (size_t r = 0; r < rows_num; r++) {
+    snmp_agent_row_t *row = rows + r;
+
+    if (td->index_oid.oid_len)
+      snmp_agent_snapshot_add(snap, td, &td->index_oid, row, ASN_INTEGER,
+                              &row->index, sizeof(row->index));
+
+    for (llentry_t *de = llist_head(td->columns); de != NULL; de = de->next) {
+      data_definition_t *dd = de->value;
+
+      if (dd->is_instance) {
+        snmp_agent_snapshot_add(snap, td, &dd->oids[0], row, ASN_OCTET_STR,
+                                row->instance, strlen(row->instance));
+        continue;
+      }
+
+      const data_set_t *ds = plugin_get_ds(dd->type);
+      if (ds == NULL)
+        continue;
+
+      char name[DATA_MAX_NAME_LEN];
+      format_name(name, sizeof(name), hostname_g, dd->plugin, row->instance,
+                  dd->type, dd->type_instance);
+
+      value_t *values;
+      size_t values_num;
+      if (uc_get_value_by_name(name, &values, &values_num) != 0)
+        continue;
+
+      for (size_t i = 0; (i < dd->oids_len) && (i < values_num); i++) {
+        u_char data[DATA_MAX_NAME_LEN];
+        size_t data_len = sizeof(data);
+
+        if (snmp_agent_set_vardata(data, &data_len, dd->oids[i].type,
+                                   dd->scale, dd->shift, &values[i],
+                                   sizeof(values[i]), ds->ds[i].type) != 0)
+          continue;
+
+        snmp_agent_snapshot_add(snap, td, &dd->oids[i], row, dd->oids[i].type,
+                                data, data_len);
+      }
+
+      sfree(values);
+    }
+  }
+
+  sfree(rows);
+
+  qsort(snap->cells, snap->cells_num, sizeof(*snap->cells),
+        snmp_agent_cell_compare);
+
+  return snap;
+}
+
+/* Read callback: replaces the snapshots of all tables. */
+static int snmp_agent_snapshot_refresh(void) {
+  for (llentry_t *te = llist_head(g_agent->tables); te != NULL; te = te->next) {
+    table_definition_t *td = te->value;
+
+    unsigned long generation;
+    snmp_agent_snapshot_t *snap = snmp_agent_snapshot_create(td, &generation);
+    if (snap == NULL) {
+      ERROR(PLUGIN_NAME ": Failed to create snapshot of '%s' table",
+            td->name);
+      continue;
+    }
+
+    /* If rows have been added or removed while the values were looked up, the
+     * table has been invalidated in the meantime and the snapshot is dropped.
+     * A snapshot the AgentX thread hasn't picked up yet is outdated. */
+    pthread_mutex_lock(&g_agent->lock);
+    if (td->generation == generation)
+      snap = __atomic_exchange_n(&td->pending, snap, __ATOMIC_ACQ_REL);
+    pthread_mutex_unlock(&g_agent->lock);
+
+    snmp_agent_snapshot_free(snap);
+  }
+
+  return 0;
+}
+
+/* Drops the snapshot of `td' after rows have been added or removed, so that
+ * requests are answered from the value cache until the next refresh. A removed
+ * row's index may be reused by a new row right away. Must be called with
+ * g_agent->lock held. */
+static void snmp_agent_snapshot_invalidate(table_definition_t *td) {
+  td->generation++;
+
+  snmp_agent_snapshot_t *snap = calloc(1, sizeof(*snap));
+  if (snap == NULL)
+    return;
+
+  snmp_agent_snapshot_free(
+      __atomic_exchange_n(&td->pending, snap, __ATOMIC_ACQ_REL));
+}
+
+/* Called by the AgentX thread between requests, so no request can still be
+ * using the old snapshot. */
+static void snmp_agent_snapshot_swap(void) {
+  for (llentry_t *te = llist_head(g_agent->tables); te != NULL; te = te->next) {
+    table_definition_t *td = te->value;
+
+    snmp_agent_snapshot_t *snap =
+        __atomic_exchange_n(&td->pending, NULL, __ATOMIC_ACQ_REL);
+    if (snap == NULL)
+      continue;
+
+    snmp_agent_snapshot_free(td->snapshot);
+    td->snapshot = snap;
+  }
+}
+
+/* Answers a request for a table cell from the tables' snapshots. Returns
+ * non-zero if the cell isn't contained in any snapshot, e.g. because the row
+ * has been added after the last refresh. */
+static int snmp_agent_snapshot_reply(struct netsnmp_request_info_s *requests) {
+  oid *name = requests->requestvb->name;
+  size_t name_len = requests->requestvb->name_length;
+
+  for (llentry_t *te = llist_head(g_agent->tables); te != NULL; te = te->next) {
+    table_definition_t *td = te->value;
+    snmp_agent_snapshot_t *snap = td->snapshot;
+
+    if (snap == NULL)
+      continue;
+
+    size_t lo = 0;
+    size_t hi = snap->cells_num;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      snmp_agent_cell_t *cell = snap->cells + mid;
+      int cmp = snmp_oid_compare(name, name_len, cell->name, cell->name_len);
+
+      if (cmp < 0) {
+        hi = mid;
+      } else if (cmp > 0) {
+        lo = mid + 1;
+      } else {
+        requests->requestvb->type = cell->type;
+        snmp_set_var_typed_value(requests->requestvb, cell->type, cell->data,
+                                 cell->data_len);
+        return 0;
+      }
+    }
+  }
+
+  return -1;
+}
+
 static int snmp_agent_table_row_remove(table_definition_t *td,
                                        const char *instance) {
   int *index = NULL;
@@ -385,6 +700,8 @@ static int snmp_agent_table_row_remove(table_definition_t *td,
     sfree(ins);
   }
 
+  snmp_agent_snapshot_invalidate(td);
+
   return 0;
 }
 
@@ -393,6 +710,8 @@ static int snmp_agent_clear_missing(const value_list_t *vl,
   if (vl == NULL)
     return -EINVAL;
 
+  pthread_mutex_lock(&g_agent->lock);
+
   for (llentry_t *te = llist_head(g_agent->tables); te != NULL; te = te->next) {
     table_definition_t *td = te->value;
 
@@ -403,12 +722,15 @@ static int snmp_agent_clear_missing(const value_list_t *vl,
         if (CHECK_DD_TYPE(dd, vl->plugin, vl->plugin_instance, vl->type,
                           vl->type_instance)) {
           snmp_agent_table_row_remove(td, vl->plugin_instance);
+          pthread_mutex_unlock(&g_agent->lock);
           return 0;
         }
       }
     }
   }
 
+  pthread_mutex_unlock(&g_agent->lock);
+
   return 0;
 }
 
@@ -512,6 +834,9 @@ static void snmp_agent_free_table(table_definition_t **td) {
     (*td)->instance_index = NULL;
   }
 
+  snmp_agent_snapshot_free((*td)->snapshot);
+  snmp_agent_snapshot_free((*td)->pending);
+
   sfree((*td)->name);
   sfree(*td);
 
@@ -576,6 +901,9 @@ snmp_agent_table_oid_handler(struct netsnmp_mib_handler_s *handler,
     return SNMP_ERR_NOERROR;
   }
 
+  if (snmp_agent_snapshot_reply(requests) == 0)
+    return SNMP_ERR_NOERROR;
+
   pthread_mutex_lock(&g_agent->lock);
 
   oid_t oid;
@@ -664,6 +992,9 @@ static int snmp_agent_table_index_oid_handler(
     return SNMP_ERR_NOERROR;
   }
 
+  if (snmp_agent_snapshot_reply(requests) == 0)
+    return SNMP_ERR_NOERROR;
+
   pthread_mutex_lock(&g_agent->lock);
 
   oid_t oid;
@@ -1311,6 +1642,8 @@ static int snmp_agent_update_index(table_definition_t *td,
     }
   }
 
+  snmp_agent_snapshot_invalidate(td);
+
   DEBUG(PLUGIN_NAME ": Updated index for '%s' table [%d, %s]", td->name,
         (index != NULL) ? *index : -1, ins);
 
@@ -1456,6 +1789,7 @@ static int snmp_agent_init(void) {
   if (llist_head(g_agent->tables) != NULL) {
     plugin_register_write(PLUGIN_NAME, snmp_agent_collect, NULL);
     plugin_register_missing(PLUGIN_NAME, snmp_agent_clear_missing, NULL);
+    plugin_register_read(PLUGIN_NAME, snmp_agent_snapshot_refresh);
   }
 
   return 0;
@@ -1468,6 +1802,7 @@ static void *snmp_agent_thread_run(void __attribute__((unused)) * arg) {
     pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
 
     pthread_mutex_lock(&g_agent->agentx_lock);
+    snmp_agent_snapshot_swap();
     agent_check_and_process(0); /* 0 == don't block */
     pthread_mutex_unlock(&g_agent->agentx_lock);
 
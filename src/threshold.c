@@ -27,7 +27,7 @@
 
 #include "common.h"
 #include "plugin.h"
-#include "utils_avltree.h"
+#include "utils_btree.h"
 #include "utils_cache.h"
 #include "utils_threshold.h"
 
@@ -84,7 +84,7 @@ static int ut_threshold_add(const threshold_t *th) { /* {{{ */
 
   if (th_ptr == NULL) /* no such threshold yet */
   {
-    status = c_avl_insert(threshold_tree, name_copy, th_copy);
+    status = c_btree_insert(threshold_tree, name_copy, th_copy);
   } else /* th_ptr points to the last threshold in the list */
   {
     th_ptr->next = th_copy;
@@ -95,7 +95,7 @@ static int ut_threshold_add(const threshold_t *th) { /* {{{ */
   pthread_mutex_unlock(&threshold_lock);
 
   if (status != 0) {
-    ERROR("ut_threshold_add: c_avl_insert (%s) failed.", name);
+    ERROR("ut_threshold_add: c_btree_insert (%s) failed.", name);
     sfree(name_copy);
     sfree(th_copy);
   }
@@ -784,12 +784,12 @@ static int ut_missing(const value_list_t *vl,
 
 static int ut_config(oconfig_item_t *ci) { /* {{{ */
   int status = 0;
-  int old_size = c_avl_size(threshold_tree);
+  int old_size = c_btree_size(threshold_tree);
 
   if (threshold_tree == NULL) {
-    threshold_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+    threshold_tree = c_btree_create(/* compare = */ NULL);
     if (threshold_tree == NULL) {
-      ERROR("ut_config: c_avl_create failed.");
+      ERROR("ut_config: c_btree_create failed.");
       return -1;
     }
   }
@@ -821,7 +821,7 @@ static int ut_config(oconfig_item_t *ci) { /* {{{ */
   }
 
   /* register callbacks if this is the first time we see a valid config */
-  if ((old_size == 0) && (c_avl_size(threshold_tree) > 0)) {
+  if ((old_size == 0) && (c_btree_size(threshold_tree) > 0)) {
     plugin_register_missing("threshold", ut_missing,
                             /* user data = */ NULL);
     plugin_register_write("threshold", ut_check_threshold,
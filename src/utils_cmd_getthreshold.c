@@ -29,7 +29,7 @@
 #include "common.h"
 #include "plugin.h"
 
-#include "utils_avltree.h"
+#include "utils_btree.h"
 #include "utils_cmd_getthreshold.h"
 #include "utils_parse_option.h" /* for `parse_string' */
 #include "utils_threshold.h"
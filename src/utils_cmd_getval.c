@@ -33,6 +33,27 @@
 #include "utils_cmd_getval.h"
 #include "utils_parse_option.h"
 
+/* Parses an epoch time, or a negative number of seconds relative to now. */
+static int parse_range_time(const char *str, cdtime_t *ret_time) {
+  char *endptr = NULL;
+  double t;
+
+  errno = 0;
+  t = strtod(str, &endptr);
+  if ((endptr == str) || (*endptr != 0) || (errno != 0) || !isfinite(t))
+    return -1;
+
+  if (t < 0.0) {
+    cdtime_t now = cdtime();
+    cdtime_t ago = DOUBLE_TO_CDTIME_T(-t);
+    *ret_time = (ago < now) ? (now - ago) : 0;
+  } else {
+    *ret_time = DOUBLE_TO_CDTIME_T(t);
+  }
+
+  return 0;
+} /* int parse_range_time */
+
 cmd_status_t cmd_parse_getval(size_t argc, char **argv,
                               cmd_getval_t *ret_getval,
                               const cmd_options_t *opts,
@@ -46,12 +67,52 @@ cmd_status_t cmd_parse_getval(size_t argc, char **argv,
     return CMD_ERROR;
   }
 
-  if (argc != 1) {
-    if (argc == 0)
-      cmd_error(CMD_PARSE_ERROR, err, "Missing identifier.");
-    else
-      cmd_error(CMD_PARSE_ERROR, err, "Garbage after identifier: `%s'.",
-                argv[1]);
+  if (argc < 1) {
+    cmd_error(CMD_PARSE_ERROR, err, "Missing identifier.");
+    return CMD_PARSE_ERROR;
+  }
+
+  ret_getval->range = 0;
+  ret_getval->begin = 0;
+  ret_getval->end = 0;
+  for (size_t i = 1; i < argc; i++) {
+    char *opt_key = NULL;
+    char *opt_value = NULL;
+
+    status = cmd_parse_option(argv[i], &opt_key, &opt_value, err);
+    if (status != CMD_OK) {
+      if (status == CMD_NO_OPTION)
+        cmd_error(CMD_PARSE_ERROR, err, "Garbage after identifier: `%s'.",
+                  argv[i]);
+      return CMD_PARSE_ERROR;
+    }
+
+    if ((strcasecmp("begin", opt_key) == 0) ||
+        (strcasecmp("end", opt_key) == 0)) {
+      cdtime_t t;
+
+      if (parse_range_time(opt_value, &t) != 0) {
+        cmd_error(CMD_PARSE_ERROR, err, "Invalid value for option `%s': %s",
+                  opt_key, opt_value);
+        return CMD_PARSE_ERROR;
+      }
+
+      if (strcasecmp("begin", opt_key) == 0)
+        ret_getval->begin = t;
+      else
+        ret_getval->end = t;
+      ret_getval->range = 1;
+    } else {
+      cmd_error(CMD_PARSE_ERROR, err, "Cannot parse option `%s'.", opt_key);
+      return CMD_PARSE_ERROR;
+    }
+  }
+
+  if (ret_getval->range && (ret_getval->end == 0))
+    ret_getval->end = cdtime();
+  if (ret_getval->begin > ret_getval->end) {
+    cmd_error(CMD_PARSE_ERROR, err, "The beginning of the range is after its "
+                                    "end.");
     return CMD_PARSE_ERROR;
   }
 
@@ -85,6 +146,78 @@ cmd_status_t cmd_parse_getval(size_t argc, char **argv,
     fflush(fh);                                                                \
   } while (0)
 
+static void format_gauge(char *buffer, size_t buffer_size, gauge_t value) {
+  if (isnan(value))
+    sstrncpy(buffer, "NaN", buffer_size);
+  else
+    snprintf(buffer, buffer_size, "%e", value);
+} /* void format_gauge */
+
+/* Prints one point of the history: the time, followed by min:avg:max for each
+ * data source. */
+static int print_point(FILE *fh, const history_result_t *res,
+                       const data_set_t *ds, size_t point) {
+  if (fprintf(fh, "%.3f", CDTIME_T_TO_DOUBLE(res->time[point])) < 0)
+    return -1;
+
+  for (size_t i = 0; i < res->values_num; i++) {
+    size_t idx = point * res->values_num + i;
+    char min[32], avg[32], max[32];
+
+    format_gauge(min, sizeof(min), res->min[idx]);
+    format_gauge(avg, sizeof(avg), res->avg[idx]);
+    format_gauge(max, sizeof(max), res->max[idx]);
+    if (fprintf(fh, " %s=%s:%s:%s", ds->ds[i].name, min, avg, max) < 0)
+      return -1;
+  }
+
+  if (fprintf(fh, "\n") < 0)
+    return -1;
+  return 0;
+} /* int print_point */
+
+static cmd_status_t handle_range(FILE *fh, const cmd_getval_t *getval,
+                                 const data_set_t *ds,
+                                 cmd_error_handler_t *err) {
+  history_result_t res;
+  int status;
+
+  status = uc_get_history_range(getval->raw_identifier, getval->begin,
+                                getval->end, &res);
+  if (status == ENOTSUP) {
+    cmd_error(CMD_ERROR, err, "The history is disabled.");
+    return CMD_ERROR;
+  } else if (status != 0) {
+    cmd_error(CMD_ERROR, err, "No such value.");
+    return CMD_ERROR;
+  }
+
+  if (res.values_num != ds->ds_num) {
+    ERROR("ds[%s]->ds_num = %" PRIsz ", "
+          "but uc_get_history_range returned %" PRIsz " values.",
+          ds->type, ds->ds_num, res.values_num);
+    cmd_error(CMD_ERROR, err, "Error reading history from cache.");
+    history_result_free(&res);
+    return CMD_ERROR;
+  }
+
+  status = 0;
+  if (fprintf(fh, "%" PRIsz " Point%s found, resolution %.3f\n",
+              res.points_num, (res.points_num == 1) ? "" : "s",
+              CDTIME_T_TO_DOUBLE(res.resolution)) < 0)
+    status = -1;
+  for (size_t i = 0; (status == 0) && (i < res.points_num); i++)
+    status = print_point(fh, &res, ds, i);
+  if ((status != 0) || (fflush(fh) != 0)) {
+    WARNING("cmd_handle_getval: failed to write to socket #%i: %s",
+            fileno(fh), STRERRNO);
+    status = -1;
+  }
+
+  history_result_free(&res);
+  return status;
+} /* cmd_status_t handle_range */
+
 cmd_status_t cmd_handle_getval(FILE *fh, char *buffer) {
   cmd_error_handler_t err = {cmd_error_fh, fh};
   cmd_status_t status;
@@ -120,6 +253,12 @@ cmd_status_t cmd_handle_getval(FILE *fh, char *buffer) {
     return -1;
   }
 
+  if (cmd.cmd.getval.range) {
+    status = handle_range(fh, &cmd.cmd.getval, ds, &err);
+    cmd_destroy(&cmd);
+    return status;
+  }
+
   values = NULL;
   values_num = 0;
   status =
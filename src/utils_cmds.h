@@ -59,6 +59,11 @@ typedef struct {
 typedef struct {
   char *raw_identifier;
   identifier_t identifier;
+
+  /* Set if a time range has been requested with "begin" or "end". */
+  _Bool range;
+  cdtime_t begin;
+  cdtime_t end;
 } cmd_getval_t;
 
 typedef struct {
@@ -91,6 +91,13 @@ static struct {
     {
         "GETVAL magic/MAGIC", &default_host_opts, CMD_OK, CMD_GETVAL,
     },
+    {
+        "GETVAL myhost/magic/MAGIC begin=-3600", NULL, CMD_OK, CMD_GETVAL,
+    },
+    {
+        "GETVAL myhost/magic/MAGIC begin=1500000000 end=1500003600", NULL,
+        CMD_OK, CMD_GETVAL,
+    },
 
     /* Invalid GETVAL commands. */
     {
@@ -102,6 +109,21 @@ static struct {
     {
         "GETVAL invalid", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
     },
+    {
+        "GETVAL myhost/magic/MAGIC garbage", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
+    },
+    {
+        "GETVAL myhost/magic/MAGIC begin=A", NULL, CMD_PARSE_ERROR, CMD_UNKNOWN,
+    },
+    {
+        /* Range ends before it begins. */
+        "GETVAL myhost/magic/MAGIC begin=2 end=1", NULL, CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
+    {
+        "GETVAL myhost/magic/MAGIC invalid=option", NULL, CMD_PARSE_ERROR,
+        CMD_UNKNOWN,
+    },
 
     /* Valid LISTVAL commands. */
     {
@@ -78,6 +78,13 @@ typedef struct udb_result_preparation_area_s udb_result_preparation_area_t;
 
 struct udb_query_preparation_area_s /* {{{ */
 {
+  /* Set by udb_query_prepare_result(), cleared by udb_query_finish_result(). */
+  _Bool prepared;
+
+  /* The column layout the positions in the result preparation areas have
+   * been resolved for. It is kept across results, so that a query returning
+   * the same columns as last time doesn't need to look them up again. */
+  char **column_names;
   size_t column_num;
   size_t plugin_instance_pos;
   char *host;
@@ -294,9 +301,9 @@ static int udb_result_submit(udb_result_t *r, /* {{{ */
   return 0;
 } /* }}} void udb_result_submit */
 
-static void udb_result_finish_result(udb_result_t const *r, /* {{{ */
-                                     udb_result_preparation_area_t *prep_area) {
-  if ((r == NULL) || (prep_area == NULL))
+static void udb_result_clear(udb_result_preparation_area_t *prep_area) /* {{{ */
+{
+  if (prep_area == NULL)
     return;
 
   prep_area->ds = NULL;
@@ -306,7 +313,7 @@ static void udb_result_finish_result(udb_result_t const *r, /* {{{ */
   sfree(prep_area->instances_buffer);
   sfree(prep_area->values_buffer);
   sfree(prep_area->metadata_buffer);
-} /* }}} void udb_result_finish_result */
+} /* }}} void udb_result_clear */
 
 static int udb_result_handle_result(udb_result_t *r, /* {{{ */
                                     udb_query_preparation_area_t *q_area,
@@ -347,10 +354,7 @@ static int udb_result_prepare_result(udb_result_t const *r, /* {{{ */
   return (status)
 
   /* Make sure previous preparations are cleaned up. */
-  udb_result_finish_result(r, prep_area);
-  prep_area->instances_pos = NULL;
-  prep_area->values_pos = NULL;
-  prep_area->metadata_pos = NULL;
+  udb_result_clear(prep_area);
 
   /* Read `ds' and check number of values {{{ */
   prep_area->ds = plugin_get_ds(r->type);
@@ -846,28 +850,58 @@ int udb_query_check_version(udb_query_t *q, unsigned int version) /* {{{ */
   return 1;
 } /* }}} int udb_query_check_version */
 
+/* Forgets the column layout and everything derived from it. */
+static void
+udb_query_clear_preparation(udb_query_preparation_area_t *q_area) /* {{{ */
+{
+  q_area->prepared = 0;
+
+  for (size_t i = 0; i < q_area->column_num; i++)
+    sfree(q_area->column_names[i]);
+  sfree(q_area->column_names);
+  q_area->column_num = 0;
+
+  sfree(q_area->host);
+  sfree(q_area->plugin);
+  sfree(q_area->db_name);
+
+  q_area->interval = 0;
+
+  for (udb_result_preparation_area_t *r_area = q_area->result_prep_areas;
+       r_area != NULL; r_area = r_area->next)
+    udb_result_clear(r_area);
+} /* }}} void udb_query_clear_preparation */
+
+/* Returns true if the result has the same layout as the one `q_area' has
+ * been prepared for, i.e. the positions resolved last time are still valid. */
+static _Bool
+udb_query_same_layout(udb_query_preparation_area_t *q_area, /* {{{ */
+                      const char *host, const char *plugin,
+                      const char *db_name, char **column_names,
+                      size_t column_num, cdtime_t interval) {
+  if ((q_area->column_names == NULL) || (q_area->column_num != column_num) ||
+      (q_area->interval != interval))
+    return 0;
+
+  if ((strcmp(q_area->host, host) != 0) ||
+      (strcmp(q_area->plugin, plugin) != 0) ||
+      (strcmp(q_area->db_name, db_name) != 0))
+    return 0;
+
+  for (size_t i = 0; i < column_num; i++)
+    if (strcmp(q_area->column_names[i], column_names[i]) != 0)
+      return 0;
+
+  return 1;
+} /* }}} _Bool udb_query_same_layout */
+
 void udb_query_finish_result(udb_query_t const *q, /* {{{ */
                              udb_query_preparation_area_t *prep_area) {
-  udb_result_preparation_area_t *r_area;
-  udb_result_t *r;
-
   if ((q == NULL) || (prep_area == NULL))
     return;
 
-  prep_area->column_num = 0;
-  sfree(prep_area->host);
-  sfree(prep_area->plugin);
-  sfree(prep_area->db_name);
-
-  prep_area->interval = 0;
-
-  for (r = q->results, r_area = prep_area->result_prep_areas; r != NULL;
-       r = r->next, r_area = r_area->next) {
-    /* this may happen during error conditions of the caller */
-    if (r_area == NULL)
-      break;
-    udb_result_finish_result(r, r_area);
-  }
+  /* The column layout is kept for the next result. */
+  prep_area->prepared = 0;
 } /* }}} void udb_query_finish_result */
 
 int udb_query_handle_result(udb_query_t const *q, /* {{{ */
@@ -881,8 +915,7 @@ int udb_query_handle_result(udb_query_t const *q, /* {{{ */
   if ((q == NULL) || (prep_area == NULL))
     return -EINVAL;
 
-  if ((prep_area->column_num < 1) || (prep_area->host == NULL) ||
-      (prep_area->plugin == NULL) || (prep_area->db_name == NULL)) {
+  if (!prep_area->prepared) {
     ERROR("db query utils: Query `%s': Query is not prepared; "
           "can't handle result.",
           q->name);
@@ -929,23 +962,40 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
   if ((q == NULL) || (prep_area == NULL))
     return -EINVAL;
 
-  udb_query_finish_result(q, prep_area);
+  if (udb_query_same_layout(prep_area, host, plugin, db_name, column_names,
+                            column_num, interval)) {
+    prep_area->prepared = 1;
+    return 0;
+  }
 
-  prep_area->column_num = column_num;
+  udb_query_clear_preparation(prep_area);
+
+  prep_area->column_names = calloc(column_num, sizeof(char *));
   prep_area->host = strdup(host);
   prep_area->plugin = strdup(plugin);
   prep_area->db_name = strdup(db_name);
 
   prep_area->interval = interval;
 
-  if ((prep_area->host == NULL) || (prep_area->plugin == NULL) ||
-      (prep_area->db_name == NULL)) {
+  if ((prep_area->column_names == NULL) || (prep_area->host == NULL) ||
+      (prep_area->plugin == NULL) || (prep_area->db_name == NULL)) {
     ERROR("db query utils: Query `%s': Prepare failed: Out of memory.",
           q->name);
-    udb_query_finish_result(q, prep_area);
+    udb_query_clear_preparation(prep_area);
     return -ENOMEM;
   }
 
+  prep_area->column_num = column_num;
+  for (size_t i = 0; i < column_num; i++) {
+    prep_area->column_names[i] = strdup(column_names[i]);
+    if (prep_area->column_names[i] == NULL) {
+      ERROR("db query utils: Query `%s': Prepare failed: Out of memory.",
+            q->name);
+      udb_query_clear_preparation(prep_area);
+      return -ENOMEM;
+    }
+  }
+
 #if defined(COLLECT_DEBUG) && COLLECT_DEBUG
   do {
     for (size_t i = 0; i < column_num; i++) {
@@ -971,7 +1021,7 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
       ERROR("db query utils: udb_query_prepare_result: "
             "Column `%s' from `PluginInstanceFrom' could not be found.",
             q->plugin_instance_from);
-      udb_query_finish_result(q, prep_area);
+      udb_query_clear_preparation(prep_area);
       return -ENOENT;
     }
   }
@@ -983,17 +1033,18 @@ int udb_query_prepare_result(udb_query_t const *q, /* {{{ */
       ERROR("db query utils: Query `%s': Invalid number of result "
             "preparation areas.",
             q->name);
-      udb_query_finish_result(q, prep_area);
+      udb_query_clear_preparation(prep_area);
       return -EINVAL;
     }
 
     status = udb_result_prepare_result(r, r_area, column_names, column_num);
     if (status != 0) {
-      udb_query_finish_result(q, prep_area);
+      udb_query_clear_preparation(prep_area);
       return status;
     }
   }
 
+  prep_area->prepared = 1;
   return 0;
 } /* }}} int udb_query_prepare_result */
 
@@ -1041,22 +1092,15 @@ void udb_query_delete_preparation_area(
   if (q_area == NULL)
     return;
 
+  udb_query_clear_preparation(q_area);
+
   r_area = q_area->result_prep_areas;
   while (r_area != NULL) {
     udb_result_preparation_area_t *area = r_area;
 
     r_area = r_area->next;
-
-    sfree(area->instances_pos);
-    sfree(area->values_pos);
-    sfree(area->instances_buffer);
-    sfree(area->values_buffer);
     free(area);
   }
 
-  sfree(q_area->host);
-  sfree(q_area->plugin);
-  sfree(q_area->db_name);
-
   free(q_area);
 } /* }}} void udb_query_delete_preparation_area */
@@ -164,7 +164,7 @@ static pcap_t *pcap_obj = NULL;
 static ip_list_t *IgnoreList = NULL;
 
 #if HAVE_PCAP_H
-static void (*Callback)(const rfc1035_header_t *) = NULL;
+static dnstop_callback_t Callback = NULL;
 
 static int query_count_intvl = 0;
 static int query_count_total = 0;
@@ -257,17 +257,16 @@ static void in6_addr_from_buffer(struct in6_addr *ia, const void *buf,
 
 void dnstop_set_pcap_obj(pcap_t *po) { pcap_obj = po; }
 
-void dnstop_set_callback(void (*cb)(const rfc1035_header_t *)) {
+void dnstop_set_callback(dnstop_callback_t cb) {
   Callback = cb;
 }
 
 #define RFC1035_MAXLABELSZ 63
 static int rfc1035NameUnpack(const char *buf, size_t sz, off_t *off, char *name,
-                             size_t ns) {
+                             size_t ns, int loop_detect) {
   off_t no = 0;
   unsigned char c;
   size_t len;
-  static int loop_detect = 0;
   if (loop_detect > 2)
     return 4; /* compression loop */
   if (ns == 0)
@@ -293,9 +292,8 @@ static int rfc1035NameUnpack(const char *buf, size_t sz, off_t *off, char *name,
         return 2; /* bad compression ptr */
       if (ptr < DNS_MSG_HDR_SZ)
         return 2; /* bad compression ptr */
-      loop_detect++;
-      rc = rfc1035NameUnpack(buf, sz, &ptr, name + no, ns - no);
-      loop_detect--;
+      rc = rfc1035NameUnpack(buf, sz, &ptr, name + no, ns - no,
+                             loop_detect + 1);
       return rc;
     } else if (c > RFC1035_MAXLABELSZ) {
       /*
@@ -326,7 +324,7 @@ static int rfc1035NameUnpack(const char *buf, size_t sz, off_t *off, char *name,
   return 0;
 }
 
-static int handle_dns(const char *buf, int len) {
+static int handle_dns(const char *buf, int len, void *user_data) {
   rfc1035_header_t qh;
   uint16_t us;
   off_t offset;
@@ -367,7 +365,7 @@ static int handle_dns(const char *buf, int len) {
 
   offset = DNS_MSG_HDR_SZ;
   memset(qh.qname, '\0', MAX_QNAME_SZ);
-  status = rfc1035NameUnpack(buf, len, &offset, qh.qname, MAX_QNAME_SZ);
+  status = rfc1035NameUnpack(buf, len, &offset, qh.qname, MAX_QNAME_SZ, 0);
   if (status != 0) {
     INFO("utils_dns: handle_dns: rfc1035NameUnpack failed "
          "with status %i.",
@@ -391,23 +389,25 @@ static int handle_dns(const char *buf, int len) {
   qh.length = (uint16_t)len;
 
   if (Callback != NULL)
-    Callback(&qh);
+    Callback(&qh, user_data);
 
   return 1;
 }
 
-static int handle_udp(const struct udphdr *udp, int len) {
+static int handle_udp(const struct udphdr *udp, int len, void *user_data) {
   char buf[PCAP_SNAPLEN];
+  if ((len < (int)sizeof(*udp)) || (len > PCAP_SNAPLEN))
+    return 0;
   if ((ntohs(udp->UDP_DEST) != 53) && (ntohs(udp->UDP_SRC) != 53))
     return 0;
   memcpy(buf, udp + 1, len - sizeof(*udp));
-  if (0 == handle_dns(buf, len - sizeof(*udp)))
+  if (0 == handle_dns(buf, len - sizeof(*udp), user_data))
     return 0;
   return 1;
 }
 
 #if HAVE_IPV6
-static int handle_ipv6(struct ip6_hdr *ipv6, int len) {
+static int handle_ipv6(struct ip6_hdr *ipv6, int len, void *user_data) {
   char buf[PCAP_SNAPLEN];
   unsigned int offset;
   int nexthdr;
@@ -467,7 +467,7 @@ static int handle_ipv6(struct ip6_hdr *ipv6, int len) {
     return 0;
 
   memcpy(buf, (char *)ipv6 + offset, payload_len);
-  if (handle_udp((struct udphdr *)buf, payload_len) == 0)
+  if (handle_udp((struct udphdr *)buf, payload_len, user_data) == 0)
     return 0;
 
   return 1; /* Success */
@@ -476,19 +476,23 @@ static int handle_ipv6(struct ip6_hdr *ipv6, int len) {
 
 #else  /* if !HAVE_IPV6 */
 static int handle_ipv6(__attribute__((unused)) void *pkg,
-                       __attribute__((unused)) int len) {
+                       __attribute__((unused)) int len,
+                       __attribute__((unused)) void *user_data) {
   return 0;
 }
 #endif /* !HAVE_IPV6 */
 
-static int handle_ip(const struct ip *ip, int len) {
+static int handle_ip(const struct ip *ip, int len, void *user_data) {
   char buf[PCAP_SNAPLEN];
   int offset = ip->ip_hl << 2;
   struct in6_addr c_src_addr;
   struct in6_addr c_dst_addr;
 
   if (ip->ip_v == 6)
-    return handle_ipv6((void *)ip, len);
+    return handle_ipv6((void *)ip, len, user_data);
+
+  if ((offset < (int)sizeof(*ip)) || (offset > len) || (len > PCAP_SNAPLEN))
+    return 0;
 
   in6_addr_from_buffer(&c_src_addr, &ip->ip_src.s_addr,
                        sizeof(ip->ip_src.s_addr), AF_INET);
@@ -499,13 +503,13 @@ static int handle_ip(const struct ip *ip, int len) {
   if (IPPROTO_UDP != ip->ip_p)
     return 0;
   memcpy(buf, ((char *)ip) + offset, len - offset);
-  if (0 == handle_udp((struct udphdr *)buf, len - offset))
+  if (0 == handle_udp((struct udphdr *)buf, len - offset, user_data))
     return 0;
   return 1;
 }
 
 #if HAVE_NET_IF_PPP_H
-static int handle_ppp(const u_char *pkt, int len) {
+static int handle_ppp(const u_char *pkt, int len, void *user_data) {
   char buf[PCAP_SNAPLEN];
   unsigned short us;
   unsigned short proto;
@@ -530,37 +534,37 @@ static int handle_ppp(const u_char *pkt, int len) {
   if (ETHERTYPE_IP != proto && PPP_IP != proto)
     return 0;
   memcpy(buf, pkt, len);
-  return handle_ip((struct ip *)buf, len);
+  return handle_ip((struct ip *)buf, len, user_data);
 }
 #endif /* HAVE_NET_IF_PPP_H */
 
-static int handle_null(const u_char *pkt, int len) {
+static int handle_null(const u_char *pkt, int len, void *user_data) {
   unsigned int family;
   memcpy(&family, pkt, sizeof(family));
   if (AF_INET != family)
     return 0;
-  return handle_ip((struct ip *)(pkt + 4), len - 4);
+  return handle_ip((struct ip *)(pkt + 4), len - 4, user_data);
 }
 
 #ifdef DLT_LOOP
-static int handle_loop(const u_char *pkt, int len) {
+static int handle_loop(const u_char *pkt, int len, void *user_data) {
   unsigned int family;
   memcpy(&family, pkt, sizeof(family));
   if (AF_INET != ntohl(family))
     return 0;
-  return handle_ip((struct ip *)(pkt + 4), len - 4);
+  return handle_ip((struct ip *)(pkt + 4), len - 4, user_data);
 }
 
 #endif
 
 #ifdef DLT_RAW
-static int handle_raw(const u_char *pkt, int len) {
-  return handle_ip((struct ip *)pkt, len);
+static int handle_raw(const u_char *pkt, int len, void *user_data) {
+  return handle_ip((struct ip *)pkt, len, user_data);
 }
 
 #endif
 
-static int handle_ether(const u_char *pkt, int len) {
+static int handle_ether(const u_char *pkt, int len, void *user_data) {
   char buf[PCAP_SNAPLEN];
   struct ether_header *e = (void *)pkt;
   unsigned short etype = ntohs(e->ether_type);
@@ -577,13 +581,13 @@ static int handle_ether(const u_char *pkt, int len) {
     return 0;
   memcpy(buf, pkt, len);
   if (ETHERTYPE_IPV6 == etype)
-    return handle_ipv6((void *)buf, len);
+    return handle_ipv6((void *)buf, len, user_data);
   else
-    return handle_ip((struct ip *)buf, len);
+    return handle_ip((struct ip *)buf, len, user_data);
 }
 
 #ifdef DLT_LINUX_SLL
-static int handle_linux_sll(const u_char *pkt, int len) {
+static int handle_linux_sll(const u_char *pkt, int len, void *user_data) {
   struct sll_header {
     uint16_t pkt_type;
     uint16_t dev_type;
@@ -606,9 +610,9 @@ static int handle_linux_sll(const u_char *pkt, int len) {
     return 0;
 
   if (ETHERTYPE_IPV6 == etype)
-    return handle_ipv6((void *)pkt, len);
+    return handle_ipv6((void *)pkt, len, user_data);
   else
-    return handle_ip((struct ip *)pkt, len);
+    return handle_ip((struct ip *)pkt, len, user_data);
 }
 #endif /* DLT_LINUX_SLL */
 
@@ -622,30 +626,30 @@ void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
 
   switch (pcap_datalink(pcap_obj)) {
   case DLT_EN10MB:
-    status = handle_ether(pkt, hdr->caplen);
+    status = handle_ether(pkt, hdr->caplen, udata);
     break;
 #if HAVE_NET_IF_PPP_H
   case DLT_PPP:
-    status = handle_ppp(pkt, hdr->caplen);
+    status = handle_ppp(pkt, hdr->caplen, udata);
     break;
 #endif
 #ifdef DLT_LOOP
   case DLT_LOOP:
-    status = handle_loop(pkt, hdr->caplen);
+    status = handle_loop(pkt, hdr->caplen, udata);
     break;
 #endif
 #ifdef DLT_RAW
   case DLT_RAW:
-    status = handle_raw(pkt, hdr->caplen);
+    status = handle_raw(pkt, hdr->caplen, udata);
     break;
 #endif
 #ifdef DLT_LINUX_SLL
   case DLT_LINUX_SLL:
-    status = handle_linux_sll(pkt, hdr->caplen);
+    status = handle_linux_sll(pkt, hdr->caplen, udata);
     break;
 #endif
   case DLT_NULL:
-    status = handle_null(pkt, hdr->caplen);
+    status = handle_null(pkt, hdr->caplen, udata);
     break;
 
   default:
@@ -662,6 +666,18 @@ void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
   query_count_total++;
   last_ts = hdr->ts;
 }
+
+/* public function */
+void handle_ip_packet(const u_char *pkt, int len, void *user_data) {
+  /* The handlers copy packets into buffers sized for the libpcap snap
+   * length. */
+  if (len > PCAP_SNAPLEN)
+    len = PCAP_SNAPLEN;
+  if (len < (int)sizeof(struct ip))
+    return;
+
+  handle_ip((const struct ip *)pkt, len, user_data);
+}
 #endif /* HAVE_PCAP_H */
 
 const char *qtype_str(int t) {
@@ -73,15 +73,23 @@ struct rfc1035_header_s {
 };
 typedef struct rfc1035_header_s rfc1035_header_t;
 
+/* Called for each DNS message with the user data passed to handle_pcap() or
+ * handle_ip_packet(). May be called from several threads at once. */
+typedef void (*dnstop_callback_t)(const rfc1035_header_t *dns,
+                                  void *user_data);
+
 #if HAVE_PCAP_H
 void dnstop_set_pcap_obj(pcap_t *po);
 #endif
-void dnstop_set_callback(void (*cb)(const rfc1035_header_t *));
+void dnstop_set_callback(dnstop_callback_t cb);
 
 void ignore_list_add_name(const char *name);
 #if HAVE_PCAP_H
 void handle_pcap(u_char *udata, const struct pcap_pkthdr *hdr,
                  const u_char *pkt);
+/* Handles an IPv4 or IPv6 packet without link layer header, as received
+ * from a packet socket of type SOCK_DGRAM. */
+void handle_ip_packet(const u_char *pkt, int len, void *user_data);
 #endif
 
 const char *qtype_str(int t);
@@ -0,0 +1,712 @@
+/**
+ * collectd - src/utils_gorilla.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "plugin.h"
+#include "utils_crc32.h"
+#include "utils_gorilla.h"
+
+#include <dirent.h>
+#include <sys/mman.h>
+
+/* Marks a value whose window of meaningful bits has not been set yet. */
+#define NO_WINDOW 0xff
+
+/* Upper bound of the bits needed for a point with `n' values. */
+#define POINT_BITS_MAX(n) (4 + 32 + (n) * (2 + 6 + 6 + 64))
+
+/* Payloads larger than this are considered corrupt. */
+#define BLOCK_SIZE_MAX (64 * 1024 * 1024)
+
+/* Number of records the index grows by. */
+#define INDEX_GROW 256
+
+struct gorilla_value_s {
+  uint64_t value;
+  /* Difference to the previous value, if `integer' is set. */
+  uint64_t delta;
+  uint8_t leading;
+  uint8_t trailing;
+  _Bool integer;
+};
+
+static struct gorilla_value_s *state_create(size_t values_num, /* {{{ */
+                                            uint8_t const *ds_types) {
+  struct gorilla_value_s *state = calloc(values_num, sizeof(*state));
+  if (state == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < values_num; i++) {
+    state[i].leading = NO_WINDOW;
+    state[i].integer = (ds_types != NULL) && (ds_types[i] != DS_TYPE_GAUGE);
+  }
+  return state;
+} /* }}} struct gorilla_value_s *state_create */
+
+/* Returns the bits to store for `v': the value XORed with the previous one
+ * or, for integers, the difference XORed with the previous difference. */
+static uint64_t state_predict(struct gorilla_value_s *st, uint64_t v) /* {{{ */
+{
+  uint64_t x;
+
+  if (st->integer) {
+    uint64_t delta = v - st->value;
+    x = delta ^ st->delta;
+    st->delta = delta;
+  } else {
+    x = v ^ st->value;
+  }
+
+  st->value = v;
+  return x;
+} /* }}} uint64_t state_predict */
+
+/* Inverse of state_predict(). */
+static uint64_t state_restore(struct gorilla_value_s *st, uint64_t x) /* {{{ */
+{
+  if (st->integer) {
+    st->delta ^= x;
+    st->value += st->delta;
+  } else {
+    st->value ^= x;
+  }
+  return st->value;
+} /* }}} uint64_t state_restore */
+
+static unsigned count_leading_zeros(uint64_t x) /* {{{ */
+{
+#if defined(__GNUC__)
+  return (unsigned)__builtin_clzll(x);
+#else
+  unsigned n = 0;
+  while (!(x & (UINT64_C(1) << 63))) {
+    x <<= 1;
+    n++;
+  }
+  return n;
+#endif
+} /* }}} unsigned count_leading_zeros */
+
+static unsigned count_trailing_zeros(uint64_t x) /* {{{ */
+{
+#if defined(__GNUC__)
+  return (unsigned)__builtin_ctzll(x);
+#else
+  unsigned n = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    n++;
+  }
+  return n;
+#endif
+} /* }}} unsigned count_trailing_zeros */
+
+static _Bool fits_signed(int64_t v, unsigned bits) /* {{{ */
+{
+  int64_t limit = INT64_C(1) << (bits - 1);
+  return (v >= -limit) && (v < limit);
+} /* }}} _Bool fits_signed */
+
+static int64_t sign_extend(uint64_t v, unsigned bits) /* {{{ */
+{
+  uint64_t sign = UINT64_C(1) << (bits - 1);
+  return (int64_t)((v ^ sign) - sign);
+} /* }}} int64_t sign_extend */
+
+/*
+ * Encoder
+ */
+/* Appends the lowest `n' bits of `value', most significant bit first. The
+ * caller guarantees that the buffer is large enough. */
+static void write_bits(gorilla_encoder_t *e, uint64_t value, unsigned n) /* {{{ */
+{
+  while (n > 0) {
+    unsigned avail = 8 - (unsigned)(e->bits % 8);
+    unsigned take = (n < avail) ? n : avail;
+    uint8_t chunk = (uint8_t)((value >> (n - take)) & ((1u << take) - 1));
+
+    e->data[e->bits / 8] |= (uint8_t)(chunk << (avail - take));
+    e->bits += take;
+    n -= take;
+  }
+} /* }}} void write_bits */
+
+static int encoder_reserve(gorilla_encoder_t *e, size_t bits) /* {{{ */
+{
+  size_t need = (e->bits + bits + 7) / 8;
+  if (need <= e->data_size)
+    return 0;
+
+  size_t size = (e->data_size > 0) ? e->data_size : 256;
+  while (size < need)
+    size *= 2;
+
+  uint8_t *tmp = realloc(e->data, size);
+  if (tmp == NULL)
+    return ENOMEM;
+  memset(tmp + e->data_size, 0, size - e->data_size);
+
+  e->data = tmp;
+  e->data_size = size;
+  return 0;
+} /* }}} int encoder_reserve */
+
+static void encode_time(gorilla_encoder_t *e, int64_t dod) /* {{{ */
+{
+  if (dod == 0) {
+    write_bits(e, 0x0, 1);
+  } else if (fits_signed(dod, 7)) {
+    write_bits(e, 0x2, 2);
+    write_bits(e, (uint64_t)dod, 7);
+  } else if (fits_signed(dod, 9)) {
+    write_bits(e, 0x6, 3);
+    write_bits(e, (uint64_t)dod, 9);
+  } else if (fits_signed(dod, 12)) {
+    write_bits(e, 0xe, 4);
+    write_bits(e, (uint64_t)dod, 12);
+  } else {
+    write_bits(e, 0xf, 4);
+    write_bits(e, (uint64_t)dod, 32);
+  }
+} /* }}} void encode_time */
+
+static void encode_value(gorilla_encoder_t *e, size_t i, uint64_t v) /* {{{ */
+{
+  struct gorilla_value_s *st = e->state + i;
+  uint64_t x = state_predict(st, v);
+
+  if (x == 0) {
+    write_bits(e, 0x0, 1);
+    return;
+  }
+
+  /* Unlike the paper, six bits are used for the number of leading zeros:
+   * differences of integers are usually small. */
+  unsigned leading = count_leading_zeros(x);
+  unsigned trailing = count_trailing_zeros(x);
+
+  /* The meaningful bits fit into the previous window. */
+  if ((st->leading != NO_WINDOW) && (leading >= st->leading) &&
+      (trailing >= st->trailing)) {
+    write_bits(e, 0x2, 2);
+    write_bits(e, x >> st->trailing, 64 - st->leading - st->trailing);
+    return;
+  }
+
+  unsigned length = 64 - leading - trailing;
+  write_bits(e, 0x3, 2);
+  write_bits(e, leading, 6);
+  write_bits(e, length - 1, 6);
+  write_bits(e, x >> trailing, length);
+
+  st->leading = (uint8_t)leading;
+  st->trailing = (uint8_t)trailing;
+} /* }}} void encode_value */
+
+int gorilla_encoder_init(gorilla_encoder_t *e, size_t values_num, /* {{{ */
+                         uint8_t const *ds_types) {
+  if ((e == NULL) || (values_num == 0) || (values_num > GORILLA_VALUES_MAX))
+    return EINVAL;
+
+  memset(e, 0, sizeof(*e));
+  e->values_num = values_num;
+  e->state = state_create(values_num, ds_types);
+  if (e->state == NULL)
+    return ENOMEM;
+
+  return 0;
+} /* }}} int gorilla_encoder_init */
+
+void gorilla_encoder_reset(gorilla_encoder_t *e) /* {{{ */
+{
+  if (e->data != NULL)
+    memset(e->data, 0, (e->bits + 7) / 8);
+  e->bits = 0;
+  e->points_num = 0;
+  e->first_time = 0;
+  e->last_time = 0;
+  e->last_delta = 0;
+} /* }}} void gorilla_encoder_reset */
+
+void gorilla_encoder_destroy(gorilla_encoder_t *e) /* {{{ */
+{
+  if (e == NULL)
+    return;
+
+  free(e->state);
+  free(e->data);
+  memset(e, 0, sizeof(*e));
+} /* }}} void gorilla_encoder_destroy */
+
+int gorilla_encoder_append(gorilla_encoder_t *e, int64_t time, /* {{{ */
+                           uint64_t const *values) {
+  int64_t delta = 0;
+  int64_t dod = 0;
+
+  if ((e->points_num > 0) && (time <= e->last_time))
+    return EINVAL;
+  if (e->points_num == UINT32_MAX)
+    return ERANGE;
+
+  if (e->points_num > 0) {
+    delta = time - e->last_time;
+    dod = delta - e->last_delta;
+    if (!fits_signed(dod, 32))
+      return ERANGE;
+  }
+
+  if (encoder_reserve(e, POINT_BITS_MAX(e->values_num)) != 0)
+    return ENOMEM;
+
+  if (e->points_num == 0) {
+    /* The time of the first point is stored in the block header. */
+    e->first_time = time;
+    for (size_t i = 0; i < e->values_num; i++) {
+      write_bits(e, values[i], 64);
+      e->state[i].value = values[i];
+      e->state[i].delta = 0;
+      e->state[i].leading = NO_WINDOW;
+      e->state[i].trailing = 0;
+    }
+  } else {
+    encode_time(e, dod);
+    for (size_t i = 0; i < e->values_num; i++)
+      encode_value(e, i, values[i]);
+  }
+
+  e->last_delta = delta;
+  e->last_time = time;
+  e->points_num++;
+  return 0;
+} /* }}} int gorilla_encoder_append */
+
+size_t gorilla_encoder_size(gorilla_encoder_t const *e) /* {{{ */
+{
+  return (e->bits + 7) / 8;
+} /* }}} size_t gorilla_encoder_size */
+
+void gorilla_encoder_header(gorilla_encoder_t const *e, /* {{{ */
+                            uint32_t series_id, gorilla_block_header_t *hdr) {
+  size_t size = gorilla_encoder_size(e);
+
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->magic = GORILLA_BLOCK_MAGIC;
+  hdr->series_id = series_id;
+  hdr->first_time = e->first_time;
+  hdr->last_time = e->last_time;
+  hdr->points_num = e->points_num;
+  hdr->values_num = (uint32_t)e->values_num;
+  hdr->size = (uint32_t)size;
+  hdr->checksum = gorilla_checksum(e->data, size);
+} /* }}} void gorilla_encoder_header */
+
+uint32_t gorilla_checksum(uint8_t const *payload, size_t size) /* {{{ */
+{
+  if (size == 0)
+    return 0;
+  return crc32_buffer(payload, size);
+} /* }}} uint32_t gorilla_checksum */
+
+/*
+ * Decoder
+ */
+static int read_bits(gorilla_decoder_t *d, unsigned n, /* {{{ */
+                     uint64_t *ret_value) {
+  uint64_t value = 0;
+
+  if ((d->bits - d->pos) < n)
+    return EINVAL;
+
+  while (n > 0) {
+    unsigned avail = 8 - (unsigned)(d->pos % 8);
+    unsigned take = (n < avail) ? n : avail;
+    uint8_t byte = d->data[d->pos / 8];
+
+    value = (value << take) | ((byte >> (avail - take)) & ((1u << take) - 1));
+    d->pos += take;
+    n -= take;
+  }
+
+  *ret_value = value;
+  return 0;
+} /* }}} int read_bits */
+
+static int decode_time(gorilla_decoder_t *d, int64_t *ret_dod) /* {{{ */
+{
+  static unsigned const widths[] = {7, 9, 12, 32};
+  size_t widths_num = sizeof(widths) / sizeof(widths[0]);
+  uint64_t bit;
+  uint64_t v;
+
+  /* The control code is a unary prefix of up to four ones. */
+  for (size_t i = 0; i < widths_num; i++) {
+    if (read_bits(d, 1, &bit) != 0)
+      return EINVAL;
+    if ((bit == 0) && (i == 0)) {
+      *ret_dod = 0;
+      return 0;
+    }
+    if ((bit == 0) || (i == widths_num - 1)) {
+      unsigned width = (bit == 0) ? widths[i - 1] : widths[i];
+      if (read_bits(d, width, &v) != 0)
+        return EINVAL;
+      *ret_dod = sign_extend(v, width);
+      return 0;
+    }
+  }
+
+  return EINVAL;
+} /* }}} int decode_time */
+
+static int decode_value(gorilla_decoder_t *d, size_t i) /* {{{ */
+{
+  struct gorilla_value_s *st = d->state + i;
+  uint64_t bit;
+  uint64_t v;
+
+  if (read_bits(d, 1, &bit) != 0)
+    return EINVAL;
+  if (bit == 0) {
+    state_restore(st, 0);
+    return 0;
+  }
+
+  if (read_bits(d, 1, &bit) != 0)
+    return EINVAL;
+  if (bit == 1) {
+    uint64_t leading;
+    uint64_t length;
+    if ((read_bits(d, 6, &leading) != 0) || (read_bits(d, 6, &length) != 0))
+      return EINVAL;
+    length++;
+    if (leading + length > 64)
+      return EINVAL;
+    st->leading = (uint8_t)leading;
+    st->trailing = (uint8_t)(64 - leading - length);
+  } else if (st->leading == NO_WINDOW) {
+    return EINVAL;
+  }
+
+  unsigned length = 64 - st->leading - st->trailing;
+  if (read_bits(d, length, &v) != 0)
+    return EINVAL;
+
+  state_restore(st, v << st->trailing);
+  return 0;
+} /* }}} int decode_value */
+
+int gorilla_decoder_init(gorilla_decoder_t *d, /* {{{ */
+                         gorilla_block_header_t const *hdr,
+                         uint8_t const *payload, uint8_t const *ds_types) {
+  if ((d == NULL) || (hdr == NULL) || (hdr->values_num == 0) ||
+      (hdr->values_num > GORILLA_VALUES_MAX) ||
+      ((payload == NULL) && (hdr->size > 0)))
+    return EINVAL;
+
+  memset(d, 0, sizeof(*d));
+  d->data = payload;
+  d->bits = 8 * (size_t)hdr->size;
+  d->values_num = hdr->values_num;
+  d->points_num = hdr->points_num;
+  d->time = hdr->first_time;
+
+  d->state = state_create(d->values_num, ds_types);
+  if (d->state == NULL)
+    return ENOMEM;
+
+  return 0;
+} /* }}} int gorilla_decoder_init */
+
+void gorilla_decoder_destroy(gorilla_decoder_t *d) /* {{{ */
+{
+  if (d == NULL)
+    return;
+
+  free(d->state);
+  memset(d, 0, sizeof(*d));
+} /* }}} void gorilla_decoder_destroy */
+
+int gorilla_decoder_next(gorilla_decoder_t *d, int64_t *time, /* {{{ */
+                         uint64_t *values) {
+  if (d->points_read >= d->points_num)
+    return ENOENT;
+
+  if (d->points_read == 0) {
+    for (size_t i = 0; i < d->values_num; i++)
+      if (read_bits(d, 64, &d->state[i].value) != 0)
+        return EINVAL;
+  } else {
+    int64_t dod;
+    if (decode_time(d, &dod) != 0)
+      return EINVAL;
+    d->delta += dod;
+    d->time += d->delta;
+
+    for (size_t i = 0; i < d->values_num; i++)
+      if (decode_value(d, i) != 0)
+        return EINVAL;
+  }
+
+  d->points_read++;
+  *time = d->time;
+  for (size_t i = 0; i < d->values_num; i++)
+    values[i] = d->state[i].value;
+  return 0;
+} /* }}} int gorilla_decoder_next */
+
+/*
+ * Series index
+ */
+static int index_map(gorilla_index_t *idx, size_t size) /* {{{ */
+{
+  int prot = PROT_READ | (idx->writable ? PROT_WRITE : 0);
+
+  void *map = mmap(NULL, size, prot, MAP_SHARED, idx->fd, 0);
+  if (map == MAP_FAILED)
+    return errno;
+
+  if (idx->map != NULL)
+    munmap(idx->map, idx->map_size);
+
+  idx->map = map;
+  idx->map_size = size;
+  idx->header = map;
+  idx->records =
+      (gorilla_index_record_t *)((char *)map + sizeof(gorilla_index_header_t));
+  return 0;
+} /* }}} int index_map */
+
+int gorilla_index_open(gorilla_index_t *idx, char const *path, /* {{{ */
+                       _Bool writable) {
+  struct stat statbuf;
+  int status;
+
+  memset(idx, 0, sizeof(*idx));
+  idx->writable = writable;
+  idx->fd = open(path, writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+  if (idx->fd < 0)
+    return errno;
+
+  if (fstat(idx->fd, &statbuf) != 0) {
+    status = errno;
+    gorilla_index_close(idx);
+    return status;
+  }
+
+  size_t size = (size_t)statbuf.st_size;
+  _Bool created = 0;
+  if ((size == 0) && writable) {
+    size = sizeof(gorilla_index_header_t) +
+           INDEX_GROW * sizeof(gorilla_index_record_t);
+    if (ftruncate(idx->fd, (off_t)size) != 0) {
+      status = errno;
+      gorilla_index_close(idx);
+      return status;
+    }
+    created = 1;
+  }
+
+  if (size < sizeof(gorilla_index_header_t)) {
+    gorilla_index_close(idx);
+    return EINVAL;
+  }
+
+  status = index_map(idx, size);
+  if (status != 0) {
+    gorilla_index_close(idx);
+    return status;
+  }
+
+  if (created) {
+    idx->header->magic = GORILLA_INDEX_MAGIC;
+    idx->header->version = GORILLA_INDEX_VERSION;
+    idx->header->record_size = sizeof(gorilla_index_record_t);
+    idx->header->records_num = 0;
+  }
+
+  if ((idx->header->magic != GORILLA_INDEX_MAGIC) ||
+      (idx->header->version != GORILLA_INDEX_VERSION) ||
+      (idx->header->record_size != sizeof(gorilla_index_record_t)) ||
+      (idx->header->records_num >
+       (size - sizeof(gorilla_index_header_t)) /
+           sizeof(gorilla_index_record_t))) {
+    gorilla_index_close(idx);
+    return EINVAL;
+  }
+
+  return 0;
+} /* }}} int gorilla_index_open */
+
+void gorilla_index_close(gorilla_index_t *idx) /* {{{ */
+{
+  if (idx == NULL)
+    return;
+
+  if (idx->map != NULL)
+    munmap(idx->map, idx->map_size);
+  if (idx->fd >= 0)
+    close(idx->fd);
+
+  memset(idx, 0, sizeof(*idx));
+  idx->fd = -1;
+} /* }}} void gorilla_index_close */
+
+int gorilla_index_add(gorilla_index_t *idx, char const *name, /* {{{ */
+                      size_t values_num, uint8_t const *ds_types,
+                      uint32_t *ret_id) {
+  if (!idx->writable)
+    return EBADF;
+  if ((values_num == 0) || (values_num > GORILLA_VALUES_MAX))
+    return EINVAL;
+  if (strlen(name) >= GORILLA_NAME_LEN)
+    return ENAMETOOLONG;
+
+  uint32_t id = idx->header->records_num;
+  size_t need = sizeof(gorilla_index_header_t) +
+                ((size_t)id + 1) * sizeof(gorilla_index_record_t);
+  if (need > idx->map_size) {
+    size_t size = idx->map_size + INDEX_GROW * sizeof(gorilla_index_record_t);
+    if (ftruncate(idx->fd, (off_t)size) != 0)
+      return errno;
+    int status = index_map(idx, size);
+    if (status != 0)
+      return status;
+  }
+
+  gorilla_index_record_t *r = idx->records + id;
+  memset(r, 0, sizeof(*r));
+  memcpy(r->name, name, strlen(name));
+  r->values_num = (uint32_t)values_num;
+  memcpy(r->ds_types, ds_types, values_num);
+
+  /* Readers only look at records below records_num. */
+  idx->header->records_num = id + 1;
+
+  *ret_id = id;
+  return 0;
+} /* }}} int gorilla_index_add */
+
+/*
+ * Segments
+ */
+int gorilla_segment_read(char const *path, /* {{{ */
+                         gorilla_block_callback_t callback, void *user_data) {
+  gorilla_block_header_t hdr;
+  uint8_t *payload = NULL;
+  size_t payload_size = 0;
+  int status = 0;
+
+  FILE *fh = fopen(path, "r");
+  if (fh == NULL)
+    return errno;
+  /* Segments are read sequentially, so use a large buffer. */
+  setvbuf(fh, NULL, _IOFBF, 1024 * 1024);
+
+  while (fread(&hdr, sizeof(hdr), 1, fh) == 1) {
+    if ((hdr.magic != GORILLA_BLOCK_MAGIC) || (hdr.size > BLOCK_SIZE_MAX)) {
+      status = EINVAL;
+      break;
+    }
+
+    if (hdr.size > payload_size) {
+      uint8_t *tmp = realloc(payload, hdr.size);
+      if (tmp == NULL) {
+        status = ENOMEM;
+        break;
+      }
+      payload = tmp;
+      payload_size = hdr.size;
+    }
+
+    if ((hdr.size > 0) && (fread(payload, hdr.size, 1, fh) != 1))
+      break;
+
+    if (gorilla_checksum(payload, hdr.size) != hdr.checksum)
+      continue;
+
+    status = callback(&hdr, payload, user_data);
+    if (status != 0)
+      break;
+  }
+
+  if ((status == 0) && ferror(fh))
+    status = EIO;
+
+  fclose(fh);
+  free(payload);
+  return status;
+} /* }}} int gorilla_segment_read */
+
+static int compare_seq(const void *a, const void *b) /* {{{ */
+{
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+} /* }}} int compare_seq */
+
+int gorilla_segment_list(char const *dir, uint32_t **ret_seqs, /* {{{ */
+                         size_t *ret_seqs_num) {
+  uint32_t *seqs = NULL;
+  size_t seqs_num = 0;
+  struct dirent *ent;
+
+  DIR *dh = opendir(dir);
+  if (dh == NULL)
+    return errno;
+
+  while ((ent = readdir(dh)) != NULL) {
+    char *end = NULL;
+
+    if (!isdigit((int)ent->d_name[0]))
+      continue;
+    unsigned long seq = strtoul(ent->d_name, &end, 10);
+    if ((strcmp(end, GORILLA_SEGMENT_SUFFIX) != 0) || (seq > UINT32_MAX))
+      continue;
+
+    uint32_t *tmp = realloc(seqs, (seqs_num + 1) * sizeof(*seqs));
+    if (tmp == NULL) {
+      closedir(dh);
+      free(seqs);
+      return ENOMEM;
+    }
+    seqs = tmp;
+    seqs[seqs_num++] = (uint32_t)seq;
+  }
+  closedir(dh);
+
+  if (seqs_num > 0)
+    qsort(seqs, seqs_num, sizeof(*seqs), compare_seq);
+
+  *ret_seqs = seqs;
+  *ret_seqs_num = seqs_num;
+  return 0;
+} /* }}} int gorilla_segment_list */
+
+int gorilla_segment_path(char *buffer, size_t buffer_size, /* {{{ */
+                         char const *dir, uint32_t seq) {
+  int status = snprintf(buffer, buffer_size, "%s/%010" PRIu32 "%s", dir, seq,
+                        GORILLA_SEGMENT_SUFFIX);
+  if ((status < 0) || ((size_t)status >= buffer_size))
+    return ENAMETOOLONG;
+  return 0;
+} /* }}} int gorilla_segment_path */
@@ -0,0 +1,267 @@
+/**
+ * collectd - src/utils_gorilla.h
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#ifndef UTILS_GORILLA_H
+#define UTILS_GORILLA_H 1
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Storage format of the "gorilla" plugin, shared with collectd-gorilla(1).
+ *
+ * A data directory holds one series index, GORILLA_INDEX_FILE, and any number
+ * of segment files named "<sequence>.seg". Segments are a plain sequence of
+ * blocks, each consisting of a gorilla_block_header_t followed by `size' bytes
+ * of payload. The payload of a block holds the points of a single series:
+ * timestamps, in milliseconds, are stored as delta-of-delta and each value is
+ * XORed with its predecessor, as described in "Gorilla: A Fast, Scalable,
+ * In-Memory Time Series Database" (Pelkonen et al., VLDB 2015). Values are
+ * handled as the 64 bit pattern of their value_t. For data sources other than
+ * gauges, the difference to the previous value is XORed with the previous
+ * difference instead, so that counters increasing at a steady rate compress
+ * as well as constant gauges.
+ *
+ * The index is an array of fixed-size records, mapped into memory. The id of
+ * a series is the position of its record. All integers are stored in host byte
+ * order.
+ */
+
+#define GORILLA_INDEX_FILE "series.idx"
+#define GORILLA_SEGMENT_SUFFIX ".seg"
+
+#define GORILLA_INDEX_MAGIC 0x58444947 /* "GIDX" */
+#define GORILLA_INDEX_VERSION 1
+#define GORILLA_BLOCK_MAGIC 0x4b4c4247 /* "GBLK" */
+
+/* Large enough for the identifiers created by FORMAT_VL. */
+#define GORILLA_NAME_LEN 768
+#define GORILLA_VALUES_MAX 252
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t records_num;
+} gorilla_index_header_t;
+
+typedef struct {
+  char name[GORILLA_NAME_LEN];
+  uint32_t values_num;
+  uint8_t ds_types[GORILLA_VALUES_MAX];
+} gorilla_index_record_t;
+
+typedef struct {
+  int fd;
+  _Bool writable;
+  void *map;
+  size_t map_size;
+  gorilla_index_header_t *header;
+  gorilla_index_record_t *records;
+} gorilla_index_t;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t series_id;
+  int64_t first_time;
+  int64_t last_time;
+  uint32_t points_num;
+  uint32_t values_num;
+  /* Size of the payload in bytes and its CRC32. */
+  uint32_t size;
+  uint32_t checksum;
+} gorilla_block_header_t;
+
+/* Per-value state of encoders and decoders. */
+struct gorilla_value_s;
+
+typedef struct {
+  size_t values_num;
+  uint32_t points_num;
+  int64_t first_time;
+  int64_t last_time;
+  int64_t last_delta;
+  struct gorilla_value_s *state;
+
+  uint8_t *data;
+  size_t data_size;
+  size_t bits;
+} gorilla_encoder_t;
+
+typedef struct {
+  const uint8_t *data;
+  size_t bits;
+  size_t pos;
+
+  size_t values_num;
+  uint32_t points_num;
+  uint32_t points_read;
+  int64_t time;
+  int64_t delta;
+  struct gorilla_value_s *state;
+} gorilla_decoder_t;
+
+/*
+ * NAME
+ *  gorilla_encoder_init
+ *
+ * DESCRIPTION
+ *  Initializes an empty block for a series with `values_num' values of the
+ *  data source types in `ds_types'. gorilla_encoder_reset() empties the block
+ *  while keeping its buffers.
+ *
+ * RETURN VALUE
+ *  Zero on success, EINVAL or ENOMEM on failure.
+ */
+int gorilla_encoder_init(gorilla_encoder_t *e, size_t values_num,
+                         uint8_t const *ds_types);
+void gorilla_encoder_reset(gorilla_encoder_t *e);
+void gorilla_encoder_destroy(gorilla_encoder_t *e);
+
+/*
+ * NAME
+ *  gorilla_encoder_append
+ *
+ * DESCRIPTION
+ *  Appends a point, taken at `time' milliseconds, to the block.
+ *
+ * RETURN VALUE
+ *  Zero on success. EINVAL if `time' is not after the last point of the block,
+ *  ERANGE if the point cannot be encoded in this block, in which case it
+ *  should be appended to a new one, and ENOMEM on failure.
+ */
+int gorilla_encoder_append(gorilla_encoder_t *e, int64_t time,
+                           uint64_t const *values);
+
+/* Returns the size of the encoded payload, in bytes. */
+size_t gorilla_encoder_size(gorilla_encoder_t const *e);
+
+/* Fills in all fields of `hdr' describing the current block. */
+void gorilla_encoder_header(gorilla_encoder_t const *e, uint32_t series_id,
+                            gorilla_block_header_t *hdr);
+
+/*
+ * NAME
+ *  gorilla_decoder_init
+ *
+ * DESCRIPTION
+ *  Prepares reading the points of the block described by `hdr' from
+ *  `payload'. `ds_types' must match the types the block was encoded with, as
+ *  stored in the index. The payload must stay valid until the decoder is
+ *  destroyed.
+ *
+ * RETURN VALUE
+ *  Zero on success, EINVAL or ENOMEM on failure.
+ */
+int gorilla_decoder_init(gorilla_decoder_t *d,
+                         gorilla_block_header_t const *hdr,
+                         uint8_t const *payload, uint8_t const *ds_types);
+void gorilla_decoder_destroy(gorilla_decoder_t *d);
+
+/*
+ * NAME
+ *  gorilla_decoder_next
+ *
+ * DESCRIPTION
+ *  Reads the next point, storing its time in `time' and its `values_num'
+ *  values in `values'.
+ *
+ * RETURN VALUE
+ *  Zero on success, ENOENT after the last point and EINVAL if the payload is
+ *  corrupt.
+ */
+int gorilla_decoder_next(gorilla_decoder_t *d, int64_t *time,
+                         uint64_t *values);
+
+/* Returns the checksum stored in the header of a block with this payload. */
+uint32_t gorilla_checksum(uint8_t const *payload, size_t size);
+
+/*
+ * NAME
+ *  gorilla_index_open
+ *
+ * DESCRIPTION
+ *  Maps the index at `path' into memory. If `writable' is true, the index is
+ *  created if it does not exist yet and records may be added.
+ *
+ * RETURN VALUE
+ *  Zero on success, an errno value on failure.
+ */
+int gorilla_index_open(gorilla_index_t *idx, char const *path,
+                       _Bool writable);
+void gorilla_index_close(gorilla_index_t *idx);
+
+/*
+ * NAME
+ *  gorilla_index_add
+ *
+ * DESCRIPTION
+ *  Adds a record for the series `name', growing the index as required, and
+ *  stores its id in `ret_id'.
+ *
+ * RETURN VALUE
+ *  Zero on success, an errno value on failure.
+ */
+int gorilla_index_add(gorilla_index_t *idx, char const *name,
+                      size_t values_num, uint8_t const *ds_types,
+                      uint32_t *ret_id);
+
+/*
+ * NAME
+ *  gorilla_segment_read
+ *
+ * DESCRIPTION
+ *  Calls `callback' for each block of the segment at `path', in file order.
+ *  Blocks whose checksum does not match are skipped; a truncated block at the
+ *  end of the segment, as left by a segment being written, ends the scan.
+ *  If the callback returns non-zero, the scan stops and that value is
+ *  returned.
+ *
+ * RETURN VALUE
+ *  Zero on success, an errno value if the segment cannot be read or is
+ *  corrupt, or the return value of `callback'.
+ */
+typedef int (*gorilla_block_callback_t)(gorilla_block_header_t const *hdr,
+                                        uint8_t const *payload,
+                                        void *user_data);
+int gorilla_segment_read(char const *path, gorilla_block_callback_t callback,
+                         void *user_data);
+
+/*
+ * NAME
+ *  gorilla_segment_list
+ *
+ * DESCRIPTION
+ *  Returns the sequence numbers of all segments in `dir', sorted in
+ *  ascending order. The array must be freed by the caller.
+ *
+ * RETURN VALUE
+ *  Zero on success, an errno value on failure.
+ */
+int gorilla_segment_list(char const *dir, uint32_t **ret_seqs,
+                         size_t *ret_seqs_num);
+
+/* Formats the path of the segment `seq' in `dir'. */
+int gorilla_segment_path(char *buffer, size_t buffer_size, char const *dir,
+                         uint32_t seq);
+
+#endif /* UTILS_GORILLA_H */
@@ -0,0 +1,233 @@
+/**
+ * collectd - src/utils_gorilla_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "testing.h"
+#include "utils_gorilla.h"
+
+#include "plugin.h"
+
+#define POINTS_NUM 720
+
+static uint64_t gauge_bits(gauge_t g) {
+  value_t v = {.gauge = g};
+  return v.derive;
+}
+
+static uint64_t counter_bits(counter_t c) {
+  value_t v = {.counter = c};
+  return v.derive;
+}
+
+DEF_TEST(roundtrip) {
+  gorilla_encoder_t e;
+  gorilla_decoder_t d;
+  gorilla_block_header_t hdr;
+  uint8_t types[3] = {DS_TYPE_GAUGE, DS_TYPE_COUNTER, DS_TYPE_GAUGE};
+  uint64_t in[POINTS_NUM][3];
+  int64_t times[POINTS_NUM];
+
+  CHECK_ZERO(gorilla_encoder_init(&e, 3, types));
+
+  /* Ten second interval with jitter, the occasional gap and a mix of slowly
+   * changing, constant and special values. The counter wraps around. */
+  int64_t t = 1500000000000;
+  int status = 0;
+  for (int i = 0; i < POINTS_NUM; i++) {
+    t += 10000 + (i % 7) - 3;
+    if (i == 100)
+      t += 3600000;
+    if (i == 200)
+      t += 86400000;
+    times[i] = t;
+    in[i][0] = gauge_bits((i == 50) ? NAN : 20.0 + (i % 13) * 0.25);
+    in[i][1] = counter_bits(UINT64_MAX - 300 * 1234 + 1234 * (counter_t)i);
+    in[i][2] = gauge_bits((i < 300) ? 0.0 : -1e300);
+    status |= gorilla_encoder_append(&e, times[i], in[i]);
+  }
+  EXPECT_EQ_INT(0, status);
+
+  /* Points must be appended in order. */
+  EXPECT_EQ_INT(EINVAL, gorilla_encoder_append(&e, t, in[0]));
+  EXPECT_EQ_INT(EINVAL, gorilla_encoder_append(&e, t - 1, in[0]));
+
+  gorilla_encoder_header(&e, 42, &hdr);
+  EXPECT_EQ_INT(42, hdr.series_id);
+  EXPECT_EQ_INT(POINTS_NUM, hdr.points_num);
+  EXPECT_EQ_UINT64(times[0], hdr.first_time);
+  EXPECT_EQ_UINT64(t, hdr.last_time);
+  EXPECT_EQ_INT(gorilla_encoder_size(&e), hdr.size);
+  /* Far below the 32 bytes of uncompressed points. */
+  OK(hdr.size < POINTS_NUM * 12);
+
+  CHECK_ZERO(gorilla_decoder_init(&d, &hdr, e.data, types));
+  int mismatch = 0;
+  for (int i = 0; i < POINTS_NUM; i++) {
+    int64_t got_time;
+    uint64_t got[3];
+
+    status |= gorilla_decoder_next(&d, &got_time, got);
+    if ((got_time != times[i]) || (memcmp(got, in[i], sizeof(got)) != 0))
+      mismatch++;
+  }
+  EXPECT_EQ_INT(0, status);
+  EXPECT_EQ_INT(0, mismatch);
+  EXPECT_EQ_INT(ENOENT, gorilla_decoder_next(&d, &t, in[0]));
+  gorilla_decoder_destroy(&d);
+
+  /* A truncated payload is detected. */
+  hdr.size /= 2;
+  CHECK_ZERO(gorilla_decoder_init(&d, &hdr, e.data, types));
+  while ((status = gorilla_decoder_next(&d, &t, in[0])) == 0)
+    ;
+  EXPECT_EQ_INT(EINVAL, status);
+  gorilla_decoder_destroy(&d);
+
+  gorilla_encoder_destroy(&e);
+  return 0;
+}
+
+DEF_TEST(compression) {
+  gorilla_encoder_t e;
+  uint64_t v;
+
+  uint8_t gauge = DS_TYPE_GAUGE;
+  uint8_t derive = DS_TYPE_DERIVE;
+  int status = 0;
+
+  /* A regular series of constant values needs one bit per timestamp and one
+   * per value, after the first two points. */
+  CHECK_ZERO(gorilla_encoder_init(&e, 1, &gauge));
+  v = gauge_bits(42.0);
+  for (int i = 0; i < POINTS_NUM; i++)
+    status |= gorilla_encoder_append(&e, 10000 * (int64_t)i, &v);
+  EXPECT_EQ_INT(0, status);
+  OK(gorilla_encoder_size(&e) <= 16 + POINTS_NUM / 4);
+  gorilla_encoder_destroy(&e);
+
+  /* The same holds for integers increasing at a constant rate. */
+  CHECK_ZERO(gorilla_encoder_init(&e, 1, &derive));
+  for (int i = 0; i < POINTS_NUM; i++) {
+    v = 1000000 + 4711 * (uint64_t)i;
+    status |= gorilla_encoder_append(&e, 10000 * (int64_t)i, &v);
+  }
+  EXPECT_EQ_INT(0, status);
+  OK(gorilla_encoder_size(&e) <= 32 + POINTS_NUM / 4);
+  gorilla_encoder_destroy(&e);
+
+  CHECK_ZERO(gorilla_encoder_init(&e, 1, &gauge));
+  v = gauge_bits(42.0);
+
+  /* Resetting keeps the buffer but starts from scratch. */
+  gorilla_encoder_reset(&e);
+  EXPECT_EQ_INT(0, gorilla_encoder_size(&e));
+  CHECK_ZERO(gorilla_encoder_append(&e, 0, &v));
+  EXPECT_EQ_INT(8, gorilla_encoder_size(&e));
+
+  /* Deltas of deltas beyond 32 bits need a new block. */
+  CHECK_ZERO(gorilla_encoder_append(&e, 1, &v));
+  EXPECT_EQ_INT(ERANGE, gorilla_encoder_append(&e, INT64_C(1) << 40, &v));
+
+  gorilla_encoder_destroy(&e);
+  return 0;
+}
+
+static int count_block(gorilla_block_header_t const *hdr,
+                       __attribute__((unused)) uint8_t const *payload,
+                       void *user_data) {
+  int *count = user_data;
+  (*count) += hdr->points_num;
+  return 0;
+}
+
+DEF_TEST(files) {
+  char dir[] = "/tmp/gorilla_test.XXXXXX";
+  char path[PATH_MAX];
+  gorilla_index_t idx;
+  gorilla_encoder_t e;
+  gorilla_block_header_t hdr;
+  uint8_t types[2] = {DS_TYPE_GAUGE, DS_TYPE_DERIVE};
+  uint32_t id;
+
+  CHECK_NOT_NULL(mkdtemp(dir));
+
+  /* The index is created and grows as records are added. */
+  snprintf(path, sizeof(path), "%s/%s", dir, GORILLA_INDEX_FILE);
+  CHECK_ZERO(gorilla_index_open(&idx, path, /* writable = */ 1));
+  for (uint32_t i = 0; i < 300; i++) {
+    char name[64];
+    snprintf(name, sizeof(name), "host/plugin/type-%" PRIu32, i);
+    if ((gorilla_index_add(&idx, name, 2, types, &id) != 0) || (id != i))
+      break;
+  }
+  EXPECT_EQ_INT(300, idx.header->records_num);
+  gorilla_index_close(&idx);
+
+  CHECK_ZERO(gorilla_index_open(&idx, path, /* writable = */ 0));
+  EXPECT_EQ_INT(300, idx.header->records_num);
+  EXPECT_EQ_STR("host/plugin/type-299", idx.records[299].name);
+  EXPECT_EQ_INT(DS_TYPE_DERIVE, idx.records[299].ds_types[1]);
+  EXPECT_EQ_INT(EBADF, gorilla_index_add(&idx, "x", 2, types, &id));
+  gorilla_index_close(&idx);
+
+  /* Two blocks followed by a partially written one. */
+  CHECK_ZERO(gorilla_encoder_init(&e, 1, types));
+  for (int i = 0; i < 10; i++) {
+    uint64_t v = (uint64_t)i;
+    gorilla_encoder_append(&e, 1000 * (int64_t)i, &v);
+  }
+  gorilla_encoder_header(&e, 7, &hdr);
+
+  CHECK_ZERO(gorilla_segment_path(path, sizeof(path), dir, 3));
+  FILE *fh = fopen(path, "w");
+  CHECK_NOT_NULL(fh);
+  for (int i = 0; i < 3; i++) {
+    fwrite(&hdr, sizeof(hdr), 1, fh);
+    fwrite(e.data, (i < 2) ? hdr.size : hdr.size / 2, 1, fh);
+  }
+  fclose(fh);
+  gorilla_encoder_destroy(&e);
+
+  int count = 0;
+  CHECK_ZERO(gorilla_segment_read(path, count_block, &count));
+  EXPECT_EQ_INT(20, count);
+
+  uint32_t *seqs = NULL;
+  size_t seqs_num = 0;
+  CHECK_ZERO(gorilla_segment_list(dir, &seqs, &seqs_num));
+  EXPECT_EQ_INT(1, seqs_num);
+  EXPECT_EQ_INT(3, seqs[0]);
+  free(seqs);
+
+  unlink(path);
+  snprintf(path, sizeof(path), "%s/%s", dir, GORILLA_INDEX_FILE);
+  unlink(path);
+  rmdir(dir);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(roundtrip);
+  RUN_TEST(compression);
+  RUN_TEST(files);
+
+  END_TEST;
+}
@@ -56,37 +56,156 @@
 #include "plugin.h"
 #include "utils_ignorelist.h"
 
+/*
+ * Entries are compiled as they are added: literal strings go into a hash set,
+ * regular expressions are combined into a single expression, so that a lookup
+ * costs one hash probe and at most one regexec(3), regardless of the number of
+ * entries. As the same entries (device names and the like) are looked up every
+ * interval, the results of the regular expressions are memoized.
+ */
+
 /*
  * private prototypes
  */
-struct ignorelist_item_s {
+
+/* Open addressing hash table of strings, also used as the result memo. */
+typedef struct {
+  char *key;
+  uint32_t hash;
+  int value;
+} ignorelist_slot_t;
+
+typedef struct {
+  ignorelist_slot_t *slots;
+  size_t size; /* power of two */
+  size_t num;
+} ignorelist_table_t;
+
+/* Number of memoized results after which the memo is started over. */
+#define IGNORELIST_MEMO_MAX 16384
+
 #if HAVE_REGEX_H
+struct ignorelist_item_s {
   regex_t *rmatch; /* regular expression entry identification */
-#endif
-  char *smatch; /* string entry identification */
   struct ignorelist_item_s *next;
 };
 typedef struct ignorelist_item_s ignorelist_item_t;
+#endif
 
 struct ignorelist_s {
-  int ignore;              /* ignore entries */
-  ignorelist_item_t *head; /* pointer to the first entry */
+  int ignore; /* ignore entries */
+  ignorelist_table_t strings;
+
+#if HAVE_REGEX_H
+  /* Regular expressions that cannot be combined, because they use
+   * back-references. */
+  ignorelist_item_t *head;
+
+  /* All other expressions are combined into `combined' by the first lookup
+   * after an entry has been added. If that fails, they are compiled one by
+   * one into `fallback'. */
+  char **sources;
+  size_t sources_num;
+  size_t sources_nsub;
+  regex_t *combined;
+  ignorelist_item_t *fallback;
+  _Bool dirty;
+
+  ignorelist_table_t memo;
+  pthread_mutex_t lock;
+#endif
 };
 
 /* *** *** *** ********************************************* *** *** *** */
 /* *** *** *** *** *** ***   private functions   *** *** *** *** *** *** */
 /* *** *** *** ********************************************* *** *** *** */
 
-static inline void ignorelist_append(ignorelist_t *il,
-                                     ignorelist_item_t *item) {
-  assert((il != NULL) && (item != NULL));
+/* FNV-1a */
+static uint32_t ignorelist_hash(const char *str) {
+  uint32_t hash = 2166136261u;
+  for (const unsigned char *c = (const unsigned char *)str; *c != 0; c++) {
+    hash ^= *c;
+    hash *= 16777619u;
+  }
+  return hash;
+} /* uint32_t ignorelist_hash */
+
+static ignorelist_slot_t *ignorelist_table_find(ignorelist_table_t *t,
+                                                const char *key,
+                                                uint32_t hash) {
+  if (t->size == 0)
+    return NULL;
+
+  for (size_t i = hash & (t->size - 1);; i = (i + 1) & (t->size - 1)) {
+    ignorelist_slot_t *slot = t->slots + i;
+    if (slot->key == NULL)
+      return slot;
+    if ((slot->hash == hash) && (strcmp(slot->key, key) == 0))
+      return slot;
+  }
+} /* ignorelist_slot_t *ignorelist_table_find */
+
+static void ignorelist_table_clear(ignorelist_table_t *t) {
+  for (size_t i = 0; i < t->size; i++)
+    sfree(t->slots[i].key);
+  sfree(t->slots);
+  t->size = 0;
+  t->num = 0;
+} /* void ignorelist_table_clear */
+
+/* Adds `key' unless it is present already. The table is kept at most half
+ * full. */
+static int ignorelist_table_add(ignorelist_table_t *t, const char *key,
+                                int value) {
+  uint32_t hash = ignorelist_hash(key);
+
+  if (2 * (t->num + 1) > t->size) {
+    size_t size = (t->size > 0) ? 2 * t->size : 16;
+    ignorelist_table_t tmp = {.size = size};
+
+    tmp.slots = calloc(size, sizeof(*tmp.slots));
+    if (tmp.slots == NULL)
+      return ENOMEM;
+
+    for (size_t i = 0; i < t->size; i++) {
+      if (t->slots[i].key == NULL)
+        continue;
+      *ignorelist_table_find(&tmp, t->slots[i].key, t->slots[i].hash) =
+          t->slots[i];
+      tmp.num++;
+    }
 
-  item->next = il->head;
-  il->head = item;
-}
+    sfree(t->slots);
+    *t = tmp;
+  }
+
+  ignorelist_slot_t *slot = ignorelist_table_find(t, key, hash);
+  if (slot->key != NULL)
+    return 0;
+
+  slot->key = strdup(key);
+  if (slot->key == NULL)
+    return ENOMEM;
+  slot->hash = hash;
+  slot->value = value;
+  t->num++;
+
+  return 0;
+} /* int ignorelist_table_add */
 
 #if HAVE_REGEX_H
-static int ignorelist_append_regex(ignorelist_t *il, const char *re_str) {
+static void ignorelist_items_free(ignorelist_item_t *item) {
+  while (item != NULL) {
+    ignorelist_item_t *next = item->next;
+    regfree(item->rmatch);
+    sfree(item->rmatch);
+    sfree(item);
+    item = next;
+  }
+} /* void ignorelist_items_free */
+
+static int ignorelist_items_add(ignorelist_item_t **head, const char *re_str,
+                                size_t *ret_nsub) {
   regex_t *re;
   ignorelist_item_t *entry;
   int status;
@@ -97,7 +216,7 @@ static int ignorelist_append_regex(ignorelist_t *il, const char *re_str) {
     return ENOMEM;
   }
 
-  status = regcomp(re, re_str, REG_EXTENDED);
+  status = regcomp(re, re_str, REG_EXTENDED | REG_NOSUB);
   if (status != 0) {
     char errbuf[1024];
     (void)regerror(status, re, errbuf, sizeof(errbuf));
@@ -118,57 +237,157 @@ static int ignorelist_append_regex(ignorelist_t *il, const char *re_str) {
   }
   entry->rmatch = re;
 
-  ignorelist_append(il, entry);
+  if (ret_nsub != NULL)
+    *ret_nsub = re->re_nsub;
+
+  entry->next = *head;
+  *head = entry;
   return 0;
-} /* int ignorelist_append_regex */
-#endif
+} /* int ignorelist_items_add */
+
+/* Back-references refer to the groups of the original expression, which are
+ * renumbered in the combined expression. */
+static _Bool ignorelist_has_backref(const char *re_str) {
+  for (const char *c = re_str; *c != 0; c++) {
+    if (*c != '\\')
+      continue;
+    if ((c[1] >= '1') && (c[1] <= '9'))
+      return 1;
+    if (c[1] != 0)
+      c++;
+  }
+  return 0;
+} /* _Bool ignorelist_has_backref */
 
-static int ignorelist_append_string(ignorelist_t *il, const char *entry) {
-  ignorelist_item_t *new;
+static int ignorelist_append_regex(ignorelist_t *il, const char *re_str) {
+  if (ignorelist_has_backref(re_str)) {
+    il->dirty = 1;
+    return ignorelist_items_add(&il->head, re_str, /* ret_nsub = */ NULL);
+  }
 
-  /* create new entry */
-  if ((new = calloc(1, sizeof(*new))) == NULL) {
-    ERROR("cannot allocate new entry");
-    return 1;
+  /* Each expression is compiled on its own first, so that errors are
+   * reported for the expression at fault. */
+  ignorelist_item_t *tmp = NULL;
+  size_t nsub = 0;
+  int status = ignorelist_items_add(&tmp, re_str, &nsub);
+  ignorelist_items_free(tmp);
+  if (status != 0)
+    return status;
+
+  char **sources =
+      realloc(il->sources, (il->sources_num + 1) * sizeof(*il->sources));
+  if (sources == NULL) {
+    ERROR("ignorelist_append_regex: realloc failed.");
+    return ENOMEM;
   }
-  new->smatch = sstrdup(entry);
+  il->sources = sources;
 
-  /* append new entry */
-  ignorelist_append(il, new);
+  il->sources[il->sources_num] = strdup(re_str);
+  if (il->sources[il->sources_num] == NULL) {
+    ERROR("ignorelist_append_regex: strdup failed.");
+    return ENOMEM;
+  }
+  il->sources_num++;
+  il->sources_nsub += nsub + 1;
+  il->dirty = 1;
 
   return 0;
-} /* int ignorelist_append_string(ignorelist_t *il, const char *entry) */
+} /* int ignorelist_append_regex */
 
-#if HAVE_REGEX_H
-/*
- * check list for entry regex match
- * return 1 if found
- */
-static int ignorelist_match_regex(ignorelist_item_t *item, const char *entry) {
-  assert((item != NULL) && (item->rmatch != NULL) && (entry != NULL) &&
-         (strlen(entry) > 0));
+static void ignorelist_free_combined(ignorelist_t *il) {
+  if (il->combined != NULL) {
+    regfree(il->combined);
+    sfree(il->combined);
+  }
 
-  /* match regex */
-  if (regexec(item->rmatch, entry, 0, NULL, 0) == 0)
-    return 1;
+  ignorelist_items_free(il->fallback);
+  il->fallback = NULL;
+} /* void ignorelist_free_combined */
 
-  return 0;
-} /* int ignorelist_match_regex (ignorelist_item_t *item, const char *entry) */
-#endif
+/* Compiles the combined expression "(re0)|(re1)|...". Must be called with
+ * `lock' held. */
+static void ignorelist_compile(ignorelist_t *il) {
+  il->dirty = 0;
+  ignorelist_table_clear(&il->memo);
+  ignorelist_free_combined(il);
+
+  if (il->sources_num == 0)
+    return;
+
+  size_t len = 1;
+  for (size_t i = 0; i < il->sources_num; i++)
+    len += strlen(il->sources[i]) + strlen("|()");
+
+  char *str = malloc(len);
+  il->combined = calloc(1, sizeof(*il->combined));
+  if ((str != NULL) && (il->combined != NULL)) {
+    size_t offset = 0;
+    for (size_t i = 0; i < il->sources_num; i++)
+      offset += snprintf(str + offset, len - offset, "%s(%s)",
+                         (i > 0) ? "|" : "", il->sources[i]);
+
+    int status = regcomp(il->combined, str, REG_EXTENDED | REG_NOSUB);
+    /* The group count tells whether an expression with unbalanced
+     * parentheses has leaked into its neighbours. */
+    if ((status == 0) && (il->combined->re_nsub == il->sources_nsub)) {
+      sfree(str);
+      return;
+    }
+    if (status == 0)
+      regfree(il->combined);
+  }
+  sfree(str);
+  sfree(il->combined);
+
+  WARNING("utils_ignorelist: Combining %" PRIsz " regular expressions failed, "
+          "matching them one by one.",
+          il->sources_num);
+  for (size_t i = 0; i < il->sources_num; i++)
+    ignorelist_items_add(&il->fallback, il->sources[i], /* ret_nsub = */ NULL);
+} /* void ignorelist_compile */
 
 /*
- * check list for entry string match
+ * check the regular expressions for entry
  * return 1 if found
  */
-static int ignorelist_match_string(ignorelist_item_t *item, const char *entry) {
-  assert((item != NULL) && (item->smatch != NULL) && (entry != NULL) &&
-         (strlen(entry) > 0));
+static int ignorelist_match_regex(ignorelist_t *il, const char *entry) {
+  int status = 0;
 
-  if (strcmp(entry, item->smatch) == 0)
-    return 1;
+  pthread_mutex_lock(&il->lock);
 
-  return 0;
-} /* int ignorelist_match_string (ignorelist_item_t *item, const char *entry) */
+  if (il->dirty)
+    ignorelist_compile(il);
+
+  uint32_t hash = ignorelist_hash(entry);
+  ignorelist_slot_t *slot = ignorelist_table_find(&il->memo, entry, hash);
+  if ((slot != NULL) && (slot->key != NULL)) {
+    status = slot->value;
+    pthread_mutex_unlock(&il->lock);
+    return status;
+  }
+
+  if ((il->combined != NULL) &&
+      (regexec(il->combined, entry, 0, NULL, 0) == 0))
+    status = 1;
+
+  for (ignorelist_item_t *item = il->fallback;
+       (status == 0) && (item != NULL); item = item->next)
+    if (regexec(item->rmatch, entry, 0, NULL, 0) == 0)
+      status = 1;
+
+  for (ignorelist_item_t *item = il->head; (status == 0) && (item != NULL);
+       item = item->next)
+    if (regexec(item->rmatch, entry, 0, NULL, 0) == 0)
+      status = 1;
+
+  if (il->memo.num >= IGNORELIST_MEMO_MAX)
+    ignorelist_table_clear(&il->memo);
+  ignorelist_table_add(&il->memo, entry, status);
+
+  pthread_mutex_unlock(&il->lock);
+  return status;
+} /* int ignorelist_match_regex */
+#endif
 
 /* *** *** *** ******************************************** *** *** *** */
 /* *** *** *** *** *** ***   public functions   *** *** *** *** *** *** */
@@ -191,6 +410,10 @@ ignorelist_t *ignorelist_create(int invert) {
    */
   il->ignore = invert ? 0 : 1;
 
+#if HAVE_REGEX_H
+  pthread_mutex_init(&il->lock, /* attr = */ NULL);
+#endif
+
   return il;
 } /* ignorelist_t *ignorelist_create (int ignore) */
 
@@ -198,27 +421,20 @@ ignorelist_t *ignorelist_create(int invert) {
  * free memory used by ignorelist_t
  */
 void ignorelist_free(ignorelist_t *il) {
-  ignorelist_item_t *this;
-  ignorelist_item_t *next;
-
   if (il == NULL)
     return;
 
-  for (this = il->head; this != NULL; this = next) {
-    next = this->next;
+  ignorelist_table_clear(&il->strings);
+
 #if HAVE_REGEX_H
-    if (this->rmatch != NULL) {
-      regfree(this->rmatch);
-      sfree(this->rmatch);
-      this->rmatch = NULL;
-    }
+  ignorelist_items_free(il->head);
+  ignorelist_free_combined(il);
+  for (size_t i = 0; i < il->sources_num; i++)
+    sfree(il->sources[i]);
+  sfree(il->sources);
+  ignorelist_table_clear(&il->memo);
+  pthread_mutex_destroy(&il->lock);
 #endif
-    if (this->smatch != NULL) {
-      sfree(this->smatch);
-      this->smatch = NULL;
-    }
-    sfree(this);
-  }
 
   sfree(il);
 } /* void ignorelist_destroy (ignorelist_t *il) */
@@ -269,13 +485,20 @@ int ignorelist_add(ignorelist_t *il, const char *entry) {
     /* trim trailing slash */
     copy[strlen(copy) - 1] = 0;
 
+    pthread_mutex_lock(&il->lock);
     status = ignorelist_append_regex(il, copy);
+    pthread_mutex_unlock(&il->lock);
     sfree(copy);
     return status;
   }
 #endif
 
-  return ignorelist_append_string(il, entry);
+  if (ignorelist_table_add(&il->strings, entry, 1) != 0) {
+    ERROR("cannot allocate new entry");
+    return 1;
+  }
+
+  return 0;
 } /* int ignorelist_add (ignorelist_t *il, const char *entry) */
 
 /*
@@ -283,27 +506,30 @@ int ignorelist_add(ignorelist_t *il, const char *entry) {
  * return 1 for ignored entry
  */
 int ignorelist_match(ignorelist_t *il, const char *entry) {
+  if (il == NULL)
+    return 0;
+
   /* if no entries, collect all */
-  if ((il == NULL) || (il->head == NULL))
+#if HAVE_REGEX_H
+  if ((il->strings.num == 0) && (il->head == NULL) && (il->sources_num == 0))
+    return 0;
+#else
+  if (il->strings.num == 0)
     return 0;
+#endif
 
-  if ((entry == NULL) || (strlen(entry) == 0))
+  if ((entry == NULL) || (entry[0] == 0))
     return 0;
 
-  /* traverse list and check entries */
-  for (ignorelist_item_t *traverse = il->head; traverse != NULL;
-       traverse = traverse->next) {
+  ignorelist_slot_t *slot =
+      ignorelist_table_find(&il->strings, entry, ignorelist_hash(entry));
+  if ((slot != NULL) && (slot->key != NULL))
+    return il->ignore;
+
 #if HAVE_REGEX_H
-    if (traverse->rmatch != NULL) {
-      if (ignorelist_match_regex(traverse, entry))
-        return il->ignore;
-    } else
+  if (ignorelist_match_regex(il, entry))
+    return il->ignore;
 #endif
-    {
-      if (ignorelist_match_string(traverse, entry))
-        return il->ignore;
-    }
-  } /* for traverse */
 
   return 1 - il->ignore;
 } /* int ignorelist_match (ignorelist_t *il, const char *entry) */
@@ -0,0 +1,118 @@
+/**
+ * collectd - src/utils_ignorelist_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "collectd.h"
+
+#include "testing.h"
+#include "utils_ignorelist.h"
+
+DEF_TEST(strings) {
+  ignorelist_t *il = ignorelist_create(/* invert = */ 1);
+  CHECK_NOT_NULL(il);
+
+  /* An empty list collects everything. */
+  EXPECT_EQ_INT(0, ignorelist_match(il, "eth0"));
+
+  /* Enough entries to grow the hash set a few times. */
+  for (int i = 0; i < 200; i++) {
+    char name[32];
+    snprintf(name, sizeof(name), "veth%04d", 2 * i);
+    CHECK_ZERO(ignorelist_add(il, name));
+  }
+  CHECK_ZERO(ignorelist_add(il, "veth0000"));
+  OK(ignorelist_add(il, "") != 0);
+
+  /* With invert, only the entries are collected. */
+  EXPECT_EQ_INT(0, ignorelist_match(il, "veth0000"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "veth0398"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "veth0001"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "veth"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, ""));
+
+  ignorelist_set_invert(il, 0);
+  EXPECT_EQ_INT(1, ignorelist_match(il, "veth0000"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "veth0001"));
+
+  ignorelist_free(il);
+  return 0;
+}
+
+DEF_TEST(regex) {
+  ignorelist_t *il = ignorelist_create(/* invert = */ 0);
+  CHECK_NOT_NULL(il);
+
+  CHECK_ZERO(ignorelist_add(il, "/^veth/"));
+  CHECK_ZERO(ignorelist_add(il, "/^(lo|docker[0-9]+)$/"));
+  CHECK_ZERO(ignorelist_add(il, "eth1"));
+  OK(ignorelist_add(il, "/[/") != 0);
+
+  for (int i = 0; i < 2; i++) {
+    EXPECT_EQ_INT(1, ignorelist_match(il, "veth1234"));
+    EXPECT_EQ_INT(1, ignorelist_match(il, "lo"));
+    EXPECT_EQ_INT(1, ignorelist_match(il, "docker0"));
+    EXPECT_EQ_INT(1, ignorelist_match(il, "eth1"));
+    EXPECT_EQ_INT(0, ignorelist_match(il, "eth0"));
+    EXPECT_EQ_INT(0, ignorelist_match(il, "docker"));
+    EXPECT_EQ_INT(0, ignorelist_match(il, "lo0"));
+  }
+
+  /* Adding an entry invalidates the memoized results. */
+  CHECK_ZERO(ignorelist_add(il, "/^eth/"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "eth0"));
+
+  /* Back-references are kept as separate expressions. */
+  CHECK_ZERO(ignorelist_add(il, "/^(ab)\\1$/"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "abab"));
+  EXPECT_EQ_INT(0, ignorelist_match(il, "ab"));
+  EXPECT_EQ_INT(1, ignorelist_match(il, "veth0"));
+
+  ignorelist_free(il);
+  return 0;
+}
+
+DEF_TEST(memo) {
+  ignorelist_t *il = ignorelist_create(/* invert = */ 0);
+  CHECK_NOT_NULL(il);
+  CHECK_ZERO(ignorelist_add(il, "/[13579]$/"));
+
+  /* More names than the memo holds. */
+  int ignored = 0;
+  for (int n = 0; n < 3; n++) {
+    for (int i = 0; i < 40000; i++) {
+      char name[32];
+      snprintf(name, sizeof(name), "dev%d", i);
+      ignored += ignorelist_match(il, name);
+    }
+  }
+  EXPECT_EQ_INT(3 * 20000, ignored);
+
+  ignorelist_free(il);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(strings);
+  RUN_TEST(regex);
+  RUN_TEST(memo);
+
+  END_TEST;
+}
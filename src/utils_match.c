@@ -41,6 +41,12 @@ struct cu_match_s {
   regex_t excluderegex;
   int flags;
 
+  char *regex_str;
+  char *excluderegex_str;
+  /* A string every matching line contains, or NULL. Lines not containing it
+   * are rejected with strstr(3) before running the regular expression. */
+  char *literal;
+
   int (*callback)(const char *str, char *const *matches, size_t matches_num,
                   void *user_data);
   void *user_data;
@@ -72,6 +78,173 @@ static char *match_substr(const char *str, int begin, int end) {
   return ret;
 } /* char *match_substr */
 
+/* Takes a pointer to the opening bracket of a bracket expression and returns
+ * a pointer to its closing bracket, or to the terminating null byte if the
+ * expression is unterminated. */
+static const char *match_skip_bracket(const char *ptr) {
+  ptr++;
+  if (*ptr == '^')
+    ptr++;
+  /* "[]...]" and "[^]...]" include a literal closing bracket. */
+  if (*ptr == ']')
+    ptr++;
+
+  while ((*ptr != 0) && (*ptr != ']')) {
+    /* Skip "[:alpha:]", "[.x.]" and "[=x=]". */
+    if ((ptr[0] == '[') &&
+        ((ptr[1] == ':') || (ptr[1] == '.') || (ptr[1] == '='))) {
+      char delim = ptr[1];
+      ptr += 2;
+      while ((*ptr != 0) && !((ptr[0] == delim) && (ptr[1] == ']')))
+        ptr++;
+      if (*ptr == 0)
+        break;
+      ptr++;
+    }
+    ptr++;
+  }
+
+  return ptr;
+} /* const char *match_skip_bracket */
+
+/* Returns true if `regex' contains an alternation outside of a bracket
+ * expression. */
+static _Bool match_has_alternation(const char *regex) {
+  for (const char *ptr = regex; *ptr != 0; ptr++) {
+    if (*ptr == '\\') {
+      if (ptr[1] == 0)
+        break;
+      ptr++;
+    } else if (*ptr == '[') {
+      ptr = match_skip_bracket(ptr);
+      if (*ptr == 0)
+        break;
+    } else if (*ptr == '|') {
+      return 1;
+    }
+  }
+  return 0;
+} /* _Bool match_has_alternation */
+
+/* Determines the longest run of literal characters that every string
+ * matched by the extended regular expression `regex' must contain. This is
+ * deliberately conservative: only characters outside of groups, bracket
+ * expressions and optional repetitions are considered, and patterns using
+ * alternation yield no literal at all. Returns NULL if no such literal
+ * exists. */
+static char *match_required_literal(const char *regex) {
+  size_t regex_len = strlen(regex);
+  char run[regex_len + 1];
+  size_t run_len = 0;
+  char *best = NULL;
+  size_t best_len = 0;
+  int depth = 0;
+
+  if (match_has_alternation(regex))
+    return NULL;
+
+#define END_RUN                                                                \
+  do {                                                                         \
+    if (run_len > best_len) {                                                  \
+      sfree(best);                                                             \
+      best = malloc(run_len + 1);                                              \
+      if (best == NULL)                                                        \
+        return NULL;                                                           \
+      memcpy(best, run, run_len);                                              \
+      best[run_len] = 0;                                                       \
+      best_len = run_len;                                                      \
+    }                                                                          \
+    run_len = 0;                                                               \
+  } while (0)
+
+  for (const char *ptr = regex; *ptr != 0; ptr++) {
+    char c = *ptr;
+
+    if (c == '(') {
+      END_RUN;
+      depth++;
+      continue;
+    } else if (c == ')') {
+      if (depth > 0)
+        depth--;
+      continue;
+    } else if (depth > 0) {
+      /* Skip escaped characters and bracket expressions inside groups, so
+       * that parentheses within them are not counted. */
+      if ((c == '\\') && (ptr[1] != 0))
+        ptr++;
+      else if (c == '[') {
+        ptr = match_skip_bracket(ptr);
+        if (*ptr == 0)
+          break;
+      }
+      continue;
+    }
+
+    switch (c) {
+    case '*':
+    case '?':
+    case '{':
+      /* The preceding character, which may be a multi-byte character, may be
+       * absent. */
+      while ((run_len > 0) && ((run[run_len - 1] & 0xC0) == 0x80))
+        run_len--;
+      if (run_len > 0)
+        run_len--;
+      END_RUN;
+      if (c == '{') {
+        while ((*ptr != 0) && (*ptr != '}'))
+          ptr++;
+        if (*ptr == 0)
+          goto out;
+      }
+      break;
+
+    case '+':
+      /* The preceding character is required, but may repeat. */
+      END_RUN;
+      break;
+
+    case '.':
+    case '^':
+    case '$':
+      END_RUN;
+      break;
+
+    case '[':
+      END_RUN;
+      ptr = match_skip_bracket(ptr);
+      if (*ptr == 0)
+        goto out;
+      break;
+
+    case '\\':
+      if (ptr[1] == 0)
+        goto out;
+      ptr++;
+      /* Only escaped punctuation is a plain literal. Anything else, such as
+       * GNU's "\w", "\b" or "\<", is a special sequence. */
+      if (ispunct((unsigned char)*ptr) && (strchr("<>`'", *ptr) == NULL))
+        run[run_len++] = *ptr;
+      else
+        END_RUN;
+      break;
+
+    default:
+      run[run_len++] = c;
+    }
+  }
+
+out:
+  /* A quantifier can't follow the end of the expression, so the last run is
+   * complete. */
+  if (depth == 0)
+    END_RUN;
+#undef END_RUN
+
+  return best;
+} /* char *match_required_literal */
+
 static int default_callback(const char __attribute__((unused)) * str,
                             char *const *matches, size_t matches_num,
                             void *user_data) {
@@ -248,6 +421,11 @@ match_create_callback(const char *regex, const char *excluderegex,
     obj->flags |= UTILS_MATCH_FLAGS_EXCLUDE_REGEX;
   }
 
+  obj->regex_str = strdup(regex);
+  if ((excluderegex != NULL) && (strcmp(excluderegex, "") != 0))
+    obj->excluderegex_str = strdup(excluderegex);
+  obj->literal = match_required_literal(regex);
+
   obj->callback = callback;
   obj->user_data = user_data;
   obj->free = free_user_data;
@@ -310,17 +488,25 @@ void match_destroy(cu_match_t *obj) {
   if ((obj->user_data != NULL) && (obj->free != NULL))
     (*obj->free)(obj->user_data);
 
+  sfree(obj->regex_str);
+  sfree(obj->excluderegex_str);
+  sfree(obj->literal);
   sfree(obj);
 } /* void match_destroy */
 
-int match_apply(cu_match_t *obj, const char *str) {
+/* Runs the regular expressions of `obj' against `str'. Returns 1 and fills
+ * `matches' with the (sub-)matches if the line matched, 0 if it didn't and
+ * less than zero on error. The strings in `matches' must be freed with
+ * match_free_substr() in any case. */
+static int match_exec(cu_match_t *obj, const char *str, char **matches,
+                      size_t *matches_num) {
   int status;
   regmatch_t re_match[32];
-  char *matches[32] = {0};
-  size_t matches_num;
 
-  if ((obj == NULL) || (str == NULL))
-    return -1;
+  *matches_num = 0;
+
+  if ((obj->literal != NULL) && (strstr(str, obj->literal) == NULL))
+    return 0;
 
   if (obj->flags & UTILS_MATCH_FLAGS_EXCLUDE_REGEX) {
     status =
@@ -340,31 +526,51 @@ int match_apply(cu_match_t *obj, const char *str) {
   if (status != 0)
     return 0;
 
-  for (matches_num = 0; matches_num < STATIC_ARRAY_SIZE(matches);
-       matches_num++) {
-    if ((re_match[matches_num].rm_so < 0) || (re_match[matches_num].rm_eo < 0))
-      break;
+  for (*matches_num = 0; *matches_num < STATIC_ARRAY_SIZE(re_match);
+       (*matches_num)++) {
+    size_t i = *matches_num;
 
-    matches[matches_num] = match_substr(str, re_match[matches_num].rm_so,
-                                        re_match[matches_num].rm_eo);
-    if (matches[matches_num] == NULL) {
-      status = -1;
+    if ((re_match[i].rm_so < 0) || (re_match[i].rm_eo < 0))
       break;
-    }
-  }
 
-  if (status != 0) {
-    ERROR("utils_match: match_apply: match_substr failed.");
-  } else {
-    status = obj->callback(str, matches, matches_num, obj->user_data);
-    if (status != 0) {
-      ERROR("utils_match: match_apply: callback failed.");
+    matches[i] = match_substr(str, re_match[i].rm_so, re_match[i].rm_eo);
+    if (matches[i] == NULL) {
+      ERROR("utils_match: match_apply: match_substr failed.");
+      return -1;
     }
   }
 
+  return 1;
+} /* int match_exec */
+
+static void match_free_substr(char **matches, size_t matches_num) {
   for (size_t i = 0; i < matches_num; i++) {
     sfree(matches[i]);
   }
+} /* void match_free_substr */
+
+static int match_call(cu_match_t *obj, const char *str, char *const *matches,
+                      size_t matches_num) {
+  int status = obj->callback(str, matches, matches_num, obj->user_data);
+  if (status != 0) {
+    ERROR("utils_match: match_apply: callback failed.");
+  }
+  return status;
+} /* int match_call */
+
+int match_apply(cu_match_t *obj, const char *str) {
+  int status;
+  char *matches[32] = {0};
+  size_t matches_num = 0;
+
+  if ((obj == NULL) || (str == NULL))
+    return -1;
+
+  status = match_exec(obj, str, matches, &matches_num);
+  if (status > 0)
+    status = match_call(obj, str, matches, matches_num);
+
+  match_free_substr(matches, matches_num);
 
   return status;
 } /* int match_apply */
@@ -374,3 +580,107 @@ void *match_get_user_data(cu_match_t *obj) {
     return NULL;
   return obj->user_data;
 } /* void *match_get_user_data */
+
+/*
+ * Match sets
+ */
+/* Matches with identical regular expressions form a group: the expressions
+ * are evaluated once per line and the result is passed to the callbacks of
+ * all members. */
+struct cu_match_group_s {
+  cu_match_t **members;
+  size_t members_num;
+};
+typedef struct cu_match_group_s cu_match_group_t;
+
+struct cu_match_set_s {
+  cu_match_group_t *groups;
+  size_t groups_num;
+};
+
+static _Bool match_str_equal(const char *a, const char *b) {
+  if ((a == NULL) || (b == NULL))
+    return a == b;
+  return strcmp(a, b) == 0;
+} /* _Bool match_str_equal */
+
+cu_match_set_t *match_set_create(void) {
+  return calloc(1, sizeof(cu_match_set_t));
+} /* cu_match_set_t *match_set_create */
+
+void match_set_destroy(cu_match_set_t *set) {
+  if (set == NULL)
+    return;
+
+  for (size_t i = 0; i < set->groups_num; i++)
+    sfree(set->groups[i].members);
+  sfree(set->groups);
+  sfree(set);
+} /* void match_set_destroy */
+
+int match_set_add(cu_match_set_t *set, cu_match_t *match) {
+  cu_match_group_t *group = NULL;
+
+  if ((set == NULL) || (match == NULL))
+    return EINVAL;
+
+  for (size_t i = 0; i < set->groups_num; i++) {
+    cu_match_t *leader = set->groups[i].members[0];
+    if (match_str_equal(leader->regex_str, match->regex_str) &&
+        match_str_equal(leader->excluderegex_str, match->excluderegex_str)) {
+      group = set->groups + i;
+      break;
+    }
+  }
+
+  if (group == NULL) {
+    cu_match_group_t *tmp =
+        realloc(set->groups, sizeof(*set->groups) * (set->groups_num + 1));
+    if (tmp == NULL)
+      return ENOMEM;
+    set->groups = tmp;
+    group = set->groups + set->groups_num;
+    set->groups_num++;
+    memset(group, 0, sizeof(*group));
+  }
+
+  cu_match_t **tmp =
+      realloc(group->members, sizeof(*group->members) * (group->members_num + 1));
+  if (tmp == NULL) {
+    /* Don't leave an empty group behind. */
+    if (group->members_num == 0)
+      set->groups_num--;
+    return ENOMEM;
+  }
+  group->members = tmp;
+  group->members[group->members_num] = match;
+  group->members_num++;
+
+  return 0;
+} /* int match_set_add */
+
+int match_set_apply(cu_match_set_t *set, const char *str) {
+  int ret = 0;
+
+  if ((set == NULL) || (str == NULL))
+    return -1;
+
+  for (size_t i = 0; i < set->groups_num; i++) {
+    cu_match_group_t *group = set->groups + i;
+    char *matches[32] = {0};
+    size_t matches_num = 0;
+
+    int status = match_exec(group->members[0], str, matches, &matches_num);
+    if (status < 0)
+      ret = status;
+
+    for (size_t j = 0; (status > 0) && (j < group->members_num); j++) {
+      if (match_call(group->members[j], str, matches, matches_num) != 0)
+        ret = -1;
+    }
+
+    match_free_substr(matches, matches_num);
+  }
+
+  return ret;
+} /* int match_set_apply */
@@ -68,6 +68,9 @@
 struct cu_match_s;
 typedef struct cu_match_s cu_match_t;
 
+struct cu_match_set_s;
+typedef struct cu_match_set_s cu_match_set_t;
+
 struct cu_match_value_s {
   int ds_type;
   value_t value;
@@ -176,4 +179,48 @@ int match_apply(cu_match_t *obj, const char *str);
  */
 void *match_get_user_data(cu_match_t *obj);
 
+/*
+ * NAME
+ *  match_set_create
+ *
+ * DESCRIPTION
+ *  Creates an empty set of matches. A set applies all of its matches to a
+ *  string in one pass: matches using identical regular expressions (and
+ *  exclude regular expressions) are evaluated only once and their callbacks
+ *  all receive the result.
+ */
+cu_match_set_t *match_set_create(void);
+
+/*
+ * NAME
+ *  match_set_add
+ *
+ * DESCRIPTION
+ *  Adds `match' to the set. The set does not take ownership of the match, it
+ *  has to be destroyed with `match_destroy' after the set has been destroyed.
+ *
+ * RETURN VALUE
+ *  Zero upon success, an errno value otherwise.
+ */
+int match_set_add(cu_match_set_t *set, cu_match_t *match);
+
+/*
+ * NAME
+ *  match_set_apply
+ *
+ * DESCRIPTION
+ *  Equivalent to calling `match_apply' with `str' for every match in the set,
+ *  in the order they were added to their group.
+ */
+int match_set_apply(cu_match_set_t *set, const char *str);
+
+/*
+ * NAME
+ *  match_set_destroy
+ *
+ * DESCRIPTION
+ *  Destroys the set. The matches in the set are not touched.
+ */
+void match_set_destroy(cu_match_set_t *set);
+
 #endif /* UTILS_MATCH_H */
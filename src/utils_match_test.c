@@ -0,0 +1,145 @@
+/**
+ * collectd - src/utils_match_test.c
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "testing.h"
+#include "utils_match.c" /* sic */
+
+DEF_TEST(required_literal) {
+  struct {
+    char const *regex;
+    char const *want;
+  } cases[] = {
+      {"foobar", "foobar"},
+      {"S=([1-9][0-9]*)", "S="},
+      {"^GET /index.html HTTP", "GET /index"},
+      {"abcd*ef", "abc"},
+      {"ab?cdef", "cdef"},
+      {"xa+yz", "xa"},
+      {"a{2}bc", "bc"},
+      {"[[:digit:]]+ requests", " requests"},
+      {"[]x]abc", "abc"},
+      {"x(foo|bar)yz", NULL},
+      {"foo|bar", NULL},
+      {"(foo)", NULL},
+      {"\\.conf", ".conf"},
+      {"\\<word\\>", "word"},
+      {"\\w+", NULL},
+      {"[|]abc", "abc"},
+      {".*", NULL},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char *got = match_required_literal(cases[i].regex);
+
+    printf("## Case %zu: %s\n", i, cases[i].regex);
+    if (cases[i].want == NULL) {
+      OK1(got == NULL, cases[i].regex);
+    } else {
+      OK1(got != NULL, cases[i].regex);
+      EXPECT_EQ_STR(cases[i].want, got);
+    }
+    sfree(got);
+  }
+
+  return 0;
+}
+
+static int count_callback(__attribute__((unused)) const char *str,
+                          char *const *matches, size_t matches_num,
+                          void *user_data) {
+  int *count = user_data;
+
+  if ((matches_num > 1) && isdigit((unsigned char)matches[1][0]))
+    *count += atoi(matches[1]);
+  else
+    *count += 1;
+
+  return 0;
+}
+
+DEF_TEST(match_set) {
+  char const *lines[] = {
+      "GET /index.html 200 512",
+      "GET /favicon.ico 404 0",
+      "POST /login 200 64",
+      "HEAD / 301 0",
+  };
+  struct {
+    char const *regex;
+    char const *excluderegex;
+  } specs[] = {
+      {"^GET ", NULL},
+      {"^GET ", NULL},
+      {" 200 ([0-9]+)$", NULL},
+      {" 200 ([0-9]+)$", "POST"},
+      {"(HEAD|POST) ", NULL},
+  };
+  int want[STATIC_ARRAY_SIZE(specs)] = {0};
+  int got[STATIC_ARRAY_SIZE(specs)] = {0};
+  cu_match_t *single[STATIC_ARRAY_SIZE(specs)];
+  cu_match_t *grouped[STATIC_ARRAY_SIZE(specs)];
+  cu_match_set_t *set;
+
+  CHECK_NOT_NULL(set = match_set_create());
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(specs); i++) {
+    CHECK_NOT_NULL(single[i] =
+                       match_create_callback(specs[i].regex,
+                                             specs[i].excluderegex,
+                                             count_callback, want + i, NULL));
+    CHECK_NOT_NULL(grouped[i] =
+                       match_create_callback(specs[i].regex,
+                                             specs[i].excluderegex,
+                                             count_callback, got + i, NULL));
+    CHECK_ZERO(match_set_add(set, grouped[i]));
+  }
+
+  /* Identical expressions share a group. */
+  EXPECT_EQ_INT(4, set->groups_num);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(lines); i++) {
+    for (size_t j = 0; j < STATIC_ARRAY_SIZE(specs); j++)
+      CHECK_ZERO(match_apply(single[j], lines[i]));
+    CHECK_ZERO(match_set_apply(set, lines[i]));
+  }
+
+  EXPECT_EQ_INT(2, want[0]);
+  EXPECT_EQ_INT(576, want[2]);
+  EXPECT_EQ_INT(512, want[3]);
+  EXPECT_EQ_INT(2, want[4]);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(specs); i++)
+    EXPECT_EQ_INT(want[i], got[i]);
+
+  match_set_destroy(set);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(specs); i++) {
+    match_destroy(single[i]);
+    match_destroy(grouped[i]);
+  }
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(required_literal);
+  RUN_TEST(match_set);
+
+  END_TEST;
+}
@@ -35,15 +35,91 @@
 #include "common.h"
 #include "utils_tail.h"
 
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+/* Size of the chunks read from the file. */
+#define CU_TAIL_BUFFER_SIZE 65536
+
 struct cu_tail_s {
   char *file;
-  FILE *fh;
+  int fd;
   struct stat stat;
+
+  /* Data read from the file but not yet returned to the caller. Unconsumed
+   * data starts at `buffer_pos' and ends at `buffer_fill'. */
+  char buffer[CU_TAIL_BUFFER_SIZE];
+  size_t buffer_pos;
+  size_t buffer_fill;
+
+  /* With inotify, the file is only read and stat'ed after the kernel
+   * reported a change. Without inotify (inotify_fd < 0), `changed' is
+   * always set and the file is polled on every read. */
+  int inotify_fd;
+  int inotify_wd;
+  _Bool changed;
 };
 
+static void cu_tail_inotify_disable(cu_tail_t *obj) {
+  if (obj->inotify_fd >= 0)
+    close(obj->inotify_fd);
+  obj->inotify_fd = -1;
+  obj->inotify_wd = -1;
+  obj->changed = 1;
+} /* void cu_tail_inotify_disable */
+
+/* (Re-)installs the inotify watch on the file name after it was opened. */
+static void cu_tail_inotify_watch(cu_tail_t *obj) {
+#if HAVE_SYS_INOTIFY_H
+  if (obj->inotify_fd < 0)
+    return;
+
+  if (obj->inotify_wd >= 0)
+    inotify_rm_watch(obj->inotify_fd, obj->inotify_wd);
+
+  obj->inotify_wd = inotify_add_watch(
+      obj->inotify_fd, obj->file,
+      IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+  if (obj->inotify_wd < 0) {
+    WARNING("utils_tail: inotify_add_watch (%s) failed: %s. Falling back to "
+            "polling.",
+            obj->file, STRERRNO);
+    cu_tail_inotify_disable(obj);
+  }
+#endif
+} /* void cu_tail_inotify_watch */
+
+/* Reads all pending inotify events and sets `changed' if there were any. */
+static void cu_tail_inotify_drain(cu_tail_t *obj) {
+#if HAVE_SYS_INOTIFY_H
+  char buf[4096]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  while (obj->inotify_fd >= 0) {
+    ssize_t status = read(obj->inotify_fd, buf, sizeof(buf));
+    if (status > 0) {
+      obj->changed = 1;
+      continue;
+    }
+
+    if ((status < 0) && (errno == EINTR))
+      continue;
+
+    if ((status < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+      WARNING("utils_tail: reading inotify events for `%s' failed: %s. "
+              "Falling back to polling.",
+              obj->file, STRERRNO);
+      cu_tail_inotify_disable(obj);
+    }
+    break;
+  }
+#endif
+} /* void cu_tail_inotify_drain */
+
 static int cu_tail_reopen(cu_tail_t *obj) {
   int seek_end = 0;
-  FILE *fh;
+  int fd;
   struct stat stat_buf = {0};
   int status;
 
@@ -54,17 +130,19 @@ static int cu_tail_reopen(cu_tail_t *obj) {
   }
 
   /* The file is already open.. */
-  if ((obj->fh != NULL) && (stat_buf.st_ino == obj->stat.st_ino)) {
+  if ((obj->fd >= 0) && (stat_buf.st_ino == obj->stat.st_ino)) {
     /* Seek to the beginning if file was truncated */
     if (stat_buf.st_size < obj->stat.st_size) {
       INFO("utils_tail: File `%s' was truncated.", obj->file);
-      status = fseek(obj->fh, 0, SEEK_SET);
-      if (status != 0) {
-        ERROR("utils_tail: fseek (%s) failed: %s", obj->file, STRERRNO);
-        fclose(obj->fh);
-        obj->fh = NULL;
+      if (lseek(obj->fd, 0, SEEK_SET) == (off_t)-1) {
+        ERROR("utils_tail: lseek (%s) failed: %s", obj->file, STRERRNO);
+        close(obj->fd);
+        obj->fd = -1;
         return -1;
       }
+      /* A partial line from before the truncation can't be completed. */
+      obj->buffer_pos = 0;
+      obj->buffer_fill = 0;
     }
     memcpy(&obj->stat, &stat_buf, sizeof(struct stat));
     return 1;
@@ -75,29 +153,91 @@ static int cu_tail_reopen(cu_tail_t *obj) {
   if ((obj->stat.st_ino == 0) || (obj->stat.st_ino == stat_buf.st_ino))
     seek_end = 1;
 
-  fh = fopen(obj->file, "r");
-  if (fh == NULL) {
-    ERROR("utils_tail: fopen (%s) failed: %s", obj->file, STRERRNO);
+  fd = open(obj->file, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    ERROR("utils_tail: open (%s) failed: %s", obj->file, STRERRNO);
     return -1;
   }
 
   if (seek_end != 0) {
-    status = fseek(fh, 0, SEEK_END);
-    if (status != 0) {
-      ERROR("utils_tail: fseek (%s) failed: %s", obj->file, STRERRNO);
-      fclose(fh);
+    if (lseek(fd, 0, SEEK_END) == (off_t)-1) {
+      ERROR("utils_tail: lseek (%s) failed: %s", obj->file, STRERRNO);
+      close(fd);
       return -1;
     }
   }
 
-  if (obj->fh != NULL)
-    fclose(obj->fh);
-  obj->fh = fh;
+  if (obj->fd >= 0)
+    close(obj->fd);
+  obj->fd = fd;
   memcpy(&obj->stat, &stat_buf, sizeof(struct stat));
 
+  cu_tail_inotify_watch(obj);
+  obj->changed = 1;
+
   return 0;
 } /* int cu_tail_reopen */
 
+/* Reads the next chunk of the file into the buffer. Returns the number of
+ * bytes read, zero on EOF and less than zero on error. */
+static ssize_t cu_tail_fill(cu_tail_t *obj) {
+  ssize_t status;
+
+  /* Move unconsumed data to the front of the buffer. */
+  if (obj->buffer_pos > 0) {
+    memmove(obj->buffer, obj->buffer + obj->buffer_pos,
+            obj->buffer_fill - obj->buffer_pos);
+    obj->buffer_fill -= obj->buffer_pos;
+    obj->buffer_pos = 0;
+  }
+
+  do {
+    status = read(obj->fd, obj->buffer + obj->buffer_fill,
+                  sizeof(obj->buffer) - obj->buffer_fill);
+  } while ((status < 0) && (errno == EINTR));
+
+  if (status < 0) {
+    WARNING("utils_tail: read (%s) failed: %s", obj->file, STRERRNO);
+    return -1;
+  }
+
+  obj->buffer_fill += (size_t)status;
+  return status;
+} /* ssize_t cu_tail_fill */
+
+/* Copies the next line, including the newline character, from the buffer to
+ * `buf'. Lines longer than `buflen - 1' are returned in pieces. Incomplete
+ * lines are only returned if `force' is true. Returns true if `buf' has been
+ * filled. */
+static _Bool cu_tail_copy_line(cu_tail_t *obj, char *buf, int buflen,
+                               _Bool force) {
+  char *start = obj->buffer + obj->buffer_pos;
+  size_t avail = obj->buffer_fill - obj->buffer_pos;
+  size_t max = (size_t)buflen - 1;
+  size_t len;
+
+  char *newline = memchr(start, '\n', (avail < max) ? avail : max);
+  if (newline != NULL)
+    len = (size_t)(newline - start) + 1;
+  else if (avail >= max)
+    len = max;
+  else if ((force || (avail == sizeof(obj->buffer))) && (avail > 0))
+    len = avail;
+  else
+    return 0;
+
+  memcpy(buf, start, len);
+  buf[len] = 0;
+
+  obj->buffer_pos += len;
+  if (obj->buffer_pos == obj->buffer_fill) {
+    obj->buffer_pos = 0;
+    obj->buffer_fill = 0;
+  }
+
+  return 1;
+} /* _Bool cu_tail_copy_line */
+
 cu_tail_t *cu_tail_create(const char *file) {
   cu_tail_t *obj;
 
@@ -111,14 +251,26 @@ cu_tail_t *cu_tail_create(const char *file) {
     return NULL;
   }
 
-  obj->fh = NULL;
+  obj->fd = -1;
+  obj->inotify_fd = -1;
+  obj->inotify_wd = -1;
+  obj->changed = 1;
+
+#if HAVE_SYS_INOTIFY_H
+  obj->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (obj->inotify_fd < 0)
+    INFO("utils_tail: inotify_init1 failed: %s. Polling `%s' instead.",
+         STRERRNO, obj->file);
+#endif
 
   return obj;
 } /* cu_tail_t *cu_tail_create */
 
 int cu_tail_destroy(cu_tail_t *obj) {
-  if (obj->fh != NULL)
-    fclose(obj->fh);
+  if (obj->fd >= 0)
+    close(obj->fd);
+  if (obj->inotify_fd >= 0)
+    close(obj->inotify_fd);
   free(obj->file);
   free(obj);
 
@@ -133,58 +285,55 @@ int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen) {
     return -1;
   }
 
-  if (obj->fh == NULL) {
+  if (obj->fd < 0) {
     status = cu_tail_reopen(obj);
     if (status < 0)
       return status;
   }
-  assert(obj->fh != NULL);
+  assert(obj->fd >= 0);
 
-  /* Try to read from the filehandle. If that succeeds, everything appears to
-   * be fine and we can return. */
-  clearerr(obj->fh);
-  if (fgets(buf, buflen, obj->fh) != NULL) {
-    buf[buflen - 1] = 0;
-    return 0;
-  }
+  while (42) {
+    /* Serve complete lines from the buffer first. */
+    if (cu_tail_copy_line(obj, buf, buflen, /* force = */ 0))
+      return 0;
+
+    /* Nothing happened to the file since it was last read to the end. */
+    cu_tail_inotify_drain(obj);
+    if (!obj->changed) {
+      buf[0] = 0;
+      return 0;
+    }
 
-  /* Check if we encountered an error */
-  if (ferror(obj->fh) != 0) {
-    /* Jupp, error. Force `cu_tail_reopen' to reopen the file.. */
-    fclose(obj->fh);
-    obj->fh = NULL;
-  }
-  /* else: eof -> check if the file was moved away and reopen the new file if
-   * so.. */
-
-  status = cu_tail_reopen(obj);
-  /* error -> return with error */
-  if (status < 0)
-    return status;
-  /* file end reached and file not reopened -> nothing more to read */
-  else if (status > 0) {
-    buf[0] = 0;
-    return 0;
-  }
+    ssize_t read_status = cu_tail_fill(obj);
+    if (read_status > 0)
+      continue;
 
-  /* If we get here: file was re-opened and there may be more to read.. Let's
-   * try again. */
-  if (fgets(buf, buflen, obj->fh) != NULL) {
-    buf[buflen - 1] = 0;
-    return 0;
-  }
+    if (read_status < 0) {
+      /* Jupp, error. Force `cu_tail_reopen' to reopen the file.. */
+      close(obj->fd);
+      obj->fd = -1;
+    }
+    /* else: eof -> check if the file was moved away and reopen the new file
+     * if so.. */
 
-  if (ferror(obj->fh) != 0) {
-    WARNING("utils_tail: fgets (%s) returned an error: %s", obj->file,
-            STRERRNO);
-    fclose(obj->fh);
-    obj->fh = NULL;
-    return -1;
-  }
+    status = cu_tail_reopen(obj);
+    /* error -> return with error */
+    if (status < 0)
+      return status;
+    /* file end reached and file not reopened -> nothing more to read */
+    else if (status > 0) {
+      if (obj->inotify_fd >= 0)
+        obj->changed = 0;
+      buf[0] = 0;
+      return 0;
+    }
 
-  /* EOf, well, apparently the new file is empty.. */
-  buf[0] = 0;
-  return 0;
+    /* If we get here: file was re-opened and there may be more to read.
+     * Whatever is left of the old file will never be completed, so return
+     * it first. */
+    if (cu_tail_copy_line(obj, buf, buflen, /* force = */ 1))
+      return 0;
+  }
 } /* int cu_tail_readline */
 
 int cu_tail_read(cu_tail_t *obj, char *buf, int buflen, tailfunc_t *callback,
@@ -71,6 +71,11 @@ int cu_tail_destroy(cu_tail_t *obj);
  * the length of the string stored in the buffer is zero, EOF occurred.
  * Otherwise at least the newline character will be in the buffer.
  *
+ * The file is read in large chunks. A trailing line without a newline
+ * character is held back until it is completed, or returned as-is when the
+ * file is rotated. Where inotify(7) is available, the file is only read and
+ * checked for rotation after the kernel reported a change.
+ *
  * Returns 0 when successful and non-zero otherwise.
  */
 int cu_tail_readline(cu_tail_t *obj, char *buf, int buflen);
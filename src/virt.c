@@ -40,6 +40,10 @@
 
 #ifdef LIBVIR_CHECK_VERSION
 
+#if LIBVIR_CHECK_VERSION(0, 9, 0)
+#define HAVE_DOMAIN_EVENTS 1
+#endif
+
 #if LIBVIR_CHECK_VERSION(0, 9, 2)
 #define HAVE_DOM_REASON 1
 #endif
@@ -67,6 +71,10 @@
 #define HAVE_DOM_REASON_PAUSED_CRASHED 1
 #endif
 
+#if LIBVIR_CHECK_VERSION(1, 2, 8)
+#define HAVE_DOMAIN_STATS 1
+#endif
+
 #if LIBVIR_CHECK_VERSION(1, 2, 9)
 #define HAVE_JOB_STATS 1
 #endif
@@ -108,6 +116,9 @@ static const char *config_keys[] = {"Connection",
 
                                     "Instances",
                                     "ExtraStats",
+
+                                    "BulkStats",
+                                    "DomainEvents",
                                     NULL};
 
 const char *domain_states[] = {
@@ -251,6 +262,13 @@ static virNodeInfo nodeinfo;
 /* Seconds between list refreshes, 0 disables completely. */
 static int interval = 60;
 
+/* Fetch the statistics of all domains with one virDomainListGetStats call. */
+static _Bool bulk_stats = 0;
+
+/* Refresh the lists on domain lifecycle events instead of every
+ * RefreshInterval seconds. */
+static _Bool domain_events = 0;
+
 /* List of domains, if specified. */
 static ignorelist_t *il_domains = NULL;
 /* List of block devices, if specified. */
@@ -315,6 +333,8 @@ struct lv_read_instance {
   struct lv_read_state read_state;
   char tag[PARTITION_TAG_MAX_LEN];
   size_t id;
+  /* Value of domain_event_count at the last list refresh. */
+  unsigned long domain_events_seen;
 };
 
 struct lv_user_data {
@@ -1070,10 +1090,150 @@ static int lv_config(const char *key, const char *value) {
     }
   }
 
+  if (strcasecmp(key, "BulkStats") == 0) {
+#ifdef HAVE_DOMAIN_STATS
+    bulk_stats = IS_TRUE(value);
+    return 0;
+#else
+    ERROR(PLUGIN_NAME " plugin: BulkStats requires libvirt API version 1.2.8 "
+                      "or later.");
+    return -1;
+#endif
+  }
+
+  if (strcasecmp(key, "DomainEvents") == 0) {
+#ifdef HAVE_DOMAIN_EVENTS
+    domain_events = IS_TRUE(value);
+    return 0;
+#else
+    ERROR(PLUGIN_NAME " plugin: DomainEvents requires libvirt API version "
+                      "0.9.0 or later.");
+    return -1;
+#endif
+  }
+
   /* Unrecognised option. */
   return -1;
 }
 
+#ifdef HAVE_DOMAIN_EVENTS
+/* Domain lifecycle events are delivered by libvirt's default event loop,
+ * which is run by a dedicated thread. Every event bumps domain_event_count;
+ * read instances compare it against the count seen at their last refresh. */
+static pthread_t event_loop_thread;
+static _Bool event_loop_running = 0;
+static int event_loop_timer = -1;
+static int domain_event_callback = -1;
+
+static pthread_mutex_t domain_event_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long domain_event_count = 0;
+
+static void lv_domain_events_notify(void) {
+  pthread_mutex_lock(&domain_event_lock);
+  domain_event_count++;
+  pthread_mutex_unlock(&domain_event_lock);
+}
+
+static unsigned long lv_domain_events_get(void) {
+  unsigned long count;
+
+  pthread_mutex_lock(&domain_event_lock);
+  count = domain_event_count;
+  pthread_mutex_unlock(&domain_event_lock);
+
+  return count;
+}
+
+static int lv_domain_event_cb(__attribute__((unused)) virConnectPtr c,
+                              virDomainPtr dom, int event, int detail,
+                              __attribute__((unused)) void *opaque) {
+  DEBUG(PLUGIN_NAME " plugin: lifecycle event %i (detail %i) for domain %s",
+        event, detail, virDomainGetName(dom));
+  lv_domain_events_notify();
+  return 0;
+}
+
+/* The timer is only armed to wake up the event loop on shutdown. */
+static void lv_event_timeout_cb(__attribute__((unused)) int timer,
+                                __attribute__((unused)) void *opaque) {}
+
+static void *lv_event_loop(__attribute__((unused)) void *arg) {
+  while (event_loop_running) {
+    if (virEventRunDefaultImpl() < 0) {
+      VIRT_ERROR(NULL, PLUGIN_NAME " plugin: virEventRunDefaultImpl failed");
+      /* Don't spin on a persistent error. */
+      sleep(1);
+    }
+  }
+
+  return NULL;
+}
+
+/* Must be called before the connection is opened. */
+static int lv_start_event_loop(void) {
+  if (virEventRegisterDefaultImpl() != 0) {
+    VIRT_ERROR(NULL, PLUGIN_NAME " plugin: virEventRegisterDefaultImpl failed");
+    return -1;
+  }
+
+  event_loop_timer = virEventAddTimeout(-1, lv_event_timeout_cb, NULL, NULL);
+  if (event_loop_timer < 0) {
+    ERROR(PLUGIN_NAME " plugin: virEventAddTimeout failed.");
+    return -1;
+  }
+
+  event_loop_running = 1;
+  int status = plugin_thread_create(&event_loop_thread, NULL, lv_event_loop,
+                                    NULL, "virt events");
+  if (status != 0) {
+    ERROR(PLUGIN_NAME " plugin: pthread_create failed: %s", STRERROR(status));
+    event_loop_running = 0;
+    virEventRemoveTimeout(event_loop_timer);
+    event_loop_timer = -1;
+    return -1;
+  }
+
+  return 0;
+}
+
+static void lv_stop_event_loop(void) {
+  if (!event_loop_running)
+    return;
+
+  event_loop_running = 0;
+  /* Fire the timer immediately so virEventRunDefaultImpl() returns. */
+  virEventUpdateTimeout(event_loop_timer, 0);
+  pthread_join(event_loop_thread, NULL);
+
+  virEventRemoveTimeout(event_loop_timer);
+  event_loop_timer = -1;
+}
+
+static void lv_register_domain_events(void) {
+  if (!event_loop_running || (domain_event_callback >= 0))
+    return;
+
+  domain_event_callback = virConnectDomainEventRegisterAny(
+      conn, /* dom = */ NULL, VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+      VIR_DOMAIN_EVENT_CALLBACK(lv_domain_event_cb), NULL, NULL);
+  if (domain_event_callback < 0) {
+    VIRT_ERROR(conn, PLUGIN_NAME " plugin: registering domain events");
+    return;
+  }
+
+  /* Events may have been missed while we were not connected. */
+  lv_domain_events_notify();
+}
+
+static void lv_deregister_domain_events(void) {
+  if (domain_event_callback < 0)
+    return;
+
+  virConnectDomainEventDeregisterAny(conn, domain_event_callback);
+  domain_event_callback = -1;
+}
+#endif /* HAVE_DOMAIN_EVENTS */
+
 static int lv_connect(void) {
   if (conn == NULL) {
 /* `conn_string == NULL' is acceptable */
@@ -1095,6 +1255,9 @@ static int lv_connect(void) {
       ERROR(PLUGIN_NAME ": virNodeGetInfo failed");
       return -1;
     }
+#ifdef HAVE_DOMAIN_EVENTS
+    lv_register_domain_events();
+#endif
   }
   c_release(LOG_NOTICE, &conn_complain,
             PLUGIN_NAME " plugin: Connection established.");
@@ -1102,6 +1265,10 @@ static int lv_connect(void) {
 }
 
 static void lv_disconnect(void) {
+#ifdef HAVE_DOMAIN_EVENTS
+  if (conn != NULL)
+    lv_deregister_domain_events();
+#endif
   if (conn != NULL)
     virConnectClose(conn);
   conn = NULL;
@@ -1533,15 +1700,10 @@ static int get_domain_metrics(domain_t *domain) {
   return 0;
 }
 
-static int get_if_dev_stats(struct interface_device *if_dev) {
-  virDomainInterfaceStatsStruct stats = {0};
+static void interface_submit(struct interface_device *if_dev,
+                             virDomainInterfaceStatsPtr stats) {
   char *display_name = NULL;
 
-  if (!if_dev) {
-    ERROR(PLUGIN_NAME " plugin: get_if_dev_stats: NULL pointer");
-    return -1;
-  }
-
   switch (interface_format) {
   case if_address:
     display_name = if_dev->address;
@@ -1554,29 +1716,376 @@ static int get_if_dev_stats(struct interface_device *if_dev) {
     display_name = if_dev->path;
   }
 
+  if ((stats->rx_bytes != -1) && (stats->tx_bytes != -1))
+    submit_derive2("if_octets", (derive_t)stats->rx_bytes,
+                   (derive_t)stats->tx_bytes, if_dev->dom, display_name);
+
+  if ((stats->rx_packets != -1) && (stats->tx_packets != -1))
+    submit_derive2("if_packets", (derive_t)stats->rx_packets,
+                   (derive_t)stats->tx_packets, if_dev->dom, display_name);
+
+  if ((stats->rx_errs != -1) && (stats->tx_errs != -1))
+    submit_derive2("if_errors", (derive_t)stats->rx_errs,
+                   (derive_t)stats->tx_errs, if_dev->dom, display_name);
+
+  if ((stats->rx_drop != -1) && (stats->tx_drop != -1))
+    submit_derive2("if_dropped", (derive_t)stats->rx_drop,
+                   (derive_t)stats->tx_drop, if_dev->dom, display_name);
+}
+
+static int get_if_dev_stats(struct interface_device *if_dev) {
+  virDomainInterfaceStatsStruct stats = {0};
+
+  if (!if_dev) {
+    ERROR(PLUGIN_NAME " plugin: get_if_dev_stats: NULL pointer");
+    return -1;
+  }
+
   if (virDomainInterfaceStats(if_dev->dom, if_dev->path, &stats,
                               sizeof(stats)) != 0) {
     ERROR(PLUGIN_NAME " plugin: virDomainInterfaceStats failed");
     return -1;
   }
 
-  if ((stats.rx_bytes != -1) && (stats.tx_bytes != -1))
-    submit_derive2("if_octets", (derive_t)stats.rx_bytes,
-                   (derive_t)stats.tx_bytes, if_dev->dom, display_name);
+  interface_submit(if_dev, &stats);
+  return 0;
+}
+
+#ifdef HAVE_DOMAIN_STATS
+/* Bulk statistics: one virDomainListGetStats() call returns the typed
+ * parameters of all domains handled by a read instance, replacing the
+ * per-domain and per-device RPCs done by get_domain_metrics(),
+ * get_block_stats() and get_if_dev_stats(). */
+
+static domain_t *lv_find_domain(struct lv_read_state *state,
+                                virDomainPtr dom) {
+  unsigned char uuid[VIR_UUID_BUFLEN];
+  unsigned char other[VIR_UUID_BUFLEN];
+
+  if (virDomainGetUUID(dom, uuid) != 0)
+    return NULL;
+
+  for (int i = 0; i < state->nr_domains; ++i) {
+    if (virDomainGetUUID(state->domains[i].ptr, other) != 0)
+      continue;
+    if (memcmp(uuid, other, sizeof(uuid)) == 0)
+      return &state->domains[i];
+  }
+
+  return NULL;
+}
+
+static _Bool lv_block_device_selected(struct lv_read_state *state,
+                                      virDomainPtr dom, const char *path) {
+  for (int i = 0; i < state->nr_block_devices; ++i) {
+    if ((state->block_devices[i].dom == dom) &&
+        (strcmp(state->block_devices[i].path, path) == 0))
+      return 1;
+  }
+  return 0;
+}
+
+static struct interface_device *
+lv_find_interface_device(struct lv_read_state *state, virDomainPtr dom,
+                         const char *path) {
+  for (int i = 0; i < state->nr_interface_devices; ++i) {
+    if ((state->interface_devices[i].dom == dom) &&
+        (strcmp(state->interface_devices[i].path, path) == 0))
+      return &state->interface_devices[i];
+  }
+  return NULL;
+}
+
+/* Looks up "<prefix>.<idx>.<name>" and stores it in *ret if present. */
+static void lv_get_indexed_param(virTypedParameterPtr params, int nparams,
+                                 const char *prefix, unsigned int idx,
+                                 const char *name, long long *ret) {
+  char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+  unsigned long long value;
+
+  snprintf(field, sizeof(field), "%s.%u.%s", prefix, idx, name);
+  if (virTypedParamsGetULLong(params, nparams, field, &value) == 1)
+    *ret = (long long)value;
+}
+
+static void lv_bulk_memory_submit(virDomainPtr dom,
+                                  virTypedParameterPtr params, int nparams) {
+  /* Same order as the tags in memory_stats_submit(). */
+  static const char *fields[] = {
+      "balloon.swap_in",     "balloon.swap_out", "balloon.major_fault",
+      "balloon.minor_fault", "balloon.unused",   "balloon.available",
+      "balloon.current",     "balloon.rss",      "balloon.usable",
+      "balloon.last-update"};
+  unsigned long long value;
+
+  if (virTypedParamsGetULLong(params, nparams, "balloon.current", &value) == 1)
+    memory_submit(dom, (gauge_t)value * 1024);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); ++i) {
+    if (virTypedParamsGetULLong(params, nparams, fields[i], &value) == 1)
+      memory_stats_submit((gauge_t)value * 1024, dom, (int)i);
+  }
+}
+
+static void lv_bulk_vcpu_submit(virDomainPtr dom, virTypedParameterPtr params,
+                                int nparams) {
+  unsigned int nr_vcpus = 0;
+
+  /* Offline vCPUs have no entries, so walk up to the maximum. */
+  virTypedParamsGetUInt(params, nparams, "vcpu.maximum", &nr_vcpus);
+
+  for (unsigned int i = 0; i < nr_vcpus; ++i) {
+    long long value = -1;
+
+    lv_get_indexed_param(params, nparams, "vcpu", i, "time", &value);
+    if (value != -1)
+      vcpu_submit((derive_t)value, dom, (int)i, "virt_vcpu");
+  }
+}
+
+static void lv_bulk_block_submit(struct lv_read_state *state, virDomainPtr dom,
+                                 virTypedParameterPtr params, int nparams) {
+  unsigned int nr_blocks = 0;
+
+  virTypedParamsGetUInt(params, nparams, "block.count", &nr_blocks);
+
+  for (unsigned int i = 0; i < nr_blocks; ++i) {
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+    const char *path = NULL;
+
+    snprintf(field, sizeof(field), "block.%u.%s", i,
+             (blockdevice_format == source) ? "path" : "name");
+    if (virTypedParamsGetString(params, nparams, field, &path) != 1)
+      continue;
+    if (!lv_block_device_selected(state, dom, path))
+      continue;
+
+    struct lv_block_info binfo;
+    init_block_info(&binfo);
+
+    lv_get_indexed_param(params, nparams, "block", i, "rd.reqs",
+                         &binfo.bi.rd_req);
+    lv_get_indexed_param(params, nparams, "block", i, "wr.reqs",
+                         &binfo.bi.wr_req);
+    lv_get_indexed_param(params, nparams, "block", i, "rd.bytes",
+                         &binfo.bi.rd_bytes);
+    lv_get_indexed_param(params, nparams, "block", i, "wr.bytes",
+                         &binfo.bi.wr_bytes);
+    lv_get_indexed_param(params, nparams, "block", i, "rd.times",
+                         &binfo.rd_total_times);
+    lv_get_indexed_param(params, nparams, "block", i, "wr.times",
+                         &binfo.wr_total_times);
+    lv_get_indexed_param(params, nparams, "block", i, "fl.reqs",
+                         &binfo.fl_req);
+    lv_get_indexed_param(params, nparams, "block", i, "fl.times",
+                         &binfo.fl_total_times);
+
+    disk_submit(&binfo, dom, path);
+  }
+}
+
+static void lv_bulk_interface_submit(struct lv_read_state *state,
+                                     virDomainPtr dom,
+                                     virTypedParameterPtr params,
+                                     int nparams) {
+  unsigned int nr_nets = 0;
+
+  virTypedParamsGetUInt(params, nparams, "net.count", &nr_nets);
+
+  for (unsigned int i = 0; i < nr_nets; ++i) {
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+    const char *path = NULL;
+
+    snprintf(field, sizeof(field), "net.%u.name", i);
+    if (virTypedParamsGetString(params, nparams, field, &path) != 1)
+      continue;
+
+    struct interface_device *if_dev =
+        lv_find_interface_device(state, dom, path);
+    if (if_dev == NULL)
+      continue;
+
+    virDomainInterfaceStatsStruct stats = {
+        .rx_bytes = -1,
+        .rx_packets = -1,
+        .rx_errs = -1,
+        .rx_drop = -1,
+        .tx_bytes = -1,
+        .tx_packets = -1,
+        .tx_errs = -1,
+        .tx_drop = -1,
+    };
+
+    lv_get_indexed_param(params, nparams, "net", i, "rx.bytes",
+                         &stats.rx_bytes);
+    lv_get_indexed_param(params, nparams, "net", i, "rx.pkts",
+                         &stats.rx_packets);
+    lv_get_indexed_param(params, nparams, "net", i, "rx.errs",
+                         &stats.rx_errs);
+    lv_get_indexed_param(params, nparams, "net", i, "rx.drop",
+                         &stats.rx_drop);
+    lv_get_indexed_param(params, nparams, "net", i, "tx.bytes",
+                         &stats.tx_bytes);
+    lv_get_indexed_param(params, nparams, "net", i, "tx.pkts",
+                         &stats.tx_packets);
+    lv_get_indexed_param(params, nparams, "net", i, "tx.errs",
+                         &stats.tx_errs);
+    lv_get_indexed_param(params, nparams, "net", i, "tx.drop",
+                         &stats.tx_drop);
+
+    interface_submit(if_dev, &stats);
+  }
+}
+
+#ifdef HAVE_PERF_STATS
+static void lv_bulk_perf_submit(virDomainPtr dom, virTypedParameterPtr params,
+                                int nparams) {
+  for (int i = 0; i < nparams; ++i) {
+    if (strncmp(params[i].field, "perf.", strlen("perf.")) != 0)
+      continue;
+
+    /* Same type instance as perf_submit(): "perf.cmt" -> "perf_cmt" */
+    char type_instance[VIR_TYPED_PARAM_FIELD_LENGTH];
+    sstrncpy(type_instance, params[i].field, sizeof(type_instance));
+    type_instance[strlen("perf")] = '_';
+
+    submit(dom, "perf", type_instance,
+           &(value_t){.derive = params[i].value.ul}, 1);
+  }
+}
+#endif /* HAVE_PERF_STATS */
+
+static int lv_bulk_domain_submit(struct lv_read_state *state,
+                                 virDomainStatsRecordPtr record) {
+  virTypedParameterPtr params = record->params;
+  int nparams = record->nparams;
+  int status;
+
+  /* The domain list may have changed after the last refresh. */
+  domain_t *domain = lv_find_domain(state, record->dom);
+  if (domain == NULL)
+    return 0;
+
+  virDomainPtr dom = domain->ptr;
+
+  int dom_state = VIR_DOMAIN_NOSTATE;
+  int dom_reason = 0;
+  virTypedParamsGetInt(params, nparams, "state.state", &dom_state);
+  virTypedParamsGetInt(params, nparams, "state.reason", &dom_reason);
+
+  if (extra_stats & ex_stats_domain_state)
+    domain_state_submit(dom, dom_state, dom_reason);
+
+  /* Gather remaining stats only for running domains */
+  if (dom_state != VIR_DOMAIN_RUNNING)
+    return 0;
+
+  unsigned long long cpu_time = 0;
+  virTypedParamsGetULLong(params, nparams, "cpu.time", &cpu_time);
+
+  if (extra_stats & ex_stats_pcpu) {
+    unsigned long long user_time = 0;
+    unsigned long long syst_time = 0;
+
+    virTypedParamsGetULLong(params, nparams, "cpu.user", &user_time);
+    virTypedParamsGetULLong(params, nparams, "cpu.system", &syst_time);
+    submit_derive2("ps_cputime", (derive_t)user_time, (derive_t)syst_time, dom,
+                   NULL);
+  }
+
+  cpu_submit(domain, cpu_time);
+  /* Update the cached cpuTime. It has to be done after cpu_submit */
+  domain->info.cpuTime = cpu_time;
+
+  lv_bulk_memory_submit(dom, params, nparams);
+
+  /* Pinning isn't part of the bulk stats: fall back to virDomainGetVcpus. */
+  if (extra_stats & ex_stats_vcpupin) {
+    unsigned int nr_vcpus = 0;
+    virTypedParamsGetUInt(params, nparams, "vcpu.current", &nr_vcpus);
+    GET_STATS(get_vcpu_stats, "vcpu stats", dom, (unsigned short)nr_vcpus);
+  } else {
+    lv_bulk_vcpu_submit(dom, params, nparams);
+  }
+
+  lv_bulk_block_submit(state, dom, params, nparams);
+  lv_bulk_interface_submit(state, dom, params, nparams);
+
+#ifdef HAVE_PERF_STATS
+  if (extra_stats & ex_stats_perf)
+    lv_bulk_perf_submit(dom, params, nparams);
+#endif
+
+#ifdef HAVE_FS_INFO
+  if (extra_stats & ex_stats_fs_info)
+    GET_STATS(get_fs_info, "file system info", dom);
+#endif
+
+#ifdef HAVE_DISK_ERR
+  if (extra_stats & ex_stats_disk_err)
+    GET_STATS(get_disk_err, "disk errors", dom);
+#endif
+
+#ifdef HAVE_JOB_STATS
+  if (extra_stats &
+      (ex_stats_job_stats_completed | ex_stats_job_stats_background))
+    GET_STATS(get_job_stats, "job stats", dom);
+#endif
+
+  return 0;
+}
+
+static int lv_read_bulk_stats(struct lv_read_state *state) {
+  if (state->nr_domains == 0)
+    return 0;
+
+  /* virDomainListGetStats requires a NULL terminated list of domains */
+  virDomainPtr *domains = calloc(state->nr_domains + 1, sizeof(*domains));
+  if (domains == NULL) {
+    ERROR(PLUGIN_NAME " plugin: calloc failed.");
+    return -1;
+  }
+  for (int i = 0; i < state->nr_domains; ++i)
+    domains[i] = state->domains[i].ptr;
+
+  unsigned int stats = VIR_DOMAIN_STATS_STATE | VIR_DOMAIN_STATS_CPU_TOTAL |
+                       VIR_DOMAIN_STATS_BALLOON | VIR_DOMAIN_STATS_VCPU |
+                       VIR_DOMAIN_STATS_INTERFACE | VIR_DOMAIN_STATS_BLOCK;
+#ifdef HAVE_PERF_STATS
+  if (extra_stats & ex_stats_perf)
+    stats |= VIR_DOMAIN_STATS_PERF;
+#endif
 
-  if ((stats.rx_packets != -1) && (stats.tx_packets != -1))
-    submit_derive2("if_packets", (derive_t)stats.rx_packets,
-                   (derive_t)stats.tx_packets, if_dev->dom, display_name);
+  virDomainStatsRecordPtr *records = NULL;
+  int nr_records = virDomainListGetStats(domains, stats, &records, 0);
+  sfree(domains);
+  if (nr_records < 0) {
+    VIRT_ERROR(conn, PLUGIN_NAME " plugin: virDomainListGetStats failed");
+    return -1;
+  }
 
-  if ((stats.rx_errs != -1) && (stats.tx_errs != -1))
-    submit_derive2("if_errors", (derive_t)stats.rx_errs,
-                   (derive_t)stats.tx_errs, if_dev->dom, display_name);
+  for (int i = 0; i < nr_records; ++i) {
+    if (lv_bulk_domain_submit(state, records[i]) != 0)
+      ERROR(PLUGIN_NAME " failed to get metrics for domain=%s",
+            virDomainGetName(records[i]->dom));
+  }
 
-  if ((stats.rx_drop != -1) && (stats.tx_drop != -1))
-    submit_derive2("if_dropped", (derive_t)stats.rx_drop,
-                   (derive_t)stats.tx_drop, if_dev->dom, display_name);
+  virDomainStatsRecordListFree(records);
   return 0;
 }
+#endif /* HAVE_DOMAIN_STATS */
+
+static _Bool lv_need_refresh(struct lv_read_instance *inst, time_t t) {
+  if (last_refresh == (time_t)0)
+    return 1;
+
+#ifdef HAVE_DOMAIN_EVENTS
+  if (domain_events)
+    return inst->domain_events_seen != lv_domain_events_get();
+#endif
+
+  return (interval > 0) && ((last_refresh + interval) <= t);
+}
 
 static int lv_read(user_data_t *ud) {
   time_t t;
@@ -1599,14 +2108,21 @@ static int lv_read(user_data_t *ud) {
   time(&t);
 
   /* Need to refresh domain or device lists? */
-  if ((last_refresh == (time_t)0) ||
-      ((interval > 0) && ((last_refresh + interval) <= t))) {
+  if (lv_need_refresh(inst, t)) {
+#ifdef HAVE_DOMAIN_EVENTS
+    /* Taken before refreshing, so that events arriving meanwhile trigger
+     * another refresh. */
+    unsigned long events = lv_domain_events_get();
+#endif
     if (refresh_lists(inst) != 0) {
       if (inst->id == 0)
         lv_disconnect();
       return -1;
     }
     last_refresh = t;
+#ifdef HAVE_DOMAIN_EVENTS
+    inst->domain_events_seen = events;
+#endif
   }
 
 #if 0
@@ -1622,6 +2138,11 @@ static int lv_read(user_data_t *ud) {
                  interface_devices[i].path);
 #endif
 
+#ifdef HAVE_DOMAIN_STATS
+  if (bulk_stats)
+    return lv_read_bulk_stats(state);
+#endif
+
   /* Get domains' metrics */
   for (int i = 0; i < state->nr_domains; ++i) {
     int status = get_domain_metrics(&state->domains[i]);
@@ -1688,6 +2209,12 @@ static int lv_init(void) {
   if (virInitialize() != 0)
     return -1;
 
+#ifdef HAVE_DOMAIN_EVENTS
+  /* The event loop has to be registered before the connection is opened. */
+  if (domain_events && !event_loop_running && (lv_start_event_loop() != 0))
+    return -1;
+#endif
+
   if (lv_connect() != 0)
     return -1;
 
@@ -2167,6 +2694,9 @@ static int lv_shutdown(void) {
   }
 
   lv_disconnect();
+#ifdef HAVE_DOMAIN_EVENTS
+  lv_stop_event_loop();
+#endif
 
   ignorelist_free(il_domains);
   il_domains = NULL;
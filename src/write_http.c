@@ -32,10 +32,27 @@
 
 #include <curl/curl.h>
 
+#if HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #ifndef WRITE_HTTP_DEFAULT_BUFFER_SIZE
 #define WRITE_HTTP_DEFAULT_BUFFER_SIZE 4096
 #endif
 
+#ifndef WRITE_HTTP_DEFAULT_QUEUE_LENGTH
+#define WRITE_HTTP_DEFAULT_QUEUE_LENGTH 16
+#endif
+
+#ifndef WRITE_HTTP_DEFAULT_MAX_RETRIES
+#define WRITE_HTTP_DEFAULT_MAX_RETRIES 3
+#endif
+
+/* Upper bound of the delay between two attempts to post a buffer. */
+#ifndef WRITE_HTTP_MAX_BACKOFF
+#define WRITE_HTTP_MAX_BACKOFF TIME_T_TO_CDTIME_T(60)
+#endif
+
 #ifndef WRITE_HTTP_DEFAULT_PREFIX
 #define WRITE_HTTP_DEFAULT_PREFIX "collectd"
 #endif
@@ -43,6 +60,30 @@
 /*
  * Private variables
  */
+
+/* A completed buffer waiting to be posted by the sender thread. */
+struct wh_request_s {
+  char *data;
+  size_t size;
+  _Bool compressed;
+
+  int attempts;
+  cdtime_t retry_time;
+
+  struct wh_request_s *next;
+};
+typedef struct wh_request_s wh_request_t;
+
+/* A keep-alive connection used by the sender thread. */
+struct wh_connection_s {
+  CURL *curl;
+  char errbuf[CURL_ERROR_SIZE];
+
+  /* The request being posted or NULL if the connection is idle. */
+  wh_request_t *request;
+};
+typedef struct wh_connection_s wh_connection_t;
+
 struct wh_callback_s {
   char *name;
 
@@ -71,10 +112,22 @@ struct wh_callback_s {
   _Bool send_metrics;
   _Bool send_notifications;
 
-  CURL *curl;
+#define WH_COMPRESS_NONE 0
+#define WH_COMPRESS_GZIP 1
+#define WH_COMPRESS_DEFLATE 2
+  int compression;
+  int connections_num;
+  int queue_length;
+  int max_retries;
+
+  CURLM *multi;
+  wh_connection_t *connections;
   struct curl_slist *headers;
-  char curl_errbuf[CURL_ERROR_SIZE];
 
+  /* Value lists are formatted into send_buffer by the write threads. Full
+   * buffers are handed to the sender thread via the send queue, which posts
+   * them using all connections concurrently. Lock order: send_lock before
+   * queue_lock. */
   char *send_buffer;
   size_t send_buffer_size;
   size_t send_buffer_free;
@@ -83,6 +136,16 @@ struct wh_callback_s {
 
   pthread_mutex_t send_lock;
 
+  wh_request_t *queue_head;
+  wh_request_t *queue_tail;
+  size_t queue_num;
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+
+  pthread_t sender;
+  _Bool sender_running;
+  _Bool sender_stop;
+
   int data_ttl;
   char *metrics_prefix;
 };
@@ -91,14 +154,10 @@ typedef struct wh_callback_s wh_callback_t;
 static char **http_attrs;
 static size_t http_attrs_num;
 
-static void wh_log_http_error(wh_callback_t *cb) {
+static void wh_log_http_error(wh_callback_t *cb, long http_code) {
   if (!cb->log_http_error)
     return;
 
-  long http_code = 0;
-
-  curl_easy_getinfo(cb->curl, CURLINFO_RESPONSE_CODE, &http_code);
-
   if (http_code != 200)
     INFO("write_http plugin: HTTP Error code: %lu", http_code);
 }
@@ -119,106 +178,482 @@ static void wh_reset_buffer(wh_callback_t *cb) /* {{{ */
   }
 } /* }}} wh_reset_buffer */
 
-/* must hold cb->send_lock when calling */
-static int wh_post_nolock(wh_callback_t *cb, char const *data) /* {{{ */
+static void wh_request_free(wh_request_t *req) /* {{{ */
 {
-  int status = 0;
+  if (req == NULL)
+    return;
+
+  sfree(req->data);
+  sfree(req);
+} /* }}} void wh_request_free */
 
-  curl_easy_setopt(cb->curl, CURLOPT_URL, cb->location);
-  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDS, data);
-  status = curl_easy_perform(cb->curl);
+/* Appends `data' to the send queue, taking ownership of it. If the queue is
+ * full, the oldest buffer is dropped so that write threads never wait for the
+ * server. */
+static int wh_enqueue(wh_callback_t *cb, char *data, size_t size) /* {{{ */
+{
+  wh_request_t *req;
+  wh_request_t *dropped = NULL;
+
+  req = calloc(1, sizeof(*req));
+  if (req == NULL) {
+    ERROR("write_http plugin: calloc failed.");
+    sfree(data);
+    return ENOMEM;
+  }
+  req->data = data;
+  req->size = size;
+
+  pthread_mutex_lock(&cb->queue_lock);
+  if ((cb->queue_num >= (size_t)cb->queue_length) &&
+      (cb->queue_head != NULL)) {
+    dropped = cb->queue_head;
+    cb->queue_head = dropped->next;
+    if (cb->queue_head == NULL)
+      cb->queue_tail = NULL;
+    cb->queue_num--;
+  }
+
+  if (cb->queue_tail == NULL)
+    cb->queue_head = req;
+  else
+    cb->queue_tail->next = req;
+  cb->queue_tail = req;
+  cb->queue_num++;
+
+  pthread_cond_signal(&cb->queue_cond);
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  if (dropped != NULL) {
+    WARNING("write_http plugin: Send queue of \"%s\" is full. Dropping %" PRIsz
+            " bytes.",
+            cb->name, dropped->size);
+    wh_request_free(dropped);
+  }
+
+  return 0;
+} /* }}} int wh_enqueue */
+
+/* Hands the send buffer to the sender thread and starts a new one. Must hold
+ * cb->send_lock. */
+static int wh_enqueue_buffer_nolock(wh_callback_t *cb) /* {{{ */
+{
+  char *buffer;
+  int status;
+
+  buffer = malloc(cb->send_buffer_size);
+  if (buffer == NULL) {
+    ERROR("write_http plugin: malloc(%" PRIsz ") failed.",
+          cb->send_buffer_size);
+    wh_reset_buffer(cb);
+    return ENOMEM;
+  }
+
+  status = wh_enqueue(cb, cb->send_buffer, cb->send_buffer_fill);
+  cb->send_buffer = buffer;
+  wh_reset_buffer(cb);
+
+  return status;
+} /* }}} int wh_enqueue_buffer_nolock */
+
+/* Returns the first queued request that may be posted now. Must hold
+ * cb->queue_lock. */
+static wh_request_t *wh_queue_pop_nolock(wh_callback_t *cb) /* {{{ */
+{
+  cdtime_t now = cdtime();
+  wh_request_t *prev = NULL;
+
+  for (wh_request_t *req = cb->queue_head; req != NULL; req = req->next) {
+    /* When shutting down, pending retries are attempted immediately. */
+    if (!cb->sender_stop && (req->retry_time > now)) {
+      prev = req;
+      continue;
+    }
 
-  wh_log_http_error(cb);
+    if (prev == NULL)
+      cb->queue_head = req->next;
+    else
+      prev->next = req->next;
+    if (cb->queue_tail == req)
+      cb->queue_tail = prev;
+    cb->queue_num--;
 
-  if (status != CURLE_OK) {
+    req->next = NULL;
+    return req;
+  }
+
+  return NULL;
+} /* }}} wh_request_t *wh_queue_pop_nolock */
+
+/* Blocks until a request is queued, the earliest retry is due or the sender
+ * is stopped. Must hold cb->queue_lock. */
+static void wh_queue_wait_nolock(wh_callback_t *cb) /* {{{ */
+{
+  cdtime_t next = 0;
+  cdtime_t now = cdtime();
+
+  if (cb->sender_stop)
+    return;
+
+  for (wh_request_t *req = cb->queue_head; req != NULL; req = req->next) {
+    if (req->retry_time <= now)
+      return;
+    if ((next == 0) || (req->retry_time < next))
+      next = req->retry_time;
+  }
+
+  if (next == 0) {
+    pthread_cond_wait(&cb->queue_cond, &cb->queue_lock);
+  } else {
+    struct timespec ts = CDTIME_T_TO_TIMESPEC(next);
+    pthread_cond_timedwait(&cb->queue_cond, &cb->queue_lock, &ts);
+  }
+} /* }}} void wh_queue_wait_nolock */
+
+#if HAVE_LIBZ
+/* Replaces the request body with its gzip or zlib ("deflate") encoding. */
+static int wh_compress(wh_callback_t *cb, wh_request_t *req) /* {{{ */
+{
+  z_stream stream = {0};
+  int window_bits = MAX_WBITS;
+  char *out;
+  size_t out_size;
+  int status;
+
+  /* Adding 16 to the window bits selects the gzip wrapper. */
+  if (cb->compression == WH_COMPRESS_GZIP)
+    window_bits += 16;
+
+  status = deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, window_bits,
+                        /* memLevel = */ 8, Z_DEFAULT_STRATEGY);
+  if (status != Z_OK) {
+    ERROR("write_http plugin: deflateInit2 failed with status %i.", status);
+    return -1;
+  }
+
+  out_size = (size_t)deflateBound(&stream, (uLong)req->size);
+  out = malloc(out_size);
+  if (out == NULL) {
+    ERROR("write_http plugin: malloc(%" PRIsz ") failed.", out_size);
+    deflateEnd(&stream);
+    return ENOMEM;
+  }
+
+  stream.next_in = (Bytef *)req->data;
+  stream.avail_in = (uInt)req->size;
+  stream.next_out = (Bytef *)out;
+  stream.avail_out = (uInt)out_size;
+
+  status = deflate(&stream, Z_FINISH);
+  deflateEnd(&stream);
+  if (status != Z_STREAM_END) {
+    ERROR("write_http plugin: deflate failed with status %i.", status);
+    sfree(out);
+    return -1;
+  }
+
+  sfree(req->data);
+  req->data = out;
+  req->size = out_size - stream.avail_out;
+  req->compressed = 1;
+
+  return 0;
+} /* }}} int wh_compress */
+#endif
+
+/* Hands queued requests to idle connections. Returns the number of requests
+ * started. Only called by the sender thread. */
+static int wh_start_requests(wh_callback_t *cb) /* {{{ */
+{
+  int started = 0;
+
+  for (int i = 0; i < cb->connections_num; i++) {
+    wh_connection_t *conn = cb->connections + i;
+    wh_request_t *req;
+
+    if (conn->request != NULL)
+      continue;
+
+    pthread_mutex_lock(&cb->queue_lock);
+    req = wh_queue_pop_nolock(cb);
+    pthread_mutex_unlock(&cb->queue_lock);
+    if (req == NULL)
+      break;
+
+#if HAVE_LIBZ
+    if ((cb->compression != WH_COMPRESS_NONE) && !req->compressed &&
+        (wh_compress(cb, req) != 0)) {
+      wh_request_free(req);
+      continue;
+    }
+#endif
+
+    conn->request = req;
+    conn->errbuf[0] = 0;
+    curl_easy_setopt(conn->curl, CURLOPT_URL, cb->location);
+    curl_easy_setopt(conn->curl, CURLOPT_POSTFIELDSIZE, (long)req->size);
+    curl_easy_setopt(conn->curl, CURLOPT_POSTFIELDS, req->data);
+    curl_multi_add_handle(cb->multi, conn->curl);
+    started++;
+  }
+
+  return started;
+} /* }}} int wh_start_requests */
+
+/* Frees a finished request or, if the server or the network failed, queues it
+ * again with exponential backoff until max_retries is reached. */
+static void wh_request_done(wh_callback_t *cb, /* {{{ */
+                            wh_connection_t *conn, CURLcode result,
+                            long http_code) {
+  wh_request_t *req = conn->request;
+  _Bool retry = 0;
+
+  conn->request = NULL;
+
+  if (result != CURLE_OK) {
     ERROR("write_http plugin: curl_easy_perform failed with "
           "status %i: %s",
-          status, cb->curl_errbuf);
+          result,
+          (conn->errbuf[0] != 0) ? conn->errbuf : curl_easy_strerror(result));
+    retry = 1;
+  } else {
+    wh_log_http_error(cb, http_code);
+    retry = (http_code >= 500);
   }
-  return status;
-} /* }}} wh_post_nolock */
 
-static int wh_callback_init(wh_callback_t *cb) /* {{{ */
+  if (!retry) {
+    wh_request_free(req);
+    return;
+  }
+
+  pthread_mutex_lock(&cb->queue_lock);
+  if (!cb->sender_stop && (req->attempts < cb->max_retries)) {
+    cdtime_t backoff = TIME_T_TO_CDTIME_T(1) << req->attempts;
+    if (backoff > WRITE_HTTP_MAX_BACKOFF)
+      backoff = WRITE_HTTP_MAX_BACKOFF;
+
+    req->attempts++;
+    req->retry_time = cdtime() + backoff;
+
+    /* Retries are not subject to the queue length. */
+    req->next = cb->queue_head;
+    cb->queue_head = req;
+    if (cb->queue_tail == NULL)
+      cb->queue_tail = req;
+    cb->queue_num++;
+    req = NULL;
+  }
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  if (req != NULL) {
+    WARNING("write_http plugin: Giving up posting %" PRIsz " bytes to \"%s\" "
+            "after %i attempts.",
+            req->size, cb->location, req->attempts + 1);
+    wh_request_free(req);
+  }
+} /* }}} void wh_request_done */
+
+/* Collects the results of finished transfers. Returns the number of requests
+ * finished. Only called by the sender thread. */
+static int wh_finish_requests(wh_callback_t *cb) /* {{{ */
 {
-  if (cb->curl != NULL)
-    return 0;
+  CURLMsg *msg;
+  int msgs_left;
+  int finished = 0;
+
+  while ((msg = curl_multi_info_read(cb->multi, &msgs_left)) != NULL) {
+    wh_connection_t *conn = NULL;
+    long http_code = 0;
+
+    if (msg->msg != CURLMSG_DONE)
+      continue;
+
+    for (int i = 0; i < cb->connections_num; i++) {
+      if (cb->connections[i].curl == msg->easy_handle) {
+        conn = cb->connections + i;
+        break;
+      }
+    }
+    if ((conn == NULL) || (conn->request == NULL))
+      continue;
+
+    curl_easy_getinfo(conn->curl, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_multi_remove_handle(cb->multi, conn->curl);
+
+    wh_request_done(cb, conn, msg->data.result, http_code);
+    finished++;
+  }
+
+  return finished;
+} /* }}} int wh_finish_requests */
+
+static void *wh_sender_thread(void *arg) /* {{{ */
+{
+  wh_callback_t *cb = arg;
+  int active = 0;
+
+  while (42) {
+    int running = 0;
+
+    active += wh_start_requests(cb);
+
+    if (active == 0) {
+      _Bool done;
+
+      pthread_mutex_lock(&cb->queue_lock);
+      done = cb->sender_stop && (cb->queue_head == NULL);
+      if (!done)
+        wh_queue_wait_nolock(cb);
+      pthread_mutex_unlock(&cb->queue_lock);
+
+      if (done)
+        break;
+      continue;
+    }
+
+    curl_multi_perform(cb->multi, &running);
+    active -= wh_finish_requests(cb);
+
+    /* Wake up regularly to pick up newly queued buffers. */
+    if (running > 0)
+      curl_multi_wait(cb->multi, NULL, 0, /* timeout_ms = */ 100, NULL);
+  }
+
+  return NULL;
+} /* }}} void *wh_sender_thread */
 
-  cb->curl = curl_easy_init();
-  if (cb->curl == NULL) {
+static CURL *wh_curl_create(wh_callback_t *cb, char *errbuf) /* {{{ */
+{
+  CURL *curl;
+
+  curl = curl_easy_init();
+  if (curl == NULL) {
     ERROR("curl plugin: curl_easy_init failed.");
-    return -1;
+    return NULL;
   }
 
   if (cb->low_speed_limit > 0 && cb->low_speed_time > 0) {
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_LIMIT,
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT,
                      (long)(cb->low_speed_limit * cb->low_speed_time));
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_TIME,
-                     (long)cb->low_speed_time);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)cb->low_speed_time);
   }
 
 #ifdef HAVE_CURLOPT_TIMEOUT_MS
   if (cb->timeout > 0)
-    curl_easy_setopt(cb->curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
 #endif
 
-  curl_easy_setopt(cb->curl, CURLOPT_NOSIGNAL, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, cb->headers);
 
-  cb->headers = curl_slist_append(cb->headers, "Accept:  */*");
-  if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB)
-    cb->headers =
-        curl_slist_append(cb->headers, "Content-Type: application/json");
-  else
-    cb->headers = curl_slist_append(cb->headers, "Content-Type: text/plain");
-  cb->headers = curl_slist_append(cb->headers, "Expect:");
-  curl_easy_setopt(cb->curl, CURLOPT_HTTPHEADER, cb->headers);
-
-  curl_easy_setopt(cb->curl, CURLOPT_ERRORBUFFER, cb->curl_errbuf);
-  curl_easy_setopt(cb->curl, CURLOPT_FOLLOWLOCATION, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_MAXREDIRS, 50L);
+  curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, errbuf);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 50L);
 
   if (cb->user != NULL) {
 #ifdef HAVE_CURLOPT_USERNAME
-    curl_easy_setopt(cb->curl, CURLOPT_USERNAME, cb->user);
-    curl_easy_setopt(cb->curl, CURLOPT_PASSWORD,
+    curl_easy_setopt(curl, CURLOPT_USERNAME, cb->user);
+    curl_easy_setopt(curl, CURLOPT_PASSWORD,
                      (cb->pass == NULL) ? "" : cb->pass);
 #else
-    size_t credentials_size;
+    if (cb->credentials == NULL) {
+      size_t credentials_size;
 
-    credentials_size = strlen(cb->user) + 2;
-    if (cb->pass != NULL)
-      credentials_size += strlen(cb->pass);
+      credentials_size = strlen(cb->user) + 2;
+      if (cb->pass != NULL)
+        credentials_size += strlen(cb->pass);
 
-    cb->credentials = malloc(credentials_size);
-    if (cb->credentials == NULL) {
-      ERROR("curl plugin: malloc failed.");
-      return -1;
-    }
+      cb->credentials = malloc(credentials_size);
+      if (cb->credentials == NULL) {
+        ERROR("curl plugin: malloc failed.");
+        curl_easy_cleanup(curl);
+        return NULL;
+      }
 
-    snprintf(cb->credentials, credentials_size, "%s:%s", cb->user,
-             (cb->pass == NULL) ? "" : cb->pass);
-    curl_easy_setopt(cb->curl, CURLOPT_USERPWD, cb->credentials);
+      snprintf(cb->credentials, credentials_size, "%s:%s", cb->user,
+               (cb->pass == NULL) ? "" : cb->pass);
+    }
+    curl_easy_setopt(curl, CURLOPT_USERPWD, cb->credentials);
 #endif
-    curl_easy_setopt(cb->curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+    curl_easy_setopt(curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
   }
 
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
-  curl_easy_setopt(cb->curl, CURLOPT_SSLVERSION, cb->sslversion);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
+  curl_easy_setopt(curl, CURLOPT_SSLVERSION, cb->sslversion);
   if (cb->cacert != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAINFO, cb->cacert);
+    curl_easy_setopt(curl, CURLOPT_CAINFO, cb->cacert);
   if (cb->capath != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAPATH, cb->capath);
+    curl_easy_setopt(curl, CURLOPT_CAPATH, cb->capath);
 
   if (cb->clientkey != NULL && cb->clientcert != NULL) {
-    curl_easy_setopt(cb->curl, CURLOPT_SSLKEY, cb->clientkey);
-    curl_easy_setopt(cb->curl, CURLOPT_SSLCERT, cb->clientcert);
+    curl_easy_setopt(curl, CURLOPT_SSLKEY, cb->clientkey);
+    curl_easy_setopt(curl, CURLOPT_SSLCERT, cb->clientcert);
 
     if (cb->clientkeypass != NULL)
-      curl_easy_setopt(cb->curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
+      curl_easy_setopt(curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
   }
 
-  wh_reset_buffer(cb);
+  return curl;
+} /* }}} CURL *wh_curl_create */
+
+/* Sets up the connections and starts the sender thread. Must hold
+ * cb->send_lock. */
+static int wh_callback_init(wh_callback_t *cb) /* {{{ */
+{
+  int status;
+
+  if (cb->sender_running)
+    return 0;
+
+  if (cb->multi == NULL) {
+    cb->headers = curl_slist_append(cb->headers, "Accept:  */*");
+    if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB)
+      cb->headers =
+          curl_slist_append(cb->headers, "Content-Type: application/json");
+    else
+      cb->headers = curl_slist_append(cb->headers, "Content-Type: text/plain");
+    if (cb->compression == WH_COMPRESS_GZIP)
+      cb->headers = curl_slist_append(cb->headers, "Content-Encoding: gzip");
+    else if (cb->compression == WH_COMPRESS_DEFLATE)
+      cb->headers = curl_slist_append(cb->headers, "Content-Encoding: deflate");
+    cb->headers = curl_slist_append(cb->headers, "Expect:");
+
+    cb->multi = curl_multi_init();
+    if (cb->multi == NULL) {
+      ERROR("write_http plugin: curl_multi_init failed.");
+      return -1;
+    }
+  }
+
+  if (cb->connections == NULL) {
+    cb->connections = calloc(cb->connections_num, sizeof(*cb->connections));
+    if (cb->connections == NULL) {
+      ERROR("write_http plugin: calloc failed.");
+      return -1;
+    }
+  }
+
+  for (int i = 0; i < cb->connections_num; i++) {
+    wh_connection_t *conn = cb->connections + i;
+
+    if (conn->curl != NULL)
+      continue;
+
+    conn->curl = wh_curl_create(cb, conn->errbuf);
+    if (conn->curl == NULL)
+      return -1;
+  }
+
+  status = plugin_thread_create(&cb->sender, /* attr = */ NULL,
+                                wh_sender_thread, cb, "write_http send");
+  if (status != 0) {
+    ERROR("write_http plugin: Starting the sender thread failed: %s",
+          STRERROR(status));
+    return -1;
+  }
+  cb->sender_running = 1;
 
   return 0;
 } /* }}} int wh_callback_init */
@@ -246,8 +681,7 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
       return 0;
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer);
-    wh_reset_buffer(cb);
+    status = wh_enqueue_buffer_nolock(cb);
   } else if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB) {
     if (cb->send_buffer_fill <= 2) {
       cb->send_buffer_init_time = cdtime();
@@ -263,8 +697,7 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
       return status;
     }
 
-    status = wh_post_nolock(cb, cb->send_buffer);
-    wh_reset_buffer(cb);
+    status = wh_enqueue_buffer_nolock(cb);
   } else {
     ERROR("write_http: wh_flush_nolock: "
           "Unknown format: %i",
@@ -312,9 +745,37 @@ static void wh_callback_free(void *data) /* {{{ */
   if (cb->send_buffer != NULL)
     wh_flush_nolock(/* timeout = */ 0, cb);
 
-  if (cb->curl != NULL) {
-    curl_easy_cleanup(cb->curl);
-    cb->curl = NULL;
+  /* The sender thread posts everything still queued before exiting. */
+  if (cb->sender_running) {
+    pthread_mutex_lock(&cb->queue_lock);
+    cb->sender_stop = 1;
+    pthread_cond_broadcast(&cb->queue_cond);
+    pthread_mutex_unlock(&cb->queue_lock);
+
+    pthread_join(cb->sender, /* retval = */ NULL);
+    cb->sender_running = 0;
+  }
+
+  while (cb->queue_head != NULL) {
+    wh_request_t *next = cb->queue_head->next;
+    wh_request_free(cb->queue_head);
+    cb->queue_head = next;
+  }
+  cb->queue_tail = NULL;
+  cb->queue_num = 0;
+
+  if (cb->connections != NULL) {
+    for (int i = 0; i < cb->connections_num; i++) {
+      if (cb->connections[i].curl != NULL)
+        curl_easy_cleanup(cb->connections[i].curl);
+      wh_request_free(cb->connections[i].request);
+    }
+    sfree(cb->connections);
+  }
+
+  if (cb->multi != NULL) {
+    curl_multi_cleanup(cb->multi);
+    cb->multi = NULL;
   }
 
   if (cb->headers != NULL) {
@@ -335,6 +796,10 @@ static void wh_callback_free(void *data) /* {{{ */
   sfree(cb->send_buffer);
   sfree(cb->metrics_prefix);
 
+  pthread_mutex_destroy(&cb->send_lock);
+  pthread_mutex_destroy(&cb->queue_lock);
+  pthread_cond_destroy(&cb->queue_cond);
+
   sfree(cb);
 } /* }}} void wh_callback_free */
 
@@ -470,13 +935,11 @@ static int wh_write_kairosdb(const data_set_t *ds,
 
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->curl == NULL) {
-    status = wh_callback_init(cb);
-    if (status != 0) {
-      ERROR("write_http plugin: wh_callback_init failed.");
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
+  status = wh_callback_init(cb);
+  if (status != 0) {
+    ERROR("write_http plugin: wh_callback_init failed.");
+    pthread_mutex_unlock(&cb->send_lock);
+    return -1;
   }
 
   status = format_kairosdb_value_list(
@@ -562,10 +1025,16 @@ static int wh_notify(notification_t const *n, user_data_t *ud) /* {{{ */
     return -1;
   }
 
-  status = wh_post_nolock(cb, alert);
   pthread_mutex_unlock(&cb->send_lock);
 
-  return status;
+  /* Notifications are posted by the sender thread, too. */
+  char *data = strdup(alert);
+  if (data == NULL) {
+    ERROR("write_http plugin: strdup failed.");
+    return ENOMEM;
+  }
+
+  return wh_enqueue(cb, data, strlen(data));
 } /* }}} int wh_notify */
 
 static int config_set_format(wh_callback_t *cb, /* {{{ */
@@ -594,6 +1063,38 @@ static int config_set_format(wh_callback_t *cb, /* {{{ */
   return 0;
 } /* }}} int config_set_format */
 
+static int config_set_compression(wh_callback_t *cb, /* {{{ */
+                                  oconfig_item_t *ci) {
+  char *string = NULL;
+  int status;
+
+  status = cf_util_get_string(ci, &string);
+  if (status != 0)
+    return status;
+
+  if (strcasecmp("None", string) == 0)
+    cb->compression = WH_COMPRESS_NONE;
+  else if (strcasecmp("Gzip", string) == 0)
+    cb->compression = WH_COMPRESS_GZIP;
+  else if (strcasecmp("Deflate", string) == 0)
+    cb->compression = WH_COMPRESS_DEFLATE;
+  else {
+    ERROR("write_http plugin: Invalid compression: %s", string);
+    status = EINVAL;
+  }
+  sfree(string);
+
+#if !HAVE_LIBZ
+  if ((status == 0) && (cb->compression != WH_COMPRESS_NONE)) {
+    ERROR("write_http plugin: Compression is not supported because the "
+          "plugin has been built without zlib.");
+    status = EINVAL;
+  }
+#endif
+
+  return status;
+} /* }}} int config_set_compression */
+
 static int wh_config_append_string(const char *name,
                                    struct curl_slist **dest, /* {{{ */
                                    oconfig_item_t *ci) {
@@ -635,6 +1136,10 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   cb->send_metrics = 1;
   cb->send_notifications = 0;
   cb->data_ttl = 0;
+  cb->compression = WH_COMPRESS_NONE;
+  cb->connections_num = 1;
+  cb->queue_length = WRITE_HTTP_DEFAULT_QUEUE_LENGTH;
+  cb->max_retries = WRITE_HTTP_DEFAULT_MAX_RETRIES;
   cb->metrics_prefix = strdup(WRITE_HTTP_DEFAULT_PREFIX);
 
   if (cb->metrics_prefix == NULL) {
@@ -644,6 +1149,8 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   }
 
   pthread_mutex_init(&cb->send_lock, /* attr = */ NULL);
+  pthread_mutex_init(&cb->queue_lock, /* attr = */ NULL);
+  pthread_cond_init(&cb->queue_cond, /* attr = */ NULL);
 
   cf_util_get_string(ci, &cb->name);
 
@@ -755,6 +1262,14 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &cb->data_ttl);
     } else if (strcasecmp("Prefix", child->key) == 0) {
       status = cf_util_get_string(child, &cb->metrics_prefix);
+    } else if (strcasecmp("Compression", child->key) == 0) {
+      status = config_set_compression(cb, child);
+    } else if (strcasecmp("Connections", child->key) == 0) {
+      status = cf_util_get_int(child, &cb->connections_num);
+    } else if (strcasecmp("QueueLength", child->key) == 0) {
+      status = cf_util_get_int(child, &cb->queue_length);
+    } else if (strcasecmp("MaxRetries", child->key) == 0) {
+      status = cf_util_get_int(child, &cb->max_retries);
     } else {
       ERROR("write_http plugin: Invalid configuration "
             "option: %s.",
@@ -788,6 +1303,17 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   if (strlen(cb->metrics_prefix) == 0)
     sfree(cb->metrics_prefix);
 
+  if (cb->connections_num < 1) {
+    WARNING("write_http plugin: Connections must be at least 1.");
+    cb->connections_num = 1;
+  }
+  if (cb->queue_length < 1) {
+    WARNING("write_http plugin: QueueLength must be at least 1.");
+    cb->queue_length = 1;
+  }
+  if (cb->max_retries < 0)
+    cb->max_retries = 0;
+
   if (cb->low_speed_limit > 0)
     cb->low_speed_time = CDTIME_T_TO_TIME_T(plugin_get_interval());
 
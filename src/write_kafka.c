@@ -37,6 +37,22 @@
 #include <librdkafka/rdkafka.h>
 #include <stdint.h>
 
+/* How long to wait for outstanding messages to be delivered on shutdown. */
+#ifndef KAFKA_SHUTDOWN_TIMEOUT_MS
+#define KAFKA_SHUTDOWN_TIMEOUT_MS 10000
+#endif
+
+/* Value lists collected into one Kafka message. The buffer is handed over to
+ * librdkafka when the message is produced and allocated anew afterwards. */
+struct kafka_batch {
+  int32_t partition;
+  char *buffer;
+  size_t fill;
+  size_t free;
+  size_t values_num;
+  cdtime_t first_time;
+};
+
 struct kafka_topic_context {
 #define KAFKA_FORMAT_JSON 0
 #define KAFKA_FORMAT_COMMAND 1
@@ -53,6 +69,15 @@ struct kafka_topic_context {
   char *postfix;
   char escape_char;
   char *topic_name;
+
+  /* If batch_max_size is non-zero, many value lists are packed into each
+   * message. Value lists are assigned to one batch per partition by the hash
+   * of their identifier, so that the points of a series stay in order. */
+  size_t batch_max_size;
+  cdtime_t batch_timeout;
+  struct kafka_batch *batches;
+  size_t batches_num;
+
   pthread_mutex_t lock;
 };
 
@@ -114,6 +139,48 @@ static int32_t kafka_partition(const rd_kafka_topic_t *rkt, const void *keydata,
   return target;
 }
 
+/* Creates one batch per partition of the topic. If a key is configured, or
+ * the number of partitions cannot be determined, a single batch is used and
+ * the partitioner picks the partition. */
+static int kafka_batches_init(struct kafka_topic_context *ctx) /* {{{ */
+{
+  const struct rd_kafka_metadata *md = NULL;
+  size_t partitions_num = 0;
+
+  if (ctx->key == NULL) {
+    rd_kafka_resp_err_t err =
+        rd_kafka_metadata(ctx->kafka, /* all_topics = */ 0, ctx->topic, &md,
+                          /* timeout = */ 5000);
+    if (err != RD_KAFKA_RESP_ERR_NO_ERROR)
+      WARNING("write_kafka plugin: Fetching the partitions of topic \"%s\" "
+              "failed: %s. Batches will not be partitioned by series.",
+              ctx->topic_name, rd_kafka_err2str(err));
+    else if ((md->topic_cnt == 1) && (md->topics[0].partition_cnt > 0))
+      partitions_num = (size_t)md->topics[0].partition_cnt;
+
+    if (md != NULL)
+      rd_kafka_metadata_destroy(md);
+  }
+
+  ctx->batches = calloc((partitions_num > 0) ? partitions_num : 1,
+                        sizeof(*ctx->batches));
+  if (ctx->batches == NULL) {
+    ERROR("write_kafka plugin: calloc failed.");
+    return ENOMEM;
+  }
+
+  if (partitions_num == 0) {
+    ctx->batches[0].partition = RD_KAFKA_PARTITION_UA;
+    ctx->batches_num = 1;
+  } else {
+    for (size_t i = 0; i < partitions_num; i++)
+      ctx->batches[i].partition = (int32_t)i;
+    ctx->batches_num = partitions_num;
+  }
+
+  return 0;
+} /* }}} int kafka_batches_init */
+
 static int kafka_handle(struct kafka_topic_context *ctx) /* {{{ */
 {
   char errbuf[1024];
@@ -166,19 +233,220 @@ static int kafka_handle(struct kafka_topic_context *ctx) /* {{{ */
          rd_kafka_topic_name(ctx->topic));
   }
 
+  if ((ctx->batch_max_size > 0) && (ctx->batches == NULL))
+    return kafka_batches_init(ctx);
+
   return 0;
 
 } /* }}} int kafka_handle */
 
+/* Formats a single value list into `buffer' using the "Command" or "Graphite"
+ * format. Lines are terminated by a newline. */
+static int kafka_format_line(struct kafka_topic_context *ctx, /* {{{ */
+                             char *buffer, size_t buffer_size,
+                             const data_set_t *ds, const value_list_t *vl) {
+  int status;
+
+  if (ctx->format == KAFKA_FORMAT_COMMAND) {
+    status = cmd_create_putval(buffer, buffer_size, ds, vl);
+    if (status != 0) {
+      ERROR("write_kafka plugin: cmd_create_putval failed with status %i.",
+            status);
+      return status;
+    }
+    /* cmd_create_putval does not add a newline. */
+    if (ctx->batch_max_size > 0) {
+      size_t len = strlen(buffer);
+      if (len + 2 > buffer_size)
+        return -ENOMEM;
+      buffer[len] = '\n';
+      buffer[len + 1] = 0;
+    }
+  } else if (ctx->format == KAFKA_FORMAT_GRAPHITE) {
+    status = format_graphite(buffer, buffer_size, ds, vl, ctx->prefix,
+                             ctx->postfix, ctx->escape_char,
+                             ctx->graphite_flags);
+    if (status != 0) {
+      ERROR("write_kafka plugin: format_graphite failed with status %i.",
+            status);
+      return status;
+    }
+  } else {
+    ERROR("write_kafka plugin: invalid format %i.", ctx->format);
+    return -1;
+  }
+
+  return 0;
+} /* }}} int kafka_format_line */
+
+/* Produces the message collected in `b'. The buffer is passed to librdkafka,
+ * which frees it once the message has been delivered. Must hold ctx->lock. */
+static int kafka_batch_flush(struct kafka_topic_context *ctx, /* {{{ */
+                             struct kafka_batch *b) {
+  size_t keylen = (ctx->key != NULL) ? strlen(ctx->key) : 0;
+  int status = 0;
+
+  if ((b->buffer == NULL) || (b->values_num == 0))
+    return 0;
+
+  if (ctx->format == KAFKA_FORMAT_JSON)
+    format_json_finalize(b->buffer, &b->fill, &b->free);
+
+  if (rd_kafka_produce(ctx->topic, b->partition, RD_KAFKA_MSG_F_FREE,
+                       b->buffer, b->fill, ctx->key, keylen, NULL) != 0) {
+    ERROR("write_kafka plugin: Producing a message with %" PRIsz
+          " values failed: %s",
+          b->values_num, rd_kafka_err2str(kafka_error()));
+    /* The message has not been enqueued, so the buffer is still ours. */
+    sfree(b->buffer);
+    status = -1;
+  }
+
+  b->buffer = NULL;
+  b->fill = 0;
+  b->free = 0;
+  b->values_num = 0;
+  b->first_time = 0;
+
+  return status;
+} /* }}} int kafka_batch_flush */
+
+/* Flushes all batches older than `timeout'. A timeout of zero flushes all
+ * batches. Must hold ctx->lock. */
+static int kafka_flush_nolock(struct kafka_topic_context *ctx, /* {{{ */
+                              cdtime_t timeout) {
+  cdtime_t now = cdtime();
+  int status = 0;
+
+  for (size_t i = 0; i < ctx->batches_num; i++) {
+    struct kafka_batch *b = ctx->batches + i;
+
+    if (b->values_num == 0)
+      continue;
+    if ((timeout != 0) && ((now - b->first_time) < timeout))
+      continue;
+
+    if (kafka_batch_flush(ctx, b) != 0)
+      status = -1;
+  }
+
+  return status;
+} /* }}} int kafka_flush_nolock */
+
+/* Must hold ctx->lock. */
+static int kafka_batch_reset(struct kafka_topic_context *ctx, /* {{{ */
+                             struct kafka_batch *b) {
+  if (b->buffer != NULL)
+    return 0;
+
+  b->buffer = malloc(ctx->batch_max_size);
+  if (b->buffer == NULL) {
+    ERROR("write_kafka plugin: malloc failed.");
+    return ENOMEM;
+  }
+  b->fill = 0;
+  b->free = ctx->batch_max_size;
+  b->buffer[0] = 0;
+
+  if (ctx->format == KAFKA_FORMAT_JSON)
+    format_json_initialize(b->buffer, &b->fill, &b->free);
+
+  return 0;
+} /* }}} int kafka_batch_reset */
+
+/* Must hold ctx->lock. */
+static int kafka_batch_append(struct kafka_topic_context *ctx, /* {{{ */
+                              struct kafka_batch *b, const data_set_t *ds,
+                              const value_list_t *vl) {
+  char line[8192];
+  size_t len = 0;
+  int status;
+
+  if (ctx->format != KAFKA_FORMAT_JSON) {
+    status = kafka_format_line(ctx, line, sizeof(line), ds, vl);
+    if (status != 0)
+      return status;
+    len = strlen(line);
+  }
+
+  /* Try twice: if the value list does not fit, send the batch and start a new
+   * one. */
+  for (int i = 0; i < 2; i++) {
+    if (i > 0) {
+      if (b->values_num == 0)
+        break;
+      kafka_batch_flush(ctx, b);
+    }
+
+    status = kafka_batch_reset(ctx, b);
+    if (status != 0)
+      return status;
+
+    if (ctx->format == KAFKA_FORMAT_JSON) {
+      status = format_json_value_list(b->buffer, &b->fill, &b->free, ds, vl,
+                                      ctx->store_rates);
+    } else if (len < b->free) {
+      memcpy(b->buffer + b->fill, line, len + 1);
+      b->fill += len;
+      b->free -= len;
+      status = 0;
+    } else {
+      status = -ENOMEM;
+    }
+
+    if (status != -ENOMEM)
+      break;
+  }
+
+  if (status == -ENOMEM) {
+    ERROR("write_kafka plugin: A value list does not fit into BatchMaxSize "
+          "(%" PRIsz " bytes).",
+          ctx->batch_max_size);
+    return status;
+  } else if (status != 0) {
+    return status;
+  }
+
+  if (b->values_num == 0)
+    b->first_time = cdtime();
+  b->values_num++;
+
+  return 0;
+} /* }}} int kafka_batch_append */
+
+static int kafka_write_batched(struct kafka_topic_context *ctx, /* {{{ */
+                               const data_set_t *ds, const value_list_t *vl) {
+  struct kafka_batch *b = ctx->batches;
+  int status;
+
+  if (ctx->batches_num > 1) {
+    char ident[6 * DATA_MAX_NAME_LEN];
+
+    status = FORMAT_VL(ident, sizeof(ident), vl);
+    if (status != 0)
+      return status;
+    b = ctx->batches + (kafka_hash(ident, strlen(ident)) % ctx->batches_num);
+  }
+
+  status = kafka_batch_append(ctx, b, ds, vl);
+  if (status != 0)
+    return status;
+
+  /* The other batches are aged out by kafka_flush_aged(). */
+  if ((b->values_num > 0) && ((cdtime() - b->first_time) >= ctx->batch_timeout))
+    return kafka_batch_flush(ctx, b);
+
+  return 0;
+} /* }}} int kafka_write_batched */
+
 static int kafka_write(const data_set_t *ds, /* {{{ */
                        const value_list_t *vl, user_data_t *ud) {
   int status = 0;
-  void *key;
-  size_t keylen = 0;
+  const char *key;
+  char ident[6 * DATA_MAX_NAME_LEN];
   char buffer[8192];
   size_t bfree = sizeof(buffer);
   size_t bfill = 0;
-  size_t blen = 0;
   struct kafka_topic_context *ctx = ud->data;
 
   if ((ds == NULL) || (vl == NULL) || (ctx == NULL))
@@ -186,54 +454,83 @@ static int kafka_write(const data_set_t *ds, /* {{{ */
 
   pthread_mutex_lock(&ctx->lock);
   status = kafka_handle(ctx);
+  if ((status == 0) && (ctx->batches != NULL))
+    status = kafka_write_batched(ctx, ds, vl);
   pthread_mutex_unlock(&ctx->lock);
-  if (status != 0)
+  if ((status != 0) || (ctx->batch_max_size > 0))
     return status;
 
-  bzero(buffer, sizeof(buffer));
-
-  switch (ctx->format) {
-  case KAFKA_FORMAT_COMMAND:
-    status = cmd_create_putval(buffer, sizeof(buffer), ds, vl);
-    if (status != 0) {
-      ERROR("write_kafka plugin: cmd_create_putval failed with status %i.",
-            status);
-      return status;
-    }
-    blen = strlen(buffer);
-    break;
-  case KAFKA_FORMAT_JSON:
+  if (ctx->format == KAFKA_FORMAT_JSON) {
     format_json_initialize(buffer, &bfill, &bfree);
     format_json_value_list(buffer, &bfill, &bfree, ds, vl, ctx->store_rates);
     format_json_finalize(buffer, &bfill, &bfree);
-    blen = strlen(buffer);
-    break;
-  case KAFKA_FORMAT_GRAPHITE:
-    status =
-        format_graphite(buffer, sizeof(buffer), ds, vl, ctx->prefix,
-                        ctx->postfix, ctx->escape_char, ctx->graphite_flags);
-    if (status != 0) {
-      ERROR("write_kafka plugin: format_graphite failed with status %i.",
-            status);
+  } else {
+    status = kafka_format_line(ctx, buffer, sizeof(buffer), ds, vl);
+    if (status != 0)
       return status;
-    }
-    blen = strlen(buffer);
-    break;
-  default:
-    ERROR("write_kafka plugin: invalid format %i.", ctx->format);
-    return -1;
   }
 
-  key =
-      (ctx->key != NULL) ? ctx->key : kafka_random_key(KAFKA_RANDOM_KEY_BUFFER);
-  keylen = strlen(key);
+  /* Without a configured key, the identifier is used so that all points of a
+   * series end up in the same partition. */
+  key = ctx->key;
+  if (key == NULL) {
+    status = FORMAT_VL(ident, sizeof(ident), vl);
+    if (status != 0)
+      return status;
+    key = ident;
+  }
 
   rd_kafka_produce(ctx->topic, RD_KAFKA_PARTITION_UA, RD_KAFKA_MSG_F_COPY,
-                   buffer, blen, key, keylen, NULL);
+                   buffer, strlen(buffer), (void *)key, strlen(key), NULL);
 
   return status;
 } /* }}} int kafka_write */
 
+static int kafka_flush(cdtime_t timeout, /* {{{ */
+                       __attribute__((unused)) const char *identifier,
+                       user_data_t *ud) {
+  struct kafka_topic_context *ctx = ud->data;
+  int status;
+
+  pthread_mutex_lock(&ctx->lock);
+  status = kafka_flush_nolock(ctx, timeout);
+  pthread_mutex_unlock(&ctx->lock);
+
+  return status;
+} /* }}} int kafka_flush */
+
+/* Sends the batches older than BatchFlushTimeout, even if no further values
+ * are written. Registered as a read callback running every
+ * BatchFlushTimeout. */
+static int kafka_flush_aged(user_data_t *ud) /* {{{ */
+{
+  struct kafka_topic_context *ctx = ud->data;
+
+  /* A timeout of zero would send all batches. */
+  if (ctx->batch_timeout == 0)
+    return 0;
+
+  return kafka_flush(ctx->batch_timeout, /* identifier = */ NULL, ud);
+} /* }}} int kafka_flush_aged */
+
+/* Waits until librdkafka has delivered the produced messages, so that the
+ * last batches are not lost when the handle is destroyed. */
+static void kafka_drain(rd_kafka_t *kafka) /* {{{ */
+{
+#ifdef HAVE_LIBRDKAFKA_FLUSH
+  rd_kafka_flush(kafka, KAFKA_SHUTDOWN_TIMEOUT_MS);
+#else
+  cdtime_t end = cdtime() + MS_TO_CDTIME_T(KAFKA_SHUTDOWN_TIMEOUT_MS);
+  while ((rd_kafka_outq_len(kafka) > 0) && (cdtime() < end))
+    rd_kafka_poll(kafka, /* timeout_ms = */ 100);
+#endif
+
+  if (rd_kafka_outq_len(kafka) > 0)
+    WARNING("write_kafka plugin: %d messages have not been delivered "
+            "before shutting down.",
+            rd_kafka_outq_len(kafka));
+} /* }}} void kafka_drain */
+
 static void kafka_topic_context_free(void *p) /* {{{ */
 {
   struct kafka_topic_context *ctx = p;
@@ -241,6 +538,14 @@ static void kafka_topic_context_free(void *p) /* {{{ */
   if (ctx == NULL)
     return;
 
+  if (ctx->batches != NULL) {
+    if (ctx->topic != NULL)
+      kafka_flush_nolock(ctx, /* timeout = */ 0);
+    for (size_t i = 0; i < ctx->batches_num; i++)
+      sfree(ctx->batches[i].buffer);
+    sfree(ctx->batches);
+  }
+
   if (ctx->topic_name != NULL)
     sfree(ctx->topic_name);
   if (ctx->topic != NULL)
@@ -249,8 +554,10 @@ static void kafka_topic_context_free(void *p) /* {{{ */
     rd_kafka_topic_conf_destroy(ctx->conf);
   if (ctx->kafka_conf != NULL)
     rd_kafka_conf_destroy(ctx->kafka_conf);
-  if (ctx->kafka != NULL)
+  if (ctx->kafka != NULL) {
+    kafka_drain(ctx->kafka);
     rd_kafka_destroy(ctx->kafka);
+  }
 
   sfree(ctx);
 } /* }}} void kafka_topic_context_free */
@@ -276,6 +583,7 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
   tctx->store_rates = 1;
   tctx->format = KAFKA_FORMAT_JSON;
   tctx->key = NULL;
+  tctx->batch_timeout = plugin_get_interval();
 
   if ((tctx->kafka_conf = rd_kafka_conf_dup(conf)) == NULL) {
     sfree(tctx);
@@ -387,6 +695,17 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
       status = cf_util_get_string(child, &tctx->prefix);
     } else if (strcasecmp("GraphitePostfix", child->key) == 0) {
       status = cf_util_get_string(child, &tctx->postfix);
+    } else if (strcasecmp("BatchMaxSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 0)) {
+        WARNING("write_kafka plugin: BatchMaxSize must not be negative.");
+        status = -1;
+      } else if (status == 0) {
+        tctx->batch_max_size = (size_t)tmp;
+      }
+    } else if (strcasecmp("BatchFlushTimeout", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &tctx->batch_timeout);
     } else if (strcasecmp("GraphiteEscapeChar", child->key) == 0) {
       char *tmp_buff = NULL;
       status = cf_util_get_string(child, &tmp_buff);
@@ -409,6 +728,8 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
   snprintf(callback_name, sizeof(callback_name), "write_kafka/%s",
            tctx->topic_name);
 
+  pthread_mutex_init(&tctx->lock, /* attr = */ NULL);
+
   status = plugin_register_write(
       callback_name, kafka_write,
       &(user_data_t){
@@ -421,7 +742,15 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
     goto errout;
   }
 
-  pthread_mutex_init(&tctx->lock, /* attr = */ NULL);
+  /* The write callback owns the context. The flush and read callbacks only
+   * borrow it; both are destroyed before the write callbacks. */
+  if (tctx->batch_max_size > 0) {
+    plugin_register_flush(callback_name, kafka_flush,
+                          &(user_data_t){.data = tctx});
+    plugin_register_complex_read(/* group = */ "write_kafka", callback_name,
+                                 kafka_flush_aged, tctx->batch_timeout,
+                                 &(user_data_t){.data = tctx});
+  }
 
   return;
 errout:
@@ -34,10 +34,26 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 #include "utils_cache.h"
 
 #include <mongoc.h>
 
+#ifndef WM_DEFAULT_BATCH_SIZE
+#define WM_DEFAULT_BATCH_SIZE 256
+#endif
+
+/* Collection handle and pending inserts for one plugin, i.e. one collection.
+ * Handles are kept for as long as the client exists. */
+struct wm_collection_s {
+  char *name;
+  mongoc_collection_t *collection;
+  mongoc_bulk_operation_t *bulk;
+  size_t docs_num;
+  cdtime_t first_time;
+};
+typedef struct wm_collection_s wm_collection_t;
+
 struct wm_node_s {
   char name[DATA_MAX_NAME_LEN];
 
@@ -53,8 +69,15 @@ struct wm_node_s {
   _Bool store_rates;
   _Bool connected;
 
+  /* Documents are buffered in unordered bulk operations and sent once
+   * batch_size documents are buffered for a collection or the oldest one is
+   * older than batch_timeout. */
+  int batch_size;
+  cdtime_t batch_timeout;
+
   mongoc_client_t *client;
   mongoc_database_t *database;
+  c_avl_tree_t *collections;
   pthread_mutex_t lock;
 };
 typedef struct wm_node_s wm_node_t;
@@ -218,13 +241,137 @@ static int wm_initialize(wm_node_t *node) /* {{{ */
   return 0;
 } /* }}} int wm_initialize */
 
+static void wm_collection_destroy(wm_collection_t *c) /* {{{ */
+{
+  if (c == NULL)
+    return;
+
+  if (c->bulk != NULL)
+    mongoc_bulk_operation_destroy(c->bulk);
+  if (c->collection != NULL)
+    mongoc_collection_destroy(c->collection);
+  sfree(c->name);
+  sfree(c);
+} /* }}} void wm_collection_destroy */
+
+/* Returns the cached handle for the collection `name', creating it if
+ * necessary. Must hold node->lock. */
+static wm_collection_t *wm_collection_get(wm_node_t *node, /* {{{ */
+                                          const char *name) {
+  wm_collection_t *c = NULL;
+
+  if (c_avl_get(node->collections, name, (void *)&c) == 0)
+    return c;
+
+  c = calloc(1, sizeof(*c));
+  if (c == NULL)
+    return NULL;
+
+  c->name = strdup(name);
+  c->collection = mongoc_client_get_collection(node->client, "collectd", name);
+  if ((c->name == NULL) || (c->collection == NULL)) {
+    ERROR("write_mongodb plugin: error creating/getting collection \"%s\"",
+          name);
+    wm_collection_destroy(c);
+    return NULL;
+  }
+
+  if (c_avl_insert(node->collections, c->name, c) != 0) {
+    wm_collection_destroy(c);
+    return NULL;
+  }
+
+  return c;
+} /* }}} wm_collection_t *wm_collection_get */
+
+/* Sends the documents buffered for collection `c'. A failed bulk operation
+ * only loses its own documents; the client reconnects by itself, so the
+ * connection is not torn down. Must hold node->lock. */
+static int wm_collection_flush(wm_node_t *node, /* {{{ */
+                               wm_collection_t *c) {
+  bson_error_t error;
+  bson_t reply;
+  uint32_t status;
+
+  if ((c->bulk == NULL) || (c->docs_num == 0))
+    return 0;
+
+  status = mongoc_bulk_operation_execute(c->bulk, &reply, &error);
+  if (status == 0)
+    ERROR("write_mongodb plugin: Node \"%s\": inserting %" PRIsz
+          " records into \"%s\" failed: %s",
+          node->name, c->docs_num, c->name, error.message);
+
+  bson_destroy(&reply);
+
+  /* Bulk operations can only be executed once. */
+  mongoc_bulk_operation_destroy(c->bulk);
+  c->bulk = NULL;
+  c->docs_num = 0;
+  c->first_time = 0;
+
+  return (status == 0) ? -1 : 0;
+} /* }}} int wm_collection_flush */
+
+/* Flushes all collections whose oldest document is older than `timeout'. A
+ * timeout of zero flushes all collections. Must hold node->lock. */
+static int wm_flush_nolock(wm_node_t *node, cdtime_t timeout) /* {{{ */
+{
+  c_avl_iterator_t *iter;
+  wm_collection_t *c;
+  char *name;
+  cdtime_t now;
+  int status = 0;
+
+  if (node->collections == NULL)
+    return 0;
+
+  now = cdtime();
+  iter = c_avl_get_iterator(node->collections);
+  while (c_avl_iterator_next(iter, (void *)&name, (void *)&c) == 0) {
+    if (c->docs_num == 0)
+      continue;
+    if ((timeout != 0) && ((now - c->first_time) < timeout))
+      continue;
+
+    if (wm_collection_flush(node, c) != 0)
+      status = -1;
+  }
+  c_avl_iterator_destroy(iter);
+
+  return status;
+} /* }}} int wm_flush_nolock */
+
+/* Adds `doc' to the bulk operation of collection `c'. Must hold node->lock. */
+static int wm_collection_insert(wm_node_t *node, /* {{{ */
+                                wm_collection_t *c, const bson_t *doc) {
+#ifdef HAVE_LIBMONGOC_INSERT_WITH_OPTS
+  bson_error_t error;
+
+  /* A rejected document leaves the bulk operation and the documents already
+   * buffered in it intact. */
+  if (!mongoc_bulk_operation_insert_with_opts(c->bulk, doc, /* opts = */ NULL,
+                                              &error)) {
+    ERROR("write_mongodb plugin: Node \"%s\": adding a record to the bulk "
+          "operation for \"%s\" failed: %s",
+          node->name, c->name, error.message);
+    return -1;
+  }
+#else
+  /* Older versions of libmongoc report a rejected document only when the bulk
+   * operation is executed. */
+  mongoc_bulk_operation_insert(c->bulk, doc);
+#endif
+
+  return 0;
+} /* }}} int wm_collection_insert */
+
 static int wm_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wm_node_t *node = ud->data;
-  mongoc_collection_t *collection = NULL;
+  wm_collection_t *c;
   bson_t *bson_record;
-  bson_error_t error;
-  int status;
+  int status = 0;
 
   bson_record = wm_create_bson(ds, vl, node->store_rates);
   if (!bson_record) {
@@ -240,46 +387,72 @@ static int wm_write(const data_set_t *ds, /* {{{ */
     return -1;
   }
 
-  collection =
-      mongoc_client_get_collection(node->client, "collectd", vl->plugin);
-  if (!collection) {
-    ERROR("write_mongodb plugin: error creating/getting collection");
-    mongoc_database_destroy(node->database);
-    mongoc_client_destroy(node->client);
-    node->database = NULL;
-    node->client = NULL;
-    node->connected = 0;
+  c = wm_collection_get(node, vl->plugin);
+  if (c == NULL) {
     pthread_mutex_unlock(&node->lock);
     bson_destroy(bson_record);
     return -1;
   }
 
-  status = mongoc_collection_insert(collection, MONGOC_INSERT_NONE, bson_record,
-                                    NULL, &error);
+  if (c->bulk == NULL) {
+    c->bulk = mongoc_collection_create_bulk_operation(
+        c->collection, /* ordered = */ false, /* write_concern = */ NULL);
+    if (c->bulk == NULL) {
+      ERROR("write_mongodb plugin: error creating bulk operation");
+      pthread_mutex_unlock(&node->lock);
+      bson_destroy(bson_record);
+      return -1;
+    }
+  }
 
-  if (!status) {
-    ERROR("write_mongodb plugin: error inserting record: %s", error.message);
-    mongoc_database_destroy(node->database);
-    mongoc_client_destroy(node->client);
-    node->database = NULL;
-    node->client = NULL;
-    node->connected = 0;
+  /* The document is copied into the bulk operation. */
+  if (wm_collection_insert(node, c, bson_record) != 0) {
     pthread_mutex_unlock(&node->lock);
     bson_destroy(bson_record);
-    mongoc_collection_destroy(collection);
     return -1;
   }
+  bson_destroy(bson_record);
 
-  /* free our resource as not to leak memory */
-  mongoc_collection_destroy(collection);
+  if (c->docs_num == 0)
+    c->first_time = cdtime();
+  c->docs_num++;
 
-  pthread_mutex_unlock(&node->lock);
+  /* The other collections are aged out by wm_flush_aged(). */
+  if ((c->docs_num >= (size_t)node->batch_size) ||
+      ((cdtime() - c->first_time) >= node->batch_timeout))
+    status = wm_collection_flush(node, c);
 
-  bson_destroy(bson_record);
+  pthread_mutex_unlock(&node->lock);
 
-  return 0;
+  return status;
 } /* }}} int wm_write */
 
+static int wm_flush(cdtime_t timeout, /* {{{ */
+                    __attribute__((unused)) const char *identifier,
+                    user_data_t *ud) {
+  wm_node_t *node = ud->data;
+  int status;
+
+  pthread_mutex_lock(&node->lock);
+  status = wm_flush_nolock(node, timeout);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wm_flush */
+
+/* Read callback sending the documents of collections that have not been
+ * written to for BatchFlushTimeout. */
+static int wm_flush_aged(user_data_t *ud) /* {{{ */
+{
+  wm_node_t *node = ud->data;
+
+  /* A timeout of zero would flush all collections. */
+  if (node->batch_timeout == 0)
+    return 0;
+
+  return wm_flush(node->batch_timeout, /* identifier = */ NULL, ud);
+} /* }}} int wm_flush_aged */
+
 static void wm_config_free(void *ptr) /* {{{ */
 {
   wm_node_t *node = ptr;
@@ -287,6 +460,17 @@ static void wm_config_free(void *ptr) /* {{{ */
   if (node == NULL)
     return;
 
+  if (node->collections != NULL) {
+    wm_collection_t *c;
+    char *name;
+
+    wm_flush_nolock(node, /* timeout = */ 0);
+    while (c_avl_pick(node->collections, (void *)&name, (void *)&c) == 0)
+      wm_collection_destroy(c);
+    c_avl_destroy(node->collections);
+    node->collections = NULL;
+  }
+
   mongoc_database_destroy(node->database);
   mongoc_client_destroy(node->client);
   node->database = NULL;
@@ -313,13 +497,21 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
   }
   node->port = MONGOC_DEFAULT_PORT;
   node->store_rates = 1;
+  node->batch_size = WM_DEFAULT_BATCH_SIZE;
+  node->batch_timeout = plugin_get_interval();
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
+  node->collections =
+      c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (node->collections == NULL) {
+    wm_config_free(node);
+    return ENOMEM;
+  }
+
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
 
   if (status != 0) {
-    sfree(node->host);
-    sfree(node);
+    wm_config_free(node);
     return status;
   }
 
@@ -344,6 +536,15 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_string(child, &node->user);
     else if (strcasecmp("Password", child->key) == 0)
       status = cf_util_get_string(child, &node->passwd);
+    else if (strcasecmp("BatchSize", child->key) == 0) {
+      status = cf_util_get_int(child, &node->batch_size);
+      if ((status == 0) && (node->batch_size < 1)) {
+        WARNING("write_mongodb plugin: BatchSize must be positive, "
+                "setting it to 1.");
+        node->batch_size = 1;
+      }
+    } else if (strcasecmp("BatchFlushTimeout", child->key) == 0)
+      status = cf_util_get_cdtime(child, &node->batch_timeout);
     else
       WARNING("write_mongodb plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -377,6 +578,15 @@ static int wm_config_node(oconfig_item_t *ci) /* {{{ */
                               });
     INFO("write_mongodb plugin: registered write plugin %s %d", cb_name,
          status);
+
+    /* The write callback owns the node. The flush and read callbacks only
+     * borrow it; both are destroyed before the write callbacks. */
+    if (status == 0) {
+      plugin_register_flush(cb_name, wm_flush, &(user_data_t){.data = node});
+      plugin_register_complex_read(/* group = */ "write_mongodb", cb_name,
+                                   wm_flush_aged, node->batch_timeout,
+                                   &(user_data_t){.data = node});
+    }
   }
 
   if (status != 0)
@@ -28,6 +28,8 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
+#include "utils_cache.h"
 
 #include <hiredis/hiredis.h>
 #include <sys/time.h>
@@ -36,6 +38,10 @@
 #define REDIS_DEFAULT_PREFIX "collectd/"
 #endif
 
+#ifndef REDIS_DEFAULT_BATCH_SIZE
+#define REDIS_DEFAULT_BATCH_SIZE 512
+#endif
+
 struct wr_node_s {
   char name[DATA_MAX_NAME_LEN];
 
@@ -47,15 +53,185 @@ struct wr_node_s {
   int max_set_size;
   int max_set_duration;
   _Bool store_rates;
+  int batch_size;
+  cdtime_t trim_interval;
+
+  /* Meta data key used to remember in the value cache which identifiers have
+   * already been added to the "values" set. */
+  char registry_key[sizeof("write_redis/") + DATA_MAX_NAME_LEN];
 
   redisContext *conn;
   pthread_mutex_t lock;
+
+  /* One entry per command appended to the connection's output buffer whose
+   * reply has not been read yet. Entries belonging to SADD commands hold the
+   * registered identifier, all others are NULL. */
+  char **pending;
+  size_t pending_num;
+  size_t pending_size;
+
+  /* Keys written to since the last trim. */
+  c_avl_tree_t *dirty_keys;
 };
 typedef struct wr_node_s wr_node_t;
 
 /*
  * Functions
  */
+static const char *wr_prefix(const wr_node_t *node) /* {{{ */
+{
+  return (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX;
+} /* }}} const char *wr_prefix */
+
+/* Must hold node->lock. */
+static int wr_connect(wr_node_t *node) /* {{{ */
+{
+  redisReply *rr;
+
+  if (node->conn != NULL)
+    return 0;
+
+  node->conn =
+      redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
+  if (node->conn == NULL) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
+          "Unknown reason",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379);
+    return -1;
+  } else if (node->conn->err) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379, node->conn->errstr);
+    redisFree(node->conn);
+    node->conn = NULL;
+    return -1;
+  }
+
+  rr = redisCommand(node->conn, "SELECT %d", node->database);
+  if (rr == NULL)
+    WARNING("SELECT command error. database:%d message:%s", node->database,
+            node->conn->errstr);
+  else
+    freeReplyObject(rr);
+
+  return 0;
+} /* }}} int wr_connect */
+
+/* Removes the registration of `ident' from the value cache, so that the SADD
+ * command is sent again with the next value. */
+static void wr_forget_series(wr_node_t *node, const char *ident) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+
+  if (parse_identifier_vl(ident, &vl) != 0)
+    return;
+
+  uc_meta_data_delete(&vl, node->registry_key);
+} /* }}} void wr_forget_series */
+
+/* Makes room for recording `num' more commands. Called before appending
+ * commands, so that every appended command can be recorded: a command
+ * without an entry would shift all following replies. Must hold node->lock. */
+static int wr_pending_reserve(wr_node_t *node, size_t num) /* {{{ */
+{
+  if (node->pending_num + num <= node->pending_size)
+    return 0;
+
+  size_t new_size = (node->pending_size == 0) ? 64 : 2 * node->pending_size;
+  while (new_size < node->pending_num + num)
+    new_size *= 2;
+
+  char **tmp = realloc(node->pending, new_size * sizeof(*tmp));
+  if (tmp == NULL) {
+    ERROR("write_redis plugin: Node \"%s\": realloc failed.", node->name);
+    return ENOMEM;
+  }
+  node->pending = tmp;
+  node->pending_size = new_size;
+  return 0;
+} /* }}} int wr_pending_reserve */
+
+/* Records a command appended to the output buffer. Takes ownership of
+ * `ident'. Room must have been made with wr_pending_reserve(). Must hold
+ * node->lock. */
+static void wr_pending_add(wr_node_t *node, char *ident) /* {{{ */
+{
+  assert(node->pending_num < node->pending_size);
+
+  node->pending[node->pending_num] = ident;
+  node->pending_num++;
+} /* }}} void wr_pending_add */
+
+/* Sends all appended commands and reads their replies. If the connection
+ * fails, the remaining replies are discarded and the connection is closed; it
+ * is re-established with the next write. Must hold node->lock. */
+static int wr_flush_pending(wr_node_t *node) /* {{{ */
+{
+  size_t failed = 0;
+  int status = 0;
+
+  for (size_t i = 0; i < node->pending_num; i++) {
+    char *ident = node->pending[i];
+    redisReply *rr = NULL;
+
+    node->pending[i] = NULL;
+
+    if ((node->conn == NULL) ||
+        (redisGetReply(node->conn, (void **)&rr) != REDIS_OK)) {
+      if (node->conn != NULL) {
+        ERROR("write_redis plugin: Node \"%s\": Sending commands failed: %s",
+              node->name, node->conn->errstr);
+        redisFree(node->conn);
+        node->conn = NULL;
+      }
+      if (ident != NULL)
+        wr_forget_series(node, ident);
+      sfree(ident);
+      failed++;
+      status = -1;
+      continue;
+    }
+
+    if (rr->type == REDIS_REPLY_ERROR) {
+      WARNING("write_redis plugin: Node \"%s\": Command failed: %s", node->name,
+              rr->str);
+      if (ident != NULL)
+        wr_forget_series(node, ident);
+      failed++;
+    }
+
+    freeReplyObject(rr);
+    sfree(ident);
+  }
+
+  if (failed > 0)
+    WARNING("write_redis plugin: Node \"%s\": %zu of %zu commands failed.",
+            node->name, failed, node->pending_num);
+
+  node->pending_num = 0;
+  return status;
+} /* }}} int wr_flush_pending */
+
+/* Must hold node->lock. */
+static void wr_mark_dirty(wr_node_t *node, const char *key) /* {{{ */
+{
+  char *key_copy;
+
+  if ((node->max_set_size < 0) && (node->max_set_duration <= 0))
+    return;
+
+  if (c_avl_get(node->dirty_keys, key, NULL) == 0)
+    return;
+
+  key_copy = strdup(key);
+  if (key_copy == NULL)
+    return;
+
+  if (c_avl_insert(node->dirty_keys, key_copy, NULL) != 0)
+    sfree(key_copy);
+} /* }}} void wr_mark_dirty */
+
 static int wr_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wr_node_t *node = ud->data;
@@ -66,13 +242,11 @@ static int wr_write(const data_set_t *ds, /* {{{ */
   size_t value_size;
   char *value_ptr;
   int status;
-  redisReply *rr;
 
   status = FORMAT_VL(ident, sizeof(ident), vl);
   if (status != 0)
     return status;
-  snprintf(key, sizeof(key), "%s%s",
-           (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX, ident);
+  snprintf(key, sizeof(key), "%s%s", wr_prefix(node), ident);
   snprintf(time, sizeof(time), "%.9f", CDTIME_T_TO_DOUBLE(vl->time));
 
   value_size = sizeof(value);
@@ -83,93 +257,147 @@ static int wr_write(const data_set_t *ds, /* {{{ */
 
   pthread_mutex_lock(&node->lock);
 
-  if (node->conn == NULL) {
-    node->conn =
-        redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
-    if (node->conn == NULL) {
-      ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
-            "Unknown reason",
-            (node->host != NULL) ? node->host : "localhost",
-            (node->port != 0) ? node->port : 6379);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    } else if (node->conn->err) {
-      ERROR(
-          "write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
-          (node->host != NULL) ? node->host : "localhost",
-          (node->port != 0) ? node->port : 6379, node->conn->errstr);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    }
+  if (wr_connect(node) != 0) {
+    pthread_mutex_unlock(&node->lock);
+    return -1;
+  }
 
-    rr = redisCommand(node->conn, "SELECT %d", node->database);
-    if (rr == NULL)
-      WARNING("SELECT command error. database:%d message:%s", node->database,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+  /* ZADD and possibly SADD. */
+  if (wr_pending_reserve(node, 2) != 0) {
+    pthread_mutex_unlock(&node->lock);
+    return ENOMEM;
   }
 
-  rr = redisCommand(node->conn, "ZADD %s %s %s", key, time, value);
-  if (rr == NULL)
+  if (redisAppendCommand(node->conn, "ZADD %s %s %s", key, time, value) !=
+      REDIS_OK) {
     WARNING("ZADD command error. key:%s message:%s", key, node->conn->errstr);
-  else
-    freeReplyObject(rr);
-
-  if (node->max_set_size >= 0) {
-    rr = redisCommand(node->conn, "ZREMRANGEBYRANK %s %d %d", key, 0,
-                      (-1 * node->max_set_size) - 1);
-    if (rr == NULL)
-      WARNING("ZREMRANGEBYRANK command error. key:%s message:%s", key,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+    pthread_mutex_unlock(&node->lock);
+    return -1;
   }
-
-  if (node->max_set_duration > 0) {
-    /*
-     * remove element, scored less than 'current-max_set_duration'
-     * '(%d' indicates 'less than' in redis CLI.
-     */
-    rr = redisCommand(node->conn, "ZREMRANGEBYSCORE %s -1 (%d", key,
-                      (time - node->max_set_duration) + 1);
-    if (rr == NULL)
-      WARNING("ZREMRANGEBYSCORE command error. key:%s message:%s", key,
+  wr_pending_add(node, NULL);
+  wr_mark_dirty(node, key);
+
+  /* The identifier only needs to be added to the set once. The registration
+   * is undone in wr_flush_pending() if the command fails. */
+  if (uc_meta_data_exists(vl, node->registry_key) <= 0) {
+    char *ident_copy = strdup(ident);
+
+    if ((ident_copy != NULL) &&
+        (redisAppendCommand(node->conn, "SADD %svalues %s", wr_prefix(node),
+                            ident) == REDIS_OK)) {
+      uc_meta_data_add_boolean(vl, node->registry_key, 1);
+      wr_pending_add(node, ident_copy);
+    } else {
+      WARNING("SADD command error. ident:%s message:%s", ident,
               node->conn->errstr);
-    else
-      freeReplyObject(rr);
+      sfree(ident_copy);
+    }
   }
 
-  /* TODO(octo): This is more overhead than necessary. Use the cache and
-   * metadata to determine if it is a new metric and call SADD only once for
-   * each metric. */
-  rr = redisCommand(
-      node->conn, "SADD %svalues %s",
-      (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX, ident);
-  if (rr == NULL)
-    WARNING("SADD command error. ident:%s message:%s", ident,
-            node->conn->errstr);
-  else
-    freeReplyObject(rr);
+  if (node->pending_num >= (size_t)node->batch_size)
+    status = wr_flush_pending(node);
 
   pthread_mutex_unlock(&node->lock);
 
-  return 0;
+  return status;
 } /* }}} int wr_write */
 
+static int wr_flush(__attribute__((unused)) cdtime_t timeout, /* {{{ */
+                    __attribute__((unused)) const char *identifier,
+                    user_data_t *ud) {
+  wr_node_t *node = ud->data;
+  int status;
+
+  pthread_mutex_lock(&node->lock);
+  status = wr_flush_pending(node);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wr_flush */
+
+/* Sends outstanding writes and trims the sorted sets written to since the
+ * previous run. Registered as a read callback running every TrimInterval. */
+static int wr_trim(user_data_t *ud) /* {{{ */
+{
+  wr_node_t *node = ud->data;
+  char min_score[32];
+  char *key;
+  void *unused;
+  int status;
+
+  pthread_mutex_lock(&node->lock);
+
+  status = wr_flush_pending(node);
+  if ((status != 0) || (c_avl_size(node->dirty_keys) == 0)) {
+    pthread_mutex_unlock(&node->lock);
+    return status;
+  }
+
+  if (wr_connect(node) != 0) {
+    pthread_mutex_unlock(&node->lock);
+    return -1;
+  }
+
+  /* '(' makes the upper limit exclusive, i.e. only elements scored less than
+   * 'now - MaxSetDuration' are removed. */
+  snprintf(min_score, sizeof(min_score), "(%.9f",
+           CDTIME_T_TO_DOUBLE(cdtime()) - (double)node->max_set_duration);
+
+  while (c_avl_pick(node->dirty_keys, (void *)&key, &unused) == 0) {
+    /* Keep the key for the next run if no command can be recorded. */
+    if (wr_pending_reserve(node, 2) != 0) {
+      if (c_avl_insert(node->dirty_keys, key, NULL) != 0)
+        sfree(key);
+      break;
+    }
+
+    if ((node->max_set_size >= 0) &&
+        (redisAppendCommand(node->conn, "ZREMRANGEBYRANK %s %d %d", key, 0,
+                            (-1 * node->max_set_size) - 1) == REDIS_OK))
+      wr_pending_add(node, NULL);
+
+    if ((node->max_set_duration > 0) &&
+        (redisAppendCommand(node->conn, "ZREMRANGEBYSCORE %s -inf %s", key,
+                            min_score) == REDIS_OK))
+      wr_pending_add(node, NULL);
+
+    sfree(key);
+  }
+
+  status = wr_flush_pending(node);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wr_trim */
+
 static void wr_config_free(void *ptr) /* {{{ */
 {
   wr_node_t *node = ptr;
+  char *key;
+  void *unused;
 
   if (node == NULL)
     return;
 
+  pthread_mutex_lock(&node->lock);
+  wr_flush_pending(node);
+  pthread_mutex_unlock(&node->lock);
+
   if (node->conn != NULL) {
     redisFree(node->conn);
     node->conn = NULL;
   }
 
+  if (node->dirty_keys != NULL) {
+    while (c_avl_pick(node->dirty_keys, (void *)&key, &unused) == 0)
+      sfree(key);
+    c_avl_destroy(node->dirty_keys);
+  }
+
+  sfree(node->pending);
   sfree(node->host);
+  sfree(node->prefix);
+  pthread_mutex_destroy(&node->lock);
   sfree(node);
 } /* }}} void wr_config_free */
 
@@ -192,11 +420,20 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
   node->max_set_size = -1;
   node->max_set_duration = -1;
   node->store_rates = 1;
+  node->batch_size = REDIS_DEFAULT_BATCH_SIZE;
+  node->trim_interval = 0;
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
+  node->dirty_keys =
+      c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (node->dirty_keys == NULL) {
+    wr_config_free(node);
+    return ENOMEM;
+  }
+
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
   if (status != 0) {
-    sfree(node);
+    wr_config_free(node);
     return status;
   }
 
@@ -225,6 +462,15 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &node->max_set_duration);
     } else if (strcasecmp("StoreRates", child->key) == 0) {
       status = cf_util_get_boolean(child, &node->store_rates);
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      status = cf_util_get_int(child, &node->batch_size);
+      if ((status == 0) && (node->batch_size < 1)) {
+        WARNING("write_redis plugin: BatchSize must be positive, "
+                "setting it to 1.");
+        node->batch_size = 1;
+      }
+    } else if (strcasecmp("TrimInterval", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &node->trim_interval);
     } else
       WARNING("write_redis plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -237,17 +483,25 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
     char cb_name[sizeof("write_redis/") + DATA_MAX_NAME_LEN];
 
     snprintf(cb_name, sizeof(cb_name), "write_redis/%s", node->name);
+    sstrncpy(node->registry_key, cb_name, sizeof(node->registry_key));
 
+    /* The write callback owns the node. The flush and read callbacks only
+     * borrow it; both are destroyed before the write callbacks. */
     status =
         plugin_register_write(cb_name, wr_write,
                               &(user_data_t){
                                   .data = node, .free_func = wr_config_free,
                               });
+    if (status == 0) {
+      plugin_register_flush(cb_name, wr_flush, &(user_data_t){.data = node});
+      plugin_register_complex_read(/* group = */ "write_redis", cb_name,
+                                   wr_trim, node->trim_interval,
+                                   &(user_data_t){.data = node});
+      return 0;
+    }
   }
 
-  if (status != 0)
-    wr_config_free(node);
-
+  wr_config_free(node);
   return status;
 } /* }}} int wr_config_node */
 
@@ -29,7 +29,7 @@
 
 #include "common.h"
 #include "plugin.h"
-#include "utils_avltree.h"
+#include "utils_btree.h"
 #include "utils_cache.h"
 #include "utils_threshold.h"
 #include "write_riemann_threshold.h"